@@ -19,6 +19,8 @@ Copyright Glare Technologies Limited 2021 -
 #include <utils/MemMappedFile.h>
 #include <utils/FileInStream.h>
 #include <utils/RuntimeCheck.h>
+#include <utils/Timer.h>
+#include <utils/Lock.h>
 
 
 namespace glare
@@ -27,7 +29,7 @@ namespace glare
 
 AudioSource::AudioSource()
 :	resonance_handle(0), cur_read_i(0), type(SourceType_Looping), spatial_type(SourceSpatialType_Spatial), remove_on_finish(true), volume(1.f), mute_volume_factor(1.f), mute_change_start_time(-2), mute_change_end_time(-1), mute_vol_fac_start(1.f),
-	mute_vol_fac_end(1.f), pos(0,0,0,1), num_occlusions(0), userdata_1(0), doppler_factor(1), smoothed_cur_level(0), sampling_rate(44100)
+	mute_vol_fac_end(1.f), pos(0,0,0,1), num_occlusions(0), userdata_1(0), doppler_factor(1), smoothed_cur_level(0), sampling_rate(44100), max_buffered_samples(0), requested_sampling_rate(0)
 {}
 
 
@@ -126,7 +128,12 @@ float SoundFile::minVal() const
 AudioEngine::AudioEngine()
 :	audio(NULL),
 	resonance(NULL),
-	initialised(false)
+	initialised(false),
+	num_buffers_mixed(0),
+	num_mix_deadline_misses(0),
+	max_mix_time(0),
+	sample_rate(0),
+	frames_per_buffer(0)
 {
 
 }
@@ -212,25 +219,24 @@ static int rtAudioCallback(void* output_buffer, void* input_buffer, unsigned int
 		}
 	}
 #else
+	// Doesn't take any locks, so that we never wait on another thread here.
+	if(data->buffer.popFrontNItems(output_buffer_f, n_buffer_frames*2))
 	{
-		Lock lock(data->buffer_mutex);
+		//conPrint("rtAudioCallback: got data.");
 
-		if(data->buffer.size() >= n_buffer_frames*2)
-		{
-			//conPrint("rtAudioCallback: got data.");
-			data->buffer.popFrontNItems(output_buffer_f, n_buffer_frames*2);
+		// clamp data
+		for(unsigned int z=0; z<n_buffer_frames*2; ++z)
+			output_buffer_f[z] = myClamp(output_buffer_f[z], -1.f, 1.f);
+	}
+	else
+	{
+		//conPrint("rtAudioCallback: not enough data in queue.");
+		// Just write zeroes to output_buffer
+		for(unsigned int i=0; i<n_buffer_frames*2; ++i)
+			output_buffer_f[i] = 0.f;
 
-			// clamp data
-			for(unsigned int z=0; z<n_buffer_frames*2; ++z)
-				output_buffer_f[z] = myClamp(output_buffer_f[z], -1.f, 1.f);
-		}
-		else
-		{
-			//conPrint("rtAudioCallback: not enough data in queue.");
-			// Just write zeroes to output_buffer
-			for(unsigned int i=0; i<n_buffer_frames*2; ++i)
-				output_buffer_f[i] = 0.f;
-		}
+		if(data->output_started.load(std::memory_order_relaxed))
+			data->num_output_underruns++;
 	}
 #endif
 
@@ -247,6 +253,9 @@ static void zeroBuffer(js::Vector<float, 16>& v)
 
 // Gets buffered audio data from audio sources, copies it to resonance buffers.
 // Then gets mixed data from resonance, puts on queue to rtAudioCallback.
+//
+// Doesn't take any locks: the list of sources is private to this thread, and is updated with the commands in engine->source_commands.
+// Resonance API calls from other threads (source positions, volumes etc.) are queued internally by Resonance.
 class ResonanceThread : public MessageableThread
 {
 public:
@@ -258,216 +267,315 @@ public:
 		
 		try
 		{
+			sources.reserve(1024);
+			unreturned_sources.reserve(256);
+
+			const double buffer_period = (double)frames_per_buffer / engine->getSampleRate();
+
 			while(die == 0)
 			{
-				size_t num_samples_buffered;
-				{
-					Lock lock(callback_data->buffer_mutex);
-					num_samples_buffered = callback_data->buffer.size();
-				}
+				processSourceCommands();
 
 				// 512/2 samples per buffer / 48000.0 samples/s = 0.00533 s / buffer.
 				// So we will aim for N of these buffers being queued, resulting in N * 0.00533 s latency.
 				// For N = 4 this gives 0.0213 s = 21.3 ms of latency.
-				while(num_samples_buffered < 512 * 4)
+				while(callback_data->buffer.size() < 512 * 4)
+				{
+					Timer mix_timer;
+
+					setResonanceSourceBuffers();
+
+					// Get mixed/filtered data from Resonance.
+					temp_buf.resizeNoCopy(frames_per_buffer * 2); // We will receive stereo data
+					bool filled_valid_buffer = resonance->FillInterleavedOutputBuffer(
+						2, // num channels
+						frames_per_buffer, // num frames
+						temp_buf.data()
+					);
+
+					buffers_processed++;
+
+					//for(size_t i=0; i<10; ++i)
+					//	conPrint("buf[" + toString(i) + "]: " + toString(buf[i]));
+					if(buffers_processed * frames_per_buffer < 48000) // Ignore first second or so of sound because resonance seems to fill it with garbage.
+						filled_valid_buffer = false;
+
+					//printVar(filled_valid_buffer);
+					if(!filled_valid_buffer)
+						break; // break while loop
+
+					// Push mixed/filtered data onto back of buffer that feeds to rtAudioCallback.
+					callback_data->buffer.pushBackNItems(temp_buf.data(), frames_per_buffer * 2);
+					callback_data->output_started.store(true, std::memory_order_relaxed);
+
+					const double mix_time = mix_timer.elapsed();
+					engine->num_buffers_mixed++;
+					if(mix_time > buffer_period)
+						engine->num_mix_deadline_misses++;
+					if(mix_time > engine->max_mix_time.load(std::memory_order_relaxed)) // We are the only writer of max_mix_time.
+						engine->max_mix_time.store((float)mix_time, std::memory_order_relaxed);
+				}
+
+				PlatformUtils::Sleep(1);
+			}
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("ResonanceThread excep: " + e.what());
+		}
+	}
+
+	// Applies add and remove commands from the main thread to our sources list.
+	// The Resonance source handles used for mixing are the ones passed in the add commands, not AudioSource::resonance_handle, which the main thread
+	// may have already replaced when re-adding a source whose remove command we haven't processed yet.
+	//
+	// The mix thread never releases what might be the last reference to an AudioSource, as the AudioSource destructor may free memory or take locks.
+	// References are only released here while another reference held by this thread keeps the source alive, and the last reference is handed back with returnSource().
+	void processSourceCommands()
+	{
+		flushUnreturnedSources();
+
+		AudioEngine::SourceCommand command;
+		while(engine->source_commands.popFront(command))
+		{
+			if(command.type == AudioEngine::SourceCommand::Type_AddSource)
+			{
+				// The producer made the filter table with AudioResampler::prepareFilter(), so this doesn't need to lock or allocate.
+				// The resampler is only initialised here, as it may still be in use by this thread when the main thread re-adds the source.
+				command.source->resampler.initNonBlocking(/*src rate=*/command.source->sampling_rate, /*dest rate=*/engine->getSampleRate());
+
+				bool already_added = false;
+				for(size_t i=0; i<sources.size(); ++i)
+					if(sources[i].source.ptr() == command.source.ptr())
+					{
+						// Added again without being removed: switch to the new Resonance source.
+						resonance->DestroySource(sources[i].resonance_handle);
+						sources[i].resonance_handle = command.resonance_handle;
+						already_added = true;
+					}
+				if(!already_added)
+				{
+					MixThreadSource mix_thread_source;
+					mix_thread_source.source = command.source;
+					mix_thread_source.resonance_handle = command.resonance_handle;
+					sources.push_back(mix_thread_source);
+				}
+				command.source = NULL; // sources holds a reference, so this isn't the last one.
+			}
+			else if(command.type == AudioEngine::SourceCommand::Type_RemoveSource)
+			{
+				for(size_t i=0; i<sources.size(); ++i)
+					if(sources[i].source.ptr() == command.source.ptr())
+					{
+						removeSourceAt(i); // command holds a reference, so this doesn't release the last one.
+						break;
+					}
+
+				returnSource(command.source, AudioEngine::SourceCommand::Type_RemoveSource); // Resets command.source.
+			}
+		}
+	}
+
+	// Destroys the Resonance source for sources[i] and removes it from sources.  Doesn't preserve order.
+	void removeSourceAt(size_t i)
+	{
+		resonance->DestroySource(sources[i].resonance_handle);
+
+		sources[i] = sources.back();
+		sources.pop_back();
+	}
+
+	// Passes a source reference we are done with back to the main thread, so the source is freed there instead of on this thread.  Resets source.
+	void returnSource(AudioSourceRef& source, int type)
+	{
+		AudioEngine::SourceCommand returned;
+		returned.type = type;
+		returned.source = source;
+		source = NULL; // returned holds a reference, so this isn't the last one.
+
+		if(!unreturned_sources.empty() || !engine->returned_sources.pushBackAndReset(returned)) // Keep the returned sources in order.
+			unreturned_sources.push_back(returned); // returned_sources is full, hold on to the source until there is space.
+	}
+
+	// Retries returning sources that didn't fit in returned_sources.
+	void flushUnreturnedSources()
+	{
+		size_t num_returned = 0;
+		while(num_returned < unreturned_sources.size() && engine->returned_sources.pushBackAndReset(unreturned_sources[num_returned]))
+			num_returned++;
+
+		unreturned_sources.erase(unreturned_sources.begin(), unreturned_sources.begin() + num_returned); // Erased entries have been reset, so this doesn't release any references.
+	}
+
+	// Set resonance audio buffers for all audio sources
+	void setResonanceSourceBuffers()
+	{
+		for(size_t source_i = 0; source_i < sources.size(); )
+		{
+			AudioSource* source = sources[source_i].source.ptr();
+			const int resonance_handle = sources[source_i].resonance_handle;
+			bool remove_source = false;
+
+			// Pick up any sampling rate change from a producer thread.
+			const int requested_sampling_rate = source->requested_sampling_rate.load(std::memory_order_acquire); // Acquire, so the filter table made by the producer is visible.
+			if(requested_sampling_rate != 0 && requested_sampling_rate != source->sampling_rate)
+			{
+				// The producer makes the filter table with AudioResampler::prepareFilter() before requesting the rate, so this doesn't need to lock or allocate.
+				source->sampling_rate = requested_sampling_rate;
+				source->resampler.initNonBlocking(/*src rate=*/requested_sampling_rate, /*dest rate=*/engine->getSampleRate());
+			}
+
+			const int source_sampling_rate = source->sampling_rate;
+			const int resonance_sampling_rate = engine->getSampleRate();
+
+			size_t src_samples_needed;
+			if(source_sampling_rate == resonance_sampling_rate)
+				src_samples_needed = frames_per_buffer;
+			else
+				src_samples_needed = (int)source->resampler.numSrcSamplesNeeded(frames_per_buffer);
+
+			temp_buf.resizeNoCopy(src_samples_needed);
+
+			const float* contiguous_data_ptr = temp_buf.data(); // Pointer to a buffer of contiguous source samples.
+			// Will either point into an existing shared buffer, or at the start of temp_buf if we need to use it.
+
+			if(source->type == AudioSource::SourceType_Looping)
+			{
+				if(source->shared_buffer.nonNull()) // If we are reading from shared_buffer:
 				{
-					bool filled_valid_buffer = false;
+					if(source->cur_read_i + src_samples_needed <= source->shared_buffer->buffer.size()) // If we can just copy the current buffer range directly from source->buffer:
 					{
-						Lock lock(engine->mutex);
+						contiguous_data_ptr = &source->shared_buffer->buffer[source->cur_read_i];
 
-						// Set resonance audio buffers for all audio sources
-						for(auto it = engine->audio_sources.begin(); it != engine->audio_sources.end(); )
+						source->cur_read_i += src_samples_needed;
+						if(source->cur_read_i == source->shared_buffer->buffer.size()) // If reached end of buf:
+							source->cur_read_i = 0; // wrap
+					}
+					else
+					{
+						// The data range we want to read from the shared buffer wraps.  So copy data to a temporary contiguous buffer first.
+						size_t cur_i = source->cur_read_i;
+
+						for(size_t i=0; i<src_samples_needed; ++i)
 						{
-							AudioSource* source = it->ptr();
-							bool remove_source = false;
+							temp_buf[i] = source->shared_buffer->buffer[cur_i++];
+							if(cur_i == source->shared_buffer->buffer.size()) // If reach end of buf:
+								cur_i = 0; // wrap.  TODO: optimise: do simple copy in 2 sections.
+						}
 
-							const int source_sampling_rate = source->sampling_rate;
-							const int resonance_sampling_rate = engine->getSampleRate();
+						source->cur_read_i = cur_i;
+					}
+				}
+				else // Else if we are reading from a circular buffer:
+				{
+					assert(0); // SourceType_Looping sources should only read from shared buffers.
+					zeroBuffer(temp_buf); // Just pass zeroes to resonance so as to not blow up the listener's ears.
+				}
+			}
+			else if(source->type == AudioSource::SourceType_OneShot)
+			{
+				if(source->shared_buffer.nonNull()) // If we are reading from shared_buffer:
+				{
+					if(source->cur_read_i + src_samples_needed <= source->shared_buffer->buffer.size()) // If we can just copy the current buffer range directly from source->buffer:
+					{
+						contiguous_data_ptr = &source->shared_buffer->buffer[source->cur_read_i];
+						
+						source->cur_read_i += src_samples_needed;
+					}
+					else
+					{
+						// The data range we want to read from the shared buffer exceeds the shared buffer length.  Just read as much data as we can and then pad with zeroes.
+						// Copy data to a temporary contiguous buffer
+						size_t cur_i = source->cur_read_i;
 
-							size_t src_samples_needed;
-							if(source_sampling_rate == resonance_sampling_rate)
-								src_samples_needed = frames_per_buffer;
-							else
-								src_samples_needed = (int)source->resampler.numSrcSamplesNeeded(frames_per_buffer);
-
-							temp_buf.resizeNoCopy(src_samples_needed);
-
-							const float* contiguous_data_ptr = temp_buf.data(); // Pointer to a buffer of contiguous source samples.
-							// Will either point into an existing shared buffer, or at the start of temp_buf if we need to use it.
-
-							if(source->type == AudioSource::SourceType_Looping)
-							{
-								if(source->shared_buffer.nonNull()) // If we are reading from shared_buffer:
-								{
-									if(source->cur_read_i + src_samples_needed <= source->shared_buffer->buffer.size()) // If we can just copy the current buffer range directly from source->buffer:
-									{
-										contiguous_data_ptr = &source->shared_buffer->buffer[source->cur_read_i];
-
-										source->cur_read_i += src_samples_needed;
-										if(source->cur_read_i == source->shared_buffer->buffer.size()) // If reached end of buf:
-											source->cur_read_i = 0; // wrap
-									}
-									else
-									{
-										// The data range we want to read from the shared buffer wraps.  So copy data to a temporary contiguous buffer first.
-										size_t cur_i = source->cur_read_i;
-
-										for(size_t i=0; i<src_samples_needed; ++i)
-										{
-											temp_buf[i] = source->shared_buffer->buffer[cur_i++];
-											if(cur_i == source->shared_buffer->buffer.size()) // If reach end of buf:
-												cur_i = 0; // wrap.  TODO: optimise: do simple copy in 2 sections.
-										}
-
-										source->cur_read_i = cur_i;
-									}
-								}
-								else // Else if we are reading from a circular buffer:
-								{
-									assert(0); // SourceType_Looping sources should only read from shared buffers.
-									zeroBuffer(temp_buf); // Just pass zeroes to resonance so as to not blow up the listener's ears.
-								}
-							}
-							else if(source->type == AudioSource::SourceType_OneShot)
-							{
-								if(source->shared_buffer.nonNull()) // If we are reading from shared_buffer:
-								{
-									if(source->cur_read_i + src_samples_needed <= source->shared_buffer->buffer.size()) // If we can just copy the current buffer range directly from source->buffer:
-									{
-										contiguous_data_ptr = &source->shared_buffer->buffer[source->cur_read_i];
-										
-										source->cur_read_i += src_samples_needed;
-									}
-									else
-									{
-										// The data range we want to read from the shared buffer exceeds the shared buffer length.  Just read as much data as we can and then pad with zeroes.
-										// Copy data to a temporary contiguous buffer
-										size_t cur_i = source->cur_read_i;
-
-										for(size_t i=0; i<src_samples_needed; ++i)
-										{
-											if(cur_i < source->shared_buffer->buffer.size())
-												temp_buf[i] = source->shared_buffer->buffer[cur_i++];
-											else
-												temp_buf[i] = 0;
-										}
-										source->cur_read_i = cur_i;
-										remove_source = source->remove_on_finish && (cur_i >= source->shared_buffer->buffer.size()); // Remove the source if we reached the end of the buffer.
-									}
-								}
-								else // Else if we are reading from a circular buffer:
-								{
-									assert(0); // SourceType_OneShot sources should only read from shared buffers.
-									zeroBuffer(temp_buf); // Just pass zeroes to resonance so as to not blow up the listener's ears.
-								}
-							}
-							else if(source->type == AudioSource::SourceType_Streaming)
-							{
-								if(!source->mix_sources.empty())
-								{
-									// Mix together the audio sources, applying pitch shift factor and volume factor.
-									zeroBuffer(temp_buf);
-
-									for(size_t z=0; z<source->mix_sources.size(); ++z)
-									{
-										MixSource& mix_source = source->mix_sources[z];
-										const size_t src_buffer_size  = mix_source.soundfile->buf->buffer.size();
-										const float* const src_buffer = mix_source.soundfile->buf->buffer.data();
-
-										for(size_t i=0; i<src_samples_needed; ++i)
-										{
-											mix_source.sound_file_i += mix_source.source_delta; // Advance floating-point read index (index into source buffer)
-
-											const size_t index   = (size_t)mix_source.sound_file_i % src_buffer_size;
-											const size_t index_1 = (index + 1)                     % src_buffer_size;
-											const float frac = (float)(mix_source.sound_file_i - (size_t)mix_source.sound_file_i);
-
-											const float sample = src_buffer[index] * (1 - frac) + src_buffer[index_1] * frac;
-											temp_buf[i] += sample * mix_source.mix_factor;
-										}
-									}
-								}
-								else
-								{
-									if(source->buffer.size() >= src_samples_needed) // If there is sufficient data in the circular buffer:
-									{
-										// Copy data to temp_buf before we pop it from the source buffer.  NOTE: Could optimise by popping later, after we process the data, to avoid copying to temp_buf.
-										source->buffer.popFrontNItems(/*dest=*/temp_buf.data(), src_samples_needed);
-									}
-									else
-									{
-										//conPrint("Ran out of data for streaming audio src!");
-										const size_t source_buf_size = source->buffer.size();
-										source->buffer.popFrontNItems(/*dest=*/temp_buf.data(), source_buf_size); // Copy the data that there is to temp_buf
-										for(size_t i=source_buf_size; i<src_samples_needed; ++i) // Pad the rest with zeroes.
-											temp_buf[i] = 0.f;
-									}
-								}
-							}
-
-							
-							runtimeCheck(contiguous_data_ptr != NULL);
-							if(source_sampling_rate == resonance_sampling_rate)
-							{
-								const float* bufptr = contiguous_data_ptr;
-								resonance->SetPlanarBuffer(source->resonance_handle, &bufptr, /*num channels=*/1, frames_per_buffer);
-							}
-							else
-							{
-								// Resample audio to the audio engine and Resonance sampling rate.
-								resampled_buf.resizeNoCopy(frames_per_buffer);
-								
-								source->resampler.resample(resampled_buf.data(), frames_per_buffer, contiguous_data_ptr, src_samples_needed, temp_resampling_buf);
-
-								const float* bufptr = resampled_buf.data();
-								resonance->SetPlanarBuffer(source->resonance_handle, &bufptr, /*num channels=*/1, frames_per_buffer);
-							}
-
-
-							if(remove_source)
-							{
-								resonance->DestroySource(source->resonance_handle);
-								it = engine->audio_sources.erase(it); // Remove currently iterated to source, advance iterator.
-							}
+						for(size_t i=0; i<src_samples_needed; ++i)
+						{
+							if(cur_i < source->shared_buffer->buffer.size())
+								temp_buf[i] = source->shared_buffer->buffer[cur_i++];
 							else
-								++it;
+								temp_buf[i] = 0;
 						}
+						source->cur_read_i = cur_i;
+						remove_source = source->remove_on_finish && (cur_i >= source->shared_buffer->buffer.size()); // Remove the source if we reached the end of the buffer.
+					}
+				}
+				else // Else if we are reading from a circular buffer:
+				{
+					assert(0); // SourceType_OneShot sources should only read from shared buffers.
+					zeroBuffer(temp_buf); // Just pass zeroes to resonance so as to not blow up the listener's ears.
+				}
+			}
+			else if(source->type == AudioSource::SourceType_Streaming)
+			{
+				if(!source->mix_sources.empty())
+				{
+					// Mix together the audio sources, applying pitch shift factor and volume factor.
+					zeroBuffer(temp_buf);
 
-						// Get mixed/filtered data from Resonance.
-						temp_buf.resizeNoCopy(frames_per_buffer * 2); // We will receive stereo data
-						filled_valid_buffer = resonance->FillInterleavedOutputBuffer(
-							2, // num channels
-							frames_per_buffer, // num frames
-							temp_buf.data()
-						);
-
-						buffers_processed++;
+					for(size_t z=0; z<source->mix_sources.size(); ++z)
+					{
+						MixSource& mix_source = source->mix_sources[z];
+						const size_t src_buffer_size  = mix_source.soundfile->buf->buffer.size();
+						const float* const src_buffer = mix_source.soundfile->buf->buffer.data();
+						const double source_delta = mix_source.source_delta.load(std::memory_order_relaxed);
+						const float mix_factor = mix_source.mix_factor.load(std::memory_order_relaxed);
 
-						//for(size_t i=0; i<10; ++i)
-						//	conPrint("buf[" + toString(i) + "]: " + toString(buf[i]));
-						if(buffers_processed * frames_per_buffer < 48000) // Ignore first second or so of sound because resonance seems to fill it with garbage.
-							filled_valid_buffer = false;
+						for(size_t i=0; i<src_samples_needed; ++i)
+						{
+							mix_source.sound_file_i += source_delta; // Advance floating-point read index (index into source buffer)
 
-						//printVar(filled_valid_buffer);
-						if(!filled_valid_buffer)
-							break; // break while loop
-					} // End engine->mutex scope
+							const size_t index   = (size_t)mix_source.sound_file_i % src_buffer_size;
+							const size_t index_1 = (index + 1)                     % src_buffer_size;
+							const float frac = (float)(mix_source.sound_file_i - (size_t)mix_source.sound_file_i);
 
-					// Push mixed/filtered data onto back of buffer that feeds to rtAudioCallback.
-					if(filled_valid_buffer)
+							const float sample = src_buffer[index] * (1 - frac) + src_buffer[index_1] * frac;
+							temp_buf[i] += sample * mix_factor;
+						}
+					}
+				}
+				else
+				{
+					// If too much data is queued up for this audio source, drop the oldest data.
+					if(source->max_buffered_samples > 0)
 					{
-						Lock lock(callback_data->buffer_mutex);
-						callback_data->buffer.pushBackNItems(temp_buf.data(), frames_per_buffer * 2);
-						num_samples_buffered = callback_data->buffer.size();
+						const size_t num_buffered = source->buffer.size();
+						if(num_buffered > source->max_buffered_samples)
+							source->buffer.discardFrontNItems(num_buffered - source->max_buffered_samples / 2);
 					}
+
+					const size_t num_popped = source->buffer.popFrontUpToNItems(/*dest=*/temp_buf.data(), src_samples_needed);
+					for(size_t i=num_popped; i<src_samples_needed; ++i) // If we ran out of data, pad the rest with zeroes.
+						temp_buf[i] = 0.f;
 				}
+			}
 
-				PlatformUtils::Sleep(1);
+			
+			runtimeCheck(contiguous_data_ptr != NULL);
+			if(source_sampling_rate == resonance_sampling_rate)
+			{
+				const float* bufptr = contiguous_data_ptr;
+				resonance->SetPlanarBuffer(resonance_handle, &bufptr, /*num channels=*/1, frames_per_buffer);
 			}
-		}
-		catch(glare::Exception& e)
-		{
-			conPrint("ResonanceThread excep: " + e.what());
+			else
+			{
+				// Resample audio to the audio engine and Resonance sampling rate.
+				resampled_buf.resizeNoCopy(frames_per_buffer);
+				
+				source->resampler.resample(resampled_buf.data(), frames_per_buffer, contiguous_data_ptr, src_samples_needed, temp_resampling_buf);
+
+				const float* bufptr = resampled_buf.data();
+				resonance->SetPlanarBuffer(resonance_handle, &bufptr, /*num channels=*/1, frames_per_buffer);
+			}
+
+
+			if(remove_source)
+			{
+				AudioSourceRef finished_source = sources[source_i].source;
+				removeSourceAt(source_i); // Moves the last source into slot source_i, so don't advance source_i.  finished_source holds a reference, so this doesn't release the last one.
+				returnSource(finished_source, AudioEngine::SourceCommand::Type_SourceFinished);
+			}
+			else
+				source_i++;
 		}
 	}
 
@@ -484,6 +592,14 @@ public:
 	uint64 frames_per_buffer; // e.g. 256, with 2 samples per frame = 512 samples.
 	uint64 buffers_processed;
 
+	struct MixThreadSource
+	{
+		AudioSourceRef source;
+		int resonance_handle; // From the add command for the source.
+	};
+	std::vector<MixThreadSource> sources; // Sources being mixed.  Only accessed by this thread.
+	std::vector<AudioEngine::SourceCommand> unreturned_sources; // Sources to pass back through engine->returned_sources, once it has space.  Only accessed by this thread.
+
 	js::Vector<float, 16> temp_buf;
 	js::Vector<float, 16> temp_resampling_buf;
 	js::Vector<float, 16> resampled_buf;
@@ -548,13 +664,24 @@ void AudioEngine::init()
 	callback_data.resonance = NULL;
 	callback_data.engine = this;
 
+	source_commands.init(4096);
+	returned_sources.init(4096);
+
 	RtAudioErrorType rtaudio_res = audio->openStream(&parameters, /*input parameters=*/NULL, RTAUDIO_FLOAT32, desired_sample_rate, &buffer_frames, rtAudioCallback, /*userdata=*/&callback_data);
 	if(rtaudio_res != RTAUDIO_NO_ERROR)
 		throw glare::Exception("Error opening audio stream: code: " + toString((int)rtaudio_res));
 
 	this->sample_rate = audio->getStreamSampleRate(); // Get actual sample rate used.
+	this->frames_per_buffer = buffer_frames;
+
+	callback_data.buffer.init(512 * 4 + buffer_frames * 2); // ResonanceThread keeps up to 512 * 4 samples queued, and pushes a stereo buffer at a time.  The stream is not started yet, so this is safe.
 
 	conPrint("Using sample rate of " + toString(sample_rate) + " hz");
+
+	// Make the resampling filter tables for the common source sampling rates now, instead of when a source first uses them.
+	const int common_source_sampling_rates[] = { 8000, 11025, 16000, 22050, 24000, 32000, 44100, 48000 };
+	for(size_t i=0; i<staticArrayNumElems(common_source_sampling_rates); ++i)
+		AudioResampler::prepareFilter(common_source_sampling_rates[i], (int)sample_rate);
 	
 
 	// Resonance audio
@@ -690,6 +817,8 @@ void AudioEngine::addSource(AudioSourceRef source)
 	if(source->sampling_rate < 8000 || source->sampling_rate > 48000)
 		throw glare::Exception("Unsupported sampling rate for audio source: " + toString(source->sampling_rate));
 
+	// Each add gets a new Resonance source, which is passed to the mix thread in the add command.  If the source is being re-added, the mix thread
+	// destroys the old Resonance source when it processes the remove command, so it doesn't matter that source->resonance_handle is overwritten here.
 	if(source->spatial_type == AudioSource::SourceSpatialType_Spatial)
 	{
 		source->resonance_handle = resonance->CreateSoundObjectSource(vraudio::RenderingMode::kBinauralHighQuality);
@@ -706,10 +835,19 @@ void AudioEngine::addSource(AudioSourceRef source)
 		resonance->SetSourceVolume(source->resonance_handle, source->volume * source->getMuteVolumeFactor());
 	}
 
-	source->resampler.init(/*src rate=*/source->sampling_rate, this->sample_rate);
+	AudioResampler::prepareFilter(/*src rate=*/source->sampling_rate, this->sample_rate); // The mix thread initialises the resampler when it processes the add command.
 
-	Lock lock(mutex);
-	audio_sources.insert(source);
+	if(source->type == AudioSource::SourceType_Streaming && source->buffer.capacity() == 0)
+		source->buffer.init(16384); // ~340 ms at 48 khz.  Producers fill to ~4096 - 8192 samples.
+
+	removeFinishedSources();
+
+	{
+		Lock lock(mutex);
+		audio_sources.insert(source);
+	}
+
+	pushSourceCommand(SourceCommand::Type_AddSource, source, source->resonance_handle);
 }
 
 
@@ -718,7 +856,8 @@ void AudioEngine::removeSource(AudioSourceRef source)
 	if(!initialised)
 		return;
 
-	resonance->DestroySource(source->resonance_handle);
+	// The mix thread will destroy the Resonance source when it processes the remove command.
+	pushSourceCommand(SourceCommand::Type_RemoveSource, source, /*resonance_handle=*/-1);
 
 	{
 		Lock lock(mutex);
@@ -752,6 +891,94 @@ void AudioEngine::removeSource(AudioSourceRef source)
 			sources_playing_streams.erase(streamer_to_remove);
 		}
 	} // End lock scope
+
+	removeFinishedSources();
+}
+
+
+void AudioEngine::pushSourceCommand(int type, const AudioSourceRef& source, int resonance_handle)
+{
+	SourceCommand command;
+	command.type = type;
+	command.source = source;
+	command.resonance_handle = resonance_handle;
+
+	Lock lock(source_commands_mutex);
+
+	// Keep commands in order: if earlier commands are still waiting for space, this one has to wait behind them.
+	flushOverflowSourceCommands();
+	if(!overflow_source_commands.empty() || !source_commands.pushBack(command))
+		overflow_source_commands.push_back(command);
+}
+
+
+void AudioEngine::flushOverflowSourceCommands()
+{
+	// The mix thread processes commands every few ms, so there should only be overflow commands if the mix thread was stalled.
+	while(!overflow_source_commands.empty() && source_commands.pushBack(overflow_source_commands.front()))
+		overflow_source_commands.pop_front();
+}
+
+
+void AudioEngine::removeFinishedSources()
+{
+	if(!initialised)
+		return;
+
+	{
+		Lock lock(source_commands_mutex);
+		flushOverflowSourceCommands();
+	}
+
+	Lock lock(mutex); // Serialises consumers of returned_sources, and guards audio_sources.
+
+	SourceCommand command;
+	while(returned_sources.popFront(command))
+	{
+		if(command.type == SourceCommand::Type_SourceFinished)
+			audio_sources.erase(command.source);
+	}
+}
+
+
+AudioMixStats AudioEngine::getMixStats() const
+{
+	AudioMixStats stats;
+	stats.num_buffers_mixed = num_buffers_mixed;
+	stats.num_deadline_misses = num_mix_deadline_misses;
+	stats.num_output_underruns = callback_data.num_output_underruns;
+	stats.max_mix_time = max_mix_time;
+	stats.buffer_period = (sample_rate > 0) ? ((double)frames_per_buffer / sample_rate) : 0.0;
+	return stats;
+}
+
+
+size_t AudioEngine::getTotalMemUsage()
+{
+	// Buffers may be shared between sound files and sources, so only count each buffer once.
+	std::set<const AudioBuffer*> buffers;
+	size_t sum = 0;
+
+	for(auto it = sound_files.begin(); it != sound_files.end(); ++it)
+		if(buffers.insert(it->second->buf.ptr()).second)
+			sum += it->second->buf->buffer.size() * sizeof(float);
+
+	Lock lock(mutex);
+	for(auto it = audio_sources.begin(); it != audio_sources.end(); ++it)
+	{
+		const AudioSource* source = it->ptr();
+
+		sum += source->buffer.capacity() * sizeof(float);
+
+		if(source->shared_buffer.nonNull() && buffers.insert(source->shared_buffer.ptr()).second)
+			sum += source->shared_buffer->buffer.size() * sizeof(float);
+
+		for(size_t i=0; i<source->mix_sources.size(); ++i)
+			if(source->mix_sources[i].soundfile.nonNull() && buffers.insert(source->mix_sources[i].soundfile->buf.ptr()).second)
+				sum += source->mix_sources[i].soundfile->buf->buffer.size() * sizeof(float);
+	}
+
+	return sum;
 }
 
 
@@ -913,7 +1140,7 @@ AudioSourceRef AudioEngine::addSourceFromStreamingSoundFile(const std::string& s
 		{
 			AudioSourceRef first_source = *first_source_it;
 
-			source->buffer = first_source->buffer;
+			source->buffer.copyFrom(first_source->buffer); // StreamerThread only pushes to the buffer with the mutex held, so this is safe.
 		}
 
 		sources_playing_streams[streamer].insert(source); // Add this audio source as a user of this stream.
@@ -936,10 +1163,296 @@ AudioSourceRef AudioEngine::addSourceFromStreamingSoundFile(const std::string& s
 #include "PlatformUtils.h"
 #include "Timer.h"
 #include "../utils/TestUtils.h"
+#include "../maths/PCG32.h"
+#include <thread>
+#include <cstdlib>
+
+
+// Pushes 0, 1, 2, ... to a ring buffer in chunks of varying size.
+class RingBufferTestProducerThread : public MyThread
+{
+public:
+	virtual void run() override
+	{
+		PCG32 rng(1);
+		std::vector<uint32> chunk;
+		uint32 next = 0;
+		while(next < num_items)
+		{
+			const uint32 chunk_size = myMin(1 + rng.nextUInt(100), num_items - next);
+			chunk.resize(chunk_size);
+			for(uint32 i=0; i<chunk_size; ++i)
+				chunk[i] = next + i;
+
+			const size_t num_pushed = buffer->pushBackNItems(chunk.data(), chunk_size); // May push less than chunk_size if the buffer is full.
+			next += (uint32)num_pushed;
+			if(num_pushed == 0)
+				std::this_thread::yield();
+		}
+	}
+
+	glare::SPSCRingBuffer<uint32>* buffer;
+	uint32 num_items;
+};
+
+
+static void testSPSCRingBuffer()
+{
+	conPrint("testSPSCRingBuffer()");
+
+	// Test basic pushing and popping, and wrapping around the end of the buffer.
+	{
+		glare::SPSCRingBuffer<float> buffer;
+		testAssert(buffer.capacity() == 0);
+		const float item = 1.f;
+		testAssert(!buffer.pushBack(item));
+
+		buffer.init(6);
+		testAssert(buffer.capacity() == 8);
+		testAssert(buffer.empty());
+
+		const float data[10] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+		testAssert(buffer.pushBackNItems(data, 5) == 5);
+		testAssert(buffer.size() == 5);
+
+		float popped[10];
+		testAssert(!buffer.popFrontNItems(popped, 6)); // Not enough items, should pop nothing.
+		testAssert(buffer.size() == 5);
+		testAssert(buffer.popFrontNItems(popped, 3));
+		testAssert(popped[0] == 0 && popped[1] == 1 && popped[2] == 2);
+
+		testAssert(buffer.pushBackNItems(data, 10) == 6); // Only 6 slots free.  Wraps around.
+		testAssert(buffer.size() == 8);
+
+		testAssert(buffer.popFrontUpToNItems(popped, 10) == 8);
+		const float expected[8] = { 3, 4, 0, 1, 2, 3, 4, 5 };
+		for(int i=0; i<8; ++i)
+			testAssert(popped[i] == expected[i]);
+		testAssert(buffer.empty());
+
+		testAssert(buffer.pushBackNItems(data, 4) == 4);
+		testAssert(buffer.discardFrontNItems(3) == 3);
+		testAssert(buffer.popFront(popped[0]) && popped[0] == 3);
+		testAssert(!buffer.popFront(popped[0]));
+
+		// Test copyFrom()
+		testAssert(buffer.pushBackNItems(data, 7) == 7);
+		buffer.discardFrontNItems(2);
+		glare::SPSCRingBuffer<float> buffer2;
+		buffer2.copyFrom(buffer);
+		testAssert(buffer2.size() == 5 && buffer.size() == 5);
+		testAssert(buffer2.popFrontNItems(popped, 5));
+		for(int i=0; i<5; ++i)
+			testAssert(popped[i] == data[2 + i]);
+	}
+
+	// Test popped references are released.
+	{
+		glare::SPSCRingBuffer<glare::AudioSourceRef> buffer;
+		buffer.init(4);
+		glare::AudioSourceRef source = new glare::AudioSource();
+		testAssert(buffer.pushBack(source));
+		testAssert(source->getRefCount() == 2);
+		glare::AudioSourceRef popped;
+		testAssert(buffer.popFront(popped));
+		testAssert(popped.ptr() == source.ptr());
+		popped = NULL;
+		testAssert(source->getRefCount() == 1);
+	}
+
+	// Test pushBackAndReset()
+	{
+		glare::SPSCRingBuffer<glare::AudioSourceRef> buffer;
+		buffer.init(1);
+		glare::AudioSourceRef source = new glare::AudioSource();
+		glare::AudioSourceRef item = source;
+		testAssert(buffer.pushBackAndReset(item));
+		testAssert(item.isNull());
+		testAssert(source->getRefCount() == 2);
+
+		item = source;
+		testAssert(!buffer.pushBackAndReset(item)); // Buffer is full, item should be unchanged.
+		testAssert(item.ptr() == source.ptr());
+		item = NULL;
+
+		glare::AudioSourceRef popped;
+		testAssert(buffer.popFront(popped));
+		testAssert(popped.ptr() == source.ptr());
+		popped = NULL;
+		testAssert(source->getRefCount() == 1);
+	}
+
+	// Test with a producer thread, check all items are received in order.
+	{
+		glare::SPSCRingBuffer<uint32> buffer;
+		buffer.init(256);
+
+		Reference<RingBufferTestProducerThread> producer = new RingBufferTestProducerThread();
+		producer->buffer = &buffer;
+		producer->num_items = 1000000;
+		producer->launch();
+
+		PCG32 rng(2);
+		std::vector<uint32> popped(128);
+		uint32 next_expected = 0;
+		while(next_expected < producer->num_items)
+		{
+			const size_t num_popped = buffer.popFrontUpToNItems(popped.data(), 1 + rng.nextUInt(127));
+			for(size_t i=0; i<num_popped; ++i)
+				testAssert(popped[i] == next_expected++);
+			if(num_popped == 0)
+				std::this_thread::yield();
+		}
+		producer->join();
+		testAssert(buffer.empty());
+	}
+
+	conPrint("testSPSCRingBuffer() done");
+}
+
+
+// Adds, removes and updates sources as fast as possible from this thread, while also sometimes holding the engine mutex for a long time, as the main thread does during heavy scene loading.
+// Checks there were no mix deadline misses or output underruns.  These depend on the machine and its load, so the test is only run when opted in to, see AudioEngine::test().
+static void stressTestAudioEngine()
+{
+	conPrint("stressTestAudioEngine()");
+
+	glare::AudioEngine engine;
+	engine.init();
+
+	// Make a 0.5 s 440 hz sine wave sound.  Use a sampling rate different from the engine sample rate, to exercise the resampler.
+	glare::SoundFileRef sound = new glare::SoundFile();
+	sound->num_channels = 1;
+	sound->sample_rate = 44100;
+	sound->buf->buffer.resize(22050);
+	for(size_t i=0; i<sound->buf->buffer.size(); ++i)
+		sound->buf->buffer[i] = 0.1f * std::sin(Maths::get2Pi<float>() * 440.f * i / sound->sample_rate);
+
+	// Add a streaming source that we push data to from this thread.
+	glare::AudioSourceRef streaming_source = new glare::AudioSource();
+	streaming_source->type = glare::AudioSource::SourceType_Streaming;
+	streaming_source->sampling_rate = engine.getSampleRate();
+	streaming_source->max_buffered_samples = 4096;
+	engine.addSource(streaming_source);
+
+	PlatformUtils::Sleep(1500); // Wait for Resonance to warm up (see ResonanceThread), and the mix thread to start outputting data.
+	const glare::AudioMixStats initial_stats = engine.getMixStats();
+
+	PCG32 rng(1);
+	std::vector<glare::AudioSourceRef> sources;
+	size_t num_adds = 0, num_removes = 0, num_updates = 0;
+	std::vector<float> stream_data(480);
+	Timer timer;
+	Timer stream_timer;
+	double stream_time_pushed = 0;
+	for(int iter=0; timer.elapsed() < 5.0; ++iter)
+	{
+		const uint32 action = rng.nextUInt(4);
+		if(action == 0 && sources.size() < 200)
+		{
+			glare::AudioSourceRef source = new glare::AudioSource();
+			source->type = (rng.unitRandom() < 0.5f) ? glare::AudioSource::SourceType_Looping : glare::AudioSource::SourceType_OneShot;
+			source->remove_on_finish = true;
+			source->shared_buffer = sound->buf;
+			source->sampling_rate = sound->sample_rate;
+			source->cur_read_i = rng.nextUInt((uint32)sound->buf->buffer.size());
+			source->pos = Vec4f(rng.unitRandom() * 10, rng.unitRandom() * 10, 0, 1);
+			source->volume = 0.1f;
+			engine.addSource(source);
+			sources.push_back(source);
+			num_adds++;
+		}
+		else if(action == 1 && !sources.empty())
+		{
+			const size_t i = rng.nextUInt((uint32)sources.size());
+			engine.removeSource(sources[i]);
+			num_removes++;
+			if(rng.unitRandom() < 0.5f)
+			{
+				// Re-add the source straight away, before the mix thread has processed the remove command.
+				engine.addSource(sources[i]);
+				num_adds++;
+			}
+			else
+			{
+				sources[i] = sources.back();
+				sources.pop_back();
+			}
+		}
+		else if(!sources.empty())
+		{
+			glare::AudioSource* source = sources[rng.nextUInt((uint32)sources.size())].ptr();
+			source->pos = Vec4f(rng.unitRandom() * 10, rng.unitRandom() * 10, 0, 1);
+			source->volume = rng.unitRandom() * 0.1f;
+			engine.sourcePositionUpdated(*source);
+			engine.sourceVolumeUpdated(*source);
+			num_updates++;
+		}
+
+		// Stream data in 10 ms chunks, in real time.
+		while(stream_time_pushed < stream_timer.elapsed())
+		{
+			for(size_t i=0; i<stream_data.size(); ++i)
+				stream_data[i] = 0.05f * rng.unitRandom();
+			streaming_source->buffer.pushBackNItems(stream_data.data(), stream_data.size());
+			stream_time_pushed += 0.01;
+		}
+
+		// Every so often, hold the engine mutex for a long time.
+		if(iter % 1000 == 0)
+		{
+			Lock lock(engine.mutex);
+			PlatformUtils::Sleep(50);
+		}
+
+		engine.removeFinishedSources();
+	}
+
+	for(size_t i=0; i<sources.size(); ++i)
+		engine.removeSource(sources[i]);
+	engine.removeSource(streaming_source);
+
+	PlatformUtils::Sleep(100); // Wait for the mix thread to process the remove commands.
+	engine.removeFinishedSources();
+
+	{
+		Lock lock(engine.mutex);
+		testAssert(engine.audio_sources.empty());
+	}
+
+	const glare::AudioMixStats stats = engine.getMixStats();
+	const uint64 num_buffers_mixed = stats.num_buffers_mixed - initial_stats.num_buffers_mixed;
+	const uint64 num_deadline_misses = stats.num_deadline_misses - initial_stats.num_deadline_misses;
+	const uint64 num_underruns = stats.num_output_underruns - initial_stats.num_output_underruns;
+	conPrint(toString(num_adds) + " adds, " + toString(num_removes) + " removes, " + toString(num_updates) + " updates");
+	conPrint("Mixed " + toString(num_buffers_mixed) + " buffers, deadline misses: " + toString(num_deadline_misses) + ", output underruns: " + toString(num_underruns) +
+		", max mix time: " + doubleToStringNSigFigs(stats.max_mix_time * 1.0e3, 4) + " ms (buffer period: " + doubleToStringNSigFigs(stats.buffer_period * 1.0e3, 4) + " ms)");
+
+	testAssert(num_buffers_mixed > 0);
+	testAssert(num_deadline_misses == 0);
+	testAssert(num_underruns == 0);
+
+	conPrint("stressTestAudioEngine() done");
+}
 
 
 void glare::AudioEngine::test()
 {
+	testSPSCRingBuffer();
+
+	// Stress test.  Needs an audio output device and an otherwise idle machine, so only run when the SUBSTRATA_AUDIO_STRESS_TEST environment variable is set.
+	if(std::getenv("SUBSTRATA_AUDIO_STRESS_TEST"))
+	{
+		try
+		{
+			stressTestAudioEngine();
+		}
+		catch(glare::Exception& e)
+		{
+			failTest(e.what());
+		}
+	}
+
 	try
 	{
 		AudioEngine engine;
@@ -7,12 +7,12 @@ Copyright Glare Technologies Limited 2021 -
 
 
 #include "AudioResampler.h"
+#include "SPSCRingBuffer.h"
 #include "../maths/vec3.h"
 #include "../maths/vec2.h"
 #include "../maths/matrix3.h"
 #include "../maths/Quat.h"
 #include "../physics/jscol_aabbox.h"
-#include <utils/CircularBuffer.h>
 #include <utils/Mutex.h>
 #include <utils/ThreadManager.h>
 #include <utils/Vector.h>
@@ -20,6 +20,8 @@ Copyright Glare Technologies Limited 2021 -
 #include <vector>
 #include <set>
 #include <map>
+#include <deque>
+#include <atomic>
 
 
 class RtAudio;
@@ -59,11 +61,21 @@ typedef Reference<SoundFile> SoundFileRef;
 struct MixSource
 {
 	MixSource() : sound_file_i(0), source_delta(1), mix_factor(1) {}
+	MixSource(const MixSource& other) : soundfile(other.soundfile), sound_file_i(other.sound_file_i), source_delta(other.source_delta.load()), mix_factor(other.mix_factor.load()) {}
+
+	MixSource& operator = (const MixSource& other)
+	{
+		soundfile = other.soundfile;
+		sound_file_i = other.sound_file_i;
+		source_delta = other.source_delta.load();
+		mix_factor = other.mix_factor.load();
+		return *this;
+	}
 
 	Reference<SoundFile> soundfile;
-	double sound_file_i; // Current (floating-point) index into soundfile buffer.
-	double source_delta; // Every sample, we advance this much in the soundfile buffer.
-	float mix_factor; // Volume mixing factor.
+	double sound_file_i; // Current (floating-point) index into soundfile buffer.  Only accessed by the mix thread once the source has been added.
+	std::atomic<double> source_delta; // Every sample, we advance this much in the soundfile buffer.  May be set from other threads while playing.
+	std::atomic<float> mix_factor; // Volume mixing factor.  May be set from other threads while playing.
 };
 
 
@@ -97,17 +109,23 @@ public:
 
 	void updateDopplerEffectFactor(const Vec4f& source_linear_vel, const Vec4f& listener_linear_vel, const Vec4f& listener_pos);
 
-	int resonance_handle; // Set in AudioEngine::addSource().
+	int resonance_handle; // Set in AudioEngine::addSource(), for position, volume etc. updates.  The mix thread uses the handle from the add command instead.
 
 	int sampling_rate;
 	
 	// Audio data can either be in buffer or shared_buffer.
-	CircularBuffer<float> buffer; // Read from front, enqueue to back.  Used for type SourceType_Streaming only.
+	// Used for type SourceType_Streaming only.  Allocated in AudioEngine::addSource().
+	// Lock-free: there should be a single producer thread pushing to the back, the mix thread pops from the front.
+	SPSCRingBuffer<float> buffer;
+	size_t max_buffered_samples; // If non-zero, and more than this many samples are queued in buffer, the mix thread drops all but the most recent max_buffered_samples / 2, to limit latency.
+
+	std::atomic<int> requested_sampling_rate; // If non-zero and different from sampling_rate, the mix thread changes sampling_rate to this, and re-initialises the resampler.  For producer threads, which should call AudioResampler::prepareFilter() for the rate first.
 
 	AudioBufferRef shared_buffer; // Used for SourceType_Looping and SourceType_OneShot types only.
 	size_t cur_read_i; // Current read index in shared_buffer.
 
 	std::vector<MixSource> mix_sources; // If this is non-empty, this audio source mixes pitch-shifted and volume-scaled sounds together.  Used for type SourceType_Streaming.
+	// Should not be resized after the source is added, but the mix parameters may be changed.
 
 	SourceType type;
 	SourceSpatialType spatial_type; // Default is SourceSpatialType_Spatial
@@ -141,20 +159,43 @@ typedef Reference<AudioSource> AudioSourceRef;
 
 struct AudioCallbackData
 {
-	Mutex buffer_mutex; // protects buffer
-	CircularBuffer<float> buffer			GUARDED_BY(buffer_mutex);
+	AudioCallbackData() : output_started(false), num_output_underruns(0) {}
+
+	SPSCRingBuffer<float> buffer; // Mixed stereo data.  Pushed to by ResonanceThread, popped by rtAudioCallback.
 
 	//ThreadSafeQueue<Reference<AudioBuffer>> audio_buffer_queue;
 	vraudio::ResonanceAudioApi* resonance;
 	AudioEngine* engine;
 
 	std::vector<float> temp_buf;
+
+	std::atomic<bool> output_started; // Set when ResonanceThread pushes its first valid buffer.
+	std::atomic<uint64> num_output_underruns; // Number of times rtAudioCallback didn't have enough mixed data, after output started.
+};
+
+
+// Statistics about the mix thread, for diagnostics and tests.
+struct AudioMixStats
+{
+	uint64 num_buffers_mixed;
+	uint64 num_deadline_misses; // Number of buffers that took longer to mix than the buffer play time.
+	uint64 num_output_underruns; // Number of times the audio output callback ran out of mixed data.
+	double max_mix_time; // Max time to mix a buffer, in seconds.
+	double buffer_period; // Play time of a buffer, in seconds.
 };
 
 
 /*=====================================================================
 AudioEngine
 -----------
+Audio sources are mixed by Resonance in ResonanceThread, and the mixed data is passed to the RtAudio callback through a lock-free ring buffer.
+
+Neither the mix thread nor the RtAudio callback take any locks.
+The mix thread has its own list of sources, which addSource() and removeSource() update by pushing commands
+to source_commands, or to overflow_source_commands while source_commands is full, so commands are never dropped.
+Each add command carries a new Resonance source, which the mix thread destroys when the source is removed or finishes.
+Sources that the mix thread has finished with are passed back through returned_sources,
+so they are freed, and one-shot sources are removed from audio_sources, in removeFinishedSources().
 =====================================================================*/
 class AudioEngine
 {
@@ -192,9 +233,20 @@ public:
 
 	SoundFileRef getOrLoadSoundFile(const std::string& sound_file_path);
 
+	// Removes one-shot sources that have finished playing from audio_sources, and frees sources the mix thread is done with.
+	// Should be called periodically from the main thread.
+	void removeFinishedSources();
+
+	AudioMixStats getMixStats() const;
+
+	// Returns the memory used by loaded sound files and audio source buffers, in bytes.  Should be called from the main thread.
+	size_t getTotalMemUsage();
+
 	static void test();
 private:
 	SoundFileRef loadSoundFile(const std::string& sound_file_path);
+	void pushSourceCommand(int type, const AudioSourceRef& source, int resonance_handle);
+	void flushOverflowSourceCommands() REQUIRES(source_commands_mutex);
 
 	RtAudio* audio;
 	vraudio::ResonanceAudioApi* resonance;
@@ -204,9 +256,35 @@ private:
 	bool initialised;
 
 public:
-	Mutex mutex; // Guards access to audio_sources, and resonance
+	Mutex mutex; // Guards access to audio_sources, and the streams maps.  Not taken by the mix thread or the RtAudio callback.
 	std::set<AudioSourceRef> audio_sources			GUARDED_BY(mutex);
 
+	struct SourceCommand
+	{
+		enum Type
+		{
+			Type_AddSource,
+			Type_RemoveSource,
+			Type_SourceFinished // Sent from the mix thread when a one-shot source has finished playing.
+		};
+
+		SourceCommand() : resonance_handle(-1) {}
+
+		int type;
+		AudioSourceRef source;
+		int resonance_handle; // For Type_AddSource: the Resonance source the mix thread should use for the source.
+	};
+
+	Mutex source_commands_mutex; // Serialises producers of source_commands.  Not taken by the mix thread.
+	SPSCRingBuffer<SourceCommand> source_commands; // Add and remove commands to the mix thread.
+	std::deque<SourceCommand> overflow_source_commands GUARDED_BY(source_commands_mutex); // Commands waiting for space in source_commands, so that add and remove commands are never dropped.
+	SPSCRingBuffer<SourceCommand> returned_sources; // Sources removed from the mix thread list, back to the main thread.
+
+	// Mix stats, written by the mix thread.
+	std::atomic<uint64> num_buffers_mixed;
+	std::atomic<uint64> num_mix_deadline_misses;
+	std::atomic<float> max_mix_time;
+
 	ThreadManager thread_manager; // Manages: ResonanceThread, StreamerThread
 
 	std::map<std::string, SoundFileRef> sound_files;
@@ -217,6 +295,7 @@ public:
 
 private:
 	uint32 sample_rate;
+	uint32 frames_per_buffer;
 };
 
 
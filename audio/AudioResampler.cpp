@@ -9,19 +9,192 @@ Copyright Glare Technologies Limited 2023 -
 #include <utils/ConPrint.h>
 #include <utils/StringUtils.h>
 #include <utils/PlatformUtils.h>
+#include <utils/Mutex.h>
+#include <utils/Lock.h>
+#include <maths/mathstypes.h>
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <emmintrin.h>
 
 
 namespace glare
 {
 	
 
+static const int MAX_FILTER_PHASES = 1024;
+static const int MAX_FILTER_TAPS = 256;
+static const double KAISER_BETA = 8.0; // Gives about 80 dB stop-band attenuation.
+static const int MAX_CACHED_FILTERS = 64;
+
+
 AudioResampler::AudioResampler()
 {
+	history.resizeNoCopy(MAX_FILTER_TAPS * 2); // Big enough for any filter, so init calls don't need to allocate.
 	init(48000, 48000);
 }
 
 
-void AudioResampler::init(int src_rate_, int dest_rate_)
+static int64 greatestCommonDivisor(int64 a, int64 b)
+{
+	while(b != 0)
+	{
+		const int64 t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser window.
+static double besselI0(double x)
+{
+	double sum = 1;
+	double term = 1;
+	for(int k=1; k<50; ++k)
+	{
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if(term < sum * 1.0e-12)
+			break;
+	}
+	return sum;
+}
+
+
+// Returns NULL if the rate ratio needs too large a filter table.
+static Reference<ResamplingFilter> makeResamplingFilter(int L, int M)
+{
+	// Use 32 taps when upsampling.  When downsampling, the filter has to be wider in source samples, as the cutoff is lower.
+	const double downsampling_factor = myMax(1.0, (double)M / L);
+	const int num_taps = ((int)std::ceil(32 * downsampling_factor) + 3) / 4 * 4;
+	if(L > MAX_FILTER_PHASES || num_taps > MAX_FILTER_TAPS)
+		return NULL;
+
+	Reference<ResamplingFilter> filter = new ResamplingFilter();
+	filter->L = L;
+	filter->M = M;
+	filter->num_taps = num_taps;
+	filter->coeffs.resize((size_t)L * num_taps);
+
+	// Cutoff frequency in cycles per source sample.  Put the cutoff a little under the Nyquist frequency of the lower rate, so most of the transition band is below it.
+	const double cutoff = 0.46 / downsampling_factor;
+	const int H = num_taps / 2;
+	const double I0_beta = besselI0(KAISER_BETA);
+
+	for(int p=0; p<L; ++p)
+	{
+		// Tap t of phase p is applied to the source sample at distance d = t - H + 1 - p/L from the (delayed) destination sample position.
+		float* const phase_coeffs = &filter->coeffs[(size_t)p * num_taps];
+		double sum = 0;
+		for(int t=0; t<num_taps; ++t)
+		{
+			const double d = t - H + 1 - (double)p / L;
+			const double x = 2 * cutoff * d;
+			const double sinc = (x == 0) ? 1.0 : (std::sin(Maths::pi<double>() * x) / (Maths::pi<double>() * x));
+			const double r = d / H; // in [-1, 1]
+			const double window = besselI0(KAISER_BETA * std::sqrt(myMax(0.0, 1 - r*r))) / I0_beta;
+			const double h = 2 * cutoff * sinc * window;
+			phase_coeffs[t] = (float)h;
+			sum += h;
+		}
+
+		// Normalise so each phase has unit DC gain.
+		for(int t=0; t<num_taps; ++t)
+			phase_coeffs[t] = (float)(phase_coeffs[t] / sum);
+	}
+
+	return filter;
+}
+
+
+// Filter tables are cached, so that all sources with the same rates share a table.
+// Made tables are published in cached_filters, which can be searched without taking a lock, so that the mix thread can look them up.
+// Tables are never removed from the cache.
+static std::atomic<ResamplingFilter*> cached_filters[MAX_CACHED_FILTERS]; // Filled from the front.
+
+
+// Returns NULL if the table for L/M has not been made yet.  Doesn't take a lock or allocate.
+static ResamplingFilter* findCachedResamplingFilter(int L, int M)
+{
+	for(int i=0; i<MAX_CACHED_FILTERS; ++i)
+	{
+		ResamplingFilter* filter = cached_filters[i].load(std::memory_order_acquire);
+		if(!filter)
+			break;
+		if(filter->L == L && filter->M == M)
+			return filter;
+	}
+	return NULL;
+}
+
+
+static Reference<ResamplingFilter> getOrMakeResamplingFilter(int L, int M)
+{
+	ResamplingFilter* cached_filter = findCachedResamplingFilter(L, M);
+	if(cached_filter)
+		return cached_filter;
+
+	// Make the table without holding the lock, so that looking up other tables doesn't wait on it.
+	Reference<ResamplingFilter> filter = makeResamplingFilter(L, M); // Returns quickly if the ratio is not supported.
+	if(filter.isNull())
+		return NULL;
+
+	static Mutex mutex;
+	static std::vector<Reference<ResamplingFilter>> filter_refs; // Protected by mutex.  Keeps the tables in cached_filters alive.
+
+	Lock lock(mutex);
+	cached_filter = findCachedResamplingFilter(L, M); // Another thread may have made the same table in the meantime.
+	if(cached_filter)
+		return cached_filter;
+
+	if(filter_refs.size() < (size_t)MAX_CACHED_FILTERS) // If the cache is full, just return the table uncached.
+	{
+		filter_refs.push_back(filter);
+		cached_filters[filter_refs.size() - 1].store(filter.ptr(), std::memory_order_release);
+	}
+	return filter;
+}
+
+
+void AudioResampler::prepareFilter(int src_rate, int dest_rate)
+{
+	if(src_rate != dest_rate && src_rate > 0 && dest_rate > 0)
+	{
+		const int64 gcd = greatestCommonDivisor(src_rate, dest_rate);
+		getOrMakeResamplingFilter((int)(dest_rate / gcd), (int)(src_rate / gcd));
+	}
+}
+
+
+void AudioResampler::init(int src_rate_, int dest_rate_, Quality quality_)
+{
+	Reference<ResamplingFilter> new_filter;
+	if(quality_ == Quality_BandLimited && src_rate_ != dest_rate_ && src_rate_ > 0 && dest_rate_ > 0)
+	{
+		const int64 gcd = greatestCommonDivisor(src_rate_, dest_rate_);
+		new_filter = getOrMakeResamplingFilter((int)(dest_rate_ / gcd), (int)(src_rate_ / gcd));
+	}
+
+	initWithFilter(src_rate_, dest_rate_, new_filter.ptr());
+}
+
+
+void AudioResampler::initNonBlocking(int src_rate_, int dest_rate_)
+{
+	ResamplingFilter* new_filter = NULL;
+	if(src_rate_ != dest_rate_ && src_rate_ > 0 && dest_rate_ > 0)
+	{
+		const int64 gcd = greatestCommonDivisor(src_rate_, dest_rate_);
+		new_filter = findCachedResamplingFilter((int)(dest_rate_ / gcd), (int)(src_rate_ / gcd));
+	}
+
+	initWithFilter(src_rate_, dest_rate_, new_filter);
+}
+
+
+void AudioResampler::initWithFilter(int src_rate_, int dest_rate_, ResamplingFilter* new_filter)
 {
 	src_rate = src_rate_;
 	dest_rate = dest_rate_;
@@ -30,6 +203,19 @@ void AudioResampler::init(int src_rate_, int dest_rate_)
 	prev_samples_0_src_coords = -2;
 	prev_samples[0] = 0;
 	prev_samples[1] = 0;
+
+	filter = new_filter;
+	quality = filter.nonNull() ? Quality_BandLimited : Quality_Linear;
+	next_dest_i = 0;
+	num_src_consumed = 0;
+	if(filter.nonNull())
+	{
+		const size_t history_size = (size_t)filter->num_taps * 2;
+		if(history.size() < history_size) // history is made big enough for any filter in the constructor, so this shouldn't happen.
+			history.resizeNoCopy(history_size);
+		for(size_t i=0; i<history_size; ++i)
+			history[i] = 0;
+	}
 }
 
 
@@ -74,8 +260,158 @@ static void resampleFromContiguousBuffer(float* dest_samples, size_t num_dest, c
 }
 
 
+// Returns (x_0 + x_1) + (x_2 + x_3).  Sums in the same order as the transposed sum in resampleBandLimited(), so results don't depend on which path computes them.
+static inline float horizontalSum(const __m128 v)
+{
+	const __m128 sums = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1))); // (x_0 + x_1, x_1 + x_0, x_2 + x_3, x_3 + x_2)
+	return _mm_cvtss_f32(_mm_add_ss(sums, _mm_movehl_ps(sums, sums)));
+}
+
+
+// Returns the per-lane partial sums of src[t] * coeffs[t] for t in [0, num_taps).  coeffs must be 16-byte aligned.
+static inline __m128 filterPartialSums(const float* src, const float* coeffs, int num_taps)
+{
+	__m128 sum = _mm_mul_ps(_mm_loadu_ps(src), _mm_load_ps(coeffs));
+	for(int t=4; t<num_taps; t += 4)
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(src + t), _mm_load_ps(coeffs + t)));
+	return sum;
+}
+
+
+// Destination sample j is at source position j*M/L - num_taps/2 (delayed by half the filter length so we don't need source samples past floor(j*M/L)).
+// Writing j*M = c*L + p, the filter window for dest sample j covers the source samples [c - num_taps + 1, c], and uses the coefficients for phase p.
+void AudioResampler::resampleBandLimited(float* dest_samples, size_t dest_samples_size, const float* src_samples, size_t src_samples_size)
+{
+	const int L = filter->L;
+	const int M = filter->M;
+	const int num_taps = filter->num_taps;
+	const float* const coeffs = filter->coeffs.data();
+
+	const int64 chunk_begin = num_src_consumed; // Source index of src_samples[0]
+	const int64 chunk_end = chunk_begin + (int64)src_samples_size;
+
+	const int64 c_step = M / L;
+	const int64 p_step = M % L;
+
+	int64 c = next_dest_i * M / L;
+	int64 p = next_dest_i * M - c * L;
+
+	// Form a buffer with the last num_taps samples from the previous chunk, followed by the first num_taps samples of this chunk (or as many as there are),
+	// for the filter windows that straddle the start of the chunk.
+	float* const edge_buf = history.data(); // history is at least 2 * num_taps long, the first num_taps samples are the previous samples.
+	const size_t num_edge_src = myMin(src_samples_size, (size_t)num_taps);
+	std::memcpy(edge_buf + num_taps, src_samples, sizeof(float) * num_edge_src);
+	const int64 edge_begin = chunk_begin - num_taps; // Source index of edge_buf[0]
+	const int64 edge_end = chunk_begin + (int64)num_edge_src;
+
+	size_t i = 0;
+	while(i < dest_samples_size)
+	{
+		// Work out the window positions of the next 4 destination samples.
+		int64 group_c[4];
+		int64 group_p[4];
+		group_c[0] = c;
+		group_p[0] = p;
+		for(int k=1; k<4; ++k)
+		{
+			group_c[k] = group_c[k-1] + c_step;
+			group_p[k] = group_p[k-1] + p_step;
+			if(group_p[k] >= L)
+			{
+				group_p[k] -= L;
+				group_c[k]++;
+			}
+		}
+
+		// Windows for the 4 destination samples are contiguous in either src_samples (most of the time) or edge_buf.
+		const int64 window_0_begin = group_c[0] - num_taps + 1;
+		const float* buf = NULL;
+		int64 buf_begin = 0;
+		if(window_0_begin >= chunk_begin && group_c[3] < chunk_end)
+		{
+			buf = src_samples;
+			buf_begin = chunk_begin;
+		}
+		else if(window_0_begin >= edge_begin && group_c[3] < edge_end)
+		{
+			buf = edge_buf;
+			buf_begin = edge_begin;
+		}
+
+		if((i + 4 <= dest_samples_size) && buf)
+		{
+			__m128 sum0 = filterPartialSums(buf + (group_c[0] - num_taps + 1 - buf_begin), coeffs + group_p[0] * num_taps, num_taps);
+			__m128 sum1 = filterPartialSums(buf + (group_c[1] - num_taps + 1 - buf_begin), coeffs + group_p[1] * num_taps, num_taps);
+			__m128 sum2 = filterPartialSums(buf + (group_c[2] - num_taps + 1 - buf_begin), coeffs + group_p[2] * num_taps, num_taps);
+			__m128 sum3 = filterPartialSums(buf + (group_c[3] - num_taps + 1 - buf_begin), coeffs + group_p[3] * num_taps, num_taps);
+
+			// Transpose so we can do the 4 horizontal sums at once.
+			_MM_TRANSPOSE4_PS(sum0, sum1, sum2, sum3);
+			_mm_storeu_ps(dest_samples + i, _mm_add_ps(_mm_add_ps(sum0, sum1), _mm_add_ps(sum2, sum3)));
+
+			i += 4;
+			c = group_c[3] + c_step;
+			p = group_p[3] + p_step;
+		}
+		else
+		{
+			// Do a single destination sample.  Used at the end of the destination buffer, or where the group straddles the end of edge_buf.
+			const int64 window_begin = c - num_taps + 1;
+			float window[MAX_FILTER_TAPS];
+			const float* window_ptr;
+			if(window_begin >= chunk_begin && c < chunk_end)
+				window_ptr = src_samples + (window_begin - chunk_begin);
+			else if(window_begin >= edge_begin && c < edge_end)
+				window_ptr = edge_buf + (window_begin - edge_begin);
+			else
+			{
+				// We only get here if the caller passed less than numSrcSamplesNeeded() samples.  Treat the missing samples as zero.
+				for(int t=0; t<num_taps; ++t)
+				{
+					const int64 src_i = window_begin + t;
+					window[t] = (src_i >= chunk_begin && src_i < chunk_end) ? src_samples[src_i - chunk_begin] : ((src_i >= edge_begin && src_i < edge_end) ? edge_buf[src_i - edge_begin] : 0.f);
+				}
+				window_ptr = window;
+			}
+
+			dest_samples[i] = horizontalSum(filterPartialSums(window_ptr, coeffs + p * num_taps, num_taps));
+
+			i++;
+			c += c_step;
+			p += p_step;
+		}
+
+		if(p >= L)
+		{
+			p -= L;
+			c++;
+		}
+	}
+
+	next_dest_i += (int64)dest_samples_size;
+	num_src_consumed = chunk_end;
+
+	// Update history with the last num_taps source samples.
+	if(src_samples_size >= (size_t)num_taps)
+		std::memcpy(edge_buf, src_samples + (src_samples_size - num_taps), sizeof(float) * num_taps);
+	else
+		std::memmove(edge_buf, edge_buf + src_samples_size, sizeof(float) * num_taps); // edge_buf has the previous samples followed by all of src_samples.
+}
+
+
 size_t AudioResampler::numSrcSamplesNeeded(size_t dest_num_samples)
 {
+	if(quality == Quality_BandLimited)
+	{
+		if(dest_num_samples == 0)
+			return 0;
+
+		// We need source samples up to c = floor(j*M/L) for the last destination sample j.  See resampleBandLimited().
+		const int64 last_dest_i = next_dest_i + (int64)dest_num_samples - 1;
+		const int64 last_c = last_dest_i * filter->M / filter->L;
+		return (size_t)myMax<int64>(0, last_c + 1 - num_src_consumed);
+	}
+
 	const int64 max_dest_dst_coords = prev_dest_dst_coords + dest_num_samples; // Get destination coordinate for largest destination sample to be computed
 	const double max_dest_x_src_coords  = max_dest_dst_coords * (double)src_rate / (double)dest_rate; // Source coordinates for the new rightmost destination sample.
 
@@ -88,6 +424,12 @@ size_t AudioResampler::numSrcSamplesNeeded(size_t dest_num_samples)
 
 void AudioResampler::resample(float* dest_samples, size_t dest_samples_size, const float* src_samples, size_t src_samples_size, js::Vector<float, 16>& temp_buf)
 {
+	if(quality == Quality_BandLimited)
+	{
+		resampleBandLimited(dest_samples, dest_samples_size, src_samples, src_samples_size);
+		return;
+	}
+
 #if 1
 	// Simpler code that just forms a temporary buffer of source samples.  Less efficient due to copying of samples to the temp buffer.
 	
@@ -208,6 +550,9 @@ void AudioResampler::resample(float* dest_samples, size_t dest_samples_size, con
 
 
 #include <utils/TestUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+#include <vector>
 
 
 static void testResamplingLinearRamp(int src_sample_rate, int dest_sample_rate)
@@ -221,7 +566,7 @@ static void testResamplingLinearRamp(int src_sample_rate, int dest_sample_rate)
 		src_data[i] = (float)i;
 
 	glare::AudioResampler resampler;
-	resampler.init(src_sample_rate, dest_sample_rate);
+	resampler.init(src_sample_rate, dest_sample_rate, glare::AudioResampler::Quality_Linear);
 
 	const int dest_chunk_size = 4;
 	const int dest_N = dest_chunk_size * 10;
@@ -249,6 +594,195 @@ static void testResamplingLinearRamp(int src_sample_rate, int dest_sample_rate)
 }
 
 
+// Resamples all of src_data, or as much as possible, in chunks of dest samples with sizes from chunk_sizes (used cyclically).
+static void resampleAll(glare::AudioResampler& resampler, const std::vector<float>& src_data, const std::vector<size_t>& chunk_sizes, std::vector<float>& resampled_out)
+{
+	js::Vector<float, 16> temp_buf;
+	resampled_out.clear();
+	size_t src_i = 0;
+	for(size_t z=0; ; ++z)
+	{
+		const size_t chunk_size = chunk_sizes[z % chunk_sizes.size()];
+		const size_t num_src_needed = resampler.numSrcSamplesNeeded(chunk_size);
+		if(src_i + num_src_needed > src_data.size())
+			break;
+
+		resampled_out.resize(resampled_out.size() + chunk_size);
+		resampler.resample(&resampled_out[resampled_out.size() - chunk_size], chunk_size, src_data.data() + src_i, num_src_needed, temp_buf);
+		src_i += num_src_needed;
+	}
+}
+
+
+static void testBandLimitedDC(int src_sample_rate, int dest_sample_rate)
+{
+	std::vector<float> src_data(20000, 1.f);
+
+	glare::AudioResampler resampler;
+	resampler.init(src_sample_rate, dest_sample_rate);
+	testAssert(resampler.getQuality() == glare::AudioResampler::Quality_BandLimited);
+
+	std::vector<float> resampled;
+	resampleAll(resampler, src_data, std::vector<size_t>(1, 256), resampled);
+	testAssert(resampled.size() > 1000);
+
+	// Skip the samples affected by the zero history at the start.
+	const size_t num_warmup = (size_t)std::ceil(2.0 * resampler.getDelay() * dest_sample_rate / src_sample_rate) + 1;
+	for(size_t i=num_warmup; i<resampled.size(); ++i)
+		testAssert(std::fabs(resampled[i] - 1.f) < 1.0e-5f);
+}
+
+
+// Check results don't depend on the chunk sizes used.
+static void testBandLimitedChunking(int src_sample_rate, int dest_sample_rate)
+{
+	PCG32 rng(1);
+	std::vector<float> src_data(20000);
+	for(size_t i=0; i<src_data.size(); ++i)
+		src_data[i] = rng.unitRandom() * 2 - 1;
+
+	glare::AudioResampler resampler;
+	resampler.init(src_sample_rate, dest_sample_rate);
+	std::vector<float> ref_resampled;
+	resampleAll(resampler, src_data, std::vector<size_t>(1, 1000), ref_resampled);
+
+	std::vector<size_t> chunk_sizes;
+	for(int i=0; i<100; ++i)
+		chunk_sizes.push_back(rng.nextUInt(300));
+
+	resampler.init(src_sample_rate, dest_sample_rate);
+	std::vector<float> resampled;
+	resampleAll(resampler, src_data, chunk_sizes, resampled);
+
+	const size_t N = myMin(resampled.size(), ref_resampled.size());
+	testAssert(N >= 2000);
+	for(size_t i=0; i<N; ++i)
+		testAssert(resampled[i] == ref_resampled[i]);
+}
+
+
+struct ToneResult
+{
+	double gain; // Amplitude of the output at the tone frequency.
+	double residual; // RMS of the output after removing the tone, relative to the RMS of a unit amplitude tone.  From aliasing, imaging, and other errors.
+};
+
+
+// Resamples a unit-amplitude sine tone with the given frequency, and fits a sinusoid of the same frequency to the output.
+static ToneResult resampleTone(int src_sample_rate, int dest_sample_rate, double freq, glare::AudioResampler::Quality quality)
+{
+	std::vector<float> src_data(src_sample_rate / 2);
+	for(size_t i=0; i<src_data.size(); ++i)
+		src_data[i] = (float)std::sin(Maths::get2Pi<double>() * freq * i / src_sample_rate);
+
+	glare::AudioResampler resampler;
+	resampler.init(src_sample_rate, dest_sample_rate, quality);
+	std::vector<float> resampled;
+	resampleAll(resampler, src_data, std::vector<size_t>(1, 256), resampled);
+
+	// Least-squares fit of a * sin(w k) + b * cos(w k) to the output, skipping the start.
+	const size_t begin = 1024;
+	const double w = Maths::get2Pi<double>() * freq / dest_sample_rate;
+	double ss = 0, sc = 0, cc = 0, ys = 0, yc = 0;
+	for(size_t k=begin; k<resampled.size(); ++k)
+	{
+		const double s = std::sin(w * k);
+		const double c = std::cos(w * k);
+		ss += s * s;
+		sc += s * c;
+		cc += c * c;
+		ys += resampled[k] * s;
+		yc += resampled[k] * c;
+	}
+	const double det = ss * cc - sc * sc;
+	const double a = (ys * cc - yc * sc) / det;
+	const double b = (yc * ss - ys * sc) / det;
+
+	double residual_sum = 0;
+	for(size_t k=begin; k<resampled.size(); ++k)
+		residual_sum += Maths::square(resampled[k] - (a * std::sin(w * k) + b * std::cos(w * k)));
+
+	ToneResult result;
+	result.gain = std::sqrt(a * a + b * b);
+	result.residual = std::sqrt(residual_sum / (resampled.size() - begin)) * std::sqrt(2.0);
+	return result;
+}
+
+
+static void testToneQuality(int src_sample_rate, int dest_sample_rate, double freq, double max_band_limited_residual, double min_band_limited_gain)
+{
+	const ToneResult linear = resampleTone(src_sample_rate, dest_sample_rate, freq, glare::AudioResampler::Quality_Linear);
+	const ToneResult band_limited = resampleTone(src_sample_rate, dest_sample_rate, freq, glare::AudioResampler::Quality_BandLimited);
+
+	conPrint(toString(src_sample_rate) + " -> " + toString(dest_sample_rate) + " hz, " + toString((int)freq) + " hz tone: linear: gain " + doubleToStringNSigFigs(linear.gain, 4) +
+		", residual " + doubleToStringNSigFigs(20 * std::log10(linear.residual), 3) + " dB, band-limited: gain " + doubleToStringNSigFigs(band_limited.gain, 4) +
+		", residual " + doubleToStringNSigFigs(20 * std::log10(band_limited.residual), 3) + " dB");
+
+	testAssert(band_limited.residual <= max_band_limited_residual);
+	testAssert(band_limited.residual <= linear.residual);
+	testAssert(band_limited.gain >= min_band_limited_gain && band_limited.gain <= 1.01);
+}
+
+
+// A tone above the destination Nyquist frequency should be removed when downsampling, instead of being aliased to a lower frequency.
+static void testDownsamplingAliasing(int src_sample_rate, int dest_sample_rate, double freq, double max_band_limited_rms)
+{
+	std::vector<float> src_data(src_sample_rate / 2);
+	for(size_t i=0; i<src_data.size(); ++i)
+		src_data[i] = (float)std::sin(Maths::get2Pi<double>() * freq * i / src_sample_rate);
+
+	double rms[2];
+	for(int q=0; q<2; ++q)
+	{
+		glare::AudioResampler resampler;
+		resampler.init(src_sample_rate, dest_sample_rate, (q == 0) ? glare::AudioResampler::Quality_Linear : glare::AudioResampler::Quality_BandLimited);
+		std::vector<float> resampled;
+		resampleAll(resampler, src_data, std::vector<size_t>(1, 256), resampled);
+
+		double sum = 0;
+		for(size_t k=1024; k<resampled.size(); ++k)
+			sum += Maths::square(resampled[k]);
+		rms[q] = std::sqrt(sum / (resampled.size() - 1024)) * std::sqrt(2.0); // Relative to RMS of unit amplitude tone.
+	}
+
+	conPrint(toString(src_sample_rate) + " -> " + toString(dest_sample_rate) + " hz, " + toString((int)freq) + " hz tone: aliased level: linear: " + doubleToStringNSigFigs(20 * std::log10(rms[0]), 3) +
+		" dB, band-limited: " + doubleToStringNSigFigs(20 * std::log10(rms[1]), 3) + " dB");
+
+	testAssert(rms[1] <= max_band_limited_rms);
+}
+
+
+static void benchmarkResampler(int src_sample_rate, int dest_sample_rate)
+{
+	const size_t dest_chunk_size = 256; // Same as the audio engine buffer size.
+	std::vector<float> src_data(src_sample_rate * 4);
+	PCG32 rng(1);
+	for(size_t i=0; i<src_data.size(); ++i)
+		src_data[i] = rng.unitRandom() * 2 - 1;
+
+	double ns_per_sample[2];
+	for(int q=0; q<2; ++q)
+	{
+		glare::AudioResampler resampler;
+		resampler.init(src_sample_rate, dest_sample_rate, (q == 0) ? glare::AudioResampler::Quality_Linear : glare::AudioResampler::Quality_BandLimited);
+
+		std::vector<float> resampled;
+		double min_time = 1.0e10;
+		for(int trial=0; trial<5; ++trial)
+		{
+			resampler.init(src_sample_rate, dest_sample_rate, resampler.getQuality());
+			Timer timer;
+			resampleAll(resampler, src_data, std::vector<size_t>(1, dest_chunk_size), resampled);
+			min_time = myMin(min_time, timer.elapsed());
+		}
+		ns_per_sample[q] = min_time * 1.0e9 / resampled.size();
+	}
+
+	conPrint(toString(src_sample_rate) + " -> " + toString(dest_sample_rate) + " hz: linear: " + doubleToStringNSigFigs(ns_per_sample[0], 3) + " ns/sample, band-limited: " +
+		doubleToStringNSigFigs(ns_per_sample[1], 3) + " ns/sample");
+}
+
+
 void glare::AudioResampler::test()
 {
 	testResamplingLinearRamp(/*src rate=*/8000, /*dest rate=*/48000);
@@ -271,20 +805,62 @@ void glare::AudioResampler::test()
 	
 	testResamplingLinearRamp(/*src rate=*/44100, /*dest rate=*/44100);
 
+	// Test band-limited mode is used for the common rates, and falls back to linear for others.
+	{
+		AudioResampler resampler;
+		resampler.init(44100, 48000);
+		testAssert(resampler.getQuality() == Quality_BandLimited);
+		resampler.init(48000, 48000);
+		testAssert(resampler.getQuality() == Quality_Linear);
+		resampler.init(44100, 48000, Quality_Linear);
+		testAssert(resampler.getQuality() == Quality_Linear);
+		resampler.init(44101, 48000); // Reduced ratio is 48000/44101, too many phases.
+		testAssert(resampler.getQuality() == Quality_Linear);
+	}
 
+	// Test initNonBlocking() only uses filter tables that have already been made.
 	{
-		
-		//// Test with 1 hz sine tone
-		//for(int i=0; i<N; ++i)
-		//{
-		//	const double x = i / 44100.0;
-		//	const double val = std::sin(1.0 * Maths::get2Pi<double>() * x);
-		//	src_data[i] = val;
-		//}
+		AudioResampler resampler;
+		resampler.initNonBlocking(44100, 48000); // Made by init() above.
+		testAssert(resampler.getQuality() == Quality_BandLimited);
+		// The filter table cache is process-wide, and can't be cleared as it may be in use by a running AudioEngine, so use a rate pair that nothing else prepares.
+		// That way the result doesn't depend on which tests or engines have run before in this process.
+		resampler.initNonBlocking(1000, 1001); // 1001/1000, not made yet.
+		testAssert(resampler.getQuality() == Quality_Linear);
+		AudioResampler::prepareFilter(1000, 1001);
+		resampler.initNonBlocking(1000, 1001);
+		testAssert(resampler.getQuality() == Quality_BandLimited);
+		resampler.initNonBlocking(48000, 48000);
+		testAssert(resampler.getQuality() == Quality_Linear);
+		AudioResampler::prepareFilter(44101, 48000); // Unsupported ratio, should do nothing.
+		resampler.initNonBlocking(44101, 48000);
+		testAssert(resampler.getQuality() == Quality_Linear);
+	}
 
+	const int rate_pairs[][2] = { { 8000, 48000 }, { 16000, 48000 }, { 22050, 48000 }, { 24000, 48000 }, { 32000, 48000 }, { 44100, 48000 }, { 48000, 44100 }, { 16000, 44100 }, { 48000, 16000 }, { 48000, 8000 } };
+	for(size_t i=0; i<staticArrayNumElems(rate_pairs); ++i)
+	{
+		testBandLimitedDC(rate_pairs[i][0], rate_pairs[i][1]);
+		testBandLimitedChunking(rate_pairs[i][0], rate_pairs[i][1]);
 	}
 
+	// Quality tests against linear interpolation
+	testToneQuality(44100, 48000, /*freq=*/1000,  /*max_band_limited_residual=*/1.0e-3, /*min_band_limited_gain=*/0.99);
+	testToneQuality(44100, 48000, /*freq=*/10000, /*max_band_limited_residual=*/1.0e-3, /*min_band_limited_gain=*/0.99);
+	testToneQuality(44100, 48000, /*freq=*/16000, /*max_band_limited_residual=*/1.0e-3, /*min_band_limited_gain=*/0.9);
+	testToneQuality(24000, 48000, /*freq=*/8000,  /*max_band_limited_residual=*/1.0e-3, /*min_band_limited_gain=*/0.99);
+	testToneQuality(48000, 44100, /*freq=*/1000,  /*max_band_limited_residual=*/1.0e-3, /*min_band_limited_gain=*/0.99);
+	testDownsamplingAliasing(48000, 44100, /*freq=*/23000, /*max_band_limited_rms=*/1.0e-2); // 23 khz is in the transition band of the filter, so not fully removed.
+	testDownsamplingAliasing(48000, 16000, /*freq=*/12000, /*max_band_limited_rms=*/1.0e-3);
+
+	// Micro-benchmark
+	if(false)
+	{
+		benchmarkResampler(44100, 48000);
+		benchmarkResampler(24000, 48000);
+		benchmarkResampler(48000, 44100);
+	}
 }
 
 
-#endif // BUILD_TESTS
\ No newline at end of file
+#endif // BUILD_TESTS
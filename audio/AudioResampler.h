@@ -9,36 +9,88 @@ Copyright Glare Technologies Limited 2023 -
 #include <utils/MessageableThread.h>
 #include <utils/AtomicInt.h>
 #include <utils/Vector.h>
+#include <utils/Reference.h>
+#include <utils/ThreadSafeRefCounted.h>
 
 
 namespace glare
 {
 
 
+// Polyphase windowed-sinc filter table for resampling by the rational factor L/M.
+// Immutable once made, and shared between resamplers with the same rate ratio.
+struct ResamplingFilter : public ThreadSafeRefCounted
+{
+	int L; // dest rate / gcd(src rate, dest rate)
+	int M; // src rate / gcd(src rate, dest rate)
+	int num_taps; // Number of filter taps per phase.  A multiple of 4.
+	js::Vector<float, 16> coeffs; // L phases * num_taps coefficients.
+};
+
+
 /*=====================================================================
 AudioResampler
 --------------
+Resamples a stream of mono audio, given in chunks, from src_rate to dest_rate.
+
+Quality_BandLimited uses a polyphase windowed-sinc filter, evaluated with SSE 4 destination samples at a time, reading directly from the source chunk
+(except for the first few destination samples of each chunk, whose filter windows include samples from the previous chunk).
+This is used when the reduced rate ratio L/M is small enough for a filter table (all the common audio rate pairs, e.g. 44100 -> 48000 is 160/147),
+otherwise linear interpolation is used.
+The filter delays the signal by half the filter length, num_taps/2 source samples.
 
+Quality_Linear does linear interpolation between source samples, which aliases, but has no delay.
 =====================================================================*/
 class AudioResampler
 {
 public:
+	enum Quality
+	{
+		Quality_Linear,
+		Quality_BandLimited
+	};
+
 	AudioResampler();
 
-	void init(int src_rate, int dest_rate);
+	// May take a lock and make the filter table for the rates, so shouldn't be called from the mix thread.  Use initNonBlocking() there.
+	void init(int src_rate, int dest_rate, Quality quality = Quality_BandLimited);
+
+	// Like init() with Quality_BandLimited, but doesn't take a lock, allocate, or make a filter table, so can be called from the mix thread.
+	// Uses Quality_BandLimited only if the filter table for the rates was already made by prepareFilter() or init(), otherwise uses Quality_Linear.
+	void initNonBlocking(int src_rate, int dest_rate);
+
+	// Makes the filter table for resampling from src_rate to dest_rate if it hasn't been made yet, for later use by initNonBlocking().  threadsafe.
+	static void prepareFilter(int src_rate, int dest_rate);
+
+	Quality getQuality() const { return quality; } // Quality actually used, may be Quality_Linear if Quality_BandLimited was requested but not supported for the rates.
+	int getDelay() const { return (quality == Quality_BandLimited) ? (filter->num_taps / 2) : 0; } // Delay of the output signal, in source samples.
 
 	size_t numSrcSamplesNeeded(size_t dest_num_samples);
 
+	// src_samples_size should be numSrcSamplesNeeded(dest_samples_size).
+	// temp_buf is only used by Quality_Linear.
 	void resample(float* dest_samples, size_t dest_samples_size, const float* src_samples, size_t src_samples_size, js::Vector<float, 16>& temp_buf);
 
 	static void test();
 
 private:
+	void initWithFilter(int src_rate, int dest_rate, ResamplingFilter* filter);
+	void resampleBandLimited(float* dest_samples, size_t dest_samples_size, const float* src_samples, size_t src_samples_size);
+
 	int src_rate, dest_rate;
+	Quality quality;
+
+	// Quality_Linear state:
 	int64 prev_dest_dst_coords; // Destination coord of largest dest sample we have returned.
 	
 	int64 prev_samples_0_src_coords; // Source coordinates for prev_samples[0]
 	float prev_samples[2];
+
+	// Quality_BandLimited state:
+	Reference<ResamplingFilter> filter;
+	int64 next_dest_i; // Index of the next destination sample to compute.
+	int64 num_src_consumed; // Total number of source samples passed to resample().
+	js::Vector<float, 16> history; // The last filter->num_taps source samples passed to resample(), followed by space for the first num_taps samples of the next chunk.  Sized for the largest filter.
 };
 
 
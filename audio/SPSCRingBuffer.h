@@ -0,0 +1,192 @@
+/*=====================================================================
+SPSCRingBuffer.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/Platform.h>
+#include <maths/mathstypes.h>
+#include <atomic>
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+
+namespace glare
+{
+
+
+/*=====================================================================
+SPSCRingBuffer
+--------------
+Fixed-capacity, lock-free, single-producer single-consumer queue.
+
+One thread may push items (the producer) while another thread pops items (the consumer), without either ever waiting on a lock.
+If there are multiple producer threads, they need to be serialised with a lock of their own, likewise for multiple consumers.
+
+Capacity is rounded up to a power of two, and is set with init(), which is not threadsafe.
+Pushing never allocates: if the buffer is full, items that don't fit are not pushed.
+
+For non-trivially-copyable item types (e.g. References), popped slots are reset to T(), so the buffer doesn't hold on to popped items.
+=====================================================================*/
+template <class T>
+class SPSCRingBuffer
+{
+public:
+	SPSCRingBuffer() : mask(0), write_index(0), read_index(0) {}
+
+	// Not threadsafe.  Removes any items in the buffer.
+	void init(size_t min_capacity)
+	{
+		size_t cap = 1;
+		while(cap < min_capacity)
+			cap *= 2;
+
+		data.clear();
+		data.resize(cap);
+		mask = cap - 1;
+		write_index.store(0);
+		read_index.store(0);
+	}
+
+	size_t capacity() const { return data.size(); }
+
+	// May be called from either thread.  The result may be out of date by the time it is used, but from the producer thread it is a lower bound on the free space,
+	// and from the consumer thread it is a lower bound on the number of items that can be popped.
+	size_t size() const
+	{
+		const size_t r = read_index.load(std::memory_order_acquire); // Load read index first, so that r <= w.
+		const size_t w = write_index.load(std::memory_order_acquire);
+		return w - r;
+	}
+
+	bool empty() const { return size() == 0; }
+
+	//------------------------------------- Producer thread -------------------------------------
+
+	// Pushes as many items as will fit, up to n.  Returns the number of items pushed.
+	size_t pushBackNItems(const T* items, size_t n)
+	{
+		const size_t w = write_index.load(std::memory_order_relaxed);
+		const size_t r = read_index.load(std::memory_order_acquire);
+		const size_t num = myMin(n, data.size() - (w - r));
+		if(num == 0)
+			return 0;
+
+		const size_t begin = w & mask;
+		const size_t num_1 = myMin(num, data.size() - begin); // Number of items before wrapping around
+		std::copy(items, items + num_1, data.begin() + begin);
+		std::copy(items + num_1, items + num, data.begin());
+
+		write_index.store(w + num, std::memory_order_release);
+		return num;
+	}
+
+	bool pushBack(const T& item) { return pushBackNItems(&item, 1) == 1; }
+
+	// Pushes item and resets it to T(), if there is space.  Returns false, leaving item unchanged, if the buffer is full.
+	// item is reset before the push is visible to the consumer, so for References, the consumer is guaranteed to hold the last reference the producer had.
+	bool pushBackAndReset(T& item)
+	{
+		const size_t w = write_index.load(std::memory_order_relaxed);
+		const size_t r = read_index.load(std::memory_order_acquire);
+		if(w - r == data.size())
+			return false;
+
+		data[w & mask] = item;
+		item = T();
+
+		write_index.store(w + 1, std::memory_order_release);
+		return true;
+	}
+
+	//------------------------------------- Consumer thread -------------------------------------
+
+	// Pops min(n, size()) items to dest.  Returns the number of items popped.
+	size_t popFrontUpToNItems(T* dest, size_t n)
+	{
+		const size_t r = read_index.load(std::memory_order_relaxed);
+		const size_t w = write_index.load(std::memory_order_acquire);
+		return doPop(dest, r, myMin(n, w - r));
+	}
+
+	// Pops exactly n items to dest, if there are at least n items in the buffer.  Otherwise pops nothing and returns false.
+	bool popFrontNItems(T* dest, size_t n)
+	{
+		const size_t r = read_index.load(std::memory_order_relaxed);
+		const size_t w = write_index.load(std::memory_order_acquire);
+		if(w - r < n)
+			return false;
+		doPop(dest, r, n);
+		return true;
+	}
+
+	bool popFront(T& item_out) { return popFrontNItems(&item_out, 1); }
+
+	// Pops and discards up to n items.  Returns the number of items discarded.
+	size_t discardFrontNItems(size_t n)
+	{
+		return popFrontUpToNItems(/*dest=*/NULL, n);
+	}
+
+	//-------------------------------------------------------------------------------------------
+
+	// Replaces the contents of this buffer with a copy of the items currently in other.
+	// Other's consumer may pop concurrently, but other's producer must not push concurrently, and this buffer must not be in use by any other thread.
+	void copyFrom(const SPSCRingBuffer<T>& other)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "copyFrom() requires trivially copyable items, as the source consumer may be popping concurrently");
+
+		if(data.size() < other.data.size())
+			init(other.data.size());
+
+		const size_t w = other.write_index.load(std::memory_order_acquire);
+		const size_t r = other.read_index.load(std::memory_order_acquire); // Items in [r, w) won't be overwritten, as other's producer is not running.
+		for(size_t i=r; i!=w; ++i)
+			data[i - r] = other.data[i & other.mask];
+
+		read_index.store(0);
+		write_index.store(w - r);
+	}
+
+private:
+	GLARE_DISABLE_COPY(SPSCRingBuffer);
+
+	size_t doPop(T* dest, size_t r, size_t num)
+	{
+		if(num == 0)
+			return 0;
+
+		const size_t begin = r & mask;
+		const size_t num_1 = myMin(num, data.size() - begin); // Number of items before wrapping around
+		if(dest)
+		{
+			std::move(data.begin() + begin, data.begin() + begin + num_1, dest);
+			std::move(data.begin(), data.begin() + (num - num_1), dest + num_1);
+		}
+
+		if(!std::is_trivially_copyable<T>::value)
+		{
+			std::fill(data.begin() + begin, data.begin() + begin + num_1, T());
+			std::fill(data.begin(), data.begin() + (num - num_1), T());
+		}
+
+		read_index.store(r + num, std::memory_order_release);
+		return num;
+	}
+
+	std::vector<T> data;
+	size_t mask;
+
+	// Indices increase monotonically (wrapping around at 2^64), and are masked to get the slot index.  Kept on separate cache lines so the producer and consumer don't contend.
+	uint8 padding_0[64];
+	std::atomic<size_t> write_index; // Only written by the producer.
+	uint8 padding_1[64];
+	std::atomic<size_t> read_index; // Only written by the consumer.
+	uint8 padding_2[64];
+};
+
+
+} // end namespace glare
@@ -91,11 +91,12 @@ void StreamerThread::doRun()
 							source->buffer.pushBackNItems(mono_samples.data(), mono_samples.size());
 							if(sample_freq_hz != 0)
 							{
-								// If we have read a sample rate from the mp3 file and it differs from the default, re-init the resampler.
-								if(source->sampling_rate != sample_freq_hz)
+								// If we have read a sample rate from the mp3 file and it differs from the default, get the mix thread to re-init the resampler.
+								// Make the filter table for the new rate here, as the mix thread won't.
+								if(source->requested_sampling_rate.load(std::memory_order_relaxed) != sample_freq_hz)
 								{
-									source->sampling_rate = sample_freq_hz;
-									source->resampler.init(/*src rate=*/sample_freq_hz, /*dest rate*/audio_engine->getSampleRate());
+									AudioResampler::prepareFilter(sample_freq_hz, (int)audio_engine->getSampleRate());
+									source->requested_sampling_rate.store(sample_freq_hz, std::memory_order_release);
 								}
 							}
 						}
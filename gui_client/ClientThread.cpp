@@ -14,6 +14,8 @@ Copyright Glare Technologies Limited 2022 -
 #include <graphics/BatchedMesh.h>
 #include "../shared/Protocol.h"
 #include "../shared/ProtocolStructs.h"
+#include "../shared/QuantizedTransformUpdates.h"
+#include "../shared/CompressedMessages.h"
 #include "../shared/Parcel.h"
 #include <networking/Networking.h>
 #include <vec3.h>
@@ -40,7 +42,8 @@ ClientThread::ClientThread(ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_q
 	all_objects_received(false),
 	config(config_),
 	world_ob_pool_allocator(world_ob_pool_allocator_),
-	send_data_to_socket(false)
+	send_data_to_socket(false),
+	decompressed_msgs_offset(0)
 {
 #if !defined(EMSCRIPTEN)
 	MySocketRef mysocket = new MySocket();
@@ -102,6 +105,80 @@ WorldObjectRef ClientThread::allocWorldObject()
 }
 
 
+// world_state->mutex should be held.
+void ClientThread::handleAvatarTransformUpdate(const UID& avatar_uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state_and_input_bitflags)
+{
+	// Look up existing avatar in world state
+	auto res = world_state->avatars.find(avatar_uid);
+	if(res != world_state->avatars.end())
+	{
+		Avatar* avatar = res->second.getPointer();
+		avatar->pos = pos;
+		avatar->rotation = rotation;
+		avatar->anim_state = anim_state_and_input_bitflags & 0xFF;
+		avatar->last_physics_input_bitflags = anim_state_and_input_bitflags >> 16;
+		avatar->transform_dirty = true;
+
+		//conPrint("updated avatar transform");
+
+		avatar->pos_snapshots      [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = pos;
+		avatar->rotation_snapshots [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = rotation;
+		avatar->snapshot_times     [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = Clock::getTimeSinceInit();
+		//avatar->last_snapshot_time = Clock::getCurTimeRealSec();
+		avatar->next_snapshot_i++;
+	}
+}
+
+
+// world_state->mutex should be held.
+void ClientThread::handleObjectPhysicsTransformUpdate(const UID& object_uid, const Vec3d& pos, const Quatf& rot, const Vec4f& linear_vel, const Vec4f& angular_vel, 
+	uint32 transform_update_avatar_uid, double transform_client_time)
+{
+	// Look up existing object in world state
+	auto res = world_state->objects.find(object_uid);
+	if(res != world_state->objects.end())
+	{
+		WorldObject* ob = res.getValue().ptr();
+
+		if(ob->physics_owner_id == transform_update_avatar_uid) // Only process messages that are from the physics owner of this object, discard others.
+		{
+			// If we had non-physics snapshots, reset snapshots.
+			if(!ob->snapshots_are_physics_snapshots)
+			{
+				// conPrint("Resetting snapshots.");
+				ob->next_insertable_snapshot_i = 0;
+				ob->next_snapshot_i = 0;
+			}
+			ob->snapshots_are_physics_snapshots = true;
+
+			const double local_time = Clock::getTimeSinceInit();
+
+			ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = WorldObject::Snapshot({pos.toVec4fPoint(), rot, linear_vel, angular_vel, transform_client_time, local_time});
+
+			ob->next_snapshot_i++;
+
+			// conPrint("ClientThread: Added snapshot " + toString(ob->next_snapshot_i));
+
+			//NEW: Compute transmission_time_offset: An estimate of local_clock_time - sending_clock_time.
+			// TODO: Handle a different client taking over sending messages.
+			/*if(ob->transmission_time_offset == std::numeric_limits<double>::infinity())
+			{
+				ob->transmission_time_offset = Clock::getTimeSinceInit() - last_transform_client_time;
+
+				conPrint("Storing new ob->transmission_time_offset: " + doubleToString(ob->transmission_time_offset));
+			}*/
+
+			ob->from_remote_physics_transform_dirty = true;
+			world_state->dirty_from_remote_objects.insert(ob);
+		}
+		else
+		{
+			// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as not from physics owner of object.");
+		}
+	}
+}
+
+
 void ClientThread::doRun()
 {
 	PlatformUtils::setCurrentThreadNameIfTestsEnabled("ClientThread");
@@ -220,6 +297,15 @@ void ClientThread::doRun()
 				return;
 			}
 
+			uint32 msg_type = 0;
+			bool have_msg = false;
+			if(decompressed_msgs_offset < decompressed_msgs.size())
+			{
+				// Handle the next message from the last CompressedMessages message received, before reading any more from the socket.
+				msg_type = CompressedMessages::readNextMessage(decompressed_msgs, decompressed_msgs_offset, msg_buffer); // Copies message to msg_buffer.
+				have_msg = true;
+			}
+			else
 #if defined(_WIN32) || defined(OSX) || defined(EMSCRIPTEN)
 			if(socket->readable(/*timeout (s)=*/0.1)) // If socket has some data to read from it:  (Use a timeout so we can check should_die occasionally)
 #else
@@ -229,7 +315,7 @@ void ClientThread::doRun()
 				// Read msg type and length
 				uint32 msg_type_and_len[2];
 				socket->readData(msg_type_and_len, sizeof(uint32) * 2);
-				const uint32 msg_type = msg_type_and_len[0];
+				msg_type = msg_type_and_len[0];
 				const uint32 msg_len = msg_type_and_len[1];
 				
 				// conPrint("ClientThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
@@ -243,6 +329,30 @@ void ClientThread::doRun()
 
 				socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
 
+				if(msg_type == Protocol::CompressedMessages)
+				{
+					// Decompress the contained messages.  They are handled one at a time in the following loop iterations.
+					CompressedMessages::decompressMessages(msg_buffer, decompressed_msgs);
+					decompressed_msgs_offset = 0;
+				}
+				else
+					have_msg = true;
+			}
+			else
+			{
+#if defined(_WIN32) || defined(OSX) || defined(EMSCRIPTEN)
+#else
+				// conPrint("WorkerThread: event FD was signalled.");
+
+				// The event FD was signalled, which means should_die has been set.
+				event_fd.read(); // Reset the event fd by reading from it.
+
+				// conPrint("WorkerThread: event FD has been reset.");
+#endif
+			}
+
+			if(have_msg)
+			{
 				switch(msg_type)
 				{
 				case Protocol::AllObjectsSent:
@@ -283,28 +393,8 @@ void ClientThread::doRun()
 						const Vec3f rotation = readVec3FromStream<float>(msg_buffer);
 						const uint32 anim_state_and_input_bitflags = msg_buffer.readUInt32();
 
-						// Look up existing avatar in world state
-						{
-							Lock lock(world_state->mutex);
-							auto res = world_state->avatars.find(avatar_uid);
-							if(res != world_state->avatars.end())
-							{
-								Avatar* avatar = res->second.getPointer();
-								avatar->pos = pos;
-								avatar->rotation = rotation;
-								avatar->anim_state = anim_state_and_input_bitflags & 0xFF;
-								avatar->last_physics_input_bitflags = anim_state_and_input_bitflags >> 16;
-								avatar->transform_dirty = true;
-
-								//conPrint("updated avatar transform");
-
-								avatar->pos_snapshots      [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = pos;
-								avatar->rotation_snapshots [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = rotation;
-								avatar->snapshot_times     [Maths::intMod(avatar->next_snapshot_i, Avatar::HISTORY_BUF_SIZE)] = Clock::getTimeSinceInit();
-								//avatar->last_snapshot_time = Clock::getCurTimeRealSec();
-								avatar->next_snapshot_i++;
-							}
-						}
+						Lock lock(world_state->mutex);
+						handleAvatarTransformUpdate(avatar_uid, pos, rotation, anim_state_and_input_bitflags);
 						break;
 					}
 				case Protocol::AvatarFullUpdate:
@@ -603,55 +693,37 @@ void ClientThread::doRun()
 
 						if(transform_update_avatar_uid != (uint32)this->client_avatar_uid.value()) // Discard ObjectPhysicsTransformUpdate messages we sent.
 						{
-							// Look up existing object in world state
 							Lock lock(world_state->mutex);
-							auto res = world_state->objects.find(object_uid);
-							if(res != world_state->objects.end())
-							{
-								WorldObject* ob = res.getValue().ptr();
-
-								if(ob->physics_owner_id == transform_update_avatar_uid) // Only process messages that are from the physics owner of this object, discard others.
-								{
-									// If we had non-physics snapshots, reset snapshots.
-									if(!ob->snapshots_are_physics_snapshots)
-									{
-										// conPrint("Resetting snapshots.");
-										ob->next_insertable_snapshot_i = 0;
-										ob->next_snapshot_i = 0;
-									}
-									ob->snapshots_are_physics_snapshots = true;
-
-									const double local_time = Clock::getTimeSinceInit();
-
-									ob->snapshots[ob->next_snapshot_i % (uint32)WorldObject::HISTORY_BUF_SIZE] = WorldObject::Snapshot({pos.toVec4fPoint(), rot, linear_vel, angular_vel, transform_client_time, local_time});
-
-									ob->next_snapshot_i++;
-
-									// conPrint("ClientThread: Added snapshot " + toString(ob->next_snapshot_i));
-
-									//NEW: Compute transmission_time_offset: An estimate of local_clock_time - sending_clock_time.
-									// TODO: Handle a different client taking over sending messages.
-									/*if(ob->transmission_time_offset == std::numeric_limits<double>::infinity())
-									{
-										ob->transmission_time_offset = Clock::getTimeSinceInit() - last_transform_client_time;
-
-										conPrint("Storing new ob->transmission_time_offset: " + doubleToString(ob->transmission_time_offset));
-									}*/
-
-									ob->from_remote_physics_transform_dirty = true;
-									world_state->dirty_from_remote_objects.insert(ob);
-								}
-								else
-								{
-									// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as not from physics owner of object.");
-								}
-							}
+							handleObjectPhysicsTransformUpdate(object_uid, pos, rot, linear_vel, angular_vel, transform_update_avatar_uid, transform_client_time);
 						}
 						else
 						{
 							// conPrint("\tDiscarding ObjectPhysicsTransformUpdate message as we sent it.");
 						}
 
+						break;
+					}
+				case Protocol::QuantizedTransformUpdates:
+					{
+						// Multiple avatar and object physics transform updates.  Sent instead of AvatarTransformUpdate and ObjectPhysicsTransformUpdate by servers with protocol version >= 40.
+						QuantizedTransformUpdates::readUpdates(msg_buffer, temp_quantized_updates); // Read message data before grabbing lock
+
+						Lock lock(world_state->mutex);
+						for(size_t i=0; i<temp_quantized_updates.size(); ++i)
+						{
+							const QuantizedTransformUpdate& update = temp_quantized_updates[i];
+							if(update.type == QuantizedTransformUpdate::Type_AvatarTransform)
+							{
+								handleAvatarTransformUpdate(UID(update.uid), QuantizedTransformUpdates::getPos(update), QuantizedTransformUpdates::getAvatarRotation(update), update.anim_state);
+							}
+							else
+							{
+								if(update.transform_update_avatar_uid != (uint32)this->client_avatar_uid.value()) // Discard updates we sent.
+									handleObjectPhysicsTransformUpdate(UID(update.uid), QuantizedTransformUpdates::getPos(update), QuantizedTransformUpdates::getRotation(update), 
+										QuantizedTransformUpdates::getLinearVel(update), QuantizedTransformUpdates::getAngularVel(update), update.transform_update_avatar_uid, 
+										QuantizedTransformUpdates::getClientTime(update));
+							}
+						}
 						break;
 					}
 				case Protocol::ObjectFullUpdate:
@@ -1088,18 +1160,6 @@ void ClientThread::doRun()
 					}
 				}
 			}
-			else
-			{
-#if defined(_WIN32) || defined(OSX) || defined(EMSCRIPTEN)
-#else
-				// conPrint("WorkerThread: event FD was signalled.");
-
-				// The event FD was signalled, which means should_die has been set.
-				event_fd.read(); // Reset the event fd by reading from it.
-
-				// conPrint("WorkerThread: event FD has been reset.");
-#endif
-			}
 		}
 	}
 	catch(MySocketExcep& e)
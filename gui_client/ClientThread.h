@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "../shared/WorldSettings.h"
+#include "../shared/QuantizedTransformUpdates.h"
 #include "WorldState.h"
 #include <MessageableThread.h>
 #include <Platform.h>
@@ -251,6 +252,9 @@ private:
 	UID client_avatar_uid;
 
 	WorldObjectRef allocWorldObject();
+	void handleAvatarTransformUpdate(const UID& avatar_uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state_and_input_bitflags);
+	void handleObjectPhysicsTransformUpdate(const UID& object_uid, const Vec3d& pos, const Quatf& rot, const Vec4f& linear_vel, const Vec4f& angular_vel, 
+		uint32 transform_update_avatar_uid, double transform_client_time);
 
 	glare::AtomicInt should_die;
 	ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_queue;
@@ -269,6 +273,10 @@ private:
 	bool send_data_to_socket;
 
 	BufferInStream msg_buffer;
+	std::vector<QuantizedTransformUpdate> temp_quantized_updates;
+
+	js::Vector<uint8, 16> decompressed_msgs; // Messages from the last CompressedMessages message received.
+	size_t decompressed_msgs_offset; // Offset of the next message in decompressed_msgs to handle.
 
 	Reference<glare::PoolAllocator> world_ob_pool_allocator;
 
@@ -226,19 +226,8 @@ void ClientUDPHandlerThread::doRun()
 												max_val = myMax(max_val, std::fabs(pcm_buffer[i]));
 											//printVar(max_val);
 
-											// Append to audio source buffer
-											Lock lock(audio_engine->mutex);
-
-											// If too much data is queued up for this audio source:
-											if(stream_info->avatar_audio_source->buffer.size() > 4096) // 4096 samples ~= 85 ms at 48 khz
-											{
-												// Pop all but 2048 items from the buffer.
-												const size_t num_samples_to_remove = stream_info->avatar_audio_source->buffer.size() - 2048;
-												conPrint("Audio source buffer too full, removing " + toString(num_samples_to_remove) + " samples");
-
-												stream_info->avatar_audio_source->buffer.popFrontNItems(num_samples_to_remove);
-											}
-
+											// Append to audio source buffer.  This thread is the only producer for the buffer, so no lock is needed.
+											// If too much data is queued up, the mix thread will drop the oldest data (see max_buffered_samples).
 											stream_info->avatar_audio_source->buffer.pushBackNItems(pcm_buffer.data(), num_samples_decoded);
 
 											stream_info->avatar_audio_source->smoothed_cur_level = myMax(stream_info->avatar_audio_source->smoothed_cur_level * 0.95f, max_val);
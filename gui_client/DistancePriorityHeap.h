@@ -0,0 +1,132 @@
+/*=====================================================================
+DistancePriorityHeap.h
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <Vector.h>
+#include <maths/Vec4.h>
+#include <vector>
+#include <algorithm>
+
+
+/*=====================================================================
+DistancePriorityHeap
+--------------------
+Binary min-heap of items, keyed by item.pos.getDist(campos) * item.size_factor, so the closest and largest items come out first.
+Used by DownloadingResourceQueue and LoadItemQueue.
+
+Items are stored in a slot array, with freed slots reused, and the heap itself just contains (priority, slot index) pairs,
+so heap operations don't move items around, and memory use is bounded by the max number of items in the heap at one time.
+
+push() and pop() are O(log n).  setCamPos() recomputes all priorities and rebuilds the heap in O(n) (instead of the O(n log n) for a full sort),
+and does nothing if the camera hasn't moved.
+
+Item must have 'Vec4f pos' and 'float size_factor' members.
+Not threadsafe.
+=====================================================================*/
+template <class Item>
+class DistancePriorityHeap
+{
+public:
+	DistancePriorityHeap() : campos(0, 0, 0, 1) {}
+
+	void push(const Item& item)
+	{
+		uint32 slot;
+		if(!free_slots.empty())
+		{
+			slot = free_slots.back();
+			free_slots.pop_back();
+			slots[slot] = item;
+		}
+		else
+		{
+			slot = (uint32)slots.size();
+			slots.push_back(item);
+		}
+
+		Entry entry;
+		entry.priority = priorityForItem(item);
+		entry.slot = slot;
+		heap.push_back(entry);
+		std::push_heap(heap.begin(), heap.end(), EntryGreaterThan());
+	}
+
+	// Returns the highest priority (lowest key) item.  Heap must be non-empty.
+	const Item& top() const
+	{
+		assert(!heap.empty());
+		return slots[heap.front().slot];
+	}
+
+	// Removes the highest priority item and moves it to item_out.  Heap must be non-empty.
+	void pop(Item& item_out)
+	{
+		assert(!heap.empty());
+
+		std::pop_heap(heap.begin(), heap.end(), EntryGreaterThan());
+		const uint32 slot = heap.back().slot;
+		heap.pop_back();
+
+		item_out = std::move(slots[slot]);
+		slots[slot] = Item(); // Release any references or strings held by the item now.
+
+		if(heap.empty())
+		{
+			slots.clear();
+			free_slots.clear();
+		}
+		else
+			free_slots.push_back(slot);
+	}
+
+	// Recomputes item priorities for the new camera position, and rebuilds the heap.
+	void setCamPos(const Vec4f& new_campos)
+	{
+		if(new_campos[0] == campos[0] && new_campos[1] == campos[1] && new_campos[2] == campos[2])
+			return;
+		campos = new_campos;
+
+		for(size_t i=0; i<heap.size(); ++i)
+			heap[i].priority = priorityForItem(slots[heap[i].slot]);
+
+		std::make_heap(heap.begin(), heap.end(), EntryGreaterThan());
+	}
+
+	void clear()
+	{
+		heap.clear();
+		slots.clear();
+		free_slots.clear();
+	}
+
+	const Vec4f& getCamPos() const { return campos; }
+
+	bool empty() const { return heap.empty(); }
+	size_t size() const { return heap.size(); }
+
+	size_t numSlots() const { return slots.size(); } // Number of item slots currently allocated, including free slots.  For tests.
+
+private:
+	struct Entry
+	{
+		float priority;
+		uint32 slot;
+	};
+
+	struct EntryGreaterThan
+	{
+		bool operator () (const Entry& a, const Entry& b) const { return a.priority > b.priority; } // std heap functions build a max-heap, so use greater-than to get a min-heap.
+	};
+
+	float priorityForItem(const Item& item) const { return item.pos.getDist(campos) * item.size_factor; }
+
+	std::vector<Entry> heap;
+	js::Vector<Item, 16> slots;
+	std::vector<uint32> free_slots;
+	Vec4f campos;
+};
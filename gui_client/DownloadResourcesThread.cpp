@@ -20,6 +20,8 @@ Copyright Glare Technologies Limited 2021 -
 #include <KillThreadMessage.h>
 #include <PlatformUtils.h>
 #include <FileOutStream.h>
+#include <Timer.h>
+#include <cmath>
 #if defined(EMSCRIPTEN)
 #include <emscripten/emscripten.h>
 #endif
@@ -33,7 +35,8 @@ DownloadResourcesThread::DownloadResourcesThread(ThreadSafeQueue<Reference<Threa
 	port(port_),
 	num_resources_downloading(num_resources_downloading_),
 	config(config_),
-	download_queue(download_queue_)
+	download_queue(download_queue_),
+	next_request_id(1)
 {
 	MySocketRef mysocket = new MySocket();
 	mysocket->setUseNetworkByteOrder(false);
@@ -147,6 +150,356 @@ static void onProgress(unsigned int, void* userdata_arg, int percent_complete)
 
 
 
+DownloadResourcesThread::ActiveDownload::~ActiveDownload()
+{
+	delete file;
+}
+
+
+#if !EMSCRIPTEN
+
+
+static const size_t MAX_NUM_OUTSTANDING_REQUESTS = 16; // Should be <= ResourceRequestScheduler::MAX_NUM_REQUESTS on the server.
+static const double PRIORITY_UPDATE_PERIOD = 0.25;
+
+
+static float downloadPriority(const Vec4f& pos, float size_factor, const Vec4f& campos)
+{
+	return pos.getDist(campos) * size_factor; // Same as the DownloadingResourceQueue priority.
+}
+
+
+// Returns the size of the partial file left by an interrupted or cancelled download, or 0 if there isn't one.
+static uint64 getPartialFileSize(const std::string& partial_path)
+{
+	try
+	{
+		if(FileUtils::fileExists(partial_path))
+			return FileUtils::getFileSize(partial_path);
+	}
+	catch(glare::Exception&)
+	{}
+	catch(FileUtils::FileUtilsExcep&)
+	{}
+	return 0;
+}
+
+
+void DownloadResourcesThread::sendResourceRequest(uint32 request_id, const ActiveDownload& download, uint64 start_offset)
+{
+	socket->writeUInt32(Protocol::ResourceRequest);
+	socket->writeUInt32(request_id);
+	socket->writeStringLengthFirst(download.URL);
+	socket->writeUInt64(start_offset); // Write start offset
+	socket->writeFloat(download.sent_priority);
+}
+
+
+void DownloadResourcesThread::requestQueuedResources(const Vec4f& campos)
+{
+	// Only block waiting for new items if there are no requests in progress, otherwise we want to get back to reading the data for them.
+	const double wait_time_s = active_downloads.empty() ? 0.1 : 0.0;
+	download_queue->dequeueItemsWithTimeOut(wait_time_s, /*max_num_items=*/MAX_NUM_OUTSTANDING_REQUESTS - active_downloads.size(), queue_items);
+
+	for(size_t i=0; i<queue_items.size(); ++i)
+	{
+		const DownloadQueueItem& item = queue_items[i];
+
+		if(resource_manager->isInDownloadFailedURLs(item.URL)) // Don't try to re-download if we already failed to download this session.
+			continue;
+
+		if(item.pos.getDist(campos) > item.max_dist) // If the object using the resource is already out of range, don't download it.
+			continue;
+
+		ResourceRef resource = resource_manager->getOrCreateResourceForURL(item.URL);
+		if(resource->getState() != Resource::State_NotPresent) // If already downloaded or being downloaded:
+			continue;
+		resource->setState(Resource::State_Transferring);
+		(*this->num_resources_downloading)++;
+
+		Reference<ActiveDownload> download = new ActiveDownload();
+		download->URL = item.URL;
+		download->resource = resource;
+		download->pos = item.pos;
+		download->size_factor = item.size_factor;
+		download->max_dist = item.max_dist;
+		download->sent_priority = downloadPriority(item.pos, item.size_factor, campos);
+		download->got_result = false;
+		download->file_len = 0;
+		download->offset = 0;
+
+		const uint32 request_id = next_request_id++;
+		active_downloads[request_id] = download;
+
+		// If a previous download of this resource was interrupted or cancelled, ask for just the rest of the file.
+		const uint64 partial_size = getPartialFileSize(resource_manager->getLocalAbsPathForResource(*resource) + "_partial");
+
+		sendResourceRequest(request_id, *download, /*start offset=*/partial_size);
+	}
+}
+
+
+void DownloadResourcesThread::updateRequestPriorities(const Vec4f& campos)
+{
+	for(auto it = active_downloads.begin(); it != active_downloads.end(); )
+	{
+		const uint32 request_id = it->first;
+		ActiveDownload* download = it->second.ptr();
+
+		if(download->pos.getDist(campos) > download->max_dist)
+		{
+			// The object using the resource has gone out of range.  Cancel the request.
+			// Any partial file is kept, so the download can be resumed if the object comes back into range.
+			socket->writeUInt32(Protocol::ResourceRequestCancel);
+			socket->writeUInt32(request_id);
+
+			// conPrint("DownloadResourcesThread: Cancelled download of '" + download->URL + "'");
+
+			if(download->file)
+			{
+				try
+				{
+					download->file->close();
+				}
+				catch(glare::Exception&)
+				{}
+			}
+
+			download->resource->setState(Resource::State_NotPresent);
+			(*this->num_resources_downloading)--;
+
+			auto to_remove = it++;
+			active_downloads.erase(to_remove); // Any data still in flight for the request will be discarded.
+		}
+		else
+		{
+			// Only send a priority update if the priority has changed significantly.
+			const float priority = downloadPriority(download->pos, download->size_factor, campos);
+			if(std::fabs(priority - download->sent_priority) > 0.1f * download->sent_priority)
+			{
+				socket->writeUInt32(Protocol::ResourceRequestPriority);
+				socket->writeUInt32(request_id);
+				socket->writeFloat(priority);
+				download->sent_priority = priority;
+			}
+			++it;
+		}
+	}
+}
+
+
+// Closes the partial file and moves it to the resource path, once all the data has been received.
+void DownloadResourcesThread::completeDownload(ActiveDownload& download)
+{
+	try
+	{
+		download.file->close(); // Manually call close, to check for any errors via failbit.
+		delete download.file;
+		download.file = NULL;
+
+		const std::string path = resource_manager->getLocalAbsPathForResource(*download.resource);
+		FileUtils::moveFile(path + "_partial", path);
+
+		download.resource->setState(Resource::State_Present);
+		resource_manager->markAsChanged();
+
+		out_msg_queue->enqueue(new ResourceDownloadedMessage(download.URL));
+	}
+	catch(glare::Exception& e)
+	{
+		download.resource->setState(Resource::State_NotPresent);
+		resource_manager->markAsChanged();
+		out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while writing file to disk: " + e.what()));
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		download.resource->setState(Resource::State_NotPresent);
+		resource_manager->markAsChanged();
+		out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while moving downloaded file: " + e.what()));
+	}
+
+	(*this->num_resources_downloading)--;
+}
+
+
+void DownloadResourcesThread::handleMultiplexedDownloadMessage()
+{
+	const uint32 msg_type = socket->readUInt32();
+	if(msg_type == Protocol::ResourceRequestResult)
+	{
+		const uint32 request_id = socket->readUInt32();
+		const uint32 result = socket->readUInt32();
+		uint64 file_len = 0;
+		uint64 start_offset = 0;
+		if(result == 0)
+		{
+			file_len = socket->readUInt64();
+			start_offset = socket->readUInt64(); // Server sends the data from start_offset onwards.
+			if(file_len > 1000000000)
+				throw glare::Exception("downloaded file too large (len=" + toString(file_len) + ").");
+			if(start_offset > file_len)
+				throw glare::Exception("Invalid start offset from server.");
+		}
+
+		auto res = active_downloads.find(request_id);
+		if(res == active_downloads.end()) // If we cancelled the request:
+			return;
+		ActiveDownload* download = res->second.ptr();
+		if(download->got_result)
+			throw glare::Exception("Received multiple results for request.");
+		download->got_result = true;
+
+		if(result == 0)
+		{
+			const std::string partial_path = resource_manager->getLocalAbsPathForResource(*download->resource) + "_partial";
+
+			// When resuming, the partial file should have exactly start_offset bytes, so the data can be appended to it.
+			// It may not, for example if the partial file is from a different version of the resource that is longer than the file on the server.
+			// In that case delete the partial file and request the whole file again.
+			if((start_offset > 0) && (getPartialFileSize(partial_path) != start_offset))
+			{
+				socket->writeUInt32(Protocol::ResourceRequestCancel);
+				socket->writeUInt32(request_id);
+
+				try
+				{
+					FileUtils::deleteFile(partial_path);
+				}
+				catch(FileUtils::FileUtilsExcep& e)
+				{
+					out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while deleting partial file: " + e.what()));
+				}
+
+				const uint32 new_request_id = next_request_id++;
+				download->got_result = false;
+				active_downloads[new_request_id] = res->second;
+				active_downloads.erase(res);
+				sendResourceRequest(new_request_id, *download, /*start offset=*/0);
+				return;
+			}
+
+			download->file_len = file_len;
+			download->offset = start_offset;
+
+			try
+			{
+				// Data is written to a partial file, which is kept if the download is interrupted or cancelled, so the download can be resumed from where it stopped.
+				// If resuming, append to the existing partial file, otherwise remove any existing data in the file.
+				download->file = new FileOutStream(partial_path, std::ios::binary | ((start_offset > 0) ? std::ios::app : std::ios::trunc));
+			}
+			catch(glare::Exception& e)
+			{
+				out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while opening file: " + e.what()));
+
+				// Cancel the request, so the server doesn't send the data.
+				socket->writeUInt32(Protocol::ResourceRequestCancel);
+				socket->writeUInt32(request_id);
+
+				download->resource->setState(Resource::State_NotPresent);
+				resource_manager->markAsChanged();
+				(*this->num_resources_downloading)--;
+				active_downloads.erase(res);
+				return;
+			}
+
+			if(download->offset == download->file_len) // If there is no data to receive (empty file, or the partial file was already complete):
+			{
+				completeDownload(*download);
+				active_downloads.erase(res);
+			}
+		}
+		else
+		{
+			resource_manager->addToDownloadFailedURLs(download->URL);
+
+			download->resource->setState(Resource::State_NotPresent);
+			out_msg_queue->enqueue(new LogMessage("Server couldn't send resource '" + download->URL + "' (resource not found)"));
+
+			(*this->num_resources_downloading)--;
+			active_downloads.erase(res);
+			return;
+		}
+	}
+	else if(msg_type == Protocol::ResourceDataChunk)
+	{
+		const uint32 request_id = socket->readUInt32();
+		const uint32 chunk_len = socket->readUInt32();
+		if(chunk_len > (1u << 22))
+			throw glare::Exception("Chunk too large.");
+
+		chunk_buf.resizeNoCopy(chunk_len);
+		socket->readData(chunk_buf.data(), chunk_len);
+
+		auto res = active_downloads.find(request_id);
+		if(res == active_downloads.end()) // If we cancelled the request, discard the data.
+			return;
+		ActiveDownload* download = res->second.ptr();
+		if(!download->got_result || !download->file || (chunk_len > download->file_len - download->offset))
+			throw glare::Exception("Invalid resource data chunk.");
+
+		download->file->writeData(chunk_buf.data(), chunk_len);
+		download->offset += chunk_len;
+
+		if(download->offset == download->file_len)
+		{
+			completeDownload(*download);
+			active_downloads.erase(res);
+		}
+	}
+	else
+		throw glare::Exception("Invalid message type from server: " + toString(msg_type));
+}
+
+
+void DownloadResourcesThread::abortActiveDownloads()
+{
+	for(auto it = active_downloads.begin(); it != active_downloads.end(); ++it)
+	{
+		it->second->resource->setState(Resource::State_NotPresent);
+		(*this->num_resources_downloading)--;
+	}
+	active_downloads.clear(); // Closes any partial files.
+}
+
+
+void DownloadResourcesThread::doMultiplexedDownloads()
+{
+	Timer priority_update_timer;
+
+	while(1)
+	{
+		if(should_die || checkMessageQueue(getMessageQueue()))
+		{
+			abortActiveDownloads();
+			socket->writeInt32(Protocol::CyberspaceGoodbye);
+			socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the server.
+			return;
+		}
+
+		const Vec4f campos = download_queue->getCamPos();
+
+		if(active_downloads.size() < MAX_NUM_OUTSTANDING_REQUESTS)
+			requestQueuedResources(campos);
+
+		if(priority_update_timer.elapsed() > PRIORITY_UPDATE_PERIOD)
+		{
+			updateRequestPriorities(campos);
+			priority_update_timer.reset();
+		}
+
+		// Handle any messages from the server.  Use a timeout so that we get back to requesting new resources and checking for should_die regularly.
+		if(!active_downloads.empty() && socket->readable(/*timeout (s)=*/0.05))
+		{
+			for(int i=0; (i < 64) && socket->readable(/*timeout (s)=*/0.0); ++i)
+				handleMultiplexedDownloadMessage();
+		}
+	}
+}
+
+
+#endif // !EMSCRIPTEN
+
+
 void DownloadResourcesThread::doRun()
 {
 #if EMSCRIPTEN
@@ -289,7 +642,14 @@ void DownloadResourcesThread::doRun()
 			throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
 
 		// Read server protocol version
-		/*const uint32 server_protocol_version =*/ socket->readUInt32();
+		const uint32 server_protocol_version = socket->readUInt32();
+		if(server_protocol_version >= 43) // Multiplexed resource requests were added in protocol version 43.
+		{
+			doMultiplexedDownloads();
+			return;
+		}
+
+		const bool use_ranges = server_protocol_version >= 41; // GetFilesWithRanges was added in protocol version 41.
 
 		std::set<std::string> URLs_to_get; // Set of URLs that this thread will get from the server.
 
@@ -347,7 +707,7 @@ void DownloadResourcesThread::doRun()
 
 				if(!URLs_to_get.empty())
 				{
-					socket->writeUInt32(Protocol::GetFiles);
+					socket->writeUInt32(use_ranges ? Protocol::GetFilesWithRanges : Protocol::GetFiles);
 					socket->writeUInt64(URLs_to_get.size()); // Write number of files to get
 
 					for(auto it = URLs_to_get.begin(); it != URLs_to_get.end(); ++it)
@@ -356,6 +716,13 @@ void DownloadResourcesThread::doRun()
 
 						// conPrint("DownloadResourcesThread: Querying server for file '" + URL + "'...");
 						socket->writeStringLengthFirst(URL);
+
+						if(use_ranges)
+						{
+							// If a previous download of this resource was interrupted, ask for just the rest of the file.
+							const uint64 partial_size = getPartialFileSize(resource_manager->getLocalAbsPathForResource(*resource_manager->getOrCreateResourceForURL(URL)) + "_partial");
+							socket->writeUInt64(partial_size); // Write start offset
+						}
 					}
 
 					// Read reply, which has an error code for each resource download.
@@ -370,6 +737,9 @@ void DownloadResourcesThread::doRun()
 						{
 							// Download resource
 							const uint64 file_len = socket->readUInt64();
+							const uint64 start_offset = use_ranges ? socket->readUInt64() : 0; // Server sends the data from start_offset onwards.
+							if(start_offset > file_len)
+								throw glare::Exception("Invalid start offset from server.");
 							if(file_len > 0)
 							{
 								if(file_len > 1000000000)
@@ -379,13 +749,36 @@ void DownloadResourcesThread::doRun()
 
 								try
 								{
+									// Data is written to a partial file, which is kept if the download is interrupted, so the download can be resumed from where it stopped.
 									const std::string path = resource_manager->getLocalAbsPathForResource(*resource);
+									const std::string partial_path = path + "_partial";
+									const uint64 MAX_CHUNK_SIZE = 1ull << 14;
+									js::Vector<uint8, 16> temp_buf(MAX_CHUNK_SIZE);
+
+									// When resuming, the partial file should have exactly start_offset bytes, so the data can be appended to it.
+									// It may not, for example if the partial file is from a different version of the resource that is longer than the file on the server.
+									// In that case read and discard the data, and delete the partial file, so the whole file is downloaded next time.
+									if((start_offset > 0) && (getPartialFileSize(partial_path) != start_offset))
+									{
+										for(uint64 offset = start_offset; offset < file_len; )
+										{
+											const uint64 chunk_size = myMin(file_len - offset, MAX_CHUNK_SIZE);
+											socket->readData(temp_buf.data(), chunk_size);
+											offset += chunk_size;
+
+											if(should_die)
+												throw glare::Exception("Interrupted");
+										}
+
+										FileUtils::deleteFile(partial_path);
+										throw glare::Exception("Partial file for '" + URL + "' did not match the resume offset, discarded it.");
+									}
+
 									{
-										FileOutStream file(path, std::ios::binary | std::ios::trunc); // Remove any existing data in the file
+										// If resuming, append to the existing partial file, otherwise remove any existing data in the file.
+										FileOutStream file(partial_path, std::ios::binary | ((start_offset > 0) ? std::ios::app : std::ios::trunc));
 
-										uint64 offset = 0;
-										const uint64 MAX_CHUNK_SIZE = 1ull << 14;
-										js::Vector<uint8, 16> temp_buf(MAX_CHUNK_SIZE);
+										uint64 offset = start_offset;
 										while(offset < file_len)
 										{
 											const uint64 chunk_size = myMin(file_len - offset, MAX_CHUNK_SIZE);
@@ -401,6 +794,8 @@ void DownloadResourcesThread::doRun()
 										file.close(); // Manually call close, to check for any errors via failbit.
 									} // End scope for FileOutStream
 
+									FileUtils::moveFile(partial_path, path);
+
 									resource->setState(Resource::State_Present);
 									resource_manager->markAsChanged();
 
@@ -414,6 +809,13 @@ void DownloadResourcesThread::doRun()
 									//conPrint("DownloadResourcesThread: Error while writing file to disk: " + e.what());
 									out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while writing file to disk: " + e.what()));
 								}
+								catch(FileUtils::FileUtilsExcep& e)
+								{
+									resource->setState(Resource::State_NotPresent);
+									resource_manager->markAsChanged();
+
+									out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while moving downloaded file: " + e.what()));
+								}
 							}
 
 							//conPrint("DownloadResourcesThread: Got file '" + URL + "'.");
@@ -439,10 +841,12 @@ void DownloadResourcesThread::doRun()
 	catch(MySocketExcep& e)
 	{
 		conPrint("DownloadResourcesThread Socket error: " + e.what());
+		abortActiveDownloads();
 	}
 	catch(glare::Exception& e)
 	{
 		conPrint("DownloadResourcesThread glare::Exception: " + e.what());
+		abortActiveDownloads();
 	}
 #endif // end if !EMSCRIPTEN
 }
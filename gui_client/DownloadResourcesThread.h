@@ -17,7 +17,9 @@ Copyright Glare Technologies Limited 2021 -
 #include <utils/ThreadManager.h>
 #include <utils/ThreadSafeQueue.h>
 #include <set>
+#include <map>
 #include <string>
+class FileOutStream;
 class WorkUnit;
 class PrintOutput;
 class ThreadMessageSink;
@@ -41,6 +43,11 @@ DownloadResourcesThread
 Downloads any resources from the server as needed.
 This thread gets sent DownloadResourceMessage from MainWindow, when a new file is needed to be downloaded.
 It sends ResourceDownloadedMessages back to MainWindow via the out_msg_queue when files are downloaded.
+
+With servers that support it (protocol version >= 43), multiple ResourceRequests are kept outstanding, and the server interleaves
+the data for them, most important first.  Request priorities are updated as the camera moves, and requests for resources
+that are now too far away from the camera are cancelled.
+Otherwise GetFiles requests for a few resources at a time are made, and the resources are received one after another.
 =====================================================================*/
 class DownloadResourcesThread : public MessageableThread
 {
@@ -67,6 +74,38 @@ private:
 
 	std::vector<DownloadQueueItem> queue_items; // scratch buffer
 
+	// Multiplexed downloads
+	void doMultiplexedDownloads();
+	void requestQueuedResources(const Vec4f& campos);
+	void updateRequestPriorities(const Vec4f& campos); // Sends priority updates for outstanding requests, and cancels requests that are now out of range.
+	void handleMultiplexedDownloadMessage();
+	void abortActiveDownloads(); // Resets the state of the resources for outstanding requests, so they can be downloaded again later.
+
+	struct ActiveDownload : public RefCounted
+	{
+		GLARE_ALIGNED_16_NEW_DELETE
+
+		ActiveDownload() : file(NULL) {}
+		~ActiveDownload();
+
+		std::string URL;
+		ResourceRef resource;
+		Vec4f pos;
+		float size_factor;
+		float max_dist;
+		float sent_priority; // Priority last sent to the server.
+		bool got_result; // Have we received the ResourceRequestResult for this request?
+		uint64 file_len;
+		uint64 offset; // Offset of the next byte to receive.
+		FileOutStream* file; // Partial file the data is written to.
+	};
+	void sendResourceRequest(uint32 request_id, const ActiveDownload& download, uint64 start_offset);
+	void completeDownload(ActiveDownload& download); // Moves the partial file to the resource path and marks the resource as present.
+
+	std::map<uint32, Reference<ActiveDownload>> active_downloads; // Map from request id to download
+	uint32 next_request_id;
+	js::Vector<uint8, 16> chunk_buf;
+
 	glare::AtomicInt should_die;
 public:
 	SocketInterfaceRef socket;
@@ -14,7 +14,6 @@ Copyright Glare Technologies Limited 2021 -
 
 
 DownloadingResourceQueue::DownloadingResourceQueue()
-:	begin_i(0)
 {}
 
 
@@ -33,7 +32,7 @@ void DownloadingResourceQueue::enqueueItem(const DownloadQueueItem& item/*const
 		already_inserted = item_URL_set.find(item.URL) != item_URL_set.end();
 		if(!already_inserted)
 		{
-			items.push_back(item);
+			items.push(item);
 			item_URL_set.insert(item.URL);
 		}
 	}
@@ -46,73 +45,247 @@ void DownloadingResourceQueue::enqueueItem(const DownloadQueueItem& item/*const
 size_t DownloadingResourceQueue::size() const
 {
 	Lock lock(mutex);
-	return items.size() - begin_i;
+	return items.size();
 }
 
 
-struct QueueItemDistComparator
+void DownloadingResourceQueue::sortQueue(const Vec3d& campos_) // Reprioritise queue
 {
-	bool operator () (const DownloadQueueItem& a, const DownloadQueueItem& b)
+	// Prioritise download list by distance from camera
+	const Vec4f campos((float)campos_.x, (float)campos_.y, (float)campos_.z, 1.f);
+
 	{
-		const float a_priority = a.pos.getDist(campos) * a.size_factor;
-		const float b_priority = b.pos.getDist(campos) * b.size_factor;
-		return a_priority < b_priority;
+		Lock lock(mutex);
+
+		//Timer timer;
+
+		items.setCamPos(campos);
+
+		//conPrint("!!!!Reprioritising download queue (" + toString(items.size()) + " items) took " + timer.elapsedStringNSigFigs(4));
 	}
+}
 
-	Vec4f campos;
-};
+
+Vec4f DownloadingResourceQueue::getCamPos() const
+{
+	Lock lock(mutex);
+	return items.getCamPos();
+}
 
 
-void DownloadingResourceQueue::sortQueue(const Vec3d& campos_) // Sort queue
+void DownloadingResourceQueue::dequeueItems(size_t max_num_items, std::vector<DownloadQueueItem>& items_out)
 {
-	// Sort download list by distance from camera
-	const Vec4f campos((float)campos_.x, (float)campos_.y, (float)campos_.z, 1.f);
+	DownloadQueueItem item;
+	for(size_t i=0; (i<max_num_items) && !items.empty(); ++i) // while we have removed <= max_num_items and there are still items in the queue:
+	{
+		items.pop(item);
+		item_URL_set.erase(item.URL);
+		items_out.push_back(std::move(item));
+	}
+}
+
+
+void DownloadingResourceQueue::dequeueItemsWithTimeOut(double wait_time_seconds, size_t max_num_items, std::vector<DownloadQueueItem>& items_out)
+{
+	items_out.resize(0);
 
+	Lock lock(mutex);
+
+	if(!items.empty()) // If there are any items in the queue:
 	{
-		Lock lock(mutex);
+		dequeueItems(max_num_items, items_out);
+		return;
+	}
 
-		Timer timer;
+	nonempty.waitWithTimeout(mutex, wait_time_seconds); // Suspend thread until there are (maybe) items in the queue
+
+	dequeueItems(max_num_items, items_out);
+}
+
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <PCG32.h>
+#include <limits>
 
-		QueueItemDistComparator comparator;
-		comparator.campos = campos;
 
-		std::sort(items.begin() + begin_i, items.end(), comparator);
+static float itemPriority(const DownloadQueueItem& item, const Vec4f& campos)
+{
+	return item.pos.getDist(campos) * item.size_factor;
+}
+
 
+static DownloadQueueItem makeTestItem(PCG32& rng, int i)
+{
+	DownloadQueueItem item;
+	item.pos = Vec4f((rng.unitRandom() - 0.5f) * 2000.f, (rng.unitRandom() - 0.5f) * 2000.f, rng.unitRandom() * 50.f, 1.f);
+	item.size_factor = DownloadQueueItem::sizeFactorForAABBWS(rng.unitRandom() * 20.f);
+	item.max_dist = std::numeric_limits<float>::infinity();
+	item.URL = "resource_" + toString(i) + ".bmesh";
+	return item;
+}
 
-		/*conPrint("Download queue: ");
-		for(int i=(int)begin_i; i<(int)items.size(); ++i)
+
+struct TestItemPriorityComparator
+{
+	bool operator () (const DownloadQueueItem& a, const DownloadQueueItem& b) { return itemPriority(a, campos) < itemPriority(b, campos); }
+	Vec4f campos;
+};
+
+
+// Simulates the client over a number of frames: items are enqueued while moving through a crowded area, the queue is reprioritised
+// for the current camera position, and download threads dequeue items.
+// If use_full_sort is true, uses a sorted vector like the previous implementation, for comparison.
+static void doBenchmark(int num_items, bool use_full_sort)
+{
+	PCG32 rng(1);
+	std::vector<DownloadQueueItem> new_items(num_items);
+	for(int i=0; i<num_items; ++i)
+		new_items[i] = makeTestItem(rng, i);
+
+	DownloadingResourceQueue queue;
+	js::Vector<DownloadQueueItem, 16> sorted_items; // For use_full_sort
+	size_t begin_i = 0;
+	std::vector<DownloadQueueItem> dequeued;
+
+	double enqueue_time = 0, reprioritise_time = 0, dequeue_time = 0;
+	const int num_frames = 50;
+	size_t next_item = 0;
+	for(int frame=0; frame<num_frames; ++frame)
+	{
+		// Enqueue a batch of items
+		Timer timer;
+		const size_t end_item = (size_t)num_items * (frame + 1) / num_frames;
+		for(; next_item < end_item; ++next_item)
 		{
-			conPrint("item " + toString(i) + ": " + items[i].URL + ", (" + doubleToStringNSigFigs(items[i].pos.getDist(campos), 3) + " m away)");
-		}*/
+			if(use_full_sort)
+				sorted_items.push_back(new_items[next_item]);
+			else
+				queue.enqueueItem(new_items[next_item]);
+		}
+		enqueue_time += timer.elapsed();
+
+		// Reprioritise for the new camera position
+		const Vec3d campos(frame * 10.0, 0, 2);
+		timer.reset();
+		if(use_full_sort)
+		{
+			TestItemPriorityComparator comparator;
+			comparator.campos = Vec4f((float)campos.x, (float)campos.y, (float)campos.z, 1.f);
+			std::sort(sorted_items.begin() + begin_i, sorted_items.end(), comparator);
+		}
+		else
+			queue.sortQueue(campos);
+		reprioritise_time += timer.elapsed();
 
-		//conPrint("!!!!Sorting download queue (" + toString(items.size() - begin_i) + " items) took " + timer.elapsedStringNSigFigs(4) + " (begin_i: " + toString(begin_i) + ")");
+		// Dequeue some items
+		timer.reset();
+		for(int z=0; z<100; ++z)
+		{
+			if(use_full_sort)
+			{
+				dequeued.clear();
+				for(size_t i=0; (i<4) && (begin_i < sorted_items.size()); ++i)
+					dequeued.push_back(sorted_items[begin_i++]);
+			}
+			else
+				queue.dequeueItemsWithTimeOut(/*wait time=*/0.0, /*max num items=*/4, dequeued);
+		}
+		dequeue_time += timer.elapsed();
 	}
+
+	const size_t remaining = use_full_sort ? (sorted_items.size() - begin_i) : queue.size();
+	conPrint(std::string(use_full_sort ? "full sort:     " : "priority heap: ") + toString(num_items) + " items, " + toString(num_frames) + " frames: enqueue: " + doubleToStringNSigFigs(enqueue_time * 1.0e3, 4) + " ms, " +
+		"reprioritise: " + doubleToStringNSigFigs(reprioritise_time * 1.0e3, 4) + " ms, dequeue: " + doubleToStringNSigFigs(dequeue_time * 1.0e3, 4) + " ms, " + 
+		"remaining items: " + toString(remaining) + (use_full_sort ? (", vector size: " + toString(sorted_items.size())) : ""));
 }
 
 
-void DownloadingResourceQueue::dequeueItemsWithTimeOut(double wait_time_seconds, size_t max_num_items, std::vector<DownloadQueueItem>& items_out)
+void DownloadingResourceQueue::test()
 {
-	items_out.resize(0);
+	conPrint("DownloadingResourceQueue::test()");
 
-	Lock lock(mutex);
-
-	if(begin_i < items.size()) // If there are any items in the queue:
+	// Test items are dequeued in priority order, and duplicates are ignored.
 	{
-		for(size_t i=0; (i<max_num_items) && (begin_i < items.size()); ++i) // while we have removed <= max_num_items and there are still items in the queue:
+		PCG32 rng(1);
+		DownloadingResourceQueue queue;
+		std::vector<DownloadQueueItem> ref_items;
+		for(int i=0; i<1000; ++i)
 		{
-			items_out.push_back(items[begin_i]);
-			item_URL_set.erase(items[begin_i].URL);
-			begin_i++;
+			const DownloadQueueItem item = makeTestItem(rng, i);
+			queue.enqueueItem(item);
+			queue.enqueueItem(item); // Should be ignored
+			ref_items.push_back(item);
 		}
-		return;
+		testAssert(queue.size() == 1000);
+
+		const Vec3d campos(100, -200, 5);
+		queue.sortQueue(campos);
+
+		TestItemPriorityComparator comparator;
+		comparator.campos = Vec4f(100, -200, 5, 1);
+		std::sort(ref_items.begin(), ref_items.end(), comparator);
+
+		std::vector<DownloadQueueItem> dequeued;
+		size_t num_dequeued = 0;
+		while(queue.size() > 0)
+		{
+			queue.dequeueItemsWithTimeOut(/*wait time=*/0.0, /*max num items=*/4, dequeued);
+			testAssert(dequeued.size() >= 1 && dequeued.size() <= 4);
+			for(size_t i=0; i<dequeued.size(); ++i)
+			{
+				testAssert(itemPriority(dequeued[i], comparator.campos) == itemPriority(ref_items[num_dequeued], comparator.campos));
+				num_dequeued++;
+			}
+		}
+		testAssert(num_dequeued == 1000);
+
+		// Once dequeued, an item can be enqueued again.
+		queue.enqueueItem(ref_items[0]);
+		testAssert(queue.size() == 1);
 	}
 
-	nonempty.waitWithTimeout(mutex, wait_time_seconds); // Suspend thread until there are (maybe) items in the queue
+	// Test items enqueued after reprioritising are ordered relative to the last camera position, and that slots are reused.
+	{
+		PCG32 rng(1);
+		DistancePriorityHeap<DownloadQueueItem> heap;
+		const Vec4f campos(10, 20, 0, 1);
+		heap.setCamPos(campos);
+		
+		for(int z=0; z<100; ++z)
+		{
+			for(int i=0; i<10; ++i)
+				heap.push(makeTestItem(rng, i));
 
-	for(size_t i=0; (i<max_num_items) && (begin_i < items.size()); ++i) // while we have removed <= max_num_items and there are still items in the queue:
+			DownloadQueueItem item;
+			float last_priority = -1;
+			for(int i=0; i<5; ++i)
+			{
+				heap.pop(item);
+				testAssert(itemPriority(item, campos) >= last_priority);
+				last_priority = itemPriority(item, campos);
+			}
+		}
+		testAssert(heap.size() == 500);
+		testAssert(heap.numSlots() <= 505); // Popped slots should be reused
+
+		DownloadQueueItem item;
+		while(!heap.empty())
+			heap.pop(item);
+		testAssert(heap.numSlots() == 0);
+	}
+
+	// Performance test
+	if(false)
 	{
-		items_out.push_back(items[begin_i]);
-		item_URL_set.erase(items[begin_i].URL);
-		begin_i++;
+		doBenchmark(/*num items=*/100000, /*use_full_sort=*/true);
+		doBenchmark(/*num items=*/100000, /*use_full_sort=*/false);
 	}
+
+	conPrint("DownloadingResourceQueue::test() done");
 }
+
+
+#endif // BUILD_TESTS
@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2021 -
 #pragma once
 
 
+#include "DistancePriorityHeap.h"
 #include <Platform.h>
 #include <Mutex.h>
 #include <Condition.h>
@@ -36,6 +37,7 @@ struct DownloadQueueItem
 
 	Vec4f pos;
 	float size_factor;
+	float max_dist; // If the camera gets further than this from pos, a multiplexed download of the resource is cancelled.
 	std::string URL;
 };
 
@@ -44,7 +46,10 @@ struct DownloadQueueItem
 DownloadingResourceQueue
 ------------------------
 Queue of resource URLs to download, together with the position of the object using the resource,
-which is used for sorting the items based on distance from the camera.
+which is used for prioritising the items based on distance from the camera.
+
+Items are kept in a DistancePriorityHeap, so enqueueing and dequeueing are O(log n), and
+reprioritising for a new camera position is O(n).
 
 DownloadResourcesThreads will dequeue items from this queue.
 =====================================================================*/
@@ -58,14 +63,18 @@ public:
 
 	size_t size() const;
 
-	void sortQueue(const Vec3d& campos); // Sort queue (by item distance to camera)
+	void sortQueue(const Vec3d& campos); // Reprioritise queue (by item distance to camera)
+
+	Vec4f getCamPos() const; // Returns the camera position passed to the last sortQueue() call.
 
 	void dequeueItemsWithTimeOut(double wait_time_s, size_t max_num_items, std::vector<DownloadQueueItem>& items_out); // Blocks for up to wait_time_s
+
+	static void test();
 private:
+	void dequeueItems(size_t max_num_items, std::vector<DownloadQueueItem>& items_out) REQUIRES(mutex);
 
 	mutable Mutex mutex;
 	Condition nonempty;
-	size_t begin_i									GUARDED_BY(mutex);
-	js::Vector<DownloadQueueItem, 16> items			GUARDED_BY(mutex);
+	DistancePriorityHeap<DownloadQueueItem> items	GUARDED_BY(mutex);
 	std::unordered_set<std::string> item_URL_set	GUARDED_BY(mutex);
 };
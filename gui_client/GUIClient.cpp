@@ -39,6 +39,7 @@ Copyright Glare Technologies Limited 2023 -
 #include "AnimatedTextureManager.h"
 #include "ParticleManager.h"
 #include "Scripting.h"
+#include "PhysicsShapeCache.h"
 #include "HoverCarPhysics.h"
 #include "BikePhysics.h"
 #include "BoatPhysics.h"
@@ -153,7 +154,7 @@ GUIClient::GUIClient(const std::string& base_dir_path_, const std::string& appda
 	grabbed_angle(0),
 	force_new_undo_edit(false),
 	model_and_texture_loader_task_manager("model and texture loader task manager"),
-	task_manager(NULL), // Currently just used for LODGeneration::generateLODTexturesForMaterialsIfNotPresent().
+	task_manager(NULL), // Used for LODGeneration::generateLODTexturesForMaterialsIfNotPresent() and object script evaluation.
 	url_parcel_uid(-1),
 	running_destructor(false),
 	biome_manager(NULL),
@@ -248,12 +249,23 @@ void GUIClient::initialise(const std::string& cache_dir, SettingsStore* settings
 	this->load_distance = dist;
 	this->load_distance2 = dist*dist;
 
+	mesh_manager.setMemoryBudget(MeshManager::memoryBudgetForSetting(settings->getIntValue("setting/memory_budget_MB", /*default val=*/0)));
+
 	this->resources_dir = cache_dir + "/resources";
 	FileUtils::createDirIfDoesNotExist(this->resources_dir);
 
 	print("resources_dir: " + resources_dir);
 	resource_manager = new ResourceManager(this->resources_dir);
 
+	try
+	{
+		physics_shape_cache = new PhysicsShapeCache(cache_dir + "/physics_shape_cache", /*max total size=*/(uint64)1 << 30);
+	}
+	catch(glare::Exception& e)
+	{
+		logMessage("Failed to create physics shape cache: " + e.what());
+	}
+
 
 	// The user may have changed the resources dir (by changing the custom cache directory) since last time we ran.
 	// In this case, we want to check if each resource is actually present on disk in the current resources dir.
@@ -767,7 +779,7 @@ void GUIClient::shutdown()
 }
 
 
-void GUIClient::startDownloadingResource(const std::string& url, const Vec4f& centroid_ws, float aabb_ws_longest_len, DownloadingResourceInfo& resource_info)
+void GUIClient::startDownloadingResource(const std::string& url, const Vec4f& centroid_ws, float aabb_ws_longest_len, DownloadingResourceInfo& resource_info, float max_dist_for_download)
 {
 	//conPrint("-------------------GUIClient::startDownloadingResource()-------------------\nURL: " + url);
 	//if(shouldStreamResourceViaHTTP(url))
@@ -802,6 +814,7 @@ void GUIClient::startDownloadingResource(const std::string& url, const Vec4f& ce
 			DownloadQueueItem item;
 			item.pos = centroid_ws;
 			item.size_factor = DownloadQueueItem::sizeFactorForAABBWS(aabb_ws_longest_len);
+			item.max_dist = max_dist_for_download;
 			item.URL = url;
 			this->download_queue.enqueueItem(item);
 		}
@@ -988,6 +1001,8 @@ void GUIClient::removeAndDeleteGLObjectsForOb(WorldObject& ob)
 
 	ob.opengl_engine_ob = NULL;
 
+	if(ob.mesh_manager_data.nonNull())
+		ob.mesh_manager_data->last_use_dist = (float)ob.pos.getDist(cam_controller.getPosition()); // Used by the MeshManager to decide what to evict if this was the last user.
 	ob.mesh_manager_data = NULL;
 
 	ob.loaded_model_lod_level = -10;
@@ -1007,8 +1022,12 @@ void GUIClient::removeAndDeleteGLAndPhysicsObjectsForOb(WorldObject& ob)
 		ob.physics_object = NULL;
 	}
 
+	if(ob.mesh_manager_shape_data.nonNull())
+		ob.mesh_manager_shape_data->last_use_dist = (float)ob.pos.getDist(cam_controller.getPosition());
 	ob.mesh_manager_shape_data = NULL;
 
+	ob.voxel_edit_mesh_cache = NULL;
+
 	// TOOD: removeObScriptingInfo(&ob);
 }
 
@@ -1131,7 +1150,10 @@ void GUIClient::startDownloadingResourcesForObject(WorldObject* ob, int ob_lod_l
 				info.pos = ob->pos;
 				info.size_factor = LoadItemQueueItem::sizeFactorForAABBWS(ob->getAABBWSLongestLength(), /*importance_factor=*/1.f);
 
-				startDownloadingResource(url, ob->getCentroidWS(), ob->getAABBWSLongestLength(), info);
+				// Allow the download to be cancelled once the object is well out of load range, as it will have been unloaded by then, and will start downloading again if reloaded.
+				const float max_dist_for_download = load_distance * 1.5f + ob->getAABBWSLongestLength();
+
+				startDownloadingResource(url, ob->getCentroidWS(), ob->getAABBWSLongestLength(), info, max_dist_for_download);
 			}
 		}
 	}
@@ -1891,6 +1913,7 @@ void GUIClient::loadModelForObject(WorldObject* ob)
 							load_model_task->unit_cube_shape = this->unit_cube_shape;
 							load_model_task->result_msg_queue = &this->msg_queue;
 							load_model_task->resource_manager = resource_manager;
+							load_model_task->physics_shape_cache = physics_shape_cache;
 							load_model_task->build_dynamic_physics_ob = ob->isDynamic();
 
 							load_item_queue.enqueueItem(*ob, load_model_task, max_dist_for_ob_model_lod_level);
@@ -2083,6 +2106,7 @@ void GUIClient::loadModelForAvatar(Avatar* avatar)
 					load_model_task->unit_cube_shape = this->unit_cube_shape;
 					load_model_task->result_msg_queue = &this->msg_queue;
 					load_model_task->resource_manager = resource_manager;
+					load_model_task->physics_shape_cache = physics_shape_cache;
 
 					load_item_queue.enqueueItem(*avatar, load_model_task, max_dist_for_ob_model_lod_level, our_avatar);
 				}
@@ -2992,49 +3016,26 @@ void GUIClient::checkForLODChanges()
 		const Vec4f cam_pos = cam_controller.getPosition().toVec4fPoint();
 		const float load_distance2_ = this->load_distance2;
 
-		glare::FastIterMapValueInfo<UID, WorldObjectRef>* const objects_data = this->world_state->objects.vector.data();
-		const size_t objects_size                                            = this->world_state->objects.vector.size();
-
-		// Process just some of the objects each frame, to reduce CPU time and ease pressure on the cache.
-		const size_t num_slices = 4;
-		const size_t slice = frame_num % num_slices;
-		const size_t begin_i = myMin(objects_size, Maths::roundedUpDivide(objects_size, num_slices) * slice      );
-		const size_t end_i   = myMin(objects_size, Maths::roundedUpDivide(objects_size, num_slices) * (slice + 1));
+		// Compute LOD levels and proximity for all objects from the compact per-world table, which is cheap enough to do for every object every frame.
+		temp_lod_changes.clear();
+		this->world_state->lod_table.checkForLODChanges(cam_pos, load_distance2_, temp_lod_changes);
 
-		//conPrint("checking slice from " + toString(begin_i) + " to " + toString(end_i));
-		for(size_t i=begin_i; i<end_i; ++i)
+		for(size_t i=0; i<temp_lod_changes.size(); ++i)
 		{
-			if(i + 16 < end_i)
-				_mm_prefetch((const char*)(&objects_data[i + 16].value->centroid_ws), _MM_HINT_T0);
-
-			WorldObject* const ob = objects_data[i].value.ptr();
+			const ObjectLODTable::Change& change = temp_lod_changes[i];
+			WorldObject* const ob = change.ob;
 
-			const float cam_to_ob_d2 = ob->getCentroidWS().getDist2(cam_pos);
-			if(cam_to_ob_d2 > load_distance2_) // If object is out of load distance:
+			if(!change.in_proximity) // If an object was in proximity to the camera, and moved out of load distance:
 			{
-				if(ob->in_proximity) // If an object was in proximity to the camera, and moved out of load distance:
-				{
-					unloadObject(ob);
-					ob->in_proximity = false;
-				}
+				unloadObject(ob);
+				ob->in_proximity = false;
 			}
-			else // Else if object is within load distance:
+			else // Else if the object moved within load distance, or the LOD level changed:
 			{
-				const int lod_level = ob->getLODLevel(cam_to_ob_d2);
-
-				if((lod_level != ob->current_lod_level)/* || ob->opengl_engine_ob.isNull()*/)
-				{
-					loadModelForObject(ob);
-					ob->current_lod_level = lod_level;
-					// conPrint("Changing LOD level for object " + ob->uid.toString() + " to " + toString(lod_level));
-				}
-
-				if(!ob->in_proximity) // If an object was out of load distance, and moved within load distance:
-				{
-					ob->in_proximity = true;
-					loadModelForObject(ob);
-					ob->current_lod_level = lod_level;
-				}
+				ob->in_proximity = true;
+				loadModelForObject(ob);
+				ob->current_lod_level = change.lod_level;
+				// conPrint("Changing LOD level for object " + ob->uid.toString() + " to " + toString(change.lod_level));
 			}
 		}
 	} // End lock scope
@@ -3133,8 +3134,10 @@ void GUIClient::processLoading()
 		//int num_items_processed = 0;
 		
 		// Also limit to a total number of bytes of data uploaded to OpenGL / the GPU per frame.
+		// The limit is chosen from the measured upload throughput so that uploading takes about MAX_UPLOAD_TIME.
+		const double MAX_UPLOAD_TIME = 0.003; // 3 ms
 		size_t total_bytes_uploaded = 0;
-		const size_t max_total_upload_bytes = 1024 * 1024;
+		const size_t max_total_upload_bytes = texture_loading_stats.getUploadByteBudget(MAX_UPLOAD_TIME);
 
 		int num_models_loaded = 0;
 		int num_textures_loaded = 0;
@@ -3153,6 +3156,7 @@ void GUIClient::processLoading()
 				const std::string loading_item_name = cur_loading_lod_model_url;
 
 				// Upload a chunk of data to the GPU
+				const size_t initial_bytes_uploaded = total_bytes_uploaded;
 				try
 				{
 					opengl_engine->partialLoadOpenGLMeshDataIntoOpenGL(*opengl_engine->vert_buf_allocator, *cur_loading_mesh_data, mesh_data_loading_progress,
@@ -3164,6 +3168,8 @@ void GUIClient::processLoading()
 					cur_loading_mesh_data = NULL;
 				}
 
+				texture_loading_stats.recordUpload(total_bytes_uploaded - initial_bytes_uploaded, load_item_timer.elapsed()); // Mesh uploads share the byte budget, so feed them into the throughput estimate as well.
+
 				//logMessage("Loaded a chunk of mesh '" + cur_loading_lod_model_url + "': " + mesh_data_loading_progress.summaryString());
 
 				if(mesh_data_loading_progress.done())
@@ -3420,9 +3426,12 @@ void GUIClient::processLoading()
 				Timer load_item_timer;
 
 				// Upload a chunk of data to the GPU
+				const size_t initial_bytes_uploaded = total_bytes_uploaded;
 				opengl_engine->partialLoadOpenGLMeshDataIntoOpenGL(*opengl_engine->vert_buf_allocator, *cur_loading_mesh_data, mesh_data_loading_progress, 
 					total_bytes_uploaded, max_total_upload_bytes);
 
+				texture_loading_stats.recordUpload(total_bytes_uploaded - initial_bytes_uploaded, load_item_timer.elapsed());
+
 				//logMessage("Loaded a chunk of voxel mesh: " + mesh_data_loading_progress.summaryString());
 
 				if(mesh_data_loading_progress.done())
@@ -3552,6 +3561,7 @@ void GUIClient::processLoading()
 				Timer load_item_timer;
 
 				// Upload a chunk of data to the GPU
+				const size_t initial_bytes_uploaded = total_bytes_uploaded;
 				try
 				{
 					TextureLoading::partialLoadTextureIntoOpenGL(opengl_engine, tex_loading_progress, total_bytes_uploaded, max_total_upload_bytes);
@@ -3563,8 +3573,15 @@ void GUIClient::processLoading()
 					tex_loading_progress.opengl_tex = NULL;
 				}
 
+				const double upload_time = load_item_timer.elapsed();
+				texture_loading_stats.recordUpload(total_bytes_uploaded - initial_bytes_uploaded, upload_time);
+				cur_loading_tex_times.upload_time += upload_time;
+				cur_loading_tex_times.num_upload_frames++;
+
 				if(tex_loading_progress.done() || !tex_loading_progress.loadingInProgress())
 				{
+					texture_loading_stats.textureLoaded(cur_loading_tex_times);
+
 					if(cur_loading_terrain_map.nonNull() && terrain_system.nonNull())
 						terrain_system->handleTextureLoaded(tex_loading_progress.path, cur_loading_terrain_map);
 
@@ -3668,6 +3685,12 @@ void GUIClient::processLoading()
 
 					this->cur_loading_terrain_map = message->terrain_map;
 
+					cur_loading_tex_times = TextureLoadingStats::TextureTimes();
+					cur_loading_tex_times.decode_time = message->decode_time;
+					cur_loading_tex_times.process_time = message->process_time;
+					cur_loading_tex_times.queue_time = Clock::getTimeSinceInit() - message->creation_time;
+
+					Timer init_timer;
 					try
 					{
 						TextureLoading::initialiseTextureLoadingProgress(message->tex_path, opengl_engine, OpenGLTextureKey(message->tex_key), message->tex_params,
@@ -3678,6 +3701,7 @@ void GUIClient::processLoading()
 						this->tex_loading_progress.tex_data = NULL;
 						this->tex_loading_progress.opengl_tex = NULL;
 					}
+					cur_loading_tex_times.upload_time = init_timer.elapsed(); // Includes creating the OpenGL texture.
 
 					//conPrint("textureLoaded took                " + timer.elapsedStringNSigFigs(5));
 					//size_t tex_size_B = 0;
@@ -3985,6 +4009,13 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 	}
 #endif
 
+	// Update texture and audio memory usage for the memory budget.  Getting these takes some work, so don't do it every frame.
+	if(mem_budget_usage_update_timer.elapsed() > 1.0)
+	{
+		mesh_manager.setExternalMemUsage(/*texture CPU usage=*/texture_server ? texture_server->getTotalMemUsage() : 0, /*audio usage=*/audio_engine.getTotalMemUsage());
+		mem_budget_usage_update_timer.reset();
+	}
+
 	mesh_manager.trimMeshMemoryUsage();
 
 
@@ -4112,8 +4143,8 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 	}
 
 
-	// Sort download queue every now and then
-	if(download_queue_sort_timer.elapsed() > 2.0)
+	// Reprioritise download queue every now and then.  This also updates the camera position used to reprioritise and cancel in-flight downloads.
+	if(download_queue_sort_timer.elapsed() > 0.5)
 	{
 		this->download_queue.sortQueue(cam_controller.getPosition());
 		download_queue_sort_timer.reset();
@@ -4252,8 +4283,11 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 		ZoneScopedN("script eval"); // Tracy profiler
 
 		Timer timer;
-		Scripting::evaluateObjectScripts(this->obs_with_scripts, global_time, dt, world_state.ptr(), opengl_engine.ptr(), this->physics_world.ptr(), &this->audio_engine,
-			/*num_scripts_processed_out=*/this->last_num_scripts_processed
+		if(!obs_with_scripts.empty() && !task_manager)
+			task_manager = new glare::TaskManager("GUIClient general task manager", myClamp<size_t>(PlatformUtils::getNumLogicalProcessors() / 2, 1, 8));
+
+		object_script_evaluator.evaluateObjectScripts(this->obs_with_scripts, global_time, dt, world_state.ptr(), opengl_engine.ptr(), this->physics_world.ptr(), &this->audio_engine,
+			this->task_manager, /*num_scripts_processed_out=*/this->last_num_scripts_processed
 		);
 		this->last_eval_script_time = timer.elapsed();
 	}
@@ -4434,9 +4468,9 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 					WorldObject* ob = (WorldObject*)physics_ob->userdata;
 					assert(ob->physics_object == physics_ob);
 
-					// Scripted objects have their opengl transform set directly in evalObjectScript(), so we don't need to set it from the physics object.
-					// We will set the opengl transform in Scripting::evalObjectScript() as it should be slightly more efficient (due to computing ob_to_world_inv_transpose directly).
-					// There is also code in Scripting::evalObjectScript that computes a custom world space AABB that doesn't oscillate in size with animations.
+					// Scripted objects have their opengl transform set directly in ObjectScriptEvaluator, so we don't need to set it from the physics object.
+					// We will set the opengl transform in Scripting::ObjectScriptEvaluator as it should be slightly more efficient (due to computing ob_to_world_inv_transpose directly).
+					// There is also code in Scripting::ObjectScriptEvaluator that computes a custom world space AABB that doesn't oscillate in size with animations.
 					// For path-controlled objects, however, we will set the OpenGL transform from the physics engine.
 					if(physics_ob->dynamic || (physics_ob->kinematic && ob->is_path_controlled))
 					{
@@ -4476,7 +4510,7 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 								const js::AABBox prev_gl_aabb_ws = ob->opengl_engine_ob->aabb_ws;
 								opengl_engine->updateObjectTransformData(*ob->opengl_engine_ob);
 
-								// For objects with instances (which will have a non-null instance_matrix_vbo), we want to use the AABB we computed in evalObjectScript(), which contains all the instance AABBs,
+								// For objects with instances (which will have a non-null instance_matrix_vbo), we want to use the AABB we computed in ObjectScriptEvaluator::applyScriptResults(), which contains all the instance AABBs,
 								// and will have been overwritten in updateObjectTransformData().
 								if(ob->opengl_engine_ob->instance_matrix_vbo.nonNull())
 									ob->opengl_engine_ob->aabb_ws = prev_gl_aabb_ws;
@@ -4810,6 +4844,8 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 
 	//printVar(in_parcel_id.value());
 
+	audio_engine.removeFinishedSources(); // Remove one-shot sounds that have finished playing.
+
 	// Set audio source occlusions and check for muting audio sources not in current parcel.
 	if(physics_world.nonNull())
 	{
@@ -4994,6 +5030,7 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 						removeInstancesOfObject(ob);
 						//removeObScriptingInfo(ob);
 
+						this->world_state->lod_table.removeObject(ob);
 						this->world_state->objects.erase(ob->uid);
 
 						active_objects.erase(ob);
@@ -5016,6 +5053,11 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 
 						ob->in_proximity = ob->getCentroidWS().getDist2(campos) < this->load_distance2;
 
+						if(ob->lod_table)
+							ob->lod_table->setInProximity(*ob, ob->in_proximity);
+						else
+							this->world_state->lod_table.addObject(ob);
+
 						if(ob->getCentroidWS().getDist2(campos) < this->load_distance2)
 						{
 							loadModelForObject(ob);
@@ -6420,6 +6462,7 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 								avatar->audio_source->type = glare::AudioSource::SourceType_Streaming;
 								avatar->audio_source->pos = avatar->pos.toVec4fPoint();
 								avatar->audio_source->sampling_rate = m->sampling_rate;
+								avatar->audio_source->max_buffered_samples = 4096; // 4096 samples ~= 85 ms at 48 khz
 
 								audio_engine.addSource(avatar->audio_source);
 
@@ -6922,6 +6965,7 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 								load_model_task->unit_cube_shape = this->unit_cube_shape;
 								load_model_task->result_msg_queue = &this->msg_queue;
 								load_model_task->resource_manager = resource_manager;
+								load_model_task->physics_shape_cache = physics_shape_cache;
 								load_model_task->build_dynamic_physics_ob = build_dynamic_physics_ob;
 
 								load_item_queue.enqueueItem(pos.toVec4fPoint(), size_factor, load_model_task, 
@@ -6994,8 +7038,11 @@ std::string GUIClient::getDiagnosticsString(bool do_graphics_diagnostics, bool d
 	msg += "last_model_and_tex_loading_time: " + doubleToStringNSigFigs(this->last_model_and_tex_loading_time * 1000, 3) + " ms\n";
 	msg += "load_item_queue: " + toString(load_item_queue.size()) + "\n";
 	msg += "model_and_texture_loader_task_manager unfinished tasks: " + toString(model_and_texture_loader_task_manager.getNumUnfinishedTasks()) + "\n";
+	if(physics_shape_cache.nonNull())
+		msg += "physics shape cache: " + toString((int64)physics_shape_cache->num_hits) + " hits, " + toString((int64)physics_shape_cache->num_misses) + " misses, " + getNiceByteSize(physics_shape_cache->getTotalSizeB()) + "\n";
 	msg += "model_loaded_messages_to_process: " + toString(model_loaded_messages_to_process.size()) + "\n";
 	msg += "texture_loaded_messages_to_process: " + toString(texture_loaded_messages_to_process.size()) + "\n";
+	msg += texture_loading_stats.getDiagnostics();
 
 	if(texture_server)
 		msg += "texture_server total mem usage:         " + getNiceByteSize(this->texture_server->getTotalMemUsage()) + "\n";
@@ -7010,6 +7057,9 @@ std::string GUIClient::getDiagnosticsString(bool do_graphics_diagnostics, bool d
 			msg += "Num audio obs: " + toString(audio_obs.size()) + "\n";
 			msg += "Num active audio sources: " + toString(audio_engine.audio_sources.size()) + "\n";
 		}
+		const glare::AudioMixStats mix_stats = audio_engine.getMixStats();
+		msg += "Mix deadline misses: " + toString(mix_stats.num_deadline_misses) + " / " + toString(mix_stats.num_buffers_mixed) + " buffers, output underruns: " + toString(mix_stats.num_output_underruns) + "\n";
+		msg += "Max mix time: " + doubleToStringNSigFigs(mix_stats.max_mix_time * 1.0e3, 3) + " ms (buffer period: " + doubleToStringNSigFigs(mix_stats.buffer_period * 1.0e3, 3) + " ms)\n";
 		/*msg += "Audio sources\n";
 		Lock lock(audio_engine.mutex);
 		for(auto it = audio_engine.audio_sources.begin(); it != audio_engine.audio_sources.end(); ++it)
@@ -10089,13 +10139,18 @@ void GUIClient::updateObjectModelForChangedDecompressedVoxels(WorldObjectRef& ob
 		for(size_t i=0; i<ob->materials.size(); ++i)
 			mat_transparent[i] = ob->materials[i]->opacity.val < 1.f;
 
-		// Add updated model!
+		if(!task_manager)
+			task_manager = new glare::TaskManager("GUIClient general task manager", myClamp<size_t>(PlatformUtils::getNumLogicalProcessors() / 2, 1, 8));
+
+		if(ob->voxel_edit_mesh_cache.isNull())
+			ob->voxel_edit_mesh_cache = new VoxelEditMeshCache();
+
+		// Add updated model!  Only the chunks around the edit are re-meshed, and have their physics shapes rebuilt.
 		PhysicsShape physics_shape;
-		Indigo::MeshRef indigo_mesh;
 		const int subsample_factor = 1;
-		Reference<OpenGLMeshRenderData> gl_meshdata = ModelLoading::makeModelForVoxelGroup(ob->getDecompressedVoxelGroup(), subsample_factor, ob_to_world,
-			opengl_engine->vert_buf_allocator.ptr(), /*do_opengl_stuff=*/true, /*need_lightmap_uvs=*/false, mat_transparent, /*build_dynamic_physics_ob=*/ob->isDynamic(),
-			physics_shape, indigo_mesh);
+		Reference<OpenGLMeshRenderData> gl_meshdata = ModelLoading::makeModelForVoxelGroupIncremental(ob->getDecompressedVoxelGroup(), subsample_factor,
+			opengl_engine->vert_buf_allocator.ptr(), /*do_opengl_stuff=*/true, mat_transparent, /*build_dynamic_physics_ob=*/ob->isDynamic(),
+			*ob->voxel_edit_mesh_cache, task_manager, physics_shape);
 
 		GLObjectRef gl_ob = opengl_engine->allocateObject();
 		gl_ob->ob_to_world_matrix = ob_to_world;
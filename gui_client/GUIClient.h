@@ -21,7 +21,9 @@ Copyright Glare Technologies Limited 2023 -
 #include "DownloadingResourceQueue.h"
 #include "LoadItemQueue.h"
 #include "MeshManager.h"
+#include "TextureLoadingStats.h"
 #include "WorldState.h"
+#include "Scripting.h"
 #include "../shared/WorldSettings.h"
 #include "../audio/AudioEngine.h"
 #include "../audio/MicReadThread.h" // For MicReadStatus
@@ -40,6 +42,7 @@ Copyright Glare Technologies Limited 2023 -
 #include <string>
 #include <unordered_set>
 #include <deque>
+#include <limits>
 class UDPSocket;
 namespace Ui { class MainWindow; }
 class TextureServer;
@@ -63,6 +66,7 @@ class ClientThread;
 class MySocket;
 class LogWindow;
 class ResourceManager;
+class PhysicsShapeCache;
 struct ID3D11Device;
 struct IMFDXGIDeviceManager;
 class SettingsStore;
@@ -132,7 +136,9 @@ public:
 	void startDownloadingResourcesForObject(WorldObject* ob, int ob_lod_level);
 	void startDownloadingResourcesForAvatar(Avatar* ob, int ob_lod_level, bool our_avatar);
 
-	void startDownloadingResource(const std::string& url, const Vec4f& centroid_ws, float aabb_ws_longest_len, DownloadingResourceInfo& resouce_info); // For every resource that the object uses (model, textures etc..), if the resource is not present locally, start downloading it.
+	// For every resource that the object uses (model, textures etc..), if the resource is not present locally, start downloading it.
+	// The download may be cancelled if the camera gets further than max_dist_for_download from centroid_ws.
+	void startDownloadingResource(const std::string& url, const Vec4f& centroid_ws, float aabb_ws_longest_len, DownloadingResourceInfo& resouce_info, float max_dist_for_download = std::numeric_limits<float>::infinity());
 	
 	std::string getDiagnosticsString(bool do_graphics_diagnostics, bool do_physics_diagnostics, double last_timerEvent_CPU_work_elapsed, double last_updateGL_time);
 	void updateVoxelEditMarkers(const MouseCursorState& mouse_cursor_state);
@@ -352,6 +358,7 @@ public:
 
 	std::string resources_dir;
 	Reference<ResourceManager> resource_manager;
+	Reference<PhysicsShapeCache> physics_shape_cache; // Cache of built physics shapes for models.  May be null.
 
 
 	// NOTE: these object sets need to be cleared in connectToServer(), also when removing a dead object in ob->state == WorldObject::State_Dead case in timerEvent, the object needs to be removed
@@ -364,6 +371,7 @@ public:
 	std::set<WorldObjectRef> browser_vid_player_obs;
 	std::set<WorldObjectRef> audio_obs; // Objects with an audio_source or a non-empty audio_source_url, or objects that may play audio such as web-views or videos.
 	std::set<WorldObjectRef> obs_with_scripts; // Objects with non-null script_evaluator
+	Scripting::ObjectScriptEvaluator object_script_evaluator;
 	std::set<WorldObjectRef> obs_with_diagnostic_vis;
 
 
@@ -413,7 +421,7 @@ public:
 	Reference<OpenGLProgram> parcel_shader_prog;
 
 	StandardPrintOutput print_output;
-	glare::TaskManager* task_manager; // General purpose task manager, for quick/blocking multithreaded builds of stuff. Currently just used for LODGeneration::generateLODTexturesForMaterialsIfNotPresent(). Lazily created.
+	glare::TaskManager* task_manager; // General purpose task manager, for quick/blocking multithreaded work on the main thread: LODGeneration::generateLODTexturesForMaterialsIfNotPresent() and object script evaluation. Lazily created.
 	
 	glare::TaskManager model_and_texture_loader_task_manager;
 
@@ -530,6 +538,8 @@ public:
 
 	js::Vector<Vec4f, 16> temp_av_positions;
 
+	js::Vector<ObjectLODTable::Change, 16> temp_lod_changes;
+
 	std::map<std::string, DownloadingResourceInfo> URL_to_downloading_info; // Map from URL to info about the resource, for currently downloading resources.
 
 	std::map<ModelProcessingKey, std::set<UID>> loading_model_URL_to_world_ob_UID_map;
@@ -554,6 +564,8 @@ public:
 	Map2DRef cur_loading_terrain_map; // Non-null iff we are currently loading a map used for the terrain system into OpenGL.
 
 	OpenGLTextureLoadingProgress tex_loading_progress;
+	TextureLoadingStats::TextureTimes cur_loading_tex_times; // Stage timings for the texture currently being uploaded.
+	TextureLoadingStats texture_loading_stats;
 
 	Reference<glare::PoolAllocator> world_ob_pool_allocator;
 
@@ -610,6 +622,7 @@ public:
 
 	Timer total_timer;
 	Timer discovery_udp_packet_timer;
+	Timer mem_budget_usage_update_timer;
 
 
 	bool SHIFT_down, CTRL_down, A_down, W_down, S_down, D_down, space_down, C_down, left_down, right_down, up_down, down_down, B_down;
@@ -8,6 +8,7 @@ Copyright Glare Technologies Limited 2023 -
 
 #include "CameraController.h"
 #include "MainOptionsDialog.h"
+#include "MeshManager.h"
 #include "../dll/include/IndigoMesh.h"
 #include "../indigo/TextureServer.h"
 #include "../indigo/globals.h"
@@ -219,11 +220,13 @@ void GlWidget::initializeGL()
 	bool shadows = true;
 	bool use_MSAA = true;
 	bool bloom = true;
+	int mem_budget_setting_MB = 0; // Automatic
 	if(settings)
 	{
 		shadows  = settings->value(MainOptionsDialog::shadowsKey(),	/*default val=*/true).toBool();
 		use_MSAA = settings->value(MainOptionsDialog::MSAAKey(),	/*default val=*/true).toBool();
 		bloom    = settings->value(MainOptionsDialog::BloomKey(),	/*default val=*/true).toBool();
+		mem_budget_setting_MB = settings->value(MainOptionsDialog::memoryBudgetKey(), /*default val=*/0).toInt();
 	}
 
 #if OSX
@@ -245,7 +248,8 @@ void GlWidget::initializeGL()
 	engine_settings.depth_fog = true;
 	//engine_settings.use_final_image_buffer = bloom;
 	engine_settings.msaa_samples = use_MSAA ? 4 : -1;
-	engine_settings.max_tex_mem_usage = 1536 * 1024 * 1024ull; // Should be large enough that we have some spare room for the LRU texture cache.
+	// Use the part of the memory budget reserved for textures.  Should be large enough that we have some spare room for the LRU texture cache.
+	engine_settings.max_tex_mem_usage = MeshManager::textureBudgetForMemoryBudget(MeshManager::memoryBudgetForSetting(mem_budget_setting_MB));
 	engine_settings.allow_multi_draw_indirect = this->allow_multi_draw_indirect;
 	engine_settings.allow_bindless_textures = this->allow_bindless_textures;
 
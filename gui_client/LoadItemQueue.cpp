@@ -18,7 +18,6 @@ Copyright Glare Technologies Limited 2022 -
 
 
 LoadItemQueue::LoadItemQueue()
-:	begin_i(0)
 {}
 
 
@@ -57,82 +56,128 @@ void LoadItemQueue::enqueueItem(const Vec4f& pos, float size_factor, const glare
 	item.task = task;
 	item.task_max_dist = task_max_dist;
 
-	items.push_back(item);
+	items.push(item);
 }
 
 
 
 size_t LoadItemQueue::size() const
 {
-	return items.size() - begin_i;
+	return items.size();
 }
 
 
 void LoadItemQueue::clear()
 {
-	begin_i = 0;
 	items.clear();
 }
 
 
-struct QueueItemDistComparator
+void LoadItemQueue::sortQueue(const Vec3d& campos_) // Reprioritise queue
 {
-	bool operator () (const LoadItemQueueItem& a, const LoadItemQueueItem& b)
-	{
-		const float a_priority = a.pos.getDist(campos) * a.size_factor;
-		const float b_priority = b.pos.getDist(campos) * b.size_factor;
-		return a_priority < b_priority;
-	}
+	// Prioritise list by distance from camera
+	const Vec4f campos((float)campos_.x, (float)campos_.y, (float)campos_.z, 1.f);
+
+	//Timer timer;
+
+	items.setCamPos(campos);
+
+	//conPrint("!!!!Reprioritising load item queue (" + toString(items.size()) + " items) took " + timer.elapsedStringNSigFigs(4));
+}
+
+
+LoadItemQueueItem LoadItemQueue::dequeueFront()
+{
+	assert(!items.empty());
+
+	LoadItemQueueItem item;
+	items.pop(item);
+	return item;
+}
 
-	Vec4f campos;
+
+#if BUILD_TESTS
+
+
+#include <TestUtils.h>
+#include <PCG32.h>
+
+
+class LoadItemQueueTestTask : public glare::Task
+{
+public:
+	virtual void run(size_t /*thread_index*/) {}
 };
 
 
-void LoadItemQueue::sortQueue(const Vec3d& campos_) // Sort queue
+void LoadItemQueue::test()
 {
-	// Sort list by distance from camera
-	const Vec4f campos((float)campos_.x, (float)campos_.y, (float)campos_.z, 1.f);
+	conPrint("LoadItemQueue::test()");
 
-	//Timer timer;
+	// Test tasks are dequeued in priority order, including tasks enqueued after reprioritising, and that task references are released on dequeue.
+	{
+		PCG32 rng(1);
+		LoadItemQueue queue;
+		glare::TaskRef task = new LoadItemQueueTestTask();
+
+		queue.sortQueue(Vec3d(50, 50, 0));
+		const Vec4f campos(50, 50, 0, 1);
+		for(int z=0; z<20; ++z)
+		{
+			for(int i=0; i<100; ++i)
+				queue.enqueueItem(Vec4f((rng.unitRandom() - 0.5f) * 1000.f, (rng.unitRandom() - 0.5f) * 1000.f, 0, 1), /*aabb_ws_longest_len=*/rng.unitRandom() * 10.f, task, 
+					/*task_max_dist=*/1000.f, /*importance_factor=*/1.f);
+
+			float last_priority = -1;
+			for(int i=0; i<50; ++i)
+			{
+				const LoadItemQueueItem item = queue.dequeueFront();
+				const float priority = item.pos.getDist(campos) * item.size_factor;
+				testAssert(priority >= last_priority);
+				last_priority = priority;
+			}
+		}
+		testAssert(queue.size() == 1000);
+
+		queue.clear();
+		testAssert(queue.empty());
+		testAssert(task->getRefCount() == 1);
+	}
 
-	QueueItemDistComparator comparator;
-	comparator.campos = campos;
-
-	std::sort(items.begin() + begin_i, items.end(), comparator);
-
-	//conPrint("!!!!Sorting load item queue (" + toString(items.size() - begin_i) + " items) took " + timer.elapsedStringNSigFigs(4));
-
-	/*
-	If the unused space at the start of the array gets too large, copy items back to the start of the array, and trim off the end.
-	                 begin_i                    end
-	---------------------------------------------
-	   unused          |         data           |
-	---------------------------------------------
-	
-	|
-	v
-
-	begin_i                  end
-	--------------------------
-	|         data           |
-	--------------------------
-	
-	*/
-	if(begin_i > 1000)
+	// Benchmark, with a queue of 100k items, reprioritised every frame for a moving camera while tasks are dequeued.
+	if(false)
 	{
-		//conPrint("LoadItemQueue::sortQueue(): copying backwards (begin_i: " + toString(begin_i) + ")");
-		const size_t items_size = items.size();
-		for(size_t i = begin_i; i < items_size; ++i)
-			items[i - begin_i] = items[i];
-		items.resize(items.size() - begin_i);
-		begin_i = 0;
+		PCG32 rng(1);
+		LoadItemQueue queue;
+		glare::TaskRef task = new LoadItemQueueTestTask();
+		
+		Timer timer;
+		for(int i=0; i<100000; ++i)
+			queue.enqueueItem(Vec4f((rng.unitRandom() - 0.5f) * 2000.f, (rng.unitRandom() - 0.5f) * 2000.f, 0, 1), /*aabb_ws_longest_len=*/rng.unitRandom() * 10.f, task, 
+				/*task_max_dist=*/1000.f, /*importance_factor=*/1.f);
+		const double enqueue_time = timer.elapsed();
+
+		double reprioritise_time = 0;
+		double dequeue_time = 0;
+		const int num_frames = 100;
+		for(int frame=0; frame<num_frames; ++frame)
+		{
+			timer.reset();
+			queue.sortQueue(Vec3d(frame * 1.0, 0, 2));
+			reprioritise_time += timer.elapsed();
+
+			timer.reset();
+			for(int i=0; i<32; ++i)
+				queue.dequeueFront();
+			dequeue_time += timer.elapsed();
+		}
+
+		conPrint("LoadItemQueue: 100000 items: enqueue: " + doubleToStringNSigFigs(enqueue_time * 1.0e3, 4) + " ms, reprioritise: " + doubleToStringNSigFigs(reprioritise_time * 1.0e3 / num_frames, 4) + " ms/frame, " +
+			"dequeue: " + doubleToStringNSigFigs(dequeue_time * 1.0e9 / (num_frames * 32), 4) + " ns/item");
 	}
+
+	conPrint("LoadItemQueue::test() done");
 }
 
 
-LoadItemQueueItem LoadItemQueue::dequeueFront()
-{
-	assert(begin_i < items.size());
-
-	return items[begin_i++];
-}
+#endif // BUILD_TESTS
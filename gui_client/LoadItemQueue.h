@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2022 -
 #pragma once
 
 
+#include "DistancePriorityHeap.h"
 #include <Platform.h>
 #include <Vector.h>
 #include <Task.h>
@@ -45,7 +46,10 @@ struct LoadItemQueueItem
 LoadItemQueue
 -------------
 Queue of load model tasks, load texture tasks etc, together with the position of the item,
-which is used for sorting the tasks based on distance from the camera.
+which is used for prioritising the tasks based on distance from the camera.
+
+Items are kept in a DistancePriorityHeap, so enqueueing and dequeueing are O(log n), and
+reprioritising for a new camera position is O(n).
 =====================================================================*/
 class LoadItemQueue
 {
@@ -60,15 +64,15 @@ public:
 
 	void clear();
 
-	bool empty() const { return size() == 0; }
+	bool empty() const { return items.empty(); }
 
 	size_t size() const;
 
-	void sortQueue(const Vec3d& campos); // Sort queue (by item distance to camera)
+	void sortQueue(const Vec3d& campos); // Reprioritise queue (by item distance to camera)
 
 	LoadItemQueueItem dequeueFront();
+
+	static void test();
 private:
-	// Valid items are at indices [begin_i, items.size())
-	size_t begin_i;
-	js::Vector<LoadItemQueueItem, 16> items;
+	DistancePriorityHeap<LoadItemQueueItem> items;
 };
@@ -67,7 +67,7 @@ void LoadModelTask::run(size_t thread_index)
 				const bool need_lightmap_uvs = !voxel_ob->lightmap_url.empty();
 				Indigo::MeshRef indigo_mesh;
 				gl_meshdata = ModelLoading::makeModelForVoxelGroup(voxel_group, subsample_factor, ob_to_world_matrix, /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, 
-					need_lightmap_uvs, mat_transparent, build_dynamic_physics_ob, /*physics shape out=*/physics_shape, indigo_mesh);
+					need_lightmap_uvs, mat_transparent, build_dynamic_physics_ob, /*physics shape out=*/physics_shape, indigo_mesh, &opengl_engine->getTaskManager()); // Large groups are meshed in chunks in parallel.
 
 				// Temp for testing: Save voxels to disk.
 				//FileUtils::writeEntireFile("d:/files/voxeldata/ob_" + voxel_ob->uid.toString() + "_voxeldata.voxdata", (const char*)voxel_group.voxels.data(), voxel_group.voxels.dataSizeBytes());
@@ -85,7 +85,7 @@ void LoadModelTask::run(size_t thread_index)
 				/*vert_buf_allocator=*/NULL, 
 				true, // skip_opengl_calls - we need to do these on the main thread.
 				build_dynamic_physics_ob,
-				/*physics shape out=*/physics_shape, /*batched_mesh_out=*/batched_mesh);
+				/*physics shape out=*/physics_shape, /*batched_mesh_out=*/batched_mesh, this->physics_shape_cache.ptr());
 		}
 
 		// Send a ModelLoadedThreadMessage back to main window.
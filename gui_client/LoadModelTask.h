@@ -9,6 +9,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "../shared/WorldObject.h"
 #include "../shared/Avatar.h"
 #include "PhysicsObject.h"
+#include "PhysicsShapeCache.h"
 #include <opengl/OpenGLEngine.h>
 #include <Task.h>
 #include <ThreadMessage.h>
@@ -65,5 +66,6 @@ public:
 	PhysicsShape unit_cube_shape;
 	Reference<OpenGLEngine> opengl_engine;
 	Reference<ResourceManager> resource_manager;
+	Reference<PhysicsShapeCache> physics_shape_cache; // May be null.
 	ThreadSafeQueue<Reference<ThreadMessage> >* result_msg_queue;
 };
@@ -18,6 +18,7 @@ Copyright Glare Technologies Limited 2019 -
 #include <opengl/TextureAllocator.h>
 #include <ConPrint.h>
 #include <PlatformUtils.h>
+#include <Timer.h>
 #include <IncludeHalf.h>
 
 
@@ -42,11 +43,15 @@ void LoadTextureTask::run(size_t thread_index)
 			return;
 
 		// Load texture from disk and decode it.
+		Timer timer;
 		Reference<Map2D> map;
 		if(hasExtension(key, "gif"))
 			map = GIFDecoder::decodeImageSequence(key);
 		else
-			map = ImageDecoding::decodeImage(".", key);
+			map = ImageDecoding::decodeImage(".", key, &opengl_engine->getTaskManager());
+
+		const double decode_time = timer.elapsed();
+		timer.reset();
 
 #if USE_TEXTURE_VIEWS // NOTE: USE_TEXTURE_VIEWS is defined in opengl/TextureAllocator.h
 		// Resize for texture view
@@ -87,6 +92,8 @@ void LoadTextureTask::run(size_t thread_index)
 		msg->texture_data = texture_data;
 		if(is_terrain_map)
 			msg->terrain_map = map;
+		msg->decode_time = decode_time;
+		msg->process_time = timer.elapsed();
 		result_msg_queue->enqueue(msg);
 	}
 	catch(TextureServerExcep& e)
@@ -10,6 +10,7 @@ Copyright Glare Technologies Limited 2019 -
 #include <Task.h>
 #include <ThreadMessage.h>
 #include <ThreadSafeQueue.h>
+#include <Clock.h>
 #include <string>
 class OpenGLEngine;
 class TextureServer;
@@ -20,19 +21,30 @@ class Map2D;
 class TextureLoadedThreadMessage : public ThreadMessage
 {
 public:
+	TextureLoadedThreadMessage() : decode_time(0), process_time(0), creation_time(Clock::getTimeSinceInit()) {}
+
 	std::string tex_path;
 	std::string tex_key;
 	TextureParams tex_params;
 	Reference<TextureData> texture_data;
 	
 	Reference<Map2D> terrain_map; // Non-null iff we are loading a terrain map (e.g. is_terrain_map is true)
+
+	// Stage timings, for diagnostics.
+	double decode_time; // Time to read and decode the image file.
+	double process_time; // Time to resize, build mipmaps and compress.
+	double creation_time; // Clock::getTimeSinceInit() when the message was created, just before it was enqueued.
 };
 
 
 /*=====================================================================
 LoadTextureTask
 ---------------
-
+Decodes a texture and builds the texture data (mipmaps, compression) to upload.
+Large JPEGs are decoded in bands, and mipmaps built, in parallel on the OpenGL engine task manager,
+so a large texture takes less wall-clock time to load.  The loader thread running this task waits
+for the band and mipmap tasks to complete, so it is still occupied for the whole decode.
+The texture data is uploaded by the main thread over one or more frames, within a per-frame upload budget.
 =====================================================================*/
 class LoadTextureTask : public glare::Task
 {
@@ -144,6 +144,7 @@ MainOptionsDialog::MainOptionsDialog(QSettings* settings_)
 	const bool use_custom_cache_dir = settings->value(useCustomCacheDirKey(), /*default val=*/false).toBool();
 
 	SignalBlocker::setValue(this->loadDistanceDoubleSpinBox,		settings->value(objectLoadDistanceKey(),	/*default val=*/500.0).toDouble());
+	SignalBlocker::setValue(this->memoryBudgetSpinBox,				settings->value(memoryBudgetKey(),			/*default val=*/0).toInt());
 	SignalBlocker::setChecked(this->shadowsCheckBox,				settings->value(shadowsKey(),				/*default val=*/true).toBool());
 	SignalBlocker::setChecked(this->MSAACheckBox,					settings->value(MSAAKey(),					/*default val=*/true).toBool());
 	SignalBlocker::setChecked(this->bloomCheckBox,					settings->value(BloomKey(),					/*default val=*/true).toBool());
@@ -181,6 +182,7 @@ MainOptionsDialog::~MainOptionsDialog()
 void MainOptionsDialog::accepted()
 {
 	settings->setValue(objectLoadDistanceKey(),						this->loadDistanceDoubleSpinBox->value());
+	settings->setValue(memoryBudgetKey(),							this->memoryBudgetSpinBox->value());
 	settings->setValue(shadowsKey(),								this->shadowsCheckBox->isChecked());
 	settings->setValue(MSAAKey(),									this->MSAACheckBox->isChecked());
 	settings->setValue(BloomKey(),									this->bloomCheckBox->isChecked());
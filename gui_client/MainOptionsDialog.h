@@ -49,6 +49,8 @@ public:
 
 	static const QString showMinimapKey() { return "setting/show_minimap"; }
 
+	static const QString memoryBudgetKey() { return "setting/memory_budget_MB"; } // 0 means automatic, based on system memory.
+
 	static std::string getInputDeviceName(const QSettings* settings);
 	static float getInputScaleFactor(const QSettings* settings);
 
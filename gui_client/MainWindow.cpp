@@ -2650,6 +2650,8 @@ void MainWindow::on_actionOptions_triggered()
 		gui_client.load_distance = dist;
 		gui_client.load_distance2 = dist*dist;
 
+		gui_client.mesh_manager.setMemoryBudget(MeshManager::memoryBudgetForSetting(settings->value(MainOptionsDialog::memoryBudgetKey(), /*default val=*/0).toInt()));
+
 		//ui->glWidget->opengl_engine->setMSAAEnabled(settings->value(MainOptionsDialog::MSAAKey(), /*default val=*/true).toBool());
 
 		startMainTimer(); // Restart main timer, as the timer interval depends on max FPS, whiich may have changed.
@@ -9,6 +9,17 @@ Copyright Glare Technologies Limited 2022 -
 #include <opengl/OpenGLEngine.h>
 #include <opengl/OpenGLMeshRenderData.h>
 #include <utils/PlatformUtils.h>
+#include <utils/StringUtils.h>
+#include <utils/ConPrint.h>
+#include <maths/mathstypes.h>
+#include <algorithm>
+#if defined(_WIN32)
+#include <utils/IncludeWindows.h>
+#elif defined(OSX)
+#include <sys/sysctl.h>
+#elif !defined(EMSCRIPTEN)
+#include <unistd.h>
+#endif
 
 
 void MeshData::meshDataBecameUsed() const
@@ -57,6 +68,16 @@ MeshManager::MeshManager()
 	mesh_CPU_mem_usage = 0;
 	mesh_GPU_mem_usage = 0;
 	shape_mem_usage = 0;
+
+	texture_CPU_mem_usage = 0;
+	audio_mem_usage = 0;
+
+	num_meshes_evicted = 0;
+	num_shapes_evicted = 0;
+	mesh_bytes_evicted = 0;
+	shape_bytes_evicted = 0;
+
+	setMemoryBudget(computeDefaultMemoryBudget(/*physical RAM=*/0));
 }
 
 
@@ -178,6 +199,8 @@ void MeshManager::meshDataBecameUnused(const MeshData* meshdata)
 
 	//conPrint("meshDataBecameUnused():'" + meshdata->model_url + "'");
 
+	meshdata->became_unused_time = timer.elapsed();
+
 	model_URL_to_mesh_map.itemBecameUnused(meshdata->model_url);
 }
 
@@ -198,55 +221,230 @@ void MeshManager::physicsShapeDataBecameUnused(const PhysicsShapeData* shape_dat
 
 	//conPrint("physicsShapeDataBecameUnused(): '" + shape_data->model_url + "'");
 
+	shape_data->became_unused_time = timer.elapsed();
+
 	physics_shape_map.itemBecameUnused(MeshManagerPhysicsShapeKey(shape_data->model_url, shape_data->dynamic));
 }
 
 
+// Evicting an item means it will need to be reloaded (mesh) or rebuilt (physics shape) if an object uses it again.
+// Building a physics shape BVH costs more per byte than loading a mesh, so physics shapes are kept in preference to meshes of the same size.
+static const float MESH_RELOAD_COST_FACTOR = 1.f;
+static const float SHAPE_RELOAD_COST_FACTOR = 4.f;
+
+static const double EVICTION_AGE_SCALE = 60.0; // Items unused for this many seconds have their eviction score doubled.
+static const float EVICTION_DIST_SCALE = 100.f; // Items last used at this distance from the camera have their eviction score doubled.
+
+
+// Higher scores are evicted first.
+static inline double evictionScore(uint64 size_B, double unused_time, float last_use_dist, float reload_cost_factor)
+{
+	return (double)size_B * (1.0 + myMax(0.0, unused_time) / EVICTION_AGE_SCALE) * (1.0 + last_use_dist / EVICTION_DIST_SCALE) / reload_cost_factor;
+}
+
+
+// ManagerWithCache only supports removing the least recently used unused item, so to remove an arbitrary unused item,
+// mark it as used, which takes it off the unused list, then erase it.
+template <class ManagerType, class KeyType>
+static void removeUnusedItem(ManagerType& manager, const KeyType& key)
+{
+	manager.itemBecameUsed(key);
+	manager.items.erase(key);
+}
+
+
+struct EvictionCandidate
+{
+	double score;
+	const MeshData* mesh_data; // Either mesh_data or shape_data is non-null.
+	const PhysicsShapeData* shape_data;
+
+	bool operator < (const EvictionCandidate& other) const { return score > other.score; } // Sort in descending score order.
+};
+
+
+uint64 MeshManager::getMeshAndShapeTarget() const
+{
+	// Don't let texture and audio usage starve meshes and physics shapes completely, keep at least a quarter of the budget for them.
+	const uint64 external_usage = texture_budget + texture_CPU_mem_usage + audio_mem_usage;
+	const uint64 min_target = mem_budget / 4;
+	return (external_usage + min_target >= mem_budget) ? min_target : (mem_budget - external_usage);
+}
+
+
 void MeshManager::trimMeshMemoryUsage()
 {
-	const size_t max_mesh_CPU_mem_usage = 1024ull * 1024ull * 1024ull;
-	const size_t max_mesh_GPU_mem_usage = 1024ull * 1024ull * 1024ull;
+	checkRunningOnMainThread();
 
-	const size_t max_shape_mem_usage    = 1024ull * 1024ull * 1024ull;
+	const uint64 target = getMeshAndShapeTarget();
+	if(mesh_CPU_mem_usage + mesh_GPU_mem_usage + shape_mem_usage <= target)
+		return;
 
-	// Remove textures from unused texture list until we are using <= max_tex_mem_usage
-	while(((mesh_CPU_mem_usage > max_mesh_CPU_mem_usage) || (mesh_GPU_mem_usage > max_mesh_GPU_mem_usage)) && (model_URL_to_mesh_map.numUnusedItems() > 0))
+	// Score all unused meshes and physics shapes
+	const double cur_time = timer.elapsed();
+	std::vector<EvictionCandidate> candidates;
+	candidates.reserve(model_URL_to_mesh_map.numUnusedItems() + physics_shape_map.numUnusedItems());
+
+	for(auto it = model_URL_to_mesh_map.unused_items.begin(); it != model_URL_to_mesh_map.unused_items.end(); ++it)
 	{
-		std::string removed_key;
-		Reference<MeshData> removed_meshdata;
-		const bool removed = model_URL_to_mesh_map.removeLRUUnusedItem(removed_key, removed_meshdata);
-		assert(removed);
-		if(removed)
+		auto res = model_URL_to_mesh_map.items.find(*it); // Look up actual item for key
+		assert(res != model_URL_to_mesh_map.end());
+		if(res != model_URL_to_mesh_map.end())
+		{
+			const MeshData* mesh_data = res->second.value.ptr();
+			const GLMemUsage mesh_mem_usage = mesh_data->gl_meshdata->getTotalMemUsage();
+			EvictionCandidate candidate;
+			candidate.score = evictionScore(mesh_mem_usage.geom_cpu_usage + mesh_mem_usage.geom_gpu_usage, cur_time - mesh_data->became_unused_time, mesh_data->last_use_dist, MESH_RELOAD_COST_FACTOR);
+			candidate.mesh_data = mesh_data;
+			candidate.shape_data = NULL;
+			candidates.push_back(candidate);
+		}
+	}
+
+	for(auto it = physics_shape_map.unused_items.begin(); it != physics_shape_map.unused_items.end(); ++it)
+	{
+		auto res = physics_shape_map.items.find(*it); // Look up actual item for key
+		assert(res != physics_shape_map.end());
+		if(res != physics_shape_map.end())
+		{
+			const PhysicsShapeData* shape_data = res->second.value.ptr();
+			EvictionCandidate candidate;
+			candidate.score = evictionScore(shape_data->physics_shape.size_B, cur_time - shape_data->became_unused_time, shape_data->last_use_dist, SHAPE_RELOAD_COST_FACTOR);
+			candidate.mesh_data = NULL;
+			candidate.shape_data = shape_data;
+			candidates.push_back(candidate);
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+
+	// Evict in descending score order until we are using <= target
+	for(size_t i=0; (i < candidates.size()) && (mesh_CPU_mem_usage + mesh_GPU_mem_usage + shape_mem_usage > target); ++i)
+	{
+		if(candidates[i].mesh_data)
 		{
-			const GLMemUsage mesh_mem_usage = removed_meshdata->gl_meshdata->getTotalMemUsage();
+			const GLMemUsage mesh_mem_usage = candidates[i].mesh_data->gl_meshdata->getTotalMemUsage();
 
 			assert(this->mesh_CPU_mem_usage >= mesh_mem_usage.geom_cpu_usage);
 			assert(this->mesh_GPU_mem_usage >= mesh_mem_usage.geom_gpu_usage);
 
 			this->mesh_CPU_mem_usage -= mesh_mem_usage.geom_cpu_usage;
 			this->mesh_GPU_mem_usage -= mesh_mem_usage.geom_gpu_usage;
-		}
-	}
 
-	// Trim physics shapes from unused shape list, until we are using <= max_shape_mem_usage
-	while((shape_mem_usage > max_shape_mem_usage) && (physics_shape_map.numUnusedItems() > 0))
-	{
-		MeshManagerPhysicsShapeKey removed_key;
-		Reference<PhysicsShapeData> removed_meshdata;
-		const bool removed = physics_shape_map.removeLRUUnusedItem(removed_key, removed_meshdata);
-		assert(removed);
-		if(removed)
+			num_meshes_evicted++;
+			mesh_bytes_evicted += mesh_mem_usage.geom_cpu_usage + mesh_mem_usage.geom_gpu_usage;
+
+			const std::string key = candidates[i].mesh_data->model_url; // Copy the key, as removing the item destroys the MeshData.
+			removeUnusedItem(model_URL_to_mesh_map, key);
+		}
+		else
 		{
-			const size_t the_shape_mem_usage = removed_meshdata->physics_shape.size_B;
+			const size_t the_shape_mem_usage = candidates[i].shape_data->physics_shape.size_B;
 
 			assert(this->shape_mem_usage >= the_shape_mem_usage);
 
 			this->shape_mem_usage -= the_shape_mem_usage;
+
+			num_shapes_evicted++;
+			shape_bytes_evicted += the_shape_mem_usage;
+
+			const MeshManagerPhysicsShapeKey key(candidates[i].shape_data->model_url, candidates[i].shape_data->dynamic);
+			removeUnusedItem(physics_shape_map, key);
 		}
 	}
 }
 
 
+void MeshManager::setMemoryBudget(uint64 budget_B)
+{
+	mem_budget = budget_B;
+	texture_budget = textureBudgetForMemoryBudget(budget_B);
+}
+
+
+void MeshManager::setExternalMemUsage(uint64 texture_CPU_usage_B, uint64 audio_usage_B)
+{
+	texture_CPU_mem_usage = texture_CPU_usage_B;
+	audio_mem_usage = audio_usage_B;
+}
+
+
+MemBudgetStats MeshManager::getMemBudgetStats() const
+{
+	MemBudgetStats stats;
+	stats.budget = mem_budget;
+	stats.texture_budget = texture_budget;
+	stats.texture_CPU_usage = texture_CPU_mem_usage;
+	stats.audio_usage = audio_mem_usage;
+	stats.mesh_CPU_usage = mesh_CPU_mem_usage;
+	stats.mesh_GPU_usage = mesh_GPU_mem_usage;
+	stats.shape_usage = shape_mem_usage;
+	stats.mesh_and_shape_target = getMeshAndShapeTarget();
+	stats.num_meshes_evicted = num_meshes_evicted;
+	stats.num_shapes_evicted = num_shapes_evicted;
+	stats.mesh_bytes_evicted = mesh_bytes_evicted;
+	stats.shape_bytes_evicted = shape_bytes_evicted;
+	return stats;
+}
+
+
+uint64 MeshManager::getPhysicalRAMSize()
+{
+#if defined(_WIN32)
+	MEMORYSTATUSEX status;
+	status.dwLength = sizeof(status);
+	if(!GlobalMemoryStatusEx(&status))
+		return 0;
+	return (uint64)status.ullTotalPhys;
+#elif defined(OSX)
+	uint64 mem_size = 0;
+	size_t len = sizeof(mem_size);
+	if(sysctlbyname("hw.memsize", &mem_size, &len, NULL, 0) != 0)
+		return 0;
+	return mem_size;
+#elif defined(EMSCRIPTEN)
+	return 0;
+#else
+	const long num_pages = sysconf(_SC_PHYS_PAGES);
+	const long page_size = sysconf(_SC_PAGE_SIZE);
+	if(num_pages <= 0 || page_size <= 0)
+		return 0;
+	return (uint64)num_pages * (uint64)page_size;
+#endif
+}
+
+
+static const uint64 MIN_MEMORY_BUDGET = 1536ull * 1024 * 1024;
+static const uint64 MAX_MEMORY_BUDGET = 24ull * 1024 * 1024 * 1024;
+static const uint64 UNKNOWN_RAM_MEMORY_BUDGET = 3ull * 1024 * 1024 * 1024;
+
+
+uint64 MeshManager::computeDefaultMemoryBudget(uint64 physical_RAM_B)
+{
+	if(physical_RAM_B == 0)
+		return UNKNOWN_RAM_MEMORY_BUDGET;
+
+	// Leave most of RAM for the OS, other programs, and the rest of the client (world state, OpenGL engine etc.)
+	return myClamp<uint64>(physical_RAM_B / 5 * 2, MIN_MEMORY_BUDGET, MAX_MEMORY_BUDGET);
+}
+
+
+uint64 MeshManager::memoryBudgetForSetting(int budget_setting_MB)
+{
+	if(budget_setting_MB > 0)
+		return myMax<uint64>((uint64)budget_setting_MB * 1024 * 1024, 256ull * 1024 * 1024);
+	else
+		return computeDefaultMemoryBudget(getPhysicalRAMSize());
+}
+
+
+uint64 MeshManager::textureBudgetForMemoryBudget(uint64 budget_B)
+{
+	// Textures are mostly in GPU memory, so don't let the texture budget grow without bound on machines with lots of system RAM.
+	return myClamp<uint64>(budget_B / 20 * 7, 256ull * 1024 * 1024, 4ull * 1024 * 1024 * 1024);
+}
+
+
 std::string MeshManager::getDiagnostics() const
 {
 	//Timer timer;
@@ -294,7 +492,113 @@ std::string MeshManager::getDiagnostics() const
 	msg += "mesh_manager physics CPU active:        " + getNiceByteSize(shape_usage_used) + "\n";
 	msg += "mesh_manager physics CPU cached:        " + getNiceByteSize(unused_shape_mem) + "\n";
 
+	const MemBudgetStats budget_stats = getMemBudgetStats();
+	msg += "memory budget:                          " + getNiceByteSize(budget_stats.budget) + "\n";
+	msg += "memory budget textures (GPU reserved):  " + getNiceByteSize(budget_stats.texture_budget) + "\n";
+	msg += "memory budget textures (CPU):           " + getNiceByteSize(budget_stats.texture_CPU_usage) + "\n";
+	msg += "memory budget audio:                    " + getNiceByteSize(budget_stats.audio_usage) + "\n";
+	msg += "memory budget meshes (CPU + GPU):       " + getNiceByteSize(budget_stats.mesh_CPU_usage + budget_stats.mesh_GPU_usage) + "\n";
+	msg += "memory budget physics shapes:           " + getNiceByteSize(budget_stats.shape_usage) + "\n";
+	msg += "memory budget mesh + shape target:      " + getNiceByteSize(budget_stats.mesh_and_shape_target) + "\n";
+	msg += "memory budget meshes evicted:           " + toString(budget_stats.num_meshes_evicted) + " (" + getNiceByteSize(budget_stats.mesh_bytes_evicted) + ")\n";
+	msg += "memory budget physics shapes evicted:   " + toString(budget_stats.num_shapes_evicted) + " (" + getNiceByteSize(budget_stats.shape_bytes_evicted) + ")\n";
+
 	//conPrint("MeshManager::getDiagnostics took " + timer.elapsedStringNSigFigs(4));
 
 	return msg;
 }
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+
+
+static Reference<PhysicsShapeData> insertTestShape(MeshManager& mesh_manager, const std::string& URL, size_t size_B)
+{
+	PhysicsShape shape;
+	shape.size_B = size_B;
+	Reference<PhysicsShapeData> shape_data = mesh_manager.insertPhysicsShape(MeshManagerPhysicsShapeKey(URL, /*dynamic=*/false), shape);
+	shape_data->shapeDataBecameUsed(); // As done in GUIClient when an object uses the shape.
+	return shape_data;
+}
+
+
+static bool hasShape(MeshManager& mesh_manager, const std::string& URL)
+{
+	return mesh_manager.getPhysicsShapeData(MeshManagerPhysicsShapeKey(URL, /*dynamic=*/false)).nonNull();
+}
+
+
+void MeshManager::test()
+{
+	conPrint("MeshManager::test()");
+
+	const uint64 GB = 1024ull * 1024 * 1024;
+
+	//-------------------- Test budget sizing --------------------
+	testAssert(computeDefaultMemoryBudget(0) > 0);
+	testAssert(computeDefaultMemoryBudget(2 * GB) == MIN_MEMORY_BUDGET);
+	testAssert(computeDefaultMemoryBudget(8 * GB) > computeDefaultMemoryBudget(4 * GB));
+	testAssert(computeDefaultMemoryBudget(8 * GB) < 8 * GB / 2);
+	testAssert(computeDefaultMemoryBudget(256 * GB) == MAX_MEMORY_BUDGET);
+	testAssert(memoryBudgetForSetting(2048) == 2 * GB);
+	testAssert(memoryBudgetForSetting(0) == computeDefaultMemoryBudget(getPhysicalRAMSize()));
+	testAssert(textureBudgetForMemoryBudget(4 * GB) < 4 * GB);
+
+	conPrint("Physical RAM: " + getNiceByteSize(getPhysicalRAMSize()) + ", default memory budget: " + getNiceByteSize(memoryBudgetForSetting(0)));
+
+	//-------------------- Test eviction order --------------------
+	{
+		MeshManager mesh_manager;
+		mesh_manager.setMemoryBudget(4 * GB);
+		const uint64 target = mesh_manager.getMemBudgetStats().mesh_and_shape_target;
+		testAssert(target > 0 && target < 4 * GB);
+
+		Reference<PhysicsShapeData> used_shape = insertTestShape(mesh_manager, "used", target / 4);
+		{
+			Reference<PhysicsShapeData> near_small = insertTestShape(mesh_manager, "near_small", target / 4);
+			Reference<PhysicsShapeData> near_large = insertTestShape(mesh_manager, "near_large", target / 2);
+			Reference<PhysicsShapeData> far_large  = insertTestShape(mesh_manager, "far_large",  target / 2);
+			near_small->last_use_dist = 10;
+			near_large->last_use_dist = 10;
+			far_large->last_use_dist = 1000;
+		} // Only the MeshManager references the shapes now, so they become unused.
+
+		testAssert(mesh_manager.getMemBudgetStats().shape_usage == target / 4 * 2 + target / 2 * 2);
+
+		// Over the target by target / 2: the far shape should be evicted, as it has the highest score.
+		mesh_manager.trimMeshMemoryUsage();
+		testAssert(!hasShape(mesh_manager, "far_large"));
+		testAssert(hasShape(mesh_manager, "near_large") && hasShape(mesh_manager, "near_small") && hasShape(mesh_manager, "used"));
+		testAssert(mesh_manager.getMemBudgetStats().shape_usage <= target);
+		testAssert(mesh_manager.getMemBudgetStats().num_shapes_evicted == 1);
+
+		// Texture usage reduces the target.  Of the nearby shapes, the larger one should be evicted first.
+		mesh_manager.setExternalMemUsage(/*texture CPU usage=*/target / 2, /*audio usage=*/0);
+		const uint64 new_target = mesh_manager.getMemBudgetStats().mesh_and_shape_target;
+		testAssert(new_target < target && new_target >= target / 4 * 2);
+		mesh_manager.trimMeshMemoryUsage();
+		testAssert(!hasShape(mesh_manager, "near_large"));
+		testAssert(hasShape(mesh_manager, "near_small") && hasShape(mesh_manager, "used"));
+
+		// Used items are never evicted, even if over the target.
+		mesh_manager.setExternalMemUsage(/*texture CPU usage=*/8 * GB, /*audio usage=*/8 * GB);
+		mesh_manager.trimMeshMemoryUsage();
+		testAssert(mesh_manager.getMemBudgetStats().mesh_and_shape_target == 4 * GB / 4); // Should be clamped to the minimum target.
+		testAssert(hasShape(mesh_manager, "used"));
+
+		// Once unused, it can be evicted.
+		used_shape = NULL;
+		mesh_manager.setMemoryBudget(0);
+		mesh_manager.trimMeshMemoryUsage();
+		testAssert(!hasShape(mesh_manager, "used") && !hasShape(mesh_manager, "near_small"));
+		testAssert(mesh_manager.getMemBudgetStats().shape_usage == 0);
+	}
+
+	conPrint("MeshManager::test() done");
+}
+
+
+#endif // BUILD_TESTS
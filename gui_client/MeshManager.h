@@ -10,6 +10,7 @@ Copyright Glare Technologies Limited 2022 -
 #include <opengl/GLMemUsage.h>
 #include <simpleraytracer/raymesh.h>
 #include <utils/ManagerWithCache.h>
+#include <utils/Timer.h>
 #include <map>
 class OpenGLMeshRenderData;
 class MeshManager;
@@ -17,7 +18,7 @@ class MeshManager;
 
 struct MeshData
 {
-	MeshData(const std::string& model_URL_, Reference<OpenGLMeshRenderData> gl_meshdata_, MeshManager* mesh_manager_) : model_url(model_URL_), gl_meshdata(gl_meshdata_), refcount(0), mesh_manager(mesh_manager_) {}
+	MeshData(const std::string& model_URL_, Reference<OpenGLMeshRenderData> gl_meshdata_, MeshManager* mesh_manager_) : model_url(model_URL_), gl_meshdata(gl_meshdata_), refcount(0), mesh_manager(mesh_manager_), became_unused_time(0), last_use_dist(0) {}
 
 	//------------------- Custom ReferenceCounted stuff, so we can call meshDataBecameUnused() ---------------------
 	/// Increment reference count
@@ -59,12 +60,16 @@ struct MeshData
 	mutable glare::AtomicInt refcount;
 
 	MeshManager* mesh_manager;
+
+	// Used for choosing which unused items to evict when over the memory budget.
+	mutable double became_unused_time; // MeshManager time at which the last user stopped using this item.
+	float last_use_dist; // Distance from the camera of the last object that used this item, when the object was removed.  0 if unknown.
 };
 
 
 struct PhysicsShapeData
 {
-	PhysicsShapeData(const std::string& model_URL_, bool dynamic_, PhysicsShape physics_shape_, MeshManager* mesh_manager_) : model_url(model_URL_), dynamic(dynamic_), physics_shape(physics_shape_), refcount(0), mesh_manager(mesh_manager_) {}
+	PhysicsShapeData(const std::string& model_URL_, bool dynamic_, PhysicsShape physics_shape_, MeshManager* mesh_manager_) : model_url(model_URL_), dynamic(dynamic_), physics_shape(physics_shape_), refcount(0), mesh_manager(mesh_manager_), became_unused_time(0), last_use_dist(0) {}
 
 	//------------------- Custom ReferenceCounted stuff, so we can call shapeDataBecameUnused() ---------------------
 	/// Increment reference count
@@ -107,6 +112,10 @@ struct PhysicsShapeData
 	mutable glare::AtomicInt refcount;
 
 	MeshManager* mesh_manager;
+
+	// Used for choosing which unused items to evict when over the memory budget.
+	mutable double became_unused_time; // MeshManager time at which the last user stopped using this item.
+	float last_use_dist; // Distance from the camera of the last object that used this item, when the object was removed.  0 if unknown.
 };
 
 
@@ -141,11 +150,37 @@ struct MeshManagerPhysicsShapeKeyHasher
 };
 
 
+// Memory usage by category, counted against the MeshManager memory budget.  All sizes in bytes.
+struct MemBudgetStats
+{
+	uint64 budget;
+	uint64 texture_budget; // Part of the budget reserved for the OpenGL engine texture cache.
+	uint64 texture_CPU_usage; // Textures held by the texture server.
+	uint64 audio_usage;
+	uint64 mesh_CPU_usage;
+	uint64 mesh_GPU_usage;
+	uint64 shape_usage;
+	uint64 mesh_and_shape_target; // Meshes and physics shapes are evicted until their total usage is <= this.
+
+	uint64 num_meshes_evicted;
+	uint64 num_shapes_evicted;
+	uint64 mesh_bytes_evicted;
+	uint64 shape_bytes_evicted;
+};
+
+
 /*=====================================================================
 MeshManager
 -----------
 Caches OpenGLMeshRenderData and physics shapes loaded from disk and built.
 
+There is a single memory budget covering meshes, physics shapes, textures and audio.
+Textures and audio are managed elsewhere, so their usage is passed in with setExternalMemUsage(),
+and meshes and physics shapes not used by any object are evicted until the total is within the budget.
+
+Eviction is by cost rather than just recency: unused items with a higher
+size * age * distance / reload cost score are evicted first.
+
 NOTE: Do we need to make this class threadsafe?  Or are all methods called on the main thread (in particular meshDataBecameUnused()?)
 =====================================================================*/
 class MeshManager
@@ -171,9 +206,32 @@ public:
 
 	void trimMeshMemoryUsage();
 
+	void setMemoryBudget(uint64 budget_B); // Also sets the texture budget to textureBudgetForMemoryBudget(budget_B).
+	uint64 getMemoryBudget() const { return mem_budget; }
+
+	// Set the current memory usage of textures held by the texture server, and of audio.  These are counted against the budget, but not evicted by MeshManager.
+	void setExternalMemUsage(uint64 texture_CPU_usage_B, uint64 audio_usage_B);
+
+	MemBudgetStats getMemBudgetStats() const;
+
+	// Returns total physical RAM in bytes, or 0 if it could not be determined.
+	static uint64 getPhysicalRAMSize();
+
+	// Budget used when the user has not set one: a fraction of physical RAM, clamped to a sensible range.
+	static uint64 computeDefaultMemoryBudget(uint64 physical_RAM_B);
+
+	// Returns the budget for a memory budget user setting in MB, where 0 means automatic (computeDefaultMemoryBudget(getPhysicalRAMSize())).
+	static uint64 memoryBudgetForSetting(int budget_setting_MB);
+
+	// Part of the budget reserved for GPU textures, for OpenGLEngineSettings::max_tex_mem_usage.
+	static uint64 textureBudgetForMemoryBudget(uint64 budget_B);
+
+	static void test();
+
 	//Mutex& getMutex() { return mutex; }
 private:
 	void checkRunningOnMainThread();
+	uint64 getMeshAndShapeTarget() const;
 
 	//mutable Mutex mutex;
 	ManagerWithCache<std::string, Reference<MeshData> > model_URL_to_mesh_map;
@@ -183,7 +241,19 @@ private:
 	uint64 main_thread_id;
 
 	uint64 mesh_CPU_mem_usage; // Running sum of CPU RAM used by inserted meshes.
-	uint64 mesh_GPU_mem_usage; // Running sum of CPU RAM used by inserted meshes.
+	uint64 mesh_GPU_mem_usage; // Running sum of GPU RAM used by inserted meshes.
 
 	uint64 shape_mem_usage; // Running sum of CPU RAM used by inserted physics shapes.
+
+	uint64 mem_budget;
+	uint64 texture_budget;
+	uint64 texture_CPU_mem_usage;
+	uint64 audio_mem_usage;
+
+	uint64 num_meshes_evicted;
+	uint64 num_shapes_evicted;
+	uint64 mesh_bytes_evicted;
+	uint64 shape_bytes_evicted;
+
+	Timer timer; // For became_unused_time.
 };
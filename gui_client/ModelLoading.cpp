@@ -946,7 +946,7 @@ void ModelLoading::setMaterialTexPathsForLODLevel(GLObject& gl_ob, int ob_lod_le
 
 Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForModelURL(const std::string& lod_model_URL,
 	ResourceManager& resource_manager, VertexBufferAllocator* vert_buf_allocator,
-	bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out)
+	bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out, PhysicsShapeCache* physics_shape_cache)
 {
 	// Load mesh from disk:
 	const std::string model_path = resource_manager.pathForURL(lod_model_URL);
@@ -1017,7 +1017,7 @@ Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForMod
 
 	gl_meshdata->num_materials_referenced = batched_mesh->numMaterialsReferenced();
 
-	physics_shape_out = PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, /*is dynamic=*/build_dynamic_physics_ob);
+	physics_shape_out = PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, /*is dynamic=*/build_dynamic_physics_ob, physics_shape_cache);
 
 	batched_mesh_out = batched_mesh;
 
@@ -1368,14 +1368,48 @@ static Reference<OpenGLMeshRenderData> buildVoxelOpenGLMeshData(const Indigo::Me
 }
 
 
+// Allocates vertex and index buffers for the mesh data, and frees the CPU-side copies.
+static void loadVoxelMeshDataIntoGPUMem(OpenGLMeshRenderData& mesh_data, VertexBufferAllocator& vert_buf_allocator)
+{
+	if(!mesh_data.vert_index_buffer_uint8.empty())
+	{
+		mesh_data.indices_vbo_handle = vert_buf_allocator.allocateIndexData(mesh_data.vert_index_buffer_uint8.data(), mesh_data.vert_index_buffer_uint8.dataSizeBytes());
+		assert(mesh_data.getIndexType() == GL_UNSIGNED_BYTE);
+	}
+	else if(!mesh_data.vert_index_buffer_uint16.empty())
+	{
+		mesh_data.indices_vbo_handle = vert_buf_allocator.allocateIndexData(mesh_data.vert_index_buffer_uint16.data(), mesh_data.vert_index_buffer_uint16.dataSizeBytes());
+		assert(mesh_data.getIndexType() == GL_UNSIGNED_SHORT);
+	}
+	else
+	{
+		mesh_data.indices_vbo_handle = vert_buf_allocator.allocateIndexData(mesh_data.vert_index_buffer.data(), mesh_data.vert_index_buffer.dataSizeBytes());
+		assert(mesh_data.getIndexType() == GL_UNSIGNED_INT);
+	}
+
+	mesh_data.vbo_handle = vert_buf_allocator.allocate(mesh_data.vertex_spec, mesh_data.vert_data.data(), mesh_data.vert_data.dataSizeBytes());
+
+#if DO_INDIVIDUAL_VAO_ALLOC
+	mesh_data.individual_vao = new VAO(mesh_data.vbo_handle.vbo, mesh_data.indices_vbo_handle.index_vbo, mesh_data.vertex_spec);
+#endif
+
+	mesh_data.vert_data.clearAndFreeMem();
+	mesh_data.vert_index_buffer.clearAndFreeMem();
+	mesh_data.vert_index_buffer_uint16.clearAndFreeMem();
+	mesh_data.vert_index_buffer_uint8.clearAndFreeMem();
+}
+
+
 Reference<OpenGLMeshRenderData> ModelLoading::makeModelForVoxelGroup(const VoxelGroup& voxel_group, int subsample_factor, const Matrix4f& ob_to_world, 
 	VertexBufferAllocator* vert_buf_allocator, bool do_opengl_stuff, bool need_lightmap_uvs, const js::Vector<bool, 16>& mats_transparent, bool build_dynamic_physics_ob, 
-	PhysicsShape& physics_shape_out, Indigo::MeshRef& indigo_mesh_out)
+	PhysicsShape& physics_shape_out, Indigo::MeshRef& indigo_mesh_out, glare::TaskManager* task_manager)
 {
 	// Timer timer;
 	StandardPrintOutput print_output;
 
-	Indigo::MeshRef indigo_mesh = VoxelMeshBuilding::makeIndigoMeshForVoxelGroup(voxel_group, subsample_factor, /*generate_shading_normals=*/false, mats_transparent);
+	// Lightmaps are baked for the mesh of the whole voxel group built by LightMapperBot, so don't use chunked meshing if we need lightmap UVs, or the UVs won't match.
+	Indigo::MeshRef indigo_mesh = VoxelMeshBuilding::makeIndigoMeshForVoxelGroup(voxel_group, subsample_factor, /*generate_shading_normals=*/false, mats_transparent, 
+		need_lightmap_uvs ? NULL : task_manager);
 	// We will compute geometric normals in the opengl shader, so don't need to compute them here.
 
 	if(need_lightmap_uvs)
@@ -1400,38 +1434,62 @@ Reference<OpenGLMeshRenderData> ModelLoading::makeModelForVoxelGroup(const Voxel
 
 	// Load rendering data into GPU mem if requested.
 	if(do_opengl_stuff)
+		loadVoxelMeshDataIntoGPUMem(*mesh_data, *vert_buf_allocator);
+
+	indigo_mesh_out = indigo_mesh;
+
+	// conPrint("ModelLoading::makeModelForVoxelGroup for " + toString(voxel_group.voxels.size()) + " voxels took " + timer.elapsedString());
+	return mesh_data;
+}
+
+
+Reference<OpenGLMeshRenderData> ModelLoading::makeModelForVoxelGroupIncremental(const VoxelGroup& voxel_group, int subsample_factor,
+	VertexBufferAllocator* vert_buf_allocator, bool do_opengl_stuff, const js::Vector<bool, 16>& mats_transparent, bool build_dynamic_physics_ob,
+	VoxelEditMeshCache& edit_cache, glare::TaskManager* task_manager, PhysicsShape& physics_shape_out)
+{
+	std::vector<uint64> changed_chunks;
+	edit_cache.chunked_mesh.update(voxel_group, subsample_factor, mats_transparent, task_manager, changed_chunks);
+
+	Indigo::MeshRef indigo_mesh = edit_cache.chunked_mesh.makeMergedMesh();
+
+	if(build_dynamic_physics_ob)
 	{
-		if(!mesh_data->vert_index_buffer_uint8.empty())
-		{
-			mesh_data->indices_vbo_handle = vert_buf_allocator->allocateIndexData(mesh_data->vert_index_buffer_uint8.data(), mesh_data->vert_index_buffer_uint8.dataSizeBytes());
-			assert(mesh_data->getIndexType() == GL_UNSIGNED_BYTE);
-		}
-		else if(!mesh_data->vert_index_buffer_uint16.empty())
+		// Dynamic objects use a convex hull of the whole mesh, which needs to be rebuilt anyway.
+		edit_cache.chunk_shapes.clear();
+		physics_shape_out = PhysicsWorld::createJoltShapeForIndigoMesh(*indigo_mesh, /*build_dynamic_physics_ob=*/true);
+	}
+	else
+	{
+		// If the chunk shapes were removed, for example if the object was dynamic before, rebuild them all.
+		if(edit_cache.chunk_shapes.empty())
 		{
-			mesh_data->indices_vbo_handle = vert_buf_allocator->allocateIndexData(mesh_data->vert_index_buffer_uint16.data(), mesh_data->vert_index_buffer_uint16.dataSizeBytes());
-			assert(mesh_data->getIndexType() == GL_UNSIGNED_SHORT);
+			changed_chunks.clear();
+			edit_cache.chunked_mesh.getChunkKeys(changed_chunks);
 		}
-		else
+
+		// Rebuild shapes for changed chunks only.
+		for(size_t i=0; i<changed_chunks.size(); ++i)
 		{
-			mesh_data->indices_vbo_handle = vert_buf_allocator->allocateIndexData(mesh_data->vert_index_buffer.data(), mesh_data->vert_index_buffer.dataSizeBytes());
-			assert(mesh_data->getIndexType() == GL_UNSIGNED_INT);
+			const Indigo::Mesh* chunk_mesh = edit_cache.chunked_mesh.getChunkMesh(changed_chunks[i]);
+			if(chunk_mesh)
+				edit_cache.chunk_shapes[changed_chunks[i]] = PhysicsWorld::createJoltShapeForIndigoMesh(*chunk_mesh, /*build_dynamic_physics_ob=*/false);
+			else
+				edit_cache.chunk_shapes.erase(changed_chunks[i]);
 		}
 
-		mesh_data->vbo_handle = vert_buf_allocator->allocate(mesh_data->vertex_spec, mesh_data->vert_data.data(), mesh_data->vert_data.dataSizeBytes());
+		std::vector<PhysicsShape> shapes;
+		shapes.reserve(edit_cache.chunk_shapes.size());
+		for(auto it = edit_cache.chunk_shapes.begin(); it != edit_cache.chunk_shapes.end(); ++it)
+			shapes.push_back(it->second);
 
-#if DO_INDIVIDUAL_VAO_ALLOC
-		mesh_data->individual_vao = new VAO(mesh_data->vbo_handle.vbo, mesh_data->indices_vbo_handle.index_vbo, mesh_data->vertex_spec);
-#endif
-
-		mesh_data->vert_data.clearAndFreeMem();
-		mesh_data->vert_index_buffer.clearAndFreeMem();
-		mesh_data->vert_index_buffer_uint16.clearAndFreeMem();
-		mesh_data->vert_index_buffer_uint8.clearAndFreeMem();
+		physics_shape_out = PhysicsWorld::createStaticCompoundShape(shapes);
 	}
 
-	indigo_mesh_out = indigo_mesh;
+	Reference<OpenGLMeshRenderData> mesh_data = buildVoxelOpenGLMeshData(*indigo_mesh);
+
+	if(do_opengl_stuff)
+		loadVoxelMeshDataIntoGPUMem(*mesh_data, *vert_buf_allocator);
 
-	// conPrint("ModelLoading::makeModelForVoxelGroup for " + toString(voxel_group.voxels.size()) + " voxels took " + timer.elapsedString());
 	return mesh_data;
 }
 
@@ -1443,6 +1501,7 @@ Reference<OpenGLMeshRenderData> ModelLoading::makeModelForVoxelGroup(const Voxel
 #include <utils/TaskManager.h>
 #include <maths/PCG32.h>
 #include <utils/TestUtils.h>
+#include <utils/Timer.h>
 
 
 void ModelLoading::test()
@@ -1620,6 +1679,80 @@ void ModelLoading::test()
 		//testAssert(physics_shape->raymesh->getTriangles().size() == 2 * 5 * 2);
 	}
 
+	// Test incremental voxel model building, as used when editing voxels.  Also reports edit latency, including the physics shape rebuild, for a group with 1M voxels.
+	try
+	{
+		glare::TaskManager task_manager;
+
+		js::Vector<bool, 16> mat_transparent(2, false);
+
+		VoxelGroup group;
+		for(int z=0; z<100; ++z)
+		for(int y=0; y<100; ++y)
+		for(int x=0; x<100; ++x)
+			group.voxels.push_back(Voxel(Vec3<int>(x, y, z), (x / 10 + y / 10) % 2));
+
+		VoxelEditMeshCache edit_cache;
+		PhysicsShape physics_shape;
+		Reference<OpenGLMeshRenderData> data = makeModelForVoxelGroupIncremental(group, /*subsample_factor=*/1, /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, mat_transparent,
+			/*build_dynamic_physics_ob=*/false, edit_cache, &task_manager, physics_shape);
+
+		testAssert(edit_cache.chunked_mesh.numChunks() == 4 * 4 * 4);
+		testAssert(edit_cache.chunk_shapes.size() == edit_cache.chunked_mesh.numChunks() - 2 * 2 * 2); // The chunks in the middle of the group have no visible faces.
+		testAssert(physics_shape.jolt_shape->GetSubType() == JPH::EShapeSubType::StaticCompound);
+		testAssert(physics_shape.jolt_shape->GetLocalBounds().mMin.IsClose(JPH::Vec3(0, 0, 0), /*max dist sqrd=*/1.0e-6f));
+		testAssert(physics_shape.jolt_shape->GetLocalBounds().mMax.IsClose(JPH::Vec3(100, 100, 100), /*max dist sqrd=*/1.0e-6f));
+
+		// Remove a voxel on the surface.  Should just rebuild the shape for one chunk.
+		const PhysicsShape corner_chunk_shape = edit_cache.chunk_shapes[ChunkedVoxelMesh::chunkKey(Vec3<int>(0, 0, 0))];
+		const PhysicsShape other_chunk_shape = edit_cache.chunk_shapes[ChunkedVoxelMesh::chunkKey(Vec3<int>(1, 1, 0))];
+		group.voxels[0] = group.voxels[group.voxels.size() - 1];
+		group.voxels.resize(group.voxels.size() - 1);
+		data = makeModelForVoxelGroupIncremental(group, /*subsample_factor=*/1, /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, mat_transparent,
+			/*build_dynamic_physics_ob=*/false, edit_cache, &task_manager, physics_shape);
+		testAssert(edit_cache.chunk_shapes[ChunkedVoxelMesh::chunkKey(Vec3<int>(0, 0, 0))].jolt_shape != corner_chunk_shape.jolt_shape);
+		testAssert(edit_cache.chunk_shapes[ChunkedVoxelMesh::chunkKey(Vec3<int>(1, 1, 0))].jolt_shape == other_chunk_shape.jolt_shape);
+
+		// Dynamic objects should get a convex hull shape.
+		PhysicsShape dynamic_shape;
+		makeModelForVoxelGroupIncremental(group, /*subsample_factor=*/1, /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, mat_transparent,
+			/*build_dynamic_physics_ob=*/true, edit_cache, &task_manager, dynamic_shape);
+		testAssert(dynamic_shape.jolt_shape->GetSubType() == JPH::EShapeSubType::ConvexHull);
+		testAssert(edit_cache.chunk_shapes.empty());
+
+		// Performance test: time single voxel edits, full rebuild vs incremental.
+		if(false)
+		{
+			makeModelForVoxelGroupIncremental(group, /*subsample_factor=*/1, /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, mat_transparent,
+				/*build_dynamic_physics_ob=*/false, edit_cache, &task_manager, physics_shape);
+
+			double full_time = 1.0e10;
+			double incremental_time = 1.0e10;
+			for(int t=0; t<10; ++t)
+			{
+				group.voxels[group.voxels.size() / 2 + t * 1000].mat_index = 1 - group.voxels[group.voxels.size() / 2 + t * 1000].mat_index;
+
+				Timer timer;
+				Indigo::MeshRef indigo_mesh;
+				makeModelForVoxelGroup(group, /*subsample_factor=*/1, Matrix4f::identity(), /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, /*need_lightmap_uvs=*/false, mat_transparent,
+					/*build_dynamic_physics_ob=*/false, physics_shape, indigo_mesh);
+				full_time = myMin(full_time, timer.elapsed());
+
+				timer.reset();
+				makeModelForVoxelGroupIncremental(group, /*subsample_factor=*/1, /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, mat_transparent,
+					/*build_dynamic_physics_ob=*/false, edit_cache, &task_manager, physics_shape);
+				incremental_time = myMin(incremental_time, timer.elapsed());
+			}
+
+			conPrint("Voxel edit of " + toString(group.voxels.size()) + " voxel group, including physics shape: full rebuild: " + doubleToStringNSigFigs(full_time * 1.0e3, 4) + " ms, incremental: " +
+				doubleToStringNSigFigs(incremental_time * 1.0e3, 4) + " ms");
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
 	// Performance test
 	//if(false)
 	//{
@@ -12,6 +12,9 @@ Copyright Glare Technologies Limited 2016 -
 #include <dll/include/IndigoMesh.h>
 #include <graphics/BatchedMesh.h>
 #include <utils/Vector.h>
+#include "../shared/VoxelMeshBuilding.h"
+#include "PhysicsObject.h"
+#include <map>
 
 
 struct GLObject;
@@ -19,9 +22,19 @@ class Matrix4f;
 class ResourceManager;
 class RayMesh;
 class PhysicsShape;
+class PhysicsShapeCache;
 class VoxelGroup;
 class VertexBufferAllocator;
 namespace Indigo { class TaskManager; }
+namespace glare { class TaskManager; }
+
+
+// Per-object chunk meshes and physics shapes for a voxel object being edited, so an edit only needs the changed chunks to be rebuilt.
+struct VoxelEditMeshCache : public ThreadSafeRefCounted
+{
+	ChunkedVoxelMesh chunked_mesh;
+	std::map<uint64, PhysicsShape> chunk_shapes; // Map from chunk key to mesh physics shape for the chunk.  Not used for dynamic objects.
+};
 
 
 /*=====================================================================
@@ -83,14 +96,22 @@ public:
 
 
 	// Build a BatchedMesh and OpenGLMeshRenderData from a mesh on disk identified by lod_model_URL.  Also build a physics shape.
+	// If physics_shape_cache is non-null, the physics shape is taken from the cache if present, and added to it otherwise.
 	static Reference<OpenGLMeshRenderData> makeGLMeshDataAndBatchedMeshForModelURL(const std::string& lod_model_URL,
 		ResourceManager& resource_manager, VertexBufferAllocator* vert_buf_allocator,
-		bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out);
+		bool skip_opengl_calls, bool build_dynamic_physics_ob, PhysicsShape& physics_shape_out, BatchedMeshRef& batched_mesh_out, PhysicsShapeCache* physics_shape_cache = NULL);
 
 	// Build OpenGLMeshRenderData from voxel data.  Also return a reference to an Indigo Mesh and physics shape.
 	static Reference<OpenGLMeshRenderData> makeModelForVoxelGroup(const VoxelGroup& voxel_group, int subsample_factor, const Matrix4f& ob_to_world, 
 		VertexBufferAllocator* vert_buf_allocator, bool do_opengl_stuff, bool need_lightmap_uvs, const js::Vector<bool, 16>& mats_transparent, bool build_dynamic_physics_ob,
-		PhysicsShape& physics_shape_out, Indigo::MeshRef& indigo_mesh_out);
+		PhysicsShape& physics_shape_out, Indigo::MeshRef& indigo_mesh_out, glare::TaskManager* task_manager = NULL);
+
+	// Build OpenGLMeshRenderData and a physics shape for an edited voxel group, re-meshing only the chunks that changed since the last call with edit_cache.
+	// The physics shape is a compound of the chunk shapes, or for dynamic objects, a convex hull of the whole mesh.
+	// Doesn't build lightmap UVs.  If do_opengl_stuff is true, the mesh data is loaded into GPU mem.
+	static Reference<OpenGLMeshRenderData> makeModelForVoxelGroupIncremental(const VoxelGroup& voxel_group, int subsample_factor,
+		VertexBufferAllocator* vert_buf_allocator, bool do_opengl_stuff, const js::Vector<bool, 16>& mats_transparent, bool build_dynamic_physics_ob,
+		VoxelEditMeshCache& edit_cache, glare::TaskManager* task_manager, PhysicsShape& physics_shape_out);
 
 	//static Reference<BatchedMesh> makeBatchedMeshForVoxelGroup(const VoxelGroup& voxel_group);
 	//static Reference<Indigo::Mesh> makeIndigoMeshForVoxelGroup(const VoxelGroup& voxel_group);
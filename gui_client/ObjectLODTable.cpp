@@ -0,0 +1,367 @@
+/*=====================================================================
+ObjectLODTable.cpp
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ObjectLODTable.h"
+
+
+#include "../shared/WorldObject.h"
+#include <limits>
+
+
+ObjectLODTable::ObjectLODTable()
+{}
+
+
+ObjectLODTable::~ObjectLODTable()
+{
+	clear();
+}
+
+
+static inline Vec4f computeLODDist2(const WorldObject& ob)
+{
+	return Vec4f(
+		Maths::square(ob.getMaxDistForLODLevel(-1)),
+		Maths::square(ob.getMaxDistForLODLevel(0)),
+		Maths::square(ob.getMaxDistForLODLevel(1)),
+		std::numeric_limits<float>::infinity()
+	);
+}
+
+
+void ObjectLODTable::addObject(WorldObject* ob)
+{
+	assert(ob->lod_table == NULL);
+
+	ob->lod_table = this;
+	ob->lod_table_index = (int)obs.size();
+
+	centroids.push_back(ob->getCentroidWS());
+	lod_dist2.push_back(computeLODDist2(*ob));
+	lod_levels.push_back((int8)ob->current_lod_level);
+	in_proximity.push_back(ob->in_proximity ? 1 : 0);
+	obs.push_back(ob);
+}
+
+
+void ObjectLODTable::removeObject(WorldObject* ob)
+{
+	if(ob->lod_table != this)
+		return;
+
+	// Move the last entry into the slot of the removed object.
+	const size_t i = (size_t)ob->lod_table_index;
+	const size_t last = obs.size() - 1;
+	assert(obs[i] == ob);
+	if(i != last)
+	{
+		centroids[i]    = centroids[last];
+		lod_dist2[i]    = lod_dist2[last];
+		lod_levels[i]   = lod_levels[last];
+		in_proximity[i] = in_proximity[last];
+		obs[i]          = obs[last];
+		obs[i]->lod_table_index = (int)i;
+	}
+
+	centroids.pop_back();
+	lod_dist2.pop_back();
+	lod_levels.pop_back();
+	in_proximity.pop_back();
+	obs.pop_back();
+
+	ob->lod_table = NULL;
+	ob->lod_table_index = -1;
+}
+
+
+void ObjectLODTable::clear()
+{
+	for(size_t i=0; i<obs.size(); ++i)
+	{
+		obs[i]->lod_table = NULL;
+		obs[i]->lod_table_index = -1;
+	}
+
+	centroids.clear();
+	lod_dist2.clear();
+	lod_levels.clear();
+	in_proximity.clear();
+	obs.clear();
+}
+
+
+void ObjectLODTable::objectTransformChanged(const WorldObject& ob)
+{
+	assert(ob.lod_table == this);
+
+	const size_t i = (size_t)ob.lod_table_index;
+	centroids[i] = ob.getCentroidWS();
+	lod_dist2[i] = computeLODDist2(ob);
+}
+
+
+void ObjectLODTable::setInProximity(const WorldObject& ob, bool in_proximity_)
+{
+	assert(ob.lod_table == this);
+
+	in_proximity[ob.lod_table_index] = in_proximity_ ? 1 : 0;
+}
+
+
+void ObjectLODTable::checkForLODChanges(const Vec4f& campos, float load_distance2, js::Vector<Change, 16>& changes_out)
+{
+	// lod_dist2 increases from lane 0 to 2, and lane 3 is infinity, so the movemask of (d2 >= lod_dist2) is 0b0000, 0b0001, 0b0011 or 0b0111.
+	// The LOD level is the number of bits set, minus one.
+	static const int8 lod_level_for_mask[16] = { -1, 0, 0, 1, 0, 1, 1, 2, 0, 1, 1, 2, 1, 2, 2, 3 };
+
+	const Vec4f* const centroids_data = centroids.data();
+	const Vec4f* const lod_dist2_data = lod_dist2.data();
+	int8* const lod_levels_data = lod_levels.data();
+	uint8* const in_proximity_data = in_proximity.data();
+	const size_t num_obs = obs.size();
+
+	for(size_t i=0; i<num_obs; ++i)
+	{
+		const float cam_to_ob_d2 = centroids_data[i].getDist2(campos);
+		if(cam_to_ob_d2 > load_distance2) // If object is out of load distance:
+		{
+			if(in_proximity_data[i]) // If an object was in proximity to the camera, and moved out of load distance:
+			{
+				in_proximity_data[i] = 0;
+
+				Change change;
+				change.ob = obs[i];
+				change.lod_level = lod_levels_data[i];
+				change.in_proximity = false;
+				changes_out.push_back(change);
+			}
+		}
+		else // Else if object is within load distance:
+		{
+			const int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_set1_ps(cam_to_ob_d2), lod_dist2_data[i].v));
+			const int8 lod_level = lod_level_for_mask[mask];
+
+			if((lod_level != lod_levels_data[i]) || !in_proximity_data[i])
+			{
+				lod_levels_data[i] = lod_level;
+				in_proximity_data[i] = 1;
+
+				Change change;
+				change.ob = obs[i];
+				change.lod_level = lod_level;
+				change.in_proximity = true;
+				changes_out.push_back(change);
+			}
+		}
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+#include <algorithm>
+
+
+static WorldObjectRef makeTestObject(const Vec3d& pos, float size)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->pos = pos;
+	ob->axis = Vec3f(0, 0, 1);
+	ob->angle = 0;
+	ob->scale = Vec3f(size);
+	ob->setAABBOS(js::AABBox(Vec4f(0, 0, 0, 1), Vec4f(1, 1, 1, 1))); // Calls transformChanged()
+	return ob;
+}
+
+
+// Full pass over the objects, reading the fields from the WorldObjects, as GUIClient::checkForLODChanges() did before ObjectLODTable.
+static size_t scanWorldObjects(const std::vector<WorldObjectRef>& objects, const Vec4f& campos, float load_distance2)
+{
+	size_t num_changes = 0;
+	for(size_t i=0; i<objects.size(); ++i)
+	{
+		if(i + 16 < objects.size())
+			_mm_prefetch((const char*)(&objects[i + 16]->centroid_ws), _MM_HINT_T0);
+
+		const WorldObject* ob = objects[i].ptr();
+		const float cam_to_ob_d2 = ob->getCentroidWS().getDist2(campos);
+		if(cam_to_ob_d2 > load_distance2)
+		{
+			if(ob->in_proximity)
+				num_changes++;
+		}
+		else
+		{
+			const int lod_level = ob->getLODLevel(cam_to_ob_d2);
+			if((lod_level != ob->current_lod_level) || !ob->in_proximity)
+				num_changes++;
+		}
+	}
+	return num_changes;
+}
+
+
+void ObjectLODTable::test()
+{
+	conPrint("ObjectLODTable::test()");
+
+	const float load_distance2 = Maths::square(500.f);
+
+	// Test LOD levels and proximity changes
+	{
+		ObjectLODTable table;
+		WorldObjectRef near_ob = makeTestObject(Vec3d(10, 0, 0), 2.f);
+		WorldObjectRef mid_ob  = makeTestObject(Vec3d(200, 0, 0), 2.f);
+		WorldObjectRef far_ob  = makeTestObject(Vec3d(1000, 0, 0), 2.f);
+		table.addObject(near_ob.ptr());
+		table.addObject(mid_ob.ptr());
+		table.addObject(far_ob.ptr());
+		testAssert(table.size() == 3);
+		testAssert(mid_ob->lod_table == &table && mid_ob->lod_table_index == 1);
+
+		const Vec4f campos(0, 0, 0, 1);
+		js::Vector<Change, 16> changes;
+		table.checkForLODChanges(campos, load_distance2, changes);
+		testAssert(changes.size() == 2);
+		testAssert(changes[0].ob == near_ob.ptr() && changes[0].in_proximity && changes[0].lod_level == near_ob->getLODLevel(campos));
+		testAssert(changes[1].ob == mid_ob.ptr()  && changes[1].in_proximity && changes[1].lod_level == mid_ob->getLODLevel(campos));
+		testAssert(changes[0].lod_level == 0);
+		testAssert(changes[1].lod_level == 2);
+
+		// Nothing has changed, so there should be no changes the second time.
+		changes.clear();
+		table.checkForLODChanges(campos, load_distance2, changes);
+		testAssert(changes.empty());
+
+		// Move the near object away.  The table should be updated by transformChanged().
+		near_ob->pos = Vec3d(2000, 0, 0);
+		near_ob->transformChanged();
+		table.checkForLODChanges(campos, load_distance2, changes);
+		testAssert(changes.size() == 1);
+		testAssert(changes[0].ob == near_ob.ptr() && !changes[0].in_proximity);
+
+		// Remove the first object, the last object should be moved into its slot.
+		table.removeObject(near_ob.ptr());
+		testAssert(near_ob->lod_table == NULL && near_ob->lod_table_index == -1);
+		testAssert(table.size() == 2);
+		testAssert(far_ob->lod_table_index == 0 && mid_ob->lod_table_index == 1);
+		table.removeObject(near_ob.ptr()); // Should do nothing.
+		testAssert(table.size() == 2);
+
+		// Move the camera to the far object.
+		changes.clear();
+		table.checkForLODChanges(Vec4f(1000, 0, 0, 1), load_distance2, changes);
+		testAssert(changes.size() == 2);
+		testAssert(changes[0].ob == far_ob.ptr() && changes[0].in_proximity && changes[0].lod_level == -1);
+		testAssert(changes[1].ob == mid_ob.ptr() && !changes[1].in_proximity);
+
+		// Test the table clears the back-references when destroyed.
+		{
+			ObjectLODTable table2;
+			table2.addObject(near_ob.ptr());
+			testAssert(near_ob->lod_table == &table2);
+		}
+		testAssert(near_ob->lod_table == NULL);
+
+		table.clear();
+		testAssert(far_ob->lod_table == NULL && mid_ob->lod_table == NULL);
+	}
+
+	// Test LOD levels computed by the table match WorldObject::getLODLevel(), away from the transition distances.
+	{
+		PCG32 rng(1);
+		ObjectLODTable table;
+		std::vector<WorldObjectRef> objects;
+		for(int i=0; i<1000; ++i)
+		{
+			objects.push_back(makeTestObject(Vec3d((rng.unitRandom() - 0.5) * 800, (rng.unitRandom() - 0.5) * 800, 0), 0.1f + rng.unitRandom() * 30.f));
+			table.addObject(objects.back().ptr());
+		}
+
+		const Vec4f campos(0, 0, 0, 1);
+		js::Vector<Change, 16> changes;
+		table.checkForLODChanges(campos, load_distance2, changes);
+		for(size_t i=0; i<changes.size(); ++i)
+		{
+			WorldObject* ob = changes[i].ob;
+			const float dist = ob->getCentroidWS().getDist(campos);
+			bool near_transition = false;
+			for(int level=-1; level<=1; ++level)
+				if(std::fabs(dist - ob->getMaxDistForLODLevel(level)) < 0.01f * dist)
+					near_transition = true;
+			if(!near_transition)
+				testAssert(changes[i].lod_level == ob->getLODLevel(campos));
+		}
+		table.clear();
+	}
+
+	// Compare the time for a full pass over 100k objects, reading from the WorldObjects vs. from the table.
+	if(false)
+	{
+		const int N = 100000;
+		PCG32 rng(1);
+		std::vector<WorldObjectRef> objects;
+		objects.reserve(N);
+		for(int i=0; i<N; ++i)
+			objects.push_back(makeTestObject(Vec3d((rng.unitRandom() - 0.5) * 4000, (rng.unitRandom() - 0.5) * 4000, rng.unitRandom() * 50), 0.1f + rng.unitRandom() * 20.f));
+
+		// Objects are iterated in hash-map order, not allocation order, in GUIClient.
+		for(int i=N-1; i>0; --i)
+			std::swap(objects[i], objects[rng.nextUInt(i + 1)]);
+
+		ObjectLODTable table;
+		for(int i=0; i<N; ++i)
+			table.addObject(objects[i].ptr());
+
+		const Vec4f campos(0, 0, 2, 1);
+		js::Vector<Change, 16> changes;
+		table.checkForLODChanges(campos, load_distance2, changes); // Bring objects into proximity
+
+		// Copy state back to the objects, as GUIClient does, so both scans see the same state.
+		for(size_t i=0; i<changes.size(); ++i)
+		{
+			changes[i].ob->in_proximity = changes[i].in_proximity;
+			changes[i].ob->current_lod_level = changes[i].lod_level;
+		}
+
+		const int num_trials = 20;
+		double min_ob_scan_time = 1.0e10;
+		size_t num_ob_scan_changes = 0;
+		for(int t=0; t<num_trials; ++t)
+		{
+			Timer timer;
+			num_ob_scan_changes = scanWorldObjects(objects, campos, load_distance2);
+			min_ob_scan_time = myMin(min_ob_scan_time, timer.elapsed());
+		}
+
+		double min_table_scan_time = 1.0e10;
+		for(int t=0; t<num_trials; ++t)
+		{
+			changes.clear();
+			Timer timer;
+			table.checkForLODChanges(campos, load_distance2, changes);
+			min_table_scan_time = myMin(min_table_scan_time, timer.elapsed());
+		}
+		testAssert(changes.empty());
+
+		testAssert(num_ob_scan_changes < (size_t)N / 100); // There may be a few differences near LOD transitions, as WorldObject::getLODLevel() uses an approximate reciprocal sqrt.
+
+		conPrint("Full pass over " + toString(N) + " objects: WorldObjects: " + doubleToStringNSigFigs(min_ob_scan_time * 1.0e3, 4) + " ms, ObjectLODTable: " +
+			doubleToStringNSigFigs(min_table_scan_time * 1.0e3, 4) + " ms");
+
+		table.clear();
+	}
+
+	conPrint("ObjectLODTable::test() done");
+}
+
+
+#endif // BUILD_TESTS
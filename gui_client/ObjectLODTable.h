@@ -0,0 +1,70 @@
+/*=====================================================================
+ObjectLODTable.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <Vector.h>
+#include <maths/Vec4f.h>
+class WorldObject;
+
+
+/*=====================================================================
+ObjectLODTable
+--------------
+Compact structure-of-arrays copy of the per-object data that GUIClient::checkForLODChanges() needs:
+centroid, squared LOD transition distances, current LOD level and proximity flag.
+
+Scanning this table for all objects only touches ~40 bytes per object in a few contiguous arrays,
+instead of a cache line of each heap-allocated WorldObject, so a full pass over 100k objects takes well under a millisecond.
+
+Each object in the table has lod_table and lod_table_index set, and WorldObject::doTransformChanged() etc.
+update the centroid and LOD distances in the table when the object transform changes.
+
+Locking: the table is protected by the world state mutex, like WorldState::objects.
+Objects are added and removed, and checkForLODChanges() is called, from the main thread with the mutex held.
+Entry updates via WorldObject::transformChanged() happen both on the main thread and on ClientThread
+(e.g. when handling SummonObject messages); ClientThread always holds the mutex when doing so.
+Main-thread updates made without the mutex are only safe because they are to objects ClientThread doesn't
+modify concurrently (the same condition as for the WorldObject transform fields themselves).
+=====================================================================*/
+class ObjectLODTable
+{
+public:
+	ObjectLODTable();
+	~ObjectLODTable(); // Clears lod_table for any objects still in the table.
+
+	void addObject(WorldObject* ob); // Object must not be in a table already.  Copies current_lod_level and in_proximity from the object.
+	void removeObject(WorldObject* ob); // Does nothing if the object is not in this table.
+	void clear();
+
+	void objectTransformChanged(const WorldObject& ob); // Updates the centroid and LOD distances for the object.
+	void setInProximity(const WorldObject& ob, bool in_proximity);
+
+	struct Change
+	{
+		WorldObject* ob;
+		int lod_level; // New LOD level, valid if in_proximity is true.
+		bool in_proximity; // New proximity state.  If false, the object has moved out of load distance.
+	};
+
+	// Computes LOD levels and proximity for all objects for the given camera position, and updates the table.
+	// Appends a Change for each object that moved out of load distance, moved into load distance, or changed LOD level while within load distance.
+	void checkForLODChanges(const Vec4f& campos, float load_distance2, js::Vector<Change, 16>& changes_out);
+
+	size_t size() const { return obs.size(); }
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ObjectLODTable);
+
+	js::Vector<Vec4f, 16> centroids;
+	js::Vector<Vec4f, 16> lod_dist2; // Squared max distances for object LOD levels -1, 0 and 1, and infinity.
+	js::Vector<int8, 16> lod_levels;
+	js::Vector<uint8, 16> in_proximity;
+	js::Vector<WorldObject*, 16> obs;
+};
@@ -0,0 +1,497 @@
+/*=====================================================================
+PhysicsShapeCache.cpp
+---------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "PhysicsShapeCache.h"
+
+
+#include <utils/FileUtils.h>
+#include <utils/FileInStream.h>
+#include <utils/FileOutStream.h>
+#include <utils/Exception.h>
+#include <utils/StringUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/Lock.h>
+#include <utils/IncludeXXHash.h>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(_WIN32)
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+
+static const uint32 PHYSICS_SHAPE_CACHE_MAGIC_NUMBER = 0x3B5D17E2;
+static const uint32 PHYSICS_SHAPE_CACHE_VERSION = 1;
+static const uint64 MAX_SHAPE_DATA_SIZE = 1ull << 31;
+static const char* const SHAPE_FILE_EXTENSION = "joltshape";
+static const uint64 SHAPE_FILE_HEADER_SIZE = sizeof(uint32) * 2 + sizeof(uint64) * 3;
+
+
+// Returns the last modification time of the file in seconds since the epoch, or 0 on failure.
+static int64 getFileModifiedTime(const std::string& path)
+{
+#if defined(_WIN32)
+	struct _stat64 st;
+	if(_wstat64(StringUtils::UTF8ToPlatformUnicodeEncoding(path).c_str(), &st) != 0)
+		return 0;
+#else
+	struct stat st;
+	if(stat(path.c_str(), &st) != 0)
+		return 0;
+#endif
+	return (int64)st.st_mtime;
+}
+
+
+// Sets the modification time of the file to the current time.  Failure is ignored, it just affects the eviction order after a restart.
+static void touchFile(const std::string& path)
+{
+#if defined(_WIN32)
+	_wutime(StringUtils::UTF8ToPlatformUnicodeEncoding(path).c_str(), NULL);
+#else
+	utime(path.c_str(), NULL);
+#endif
+}
+
+
+PhysicsShapeCache::PhysicsShapeCache(const std::string& cache_dir_, uint64 max_total_size_B_)
+:	cache_dir(cache_dir_),
+	max_total_size_B(max_total_size_B_),
+	total_size_B(0),
+	next_use_index(0),
+	next_temp_file_index(0)
+{
+	try
+	{
+		FileUtils::createDirIfDoesNotExist(cache_dir);
+
+		// Remove temp files left by writes that were interrupted, e.g. by the client being killed.  There are no writes in progress yet.
+		const std::string temp_file_marker = std::string(".") + SHAPE_FILE_EXTENSION + "_temp_";
+		const std::vector<std::string> filenames = FileUtils::getFilesInDir(cache_dir);
+		for(size_t i=0; i<filenames.size(); ++i)
+			if(filenames[i].find(temp_file_marker) != std::string::npos)
+				FileUtils::deleteFile(cache_dir + "/" + filenames[i]);
+
+		const std::vector<std::string> paths = FileUtils::getFilesInDirWithExtensionFullPaths(cache_dir, SHAPE_FILE_EXTENSION);
+
+		// Order the existing entries by modification time, which is updated when an entry is used.
+		std::vector<std::pair<int64, std::string>> paths_by_time(paths.size()); // (modified time, path)
+		for(size_t i=0; i<paths.size(); ++i)
+			paths_by_time[i] = std::make_pair(getFileModifiedTime(paths[i]), paths[i]);
+		std::sort(paths_by_time.begin(), paths_by_time.end());
+
+		Lock lock(mutex);
+		for(size_t i=0; i<paths_by_time.size(); ++i)
+		{
+			CacheEntry entry;
+			entry.size_B = FileUtils::getFileSize(paths_by_time[i].second);
+			entry.last_used_index = next_use_index++;
+			entries[paths_by_time[i].second] = entry;
+			total_size_B += entry.size_B;
+		}
+
+		if(total_size_B > max_total_size_B)
+		{
+			conPrint("PhysicsShapeCache: cache size " + getNiceByteSize(total_size_B) + " is over the limit, removing least recently used entries.");
+			evictLeastRecentlyUsed(max_total_size_B - max_total_size_B / 10);
+		}
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception("Error while initialising physics shape cache in '" + cache_dir + "': " + e.what());
+	}
+}
+
+
+PhysicsShapeCache::~PhysicsShapeCache()
+{
+}
+
+
+const std::string PhysicsShapeCache::pathForKey(uint64 key) const
+{
+	return cache_dir + "/" + toHexString(key) + "." + SHAPE_FILE_EXTENSION;
+}
+
+
+uint64 PhysicsShapeCache::getTotalSizeB() const
+{
+	Lock lock(mutex);
+	return total_size_B;
+}
+
+
+size_t PhysicsShapeCache::getNumEntries() const
+{
+	Lock lock(mutex);
+	return entries.size();
+}
+
+
+// Removes entries, least recently used first, until the total size is <= target_total_size_B.
+void PhysicsShapeCache::evictLeastRecentlyUsed(uint64 target_total_size_B)
+{
+	if(total_size_B <= target_total_size_B)
+		return;
+
+	std::vector<std::pair<uint64, std::string>> entries_by_use; // (last used index, path)
+	entries_by_use.reserve(entries.size());
+	for(auto it = entries.begin(); it != entries.end(); ++it)
+		entries_by_use.push_back(std::make_pair(it->second.last_used_index, it->first));
+	std::sort(entries_by_use.begin(), entries_by_use.end());
+
+	for(size_t i=0; (i<entries_by_use.size()) && (total_size_B > target_total_size_B); ++i)
+	{
+		const std::string& path = entries_by_use[i].second;
+		try
+		{
+			FileUtils::deleteFile(path);
+		}
+		catch(FileUtils::FileUtilsExcep& e)
+		{
+			conPrint("PhysicsShapeCache: error while removing '" + path + "': " + e.what());
+		}
+
+		auto res = entries.find(path);
+		total_size_B -= res->second.size_B;
+		entries.erase(res);
+	}
+}
+
+
+bool PhysicsShapeCache::readShapeData(uint64 key, std::vector<uint8>& data_out)
+{
+	const std::string path = pathForKey(key);
+	if(!FileUtils::fileExists(path))
+	{
+		num_misses.increment();
+		return false;
+	}
+
+	try
+	{
+		FileInStream stream(path);
+
+		const uint32 magic = stream.readUInt32();
+		if(magic != PHYSICS_SHAPE_CACHE_MAGIC_NUMBER)
+			throw glare::Exception("Invalid magic number " + toString(magic));
+
+		const uint32 version = stream.readUInt32();
+		if(version != PHYSICS_SHAPE_CACHE_VERSION)
+			throw glare::Exception("Unsupported version " + toString(version));
+
+		const uint64 file_key = stream.readUInt64();
+		if(file_key != key)
+			throw glare::Exception("Key mismatch");
+
+		const uint64 data_size = stream.readUInt64();
+		if(data_size > MAX_SHAPE_DATA_SIZE)
+			throw glare::Exception("Invalid data size");
+
+		const uint64 checksum = stream.readUInt64();
+
+		data_out.resize(data_size);
+		if(data_size > 0)
+			stream.readData(data_out.data(), data_size);
+
+		if(XXH64(data_out.data(), data_out.size(), /*seed=*/1) != checksum)
+			throw glare::Exception("Checksum mismatch");
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("PhysicsShapeCache: error while reading '" + path + "': " + e.what() + ", removing it.");
+		removeShapeData(key);
+		num_misses.increment();
+		return false;
+	}
+
+	// Mark the entry as used.
+	{
+		Lock lock(mutex);
+		auto res = entries.find(path);
+		if(res != entries.end())
+			res->second.last_used_index = next_use_index++;
+	}
+	touchFile(path);
+
+	num_hits.increment();
+	return true;
+}
+
+
+void PhysicsShapeCache::writeShapeData(uint64 key, const std::vector<uint8>& data)
+{
+	const uint64 entry_size_B = SHAPE_FILE_HEADER_SIZE + data.size();
+	if(entry_size_B > max_total_size_B)
+		return;
+
+	{
+		Lock lock(mutex);
+		if(total_size_B + entry_size_B > max_total_size_B)
+		{
+			const uint64 max_others_size_B = max_total_size_B - entry_size_B;
+			evictLeastRecentlyUsed(max_others_size_B - max_others_size_B / 10);
+		}
+	}
+
+	const std::string path = pathForKey(key);
+	const std::string temp_path = path + "_temp_" + toString((uint64)next_temp_file_index.increment()); // Use a unique temp path in case another thread is writing the same shape.
+	try
+	{
+		{
+			FileOutStream stream(temp_path, std::ios::binary | std::ios::trunc);
+
+			stream.writeUInt32(PHYSICS_SHAPE_CACHE_MAGIC_NUMBER);
+			stream.writeUInt32(PHYSICS_SHAPE_CACHE_VERSION);
+			stream.writeUInt64(key);
+			stream.writeUInt64(data.size());
+			stream.writeUInt64(XXH64(data.data(), data.size(), /*seed=*/1));
+			if(!data.empty())
+				stream.writeData(data.data(), data.size());
+		} // End scope for FileOutStream
+
+		FileUtils::moveFile(temp_path, path);
+
+		Lock lock(mutex);
+		CacheEntry& entry = entries[path]; // May already exist if another thread wrote the same shape.
+		total_size_B -= entry.size_B;
+		entry.size_B = entry_size_B;
+		entry.last_used_index = next_use_index++;
+		total_size_B += entry_size_B;
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("PhysicsShapeCache: error while writing '" + path + "': " + e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("PhysicsShapeCache: error while writing '" + path + "': " + e.what());
+	}
+}
+
+
+void PhysicsShapeCache::removeShapeData(uint64 key)
+{
+	const std::string path = pathForKey(key);
+	try
+	{
+		Lock lock(mutex);
+		auto res = entries.find(path);
+		if(res != entries.end())
+		{
+			total_size_B -= res->second.size_B;
+			entries.erase(res);
+		}
+
+		if(FileUtils::fileExists(path))
+			FileUtils::deleteFile(path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("PhysicsShapeCache: error while removing '" + path + "': " + e.what());
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include "PhysicsWorld.h"
+#include "PhysicsObject.h"
+#include <graphics/BatchedMesh.h>
+#include <graphics/FormatDecoderGLTF.h>
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/Timer.h>
+
+
+// Loads a model from disk and builds its physics shape, as done for models in LoadModelTask.
+static PhysicsShape loadModelAndBuildShape(const std::string& model_path, bool build_dynamic_physics_ob, PhysicsShapeCache* cache)
+{
+	GLTFLoadedData gltf_data;
+	BatchedMeshRef batched_mesh = FormatDecoderGLTF::loadGLBFile(model_path, gltf_data);
+	batched_mesh->checkValidAndSanitiseMesh();
+	batched_mesh->optimise();
+	return PhysicsWorld::createJoltShapeForBatchedMesh(*batched_mesh, build_dynamic_physics_ob, cache);
+}
+
+
+static void checkShapesEqual(const PhysicsShape& a, const PhysicsShape& b)
+{
+	testAssert(a.jolt_shape.GetPtr() != b.jolt_shape.GetPtr());
+	testAssert(a.jolt_shape->GetSubType() == b.jolt_shape->GetSubType());
+	testAssert(a.jolt_shape->GetLocalBounds().mMin == b.jolt_shape->GetLocalBounds().mMin);
+	testAssert(a.jolt_shape->GetLocalBounds().mMax == b.jolt_shape->GetLocalBounds().mMax);
+	testAssert(a.jolt_shape->GetStats().mNumTriangles == b.jolt_shape->GetStats().mNumTriangles);
+	testAssert(a.size_B == b.size_B);
+}
+
+
+static void clearCache(const std::string& cache_dir)
+{
+	PhysicsShapeCache cache(cache_dir, /*max total size=*/0); // Any existing entries are over the size limit, so get removed.
+}
+
+
+void PhysicsShapeCache::test()
+{
+	// PhysicsWorld::init() needs to have been called already.
+	conPrint("PhysicsShapeCache::test()");
+
+	try
+	{
+		const std::string cache_dir = PlatformUtils::getTempDirPath() + "/physics_shape_cache_test";
+		const std::string model_path = TestUtils::getTestReposDir() + "/testfiles/gltf/2CylinderEngine.glb";
+		const uint64 max_size = 1ull << 30;
+
+		clearCache(cache_dir);
+
+		//-------------------- Cold cache: shape is built and added to the cache --------------------
+		PhysicsShape built_shape;
+		{
+			PhysicsShapeCache cache(cache_dir, max_size);
+			testAssert(cache.getTotalSizeB() == 0);
+
+			built_shape = loadModelAndBuildShape(model_path, /*build_dynamic_physics_ob=*/false, &cache);
+			testAssert(cache.num_misses == 1 && cache.num_hits == 0);
+			testAssert(cache.getTotalSizeB() > 0);
+
+			// Loading again in the same session should hit.
+			const PhysicsShape shape = loadModelAndBuildShape(model_path, /*build_dynamic_physics_ob=*/false, &cache);
+			testAssert(cache.num_hits == 1);
+			checkShapesEqual(built_shape, shape);
+		}
+
+		//-------------------- Warm cache, e.g. after a client restart: shape is restored from disk --------------------
+		{
+			PhysicsShapeCache cache(cache_dir, max_size);
+			testAssert(cache.getTotalSizeB() > 0);
+
+			const PhysicsShape shape = loadModelAndBuildShape(model_path, /*build_dynamic_physics_ob=*/false, &cache);
+			testAssert(cache.num_hits == 1 && cache.num_misses == 0);
+			checkShapesEqual(built_shape, shape);
+
+			// A dynamic (convex hull) shape for the same mesh is a different entry.
+			const PhysicsShape hull_shape = loadModelAndBuildShape(model_path, /*build_dynamic_physics_ob=*/true, &cache);
+			testAssert(cache.num_misses == 1);
+			testAssert(hull_shape.jolt_shape->GetSubType() == JPH::EShapeSubType::ConvexHull);
+
+			const PhysicsShape cached_hull_shape = loadModelAndBuildShape(model_path, /*build_dynamic_physics_ob=*/true, &cache);
+			testAssert(cache.num_hits == 2);
+			checkShapesEqual(hull_shape, cached_hull_shape);
+		}
+
+		//-------------------- Corrupted entries are detected and rebuilt --------------------
+		{
+			const std::vector<std::string> paths = FileUtils::getFilesInDirWithExtensionFullPaths(cache_dir, SHAPE_FILE_EXTENSION);
+			testAssert(paths.size() == 2);
+			for(size_t i=0; i<paths.size(); ++i)
+			{
+				std::vector<uint8> contents;
+				FileUtils::readEntireFile(paths[i], contents);
+				contents[contents.size() / 2] ^= 0xFF;
+				FileUtils::writeEntireFile(paths[i], contents);
+			}
+
+			PhysicsShapeCache cache(cache_dir, max_size);
+			const PhysicsShape shape = loadModelAndBuildShape(model_path, /*build_dynamic_physics_ob=*/false, &cache);
+			testAssert(cache.num_hits == 0 && cache.num_misses == 1);
+			checkShapesEqual(built_shape, shape);
+
+			// Should have been rewritten.
+			loadModelAndBuildShape(model_path, /*build_dynamic_physics_ob=*/false, &cache);
+			testAssert(cache.num_hits == 1);
+		}
+
+		//-------------------- Least recently used entries are evicted when the cache is full --------------------
+		{
+			clearCache(cache_dir);
+
+			const std::vector<uint8> data(1000, 7);
+			const uint64 entry_size = SHAPE_FILE_HEADER_SIZE + data.size();
+			{
+				PhysicsShapeCache cache(cache_dir, /*max total size=*/entry_size * 4);
+				for(uint64 key=1; key<=4; ++key)
+					cache.writeShapeData(key, data);
+				testAssert(cache.getNumEntries() == 4 && cache.getTotalSizeB() == entry_size * 4);
+
+				std::vector<uint8> read_data;
+				testAssert(cache.readShapeData(/*key=*/1, read_data)); // Entry 1 is now the most recently used.
+				testAssert(read_data == data);
+
+				// Adding entry 5 should evict down to 90% of the space left for the other entries, so evict the two least recently used entries: 2 and 3.
+				cache.writeShapeData(/*key=*/5, data);
+				testAssert(cache.getNumEntries() == 3 && cache.getTotalSizeB() == entry_size * 3);
+				testAssert(FileUtils::fileExists(cache.pathForKey(1)));
+				testAssert(!FileUtils::fileExists(cache.pathForKey(2)));
+				testAssert(!FileUtils::fileExists(cache.pathForKey(3)));
+				testAssert(FileUtils::fileExists(cache.pathForKey(4)));
+				testAssert(FileUtils::fileExists(cache.pathForKey(5)));
+
+				// A shape larger than the whole cache is not added, and doesn't evict anything.
+				cache.writeShapeData(/*key=*/6, std::vector<uint8>(entry_size * 4));
+				testAssert(cache.getNumEntries() == 3);
+			}
+
+			// Temp files left by an interrupted write are removed on construction.
+			const std::string temp_path = cache_dir + "/" + toHexString(7) + "." + SHAPE_FILE_EXTENSION + "_temp_3";
+			FileUtils::writeEntireFile(temp_path, data);
+			{
+				PhysicsShapeCache cache(cache_dir, /*max total size=*/entry_size * 4);
+				testAssert(!FileUtils::fileExists(temp_path));
+				testAssert(cache.getNumEntries() == 3 && cache.getTotalSizeB() == entry_size * 3);
+			}
+
+			// If the cache is over the limit on construction, entries are evicted down to 90% of the limit, instead of all being removed.
+			{
+				PhysicsShapeCache cache(cache_dir, /*max total size=*/entry_size * 2);
+				testAssert(cache.getNumEntries() == 1 && cache.getTotalSizeB() == entry_size);
+			}
+		}
+
+		//-------------------- Benchmark: model load times with a cold and a warm cache --------------------
+		if(false)
+		{
+			const int num_trials = 10;
+			double min_cold_time = 1.0e10;
+			double min_warm_time = 1.0e10;
+			for(int i=0; i<num_trials; ++i)
+			{
+				clearCache(cache_dir);
+				PhysicsShapeCache cache(cache_dir, max_size);
+				{
+					Timer timer;
+					loadModelAndBuildShape(model_path, /*build_dynamic_physics_ob=*/false, &cache);
+					min_cold_time = myMin(min_cold_time, timer.elapsed());
+				}
+				{
+					Timer timer;
+					loadModelAndBuildShape(model_path, /*build_dynamic_physics_ob=*/false, &cache);
+					min_warm_time = myMin(min_warm_time, timer.elapsed());
+				}
+			}
+
+			conPrint("Model load with physics shape, cold cache: " + doubleToStringNSigFigs(min_cold_time * 1.0e3, 4) + " ms, warm cache: " + doubleToStringNSigFigs(min_warm_time * 1.0e3, 4) + " ms (" + 
+				doubleToStringNSigFigs(min_cold_time / min_warm_time, 3) + "x)");
+		}
+
+		clearCache(cache_dir);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("PhysicsShapeCache::test() done");
+}
+
+
+#endif // BUILD_TESTS
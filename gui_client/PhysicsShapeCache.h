@@ -0,0 +1,84 @@
+/*=====================================================================
+PhysicsShapeCache.h
+-------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/AtomicInt.h>
+#include <utils/Mutex.h>
+#include <utils/Platform.h>
+#include <string>
+#include <vector>
+#include <map>
+
+
+/*=====================================================================
+PhysicsShapeCache
+-----------------
+On-disk cache of built (serialised) Jolt physics shapes, so that a mesh shape, and in particular its BVH,
+doesn't need to be rebuilt every time a model is loaded, e.g. after MeshManager has evicted it, or after a client restart.
+
+Keyed by a 64-bit hash of the shape build inputs, computed by PhysicsWorld: the vertex positions, triangles and material indices,
+whether a dynamic (convex hull) shape was built, and the Jolt build configuration and shape settings.
+So a change to any of these just results in a different key, and the old entries are not used any more.
+
+Each shape is stored in its own file in cache_dir, named by the key.  Files have a checksum of the shape data,
+so truncated or corrupted files are detected and removed, instead of being passed to Jolt.
+
+The total size of the cache is limited to max_total_size_B.  When adding a shape would go over the limit, the least recently used
+entries are removed, down to 90% of the limit so that this doesn't happen on every write.
+Entries are used when written or read, and the file modification time is updated on reads, so that the order is kept across restarts.
+On construction, the existing entries are ordered by modification time, and temp files left by interrupted writes are removed.
+
+Threadsafe, used by LoadModelTask threads.
+=====================================================================*/
+class PhysicsShapeCache : public ThreadSafeRefCounted
+{
+public:
+	// Creates cache_dir if it doesn't exist.  Throws glare::Exception on failure.
+	PhysicsShapeCache(const std::string& cache_dir, uint64 max_total_size_B);
+	~PhysicsShapeCache();
+
+	// Returns true and sets data_out to the serialised shape data if a shape with the key is in the cache.
+	bool readShapeData(uint64 key, std::vector<uint8>& data_out);
+
+	// Writes to a temp file then moves it into place, so a concurrent or interrupted write doesn't leave a truncated file.
+	// Failures are ignored, the shape just won't be cached.
+	void writeShapeData(uint64 key, const std::vector<uint8>& data);
+
+	// Removes the entry for the key, for example if it could not be restored.
+	void removeShapeData(uint64 key);
+
+	uint64 getTotalSizeB() const;
+	size_t getNumEntries() const;
+
+	glare::AtomicInt num_hits;
+	glare::AtomicInt num_misses;
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(PhysicsShapeCache);
+
+	const std::string pathForKey(uint64 key) const;
+	void evictLeastRecentlyUsed(uint64 target_total_size_B) REQUIRES(mutex);
+
+	struct CacheEntry
+	{
+		uint64 size_B;
+		uint64 last_used_index; // Value of next_use_index when the entry was last used.
+	};
+
+	std::string cache_dir;
+	uint64 max_total_size_B;
+
+	mutable Mutex mutex;
+	std::map<std::string, CacheEntry> entries GUARDED_BY(mutex); // Map from path to entry
+	uint64 total_size_B GUARDED_BY(mutex);
+	uint64 next_use_index GUARDED_BY(mutex); // Incremented each time an entry is used, for ordering the entries by last use.
+
+	glare::AtomicInt next_temp_file_index;
+};
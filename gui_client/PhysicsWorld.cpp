@@ -16,9 +16,11 @@ Copyright Glare Technologies Limited 2022 -
 #include <utils/HashMapInsertOnly2.h>
 #include <utils/string_view.h>
 #include <utils/RuntimeCheck.h>
+#include <utils/IncludeXXHash.h>
 #include <stdarg.h>
 #include <Lock.h>
 #include "JoltUtils.h"
+#include "PhysicsShapeCache.h"
 
 
 #if USE_JOLT
@@ -26,6 +28,7 @@ Copyright Glare Technologies Limited 2022 -
 #define JPH_PROFILE_ENABLED 1
 #endif
 #include <Jolt/Jolt.h>
+#include <Jolt/ConfigurationString.h>
 #include <Jolt/RegisterTypes.h>
 #include <Jolt/Core/Factory.h>
 #include <Jolt/Core/TempAllocator.h>
@@ -47,9 +50,11 @@ Copyright Glare Technologies Limited 2022 -
 #include <Jolt/Physics/Collision/RayCast.h>
 #include <Jolt/Physics/Collision/CastResult.h>
 #include <Jolt/Physics/Collision/Shape/OffsetCenterOfMassShape.h>
+#include <Jolt/Physics/Collision/Shape/StaticCompoundShape.h>
 #endif
 #include <HashSet.h>
 #include <fstream>
+#include <sstream>
 
 
 #if USE_JOLT
@@ -545,6 +550,106 @@ static size_t computeSizeBForShape(JPH::Ref<JPH::Shape> jolt_shape)
 }
 
 
+// Bump this when Jolt is updated, or when the way shapes are built from the vertex and triangle lists changes, to invalidate the physics shape cache.
+static const char* const JOLT_SHAPE_CACHE_VERSION_STRING = "Jolt 2023-06-11, shape cache v1";
+
+
+// Hash of everything apart from the mesh data that affects the built shape and its serialised form: the Jolt version and build configuration, and the shape settings.
+static uint64 joltShapeSettingsHash()
+{
+	const std::string config = std::string(JOLT_SHAPE_CACHE_VERSION_STRING) + ", " + JPH::GetConfigurationString();
+	uint64 hash = XXH64(config.data(), config.size(), /*seed=*/1);
+
+	JPH::MeshShapeSettings mesh_settings;
+	JPH::ConvexHullShapeSettings hull_settings;
+	const uint32 max_tris_per_leaf = mesh_settings.mMaxTrianglesPerLeaf;
+	const float hull_settings_vals[3] = { hull_settings.mMaxConvexRadius, hull_settings.mMaxErrorConvexRadius, hull_settings.mHullTolerance };
+	hash = XXH64(&max_tris_per_leaf, sizeof(max_tris_per_leaf), hash);
+	hash = XXH64(hull_settings_vals, sizeof(hull_settings_vals), hash);
+	return hash;
+}
+
+
+static uint64 meshShapeCacheKey(const JPH::VertexList& vertex_list, const JPH::IndexedTriangleList& tri_list, uint32 num_mats)
+{
+	static const uint64 settings_hash = joltShapeSettingsHash();
+
+	static_assert(sizeof(JPH::Float3) == sizeof(float) * 3, "sizeof(JPH::Float3) == sizeof(float) * 3");
+	static_assert(sizeof(JPH::IndexedTriangle) == sizeof(uint32) * 4, "sizeof(JPH::IndexedTriangle) == sizeof(uint32) * 4");
+
+	const uint32 header[3] = { /*is dynamic=*/0, (uint32)vertex_list.size(), num_mats };
+	uint64 hash = XXH64(header, sizeof(header), settings_hash);
+	hash = XXH64(vertex_list.data(), vertex_list.size() * sizeof(JPH::Float3), hash);
+	hash = XXH64(tri_list.data(), tri_list.size() * sizeof(JPH::IndexedTriangle), hash);
+	return hash;
+}
+
+
+static uint64 convexHullShapeCacheKey(const JPH::Array<JPH::Vec3>& points)
+{
+	static const uint64 settings_hash = joltShapeSettingsHash();
+
+	const uint32 header[2] = { /*is dynamic=*/1, (uint32)points.size() };
+	uint64 hash = XXH64(header, sizeof(header), settings_hash);
+	for(size_t i=0; i<points.size(); ++i)
+	{
+		const float p[3] = { points[i].GetX(), points[i].GetY(), points[i].GetZ() };
+		hash = XXH64(p, sizeof(p), hash);
+	}
+	return hash;
+}
+
+
+// Materials are always SubstrataPhysicsMaterials with index i at position i in the shape material list, so just their indices are saved to the cache.
+static const uint32 MAX_NUM_SHAPE_MATERIALS = 32; // Jolt has a maximum of 32 materials per mesh
+
+
+// Looks up the shape with the given key in the cache, and restores it if found.  Returns false if not found or it could not be restored.
+static bool getCachedJoltShape(PhysicsShapeCache& shape_cache, uint64 key, PhysicsShape& shape_out)
+{
+	std::vector<uint8> data;
+	if(!shape_cache.readShapeData(key, data))
+		return false;
+
+	JPH::Shape::IDToShapeMap shape_map;
+	JPH::Shape::IDToMaterialMap material_map;
+	for(uint32 i=0; i<MAX_NUM_SHAPE_MATERIALS; ++i)
+		material_map.push_back(new SubstrataPhysicsMaterial(i));
+
+	std::istringstream stream(std::string((const char*)data.data(), data.size()));
+	JPH::StreamInWrapper wrapper(stream);
+	JPH::Shape::ShapeResult result = JPH::Shape::sRestoreWithChildren(wrapper, shape_map, material_map);
+	if(result.HasError() || wrapper.IsFailed())
+	{
+		conPrint("Failed to restore cached physics shape: " + std::string(result.HasError() ? result.GetError().c_str() : "stream error"));
+		shape_cache.removeShapeData(key);
+		return false;
+	}
+
+	shape_out.jolt_shape = result.Get();
+	shape_out.size_B = computeSizeBForShape(shape_out.jolt_shape);
+	return true;
+}
+
+
+static void addJoltShapeToCache(PhysicsShapeCache& shape_cache, uint64 key, const JPH::PhysicsMaterialList& materials, const PhysicsShape& shape)
+{
+	JPH::Shape::ShapeToIDMap shape_map;
+	JPH::Shape::MaterialToIDMap material_map;
+	for(uint32 i=0; i<(uint32)materials.size(); ++i)
+		material_map[materials[i].GetPtr()] = i;
+
+	std::ostringstream stream;
+	JPH::StreamOutWrapper wrapper(stream);
+	shape.jolt_shape->SaveWithChildren(wrapper, shape_map, material_map);
+	if(wrapper.IsFailed())
+		return;
+
+	const std::string str = stream.str();
+	shape_cache.writeShapeData(key, std::vector<uint8>((const uint8*)str.data(), (const uint8*)str.data() + str.size()));
+}
+
+
 PhysicsShape PhysicsWorld::createJoltShapeForIndigoMesh(const Indigo::Mesh& mesh, bool build_dynamic_physics_ob)
 {
 	const Indigo::Vector<Indigo::Vec3f>& verts = mesh.vert_positions;
@@ -683,7 +788,7 @@ inline static Vec4f transformSkinnedVertex(const Vec4f vert_pos, size_t joint_of
 
 
 
-PhysicsShape PhysicsWorld::createJoltShapeForBatchedMesh(const BatchedMesh& mesh, bool build_dynamic_physics_ob)
+PhysicsShape PhysicsWorld::createJoltShapeForBatchedMesh(const BatchedMesh& mesh, bool build_dynamic_physics_ob, PhysicsShapeCache* shape_cache)
 {
 	const size_t vert_size_B = mesh.vertexSize();
 	const size_t num_verts = mesh.numVerts();
@@ -778,6 +883,11 @@ PhysicsShape PhysicsWorld::createJoltShapeForBatchedMesh(const BatchedMesh& mesh
 			points[i] = JPH::Vec3(vert_pos[0], vert_pos[1], vert_pos[2]);
 		}
 
+		const uint64 cache_key = shape_cache ? convexHullShapeCacheKey(points) : 0;
+		PhysicsShape shape;
+		if(shape_cache && getCachedJoltShape(*shape_cache, cache_key, shape))
+			return shape;
+
 		JPH::Ref<JPH::ConvexHullShapeSettings> hull_shape_settings = new JPH::ConvexHullShapeSettings(
 			points
 		);
@@ -786,9 +896,11 @@ PhysicsShape PhysicsWorld::createJoltShapeForBatchedMesh(const BatchedMesh& mesh
 		if(result.HasError())
 			throw glare::Exception(std::string("Error building Jolt shape: ") + result.GetError().c_str());
 		JPH::Ref<JPH::Shape> jolt_shape = result.Get();
-		PhysicsShape shape;
 		shape.jolt_shape = jolt_shape;
 		shape.size_B = computeSizeBForShape(jolt_shape);
+
+		if(shape_cache)
+			addJoltShapeToCache(*shape_cache, cache_key, JPH::PhysicsMaterialList(), shape);
 		return shape;
 	}
 	else
@@ -858,7 +970,14 @@ PhysicsShape PhysicsWorld::createJoltShapeForBatchedMesh(const BatchedMesh& mesh
 		}
 
 		// Create materials
-		const uint32 use_num_mats = myMin(32u, (uint32)mesh.numMaterialsReferenced());
+		const uint32 use_num_mats = myMin(MAX_NUM_SHAPE_MATERIALS, (uint32)mesh.numMaterialsReferenced());
+
+		// Building the mesh shape BVH is the expensive part, so look for an already built shape in the cache first.
+		const uint64 cache_key = shape_cache ? meshShapeCacheKey(vertex_list, tri_list, use_num_mats) : 0;
+		PhysicsShape shape;
+		if(shape_cache && getCachedJoltShape(*shape_cache, cache_key, shape))
+			return shape;
+
 		JPH::PhysicsMaterialList materials(use_num_mats);
 		for(uint32 i = 0; i < use_num_mats; ++i)
 			materials[i] = new SubstrataPhysicsMaterial(i);
@@ -868,9 +987,11 @@ PhysicsShape PhysicsWorld::createJoltShapeForBatchedMesh(const BatchedMesh& mesh
 		if(result.HasError())
 			throw glare::Exception(std::string("Error building Jolt shape: ") + result.GetError().c_str());
 		JPH::Ref<JPH::Shape> jolt_shape = result.Get();
-		PhysicsShape shape;
 		shape.jolt_shape = jolt_shape;
 		shape.size_B = computeSizeBForShape(jolt_shape);
+
+		if(shape_cache)
+			addJoltShapeToCache(*shape_cache, cache_key, materials, shape);
 		return shape;
 	}
 }
@@ -945,6 +1066,32 @@ PhysicsShape PhysicsWorld::createCOMOffsetShapeForShape(const PhysicsShape& orig
 }
 
 
+PhysicsShape PhysicsWorld::createStaticCompoundShape(const std::vector<PhysicsShape>& shapes)
+{
+	if(shapes.empty())
+		throw glare::Exception("No shapes for compound shape");
+	if(shapes.size() == 1)
+		return shapes[0];
+
+	JPH::Ref<JPH::StaticCompoundShapeSettings> compound_settings = new JPH::StaticCompoundShapeSettings();
+	size_t size_B = 0;
+	for(size_t i=0; i<shapes.size(); ++i)
+	{
+		compound_settings->AddShape(JPH::Vec3::sZero(), JPH::Quat::sIdentity(), shapes[i].jolt_shape);
+		size_B += shapes[i].size_B;
+	}
+
+	JPH::Result<JPH::Ref<JPH::Shape>> result = compound_settings->Create();
+	if(result.HasError())
+		throw glare::Exception(std::string("Error building Jolt compound shape: ") + result.GetError().c_str());
+
+	PhysicsShape compound_shape;
+	compound_shape.jolt_shape = result.Get();
+	compound_shape.size_B = size_B; // Child shapes are shared, not copied, so just count their sizes.
+	return compound_shape;
+}
+
+
 void PhysicsWorld::addObject(const Reference<PhysicsObject>& object)
 {
 	assert(object->pos.isFinite());
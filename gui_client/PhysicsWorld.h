@@ -18,6 +18,7 @@ Copyright Glare Technologies Limited 2022 -
 #include <utils/HashSet.h>
 #include <utils/Array2D.h>
 #include <set>
+#include <vector>
 
 #if USE_JOLT
 #include <Jolt/Jolt.h>
@@ -30,6 +31,7 @@ namespace Indigo { class TaskManager; }
 namespace Indigo { class Mesh; }
 class PrintOutput;
 class BatchedMesh;
+class PhysicsShapeCache;
 namespace JPH { class PhysicsSystem; }
 namespace JPH { class TempAllocator; }
 namespace JPH { class JobSystemThreadPool; }
@@ -117,7 +119,8 @@ public:
 	void removeObject(const Reference<PhysicsObject>& object);
 
 	static PhysicsShape createJoltShapeForIndigoMesh(const Indigo::Mesh& mesh, bool build_dynamic_physics_ob);
-	static PhysicsShape createJoltShapeForBatchedMesh(const BatchedMesh& mesh, bool build_dynamic_physics_ob);
+	// If shape_cache is non-null, the built shape is looked up in, and added to, the cache.
+	static PhysicsShape createJoltShapeForBatchedMesh(const BatchedMesh& mesh, bool build_dynamic_physics_ob, PhysicsShapeCache* shape_cache = NULL);
 
 	static PhysicsShape createJoltHeightFieldShape(int vert_res, const Array2D<float>& heightfield, float quad_w);
 
@@ -126,6 +129,9 @@ public:
 
 	static PhysicsShape createCOMOffsetShapeForShape(const PhysicsShape& shape, const Vec4f& COM_offset);
 
+	// Combines static shapes into a single static compound shape, e.g. the shapes for the chunks of a voxel group.  Returns the shape itself if there is only one.
+	static PhysicsShape createStaticCompoundShape(const std::vector<PhysicsShape>& shapes);
+
 	void think(double dt);
 
 #if USE_JOLT
@@ -15,6 +15,10 @@ Copyright Glare Technologies Limited 2022 -
 #include <opengl/OpenGLEngine.h>
 #include <utils/Timer.h>
 #include <utils/Lock.h>
+#include <utils/TaskManager.h>
+#include <utils/ConPrint.h>
+#include <utils/TestUtils.h>
+#include <utils/StringUtils.h>
 #include <utils/IndigoXMLDoc.h>
 #include <utils/Parser.h>
 #include <utils/XMLParseUtils.h>
@@ -280,248 +284,379 @@ void parseXMLScript(WorldObjectRef ob, const std::string& script, double global_
 }
 
 
-void evalObjectScript(WorldObject* ob, float use_global_time, double dt, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, glare::AudioEngine* audio_engine, Matrix4f& ob_to_world_out)
+// Evaluates the script rotation and translation functions, if present, and updates axis, angle and translation.
+static inline void evalScriptFunctions(WinterShaderEvaluator* script_evaluator, float use_global_time, const CybWinterEnv& winter_env, Vec3f& axis, float& angle, Vec4f& translation)
 {
-	CybWinterEnv winter_env;
-	winter_env.instance_index = 0;
-	winter_env.num_instances = 1;
-
 #if !defined(EMSCRIPTEN)
-	if(ob->script_evaluator->jitted_evalRotation)
+	if(script_evaluator->jitted_evalRotation)
 	{
-		const Vec4f rot = ob->script_evaluator->evalRotation(use_global_time, winter_env);
-		ob->angle = rot.length();
-		if(isFinite(ob->angle))
+		const Vec4f rot = script_evaluator->evalRotation(use_global_time, winter_env);
+		angle = rot.length();
+		if(isFinite(angle))
 		{
-			if(ob->angle > 0)
-				ob->axis = Vec3f(normalise(rot));
+			if(angle > 0)
+				axis = Vec3f(normalise(rot));
 			else
-				ob->axis = Vec3f(1, 0, 0);
+				axis = Vec3f(1, 0, 0);
 		}
 		else
 		{
-			ob->angle = 0;
-			ob->axis = Vec3f(1, 0, 0);
+			angle = 0;
+			axis = Vec3f(1, 0, 0);
 		}
 	}
 
-	if(ob->script_evaluator->jitted_evalTranslation)
+	if(script_evaluator->jitted_evalTranslation)
 	{
-		ob->translation = ob->script_evaluator->evalTranslation(use_global_time, winter_env);
+		translation = script_evaluator->evalTranslation(use_global_time, winter_env);
 	}
 #endif
+}
 
-	// Compute object-to-world matrix, similarly to obToWorldMatrix().  Do it here so we can reuse some components of the computation.
-	const Vec4f pos((float)ob->pos.x, (float)ob->pos.y, (float)ob->pos.z, 1.f);
-	const Vec4f translation = pos + ob->translation;
-
-	if(!translation.isFinite()) // Avoid hitting assert in Jolt (and other potential problems) if translation is Nan, or Inf.
-		return;
 
-	// Don't use a zero scale component, because it makes the matrix uninvertible, which breaks various things, including picking and normals.
-	Vec4f use_scale = ob->scale.toVec4fVector();
+// Don't use a zero scale component, because it makes the matrix uninvertible, which breaks various things, including picking and normals.
+static inline const Vec4f nonZeroScale(const Vec3f& scale)
+{
+	Vec4f use_scale = scale.toVec4fVector();
 	if(use_scale[0] == 0) use_scale[0] = 1.0e-6f;
 	if(use_scale[1] == 0) use_scale[1] = 1.0e-6f;
 	if(use_scale[2] == 0) use_scale[2] = 1.0e-6f;
+	return use_scale;
+}
 
-	const Vec4f unit_axis = normalise(ob->axis.toVec4fVector());
-	const Matrix4f rot = Matrix4f::rotationMatrix(unit_axis, ob->angle);
-	Matrix4f ob_to_world;
-	ob_to_world.setColumn(0, rot.getColumn(0) * use_scale[0]);
-	ob_to_world.setColumn(1, rot.getColumn(1) * use_scale[1]);
-	ob_to_world.setColumn(2, rot.getColumn(2) * use_scale[2]);
-	ob_to_world.setColumn(3, translation);
-
-	/* Compute upper-left inverse transpose matrix.
-	upper left inverse transpose:
-	= ((RS)^-1)^T
-	= (S^1 R^1)^T
-	= R^1^T S^1^T
-	= R S^1
-	*/
-
-	const Vec4f recip_scale = maskWToZero(div(Vec4f(1.f), use_scale));
-
-	// Right-multiplying with a scale matrix is equivalent to multiplying column 0 with scale_x, column 1 with scale_y etc.
-	Matrix4f ob_to_world_inv_transpose;
-	ob_to_world_inv_transpose.setColumn(0, rot.getColumn(0) * recip_scale[0]);
-	ob_to_world_inv_transpose.setColumn(1, rot.getColumn(1) * recip_scale[1]);
-	ob_to_world_inv_transpose.setColumn(2, rot.getColumn(2) * recip_scale[2]);
-	ob_to_world_inv_transpose.setColumn(3, Vec4f(0, 0, 0, 1));
-
-	// Update transform in 3d engine.
-	GLObject* gl_ob = ob->opengl_engine_ob.ptr();
-	if(gl_ob)
-	{
-		gl_ob->ob_to_world_matrix = ob_to_world;
-		gl_ob->ob_to_world_inv_transpose_matrix = ob_to_world_inv_transpose;
-		gl_ob->aabb_ws = gl_ob->mesh_data->aabb_os.transformedAABBFast(ob_to_world);
-		opengl_engine->objectTransformDataChanged(*gl_ob);
-
-		// Update object world space AABB (used for computing LOD level).
-		// For objects with animated rotation, we want to compute an AABB without rotation, otherwise we can get a world-space AABB
-		// that effectively oscillates in size.  See https://youtu.be/Wo_PauArb6A for an example.
-		// This is bad because it can cause the object to oscillate between LOD levels.
-		// The AABB will be somewhat wrong, but hopefully it shouldn't matter too much.
-#if !defined(EMSCRIPTEN)
-		if(ob->script_evaluator->jitted_evalRotation)
-		{
-			ob->doTransformChangedIgnoreRotation(translation, use_scale);
-		}
-		else
-#endif
-		{
-			ob->doTransformChanged(ob_to_world, use_scale);
-		}
 
+class EvalScriptsTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		evaluator->evalObjectItems(ob_begin, ob_end);
+		evaluator->evalInstanceItems(instance_begin, instance_end);
 
-		// TODO: need to call assignLightsToObject() somehow
-		// opengl_engine->updateObjectTransformData(*ob->opengl_engine_ob);
+		tasks_remaining->taskFinished();
 	}
 
-	// Update in physics engine
-	if(ob->physics_object.nonNull())
-		physics_world->moveKinematicObject(*ob->physics_object, translation, Quatf::fromAxisAndAngle(unit_axis, ob->angle), (float)dt);
+	ObjectScriptEvaluator* evaluator;
+	TaskCompletionCounter* tasks_remaining;
+	size_t ob_begin, ob_end;
+	size_t instance_begin, instance_end;
+};
 
 
-	if(ob->opengl_light.nonNull())
-	{
-		ob->opengl_light->gpu_data.dir = normalise(ob_to_world * Vec4f(0, 0, -1, 0));
+ObjectScriptEvaluator::ObjectScriptEvaluator()
+:	use_global_time(0)
+{}
 
-		opengl_engine->setLightPos(ob->opengl_light, setWToOne(translation));
-	}
 
-	// Update audio source for the object, if it has one.
-	if(ob->audio_source.nonNull())
+ObjectScriptEvaluator::~ObjectScriptEvaluator()
+{}
+
+
+// Evaluates the scripts for ob_items[begin, end).  Doesn't modify the objects, so may be called from any thread.
+void ObjectScriptEvaluator::evalObjectItems(size_t begin, size_t end)
+{
+	CybWinterEnv winter_env;
+	winter_env.instance_index = 0;
+	winter_env.num_instances = 1;
+
+	for(size_t i=begin; i<end; ++i)
 	{
-		ob->audio_source->pos = ob->getCentroidWS();
-		audio_engine->sourcePositionUpdated(*ob->audio_source);
+		ObjectItem& item = ob_items[i];
+
+		evalScriptFunctions(item.script_evaluator, use_global_time, winter_env, item.axis, item.angle, item.translation);
+
+		// Compute object-to-world matrix, similarly to obToWorldMatrix().  Do it here so we can reuse some components of the computation.
+		const Vec4f pos((float)item.pos.x, (float)item.pos.y, (float)item.pos.z, 1.f);
+		const Vec4f translation = pos + item.translation;
+
+		item.transform_valid = translation.isFinite(); // Avoid hitting assert in Jolt (and other potential problems) if translation is Nan, or Inf.
+		if(!item.transform_valid)
+			continue;
+
+		const Vec4f use_scale = nonZeroScale(item.scale);
+
+		const Vec4f unit_axis = normalise(item.axis.toVec4fVector());
+		const Matrix4f rot = Matrix4f::rotationMatrix(unit_axis, item.angle);
+		Matrix4f& ob_to_world = item.ob_to_world;
+		ob_to_world.setColumn(0, rot.getColumn(0) * use_scale[0]);
+		ob_to_world.setColumn(1, rot.getColumn(1) * use_scale[1]);
+		ob_to_world.setColumn(2, rot.getColumn(2) * use_scale[2]);
+		ob_to_world.setColumn(3, translation);
+
+		/* Compute upper-left inverse transpose matrix.
+		upper left inverse transpose:
+		= ((RS)^-1)^T
+		= (S^1 R^1)^T
+		= R^1^T S^1^T
+		= R S^1
+		*/
+
+		const Vec4f recip_scale = maskWToZero(div(Vec4f(1.f), use_scale));
+
+		// Right-multiplying with a scale matrix is equivalent to multiplying column 0 with scale_x, column 1 with scale_y etc.
+		Matrix4f& ob_to_world_inv_transpose = item.ob_to_world_inv_transpose;
+		ob_to_world_inv_transpose.setColumn(0, rot.getColumn(0) * recip_scale[0]);
+		ob_to_world_inv_transpose.setColumn(1, rot.getColumn(1) * recip_scale[1]);
+		ob_to_world_inv_transpose.setColumn(2, rot.getColumn(2) * recip_scale[2]);
+		ob_to_world_inv_transpose.setColumn(3, Vec4f(0, 0, 0, 1));
+
+		item.translation_ws = translation;
+		item.use_scale = use_scale;
+		item.unit_axis = unit_axis;
 	}
-
-	ob_to_world_out = ob_to_world;
 }
 
 
-void evalObjectInstanceScript(InstanceInfo* ob, float use_global_time, double dt, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, Matrix4f& ob_to_world_out)
+// Evaluates the scripts for instance_items[begin, end).  Updates the instance transforms and instance matrices, which are only accessed by the main thread,
+// and each of which belongs to a single item, so may be called concurrently for disjoint ranges.
+void ObjectScriptEvaluator::evalInstanceItems(size_t begin, size_t end)
 {
-	CybWinterEnv winter_env;
-	winter_env.instance_index = ob->instance_index;
-	winter_env.num_instances = ob->num_instances;
+	for(size_t i=begin; i<end; ++i)
+	{
+		InstanceItem& item = instance_items[i];
+		InstanceInfo* instance = item.instance;
+		const ObjectItem& ob_item = ob_items[item.ob_item_index];
+
+		CybWinterEnv winter_env;
+		winter_env.instance_index = instance->instance_index;
+		winter_env.num_instances = instance->num_instances;
 
 #if !defined(EMSCRIPTEN)
-	if(ob->script_evaluator->jitted_evalRotation)
+		if(instance->script_evaluator->jitted_evalTranslation && instance->prototype_object)
+			instance->pos = ob_item.pos; // The prototype object is the object with this instance, use the position read with the mutex held.
+#endif
+		evalScriptFunctions(instance->script_evaluator.ptr(), use_global_time, winter_env, instance->axis, instance->angle, instance->translation);
+
+		// Compute object-to-world matrix, similarly to obToWorldMatrix().  Do it here so we can reuse some components of the computation.
+		const Vec4f pos((float)instance->pos.x, (float)instance->pos.y, (float)instance->pos.z, 1.f);
+		const Vec4f translation = pos + instance->translation;
+
+		const Vec4f use_scale = nonZeroScale(instance->scale);
+
+		const Vec4f unit_axis = normalise(instance->axis.toVec4fVector());
+		const Matrix4f rot = Matrix4f::rotationMatrix(unit_axis, instance->angle);
+		Matrix4f ob_to_world;
+		ob_to_world.setColumn(0, rot.getColumn(0) * use_scale[0]);
+		ob_to_world.setColumn(1, rot.getColumn(1) * use_scale[1]);
+		ob_to_world.setColumn(2, rot.getColumn(2) * use_scale[2]);
+		ob_to_world.setColumn(3, translation);
+
+		*item.ob_to_world_out = ob_to_world;
+
+		if(ob_item.has_gl_ob)
+			item.aabb_ws = ob_item.aabb_os.transformedAABBFast(ob_to_world);
+	}
+}
+
+
+// Copies the script inputs from the objects.  world_state->mutex should be held, as ClientThread may update the object transforms.
+void ObjectScriptEvaluator::gatherScriptInputs(std::set<WorldObjectRef>& obs_with_scripts)
+{
+	ob_items.resizeNoCopy(obs_with_scripts.size());
+	instance_items.resize(0);
+
+	size_t num_ob_items = 0;
+	for(auto it = obs_with_scripts.begin(); it != obs_with_scripts.end(); ++it)
 	{
-		const Vec4f rot = ob->script_evaluator->evalRotation(use_global_time, winter_env);
-		ob->angle = rot.length();
-		if(isFinite(ob->angle))
-		{
-			if(ob->angle > 0)
-				ob->axis = Vec3f(normalise(rot));
-			else
-				ob->axis = Vec3f(1, 0, 0);
-		}
-		else
+		WorldObject* ob = it->getPointer();
+
+		assert(ob->script_evaluator.nonNull());
+		if(ob->script_evaluator.nonNull())
 		{
-			ob->angle = 0;
-			ob->axis = Vec3f(1, 0, 0);
+			ObjectItem& item = ob_items[num_ob_items];
+			item.ob = ob;
+			item.script_evaluator = ob->script_evaluator.ptr();
+			item.pos = ob->pos;
+			item.axis = ob->axis;
+			item.angle = ob->angle;
+			item.scale = ob->scale;
+			item.translation = ob->translation;
+			item.has_gl_ob = ob->opengl_engine_ob.nonNull();
+			if(item.has_gl_ob)
+				item.aabb_os = ob->opengl_engine_ob->mesh_data->aabb_os;
+
+			assert(ob->instance_matrices.size() == ob->instances.size());
+			item.instances_begin = instance_items.size();
+			for(size_t z=0; z<ob->instances.size(); ++z)
+			{
+				InstanceItem instance_item;
+				instance_item.instance = &ob->instances[z];
+				instance_item.ob_to_world_out = &ob->instance_matrices[z];
+				instance_item.ob_item_index = num_ob_items;
+				instance_items.push_back(instance_item);
+			}
+			item.instances_end = instance_items.size();
+
+			num_ob_items++;
 		}
 	}
+	ob_items.resize(num_ob_items);
+}
+
+
+// Evaluates all items, splitting the work over task_manager threads if there is enough of it.
+void ObjectScriptEvaluator::evalScripts(glare::TaskManager* task_manager)
+{
+	const size_t MIN_EVALS_PER_TASK = 256; // Below this, the task overhead is greater than the evaluation time.
+
+	const size_t num_evals = ob_items.size() + instance_items.size();
+	const size_t num_tasks = task_manager ? myMin(task_manager->getNumThreads(), num_evals / MIN_EVALS_PER_TASK) : 0;
+	if(num_tasks <= 1)
+	{
+		evalObjectItems(0, ob_items.size());
+		evalInstanceItems(0, instance_items.size());
+		return;
+	}
 
-	if(ob->script_evaluator->jitted_evalTranslation)
+	while(eval_tasks.size() < num_tasks)
 	{
-		if(ob->prototype_object)
-			ob->pos = ob->prototype_object->pos;
-		ob->translation = ob->script_evaluator->evalTranslation(use_global_time, winter_env);
+		eval_tasks.push_back(new EvalScriptsTask());
+		eval_tasks.back()->evaluator = this;
+		eval_tasks.back()->tasks_remaining = &eval_tasks_remaining;
 	}
+
+	eval_tasks_remaining.setNumTasks(num_tasks);
+
+	for(size_t t=0; t<num_tasks; ++t)
+	{
+		EvalScriptsTask* task = eval_tasks[t].ptr();
+		task->ob_begin       = ob_items.size() * t       / num_tasks;
+		task->ob_end         = ob_items.size() * (t + 1) / num_tasks;
+		task->instance_begin = instance_items.size() * t       / num_tasks;
+		task->instance_end   = instance_items.size() * (t + 1) / num_tasks;
+		task_manager->addTask(eval_tasks[t]);
+	}
+
+	// The task manager is shared with other work, such as LOD generation and voxel meshing, so wait for just our tasks.
+	eval_tasks_remaining.waitForTasks();
+}
+
+
+// Applies the evaluated transforms to the objects, and updates the OpenGL, physics and audio engines.  world_state->mutex should be held.
+void ObjectScriptEvaluator::applyScriptResults(double dt, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, glare::AudioEngine* audio_engine)
+{
+	for(size_t i=0; i<ob_items.size(); ++i)
+	{
+		const ObjectItem& item = ob_items[i];
+		WorldObject* ob = item.ob;
+
+		ob->axis = item.axis;
+		ob->angle = item.angle;
+		ob->translation = item.translation;
+
+		if(item.transform_valid)
+		{
+			const Matrix4f& ob_to_world = item.ob_to_world;
+
+			// Update transform in 3d engine.
+			GLObject* gl_ob = ob->opengl_engine_ob.ptr();
+			if(gl_ob)
+			{
+				gl_ob->ob_to_world_matrix = ob_to_world;
+				gl_ob->ob_to_world_inv_transpose_matrix = item.ob_to_world_inv_transpose;
+				gl_ob->aabb_ws = gl_ob->mesh_data->aabb_os.transformedAABBFast(ob_to_world);
+				opengl_engine->objectTransformDataChanged(*gl_ob);
+
+				// Update object world space AABB (used for computing LOD level).
+				// For objects with animated rotation, we want to compute an AABB without rotation, otherwise we can get a world-space AABB
+				// that effectively oscillates in size.  See https://youtu.be/Wo_PauArb6A for an example.
+				// This is bad because it can cause the object to oscillate between LOD levels.
+				// The AABB will be somewhat wrong, but hopefully it shouldn't matter too much.
+#if !defined(EMSCRIPTEN)
+				if(item.script_evaluator->jitted_evalRotation)
+				{
+					ob->doTransformChangedIgnoreRotation(item.translation_ws, item.use_scale);
+				}
+				else
 #endif
+				{
+					ob->doTransformChanged(ob_to_world, item.use_scale);
+				}
 
-	// Compute object-to-world matrix, similarly to obToWorldMatrix().  Do it here so we can reuse some components of the computation.
-	const Vec4f pos((float)ob->pos.x, (float)ob->pos.y, (float)ob->pos.z, 1.f);
-	const Vec4f translation = pos + ob->translation;
 
-	// Don't use a zero scale component, because it makes the matrix uninvertible, which breaks various things, including picking and normals.
-	Vec4f use_scale = ob->scale.toVec4fVector();
-	if(use_scale[0] == 0) use_scale[0] = 1.0e-6f;
-	if(use_scale[1] == 0) use_scale[1] = 1.0e-6f;
-	if(use_scale[2] == 0) use_scale[2] = 1.0e-6f;
+				// TODO: need to call assignLightsToObject() somehow
+				// opengl_engine->updateObjectTransformData(*ob->opengl_engine_ob);
+			}
+
+			// Update in physics engine
+			if(ob->physics_object.nonNull())
+				physics_world->moveKinematicObject(*ob->physics_object, item.translation_ws, Quatf::fromAxisAndAngle(item.unit_axis, item.angle), (float)dt);
+
+
+			if(ob->opengl_light.nonNull())
+			{
+				ob->opengl_light->gpu_data.dir = normalise(ob_to_world * Vec4f(0, 0, -1, 0));
+
+				opengl_engine->setLightPos(ob->opengl_light, setWToOne(item.translation_ws));
+			}
+
+			// Update audio source for the object, if it has one.
+			if(ob->audio_source.nonNull())
+			{
+				ob->audio_source->pos = ob->getCentroidWS();
+				audio_engine->sourcePositionUpdated(*ob->audio_source);
+			}
+		}
 
-	const Vec4f unit_axis = normalise(ob->axis.toVec4fVector());
-	const Matrix4f rot = Matrix4f::rotationMatrix(unit_axis, ob->angle);
-	Matrix4f ob_to_world;
-	ob_to_world.setColumn(0, rot.getColumn(0) * use_scale[0]);
-	ob_to_world.setColumn(1, rot.getColumn(1) * use_scale[1]);
-	ob_to_world.setColumn(2, rot.getColumn(2) * use_scale[2]);
-	ob_to_world.setColumn(3, translation);
+		if(item.instances_end > item.instances_begin)
+		{
+			// Update instance physics objects.
+			for(size_t z=item.instances_begin; z<item.instances_end; ++z)
+			{
+				const InstanceItem& instance_item = instance_items[z];
+				InstanceInfo* instance = instance_item.instance;
+				if(instance->physics_object.nonNull())
+					physics_world->moveKinematicObject(*instance->physics_object, instance_item.ob_to_world_out->getColumn(3), Quatf::fromAxisAndAngle(normalise(instance->axis.toVec4fVector()), instance->angle), (float)dt);
+			}
+
+			if(item.has_gl_ob && ob->opengl_engine_ob.nonNull())
+			{
+				// Compute AABB over all instances of the object
+				js::AABBox all_instances_aabb_ws = js::AABBox::emptyAABBox();
+				for(size_t z=item.instances_begin; z<item.instances_end; ++z)
+					all_instances_aabb_ws.enlargeToHoldAABBox(instance_items[z].aabb_ws);
 
-	// Update in physics engine
-	if(ob->physics_object.nonNull())
-		physics_world->moveKinematicObject(*ob->physics_object, translation, Quatf::fromAxisAndAngle(unit_axis, ob->angle), (float)dt);
+				// Manually set AABB of instanced object.
+				// NOTE: we will avoid opengl_engine->updateObjectTransformData(), since it doesn't handle instances currently.
+				ob->opengl_engine_ob->aabb_ws = all_instances_aabb_ws;
 
-	ob_to_world_out = ob_to_world;
+				// Also update instance_matrix_vbo.
+				if(ob->opengl_engine_ob->instance_matrix_vbo.nonNull())
+				{
+					ob->opengl_engine_ob->instance_matrix_vbo->updateData(ob->instance_matrices.data(), ob->instance_matrices.dataSizeBytes());
+				}
+			}
+		}
+	}
 }
 
 
-void evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double global_time, double dt, WorldState* world_state, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, glare::AudioEngine* audio_engine,
-	int& num_scripts_processed_out)
+void ObjectScriptEvaluator::evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double global_time, double dt, WorldState* world_state, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, glare::AudioEngine* audio_engine,
+	glare::TaskManager* task_manager, int& num_scripts_processed_out)
 {
 	// Evaluate scripts on objects
 	if(world_state)
 	{
 		PERFORMANCEAPI_INSTRUMENT("eval scripts");
-		int num_scripts_processed = 0;
-
-		Lock lock(world_state->mutex);
 
 		// When float values get too large, the gap between successive values gets greater than the frame period,
 		// resulting in 'jumpy' transformations.  So mod the double value down to a smaller range (that wraps e.g. once per hour)
 		// and then cast to float.
-		const float use_global_time = (float)Maths::doubleMod(global_time, 3600);
+		this->use_global_time = (float)Maths::doubleMod(global_time, 3600);
 
-		for(auto it = obs_with_scripts.begin(); it != obs_with_scripts.end(); ++it)
 		{
-			WorldObject* ob = it->getPointer();
+			Lock lock(world_state->mutex);
+			gatherScriptInputs(obs_with_scripts);
+		}
 
-			assert(ob->script_evaluator.nonNull());
-			if(ob->script_evaluator.nonNull())
-			{
-				Matrix4f ob_to_world;
-				evalObjectScript(ob, use_global_time, dt, opengl_engine, physics_world, audio_engine, ob_to_world);
-				num_scripts_processed++;
+		evalScripts(task_manager);
 
-				// If this object has instances (and has a graphics ob):
-				if(!ob->instances.empty() && ob->opengl_engine_ob.nonNull())
-				{
-					// Update instance ob-to-world transform based on the script.
-					// Compute AABB over all instances of the object
-					js::AABBox all_instances_aabb_ws = js::AABBox::emptyAABBox();
-					const js::AABBox aabb_os = ob->opengl_engine_ob->mesh_data->aabb_os;
-					for(size_t z=0; z<ob->instances.size(); ++z)
-					{
-						InstanceInfo* instance = &ob->instances[z];
-						Matrix4f instance_ob_to_world;
-						evalObjectInstanceScript(instance, use_global_time, dt, opengl_engine, physics_world, instance_ob_to_world); // Updates instance->physics_object->ob_to_world
-						num_scripts_processed++;
-
-						all_instances_aabb_ws.enlargeToHoldAABBox(aabb_os.transformedAABBFast(instance_ob_to_world));
-
-						ob->instance_matrices[z] = instance_ob_to_world;
-					}
-
-					// Manually set AABB of instanced object.
-					// NOTE: we will avoid opengl_engine->updateObjectTransformData(), since it doesn't handle instances currently.
-					ob->opengl_engine_ob->aabb_ws = all_instances_aabb_ws;
-
-					// Also update instance_matrix_vbo.
-					assert(ob->instance_matrices.size() == ob->instances.size());
-					if(ob->opengl_engine_ob->instance_matrix_vbo.nonNull())
-					{
-						ob->opengl_engine_ob->instance_matrix_vbo->updateData(ob->instance_matrices.data(), ob->instance_matrices.dataSizeBytes());
-					}
-				}
-			}
+		{
+			Lock lock(world_state->mutex);
+			applyScriptResults(dt, opengl_engine, physics_world, audio_engine);
 		}
 
-		num_scripts_processed_out = num_scripts_processed;
+		num_scripts_processed_out = (int)(ob_items.size() + instance_items.size());
 	}
 	else
 	{
@@ -530,4 +665,134 @@ void evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double gl
 }
 
 
+#if BUILD_TESTS
+
+
+static const char* test_script =
+	"def evalRotation(float time, WinterEnv env) vec3 : vec3(-0.6 * time + toFloat(env.instance_index), 0.0, 0.0)\n"
+	"def evalTranslation(float time, WinterEnv env) vec3 : \n"
+	"	let\n"
+	"		ifactor = toFloat(env.instance_index) * 0.1\n"
+	"		timefactor = time * 0.3\n"
+	"	in\n"
+	"		vec3(sin((timefactor + ifactor) * 3) * 4.0, 0.0, sin((timefactor + ifactor) * 2) * 4.0)\n";
+
+
+// Makes num_obs objects with the test script, each with num_instances_per_ob instances.  No OpenGL or physics objects are made.
+static void makeScriptedObjects(Reference<WinterShaderEvaluator> script_evaluator, int num_obs, int num_instances_per_ob, std::set<WorldObjectRef>& obs_out)
+{
+	for(int i=0; i<num_obs; ++i)
+	{
+		WorldObjectRef ob = new WorldObject();
+		ob->uid = UID(i);
+		ob->pos = Vec3d(i * 10.0, 0, 0);
+		ob->axis = Vec3f(0, 0, 1);
+		ob->angle = 0;
+		ob->scale = Vec3f(1, 1, 1);
+		ob->translation = Vec4f(0.f);
+		ob->script_evaluator = script_evaluator;
+
+		ob->instance_matrices.resize(num_instances_per_ob);
+		ob->instances.resize(num_instances_per_ob);
+		for(int z=0; z<num_instances_per_ob; ++z)
+		{
+			InstanceInfo* instance = &ob->instances[z];
+			instance->instance_index = z;
+			instance->num_instances = num_instances_per_ob;
+			instance->script_evaluator = script_evaluator;
+			instance->prototype_object = ob.ptr();
+			instance->pos = ob->pos;
+			instance->axis = ob->axis;
+			instance->angle = ob->angle;
+			instance->scale = ob->scale;
+			instance->translation = Vec4f(0.f);
+		}
+
+		obs_out.insert(ob);
+	}
+}
+
+
+void ObjectScriptEvaluator::test(const std::string& base_dir_path)
+{
+#if !defined(EMSCRIPTEN)
+	conPrint("ObjectScriptEvaluator::test()");
+
+	Reference<WinterShaderEvaluator> script_evaluator = new WinterShaderEvaluator(base_dir_path, test_script);
+
+	Reference<WorldState> world_state = new WorldState();
+	glare::TaskManager task_manager("ObjectScriptEvaluator test task manager");
+
+	//-------------------- Test that evaluating on task manager threads gives the same results as on the calling thread --------------------
+	{
+		std::set<WorldObjectRef> serial_obs, parallel_obs;
+		makeScriptedObjects(script_evaluator, /*num obs=*/50, /*num instances per ob=*/100, serial_obs);
+		makeScriptedObjects(script_evaluator, /*num obs=*/50, /*num instances per ob=*/100, parallel_obs);
+
+		ObjectScriptEvaluator serial_evaluator, parallel_evaluator;
+		int num_serial, num_parallel;
+		serial_evaluator  .evaluateObjectScripts(serial_obs,   /*global time=*/12.3, /*dt=*/0.01, world_state.ptr(), NULL, NULL, NULL, /*task manager=*/NULL, num_serial);
+		parallel_evaluator.evaluateObjectScripts(parallel_obs, /*global time=*/12.3, /*dt=*/0.01, world_state.ptr(), NULL, NULL, NULL, &task_manager, num_parallel);
+
+		testAssert(num_serial == 50 * 101);
+		testAssert(num_parallel == num_serial);
+
+		for(auto a = serial_obs.begin(), b = parallel_obs.begin(); a != serial_obs.end(); ++a, ++b)
+		{
+			const WorldObject* ob_a = a->ptr();
+			const WorldObject* ob_b = b->ptr();
+			testAssert(ob_a->uid == ob_b->uid);
+			testAssert(ob_a->angle == ob_b->angle && ob_a->axis == ob_b->axis);
+			testAssert(ob_a->translation == ob_b->translation);
+			for(size_t z=0; z<ob_a->instances.size(); ++z)
+			{
+				testAssert(ob_a->instance_matrices[z] == ob_b->instance_matrices[z]);
+				testAssert(ob_a->instances[z].translation == ob_b->instances[z].translation);
+			}
+
+			// Check instance translation is relative to the object position.
+			const Vec4f expected_pos = ob_a->pos.toVec4fPoint() + ob_a->instances[3].translation;
+			testAssert(epsEqual(ob_a->instance_matrices[3].getColumn(3), expected_pos));
+		}
+	}
+
+	//-------------------- Benchmark: script evaluation time per frame for N scripted instances --------------------
+	if(false)
+	{
+		const int num_instances_per_ob = 100; // Max instancing count
+		const int instance_counts[] = { 1000, 10000, 50000 };
+		for(int c=0; c<(int)staticArrayNumElems(instance_counts); ++c)
+		{
+			std::set<WorldObjectRef> obs;
+			makeScriptedObjects(script_evaluator, /*num obs=*/instance_counts[c] / num_instances_per_ob, num_instances_per_ob, obs);
+
+			for(int use_task_manager=0; use_task_manager<2; ++use_task_manager)
+			{
+				ObjectScriptEvaluator evaluator;
+				const int num_frames = 100;
+				double global_time = 0;
+				int num_processed = 0;
+
+				Timer timer;
+				for(int f=0; f<num_frames; ++f)
+				{
+					evaluator.evaluateObjectScripts(obs, global_time, /*dt=*/1.0 / 60, world_state.ptr(), NULL, NULL, NULL, use_task_manager ? &task_manager : NULL, num_processed);
+					global_time += 1.0 / 60;
+				}
+				const double time_per_frame = timer.elapsed() / num_frames;
+
+				conPrint(toString(instance_counts[c]) + " scripted instances, " + (use_task_manager ? ("task manager (" + toString(task_manager.getNumThreads()) + " threads)") : std::string("serial")) + ": " +
+					doubleToStringNSigFigs(time_per_frame * 1.0e3, 4) + " ms per frame (" + toString(num_processed) + " scripts processed)");
+			}
+		}
+	}
+
+	conPrint("ObjectScriptEvaluator::test() done.");
+#endif
+}
+
+
+#endif // BUILD_TESTS
+
+
 } // end namespace Scripting
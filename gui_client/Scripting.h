@@ -7,11 +7,14 @@ Copyright Glare Technologies Limited 2022 -
 
 
 #include "../shared/WorldObject.h"
+#include "../shared/TaskCompletionCounter.h"
 class WorldState;
 class OpenGLEngine;
 class PhysicsWorld;
 namespace glare { class AudioEngine; }
 class ObjectPathController;
+class WinterShaderEvaluator;
+namespace glare { class TaskManager; }
 
 
 namespace Scripting
@@ -126,7 +129,78 @@ public:
 void parseXMLScript(WorldObjectRef ob, const std::string& script, double global_time, Reference<ObjectPathController>& path_controller_out, Reference<VehicleScript>& vehicle_script_out);
 
 
-void evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double global_time, double dt, WorldState* world_state, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, glare::AudioEngine* audio_engine,
-	int& num_scripts_processed_out);
+class EvalScriptsTask;
+
+
+/*=====================================================================
+ObjectScriptEvaluator
+---------------------
+Evaluates the transform scripts (evalRotation, evalTranslation) of objects and their instances, each frame.
+
+This is done in 3 stages:
+* The script inputs (position, scale etc.) are copied from the objects, with the world state mutex held.
+* The scripts are evaluated and the transforms computed, spread over task_manager threads, without the mutex held.
+  The JIT'd script functions are pure functions of the time and instance index, so can be called concurrently.
+* The results are applied to the objects, and to the OpenGL, physics and audio engines, on the calling thread with the mutex held.
+
+Holds on to the item buffers between frames, so as to not allocate in steady state.
+=====================================================================*/
+class ObjectScriptEvaluator
+{
+public:
+	ObjectScriptEvaluator();
+	~ObjectScriptEvaluator();
+
+	// task_manager may be NULL, in which case the scripts are evaluated on the calling thread.
+	void evaluateObjectScripts(std::set<WorldObjectRef>& obs_with_scripts, double global_time, double dt, WorldState* world_state, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, glare::AudioEngine* audio_engine,
+		glare::TaskManager* task_manager, int& num_scripts_processed_out);
+
+	static void test(const std::string& base_dir_path);
+
+	struct ObjectItem
+	{
+		Matrix4f ob_to_world; // Result
+		Matrix4f ob_to_world_inv_transpose; // Result
+		Vec4f translation; // Input and result: ob->translation, the translation from pos computed by the script.
+		Vec4f translation_ws; // Result: pos + translation
+		Vec4f use_scale; // Result: scale with any zero components replaced.
+		Vec4f unit_axis; // Result
+		js::AABBox aabb_os; // Object space AABB of the OpenGL object mesh, if has_gl_ob is true.
+		js::AABBox instances_aabb_ws; // Result: AABB of all instances, if has_gl_ob is true.
+		Vec3d pos;
+		Vec3f axis; // Input and result
+		float angle; // Input and result
+		Vec3f scale;
+		WorldObject* ob;
+		WinterShaderEvaluator* script_evaluator;
+		size_t instances_begin, instances_end; // Range of the object's instances in instance_items.
+		bool has_gl_ob;
+		bool transform_valid; // Result: false if the computed translation was not finite.
+	};
+
+	struct InstanceItem
+	{
+		js::AABBox aabb_ws; // Result, if the object has_gl_ob.
+		InstanceInfo* instance;
+		Matrix4f* ob_to_world_out; // Points into the object's instance_matrices.
+		size_t ob_item_index;
+	};
+
+	void evalObjectItems(size_t begin, size_t end);
+	void evalInstanceItems(size_t begin, size_t end);
+
+private:
+	GLARE_DISABLE_COPY(ObjectScriptEvaluator);
+
+	void gatherScriptInputs(std::set<WorldObjectRef>& obs_with_scripts);
+	void evalScripts(glare::TaskManager* task_manager);
+	void applyScriptResults(double dt, OpenGLEngine* opengl_engine, PhysicsWorld* physics_world, glare::AudioEngine* audio_engine);
+
+	js::Vector<ObjectItem, 16> ob_items;
+	js::Vector<InstanceItem, 16> instance_items;
+	float use_global_time;
+	std::vector<Reference<EvalScriptsTask>> eval_tasks;
+	TaskCompletionCounter eval_tasks_remaining; // For waiting on just the eval_tasks in evalScripts().
+};
 
 } // end namespace Scripting
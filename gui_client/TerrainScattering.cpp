@@ -1053,20 +1053,30 @@ void TerrainScattering::buildVegLocationInfo(int chunk_x_index, int chunk_y_inde
 	}
 
 	const TerrainSystem* const terrain_system_  = terrain_system;
+
+	// Generate all candidate positions up front, so that the terrain mask can be looked up for all of them with one batched evalTerrainHeights() call.
+	glare::BumpAllocation cand_x_allocation(N * sizeof(float), /*alignment=*/16, bump_allocator);
+	glare::BumpAllocation cand_y_allocation(N * sizeof(float), /*alignment=*/16, bump_allocator);
+	glare::BumpAllocation cand_masks_allocation(N * sizeof(Colour4f), /*alignment=*/16, bump_allocator);
+	float* const cand_x = (float*)cand_x_allocation.ptr;
+	float* const cand_y = (float*)cand_y_allocation.ptr;
+	Colour4f* const cand_masks = (Colour4f*)cand_masks_allocation.ptr;
 	for(int q=0; q<N; ++q)
 	{
 		const float u = rng.unitRandom();
 		const float v = rng.unitRandom();
-		const Vec4f pos(
-			((float)chunk_x_index + u) * chunk_w_m,
-			((float)chunk_y_index + v) * chunk_w_m,
-			0,
-			1
-		);
+		cand_x[q] = ((float)chunk_x_index + u) * chunk_w_m;
+		cand_y[q] = ((float)chunk_y_index + v) * chunk_w_m;
+	}
+
+	// Lookup terrain mask to see which candidates are vegetation
+	terrain_system_->evalTerrainHeights(cand_x, cand_y, N, /*heights_out=*/NULL, cand_masks);
+
+	for(int q=0; q<N; ++q)
+	{
+		const Vec4f pos(cand_x[q], cand_y[q], 0, 1);
 
-		// Lookup terrain mask to see if this is vegetation
-		const Colour4f mask = terrain_system_->evalTerrainMask(pos[0], pos[1]);
-		float vegetation_mask = mask[2];
+		float vegetation_mask = cand_masks[q][2];
 
 		// Look up our detail_mask_map, if non-null.
 		if(detail_mask_map)
@@ -1119,15 +1129,17 @@ void TerrainScattering::buildVegLocationInfo(int chunk_x_index, int chunk_y_inde
 			//Vec3f(3.f), // base scale
 			//Vec3f(1.f), // scale variation
 
-			const float terrain_h = terrain_system_->evalTerrainHeight(pos[0], pos[1], /*quad_w=*/1.f);
-			const Vec4f use_pos(pos[0], pos[1], terrain_h/* - 0.1f*/, 1); // NOTE: offsetting down
+			// Compact the accepted positions into the start of cand_x and cand_y, for the batched height evaluation below.
+			// locations_out.size() <= q, so this doesn't overwrite any candidates not yet processed.
+			cand_x[locations_out.size()] = pos[0];
+			cand_y[locations_out.size()] = pos[1];
 
 			//const float base_scale = 3.f;
 
 			const float scale_factor =  (rng.unitRandom() * rng.unitRandom() * rng.unitRandom());
 			const float scale_variation = base_scale / 3;//1.f;
 			VegetationLocationInfo info;
-			info.pos = use_pos;
+			info.pos = pos; // z is set to the terrain height below.
 			//info.width = 9.f + scale_factor * 2.f;
 			//info.height = base_height + scale_factor * height_variation;
 			info.scale = base_scale + scale_factor * scale_variation;
@@ -1136,6 +1148,14 @@ void TerrainScattering::buildVegLocationInfo(int chunk_x_index, int chunk_y_inde
 
 scatterpos_invalid: ; // Null statement for goto label.
 	}
+
+	// Evaluate the terrain height at the accepted positions.
+	const size_t num_accepted = locations_out.size();
+	glare::BumpAllocation heights_allocation(myMax<size_t>(1, num_accepted) * sizeof(float), /*alignment=*/16, bump_allocator);
+	float* const heights = (float*)heights_allocation.ptr;
+	terrain_system_->evalTerrainHeights(cand_x, cand_y, num_accepted, heights, /*masks_out=*/NULL);
+	for(size_t i=0; i<num_accepted; ++i)
+		locations_out[i].pos = Vec4f(cand_x[i], cand_y[i], heights[i]/* - 0.1f*/, 1); // NOTE: offsetting down
 }
 
 
@@ -1147,25 +1167,31 @@ void TerrainScattering::buildVegLocationInfoWithPrecomputedPoints(int chunk_x_in
 	locations_out.resize(0);
 	locations_out.reserve(points.size());
 
-	for(int q=0; q<points.size(); ++q)
+	const size_t num_points = points.size();
+	glare::BumpAllocation p_x_allocation(num_points * sizeof(float), /*alignment=*/16, bump_allocator);
+	glare::BumpAllocation p_y_allocation(num_points * sizeof(float), /*alignment=*/16, bump_allocator);
+	glare::BumpAllocation heights_allocation(num_points * sizeof(float), /*alignment=*/16, bump_allocator);
+	glare::BumpAllocation masks_allocation(num_points * sizeof(Colour4f), /*alignment=*/16, bump_allocator);
+	float* const p_x = (float*)p_x_allocation.ptr;
+	float* const p_y = (float*)p_y_allocation.ptr;
+	float* const heights = (float*)heights_allocation.ptr;
+	Colour4f* const masks = (Colour4f*)masks_allocation.ptr;
+	for(size_t q=0; q<num_points; ++q)
 	{
-		const float u = points[q].uv.x;
-		const float v = points[q].uv.y;
-		const Vec4f pos(
-			((float)chunk_x_index + u) * chunk_w_m,
-			((float)chunk_y_index + v) * chunk_w_m,
-			0,
-			1
-		);
+		p_x[q] = ((float)chunk_x_index + points[q].uv.x) * chunk_w_m;
+		p_y[q] = ((float)chunk_y_index + points[q].uv.y) * chunk_w_m;
+	}
+
+	// Lookup terrain mask and height for all points
+	terrain_system->evalTerrainHeights(p_x, p_y, num_points, heights, masks);
 
-		// Lookup terrain mask to see if this is vegetation
-		const Colour4f mask = this->evalTerrainMask(pos[0], pos[1]);
-		const float vegetation_mask = mask[2];
+	for(int q=0; q<points.size(); ++q)
+	{
+		const float vegetation_mask = masks[q][2];
 		//TEMP if(vegetation_mask < 0.5f)
 		//TEMP 	continue;
 
-		const float terrain_h = this->evalTerrainHeight(pos[0], pos[1], /*quad_w=*/1.f);
-		const Vec4f use_pos(pos[0], pos[1], terrain_h/* - 0.1f*/, 1); // NOTE: offsetting down
+		const Vec4f use_pos(p_x[q], p_y[q], heights[q]/* - 0.1f*/, 1); // NOTE: offsetting down
 
 		//const float base_scale = 3.f;
 
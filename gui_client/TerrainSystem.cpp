@@ -233,6 +233,8 @@ void TerrainSystem::init(const TerrainPathSpec& spec_, const std::string& base_d
 	terrain_section_w = spec_.terrain_section_width_m;
 	terrain_scale_factor = 1.f / spec_.terrain_section_width_m;
 
+	fbm_imagemap = opengl_engine->fbm_imagemap;
+
 	next_id = 0;
 
 
@@ -597,10 +599,14 @@ static inline float fbm(ImageMapFloat& fbm_imagemap, Vec2f p)
 	return (fbm_imagemap.sampleSingleChannelTiled(p.x, -p.y, 0) - 0.5f) * 2.f;
 }
 
+// Rotation used for the second fbm octave in fbmMix().  Precomputed in single precision so that fbmMix4() below matches fbmMix().
+static const float fbm_rot_theta = (float)(1.618034 * 3.141592653589 * 2);
+static const float fbm_rot_cos = std::cos(fbm_rot_theta);
+static const float fbm_rot_sin = std::sin(fbm_rot_theta);
+
 static inline Vec2f rot(Vec2f p)
 {
-	const float theta = 1.618034 * 3.141592653589 * 2;
-	return Vec2f(cos(theta) * p.x - sin(theta) * p.y, sin(theta) * p.x + cos(theta) * p.y);
+	return Vec2f(fbm_rot_cos * p.x - fbm_rot_sin * p.y, fbm_rot_sin * p.x + fbm_rot_cos * p.y);
 }
 
 static inline float fbmMix(ImageMapFloat& fbm_imagemap, const Vec2f& p)
@@ -611,6 +617,54 @@ static inline float fbmMix(ImageMapFloat& fbm_imagemap, const Vec2f& p)
 }
 
 
+//-------------------------- SSE helpers for evalTerrainHeight4() --------------------------
+
+// Returns a lane mask with lane i set if bit i of bits is set.
+static inline __m128 laneMask(int bits)
+{
+	return _mm_castsi128_ps(_mm_cmpgt_epi32(_mm_and_si128(_mm_set1_epi32(bits), _mm_setr_epi32(1, 2, 4, 8)), _mm_setzero_si128()));
+}
+
+// mask ? a : b, per lane.
+static inline __m128 select4(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Same as Maths::smoothStep(a, b, x), per lane.
+static inline __m128 smoothStep4(float a, float b, __m128 x)
+{
+	const __m128 t = _mm_min_ps(_mm_max_ps(_mm_div_ps(_mm_sub_ps(x, _mm_set1_ps(a)), _mm_set1_ps(b - a)), _mm_setzero_ps()), _mm_set1_ps(1.f));
+	return _mm_mul_ps(_mm_mul_ps(t, t), _mm_sub_ps(_mm_set1_ps(3.f), _mm_mul_ps(_mm_set1_ps(2.f), t)));
+}
+
+// fbmMix() for 4 points.  The texture lookups are only done for lanes set in lane_bits, other lanes are set to zero.
+static inline __m128 fbmMix4(ImageMapFloat& fbm_imagemap, __m128 p_x, __m128 p_y, int lane_bits)
+{
+	// Compute rot(p * 2)
+	const __m128 q_x = _mm_mul_ps(p_x, _mm_set1_ps(2.f));
+	const __m128 q_y = _mm_mul_ps(p_y, _mm_set1_ps(2.f));
+	const Vec4f r_x(_mm_sub_ps(_mm_mul_ps(_mm_set1_ps(fbm_rot_cos), q_x), _mm_mul_ps(_mm_set1_ps(fbm_rot_sin), q_y)));
+	const Vec4f r_y(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(fbm_rot_sin), q_x), _mm_mul_ps(_mm_set1_ps(fbm_rot_cos), q_y)));
+
+	const Vec4f p_x_v(p_x);
+	const Vec4f p_y_v(p_y);
+	Vec4f sample_a(0.f), sample_b(0.f);
+	for(int i=0; i<4; ++i)
+		if(lane_bits & (1 << i))
+		{
+			// NOTE: textures are effecively flipped upside down in OpenGL, negate y to compensate.
+			sample_a[i] = fbm_imagemap.sampleSingleChannelTiled(p_x_v[i], -p_y_v[i], 0);
+			sample_b[i] = fbm_imagemap.sampleSingleChannelTiled(r_x[i],   -r_y[i],   0);
+		}
+
+	// fbm(p) + fbm(rot(p * 2)) * 0.5, where fbm(p) = (sample - 0.5) * 2
+	const __m128 fbm_a = _mm_mul_ps(_mm_sub_ps(sample_a.v, _mm_set1_ps(0.5f)), _mm_set1_ps(2.f));
+	const __m128 fbm_b = _mm_mul_ps(_mm_sub_ps(sample_b.v, _mm_set1_ps(0.5f)), _mm_set1_ps(2.f));
+	return _mm_and_ps(laneMask(lane_bits), _mm_add_ps(fbm_a, _mm_mul_ps(fbm_b, _mm_set1_ps(0.5f))));
+}
+
+
 // p_x, p_y are world space coordinates.
 Colour4f TerrainSystem::evalTerrainMask(float p_x, float p_y) const
 {
@@ -630,12 +684,13 @@ Colour4f TerrainSystem::evalTerrainMask(float p_x, float p_y) const
 }
 
 
+static const float MIN_TERRAIN_Z = -50.f; // Have a max under-sea depth.  This allows having a flat sea-floor, which in turn allows a lower-res mesh to be used for seafloor chunks.
+
+
 // p_x, p_y are world space coordinates.
 float TerrainSystem::evalTerrainHeight(float p_x, float p_y, float quad_w) const
 {
 #if 1
-	const float MIN_TERRAIN_Z = -50.f; // Have a max under-sea depth.  This allows having a flat sea-floor, which in turn allows a lower-res mesh to be used for seafloor chunks.
-
 	const float nx = p_x * terrain_scale_factor + 0.5f; // Offset by 0.5 so that the central heightmap is centered at (0,0,0).
 	const float ny = p_y * terrain_scale_factor + 0.5f;
 
@@ -683,7 +738,7 @@ float TerrainSystem::evalTerrainHeight(float p_x, float p_y, float quad_w) const
 		const float veg_noise_xy_scale = 1 / 50.f;
 		const float veg_noise_mag = 0.4f * mask_val[2];
 		const float veg_fbm_val = (veg_noise_mag > 0) ?
-			fbmMix(*opengl_engine->fbm_imagemap, Vec2f(p_x, p_y) * veg_noise_xy_scale) * veg_noise_mag : 
+			fbmMix(*fbm_imagemap, Vec2f(p_x, p_y) * veg_noise_xy_scale) * veg_noise_mag : 
 			0.f;
 		terrain_h += veg_fbm_val;
 
@@ -703,7 +758,7 @@ float TerrainSystem::evalTerrainHeight(float p_x, float p_y, float quad_w) const
 		if(mask_val[0] == 0)
 			rock_weight_env = 0;
 		else
-			rock_weight_env =  Maths::smoothStep(0.2f, 0.6f, mask_val[0] + fbmMix(*opengl_engine->fbm_imagemap, detail_map_2_uvs * 0.2f) * 0.2f);
+			rock_weight_env =  Maths::smoothStep(0.2f, 0.6f, mask_val[0] + fbmMix(*fbm_imagemap, detail_map_2_uvs * 0.2f) * 0.2f);
 		float rock_height = detail_heightmaps[0].nonNull() ? detail_heightmaps[0]->sampleSingleChannelTiled(detail_map_0_uvs.x, -detail_map_0_uvs.y, 0) * rock_weight_env : 0;
 
 		//float rock_height = mask_val[0] * 10.0;
@@ -794,6 +849,140 @@ float TerrainSystem::evalTerrainHeight(float p_x, float p_y, float quad_w) const
 }
 
 
+// Evaluates the terrain height and/or the terrain mask at 4 points.  Either heights_out or masks_out may be NULL.
+// This is the same computation as evalTerrainHeight() and evalTerrainMask(), but with the arithmetic done for all 4 points at once with SSE.
+// The texture lookups are still done per point, with the same samplers, so that the results match.
+void TerrainSystem::evalTerrainHeight4(const float* p_x, const float* p_y, float* heights_out, Colour4f* masks_out) const
+{
+	const __m128 px = _mm_loadu_ps(p_x);
+	const __m128 py = _mm_loadu_ps(p_y);
+	const Vec4f nx(_mm_add_ps(_mm_mul_ps(px, _mm_set1_ps(terrain_scale_factor)), _mm_set1_ps(0.5f))); // Offset by 0.5 so that the central heightmap is centered at (0,0,0).
+	const Vec4f ny(_mm_add_ps(_mm_mul_ps(py, _mm_set1_ps(terrain_scale_factor)), _mm_set1_ps(0.5f)));
+
+	// Look up the source terrain data section for each point, and sample its heightmap and mask map.
+	Vec4f heightmap_z(0.f), mask_r(0.f), mask_b(0.f);
+	int valid_bits = 0; // Bit i is set if point i is in a section with a heightmap.
+	for(int i=0; i<4; ++i)
+	{
+		const int section_x = Maths::floorToInt(nx[i]) + TERRAIN_SECTION_OFFSET;
+		const int section_y = Maths::floorToInt(ny[i]) + TERRAIN_SECTION_OFFSET;
+		const TerrainDataSection* section = (section_x < 0 || section_x >= 8 || section_y < 0 || section_y >= 8) ? NULL : &terrain_data_sections[section_x + section_y*TERRAIN_DATA_SECTION_RES];
+
+		Colour4f mask_val(0.f);
+		if(section && section->maskmap.nonNull())
+			mask_val = section->maskmap->vec3Sample(nx[i], 1.f - ny[i], /*wrap=*/false);
+
+		if(masks_out)
+			masks_out[i] = (section && section->maskmap.nonNull()) ? mask_val : Colour4f(1,0,0,0); // Same as evalTerrainMask()
+
+		if(heights_out && section && section->heightmap.nonNull())
+		{
+			// NOTE: textures are effecively flipped upside down in OpenGL, negate y to compensate.
+			heightmap_z[i] = section->heightmap->sampleSingleChannelHighQual(nx[i], 1.f - ny[i], /*channel=*/0, /*wrap=*/false);
+			mask_r[i] = mask_val[0];
+			mask_b[i] = mask_val[2];
+			valid_bits |= 1 << i;
+		}
+	}
+
+	if(!heights_out)
+		return;
+
+	__m128 terrain_h = _mm_max_ps(_mm_set1_ps(-100000.f), heightmap_z.v);
+
+	const int noise_bits = valid_bits & _mm_movemask_ps(_mm_cmpgt_ps(terrain_h, _mm_set1_ps(MIN_TERRAIN_Z))); // Don't apply fine noise on the seafloor.
+	if(noise_bits != 0)
+	{
+		ImageMapFloat& fbm_imagemap = *this->fbm_imagemap;
+
+		// Vegetation noise
+		const float veg_noise_xy_scale = 1 / 50.f;
+		const __m128 veg_noise_mag = _mm_mul_ps(_mm_set1_ps(0.4f), mask_b.v);
+		const int veg_bits = noise_bits & _mm_movemask_ps(_mm_cmpgt_ps(veg_noise_mag, _mm_setzero_ps()));
+		if(veg_bits != 0)
+		{
+			const __m128 veg_fbm = fbmMix4(fbm_imagemap, _mm_mul_ps(px, _mm_set1_ps(veg_noise_xy_scale)), _mm_mul_ps(py, _mm_set1_ps(veg_noise_xy_scale)), veg_bits);
+			terrain_h = _mm_add_ps(terrain_h, _mm_mul_ps(veg_fbm, veg_noise_mag));
+		}
+
+		// Rocks
+		const int rock_bits = noise_bits & _mm_movemask_ps(_mm_cmpneq_ps(mask_r.v, _mm_setzero_ps()));
+		if(rock_bits != 0)
+		{
+			const __m128 detail_map_2_u = _mm_mul_ps(nx.v, _mm_set1_ps((float)(8.0 * 1024 / 4.0)));
+			const __m128 detail_map_2_v = _mm_mul_ps(ny.v, _mm_set1_ps((float)(8.0 * 1024 / 4.0)));
+			const __m128 rock_fbm = fbmMix4(fbm_imagemap, _mm_mul_ps(detail_map_2_u, _mm_set1_ps(0.2f)), _mm_mul_ps(detail_map_2_v, _mm_set1_ps(0.2f)), rock_bits);
+
+			const Vec4f rock_weight_env(_mm_and_ps(laneMask(rock_bits), smoothStep4(0.2f, 0.6f, _mm_add_ps(mask_r.v, _mm_mul_ps(rock_fbm, _mm_set1_ps(0.2f))))));
+
+			if(detail_heightmaps[0].nonNull())
+			{
+				const Vec4f detail_map_0_u(_mm_mul_ps(nx.v, _mm_set1_ps((float)(8.0 * 1024 / 8.0))));
+				const Vec4f detail_map_0_v(_mm_mul_ps(ny.v, _mm_set1_ps((float)(8.0 * 1024 / 8.0))));
+
+				Vec4f rock_sample(0.f);
+				for(int i=0; i<4; ++i)
+					if(rock_weight_env[i] != 0) // Skip the lookup if it would be multiplied by zero.
+						rock_sample[i] = detail_heightmaps[0]->sampleSingleChannelTiled(detail_map_0_u[i], -detail_map_0_v[i], 0);
+
+				const __m128 rock_height = _mm_mul_ps(rock_sample.v, rock_weight_env.v);
+				terrain_h = _mm_add_ps(terrain_h, _mm_mul_ps(rock_height, _mm_set1_ps(0.8f)));
+			}
+		}
+	}
+
+	_mm_storeu_ps(heights_out, select4(laneMask(valid_bits), terrain_h, _mm_set1_ps(spec.default_terrain_z)));
+}
+
+
+void TerrainSystem::evalTerrainHeights(const float* p_x, const float* p_y, size_t num, float* heights_out, Colour4f* masks_out) const
+{
+	size_t i = 0;
+	for(; i + 4 <= num; i += 4)
+		evalTerrainHeight4(p_x + i, p_y + i, heights_out ? (heights_out + i) : NULL, masks_out ? (masks_out + i) : NULL);
+
+	if(i < num)
+	{
+		// Pad the remaining points to 4 by repeating the last point.
+		float pad_x[4], pad_y[4], pad_h[4];
+		Colour4f pad_masks[4];
+		for(size_t z=0; z<4; ++z)
+		{
+			const size_t src = myMin(i + z, num - 1);
+			pad_x[z] = p_x[src];
+			pad_y[z] = p_y[src];
+		}
+
+		evalTerrainHeight4(pad_x, pad_y, heights_out ? pad_h : NULL, masks_out ? pad_masks : NULL);
+
+		for(size_t z=0; i + z < num; ++z)
+		{
+			if(heights_out)
+				heights_out[i + z] = pad_h[z];
+			if(masks_out)
+				masks_out[i + z] = pad_masks[z];
+		}
+	}
+}
+
+
+void TerrainSystem::evalTerrainHeightRow(float p_x_0, float p_y, float spacing, size_t num, float* heights_out) const
+{
+	const float row_y[4] = { p_y, p_y, p_y, p_y };
+	for(size_t i=0; i<num; i += 4)
+	{
+		float row_x[4], row_h[4];
+		for(size_t z=0; z<4; ++z)
+			row_x[z] = (int)myMin(i + z, num - 1) * spacing + p_x_0;
+
+		evalTerrainHeight4(row_x, row_y, row_h, /*masks_out=*/NULL);
+
+		for(size_t z=0; (z < 4) && (i + z < num); ++z)
+			heights_out[i + z] = row_h[z];
+	}
+}
+
+
 void TerrainSystem::makeTerrainChunkMesh(float chunk_x, float chunk_y, float chunk_w, bool build_physics_ob, TerrainChunkData& chunk_data_out) const
 {
 	//Timer timer;
@@ -833,21 +1022,22 @@ void TerrainSystem::makeTerrainChunkMesh(float chunk_x, float chunk_y, float chu
 	{
 		const int CHECK_RES = 32;
 		const float quad_w = chunk_w / (CHECK_RES - 1);
-		const float z_0 = evalTerrainHeight(chunk_x, chunk_y, quad_w);
-		for(int y=0; y<CHECK_RES; ++y)
-		for(int x=0; x<CHECK_RES; ++x)
+		float row_z[CHECK_RES];
+		float z_0 = 0;
+		for(int y=0; (y<CHECK_RES) && completely_flat; ++y)
 		{
-			const float p_x = x * quad_w + chunk_x;
-			const float p_y = y * quad_w + chunk_y;
-			const float z = evalTerrainHeight(p_x, p_y, quad_w);
-			if(z != z_0)
-			{
-				completely_flat = false;
-				goto done;
-			}
+			evalTerrainHeightRow(/*p_x_0=*/chunk_x, /*p_y=*/y * quad_w + chunk_y, /*spacing=*/quad_w, CHECK_RES, row_z);
+			if(y == 0)
+				z_0 = row_z[0];
+
+			for(int x=0; x<CHECK_RES; ++x)
+				if(row_z[x] != z_0)
+				{
+					completely_flat = false;
+					break;
+				}
 		}
 	}
-done:
 
 	const int interior_vert_res = completely_flat ? 8 : 128; // Number of vertices along the side of a chunk, excluding the 2 border vertices.  Use a power of 2 for Jolt.
 	const int interior_quad_res = interior_vert_res - 1;
@@ -939,28 +1129,10 @@ done:
 
 	assert(in_vert_offset_B == vert_size_B);
 
+	// Evaluate heights a row at a time with the batched evaluation.  Array2D is row-major so each row is contiguous.
 	Array2D<float> raw_heightfield(interior_vert_res, interior_vert_res);
-	// Array2D<Vec3f> raw_normals(interior_vert_res, interior_vert_res);
 	for(int y=0; y<interior_vert_res; ++y)
-	for(int x=0; x<interior_vert_res; ++x)
-	{
-		const float p_x = x * quad_w + chunk_x;
-		const float p_y = y * quad_w + chunk_y;
-	// 	const float dx = 0.1f;
-	// 	const float dy = 0.1f;
-	// 
-	 	const float z    = evalTerrainHeight(p_x,      p_y,      quad_w); // z = h(p_x, p_y)
-	// 	const float z_dx = evalTerrainHeight(p_x + dx, p_y,      quad_w, water); // z_dx = h(p_x + dx, dy)
-	// 	const float z_dy = evalTerrainHeight(p_x,      p_y + dy, quad_w, water); // z_dy = h(p_x, p_y + dy)
-	// 
-	// 	const Vec3f p_dx_minus_p(dx, 0, z_dx - z); // p(p_x + dx, dy) - p(p_x, p_y) = (p_x + dx, d_y, z_dx) - (p_x, p_y, z) = (d_x, 0, z_dx - z)
-	// 	const Vec3f p_dy_minus_p(0, dy, z_dy - z);
-	// 
-	// 	const Vec3f normal = normalise(crossProduct(p_dx_minus_p, p_dy_minus_p));
-	// 
-	 	raw_heightfield.elem(x, y) = z;
-	// 	raw_normals.elem(x, y) = normal;
-	}
+		evalTerrainHeightRow(/*p_x_0=*/chunk_x, /*p_y=*/y * quad_w + chunk_y, /*spacing=*/quad_w, interior_vert_res, &raw_heightfield.elem(0, y));
 
 	//conPrint("eval terrain height took     " + timer.elapsedStringMSWIthNSigFigs(4));
 	//timer.reset();
@@ -172,7 +172,15 @@ public:
 	Colour4f evalTerrainMask(float p_x, float p_y) const;
 	float evalTerrainHeight(float p_x, float p_y, float quad_w) const;
 
+	// Batched evaluation of terrain height and/or terrain mask for num points.  Either heights_out or masks_out may be NULL.
+	// Points are evaluated 4 at a time with SSE, giving the same results as evalTerrainHeight() and evalTerrainMask() up to float rounding.
+	void evalTerrainHeights(const float* p_x, const float* p_y, size_t num, float* heights_out, Colour4f* masks_out) const;
+
+	// Evaluates terrain height at the points (p_x_0 + i * spacing, p_y) for i = 0, ..., num - 1.
+	void evalTerrainHeightRow(float p_x_0, float p_y, float spacing, size_t num, float* heights_out) const;
+
 private:
+	void evalTerrainHeight4(const float* p_x, const float* p_y, float* heights_out, Colour4f* masks_out) const;
 	void makeTerrainChunkMesh(float chunk_x, float chunk_y, float chunk_w, bool build_physics_ob, TerrainChunkData& chunk_data_out) const;
 	void updateSubtree(TerrainNode* node, const Vec3d& campos);
 	void removeSubtree(TerrainNode* node, std::vector<GLObjectRef>& old_children_gl_obs_in_out, std::vector<PhysicsObjectRef>& old_children_phys_obs_in_out);
@@ -210,6 +218,8 @@ private:
 	
 	Map2DRef detail_heightmaps[4];
 
+	Reference<ImageMapFloat> fbm_imagemap; // Noise map for the terrain height detail.  Taken from opengl_engine in init(), so height evaluation doesn't need the engine.
+
 	IndexBufAllocationHandle vert_res_10_index_buffer;
 	IndexBufAllocationHandle vert_res_130_index_buffer;
 
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "TerrainSystem.h"
+#include <graphics/ImageMap.h>
 #include <utils/TaskManager.h>
 #include <utils/ContainerUtils.h>
 #include <utils/TestUtils.h>
@@ -793,21 +794,158 @@ void TerrainTests::testTerrain()
 }
 
 
+static Reference<ImageMapFloat> makeRandomImageMap(PCG32& rng, size_t W, size_t H, size_t N, float min_val, float max_val)
+{
+	Reference<ImageMapFloat> map = new ImageMapFloat(W, H, N);
+	for(size_t y=0; y<H; ++y)
+	for(size_t x=0; x<W; ++x)
+		for(size_t c=0; c<N; ++c)
+			map->getPixel(x, y)[c] = min_val + rng.unitRandom() * (max_val - min_val);
+	return map;
+}
+
+
+// Checks the batched SSE terrain height and mask evaluation matches the scalar evaluation, on a terrain made from random maps, so no OpenGL engine is needed.
+void TerrainTests::testBatchedTerrainEvaluation()
+{
+	conPrint("testBatchedTerrainEvaluation()");
+
+	PCG32 rng(1);
+
+	Reference<TerrainSystem> terrain_system = new TerrainSystem();
+	terrain_system->spec.default_terrain_z = -30.f;
+	terrain_system->terrain_section_w = 1024.f;
+	terrain_system->terrain_scale_factor = 1.f / terrain_system->terrain_section_w;
+	terrain_system->fbm_imagemap = makeRandomImageMap(rng, 64, 64, 1, 0.f, 1.f);
+	terrain_system->detail_heightmaps[0] = makeRandomImageMap(rng, 32, 32, 1, 0.f, 1.f);
+
+	// Leave some sections without a heightmap or mask map, and zero the rock and vegetation mask channels in some others, to cover all the branches.
+	for(int i=0; i<TerrainSystem::TERRAIN_DATA_SECTION_RES * TerrainSystem::TERRAIN_DATA_SECTION_RES; ++i)
+	{
+		TerrainDataSection& section = terrain_system->terrain_data_sections[i];
+		if(i % 5 == 0)
+			continue;
+
+		section.heightmap = makeRandomImageMap(rng, 64, 64, 1, /*min val=*/-150.f, /*max val=*/150.f); // Some heights are below MIN_TERRAIN_Z, where no noise is applied.
+		if(i % 7 == 0)
+			continue;
+
+		Reference<ImageMapFloat> maskmap = makeRandomImageMap(rng, 16, 16, 4, 0.f, 1.f);
+		if(i % 3 == 0)
+		{
+			for(size_t y=0; y<maskmap->getHeight(); ++y)
+			for(size_t x=0; x<maskmap->getWidth(); ++x)
+			{
+				maskmap->getPixel(x, y)[0] = 0;
+				maskmap->getPixel(x, y)[2] = 0;
+			}
+		}
+		section.maskmap = maskmap;
+	}
+
+	const size_t N = 10001; // Not a multiple of 4, to test the padding of the last points.
+	const float range = terrain_system->terrain_section_w * (TerrainSystem::TERRAIN_DATA_SECTION_RES + 2); // Include points outside of the terrain sections.
+	std::vector<float> p_x(N), p_y(N), heights(N);
+	std::vector<Colour4f> masks(N);
+	for(size_t i=0; i<N; ++i)
+	{
+		p_x[i] = (rng.unitRandom() - 0.5f) * range;
+		p_y[i] = (rng.unitRandom() - 0.5f) * range;
+	}
+
+	terrain_system->evalTerrainHeights(p_x.data(), p_y.data(), N, heights.data(), masks.data());
+
+	float max_error = 0;
+	for(size_t i=0; i<N; ++i)
+	{
+		const float ref_h = terrain_system->evalTerrainHeight(p_x[i], p_y[i], /*quad_w=*/1.f);
+		max_error = myMax(max_error, std::fabs(heights[i] - ref_h));
+		testAssert(std::fabs(heights[i] - ref_h) <= 1.0e-3f * myMax(1.f, std::fabs(ref_h)));
+
+		const Colour4f ref_mask = terrain_system->evalTerrainMask(p_x[i], p_y[i]);
+		for(int c=0; c<4; ++c)
+			testAssert(masks[i][c] == ref_mask[c]);
+	}
+	conPrint("Batched terrain evaluation max abs error: " + toString(max_error));
+
+	// Check mask-only evaluation gives the same masks.
+	std::vector<Colour4f> masks_only(N);
+	terrain_system->evalTerrainHeights(p_x.data(), p_y.data(), N, /*heights_out=*/NULL, masks_only.data());
+	for(size_t i=0; i<N; ++i)
+		for(int c=0; c<4; ++c)
+			testAssert(masks_only[i][c] == masks[i][c]);
+
+	// Check evaluation of a row of points, for row lengths that are and aren't a multiple of 4.
+	for(size_t num=1; num<=9; ++num)
+	{
+		const float row_x_0 = -1463.f;
+		const float row_y = 1200.9f; // In a section with a heightmap and a mask map with non-zero rock and vegetation weights.
+		const float spacing = 37.f;
+		float row_heights[9];
+		terrain_system->evalTerrainHeightRow(row_x_0, row_y, spacing, num, row_heights);
+
+		for(size_t i=0; i<num; ++i)
+		{
+			const float ref_h = terrain_system->evalTerrainHeight((int)i * spacing + row_x_0, row_y, /*quad_w=*/1.f);
+			testAssert(std::fabs(row_heights[i] - ref_h) <= 1.0e-3f * myMax(1.f, std::fabs(ref_h)));
+		}
+	}
+
+	conPrint("testBatchedTerrainEvaluation() done.");
+}
+
+
+void TerrainTests::test()
+{
+	testBatchedTerrainEvaluation();
+}
+
+
 void TerrainTests::testTerrainSystem(TerrainSystem& terrain_system)
 {
 	conPrint("testTerrainSystem()");
 
-	double min_time = 1.0e10;
-	for(int i=0; i<1000; ++i)
+	// Compare the time to evaluate the heights for a chunk, with the scalar and batched evaluation, for a range of chunk resolutions.
+	for(int res=8; res<=256; res *= 2)
 	{
-		//conPrint("-------------");
-		Timer timer;
-		TerrainChunkData chunk_data;
-		terrain_system.makeTerrainChunkMesh(/*chunk_x=*/1463.f, /*chunk_y=*/1883.9f, /*chunk_w=*/1.f, /*build physics ob=*/true, chunk_data);
-		//conPrint("makeTerrainChunkMesh elapsed: " + timer.elapsedStringNSigFigs(3));
-		min_time = myMin(min_time, timer.elapsed());
+		const float chunk_x = 1463.f;
+		const float chunk_y = 1883.9f;
+		const float quad_w = 64.f / (res - 1);
+		Array2D<float> heights(res, res);
+
+		double min_scalar_time = 1.0e10;
+		double min_batched_time = 1.0e10;
+		for(int t=0; t<20; ++t)
+		{
+			Timer timer;
+			for(int y=0; y<res; ++y)
+			for(int x=0; x<res; ++x)
+				heights.elem(x, y) = terrain_system.evalTerrainHeight(x * quad_w + chunk_x, y * quad_w + chunk_y, quad_w);
+			min_scalar_time = myMin(min_scalar_time, timer.elapsed());
+
+			timer.reset();
+			for(int y=0; y<res; ++y)
+				terrain_system.evalTerrainHeightRow(chunk_x, y * quad_w + chunk_y, quad_w, res, &heights.elem(0, y));
+			min_batched_time = myMin(min_batched_time, timer.elapsed());
+		}
+
+		conPrint("res " + toString(res) + " x " + toString(res) + ": scalar: " + doubleToStringNSigFigs(min_scalar_time * 1000, 4) + " ms, batched: " + 
+			doubleToStringNSigFigs(min_batched_time * 1000, 4) + " ms (" + doubleToStringNSigFigs(min_scalar_time / min_batched_time, 3) + "x)");
+	}
+
+	// Time building whole chunks, for a range of chunk widths.  Flat chunks are built at a lower resolution.
+	for(float chunk_w = 1.f; chunk_w <= 4096.f; chunk_w *= 16.f)
+	{
+		double min_time = 1.0e10;
+		for(int i=0; i<100; ++i)
+		{
+			Timer timer;
+			TerrainChunkData chunk_data;
+			terrain_system.makeTerrainChunkMesh(/*chunk_x=*/1463.f, /*chunk_y=*/1883.9f, chunk_w, /*build physics ob=*/true, chunk_data);
+			min_time = myMin(min_time, timer.elapsed());
+		}
+		conPrint("makeTerrainChunkMesh, chunk_w " + toString(chunk_w) + " m: " + doubleToStringNSigFigs(min_time * 1000, 5) + " ms");
 	}
-	conPrint("makeTerrainChunkMesh elapsed: " + doubleToStringNSigFigs(min_time * 1000, 5) + " ms");
 
 	conPrint("testTerrainSystem() done.");
 	exit(1);
@@ -29,6 +29,11 @@ TerrainTests
 =====================================================================*/
 class TerrainTests
 {
+public:
+	static void test();
+
+private:
+	static void testBatchedTerrainEvaluation();
 
 	static void testTerrain();
 
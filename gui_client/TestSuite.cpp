@@ -8,9 +8,15 @@ Copyright Glare Technologies Limited 2023 -
 
 #include "ModelLoading.h"
 #include "PhysicsWorld.h"
+#include "PhysicsShapeCache.h"
 #include "TerrainTests.h"
 #include "URLParser.h"
 #include "CameraController.h"
+#include "DownloadingResourceQueue.h"
+#include "LoadItemQueue.h"
+#include "ObjectLODTable.h"
+#include "Scripting.h"
+#include "MeshManager.h"
 #include "../shared/VoxelMeshBuilding.h"
 #include "../shared/LODGeneration.h"
 #include "../shared/ImageDecoding.h"
@@ -142,17 +148,21 @@ void TestSuite::test()
 	runTest([&]() { Sort::test(); });
 	runTest([&]() { glare::BestFitAllocator::test(); });
 	runTest([&]() { testSRGBUtils(); });
+	runTest([&]() { ImageDecoding::test(); });
 	PhysicsWorld::init(); // Init before taking mem snapshot
 	runTest([&]() { PhysicsWorld::test(); });
+	runTest([&]() { PhysicsShapeCache::test(); });
 	runTest([&]() { TopologicalSort::test(); });
 	runTest([&]() { CheckedMaths::test(); });
 	runTest([&]() { LODGeneration::test(); });
 	runTest([&]() { VoxelMeshBuilding::test(); });
+	runTest([&]() { TerrainTests::test(); });
 	runTest([&]() { ModelLoading::test(); });
 	runTest([&]() { glare::AudioFileReader::test(); });
 	runTest([&]() { TLSSocketTests::test(); }, /*mem leak allowed=*/true);
 	runTest([&]() { URLParser::test(); });
 	runTest([&]() { testManagerWithCache(); });
+	runTest([&]() { MeshManager::test(); });
 	runTest([&]() { BitUtils::test(); });
 	runTest([&]() { MeshSimplification::test(); });
 	runTest([&]() { quaternionTests(); });
@@ -178,6 +188,10 @@ void TestSuite::test()
 	runTest([&]() { js::AABBox::test(); });
 	runTest([&]() { ReferenceTest::run(); });
 	runTest([&]() { CameraController::test(); });
+	runTest([&]() { DownloadingResourceQueue::test(); });
+	runTest([&]() { LoadItemQueue::test(); });
+	runTest([&]() { ObjectLODTable::test(); });
+	runTest([&]() { Scripting::ObjectScriptEvaluator::test(base_dir_path); });
 	// WMFVideoReader::test();
 	// UVUnwrapper::test(); // Disabled as tries to load a bunch of Indigo test scenes
 	// OpenGLEngineTests::test(base_dir_path); // Disabled as tries to load a bunch of Indigo test scenes
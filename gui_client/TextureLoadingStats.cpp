@@ -0,0 +1,78 @@
+/*=====================================================================
+TextureLoadingStats.cpp
+-----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "TextureLoadingStats.h"
+
+
+#include <utils/StringUtils.h>
+#include <maths/mathstypes.h>
+
+
+// Initial throughput estimate, gives a budget of 1 MB for 3 ms of uploading, the fixed per-frame limit used previously.
+static const double DEFAULT_UPLOAD_BYTES_PER_SEC = 1024 * 1024 / 0.003;
+static const size_t MIN_UPLOAD_BYTE_BUDGET = 256 * 1024;
+static const size_t MAX_UPLOAD_BYTE_BUDGET = 16 * 1024 * 1024;
+
+
+TextureLoadingStats::TextureLoadingStats()
+:	num_textures(0),
+	max_num_upload_frames(0),
+	upload_bytes_per_sec(DEFAULT_UPLOAD_BYTES_PER_SEC)
+{}
+
+
+void TextureLoadingStats::StageStats::add(double t)
+{
+	total_time += t;
+	max_time = myMax(max_time, t);
+}
+
+
+std::string TextureLoadingStats::StageStats::toString(size_t num_textures) const
+{
+	const double av_time = (num_textures > 0) ? (total_time / num_textures) : 0.0;
+	return "av " + doubleToStringNSigFigs(av_time * 1.0e3, 3) + " ms, max " + doubleToStringNSigFigs(max_time * 1.0e3, 3) + " ms";
+}
+
+
+void TextureLoadingStats::textureLoaded(const TextureTimes& times)
+{
+	num_textures++;
+	decode_stats.add(times.decode_time);
+	process_stats.add(times.process_time);
+	queue_stats.add(times.queue_time);
+	upload_stats.add(times.upload_time);
+	max_num_upload_frames = myMax(max_num_upload_frames, times.num_upload_frames);
+}
+
+
+void TextureLoadingStats::recordUpload(size_t num_bytes, double elapsed_time)
+{
+	// Small uploads are dominated by per-call overhead, so don't give a useful throughput estimate.
+	if(num_bytes < 64 * 1024 || elapsed_time <= 0)
+		return;
+
+	const double bytes_per_sec = num_bytes / elapsed_time;
+	upload_bytes_per_sec = upload_bytes_per_sec * 0.9 + bytes_per_sec * 0.1;
+}
+
+
+size_t TextureLoadingStats::getUploadByteBudget(double max_upload_time) const
+{
+	return myClamp((size_t)(upload_bytes_per_sec * max_upload_time), MIN_UPLOAD_BYTE_BUDGET, MAX_UPLOAD_BYTE_BUDGET);
+}
+
+
+std::string TextureLoadingStats::getDiagnostics() const
+{
+	std::string s;
+	s += "Textures loaded: " + ::toString(num_textures) + "\n";
+	s += "  decode:  " + decode_stats.toString(num_textures) + "\n";
+	s += "  process: " + process_stats.toString(num_textures) + "\n";
+	s += "  queue:   " + queue_stats.toString(num_textures) + "\n";
+	s += "  upload:  " + upload_stats.toString(num_textures) + ", max " + ::toString(max_num_upload_frames) + " frames\n";
+	s += "Upload throughput: " + getNiceByteSize((size_t)upload_bytes_per_sec) + "/s\n";
+	return s;
+}
@@ -0,0 +1,72 @@
+/*=====================================================================
+TextureLoadingStats.h
+---------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/Platform.h>
+#include <string>
+
+
+/*=====================================================================
+TextureLoadingStats
+-------------------
+Timings of the stages of texture loading, for diagnostics:
+decode (reading and decoding the image file, in LoadTextureTask),
+process (resizing, building mipmaps and compressing, in LoadTextureTask),
+queue (waiting for the main thread to start uploading the texture) and
+upload (main thread time spent uploading the texture, over one or more frames).
+
+Also keeps an estimate of the upload throughput, measured from both texture and mesh uploads, which is used to choose
+how many bytes of texture and mesh data to upload per frame, so that uploads take about a given time each frame.
+
+Only used from the main thread.
+=====================================================================*/
+class TextureLoadingStats
+{
+public:
+	TextureLoadingStats();
+
+	struct TextureTimes
+	{
+		TextureTimes() : decode_time(0), process_time(0), queue_time(0), upload_time(0), num_upload_frames(0) {}
+
+		double decode_time;
+		double process_time;
+		double queue_time;
+		double upload_time;
+		int num_upload_frames;
+	};
+
+	void textureLoaded(const TextureTimes& times);
+
+	// Record a texture or mesh upload of num_bytes that took elapsed_time on the main thread.
+	void recordUpload(size_t num_bytes, double elapsed_time);
+
+	// Returns the number of bytes that can be uploaded in about max_upload_time, based on the recent upload throughput.
+	size_t getUploadByteBudget(double max_upload_time) const;
+
+	std::string getDiagnostics() const;
+
+private:
+	struct StageStats
+	{
+		StageStats() : total_time(0), max_time(0) {}
+		void add(double t);
+		std::string toString(size_t num_textures) const;
+
+		double total_time;
+		double max_time;
+	};
+
+	size_t num_textures;
+	StageStats decode_stats;
+	StageStats process_stats;
+	StageStats queue_stats;
+	StageStats upload_stats;
+	int max_num_upload_frames;
+
+	double upload_bytes_per_sec; // Exponential moving average of upload throughput.
+};
@@ -10,6 +10,9 @@ Copyright Glare Technologies Limited 2022 -
 #include "../shared/WorldObject.h"
 #include "../shared/Parcel.h"
 #include "../shared/GroundPatch.h"
+#if GUI_CLIENT
+#include "ObjectLODTable.h"
+#endif
 #include <ThreadSafeRefCounted.h>
 #include <FastIterMap.h>
 #include <Mutex.h>
@@ -45,6 +48,11 @@ public:
 	glare::FastIterMap<UID, WorldObjectRef, UIDHasher> objects GUARDED_BY(mutex);
 	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects GUARDED_BY(mutex);
 	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_local_objects GUARDED_BY(mutex);
+#if GUI_CLIENT
+	// Compact copy of the object data used by GUIClient::checkForLODChanges().  Protected by mutex - see ObjectLODTable.h for locking details.
+	// Declared after objects so that it is destroyed first, while the objects are still alive.
+	ObjectLODTable lod_table;
+#endif
 
 	std::map<ParcelID, ParcelRef> parcels GUARDED_BY(mutex);
 	std::unordered_set<ParcelRef, ParcelRefHash> dirty_from_remote_parcels GUARDED_BY(mutex);
@@ -52,6 +52,7 @@ Copyright Glare Technologies Limited 2020 -
 #include <indigo/UVUnwrapper.h>
 #include <tls.h>
 #include "../gui_client/IndigoConversion.h"
+#include <limits>
 
 //#include <nvtt/nvtt.h>
 
@@ -145,6 +146,7 @@ public:
 				DownloadQueueItem item;
 				item.pos = Vec4f(0, 0, 0, 1);// ob_aabb_ws.centroid();
 				item.size_factor = 1.f;// DownloadQueueItem::sizeFactorForAABBWS(ob_aabb_ws);
+				item.max_dist = std::numeric_limits<float>::infinity();
 				item.URL = url;
 				this->download_queue.enqueueItem(item);
 			}
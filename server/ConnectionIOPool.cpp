@@ -0,0 +1,1028 @@
+/*=====================================================================
+ConnectionIOPool.cpp
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ConnectionIOPool.h"
+
+
+#include <MessageableThread.h>
+#include <EventFD.h>
+#include <AtomicInt.h>
+#include <Task.h>
+#include <ConPrint.h>
+#include <Exception.h>
+#include <Lock.h>
+#include <StringUtils.h>
+#include <PlatformUtils.h>
+#include <Timer.h>
+#include <maths/mathstypes.h>
+#if !(defined(_WIN32) || defined(OSX))
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/tcp.h> // For tcp_info with tcpi_bytes_acked and tcpi_bytes_received, which netinet/tcp.h doesn't have.
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+#endif
+
+
+enum PollState
+{
+	PollState_Armed,		// The fds are armed, waiting for the socket to become readable or the event FD to be signalled.
+	PollState_Dispatched,	// A service task has been queued or is running.
+	PollState_Removed		// The connection has been removed from the pool.
+};
+
+
+PooledConnection::PooledConnection()
+:	max_service_time(0.0),
+	poll_state(PollState_Armed),
+	removed(false),
+	io_thread(NULL),
+	in_service(false),
+	num_service_calls(0),
+	num_messages(0),
+	max_message_time(0.0),
+	watched_service_call(0),
+	watched_bytes_transferred(0),
+	watched_service_start_time(0),
+	watched_last_progress_time(0),
+	watched_message(0),
+	watched_message_start_time(0)
+{
+}
+
+
+PooledConnection::~PooledConnection()
+{
+}
+
+
+/*=====================================================================
+ConnectionIOThread
+------------------
+Waits on the fds of a subset of the pool's connections, and dispatches service tasks for them when they are ready.
+=====================================================================*/
+class ConnectionIOThread : public MessageableThread
+{
+public:
+	ConnectionIOThread(ConnectionIOPool* pool);
+	~ConnectionIOThread();
+
+	virtual void doRun() override;
+
+	virtual void kill() override;
+
+	void registerConnection(PooledConnection* conn); // Throws glare::Exception on failure.
+	void rearmConnection(PooledConnection* conn) REQUIRES(conn->poll_mutex);
+	void deregisterConnection(PooledConnection* conn) REQUIRES(conn->poll_mutex);
+
+	// Holds a reference to the connection until the IO thread has finished processing the current batch of events,
+	// which may still refer to the connection.
+	void releaseConnection(const PooledConnectionRef& conn);
+
+private:
+	ConnectionIOPool* pool;
+	int epoll_fd;
+	EventFD wake_fd;
+	glare::AtomicInt die;
+	Timer timer; // For checking for stalled service() calls.
+
+	Mutex release_mutex;
+	std::vector<PooledConnectionRef> to_release GUARDED_BY(release_mutex);
+};
+
+
+/*=====================================================================
+ServiceConnectionTask
+---------------------
+=====================================================================*/
+class ServiceConnectionTask : public glare::Task
+{
+public:
+	ServiceConnectionTask(ConnectionIOPool* pool_, PooledConnection* conn_) : pool(pool_), conn(conn_) {}
+
+	virtual void run(size_t thread_index)
+	{
+		pool->serviceConnection(conn.ptr());
+	}
+
+	ConnectionIOPool* pool;
+	PooledConnectionRef conn;
+};
+
+
+#if !(defined(_WIN32) || defined(OSX))
+
+
+ConnectionIOThread::ConnectionIOThread(ConnectionIOPool* pool_)
+:	pool(pool_),
+	die(0)
+{
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if(epoll_fd == -1)
+		throw glare::Exception("epoll_create1 failed: " + PlatformUtils::getLastErrorString());
+
+	// The wake fd is registered with a NULL data pointer, to distinguish it from the connection fds, which have a pointer to the connection.
+	epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd.efd, &ev) != 0)
+	{
+		const std::string error_string = PlatformUtils::getLastErrorString();
+		close(epoll_fd);
+		throw glare::Exception("epoll_ctl failed: " + error_string);
+	}
+}
+
+
+ConnectionIOThread::~ConnectionIOThread()
+{
+	close(epoll_fd);
+}
+
+
+void ConnectionIOThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("ConnectionIOThread");
+
+	const int MAX_NUM_EVENTS = 256;
+	epoll_event events[MAX_NUM_EVENTS];
+	std::vector<PooledConnectionRef> temp_to_release;
+	const double STALL_CHECK_PERIOD = 1.0;
+	double last_stall_check_time = 0;
+
+	while(die == 0)
+	{
+		const double cur_time = timer.elapsed();
+		if(cur_time - last_stall_check_time >= STALL_CHECK_PERIOD)
+		{
+			pool->shutDownStalledConnections(this, cur_time);
+			last_stall_check_time = cur_time;
+		}
+
+		// Drop references to connections removed since the last batch of events was processed.
+		// Once epoll_ctl(EPOLL_CTL_DEL) has returned, no later epoll_wait will return events for the connection, so this is safe.
+		{
+			Lock lock(release_mutex);
+			temp_to_release.swap(to_release);
+		}
+		temp_to_release.clear();
+
+		const int timeout_ms = (int)((last_stall_check_time + STALL_CHECK_PERIOD - timer.elapsed()) * 1000) + 1;
+		const int num_events = epoll_wait(epoll_fd, events, MAX_NUM_EVENTS, /*timeout=*/myMax(0, timeout_ms));
+		if(num_events == -1)
+		{
+			if(errno == EINTR)
+				continue;
+			conPrint("ConnectionIOThread: epoll_wait failed: " + PlatformUtils::getLastErrorString());
+			break;
+		}
+
+		for(int i=0; i<num_events; ++i)
+		{
+			PooledConnection* conn = (PooledConnection*)events[i].data.ptr;
+			if(conn == NULL)
+			{
+				wake_fd.read(); // Woken by kill() or releaseConnection().  Reset the wake fd.
+				continue;
+			}
+
+			// The fd fired, so is disabled now due to EPOLLONESHOT.  If the connection is already being serviced, the event can be ignored,
+			// as both fds are re-armed after service() returns, and will fire again if still ready.
+			int expected = PollState_Armed;
+			if(conn->poll_state.compare_exchange_strong(expected, PollState_Dispatched))
+				pool->dispatch(conn);
+		}
+	}
+}
+
+
+void ConnectionIOThread::kill()
+{
+	die = 1;
+	wake_fd.notify();
+}
+
+
+void ConnectionIOThread::registerConnection(PooledConnection* conn)
+{
+	epoll_event ev;
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.ptr = conn;
+
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->getSocketFD(), &ev) != 0)
+		throw glare::Exception("epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn->getEventFD(), &ev) != 0)
+	{
+		const std::string error_string = PlatformUtils::getLastErrorString();
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->getSocketFD(), NULL);
+		throw glare::Exception("epoll_ctl failed: " + error_string);
+	}
+}
+
+
+void ConnectionIOThread::rearmConnection(PooledConnection* conn)
+{
+	epoll_event ev;
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.ptr = conn;
+
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->getSocketFD(), &ev) != 0)
+		conPrint("ConnectionIOThread: epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+
+	if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->getEventFD(), &ev) != 0)
+		conPrint("ConnectionIOThread: epoll_ctl failed: " + PlatformUtils::getLastErrorString());
+}
+
+
+void ConnectionIOThread::deregisterConnection(PooledConnection* conn)
+{
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->getSocketFD(), NULL);
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->getEventFD(), NULL);
+}
+
+
+void ConnectionIOThread::releaseConnection(const PooledConnectionRef& conn)
+{
+	{
+		Lock lock(release_mutex);
+		to_release.push_back(conn);
+	}
+	wake_fd.notify();
+}
+
+
+// Resets the event FD if it has been signalled.  Anything enqueued after this will signal it again.
+static void resetEventFDIfSignalled(int fd)
+{
+	pollfd poll_fd;
+	poll_fd.fd = fd;
+	poll_fd.events = POLLIN;
+	poll_fd.revents = 0;
+	if(poll(&poll_fd, 1, /*timeout=*/0) > 0)
+	{
+		uint64 val;
+		if(read(fd, &val, sizeof(val)) == -1)
+			conPrint("ConnectionIOPool: failed to read from event fd: " + PlatformUtils::getLastErrorString());
+	}
+}
+
+
+ConnectionIOPool::ConnectionIOPool(int num_io_threads, int num_worker_threads, double max_stall_time_)
+:	max_stall_time(max_stall_time_),
+	task_manager("ConnectionIOPool task manager", myMax(1, num_worker_threads)),
+	next_io_thread_index(0)
+{
+	for(int i=0; i<myMax(1, num_io_threads); ++i)
+	{
+		Reference<ConnectionIOThread> io_thread = new ConnectionIOThread(this);
+		io_threads.push_back(io_thread);
+		io_thread_manager.addThread(io_thread);
+	}
+}
+
+
+ConnectionIOPool::~ConnectionIOPool()
+{
+	io_thread_manager.killThreadsBlocking();
+
+	// Wait for any service() calls in progress.  No new tasks can be dispatched now the IO threads have stopped.
+	task_manager.waitForTasksToComplete();
+
+	std::set<PooledConnectionRef> remaining;
+	{
+		Lock lock(connections_mutex);
+		remaining.swap(connections);
+	}
+	for(auto it = remaining.begin(); it != remaining.end(); ++it)
+	{
+		PooledConnection* conn = it->ptr();
+		{
+			Lock lock(conn->poll_mutex);
+			conn->removed = true;
+			conn->poll_state = PollState_Removed;
+			conn->io_thread->deregisterConnection(conn);
+		}
+		conn->removedFromPool();
+	}
+}
+
+
+bool ConnectionIOPool::isSupported()
+{
+	return true;
+}
+
+
+void ConnectionIOPool::addConnection(const PooledConnectionRef& conn)
+{
+	ConnectionIOThread* io_thread = io_threads[next_io_thread_index++ % io_threads.size()].ptr();
+	conn->io_thread = io_thread;
+
+	// Register the fds armed, so the first service() call is made when the client sends something, rather than straight away.
+	// Otherwise a connection that never sends anything would occupy a worker, blocked reading.
+	conn->poll_state = PollState_Armed;
+
+	{
+		Lock lock(connections_mutex);
+		connections.insert(conn);
+	}
+
+	try
+	{
+		io_thread->registerConnection(conn.ptr());
+	}
+	catch(glare::Exception&)
+	{
+		Lock lock(connections_mutex);
+		connections.erase(conn);
+		throw;
+	}
+}
+
+
+void ConnectionIOPool::dispatch(PooledConnection* conn)
+{
+	task_manager.addTask(new ServiceConnectionTask(this, conn));
+}
+
+
+void ConnectionIOPool::serviceConnection(PooledConnection* conn)
+{
+	resetEventFDIfSignalled(conn->getEventFD());
+
+	conn->num_service_calls++;
+	conn->in_service = true;
+	const bool keep_connection = conn->service();
+	conn->in_service = false;
+
+	if(keep_connection)
+	{
+		rearm(conn);
+	}
+	else
+	{
+		{
+			Lock lock(conn->poll_mutex);
+			conn->removed = true;
+			conn->poll_state = PollState_Removed;
+			conn->io_thread->deregisterConnection(conn);
+		}
+
+		const PooledConnectionRef conn_ref = conn;
+		{
+			Lock lock(connections_mutex);
+			connections.erase(conn_ref);
+		}
+
+		conn->removedFromPool();
+
+		conn->io_thread->releaseConnection(conn_ref);
+	}
+}
+
+
+void ConnectionIOPool::rearm(PooledConnection* conn)
+{
+	Lock lock(conn->poll_mutex);
+	if(conn->removed)
+		return;
+
+	// Set the state before re-arming, so that an event straight after re-arming is not ignored.
+	conn->poll_state = PollState_Armed;
+	conn->io_thread->rearmConnection(conn);
+}
+
+
+// Returns the number of bytes received on the socket plus the number of sent bytes acknowledged by the peer.
+// Returns 0 if not available, for example if the socket is not a TCP socket.
+static uint64 getNumBytesTransferred(int socket_fd)
+{
+	tcp_info info;
+	socklen_t len = sizeof(info);
+	if(getsockopt(socket_fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0 || (len < offsetof(tcp_info, tcpi_bytes_received) + sizeof(info.tcpi_bytes_received)))
+		return 0;
+	return info.tcpi_bytes_acked + info.tcpi_bytes_received;
+}
+
+
+void ConnectionIOPool::shutDownStalledConnections(ConnectionIOThread* io_thread, double cur_time)
+{
+	// Connections are removed from the connections set before removedFromPool() is called, which may close the socket, so holding connections_mutex
+	// means the socket fds of the connections in the set are still open.
+	Lock lock(connections_mutex);
+	for(auto it = connections.begin(); it != connections.end(); ++it)
+	{
+		PooledConnection* conn = it->ptr();
+		if(conn->io_thread != io_thread || !conn->in_service)
+			continue;
+
+		const uint64 service_call = conn->num_service_calls;
+		const uint64 bytes_transferred = getNumBytesTransferred(conn->getSocketFD());
+		if(service_call != conn->watched_service_call)
+		{
+			// This is a service() call we haven't seen before.
+			conn->watched_service_call = service_call;
+			conn->watched_bytes_transferred = bytes_transferred;
+			conn->watched_service_start_time = cur_time;
+			conn->watched_last_progress_time = cur_time;
+		}
+		else if(bytes_transferred != conn->watched_bytes_transferred)
+		{
+			conn->watched_bytes_transferred = bytes_transferred;
+			conn->watched_last_progress_time = cur_time;
+		}
+
+		const uint64 message = conn->num_messages;
+		if(message != conn->watched_message)
+		{
+			conn->watched_message = message;
+			conn->watched_message_start_time = cur_time;
+		}
+
+		const double max_service_time = conn->max_service_time;
+		const double max_message_time = conn->max_message_time;
+		const bool stalled = cur_time - conn->watched_last_progress_time > max_stall_time;
+		const bool took_too_long = (max_service_time > 0) && (cur_time - conn->watched_service_start_time > max_service_time);
+		const bool message_took_too_long = (max_message_time > 0) && (cur_time - conn->watched_message_start_time > max_message_time);
+		if(stalled || took_too_long || message_took_too_long)
+		{
+			const std::string reason = stalled ? "no data sent or received" : (took_too_long ? "service() call taking too long" : "message taking too long");
+			const double start_time = stalled ? conn->watched_last_progress_time : (took_too_long ? conn->watched_service_start_time : conn->watched_message_start_time);
+			conPrint("ConnectionIOPool: " + reason + " for " + doubleToStringNSigFigs(cur_time - start_time, 3) + " s, shutting down socket.");
+
+			shutdown(conn->getSocketFD(), SHUT_RDWR); // Makes the blocked reads and writes return errors.
+
+			conn->watched_last_progress_time = conn->watched_service_start_time = conn->watched_message_start_time = cur_time; // Avoid printing again each check while service() returns.
+		}
+	}
+}
+
+
+#else // else if defined(_WIN32) || defined(OSX):
+
+
+ConnectionIOThread::ConnectionIOThread(ConnectionIOPool* pool_) : pool(pool_), epoll_fd(-1), die(0) {}
+ConnectionIOThread::~ConnectionIOThread() {}
+void ConnectionIOThread::doRun() {}
+void ConnectionIOThread::kill() {}
+void ConnectionIOThread::registerConnection(PooledConnection* conn) {}
+void ConnectionIOThread::rearmConnection(PooledConnection* conn) {}
+void ConnectionIOThread::deregisterConnection(PooledConnection* conn) {}
+void ConnectionIOThread::releaseConnection(const PooledConnectionRef& conn) {}
+
+
+ConnectionIOPool::ConnectionIOPool(int num_io_threads, int num_worker_threads, double max_stall_time_)
+:	max_stall_time(max_stall_time_),
+	task_manager("ConnectionIOPool task manager", 1),
+	next_io_thread_index(0)
+{
+	throw glare::Exception("ConnectionIOPool is not supported on this platform.");
+}
+
+ConnectionIOPool::~ConnectionIOPool() {}
+bool ConnectionIOPool::isSupported() { return false; }
+void ConnectionIOPool::addConnection(const PooledConnectionRef& conn) {}
+void ConnectionIOPool::dispatch(PooledConnection* conn) {}
+void ConnectionIOPool::serviceConnection(PooledConnection* conn) {}
+void ConnectionIOPool::rearm(PooledConnection* conn) {}
+void ConnectionIOPool::shutDownStalledConnections(ConnectionIOThread* io_thread, double cur_time) {}
+
+
+#endif // end if !(defined(_WIN32) || defined(OSX))
+
+
+void ConnectionIOPool::getConnections(std::vector<PooledConnectionRef>& connections_out) const
+{
+	Lock lock(connections_mutex);
+	connections_out.assign(connections.begin(), connections.end());
+}
+
+
+size_t ConnectionIOPool::getNumConnections() const
+{
+	Lock lock(connections_mutex);
+	return connections.size();
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/Timer.h>
+#include <MySocket.h>
+
+
+#if !(defined(_WIN32) || defined(OSX))
+
+
+#include <sys/resource.h>
+#include <time.h>
+#include <fstream>
+#include <ctime>
+#include <cstring>
+
+
+static const int TEST_PORT = 7612;
+static const size_t ECHO_MSG_SIZE = 16; // Send time (double) + sequence number (uint64)
+
+
+// Echoes fixed-size messages back to the client, on a ConnectionIOPool.
+// Also sends values enqueued by other threads, to test the event FD path, and checks service() is never called concurrently.
+class EchoPooledConnection : public PooledConnection
+{
+public:
+	EchoPooledConnection(MySocketRef socket_, double max_service_time_ = 0, double max_message_time_ = 0) : socket(socket_), max_msg_time(max_message_time_), num_in_service(0), service_overlapped(false), num_service_calls(0)
+	{
+		max_service_time = max_service_time_;
+	}
+
+	virtual bool service() override
+	{
+		if(num_in_service++ != 0)
+			service_overlapped = true;
+		num_service_calls++;
+
+		bool keep_connection = true;
+		try
+		{
+			std::vector<uint64> to_send;
+			{
+				Lock lock(mutex);
+				to_send.swap(values_to_send);
+			}
+			for(size_t i=0; i<to_send.size(); ++i)
+				socket->writeUInt64(to_send[i]);
+
+			uint8 buf[ECHO_MSG_SIZE];
+			for(int i=0; (i < 16) && socket->readable(0.0); ++i) // Handle at most 16 messages per call, so the rest are handled after re-arming.
+			{
+				if(max_msg_time > 0)
+					beginMessage(max_msg_time);
+				socket->readData(buf, ECHO_MSG_SIZE);
+				socket->writeData(buf, ECHO_MSG_SIZE);
+				endMessage();
+			}
+		}
+		catch(MySocketExcep&)
+		{
+			keep_connection = false;
+		}
+
+		num_in_service--;
+		return keep_connection;
+	}
+
+	virtual void removedFromPool() override
+	{
+		socket = NULL;
+	}
+
+	virtual int getSocketFD() override { return (int)socket->getSocketHandle(); }
+	virtual int getEventFD() override { return event_fd.efd; }
+
+	void enqueueValue(uint64 x)
+	{
+		{
+			Lock lock(mutex);
+			values_to_send.push_back(x);
+		}
+		event_fd.notify();
+	}
+
+	MySocketRef socket;
+	double max_msg_time; // If non-zero, each echoed message is bracketed with beginMessage() and endMessage().
+	EventFD event_fd;
+	Mutex mutex;
+	std::vector<uint64> values_to_send GUARDED_BY(mutex);
+	std::atomic<int> num_in_service;
+	std::atomic<bool> service_overlapped;
+	std::atomic<int> num_service_calls;
+};
+
+
+// Echoes fixed-size messages back to the client on its own thread, waiting on the socket and event FD like WorkerThread::doRun().
+class EchoThread : public MessageableThread
+{
+public:
+	EchoThread(MySocketRef socket_) : socket(socket_), die(0) {}
+
+	virtual void doRun() override
+	{
+		try
+		{
+			uint8 buf[ECHO_MSG_SIZE];
+			while(die == 0)
+			{
+				if(socket->readable(event_fd))
+				{
+					socket->readData(buf, ECHO_MSG_SIZE);
+					socket->writeData(buf, ECHO_MSG_SIZE);
+				}
+				else
+					event_fd.read();
+			}
+		}
+		catch(MySocketExcep&)
+		{}
+		socket = NULL;
+	}
+
+	virtual void kill() override
+	{
+		die = 1;
+		event_fd.notify();
+	}
+
+	MySocketRef socket;
+	EventFD event_fd;
+	glare::AtomicInt die;
+};
+
+
+struct ProcessStats
+{
+	uint64 rss; // Resident set size, in bytes.
+	uint64 vm_size; // Virtual memory size, in bytes.  Includes reserved thread stacks.
+	int num_threads;
+};
+
+
+static ProcessStats getProcessStats()
+{
+	ProcessStats stats;
+	stats.rss = stats.vm_size = 0;
+	stats.num_threads = 0;
+
+	std::ifstream file("/proc/self/status");
+	std::string line;
+	while(std::getline(file, line))
+	{
+		if(hasPrefix(line, "VmRSS:"))
+			stats.rss = stringToUInt64(stripWhitespace(eatSuffix(line.substr(6), "kB"))) * 1024;
+		else if(hasPrefix(line, "VmSize:"))
+			stats.vm_size = stringToUInt64(stripWhitespace(eatSuffix(line.substr(7), "kB"))) * 1024;
+		else if(hasPrefix(line, "Threads:"))
+			stats.num_threads = stringToInt(stripWhitespace(line.substr(8)));
+	}
+	return stats;
+}
+
+
+static double getThreadCPUTime()
+{
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec * 1.0e-9;
+}
+
+
+// Each connection uses two sockets (the client and server ends) and an event FD.
+// Returns the max number of connections the fd limit allows, after trying to raise it.
+static int getMaxNumConnections(int num_connections_wanted)
+{
+	const rlim_t fds_wanted = (rlim_t)num_connections_wanted * 3 + 256;
+
+	rlimit limit;
+	if(getrlimit(RLIMIT_NOFILE, &limit) != 0)
+		return num_connections_wanted;
+	if(limit.rlim_cur < fds_wanted)
+	{
+		limit.rlim_cur = myMin(fds_wanted, limit.rlim_max);
+		setrlimit(RLIMIT_NOFILE, &limit);
+		getrlimit(RLIMIT_NOFILE, &limit);
+	}
+	return (int)myMin<rlim_t>(num_connections_wanted, (limit.rlim_cur - myMin<rlim_t>(limit.rlim_cur, 256)) / 3);
+}
+
+
+static uint64 increase(uint64 before, uint64 after) { return (after > before) ? (after - before) : 0; }
+
+
+// Makes num_idle idle and num_active active loopback connections, served either by a thread per connection or by a ConnectionIOPool.
+// Each active client sends a message every 100 ms, like a client sending avatar updates, and waits for the echo.
+// Reports the thread count, memory use, and the server's CPU time over the measurement period.
+static void doBenchmark(bool use_pool, int num_idle, int num_active, double measure_period)
+{
+	MySocketRef listener = new MySocket();
+	listener->bindAndListen(TEST_PORT, /*reuse address=*/true);
+
+	const ProcessStats stats_before = getProcessStats();
+
+	Reference<ConnectionIOPool> pool;
+	ThreadManager thread_manager;
+	if(use_pool)
+		pool = new ConnectionIOPool(/*num io threads=*/2, /*num worker threads=*/8, /*max stall time=*/30.0);
+
+	const int num_connections = num_idle + num_active;
+	std::vector<MySocketRef> clients;
+	for(int i=0; i<num_connections; ++i)
+	{
+		MySocketRef client = new MySocket("127.0.0.1", TEST_PORT);
+		MySocketRef server_socket = listener->acceptConnection();
+		if(use_pool)
+			pool->addConnection(new EchoPooledConnection(server_socket));
+		else
+			thread_manager.addThread(new EchoThread(server_socket));
+		clients.push_back(client);
+	}
+
+	PlatformUtils::Sleep(200); // Let the connections settle.
+
+	// Drive the active clients from this thread.
+	std::vector<pollfd> poll_fds(num_active);
+	for(int i=0; i<num_active; ++i)
+	{
+		poll_fds[i].fd = (int)clients[num_idle + i]->getSocketHandle();
+		poll_fds[i].events = POLLIN;
+	}
+
+	const double send_period = 0.1;
+	uint64 num_msgs_sent = 0;
+	uint64 num_replies = 0;
+	double sum_round_trip_time = 0;
+	double max_round_trip_time = 0;
+
+	Timer timer;
+	const std::clock_t process_cpu_start = std::clock();
+	const double driver_cpu_start = getThreadCPUTime();
+	double next_send_time = 0;
+	while(timer.elapsed() < measure_period)
+	{
+		if(timer.elapsed() >= next_send_time)
+		{
+			for(int i=0; i<num_active; ++i)
+			{
+				uint8 msg[ECHO_MSG_SIZE];
+				const double send_time = timer.elapsed();
+				std::memcpy(msg, &send_time, sizeof(double));
+				std::memcpy(msg + 8, &num_msgs_sent, sizeof(uint64));
+				clients[num_idle + i]->writeData(msg, ECHO_MSG_SIZE);
+				num_msgs_sent++;
+			}
+			next_send_time += send_period;
+		}
+
+		const int timeout_ms = myMax(0, (int)((next_send_time - timer.elapsed()) * 1000));
+		if(poll(poll_fds.data(), (nfds_t)poll_fds.size(), timeout_ms) > 0)
+		{
+			for(int i=0; i<num_active; ++i)
+				if(poll_fds[i].revents & POLLIN)
+				{
+					uint8 msg[ECHO_MSG_SIZE];
+					clients[num_idle + i]->readData(msg, ECHO_MSG_SIZE);
+					double send_time;
+					std::memcpy(&send_time, msg, sizeof(double));
+					const double round_trip_time = timer.elapsed() - send_time;
+					sum_round_trip_time += round_trip_time;
+					max_round_trip_time = myMax(max_round_trip_time, round_trip_time);
+					num_replies++;
+				}
+		}
+	}
+	const double elapsed = timer.elapsed();
+	const double process_cpu_time = (double)(std::clock() - process_cpu_start) / CLOCKS_PER_SEC;
+	const double driver_cpu_time = getThreadCPUTime() - driver_cpu_start;
+
+	const ProcessStats stats_during = getProcessStats();
+
+	testAssert(num_replies > 0);
+
+	// Closing the client sockets ends the server side of the connections.
+	clients.clear();
+	if(use_pool)
+	{
+		for(int i=0; (i < 1000) && (pool->getNumConnections() > 0); ++i)
+			PlatformUtils::Sleep(10);
+		testAssert(pool->getNumConnections() == 0);
+		pool = NULL;
+	}
+	thread_manager.killThreadsBlocking();
+
+	const uint64 rss_increase = increase(stats_before.rss, stats_during.rss);
+	conPrint("ConnectionIOPool benchmark (" + std::string(use_pool ? "ConnectionIOPool" : "thread per connection") + "): " + toString(num_idle) + " idle + " + toString(num_active) + " active connections");
+	conPrint("    threads: " + toString(stats_during.num_threads - stats_before.num_threads) + ", RSS: " + getNiceByteSize(rss_increase) + " (" + toString(rss_increase / myMax(1, num_connections)) + " B / connection)" +
+		", virtual: " + getNiceByteSize(increase(stats_before.vm_size, stats_during.vm_size)));
+	conPrint("    server CPU: " + doubleToStringNSigFigs((process_cpu_time - driver_cpu_time) / elapsed * 100, 3) + "% of a core (whole process: " + doubleToStringNSigFigs(process_cpu_time / elapsed * 100, 3) +
+		"%, client driver: " + doubleToStringNSigFigs(driver_cpu_time / elapsed * 100, 3) + "%)");
+	conPrint("    " + toString(num_replies) + " / " + toString(num_msgs_sent) + " messages echoed, mean round trip: " + doubleToStringNSigFigs(sum_round_trip_time / myMax<uint64>(1, num_replies) * 1.0e3, 3) +
+		" ms, max: " + doubleToStringNSigFigs(max_round_trip_time * 1.0e3, 3) + " ms");
+}
+
+
+void ConnectionIOPool::test()
+{
+	conPrint("ConnectionIOPool::test()");
+
+	try
+	{
+		//-------------------- Test echoing, sends triggered by the event FD, and removal when the client closes the connection --------------------
+		{
+			MySocketRef listener = new MySocket();
+			listener->bindAndListen(TEST_PORT, /*reuse address=*/true);
+
+			Reference<ConnectionIOPool> pool = new ConnectionIOPool(/*num io threads=*/2, /*num worker threads=*/4, /*max stall time=*/30.0);
+
+			const int N = 20;
+			const int MSGS_PER_BURST = 40; // More than are handled in one service() call.
+			std::vector<MySocketRef> clients;
+			std::vector<Reference<EchoPooledConnection>> conns;
+			for(int i=0; i<N; ++i)
+			{
+				clients.push_back(new MySocket("127.0.0.1", TEST_PORT));
+				clients.back()->setUseNetworkByteOrder(false);
+				MySocketRef server_socket = listener->acceptConnection();
+				server_socket->setUseNetworkByteOrder(false);
+				conns.push_back(new EchoPooledConnection(server_socket));
+				pool->addConnection(conns.back());
+			}
+			testAssert(pool->getNumConnections() == N);
+
+			for(int z=0; z<100; ++z)
+			{
+				for(int i=0; i<N; ++i)
+				{
+					for(int q=0; q<MSGS_PER_BURST; ++q)
+					{
+						uint8 msg[ECHO_MSG_SIZE];
+						const uint64 val = (uint64)z * 1000 + q;
+						std::memset(msg, 0, ECHO_MSG_SIZE);
+						std::memcpy(msg + 8, &val, sizeof(uint64));
+						clients[i]->writeData(msg, ECHO_MSG_SIZE);
+					}
+					conns[i]->enqueueValue((uint64)z + 1);
+				}
+
+				// Check the replies.  Echoed messages start with 8 zero bytes, enqueued values are non-zero.
+				// The enqueued value may arrive before, between or after the echoes, but the echoes must be in order.
+				for(int i=0; i<N; ++i)
+				{
+					bool got_enqueued_value = false;
+					int q = 0;
+					while(q < MSGS_PER_BURST || !got_enqueued_value)
+					{
+						const uint64 first = clients[i]->readUInt64();
+						if(first == 0)
+						{
+							testAssert(clients[i]->readUInt64() == (uint64)z * 1000 + q);
+							q++;
+						}
+						else
+						{
+							testAssert(!got_enqueued_value && first == (uint64)z + 1);
+							got_enqueued_value = true;
+						}
+					}
+				}
+			}
+
+			for(int i=0; i<N; ++i)
+				testAssert(!conns[i]->service_overlapped);
+
+			// Close the clients.  The connections should be removed from the pool.
+			clients.clear();
+			for(int i=0; (i < 500) && (pool->getNumConnections() > 0); ++i)
+				PlatformUtils::Sleep(10);
+			testAssert(pool->getNumConnections() == 0);
+			for(int i=0; i<N; ++i)
+				testAssert(conns[i]->socket.isNull()); // removedFromPool() should have been called.
+		}
+
+		//-------------------- Test that connections are only serviced once they send something, and that stalled peers don't hold on to a worker --------------------
+		{
+			MySocketRef listener = new MySocket();
+			listener->bindAndListen(TEST_PORT, /*reuse address=*/true);
+
+			// Use a single worker, so a service() call that never returned would stop all the other connections being serviced.
+			Reference<ConnectionIOPool> pool = new ConnectionIOPool(/*num io threads=*/1, /*num worker threads=*/1, /*max stall time=*/1.0);
+
+			// A client that connects but sends nothing.
+			MySocketRef idle_client = new MySocket("127.0.0.1", TEST_PORT);
+			Reference<EchoPooledConnection> idle_conn = new EchoPooledConnection(listener->acceptConnection());
+			pool->addConnection(idle_conn);
+
+			// A client that sends half a message and then stalls.  service() will block reading the rest of the message, until the pool shuts down the socket.
+			MySocketRef stalled_client = new MySocket("127.0.0.1", TEST_PORT);
+			Reference<EchoPooledConnection> stalled_conn = new EchoPooledConnection(listener->acceptConnection());
+			pool->addConnection(stalled_conn);
+
+			uint8 msg[ECHO_MSG_SIZE];
+			std::memset(msg, 0, ECHO_MSG_SIZE);
+			stalled_client->writeData(msg, ECHO_MSG_SIZE / 2);
+
+			// A normal client, which sends a message while the worker is blocked servicing the stalled connection.
+			MySocketRef client = new MySocket("127.0.0.1", TEST_PORT);
+			Reference<EchoPooledConnection> conn = new EchoPooledConnection(listener->acceptConnection());
+			pool->addConnection(conn);
+			PlatformUtils::Sleep(100);
+			client->writeData(msg, ECHO_MSG_SIZE);
+
+			Timer timer;
+			uint8 reply[ECHO_MSG_SIZE];
+			client->readData(reply, ECHO_MSG_SIZE); // Will arrive once the stalled connection's socket has been shut down.
+			testAssert(timer.elapsed() >= 1.0);
+			testAssert(std::memcmp(reply, msg, ECHO_MSG_SIZE) == 0);
+
+			for(int i=0; (i < 500) && !stalled_conn->socket.isNull(); ++i)
+				PlatformUtils::Sleep(10);
+			testAssert(stalled_conn->socket.isNull()); // Stalled connection should have been removed.
+
+			testAssert(idle_conn->num_service_calls == 0);
+			testAssert(pool->getNumConnections() == 2);
+
+			// A client that keeps sending a byte at a time, so isn't stalled, on a connection with a max service time.
+			MySocketRef slow_client = new MySocket("127.0.0.1", TEST_PORT);
+			Reference<EchoPooledConnection> slow_conn = new EchoPooledConnection(listener->acceptConnection(), /*max service time=*/1.0);
+			pool->addConnection(slow_conn);
+			try
+			{
+				for(size_t i=0; (i < ECHO_MSG_SIZE - 1) && !slow_conn->socket.isNull(); ++i)
+				{
+					slow_client->writeData(msg, 1);
+					PlatformUtils::Sleep(300);
+				}
+			}
+			catch(MySocketExcep&)
+			{} // Writing may fail once the server end has been shut down.
+
+			for(int i=0; (i < 500) && !slow_conn->socket.isNull(); ++i)
+				PlatformUtils::Sleep(10);
+			testAssert(slow_conn->socket.isNull());
+			testAssert(pool->getNumConnections() == 2);
+
+			// A client that trickles a message a byte at a time, on a connection with a per-message deadline but no max service time.
+			// The stall check alone would never fire, but the message deadline should.
+			MySocketRef trickling_client = new MySocket("127.0.0.1", TEST_PORT);
+			Reference<EchoPooledConnection> trickling_conn = new EchoPooledConnection(listener->acceptConnection(), /*max service time=*/0, /*max message time=*/1.0);
+			pool->addConnection(trickling_conn);
+			Timer trickle_timer;
+			try
+			{
+				for(size_t i=0; (i < ECHO_MSG_SIZE - 1) && !trickling_conn->socket.isNull(); ++i)
+				{
+					trickling_client->writeData(msg, 1);
+					PlatformUtils::Sleep(300);
+				}
+			}
+			catch(MySocketExcep&)
+			{} // Writing may fail once the server end has been shut down.
+
+			for(int i=0; (i < 500) && !trickling_conn->socket.isNull(); ++i)
+				PlatformUtils::Sleep(10);
+			testAssert(trickling_conn->socket.isNull());
+			testAssert(trickle_timer.elapsed() >= 1.0);
+			testAssert(pool->getNumConnections() == 2);
+		}
+
+		//-------------------- Benchmark a thread per connection against the pool --------------------
+		// Performance test.  Makes thousands of connections, and raises the process fd limit to allow them.
+		if(false)
+		{
+			int num_idle = 5000;
+			int num_active = 1000;
+			const int max_num_connections = getMaxNumConnections(num_idle + num_active);
+			if(max_num_connections < num_idle + num_active)
+			{
+				conPrint("File descriptor limit only allows " + toString(max_num_connections) + " connections, scaling down the benchmark.");
+				const int total = num_idle + num_active;
+				num_idle   = (int)((int64)num_idle   * max_num_connections / total);
+				num_active = (int)((int64)num_active * max_num_connections / total);
+			}
+
+			// Do the pool first, as the memory freed after the thread per connection run would make the pool's memory increase look smaller.
+			doBenchmark(/*use pool=*/true,  num_idle, num_active, /*measure period=*/5.0);
+			doBenchmark(/*use pool=*/false, num_idle, num_active, /*measure period=*/5.0);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(MySocketExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ConnectionIOPool::test() done.");
+}
+
+
+#else // else if defined(_WIN32) || defined(OSX):
+
+
+void ConnectionIOPool::test()
+{
+	conPrint("ConnectionIOPool::test(): not supported on this platform, skipping.");
+}
+
+
+#endif // end if !(defined(_WIN32) || defined(OSX))
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,137 @@
+/*=====================================================================
+ConnectionIOPool.h
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <ThreadManager.h>
+#include <TaskManager.h>
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Mutex.h>
+#include <Platform.h>
+#include <atomic>
+#include <set>
+#include <vector>
+class ConnectionIOThread;
+
+
+/*=====================================================================
+PooledConnection
+----------------
+A connection serviced by a ConnectionIOPool.
+=====================================================================*/
+class PooledConnection : public ThreadSafeRefCounted
+{
+public:
+	PooledConnection();
+	virtual ~PooledConnection();
+
+	// Called on a pool worker thread whenever the socket becomes readable or the event FD is signalled, starting with the first data received after the connection is added.
+	// Never called concurrently for the same connection.
+	// Should handle the data that is already available, and return, instead of waiting for more.
+	// Should not throw.  Return false to remove the connection from the pool.
+	virtual bool service() = 0;
+
+	// Called on a pool worker thread once, after service() has returned false, when the socket and event FD are no longer being polled.
+	// Also called, on the destroying thread, for the connections still in the pool when it is destroyed.
+	virtual void removedFromPool() = 0;
+
+	virtual int getSocketFD() = 0; // Must stay open until removedFromPool() is called.
+	virtual int getEventFD() = 0; // Signalled by other threads when there is data to send.  The pool resets it before calling service().
+
+protected:
+	// If non-zero, the socket is shut down if a service() call takes longer than this many seconds, even if data is still being sent or received.
+	// May be changed by service(), for example to bound the time allowed for a handshake.  Zero by default.
+	std::atomic<double> max_service_time;
+
+	// Called by service() around reading and handling a single message, or writing a single batch of data.
+	// If endMessage() hasn't been called max_time seconds after beginMessage(), the socket is shut down, even if data is still trickling in or out,
+	// so a peer that sends or reads a byte at a time can only hold on to a worker for max_time per message.
+	void beginMessage(double max_time) { num_messages++; max_message_time = max_time; }
+	void endMessage() { max_message_time = 0.0; }
+
+private:
+	friend class ConnectionIOPool;
+	friend class ConnectionIOThread;
+
+	std::atomic<int> poll_state; // PollState in ConnectionIOPool.cpp.  Ensures only one service() call is in flight at a time.
+	Mutex poll_mutex; // Protects re-arming the fds against removal from the pool.
+	bool removed GUARDED_BY(poll_mutex);
+	ConnectionIOThread* io_thread; // The IO thread polling this connection.
+
+	std::atomic<bool> in_service; // Is a service() call running?
+	std::atomic<uint64> num_service_calls; // Incremented when each service() call starts.
+	std::atomic<uint64> num_messages; // Incremented by beginMessage().
+	std::atomic<double> max_message_time; // Set by beginMessage(), zero if no message is in progress.
+
+	// Used by io_thread to detect stalled service() calls.  Only accessed by io_thread.
+	uint64 watched_service_call; // Value of num_service_calls when last checked.
+	uint64 watched_bytes_transferred; // Bytes transferred on the socket when last checked.
+	double watched_service_start_time; // When the watched service() call was first seen.
+	double watched_last_progress_time; // When data was last seen to be sent or received during the watched service() call.
+	uint64 watched_message; // Value of num_messages when last checked.
+	double watched_message_start_time; // When the watched message was first seen.
+};
+typedef Reference<PooledConnection> PooledConnectionRef;
+
+
+/*=====================================================================
+ConnectionIOPool
+----------------
+Services many mostly-idle connections with a small fixed number of threads, instead of one thread per connection.
+
+A few IO threads wait with epoll on the sockets and event FDs of all the connections.  When a connection
+becomes readable or its event FD is signalled, a task is added to the worker task manager, which calls service()
+on the connection.  The fds are registered with EPOLLONESHOT and re-armed after service() returns,
+so each connection is serviced by at most one worker at a time, and its messages are handled in order.
+
+A connection is only serviced once there is something to do, so connections that are open but send nothing don't occupy a worker.
+
+Note that service() may block reading the rest of a partially received message, or writing to a client that is not reading,
+which will occupy a worker until it completes, so there should be enough workers to cover a few slow clients.
+So that a stalled or deliberately slow peer can't hold on to a worker, each IO thread checks the service() calls in progress
+for its connections about once a second.  If no data has been sent or received on the socket for max_stall_time seconds,
+the call has taken longer than the connection's max_service_time, or the message in progress has taken longer than the
+time given to beginMessage(), the socket is shut down, which makes the blocking reads and writes fail, so service() returns.
+
+Only supported on Linux, where epoll and EventFD are available.
+=====================================================================*/
+class ConnectionIOPool : public ThreadSafeRefCounted
+{
+public:
+	// Throws glare::Exception if not supported on this platform, or if creating the epoll instances fails.
+	ConnectionIOPool(int num_io_threads, int num_worker_threads, double max_stall_time);
+	~ConnectionIOPool(); // Stops the IO threads, waits for service() calls in progress, then calls removedFromPool() on the connections still in the pool.
+
+	static bool isSupported();
+
+	// Adds the connection to the pool.  service() will be called once the socket is readable, or the event FD is signalled.  threadsafe.
+	void addConnection(const PooledConnectionRef& conn);
+
+	void getConnections(std::vector<PooledConnectionRef>& connections_out) const; // threadsafe
+	size_t getNumConnections() const; // threadsafe
+
+	static void test();
+
+private:
+	friend class ConnectionIOThread;
+	friend class ServiceConnectionTask;
+
+	void dispatch(PooledConnection* conn); // Called by the IO threads
+	void serviceConnection(PooledConnection* conn); // Called by the service tasks
+	void rearm(PooledConnection* conn);
+	void shutDownStalledConnections(ConnectionIOThread* io_thread, double cur_time); // Called by the IO threads about once a second.
+
+	double max_stall_time;
+
+	glare::TaskManager task_manager;
+	ThreadManager io_thread_manager;
+	std::vector<Reference<ConnectionIOThread>> io_threads;
+	std::atomic<uint32> next_io_thread_index;
+
+	mutable Mutex connections_mutex;
+	std::set<PooledConnectionRef> connections GUARDED_BY(connections_mutex);
+};
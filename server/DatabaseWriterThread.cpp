@@ -0,0 +1,59 @@
+/*=====================================================================
+DatabaseWriterThread.cpp
+------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "DatabaseWriterThread.h"
+
+
+#include "ServerWorldState.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <PlatformUtils.h>
+#include <KillThreadMessage.h>
+
+
+DatabaseWriterThread::DatabaseWriterThread(ServerAllWorldsState* world_state_)
+:	world_state(world_state_)
+{
+}
+
+
+DatabaseWriterThread::~DatabaseWriterThread()
+{
+}
+
+
+void DatabaseWriterThread::doRun()
+{
+	PlatformUtils::setCurrentThreadName("DatabaseWriterThread");
+
+	while(1)
+	{
+		// Block until we have a message
+		ThreadMessageRef msg;
+		getMessageQueue().dequeue(msg);
+
+		if(dynamic_cast<WriteCheckpointMessage*>(msg.ptr()))
+		{
+			const WriteCheckpointMessage* write_msg = static_cast<WriteCheckpointMessage*>(msg.ptr());
+
+			try
+			{
+				world_state->writeCheckpoint(*write_msg->checkpoint);
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("DatabaseWriterThread: Warning: writing checkpoint failed: " + e.what());
+
+				world_state->checkpointWriteFailed(*write_msg->checkpoint);
+			}
+
+			world_state->checkpoint_in_progress = false;
+		}
+		else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,41 @@
+/*=====================================================================
+DatabaseWriterThread.h
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <MessageableThread.h>
+#include <Reference.h>
+class ServerAllWorldsState;
+class DatabaseCheckpoint;
+
+
+class WriteCheckpointMessage : public ThreadMessage
+{
+public:
+	Reference<DatabaseCheckpoint> checkpoint;
+};
+
+
+/*=====================================================================
+DatabaseWriterThread
+--------------------
+Writes checkpoints captured by the main server thread to the database, and flushes
+the database to disk, so that the world state mutexes don't need to be held while doing so.
+
+Clears ServerAllWorldsState::checkpoint_in_progress after each checkpoint is written.
+=====================================================================*/
+class DatabaseWriterThread : public MessageableThread
+{
+public:
+	DatabaseWriterThread(ServerAllWorldsState* world_state);
+
+	virtual ~DatabaseWriterThread();
+
+	virtual void doRun();
+
+private:
+	ServerAllWorldsState* world_state;
+};
@@ -197,14 +197,24 @@ static void checkDynamicTexture(const ObWithDynamicTexture& ob_with_dyn_tex, Ser
 	}
 	else
 	{
+		// Look up the world the object is in
+		Reference<ServerWorldState> world;
 		{
 			Lock lock(world_state->mutex);
+			const auto world_res = world_state->world_states.find(ob_with_dyn_tex.world_name);
+			if(world_res != world_state->world_states.end())
+				world = world_res->second;
+		}
+
+		if(world.nonNull())
+		{
+			Lock lock(world->mutex);
 
 			const std::string substrata_URL = fetch_results.substrata_URL;
 
 			// Update object to use new texture
-			const auto ob_res = world_state->world_states[ob_with_dyn_tex.world_name]->objects.find(ob_with_dyn_tex.ob_uid);
-			if(ob_res != world_state->world_states[ob_with_dyn_tex.world_name]->objects.end())
+			const auto ob_res = world->objects.find(ob_with_dyn_tex.ob_uid);
+			if(ob_res != world->objects.end())
 			{
 				WorldObject* ob = ob_res->second.ptr();
 
@@ -236,11 +246,12 @@ static void checkDynamicTexture(const ObWithDynamicTexture& ob_with_dyn_tex, Ser
 					{
 						conPrint("\tDynamicTextureUpdaterThread: Texture is different from existing texture, updating object...");
 
-						world_state->world_states[ob_with_dyn_tex.world_name]->addWorldObjectAsDBDirty(ob);
+						world->addWorldObjectAsDBDirty(ob);
 						world_state->markAsChanged();
 
 						ob->from_remote_other_dirty = true; // Set this so a ObjectFullUpdate message is sent to clients.
-						world_state->world_states[ob_with_dyn_tex.world_name]->dirty_from_remote_objects.insert(ob);
+						world->dirty_from_remote_objects.insert(ob);
+						server->notifyUpdatesPending();
 
 						// Send a message to MeshLODGenThread to generate LOD textures for this new texture (if not already generated)
 						CheckGenResourcesForObject* msg = new CheckGenResourcesForObject();
@@ -300,6 +311,7 @@ void DynamicTextureUpdaterThread::doRun()
 				for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
 				{
 					ServerWorldState* world = world_it->second.ptr();
+					Lock world_lock(world->mutex);
 					for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
 					{
 						WorldObject* ob = it->second.ptr();
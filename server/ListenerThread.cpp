@@ -96,13 +96,16 @@ void ListenerThread::doRun()
 					use_socket = worker_tls_socket; // use_socket will be a TLS socket after this.
 				}
 			
-				// Handle the connection in a worker thread.
 				Reference<WorkerThread> worker_thread = new WorkerThread(
 					use_socket,
 					server
 				);
 
-				server->worker_thread_manager.addThread(worker_thread);
+				// Handle the connection on the connection IO pool if there is one, otherwise in a worker thread.
+				if(server->connection_io_pool.nonNull())
+					server->connection_io_pool->addConnection(new WorkerThreadPooledConnection(worker_thread, (int)plain_worker_sock->getSocketHandle()));
+				else
+					server->worker_thread_manager.addThread(worker_thread);
 			}
 			catch(glare::Exception& e)
 			{
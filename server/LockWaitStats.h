@@ -0,0 +1,102 @@
+/*=====================================================================
+LockWaitStats.h
+---------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Mutex.h>
+#include <Timer.h>
+#include <Platform.h>
+#include <StringUtils.h>
+#include <atomic>
+#include <string>
+
+
+/*=====================================================================
+LockWaitStats
+-------------
+Accumulated time spent waiting to acquire a mutex, for measuring lock contention.
+Updated by TimedLock.  Threadsafe.
+=====================================================================*/
+class LockWaitStats
+{
+public:
+	LockWaitStats() : num_acquisitions(0), total_wait_ns(0), max_wait_ns(0) {}
+
+	void addWait(uint64 wait_ns)
+	{
+		num_acquisitions++;
+		total_wait_ns += wait_ns;
+
+		uint64 cur_max = max_wait_ns;
+		while(wait_ns > cur_max && !max_wait_ns.compare_exchange_weak(cur_max, wait_ns))
+		{}
+	}
+
+	struct Snapshot
+	{
+		Snapshot() : num_acquisitions(0), total_wait_ns(0), max_wait_ns(0) {}
+
+		void add(const Snapshot& other)
+		{
+			num_acquisitions += other.num_acquisitions;
+			total_wait_ns += other.total_wait_ns;
+			max_wait_ns = myMax(max_wait_ns, other.max_wait_ns);
+		}
+
+		std::string toString() const
+		{
+			return ::toString(num_acquisitions) + " acquisitions, total wait: " + doubleToStringNSigFigs(total_wait_ns * 1.0e-6, 4) + " ms, mean wait: " +
+				doubleToStringNSigFigs((num_acquisitions > 0) ? (total_wait_ns * 1.0e-3 / num_acquisitions) : 0.0, 4) + " us, max wait: " + doubleToStringNSigFigs(max_wait_ns * 1.0e-6, 4) + " ms";
+		}
+
+		uint64 num_acquisitions;
+		uint64 total_wait_ns;
+		uint64 max_wait_ns;
+	};
+
+	// Returns the stats accumulated since the last call, and resets them.
+	Snapshot getAndReset()
+	{
+		Snapshot s;
+		s.num_acquisitions = num_acquisitions.exchange(0);
+		s.total_wait_ns = total_wait_ns.exchange(0);
+		s.max_wait_ns = max_wait_ns.exchange(0);
+		return s;
+	}
+
+private:
+	std::atomic<uint64> num_acquisitions;
+	std::atomic<uint64> total_wait_ns;
+	std::atomic<uint64> max_wait_ns;
+};
+
+
+/*=====================================================================
+TimedLock
+---------
+Like Lock, but records the time spent waiting to acquire the mutex in a LockWaitStats.
+=====================================================================*/
+class SCOPED_CAPABILITY TimedLock
+{
+public:
+	TimedLock(::Mutex& mutex_, LockWaitStats& stats) ACQUIRE(mutex_)
+	:	mutex(mutex_)
+	{
+		Timer timer;
+		mutex.acquire();
+		stats.addWait((uint64)(timer.elapsed() * 1.0e9));
+	}
+
+	~TimedLock() RELEASE()
+	{
+		mutex.release();
+	}
+
+private:
+	GLARE_DISABLE_COPY(TimedLock);
+
+	::Mutex& mutex;
+};
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2022 -
 
 
 #include "ServerWorldState.h"
+#include "ResourceFactsCache.h"
 #include "../shared/LODGeneration.h"
 #include "../shared/ImageDecoding.h"
 #include <ConPrint.h>
@@ -16,13 +17,18 @@ Copyright Glare Technologies Limited 2022 -
 #include <PlatformUtils.h>
 #include <Timer.h>
 #include <TaskManager.h>
+#include <Task.h>
+#include <Condition.h>
+#include <AtomicInt.h>
 #include <FileUtils.h>
 #include <KillThreadMessage.h>
 #include <graphics/ImageMap.h>
+#include <set>
 
 
-MeshLODGenThread::MeshLODGenThread(ServerAllWorldsState* world_state_)
-:	world_state(world_state_)
+MeshLODGenThread::MeshLODGenThread(ServerAllWorldsState* world_state_, const std::string& resource_facts_cache_path_)
+:	world_state(world_state_),
+	resource_facts_cache_path(resource_facts_cache_path_)
 {
 }
 
@@ -32,12 +38,6 @@ MeshLODGenThread::~MeshLODGenThread()
 }
 
 
-static bool textureHasAlphaChannel(Reference<Map2D>& map)
-{
-	return map->hasAlphaChannel() && !map->isAlphaChannelAllWhite();
-}
-
-
 struct LODMeshToGen
 {
 	std::string model_abs_path;
@@ -70,15 +70,41 @@ struct KTXTextureToGen
 
 
 
-struct MeshLODGenThreadTexInfo
+// A generic object whose object space AABB is computed from its model.
+// The model facts are looked up without holding the world lock, since a ResourceFactsCache miss loads the model, which can take a long time.
+struct ModelAABBToCheck
 {
-	bool has_alpha;
-	bool is_hi_res;
+	ServerWorldState* world;
+	UID ob_uid;
+	std::string model_url;
+	js::AABBox aabb_os;
 };
 
 
+// Set object space AABB if it's incorrect.
+static void updateObjectSpaceAABB(ServerWorldState* world, WorldObject* ob, const js::AABBox& aabb_os)
+{
+	if(!aabb_os.isEmpty()) // If we got a valid aabb_os:
+	{
+		Lock lock(world->mutex);
+
+		const bool updating_aabb_ws = !(approxEq(aabb_os.min_, ob->getAABBOS().min_) && approxEq(aabb_os.max_, ob->getAABBOS().max_)); //aabb_os != ob->getAABBOS();
+		if(updating_aabb_ws)
+		{
+			conPrint("Updating object AABB_os:");
+			conPrint("Old AABB_os: "+ ob->getAABBOS().toString());
+			conPrint("New AABB_os: "+ aabb_os.toString());
+
+			ob->setAABBOS(aabb_os);
+			world->addWorldObjectAsDBDirty(ob);
+		}
+	}
+}
+
+
 // Set object world space AABB if not set yet, or if it's incorrect.
-static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob)
+// Generic objects with a model are added to models_to_check instead, to be handled by checkModelAABBs() after the world lock is released.
+static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::vector<ModelAABBToCheck>& models_to_check)
 {
 	try
 	{
@@ -131,35 +157,19 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 		}
 		else if(ob->object_type == WorldObject::ObjectType_Generic)
 		{
-			// Try and load mesh, get AABB from it.
 			if(!ob->model_url.empty())
 			{
-				const std::string model_abs_path = world_state->resource_manager->pathForURL(ob->model_url);
-
-				BatchedMeshRef batched_mesh = LODGeneration::loadModel(model_abs_path);
-					
-				aabb_os = batched_mesh->aabb_os;
+				ModelAABBToCheck check;
+				check.world = world;
+				check.ob_uid = ob->uid;
+				check.model_url = ob->model_url;
+				models_to_check.push_back(check);
 			}
 		}
 		else
 			throw glare::Exception("invalid object type.");
 
-		// Compute and assign aabb_ws to object.
-		if(!aabb_os.isEmpty()) // If we got a valid aabb_os:
-		{
-			Lock lock(world_state->mutex);
-
-			const bool updating_aabb_ws = !(approxEq(aabb_os.min_, ob->getAABBOS().min_) && approxEq(aabb_os.max_, ob->getAABBOS().max_)); //aabb_os != ob->getAABBOS();
-			if(updating_aabb_ws)
-			{
-				conPrint("Updating object AABB_os:");
-				conPrint("Old AABB_os: "+ ob->getAABBOS().toString());
-				conPrint("New AABB_os: "+ aabb_os.toString());
-
-				ob->setAABBOS(aabb_os);
-				world->addWorldObjectAsDBDirty(ob);
-			}
-		}
+		updateObjectSpaceAABB(world, ob, aabb_os);
 	}
 	catch(glare::Exception& e)
 	{
@@ -172,6 +182,47 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 }
 
 
+// Look up the model AABBs without holding any world lock, then lock each world just to apply the results.
+// Objects that were removed, or whose model changed, while the world was unlocked are skipped.  A changed object will be scanned again anyway.
+static void checkModelAABBs(ServerAllWorldsState* world_state, std::vector<ModelAABBToCheck>& models_to_check, ResourceFactsCache& resource_facts)
+{
+	for(size_t i=0; i<models_to_check.size(); ++i)
+	{
+		ModelAABBToCheck& check = models_to_check[i];
+		check.aabb_os = js::AABBox::emptyAABBox();
+		try
+		{
+			const std::string model_abs_path = world_state->resource_manager->pathForURL(check.model_url);
+
+			check.aabb_os = resource_facts.getModelFacts(check.model_url, model_abs_path).aabb_os;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("MeshLODGenThread: glare::Exception: " + e.what());
+		}
+	}
+
+	// models_to_check is grouped by world, so lock each world once.
+	size_t i = 0;
+	while(i < models_to_check.size())
+	{
+		ServerWorldState* world = models_to_check[i].world;
+		Lock world_lock(world->mutex);
+		for(; (i < models_to_check.size()) && (models_to_check[i].world == world); ++i)
+		{
+			const ModelAABBToCheck& check = models_to_check[i];
+			auto res = world->objects.find(check.ob_uid);
+			if(res != world->objects.end())
+			{
+				WorldObject* ob = res->second.ptr();
+				if(ob->model_url == check.model_url)
+					updateObjectSpaceAABB(world, ob, check.aabb_os);
+			}
+		}
+	}
+}
+
+
 static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::unordered_set<std::string>& lod_URLs_considered, std::vector<LODMeshToGen>& meshes_to_gen)
 {
 	try
@@ -262,7 +313,7 @@ static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, Serve
 }
 
 
-static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, std::map<std::string, MeshLODGenThreadTexInfo>& tex_info)
+static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob, ResourceFactsCache& resource_facts)
 {
 	for(size_t z=0; z<ob->materials.size(); ++z)
 	{
@@ -285,22 +336,13 @@ static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldSta
 					{
 						try
 						{
-							// Compute has_alpha and is_high_res for the texture if we haven't already.
-							auto res = tex_info.find(tex_abs_path);
-							if(res == tex_info.end())
-							{
-								Reference<Map2D> map = ImageDecoding::decodeImage(".", tex_abs_path); // Load texture from disk and decode it.
-								const bool is_hi_res = map->getMapWidth() > 1024 || map->getMapHeight() > 1024;
-								const bool has_alpha = textureHasAlphaChannel(map);
-
-								tex_info[tex_abs_path].has_alpha = has_alpha;
-								tex_info[tex_abs_path].is_hi_res = is_hi_res;
-							}
+							// Get has_alpha and is_high_res for the texture.  The texture is only decoded if we haven't seen it before or it has changed.
+							const TextureFacts& tex_facts = resource_facts.getTextureFacts(mat->colour_texture_url, tex_abs_path);
 
 							// If the texture is very high res, set minimum texture lod level to -1.  Lod level 0 will be the texture resized to 1024x1024 or below.
 
-							const bool is_high_res = tex_info[tex_abs_path].is_hi_res;
-							const bool has_alpha   = tex_info[tex_abs_path].has_alpha;
+							const bool is_high_res = tex_facts.isHiRes();
+							const bool has_alpha   = tex_facts.has_alpha;
 
 							// conPrint("tex " + tex_path + " is_hi_res: " + boolToString(is_high_res));
 
@@ -311,7 +353,7 @@ static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldSta
 							if(mat->flags != old_flags)
 							{
 								{
-									Lock lock(world_state->mutex);
+									Lock lock(world->mutex);
 									world->addWorldObjectAsDBDirty(ob);
 								}
 								conPrint("Updated mat flags: (for mat with tex " + tex_abs_path + "): is_hi_res: " + boolToString(is_high_res));
@@ -449,38 +491,305 @@ static void checkForKTXTexturesToGenerate(ServerAllWorldsState* world_state, Ser
 }
 
 
+// Limit on the total estimated memory usage of generation tasks running at once.
+static const uint64 GEN_MEM_BUDGET = 4ull * 1024 * 1024 * 1024;
+
+
+/*=====================================================================
+GenMemoryBudget
+---------------
+Limits the total estimated memory usage of the generation tasks running at once,
+since the source meshes and textures can be very large once loaded or decoded.
+
+A task whose estimate exceeds the whole budget is allowed to run once no other tasks are running.
+=====================================================================*/
+class GenMemoryBudget
+{
+public:
+	GenMemoryBudget(uint64 budget_) : budget(budget_), in_use(0), num_running(0) {}
+
+	// Blocks until num_bytes can be reserved.
+	void acquire(uint64 num_bytes)
+	{
+		Lock lock(mutex);
+		while((num_running > 0) && (in_use + num_bytes > budget))
+			condition.wait(mutex); // Suspend until another task releases its reservation, or we get a spurious wake up.
+
+		in_use += num_bytes;
+		num_running++;
+	}
+
+	void release(uint64 num_bytes)
+	{
+		{
+			Lock lock(mutex);
+			assert(in_use >= num_bytes && num_running > 0);
+			in_use -= num_bytes;
+			num_running--;
+		}
+		condition.notifyAll();
+	}
+
+private:
+	const uint64 budget;
+	Mutex mutex;
+	Condition condition;
+	uint64 in_use GUARDED_BY(mutex);
+	int num_running GUARDED_BY(mutex);
+};
+
+
+// Rough estimate of peak memory usage while loading and processing a source file, based on its size on disk, since meshes and images are stored compressed.
+static uint64 estimateMemUsageForSourceFile(const std::string& abs_path, uint64 expansion_factor)
+{
+	try
+	{
+		return myMax<uint64>(FileUtils::getFileSize(abs_path) * expansion_factor, 1024 * 1024);
+	}
+	catch(FileUtils::FileUtilsExcep&)
+	{
+		return 1024 * 1024; // Generation will fail anyway.
+	}
+}
+
+
+struct GenTaskResults
+{
+	GenTaskResults() : num_succeeded(0), num_failed(0) {}
+
+	glare::AtomicInt num_succeeded;
+	glare::AtomicInt num_failed;
+};
+
+
+static void printGenThroughput(const std::string& item_description, size_t num_items, const GenTaskResults& results, double elapsed)
+{
+	conPrint("MeshLODGenThread: Done generating " + item_description + ": " + toString(num_items) + " item(s) (" + toString((int64)results.num_failed) + " failed) in " + 
+		doubleToStringNSigFigs(elapsed, 4) + " s (" + doubleToStringNSigFigs((elapsed > 0) ? (num_items / elapsed) : 0.0, 4) + " items/s)");
+}
+
+
+/*=====================================================================
+GenThreadTaskManagers
+---------------------
+One task manager per gen_task_manager thread, used by the generation functions
+for parallelising work within a single texture.
+Image resizing and KTX encoding wait for all tasks in the task manager they are given
+to complete, so concurrently running gen tasks can't share a single task manager
+without waiting on each other's work.
+=====================================================================*/
+class GenThreadTaskManagers
+{
+public:
+	GenThreadTaskManagers(size_t num_gen_threads)
+	{
+		const size_t num_threads_each = myMax<size_t>(1, PlatformUtils::getNumLogicalProcessors() / num_gen_threads);
+		for(size_t i=0; i<num_gen_threads; ++i)
+			task_managers.push_back(new glare::TaskManager("MeshLODGenThread task manager " + toString(i), num_threads_each));
+	}
+
+	~GenThreadTaskManagers()
+	{
+		for(size_t i=0; i<task_managers.size(); ++i)
+			delete task_managers[i];
+	}
+
+	glare::TaskManager& getForThread(size_t gen_thread_index) { return *task_managers[gen_thread_index]; }
+
+private:
+	GLARE_DISABLE_COPY(GenThreadTaskManagers);
+
+	std::vector<glare::TaskManager*> task_managers;
+};
+
+
+/*=====================================================================
+GenTask
+-------
+Generates a LOD mesh, LOD texture or KTX texture file on a gen_task_manager thread,
+then adds it as a resource.
+=====================================================================*/
+class GenTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		const uint64 mem_usage = estimateMemUsage();
+		mem_budget->acquire(mem_usage);
+
+		try
+		{
+			generate(thread_index);
+
+			// Now that we have generated the file, add it to resources.
+			{ // lock scope
+				Lock lock(world_state->mutex);
+
+				const std::string raw_path = FileUtils::getFilename(genAbsPath()); // NOTE: assuming we can get raw/relative path from abs path like this.
+
+				ResourceRef resource = new Resource(
+					genURL(), // URL
+					raw_path, // raw local path
+					Resource::State_Present, // state
+					ownerID()
+				);
+
+				world_state->addResourcesAsDBDirty(resource);
+				world_state->resource_manager->addResource(resource);
+			} // End lock scope
+
+
+			results->num_succeeded++;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("\tMeshLODGenThread: excep while generating " + genURL() + ": " + e.what());
+			results->num_failed++;
+		}
+		catch(std::exception& e) // catch std::bad_alloc etc..
+		{
+			conPrint("\tMeshLODGenThread: Caught std::exception while generating " + genURL() + ": " + e.what());
+			results->num_failed++;
+		}
+
+		mem_budget->release(mem_usage);
+	}
+
+	virtual uint64 estimateMemUsage() const = 0;
+	virtual void generate(size_t thread_index) = 0; // Throws glare::Exception on failure.
+	virtual const std::string& genURL() const = 0;
+	virtual const std::string& genAbsPath() const = 0;
+	virtual UserID ownerID() const = 0;
+
+	ServerAllWorldsState* world_state;
+	GenMemoryBudget* mem_budget;
+	GenTaskResults* results;
+};
+
+
+class LODMeshGenTask : public GenTask
+{
+public:
+	virtual uint64 estimateMemUsage() const { return estimateMemUsageForSourceFile(mesh_to_gen.model_abs_path, /*expansion factor=*/16); }
+
+	virtual void generate(size_t thread_index)
+	{
+		conPrint("MeshLODGenThread: Generating LOD mesh with URL " + mesh_to_gen.lod_URL);
+
+		LODGeneration::generateLODModel(mesh_to_gen.model_abs_path, mesh_to_gen.lod_level, mesh_to_gen.LOD_model_abs_path);
+	}
+
+	virtual const std::string& genURL() const { return mesh_to_gen.lod_URL; }
+	virtual const std::string& genAbsPath() const { return mesh_to_gen.LOD_model_abs_path; }
+	virtual UserID ownerID() const { return mesh_to_gen.owner_id; }
+
+	LODMeshToGen mesh_to_gen;
+};
+
+
+class LODTextureGenTask : public GenTask
+{
+public:
+	virtual uint64 estimateMemUsage() const { return estimateMemUsageForSourceFile(tex_to_gen.source_tex_abs_path, /*expansion factor=*/32); }
+
+	virtual void generate(size_t thread_index)
+	{
+		conPrint("MeshLODGenThread: Generating LOD texture with URL " + tex_to_gen.lod_URL);
+
+		LODGeneration::generateLODTexture(tex_to_gen.source_tex_abs_path, tex_to_gen.lod_level, tex_to_gen.LOD_tex_abs_path, task_managers->getForThread(thread_index));
+	}
+
+	virtual const std::string& genURL() const { return tex_to_gen.lod_URL; }
+	virtual const std::string& genAbsPath() const { return tex_to_gen.LOD_tex_abs_path; }
+	virtual UserID ownerID() const { return tex_to_gen.owner_id; }
+
+	LODTextureToGen tex_to_gen;
+	GenThreadTaskManagers* task_managers;
+};
+
+
+class KTXTextureGenTask : public GenTask
+{
+public:
+	virtual uint64 estimateMemUsage() const { return estimateMemUsageForSourceFile(tex_to_gen.source_tex_abs_path, /*expansion factor=*/48); } // Basis universal encoding needs a lot of working memory.
+
+	virtual void generate(size_t thread_index)
+	{
+		conPrint("MeshLODGenThread: Generating KTX texture with URL " + tex_to_gen.ktx_URL);
+
+		LODGeneration::generateKTXTexture(tex_to_gen.source_tex_abs_path, 
+			tex_to_gen.base_lod_level, tex_to_gen.lod_level, tex_to_gen.ktx_tex_abs_path, 
+			task_managers->getForThread(thread_index));
+	}
+
+	virtual const std::string& genURL() const { return tex_to_gen.ktx_URL; }
+	virtual const std::string& genAbsPath() const { return tex_to_gen.ktx_tex_abs_path; }
+	virtual UserID ownerID() const { return tex_to_gen.owner_id; }
+
+	KTXTextureToGen tex_to_gen;
+	GenThreadTaskManagers* task_managers;
+};
+
+
 void MeshLODGenThread::doRun()
 {
 	PlatformUtils::setCurrentThreadName("MeshLODGenThread");
 
-	glare::TaskManager task_manager("MeshLODGenThread task manager");
+	const size_t num_gen_threads = myClamp<size_t>(PlatformUtils::getNumLogicalProcessors() / 2, 1, 8);
+
+	// Used by the generation functions for parallelising work within a single texture.
+	// Declared before gen_task_manager so that it outlives any running generation tasks.
+	GenThreadTaskManagers task_managers(num_gen_threads);
+
+	// Runs the LOD mesh, LOD texture and KTX generation tasks.
+	glare::TaskManager gen_task_manager("MeshLODGenThread generation task manager", num_gen_threads);
+
+	GenMemoryBudget mem_budget(GEN_MEM_BUDGET);
+
+	// Facts derived from models and textures, such as AABBs, persisted between server runs so that unchanged resources don't need to be loaded again.
+	ResourceFactsCache resource_facts;
+	try
+	{
+		resource_facts.readFromDisk(resource_facts_cache_path);
+		conPrint("MeshLODGenThread: Read resource facts cache: " + toString(resource_facts.numModelEntries()) + " model(s), " + toString(resource_facts.numTextureEntries()) + " texture(s)");
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("MeshLODGenThread: " + e.what()); // Not fatal, facts will just be recomputed.
+	}
 
 	// When this thread starts, we will do a full scan over all objects.
-	// After that we will wait for CheckGenResourcesForObject messages, which instruct this thread to just scan a single object.
+	// After that we will wait for CheckGenResourcesForObject messages, which instruct this thread to scan just the changed objects.
 	bool do_initial_full_scan = true;
 
 	try
 	{
 		while(1)
 		{
-			UID ob_to_scan_UID = UID::invalidUID();
+			std::set<UID> obs_to_scan;
 			if(!do_initial_full_scan)
 			{
-				// Block until we have a message
+				// Block until we have a message, then take any other queued messages as well, so that a burst of changes is handled in a single pass,
+				// and an object changed several times is only scanned once.
 				ThreadMessageRef msg;
 				getMessageQueue().dequeue(msg);
-
-				if(dynamic_cast<CheckGenResourcesForObject*>(msg.ptr()))
+				while(1)
 				{
-					const CheckGenResourcesForObject* check_gen_msg = static_cast<CheckGenResourcesForObject*>(msg.ptr());
-					ob_to_scan_UID = check_gen_msg->ob_uid;
+					if(dynamic_cast<CheckGenResourcesForObject*>(msg.ptr()))
+					{
+						const CheckGenResourcesForObject* check_gen_msg = static_cast<CheckGenResourcesForObject*>(msg.ptr());
+						obs_to_scan.insert(check_gen_msg->ob_uid);
+					}
+					else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
+					{
+						return;
+					}
 
-					conPrint("MeshLODGenThread: Received message to scan object with UID " + ob_to_scan_UID.toString());
-				}
-				else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
-				{
-					return;
+					if(!getMessageQueue().dequeueWithTimeout(/*wait_time_seconds=*/0.0, msg))
+						break;
 				}
+
+				conPrint("MeshLODGenThread: Received message(s) to scan " + toString(obs_to_scan.size()) + " changed object(s)");
 			}
 
 			// Iterate over objects.
@@ -491,29 +800,41 @@ void MeshLODGenThread::doRun()
 			std::vector<LODTextureToGen> lod_textures_to_gen;
 			std::vector<KTXTextureToGen> ktx_textures_to_gen;
 			std::unordered_set<std::string> lod_URLs_considered;
-			std::map<std::string, MeshLODGenThreadTexInfo> tex_info; // Cached info about textures
+
+			std::vector<ModelAABBToCheck> models_to_check;
+
+			const size_t initial_num_model_loads = resource_facts.num_model_loads;
+			const size_t initial_num_texture_loads = resource_facts.num_texture_loads;
 
 			conPrint("MeshLODGenThread: Iterating over world object(s)...");
 			Timer timer;
 			
 			{
-				Lock lock(world_state->mutex);
+				// Take a copy of the world list, so that only one world mutex at a time needs to be held while scanning objects.
+				// The references also keep the worlds alive for checkModelAABBs().
+				std::vector<Reference<ServerWorldState>> worlds;
+				{
+					Lock lock(world_state->mutex);
+					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+						worlds.push_back(world_it->second);
+				}
 
 				if(do_initial_full_scan)
 				{
-					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+					for(size_t w=0; w<worlds.size(); ++w)
 					{
-						ServerWorldState* world = world_it->second.ptr();
+						ServerWorldState* world = worlds[w].ptr();
+						Lock world_lock(world->mutex);
 						for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
 						{
 							WorldObject* ob = it->second.ptr();
 							try
 							{
 								if(true)
-									checkObjectSpaceAABB(world_state, world, ob);
+									checkObjectSpaceAABB(world_state, world, ob, models_to_check);
 
 								if(false)
-									checkMaterialFlags(world_state, world, ob, tex_info);
+									checkMaterialFlags(world_state, world, ob, resource_facts);
 
 								checkForLODMeshesToGenerate(world_state, world, ob, lod_URLs_considered, meshes_to_gen);
 								checkForLODTexturesToGenerate(world_state, world, ob, lod_URLs_considered, lod_textures_to_gen);
@@ -529,153 +850,112 @@ void MeshLODGenThread::doRun()
 				}
 				else
 				{
-					// Look up object for UID
-					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+					// Look up the changed objects
+					for(size_t w=0; w<worlds.size(); ++w)
 					{
-						ServerWorldState* world = world_it->second.ptr();
-						auto res = world->objects.find(ob_to_scan_UID);
-						if(res != world->objects.end())
+						ServerWorldState* world = worlds[w].ptr();
+						Lock world_lock(world->mutex);
+						for(auto uid_it = obs_to_scan.begin(); uid_it != obs_to_scan.end(); ++uid_it)
 						{
-							WorldObject* ob = res->second.ptr();
-							try
-							{
-								checkForLODMeshesToGenerate(world_state, world, ob, lod_URLs_considered, meshes_to_gen);
-								checkForLODTexturesToGenerate(world_state, world, ob, lod_URLs_considered, lod_textures_to_gen);
-								checkForKTXTexturesToGenerate(world_state, world, ob, lod_URLs_considered, ktx_textures_to_gen);
-							}
-							catch(glare::Exception& e)
+							auto res = world->objects.find(*uid_it);
+							if(res != world->objects.end())
 							{
-								conPrint("\tMeshLODGenThread: exception while processing object: " + e.what());
+								WorldObject* ob = res->second.ptr();
+								try
+								{
+									checkObjectSpaceAABB(world_state, world, ob, models_to_check);
+
+									checkForLODMeshesToGenerate(world_state, world, ob, lod_URLs_considered, meshes_to_gen);
+									checkForLODTexturesToGenerate(world_state, world, ob, lod_URLs_considered, lod_textures_to_gen);
+									checkForKTXTexturesToGenerate(world_state, world, ob, lod_URLs_considered, ktx_textures_to_gen);
+								}
+								catch(glare::Exception& e)
+								{
+									conPrint("\tMeshLODGenThread: exception while processing object: " + e.what());
+								}
 							}
 						}
 					}
 				}
-			} // End lock scope
-
-			conPrint("MeshLODGenThread: Iterating over objects took " + timer.elapsedStringNSigFigs(4) + ", meshes_to_gen: " + toString(meshes_to_gen.size()) + ", lod_textures_to_gen: " + toString(lod_textures_to_gen.size()) + 
-				", ktx_textures_to_gen: " + toString(ktx_textures_to_gen.size()));
 
+				checkModelAABBs(world_state, models_to_check, resource_facts);
+			}
 
-			//-------------------------------------------  Generate each mesh, without holding the world lock -------------------------------------------
-			conPrint("MeshLODGenThread: Generating LOD meshes...");
-			timer.reset();
+			conPrint("MeshLODGenThread: Model loads: " + toString(resource_facts.num_model_loads - initial_num_model_loads) + ", texture loads: " + 
+				toString(resource_facts.num_texture_loads - initial_num_texture_loads) + " (cached: " + toString(resource_facts.numModelEntries()) + " model(s), " + 
+				toString(resource_facts.numTextureEntries()) + " texture(s))");
 
-			for(size_t i=0; i<meshes_to_gen.size(); ++i)
+			if(resource_facts.isDirty())
 			{
-				const LODMeshToGen& mesh_to_gen = meshes_to_gen[i];
 				try
 				{
-					conPrint("MeshLODGenThread: Generating LOD mesh with URL " + mesh_to_gen.lod_URL);
-
-					LODGeneration::generateLODModel(mesh_to_gen.model_abs_path, mesh_to_gen.lod_level, mesh_to_gen.LOD_model_abs_path);
-
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
-
-						const std::string raw_path = FileUtils::getFilename(mesh_to_gen.LOD_model_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
-
-						ResourceRef resource = new Resource(
-							mesh_to_gen.lod_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							mesh_to_gen.owner_id
-						);
-
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
-						
-					} // End lock scope
+					resource_facts.writeToDisk(resource_facts_cache_path);
 				}
 				catch(glare::Exception& e)
 				{
-					conPrint("\tMeshLODGenThread: glare::Exception while generating LOD model: " + e.what());
+					conPrint("MeshLODGenThread: " + e.what());
 				}
 			}
 
-			conPrint("MeshLODGenThread: Done generating LOD meshes. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ")");
+			conPrint("MeshLODGenThread: Iterating over objects took " + timer.elapsedStringNSigFigs(4) + ", meshes_to_gen: " + toString(meshes_to_gen.size()) + ", lod_textures_to_gen: " + toString(lod_textures_to_gen.size()) + 
+				", ktx_textures_to_gen: " + toString(ktx_textures_to_gen.size()));
 
 
-			//------------------------------------------- Generate each texture, without holding the world lock -------------------------------------------
-			conPrint("MeshLODGenThread: Generating LOD textures...");
+			//------------------------------------------- Generate LOD meshes and LOD textures, without holding the world lock -------------------------------------------
+			// These are independent of each other, so run them all concurrently.
+			// KTX textures are generated from the LOD textures, so are generated afterwards.
+			conPrint("MeshLODGenThread: Generating " + toString(meshes_to_gen.size()) + " LOD mesh(es) and " + toString(lod_textures_to_gen.size()) + " LOD texture(s) with " + 
+				toString(gen_task_manager.getNumThreads()) + " thread(s)...");
 			timer.reset();
 
-			for(size_t i=0; i<lod_textures_to_gen.size(); ++i)
+			GenTaskResults results;
+			
+			for(size_t i=0; i<meshes_to_gen.size(); ++i)
 			{
-				const LODTextureToGen& tex_to_gen = lod_textures_to_gen[i];
-				try
-				{
-					conPrint("MeshLODGenThread:  (LOD tex " + toString(i) + " / " + toString(lod_textures_to_gen.size()) + "): Generating LOD texture with URL " + tex_to_gen.lod_URL);
-
-					LODGeneration::generateLODTexture(tex_to_gen.source_tex_abs_path, tex_to_gen.lod_level, tex_to_gen.LOD_tex_abs_path, task_manager);
-
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
-
-						const std::string raw_path = FileUtils::getFilename(tex_to_gen.LOD_tex_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
-
-						ResourceRef resource = new Resource(
-							tex_to_gen.lod_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							tex_to_gen.owner_id
-						);
-
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
-
-					} // End lock scope
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("\tMeshLODGenThread: excep while generating LOD texture: " + e.what());
-				}
+				Reference<LODMeshGenTask> task = new LODMeshGenTask();
+				task->mesh_to_gen = meshes_to_gen[i];
+				task->world_state = world_state;
+				task->mem_budget = &mem_budget;
+				task->results = &results;
+				gen_task_manager.addTask(task);
 			}
 
-			conPrint("MeshLODGenThread: Done generating LOD textures. (Elapsed: " + timer.elapsedStringNSigFigs(4));
-
-			//------------------------------------------- Generate each KTX texture, without holding the world lock -------------------------------------------
-			conPrint("MeshLODGenThread: Generating KTX textures...");
-			timer.reset();
-
-			for(size_t i=0; i<ktx_textures_to_gen.size(); ++i)
+			for(size_t i=0; i<lod_textures_to_gen.size(); ++i)
 			{
-				const KTXTextureToGen& tex_to_gen = ktx_textures_to_gen[i];
-				try
-				{
-					conPrint("MeshLODGenThread: (ktx " + toString(i) + " / " + toString(ktx_textures_to_gen.size()) + "): Generating KTX texture with URL " + tex_to_gen.ktx_URL);
-
-					LODGeneration::generateKTXTexture(tex_to_gen.source_tex_abs_path, 
-						tex_to_gen.base_lod_level, tex_to_gen.lod_level, tex_to_gen.ktx_tex_abs_path, 
-						task_manager);
+				Reference<LODTextureGenTask> task = new LODTextureGenTask();
+				task->tex_to_gen = lod_textures_to_gen[i];
+				task->task_managers = &task_managers;
+				task->world_state = world_state;
+				task->mem_budget = &mem_budget;
+				task->results = &results;
+				gen_task_manager.addTask(task);
+			}
 
-					// Now that we have generated the LOD model, add it to resources.
-					{ // lock scope
-						Lock lock(world_state->mutex);
+			gen_task_manager.waitForTasksToComplete();
 
-						const std::string raw_path = FileUtils::getFilename(tex_to_gen.ktx_tex_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
+			printGenThroughput("LOD meshes and LOD textures", meshes_to_gen.size() + lod_textures_to_gen.size(), results, timer.elapsed());
 
-						ResourceRef resource = new Resource(
-							tex_to_gen.ktx_URL, // URL
-							raw_path, // raw local path
-							Resource::State_Present, // state
-							tex_to_gen.owner_id
-						);
+			//------------------------------------------- Generate KTX textures, without holding the world lock -------------------------------------------
+			conPrint("MeshLODGenThread: Generating " + toString(ktx_textures_to_gen.size()) + " KTX texture(s)...");
+			timer.reset();
 
-						world_state->addResourcesAsDBDirty(resource);
-						world_state->resource_manager->addResource(resource);
+			GenTaskResults ktx_results;
 
-					} // End lock scope
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("\tMeshLODGenThread: excep while generating KTX texture: " + e.what());
-				}
+			for(size_t i=0; i<ktx_textures_to_gen.size(); ++i)
+			{
+				Reference<KTXTextureGenTask> task = new KTXTextureGenTask();
+				task->tex_to_gen = ktx_textures_to_gen[i];
+				task->task_managers = &task_managers;
+				task->world_state = world_state;
+				task->mem_budget = &mem_budget;
+				task->results = &ktx_results;
+				gen_task_manager.addTask(task);
 			}
 
-			conPrint("MeshLODGenThread: Done generating KTX textures. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ")");
-			//------------------------------------------- End Generate each KTX texture  -------------------------------------------
+			gen_task_manager.waitForTasksToComplete();
+
+			printGenThroughput("KTX textures", ktx_textures_to_gen.size(), ktx_results, timer.elapsed());
+			//------------------------------------------- End generate KTX textures  -------------------------------------------
 		}
 	}
 	catch(glare::Exception& e)
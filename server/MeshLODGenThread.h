@@ -8,6 +8,7 @@ Copyright Glare Technologies Limited 2022 -
 
 #include "../shared/UID.h"
 #include <MessageableThread.h>
+#include <string>
 class ServerAllWorldsState;
 
 
@@ -23,12 +24,15 @@ MeshLODGenThread
 ----------------
 Does generation of LOD meshes, also LOD textures and KTX textures.
 
+Facts derived from models and textures (AABBs, texture alpha etc.) are cached in a ResourceFactsCache
+saved at resource_facts_cache_path, so resources that haven't changed are not loaded again after a restart.
+
 Lightmap LOD generation is done by LightMapperBot.
 =====================================================================*/
 class MeshLODGenThread : public MessageableThread
 {
 public:
-	MeshLODGenThread(ServerAllWorldsState* world_state);
+	MeshLODGenThread(ServerAllWorldsState* world_state, const std::string& resource_facts_cache_path);
 
 	virtual ~MeshLODGenThread();
 
@@ -36,4 +40,5 @@ public:
 
 private:
 	ServerAllWorldsState* world_state;
+	std::string resource_facts_cache_path;
 };
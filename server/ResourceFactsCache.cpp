@@ -0,0 +1,321 @@
+/*=====================================================================
+ResourceFactsCache.cpp
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ResourceFactsCache.h"
+
+
+#include "../shared/LODGeneration.h"
+#include "../shared/ImageDecoding.h"
+#include <graphics/Map2D.h>
+#include <maths/mathstypes.h>
+#include <FileInStream.h>
+#include <FileOutStream.h>
+#include <FileUtils.h>
+#include <Exception.h>
+#include <StringUtils.h>
+
+
+static const uint32 RESOURCE_FACTS_CACHE_MAGIC_NUMBER = 0x6F8A2C41;
+static const uint32 RESOURCE_FACTS_CACHE_VERSION = 1;
+static const uint32 MAX_NUM_CACHE_ENTRIES = 100000000;
+
+
+// Throws glare::Exception if the file size could not be determined, e.g. if the file doesn't exist.
+static uint64 getResourceFileSize(const std::string& path)
+{
+	try
+	{
+		return FileUtils::getFileSize(path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+}
+
+
+ResourceFactsCache::ResourceFactsCache()
+:	num_model_loads(0),
+	num_texture_loads(0),
+	dirty(false)
+{
+}
+
+
+const ModelFacts& ResourceFactsCache::getModelFacts(const std::string& URL, const std::string& model_abs_path)
+{
+	const uint64 file_size = getResourceFileSize(model_abs_path);
+
+	auto res = model_facts.find(URL);
+	if(res != model_facts.end() && res->second.file_size == file_size)
+		return res->second.facts;
+
+	BatchedMeshRef batched_mesh = LODGeneration::loadModel(model_abs_path); // Throws glare::Exception on failure.
+	num_model_loads++;
+
+	Entry<ModelFacts>& entry = model_facts[URL];
+	entry.file_size = file_size;
+	entry.facts.aabb_os = batched_mesh->aabb_os;
+	entry.facts.num_verts = batched_mesh->numVerts();
+	dirty = true;
+	return entry.facts;
+}
+
+
+const TextureFacts& ResourceFactsCache::getTextureFacts(const std::string& URL, const std::string& tex_abs_path)
+{
+	const uint64 file_size = getResourceFileSize(tex_abs_path);
+
+	auto res = texture_facts.find(URL);
+	if(res != texture_facts.end() && res->second.file_size == file_size)
+		return res->second.facts;
+
+	Reference<Map2D> map = ImageDecoding::decodeImage(".", tex_abs_path); // Load texture from disk and decode it.  Throws glare::Exception on failure.
+	num_texture_loads++;
+
+	Entry<TextureFacts>& entry = texture_facts[URL];
+	entry.file_size = file_size;
+	entry.facts.width = (uint32)map->getMapWidth();
+	entry.facts.height = (uint32)map->getMapHeight();
+	entry.facts.has_alpha = map->hasAlphaChannel() && !map->isAlphaChannelAllWhite();
+	dirty = true;
+	return entry.facts;
+}
+
+
+void ResourceFactsCache::readFromDisk(const std::string& path)
+{
+	model_facts.clear();
+	texture_facts.clear();
+	dirty = false;
+
+	if(!FileUtils::fileExists(path))
+		return;
+
+	try
+	{
+		FileInStream stream(path);
+
+		const uint32 magic = stream.readUInt32();
+		if(magic != RESOURCE_FACTS_CACHE_MAGIC_NUMBER)
+			throw glare::Exception("Invalid magic number " + toString(magic));
+
+		const uint32 version = stream.readUInt32();
+		if(version > RESOURCE_FACTS_CACHE_VERSION)
+			throw glare::Exception("Unsupported version " + toString(version));
+
+		const uint32 num_models = stream.readUInt32();
+		if(num_models > MAX_NUM_CACHE_ENTRIES)
+			throw glare::Exception("Too many model entries");
+		for(uint32 i=0; i<num_models; ++i)
+		{
+			const std::string URL = stream.readStringLengthFirst(/*max string length=*/20000);
+
+			Entry<ModelFacts> entry;
+			entry.file_size = stream.readUInt64();
+			stream.readData(entry.facts.aabb_os.min_.x, sizeof(float) * 3);
+			entry.facts.aabb_os.min_.x[3] = 1.f;
+			stream.readData(entry.facts.aabb_os.max_.x, sizeof(float) * 3);
+			entry.facts.aabb_os.max_.x[3] = 1.f;
+			entry.facts.num_verts = stream.readUInt64();
+
+			if(!entry.facts.aabb_os.min_.isFinite() || !entry.facts.aabb_os.max_.isFinite())
+				throw glare::Exception("Invalid AABB for model " + URL);
+
+			model_facts[URL] = entry;
+		}
+
+		const uint32 num_textures = stream.readUInt32();
+		if(num_textures > MAX_NUM_CACHE_ENTRIES)
+			throw glare::Exception("Too many texture entries");
+		for(uint32 i=0; i<num_textures; ++i)
+		{
+			const std::string URL = stream.readStringLengthFirst(/*max string length=*/20000);
+
+			Entry<TextureFacts> entry;
+			entry.file_size = stream.readUInt64();
+			entry.facts.width = stream.readUInt32();
+			entry.facts.height = stream.readUInt32();
+			entry.facts.has_alpha = stream.readUInt32() != 0;
+
+			texture_facts[URL] = entry;
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		// Don't keep a partially read cache around, everything will just be recomputed.
+		model_facts.clear();
+		texture_facts.clear();
+		throw glare::Exception("Error while reading resource facts cache from '" + path + "': " + e.what());
+	}
+}
+
+
+void ResourceFactsCache::writeToDisk(const std::string& path)
+{
+	const std::string temp_path = path + "_temp";
+	try
+	{
+		{
+			FileOutStream stream(temp_path, std::ios::binary | std::ios::trunc);
+
+			stream.writeUInt32(RESOURCE_FACTS_CACHE_MAGIC_NUMBER);
+			stream.writeUInt32(RESOURCE_FACTS_CACHE_VERSION);
+
+			stream.writeUInt32((uint32)model_facts.size());
+			for(auto it = model_facts.begin(); it != model_facts.end(); ++it)
+			{
+				stream.writeStringLengthFirst(it->first);
+				stream.writeUInt64(it->second.file_size);
+				stream.writeData(it->second.facts.aabb_os.min_.x, sizeof(float) * 3);
+				stream.writeData(it->second.facts.aabb_os.max_.x, sizeof(float) * 3);
+				stream.writeUInt64(it->second.facts.num_verts);
+			}
+
+			stream.writeUInt32((uint32)texture_facts.size());
+			for(auto it = texture_facts.begin(); it != texture_facts.end(); ++it)
+			{
+				stream.writeStringLengthFirst(it->first);
+				stream.writeUInt64(it->second.file_size);
+				stream.writeUInt32(it->second.facts.width);
+				stream.writeUInt32(it->second.facts.height);
+				stream.writeUInt32(it->second.facts.has_alpha ? 1 : 0);
+			}
+		} // End scope for FileOutStream
+
+		FileUtils::moveFile(temp_path, path);
+
+		dirty = false;
+	}
+	catch(glare::Exception& e)
+	{
+		throw glare::Exception("Error while writing resource facts cache to '" + path + "': " + e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception("Error while writing resource facts cache to '" + path + "': " + e.what());
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/PlatformUtils.h>
+
+
+void ResourceFactsCache::test()
+{
+	conPrint("ResourceFactsCache::test()");
+
+	try
+	{
+		const std::string model_path = PlatformUtils::getTempDirPath() + "/resource_facts_cache_test.obj";
+		FileUtils::writeEntireFileTextMode(model_path,
+			"v 0 0 0\n"
+			"v 1 0 0\n"
+			"v 0 2 3\n"
+			"f 1 2 3\n");
+
+		const std::string tex_path = TestUtils::getTestReposDir() + "/testfiles/pngs/PngSuite-2013jan13/basn6a08.png"; // 32x32 RGBA
+		const std::string cache_path = PlatformUtils::getTempDirPath() + "/resource_facts_cache_test.bin";
+		if(FileUtils::fileExists(cache_path))
+			FileUtils::deleteFile(cache_path);
+
+		//------------------------------------------- First run: resources are loaded once each -------------------------------------------
+		{
+			ResourceFactsCache cache;
+			cache.readFromDisk(cache_path); // Doesn't exist yet, should leave the cache empty.
+			testAssert(cache.numModelEntries() == 0 && cache.numTextureEntries() == 0);
+
+			const ModelFacts model_facts = cache.getModelFacts("resource_facts_cache_test.obj", model_path);
+			testAssert(model_facts.num_verts == 3);
+			testAssert(epsEqual(model_facts.aabb_os.max_[1], 2.f) && epsEqual(model_facts.aabb_os.max_[2], 3.f));
+
+			const TextureFacts tex_facts = cache.getTextureFacts("basn6a08.png", tex_path);
+			testAssert(tex_facts.width == 32 && tex_facts.height == 32);
+			testAssert(!tex_facts.isHiRes());
+
+			// Querying again shouldn't reload anything.
+			cache.getModelFacts("resource_facts_cache_test.obj", model_path);
+			cache.getTextureFacts("basn6a08.png", tex_path);
+
+			testAssert(cache.num_model_loads == 1);
+			testAssert(cache.num_texture_loads == 1);
+			testAssert(cache.isDirty());
+
+			cache.writeToDisk(cache_path);
+			testAssert(!cache.isDirty());
+		}
+
+		//------------------------------------------- Simulate a server restart with no changed resources: nothing should be loaded -------------------------------------------
+		{
+			ResourceFactsCache cache;
+			cache.readFromDisk(cache_path);
+			testAssert(cache.numModelEntries() == 1 && cache.numTextureEntries() == 1);
+
+			const ModelFacts model_facts = cache.getModelFacts("resource_facts_cache_test.obj", model_path);
+			testAssert(model_facts.num_verts == 3);
+			testAssert(epsEqual(model_facts.aabb_os.max_[1], 2.f) && epsEqual(model_facts.aabb_os.max_[2], 3.f));
+
+			const TextureFacts tex_facts = cache.getTextureFacts("basn6a08.png", tex_path);
+			testAssert(tex_facts.width == 32 && tex_facts.height == 32);
+
+			testAssert(cache.num_model_loads == 0);
+			testAssert(cache.num_texture_loads == 0);
+			testAssert(!cache.isDirty());
+		}
+
+		//------------------------------------------- Restart after the model file has changed: only the model should be reloaded -------------------------------------------
+		FileUtils::writeEntireFileTextMode(model_path,
+			"v 0 0 0\n"
+			"v 4 0 0\n"
+			"v 0 2 3\n"
+			"v 0 2 5\n"
+			"f 1 2 3\n"
+			"f 1 3 4\n");
+		{
+			ResourceFactsCache cache;
+			cache.readFromDisk(cache_path);
+
+			const ModelFacts model_facts = cache.getModelFacts("resource_facts_cache_test.obj", model_path);
+			testAssert(epsEqual(model_facts.aabb_os.max_[0], 4.f) && epsEqual(model_facts.aabb_os.max_[2], 5.f));
+			cache.getTextureFacts("basn6a08.png", tex_path);
+
+			testAssert(cache.num_model_loads == 1);
+			testAssert(cache.num_texture_loads == 0);
+		}
+
+		//------------------------------------------- Test reading an invalid cache file -------------------------------------------
+		{
+			FileUtils::writeEntireFileTextMode(cache_path, "not a cache file");
+
+			ResourceFactsCache cache;
+			try
+			{
+				cache.readFromDisk(cache_path);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+			testAssert(cache.numModelEntries() == 0 && cache.numTextureEntries() == 0);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ResourceFactsCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,86 @@
+/*=====================================================================
+ResourceFactsCache.h
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <physics/jscol_aabbox.h>
+#include <Platform.h>
+#include <string>
+#include <unordered_map>
+
+
+struct ModelFacts
+{
+	js::AABBox aabb_os;
+	uint64 num_verts;
+};
+
+
+struct TextureFacts
+{
+	uint32 width;
+	uint32 height;
+	bool has_alpha;
+
+	bool isHiRes() const { return width > 1024 || height > 1024; }
+};
+
+
+/*=====================================================================
+ResourceFactsCache
+------------------
+Facts derived from model and texture resources by MeshLODGenThread, such as
+the object-space AABB and vertex count of a model, and the size and alpha usage of a texture.
+
+Keyed by resource URL.  Each entry also stores the size of the resource file the facts were
+computed from, so a resource that has been replaced on disk will be reloaded.
+
+Saved to disk, so that on server restart unchanged resources don't need to be loaded and decoded again.
+
+Not threadsafe, only used by MeshLODGenThread.
+=====================================================================*/
+class ResourceFactsCache
+{
+public:
+	ResourceFactsCache();
+
+	// Returns the facts for the model at model_abs_path, loading the model if they are not cached or are stale.
+	// Throws glare::Exception if the model could not be loaded.
+	const ModelFacts& getModelFacts(const std::string& URL, const std::string& model_abs_path);
+
+	// Returns the facts for the texture at tex_abs_path, decoding the texture if they are not cached or are stale.
+	// Throws glare::Exception if the texture could not be decoded.
+	const TextureFacts& getTextureFacts(const std::string& URL, const std::string& tex_abs_path);
+
+	// Throws glare::Exception on failure.  A missing file is not an error, the cache is just left empty.
+	void readFromDisk(const std::string& path);
+
+	// Writes to a temp file then moves it over path, so an interrupted write doesn't leave a truncated cache.  Throws glare::Exception on failure.
+	void writeToDisk(const std::string& path);
+
+	bool isDirty() const { return dirty; }
+
+	size_t numModelEntries() const { return model_facts.size(); }
+	size_t numTextureEntries() const { return texture_facts.size(); }
+
+	// Number of times a model was loaded or a texture was decoded, because the facts were not already cached.
+	size_t num_model_loads;
+	size_t num_texture_loads;
+
+	static void test();
+
+private:
+	template <class Facts>
+	struct Entry
+	{
+		uint64 file_size;
+		Facts facts;
+	};
+
+	std::unordered_map<std::string, Entry<ModelFacts>> model_facts;
+	std::unordered_map<std::string, Entry<TextureFacts>> texture_facts;
+	bool dirty; // True if there are changes not yet written to disk.
+};
@@ -0,0 +1,370 @@
+/*=====================================================================
+ResourceFileSender.cpp
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ResourceFileSender.h"
+
+
+#include <MySocket.h>
+#include <MemMappedFile.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <maths/mathstypes.h>
+#if !(defined(_WIN32) || defined(OSX))
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#endif
+
+
+ResourceFileSender::ResourceFileSender()
+:	num_bytes_sent_zero_copy(0),
+	num_bytes_sent_copied(0),
+	file_size(0),
+#if defined(_WIN32) || defined(OSX)
+	mapped_file(NULL)
+#else
+	fd(-1)
+#endif
+{
+}
+
+
+ResourceFileSender::~ResourceFileSender()
+{
+	close();
+}
+
+
+void ResourceFileSender::open(const std::string& path)
+{
+	close();
+
+#if defined(_WIN32) || defined(OSX)
+	mapped_file = new MemMappedFile(path); // Throws glare::Exception on failure.
+	file_size = mapped_file->fileSize();
+#else
+	fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1)
+		throw glare::Exception("Failed to open file '" + path + "': " + std::string(std::strerror(errno)));
+
+	struct stat st;
+	if(fstat(fd, &st) != 0)
+	{
+		const std::string msg = std::strerror(errno);
+		close();
+		throw glare::Exception("fstat failed for file '" + path + "': " + msg);
+	}
+	file_size = (uint64)st.st_size;
+#endif
+}
+
+
+void ResourceFileSender::close()
+{
+#if defined(_WIN32) || defined(OSX)
+	delete mapped_file;
+	mapped_file = NULL;
+#else
+	if(fd != -1)
+	{
+		::close(fd);
+		fd = -1;
+	}
+#endif
+	file_size = 0;
+}
+
+
+void ResourceFileSender::sendRange(SocketInterface& socket, uint64 offset, uint64 len)
+{
+	if(offset > file_size || len > file_size - offset)
+		throw glare::Exception("Invalid range");
+
+#if defined(_WIN32) || defined(OSX)
+	sendRangeCopied(socket, offset, len);
+#else
+	MySocket* plain_socket = dynamic_cast<MySocket*>(&socket);
+	if(!plain_socket) // TLS sockets need the data in user space to encrypt it.
+	{
+		sendRangeCopied(socket, offset, len);
+		return;
+	}
+
+	off_t file_offset = (off_t)offset;
+	uint64 remaining = len;
+	while(remaining > 0)
+	{
+		const ssize_t res = sendfile((int)plain_socket->getSocketHandle(), fd, &file_offset, (size_t)myMin<uint64>(remaining, 1ull << 30));
+		if(res < 0)
+		{
+			if(errno == EINTR || errno == EAGAIN)
+				continue;
+			throw glare::Exception("sendfile failed: " + std::string(std::strerror(errno)));
+		}
+		if(res == 0)
+			throw glare::Exception("sendfile failed: unexpected end of file"); // File was truncated after being opened.
+
+		remaining -= (uint64)res;
+		num_bytes_sent_zero_copy += (uint64)res;
+	}
+#endif
+}
+
+
+void ResourceFileSender::sendRangeCopied(SocketInterface& socket, uint64 offset, uint64 len)
+{
+	if(offset > file_size || len > file_size - offset)
+		throw glare::Exception("Invalid range");
+
+	uint64 sent = 0;
+	while(sent < len)
+	{
+		const size_t chunk_size = (size_t)myMin<uint64>(len - sent, MAX_CHUNK_SIZE);
+
+#if defined(_WIN32) || defined(OSX)
+		socket.writeData((const uint8*)mapped_file->fileData() + offset + sent, chunk_size);
+#else
+		chunk_buf.resize(MAX_CHUNK_SIZE);
+		size_t chunk_read = 0;
+		while(chunk_read < chunk_size)
+		{
+			const ssize_t res = pread(fd, chunk_buf.data() + chunk_read, chunk_size - chunk_read, (off_t)(offset + sent + chunk_read));
+			if(res < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				throw glare::Exception("pread failed: " + std::string(std::strerror(errno)));
+			}
+			if(res == 0)
+				throw glare::Exception("pread failed: unexpected end of file");
+			chunk_read += (size_t)res;
+		}
+
+		socket.writeData(chunk_buf.data(), chunk_size);
+#endif
+
+		sent += chunk_size;
+		num_bytes_sent_copied += chunk_size;
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/PlatformUtils.h>
+#include <utils/FileUtils.h>
+#include <utils/Timer.h>
+#include <utils/TaskManager.h>
+#include <utils/Task.h>
+#include <ctime>
+#include <cstring>
+
+
+static const int TEST_PORT = 7611;
+
+
+// Accepts a single connection, then sends the requested ranges of the file at path, using a plain socket.
+class ResourceFileSenderTestTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		try
+		{
+			MySocketRef conn = listener->acceptConnection();
+			conn->setUseNetworkByteOrder(false);
+
+			ResourceFileSender sender;
+			sender.open(path);
+
+			while(1)
+			{
+				const uint64 offset = conn->readUInt64();
+				const uint64 len = conn->readUInt64();
+				if(len == 0)
+					break;
+				if(force_copy)
+					sender.sendRangeCopied(*conn, offset, len);
+				else
+					sender.sendRange(*conn, offset, len);
+			}
+
+			num_bytes_sent_zero_copy = sender.num_bytes_sent_zero_copy;
+			num_bytes_sent_copied = sender.num_bytes_sent_copied;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("ResourceFileSenderTestTask: " + e.what());
+			failed = true;
+		}
+		catch(MySocketExcep& e)
+		{
+			conPrint("ResourceFileSenderTestTask: " + e.what());
+			failed = true;
+		}
+	}
+
+	MySocketRef listener;
+	std::string path;
+	bool force_copy;
+	bool failed;
+	uint64 num_bytes_sent_zero_copy;
+	uint64 num_bytes_sent_copied;
+};
+
+
+// Serves the file over loopback, reading it back num_reps times, and reports throughput and process CPU time per GB.
+static void doLoopbackBenchmark(const std::string& path, const std::vector<uint8>& file_contents, bool force_copy, int num_reps)
+{
+	MySocketRef listener = new MySocket();
+	listener->bindAndListen(TEST_PORT, /*reuse address=*/true);
+
+	glare::TaskManager task_manager("ResourceFileSender test task manager", 1);
+	Reference<ResourceFileSenderTestTask> task = new ResourceFileSenderTestTask();
+	task->listener = listener;
+	task->path = path;
+	task->force_copy = force_copy;
+	task->failed = false;
+	task->num_bytes_sent_zero_copy = task->num_bytes_sent_copied = 0;
+	task_manager.addTask(task);
+
+	MySocketRef client = new MySocket("127.0.0.1", TEST_PORT);
+	client->setUseNetworkByteOrder(false);
+
+	std::vector<uint8> buf(file_contents.size());
+
+	// Check a range from the middle of the file, as used when resuming a download, is correct.
+	{
+		const uint64 offset = file_contents.size() / 3;
+		const uint64 len = file_contents.size() / 4;
+		client->writeUInt64(offset);
+		client->writeUInt64(len);
+		client->readData(buf.data(), len);
+		testAssert(std::memcmp(buf.data(), &file_contents[offset], len) == 0);
+	}
+
+	Timer timer;
+	const std::clock_t cpu_start = std::clock();
+	uint64 total_bytes = 0;
+	for(int i=0; i<num_reps; ++i)
+	{
+		client->writeUInt64(0);
+		client->writeUInt64(file_contents.size());
+		client->readData(buf.data(), file_contents.size());
+		total_bytes += file_contents.size();
+	}
+	const double cpu_time = (double)(std::clock() - cpu_start) / CLOCKS_PER_SEC; // Process CPU time, so includes both the sending and receiving ends.
+	const double elapsed = timer.elapsed();
+
+	testAssert(buf == file_contents);
+
+	client->writeUInt64(0); // Tell the sender we are done.
+	client->writeUInt64(0);
+	task_manager.waitForTasksToComplete();
+	testAssert(!task->failed);
+
+#if !(defined(_WIN32) || defined(OSX))
+	if(force_copy)
+		testAssert(task->num_bytes_sent_zero_copy == 0);
+	else
+		testAssert(task->num_bytes_sent_copied == 0);
+#endif
+
+	const double GB = total_bytes * 1.0e-9;
+	conPrint("ResourceFileSender loopback benchmark (" + std::string(force_copy ? "chunked copy" : "zero-copy where available") + "): " + getNiceByteSize(total_bytes) + " in " +
+		doubleToStringNSigFigs(elapsed, 4) + " s: " + doubleToStringNSigFigs(GB / elapsed, 4) + " GB/s, CPU time (sender + receiver): " + doubleToStringNSigFigs(cpu_time / GB, 4) + " s / GB");
+}
+
+
+void ResourceFileSender::test()
+{
+	conPrint("ResourceFileSender::test()");
+
+	try
+	{
+		const std::string path = PlatformUtils::getTempDirPath() + "/resource_file_sender_test.bin";
+
+		// Make a file larger than MAX_CHUNK_SIZE, and not a multiple of it.
+		std::vector<uint8> file_contents(4 * MAX_CHUNK_SIZE + 12345);
+		for(size_t i=0; i<file_contents.size(); ++i)
+			file_contents[i] = (uint8)((i * 2654435761u) >> 24);
+		FileUtils::writeEntireFile(path, file_contents);
+
+		{
+			ResourceFileSender sender;
+			sender.open(path);
+			testAssert(sender.fileSize() == file_contents.size());
+
+			// Test invalid ranges are rejected
+			MySocketRef unconnected_socket = new MySocket();
+			try
+			{
+				sender.sendRange(*unconnected_socket, file_contents.size(), 1);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+			try
+			{
+				sender.sendRange(*unconnected_socket, 10, file_contents.size());
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		try
+		{
+			ResourceFileSender sender;
+			sender.open(PlatformUtils::getTempDirPath() + "/resource_file_sender_test_nonexistent.bin");
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+
+		// Check the file is served correctly, with and without zero-copy sending.
+		doLoopbackBenchmark(path, file_contents, /*force copy=*/true, /*num reps=*/1);
+		doLoopbackBenchmark(path, file_contents, /*force copy=*/false, /*num reps=*/1);
+
+		FileUtils::deleteFile(path);
+
+		// Performance test
+		if(false)
+		{
+			std::vector<uint8> large_file_contents(64 * 1024 * 1024 + 12345);
+			for(size_t i=0; i<large_file_contents.size(); ++i)
+				large_file_contents[i] = (uint8)((i * 2654435761u) >> 24);
+			FileUtils::writeEntireFile(path, large_file_contents);
+
+			doLoopbackBenchmark(path, large_file_contents, /*force copy=*/true, /*num reps=*/8);
+			doLoopbackBenchmark(path, large_file_contents, /*force copy=*/false, /*num reps=*/8);
+
+			FileUtils::deleteFile(path);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(MySocketExcep& e)
+	{
+		failTest(e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ResourceFileSender::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,75 @@
+/*=====================================================================
+ResourceFileSender.h
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <SocketInterface.h>
+#include <Platform.h>
+#include <string>
+#include <vector>
+#include <atomic>
+class MemMappedFile;
+
+
+/*=====================================================================
+ResourceFileSender
+------------------
+Sends a byte range of a resource file over a socket.
+
+On Linux, if the socket is a plain (non-TLS) MySocket, the data is sent with sendfile(),
+so is never copied into user space.
+Otherwise the file data is written to the socket in chunks of at most MAX_CHUNK_SIZE bytes,
+so the memory used per connection is bounded regardless of the file size.
+=====================================================================*/
+class ResourceFileSender
+{
+public:
+	ResourceFileSender();
+	~ResourceFileSender();
+
+	static const size_t MAX_CHUNK_SIZE = 256 * 1024;
+
+	// Throws glare::Exception on failure.
+	void open(const std::string& path);
+	void close();
+
+	uint64 fileSize() const { return file_size; }
+
+	// Sends bytes [offset, offset + len) of the open file.  Requires offset + len <= fileSize().
+	// Throws glare::Exception or MySocketExcep on failure.
+	void sendRange(SocketInterface& socket, uint64 offset, uint64 len);
+
+	// Like sendRange(), but always copies the data through user space in bounded chunks.
+	void sendRangeCopied(SocketInterface& socket, uint64 offset, uint64 len);
+
+	uint64 num_bytes_sent_zero_copy;
+	uint64 num_bytes_sent_copied;
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ResourceFileSender);
+
+	uint64 file_size;
+#if defined(_WIN32) || defined(OSX)
+	MemMappedFile* mapped_file;
+#else
+	int fd;
+	std::vector<uint8> chunk_buf; // Only allocated if needed.
+#endif
+};
+
+
+// Totals over all resource download connections, printed periodically by the main server thread.
+struct ResourceSendStats
+{
+	ResourceSendStats() : num_files_sent(0), num_files_resumed(0), num_bytes_sent_zero_copy(0), num_bytes_sent_copied(0) {}
+
+	std::atomic<uint64> num_files_sent;
+	std::atomic<uint64> num_files_resumed; // Number of files sent starting from a non-zero offset, to resume an interrupted download.
+	std::atomic<uint64> num_bytes_sent_zero_copy;
+	std::atomic<uint64> num_bytes_sent_copied;
+};
@@ -0,0 +1,187 @@
+/*=====================================================================
+ResourceRequestScheduler.cpp
+----------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ResourceRequestScheduler.h"
+
+
+#include <Exception.h>
+#include <StringUtils.h>
+
+
+ResourceRequestScheduler::ResourceRequestScheduler()
+:	next_seq(0)
+{}
+
+
+ResourceRequestScheduler::~ResourceRequestScheduler()
+{}
+
+
+void ResourceRequestScheduler::addRequest(const Reference<Request>& request)
+{
+	if(requests.size() >= MAX_NUM_REQUESTS)
+		throw glare::Exception("Too many outstanding resource requests.");
+
+	if(requests.count(request->request_id) != 0)
+		throw glare::Exception("Resource request id " + toString(request->request_id) + " already in use.");
+
+	request->seq = next_seq++;
+	requests[request->request_id] = request;
+}
+
+
+void ResourceRequestScheduler::setPriority(uint32 request_id, float priority)
+{
+	auto res = requests.find(request_id);
+	if(res != requests.end())
+		res->second->priority = priority;
+}
+
+
+Reference<ResourceRequestScheduler::Request> ResourceRequestScheduler::removeRequest(uint32 request_id)
+{
+	auto res = requests.find(request_id);
+	if(res == requests.end())
+		return NULL;
+
+	Reference<Request> request = res->second;
+	requests.erase(res);
+	return request;
+}
+
+
+ResourceRequestScheduler::Request* ResourceRequestScheduler::getNextRequest()
+{
+	Request* best = NULL;
+	for(auto it = requests.begin(); it != requests.end(); ++it)
+	{
+		Request* request = it->second.ptr();
+		if(!best || (request->priority < best->priority) || ((request->priority == best->priority) && (request->seq < best->seq)))
+			best = request;
+	}
+	return best;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <maths/mathstypes.h>
+
+
+static Reference<ResourceRequestScheduler::Request> makeTestRequest(uint32 request_id, float priority, uint64 size)
+{
+	Reference<ResourceRequestScheduler::Request> request = new ResourceRequestScheduler::Request();
+	request->request_id = request_id;
+	request->priority = priority;
+	request->start_offset = 0;
+	request->offset = 0;
+	request->end = size;
+	return request;
+}
+
+
+// Sends chunks of at most chunk_size bytes, like WorkerThread does, until request_id completes.  Returns the number of bytes sent in total.
+static uint64 sendUntilComplete(ResourceRequestScheduler& scheduler, uint32 request_id, uint64 chunk_size)
+{
+	uint64 total_sent = 0;
+	while(1)
+	{
+		ResourceRequestScheduler::Request* request = scheduler.getNextRequest();
+		testAssert(request != NULL);
+
+		const uint64 len = myMin(request->end - request->offset, chunk_size);
+		request->offset += len;
+		total_sent += len;
+
+		if(request->offset == request->end)
+		{
+			const uint32 completed_id = request->request_id;
+			scheduler.removeRequest(completed_id);
+			if(completed_id == request_id)
+				return total_sent;
+		}
+	}
+}
+
+
+void ResourceRequestScheduler::test()
+{
+	conPrint("ResourceRequestScheduler::test()");
+
+	// Test the lowest priority value is chosen, with ties broken by request order.
+	{
+		ResourceRequestScheduler scheduler;
+		testAssert(scheduler.getNextRequest() == NULL);
+
+		scheduler.addRequest(makeTestRequest(10, 5.f, 100));
+		scheduler.addRequest(makeTestRequest(3, 2.f, 100));
+		scheduler.addRequest(makeTestRequest(7, 2.f, 100));
+		testAssert(scheduler.numRequests() == 3);
+		testAssert(scheduler.getNextRequest()->request_id == 3);
+
+		// Reprioritise
+		scheduler.setPriority(10, 1.f);
+		testAssert(scheduler.getNextRequest()->request_id == 10);
+		scheduler.setPriority(12345, 0.f); // Unknown ids should be ignored
+		testAssert(scheduler.getNextRequest()->request_id == 10);
+
+		// Cancel
+		testAssert(scheduler.removeRequest(10).nonNull());
+		testAssert(scheduler.removeRequest(10).isNull());
+		testAssert(scheduler.getNextRequest()->request_id == 3);
+		testAssert(scheduler.removeRequest(3).nonNull());
+		testAssert(scheduler.getNextRequest()->request_id == 7);
+		testAssert(scheduler.removeRequest(7).nonNull());
+		testAssert(scheduler.getNextRequest() == NULL);
+	}
+
+	// Test duplicate ids and too many requests are rejected.
+	{
+		ResourceRequestScheduler scheduler;
+		scheduler.addRequest(makeTestRequest(1, 1.f, 100));
+		try
+		{
+			scheduler.addRequest(makeTestRequest(1, 1.f, 100));
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+
+		for(uint32 i=2; i<=MAX_NUM_REQUESTS; ++i)
+			scheduler.addRequest(makeTestRequest(i, 1.f, 100));
+		try
+		{
+			scheduler.addRequest(makeTestRequest(1000, 1.f, 100));
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+	}
+
+	// Test a small, important request made after a large one only waits for the chunk in progress, not the whole large file.
+	{
+		ResourceRequestScheduler scheduler;
+		const uint64 chunk_size = 64 * 1024;
+		scheduler.addRequest(makeTestRequest(1, 10.f, 50 * 1024 * 1024));
+
+		// Send a few chunks of the large file, then request the small one.
+		for(int i=0; i<4; ++i)
+			scheduler.getNextRequest()->offset += chunk_size;
+		scheduler.addRequest(makeTestRequest(2, 1.f, 100 * 1024));
+
+		const uint64 sent_before_small_done = sendUntilComplete(scheduler, 2, chunk_size);
+		testAssert(sent_before_small_done == 100 * 1024);
+		testAssert(scheduler.numRequests() == 1);
+		testAssert(scheduler.getNextRequest()->request_id == 1);
+	}
+
+	conPrint("ResourceRequestScheduler::test() done");
+}
+
+
+#endif // BUILD_TESTS
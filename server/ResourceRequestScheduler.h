@@ -0,0 +1,64 @@
+/*=====================================================================
+ResourceRequestScheduler.h
+--------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "ResourceFileSender.h"
+#include <RefCounted.h>
+#include <Reference.h>
+#include <Platform.h>
+#include <map>
+
+
+/*=====================================================================
+ResourceRequestScheduler
+------------------------
+The outstanding multiplexed resource requests (Protocol::ResourceRequest) for one resource download connection.
+
+The connection sends the data for the requests in chunks, and getNextRequest() chooses which request the next
+chunk comes from: the request with the lowest priority value, with ties broken by request order.
+So a small, close texture requested after a large model will be sent ahead of the rest of the model, and
+the client can reprioritise requests as the camera moves.
+
+The number of outstanding requests is limited to MAX_NUM_REQUESTS, so a linear scan to find the next request is fine.
+Not threadsafe, used by the WorkerThread handling the connection.
+=====================================================================*/
+class ResourceRequestScheduler
+{
+public:
+	ResourceRequestScheduler();
+	~ResourceRequestScheduler();
+
+	static const size_t MAX_NUM_REQUESTS = 64;
+
+	struct Request : public RefCounted
+	{
+		uint32 request_id;
+		float priority; // Lower values are more important.
+		uint64 seq; // Order the request was added, to break ties.
+		uint64 start_offset; // Offset in the file the client asked to start from, clamped to the file size.
+		uint64 offset; // Offset in the file of the next byte to send.
+		uint64 end; // End offset (file size)
+		ResourceFileSender file_sender;
+	};
+
+	// Throws glare::Exception if there are too many outstanding requests, or a request with the same id is outstanding.
+	void addRequest(const Reference<Request>& request);
+
+	void setPriority(uint32 request_id, float priority); // Does nothing if there is no such outstanding request (it may have completed already).
+
+	Reference<Request> removeRequest(uint32 request_id); // Returns the removed request, or NULL if there is no such outstanding request.
+
+	Request* getNextRequest(); // Returns the request to send the next chunk for, or NULL if there are no outstanding requests.
+
+	size_t numRequests() const { return requests.size(); }
+
+	static void test();
+
+private:
+	std::map<uint32, Reference<Request>> requests;
+	uint64 next_seq;
+};
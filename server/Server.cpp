@@ -10,6 +10,7 @@ Copyright Glare Technologies Limited 2023 -
 #include "UDPHandlerThread.h"
 #include "MeshLODGenThread.h"
 #include "DynamicTextureUpdaterThread.h"
+#include "DatabaseWriterThread.h"
 //#include "ChunkGenThread.h"
 #include "WorkerThread.h"
 #include "ServerTestSuite.h"
@@ -17,6 +18,7 @@ Copyright Glare Technologies Limited 2023 -
 #include "../shared/Protocol.h"
 #include "../shared/Version.h"
 #include "../shared/MessageUtils.h"
+#include "../shared/QuantizedTransformUpdates.h"
 #include "../webserver/WebServerRequestHandler.h"
 #include "../webserver/AccountHandlers.h"
 #include "../webserver/WebDataStore.h"
@@ -47,12 +49,15 @@ Copyright Glare Technologies Limited 2023 -
 #include <utils/SocketBufferOutStream.h>
 #include <utils/OpenSSL.h>
 #include <tls.h>
+#include <ctime>
 
 
 void updateMapTiles(ServerAllWorldsState& world_state)
 {
 	uint64 next_shot_id = world_state.getNextScreenshotUID();
 
+	Lock lock(world_state.screenshots_mutex);
+
 	const int z_begin = 0;
 	const int z_end = 7;
 	if(true) // world_state.map_tile_info.empty())
@@ -126,17 +131,16 @@ void updateMapTiles(ServerAllWorldsState& world_state)
 }
 
 
-static void enqueueMessageToBroadcast(SocketBufferOutStream& packet_buffer, std::vector<std::string>& broadcast_packets)
+// Appends the message in packet_buffer to the world batch.
+static void enqueueMessageToBroadcast(SocketBufferOutStream& packet_buffer, js::Vector<uint8, 16>& world_batch)
 {
 	MessageUtils::updatePacketLengthField(packet_buffer);
 
 	if(packet_buffer.buf.size() > 0)
 	{
-		std::string packet_string(packet_buffer.buf.size(), '\0');
-
-		std::memcpy(&packet_string[0], packet_buffer.buf.data(), packet_buffer.buf.size());
-
-		broadcast_packets.push_back(packet_string);
+		const size_t write_i = world_batch.size();
+		world_batch.resize(write_i + packet_buffer.buf.size());
+		std::memcpy(&world_batch[write_i], packet_buffer.buf.data(), packet_buffer.buf.size());
 	}
 }
 
@@ -183,6 +187,22 @@ static ServerConfig parseServerConfig(const std::string& config_path)
 	config.tls_private_key_path			= XMLParseUtils::parseStringWithDefault(root_elem, "tls_private_key_path", /*default val=*/"");
 	config.allow_light_mapper_bot_full_perms = XMLParseUtils::parseBoolWithDefault(root_elem, "allow_light_mapper_bot_full_perms", /*default val=*/false);
 	config.update_parcel_sales			= XMLParseUtils::parseBoolWithDefault(root_elem, "update_parcel_sales", /*default val=*/false);
+
+	const UpdateInterestFilterConfig default_filter_config;
+	config.update_interest_filter_config.full_rate_radius		= XMLParseUtils::parseDoubleWithDefault(root_elem, "update_full_rate_radius", /*default val=*/default_filter_config.full_rate_radius);
+	config.update_interest_filter_config.max_radius				= XMLParseUtils::parseDoubleWithDefault(root_elem, "update_max_radius", /*default val=*/default_filter_config.max_radius);
+	config.update_interest_filter_config.distant_update_period	= XMLParseUtils::parseDoubleWithDefault(root_elem, "distant_update_period", /*default val=*/default_filter_config.distant_update_period);
+	config.update_interest_filter_config.max_out_of_range_updates = XMLParseUtils::parseIntWithDefault(root_elem, "update_max_out_of_range_updates", /*default val=*/default_filter_config.max_out_of_range_updates);
+
+	const VoiceRelayConfig default_voice_relay_config;
+	config.voice_relay_config.max_audible_dist = XMLParseUtils::parseDoubleWithDefault(root_elem, "voice_max_audible_dist", /*default val=*/default_voice_relay_config.max_audible_dist);
+
+	const ServerConfig default_config;
+	config.use_connection_io_pool					= XMLParseUtils::parseBoolWithDefault(root_elem, "use_connection_io_pool", /*default val=*/default_config.use_connection_io_pool);
+	config.connection_io_pool_num_io_threads		= XMLParseUtils::parseIntWithDefault(root_elem, "connection_io_pool_num_io_threads", /*default val=*/default_config.connection_io_pool_num_io_threads);
+	config.connection_io_pool_num_worker_threads	= XMLParseUtils::parseIntWithDefault(root_elem, "connection_io_pool_num_worker_threads", /*default val=*/default_config.connection_io_pool_num_worker_threads);
+	config.connection_io_pool_max_stall_time		= XMLParseUtils::parseDoubleWithDefault(root_elem, "connection_io_pool_max_stall_time", /*default val=*/default_config.connection_io_pool_max_stall_time);
+	config.compress_object_query_responses			= XMLParseUtils::parseBoolWithDefault(root_elem, "compress_object_query_responses", /*default val=*/default_config.compress_object_query_responses);
 	return config;
 }
 
@@ -445,6 +465,12 @@ int main(int argc, char *argv[])
 		if(tls_config_set_key_file(tls_configuration, tls_private_key_path.c_str()) != 0) // set private key
 			throw glare::Exception("tls_config_set_key_file failed: " + getTLSConfigErrorString(tls_configuration));
 
+		if(server.config.use_connection_io_pool && ConnectionIOPool::isSupported())
+		{
+			conPrint("Creating ConnectionIOPool...");
+			server.connection_io_pool = new ConnectionIOPool(server.config.connection_io_pool_num_io_threads, server.config.connection_io_pool_num_worker_threads, server.config.connection_io_pool_max_stall_time);
+		}
+
 		conPrint("Launching ListenerThread...");
 
 		ThreadManager thread_manager;
@@ -453,7 +479,7 @@ int main(int argc, char *argv[])
 		conPrint("Done.");
 		//----------------------------------------------- End launch substrata protocol server -----------------------------------------------
 
-		server.mesh_lod_gen_thread_manager.addThread(new MeshLODGenThread(server.world_state.ptr()));
+		server.mesh_lod_gen_thread_manager.addThread(new MeshLODGenThread(server.world_state.ptr(), server_state_dir + "/resource_facts_cache.bin"));
 
 		//thread_manager.addThread(new ChunkGenThread(server.world_state.ptr()));
 
@@ -461,311 +487,490 @@ int main(int argc, char *argv[])
 
 		server.dyn_tex_updater_thread_manager.addThread(new DynamicTextureUpdaterThread(&server, server.world_state.ptr()));
 
+		server.database_writer_thread_manager.addThread(new DatabaseWriterThread(server.world_state.ptr()));
+
 		Timer save_state_timer;
+		bool checkpoint_deferred = false; // True if a checkpoint is due, but the previous one is still being written.
+		int num_checkpoints_deferred = 0;
+		Timer time_sync_timer;
+		Timer parcel_sales_timer;
+
+		// Updates are broadcast as soon as something is marked dirty and notifyUpdatesPending() is called, but not more often than MIN_BROADCAST_PERIOD,
+		// so that under load, many updates get coalesced into a single batch per world.
+		const double MIN_BROADCAST_PERIOD = 0.01;
+		Timer last_broadcast_timer;
+
+		// Broadcast stats, printed periodically.
+		Timer broadcast_stats_timer;
+		std::clock_t broadcast_stats_cpu_start = std::clock(); // For the process CPU time over the stats period, over all threads.
+		int num_broadcasts = 0;
+		size_t num_batch_bytes = 0; // Total size of the encoded world batches.
+		size_t num_fanned_out_bytes = 0; // Total size of the world batches summed over all recipients.
+		double broadcast_time = 0; // Time spent building and fanning out batches.
+
+		// Messages to send to clients connected to a world.
+		struct WorldBroadcast
+		{
+			SharedPacketBufferRef batch; // Messages sent to every client in the world.  Built once, and the same buffer is enqueued to every recipient.
+			TransformUpdateBatch transform_updates; // Transform updates, filtered per client by the client's UpdateInterestFilter.
+		};
+		std::map<std::string, WorldBroadcast> world_broadcasts; // Map from world name to broadcast for that world.
+		std::vector<std::pair<std::string, Reference<ServerWorldState>>> worlds; // Copy of world_states, so we only need to lock each world's mutex while building its batch.
+		const TransformUpdateBatch empty_transform_updates;
+		SocketBufferOutStream filtered_updates_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		// Area-of-interest filtering stats
+		uint64 num_filtered_bytes_sent = 0;
+		uint64 num_filtered_bytes_saved = 0;
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
-		// A map from world name to a vector of packets to send to clients connected to that world.
-		std::map<std::string, std::vector<std::string>> broadcast_packets;
+		// The voice relay client set has the avatar positions used for audible distance filtering, so is rebuilt regularly, as well as when clients connect or disconnect.
+		const double VOICE_RELAY_CLIENTS_UPDATE_PERIOD = 0.25;
+		Timer voice_relay_clients_timer;
 
 		// Main server loop
 		uint64 loop_iter = 0;
 		while(1)
 		{
-			PlatformUtils::Sleep(100);
+			// Wait until there are updates to broadcast, or until a timeout, so that the periodic tasks below still run.
+			server.waitForUpdatesPending(/*max wait time=*/0.1);
 
-			SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+			const double time_since_last_broadcast = last_broadcast_timer.elapsed();
+			if(time_since_last_broadcast < MIN_BROADCAST_PERIOD)
+				PlatformUtils::Sleep(1 + (int)((MIN_BROADCAST_PERIOD - time_since_last_broadcast) * 1000));
+			last_broadcast_timer.reset();
+
+			Timer broadcast_timer;
+			world_broadcasts.clear();
 
 			{ // Begin scope for world_state->mutex lock
 
-				Lock lock(server.world_state->mutex);
+				TimedLock lock(server.world_state->mutex, server.world_state->mutex_wait_stats);
+
+				worlds.assign(server.world_state->world_states.begin(), server.world_state->world_states.end());
 
-				for(auto world_it = server.world_state->world_states.begin(); world_it != server.world_state->world_states.end(); ++world_it)
+				if(server.world_state->server_admin_message_changed)
 				{
-					Reference<ServerWorldState> world_state = world_it->second;
+					conPrint("Sending ServerAdminMessages to clients...");
+
+					// Send out ServerAdminMessageID packets to clients
+					MessageUtils::initPacket(scratch_packet, Protocol::ServerAdminMessageID);
+					scratch_packet.writeStringLengthFirst(server.world_state->server_admin_message);
+					MessageUtils::updatePacketLengthField(scratch_packet);
+
+					server.enqueuePacketToAllClients(scratch_packet);
+
+					server.world_state->server_admin_message_changed = false;
+				}
+			} // End scope for world_state->mutex lock
+
+			// Build the batch for each world, while holding just that world's mutex.
+			for(auto world_it = worlds.begin(); world_it != worlds.end(); ++world_it)
+			{
+				ServerWorldState* world_state = world_it->second.ptr();
+
+				TimedLock world_lock(world_state->mutex, world_state->mutex_wait_stats);
 
-					std::vector<std::string>& world_packets = broadcast_packets[world_it->first];
+				if(world_state->dirty_avatars.empty() && world_state->dirty_from_remote_objects.empty())
+					continue;
 
-					// Generate packets for avatar changes
-					for(auto i = world_state->avatars.begin(); i != world_state->avatars.end();)
+				WorldBroadcast& world_broadcast = world_broadcasts[world_it->first];
+				world_broadcast.batch = new SharedPacketBuffer();
+				js::Vector<uint8, 16>& world_packets = world_broadcast.batch->data;
+				TransformUpdateBatch& transform_updates = world_broadcast.transform_updates;
+
+				// Generate packets for avatar changes
+				for(auto dirty_it = world_state->dirty_avatars.begin(); dirty_it != world_state->dirty_avatars.end(); ++dirty_it)
+				{
+					const auto i = world_state->avatars.find(*dirty_it);
+					if(i == world_state->avatars.end())
+						continue;
+
+					Avatar* avatar = i->second.getPointer();
+					if(avatar->other_dirty)
 					{
-						Avatar* avatar = i->second.getPointer();
-						if(avatar->other_dirty)
+						if(avatar->state == Avatar::State_Alive)
 						{
-							if(avatar->state == Avatar::State_Alive)
-							{
-								// Send AvatarFullUpdate packet
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarFullUpdate);
-								writeAvatarToNetworkStream(*avatar, scratch_packet);
-
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
-
-								avatar->other_dirty = false;
-								avatar->transform_dirty = false;
-								i++;
-							}
-							else if(avatar->state == Avatar::State_JustCreated)
-							{
-								// Send AvatarCreated packet
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarCreated);
-								writeAvatarToNetworkStream(*avatar, scratch_packet);
-
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
-
-								avatar->state = Avatar::State_Alive;
-								avatar->other_dirty = false;
-								avatar->transform_dirty = false;
-
-								i++;
-							}
-							else if(avatar->state == Avatar::State_Dead)
-							{
-								// Send AvatarDestroyed packet
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarDestroyed);
-								writeToStream(avatar->uid, scratch_packet);
-
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
-
-								// Remove avatar from avatar map
-								auto old_avatar_iterator = i;
-								i++;
-								world_state->avatars.erase(old_avatar_iterator);
-
-								conPrint("Removed avatar from world_state->avatars");
-							}
-							else
-							{
-								assert(0);
-							}
+							// Send AvatarFullUpdate packet
+							MessageUtils::initPacket(scratch_packet, Protocol::AvatarFullUpdate);
+							writeAvatarToNetworkStream(*avatar, scratch_packet);
+
+							enqueueMessageToBroadcast(scratch_packet, world_packets);
+							transform_updates.addSupersededKey(TransformUpdateBatch::makeAvatarKey(avatar->uid));
+
+							avatar->other_dirty = false;
+							avatar->transform_dirty = false;
 						}
-						else if(avatar->transform_dirty)
+						else if(avatar->state == Avatar::State_JustCreated)
 						{
-							if(avatar->state == Avatar::State_Alive)
-							{
-								// Send AvatarTransformUpdate packet
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
-								writeToStream(avatar->uid, scratch_packet);
-								writeToStream(avatar->pos, scratch_packet);
-								writeToStream(avatar->rotation, scratch_packet);
-								scratch_packet.writeUInt32(avatar->anim_state);
-
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
-
-								avatar->transform_dirty = false;
-							}
-							i++;
+							// Send AvatarCreated packet
+							MessageUtils::initPacket(scratch_packet, Protocol::AvatarCreated);
+							writeAvatarToNetworkStream(*avatar, scratch_packet);
+
+							enqueueMessageToBroadcast(scratch_packet, world_packets);
+							transform_updates.addSupersededKey(TransformUpdateBatch::makeAvatarKey(avatar->uid));
+
+							avatar->state = Avatar::State_Alive;
+							avatar->other_dirty = false;
+							avatar->transform_dirty = false;
 						}
-						else
+						else if(avatar->state == Avatar::State_Dead)
 						{
-							i++;
-						}
-					}
+							// Send AvatarDestroyed packet
+							MessageUtils::initPacket(scratch_packet, Protocol::AvatarDestroyed);
+							writeToStream(avatar->uid, scratch_packet);
 
+							enqueueMessageToBroadcast(scratch_packet, world_packets);
+							transform_updates.addSupersededKey(TransformUpdateBatch::makeAvatarKey(avatar->uid));
 
-					// Generate packets for object changes
-					for(auto i = world_state->dirty_from_remote_objects.begin(); i != world_state->dirty_from_remote_objects.end(); ++i)
-					{
-						WorldObject* ob = i->ptr();
-						if(ob->from_remote_other_dirty)
+							// Remove avatar from avatar map
+							world_state->avatars.erase(i);
+
+							conPrint("Removed avatar from world_state->avatars");
+						}
+						else
 						{
-							// conPrint("Object 'other' dirty, sending full update");
-
-							if(ob->state == WorldObject::State_Alive)
-							{
-								// Send ObjectFullUpdate packet
-								MessageUtils::initPacket(scratch_packet, Protocol::ObjectFullUpdate);
-								ob->writeToNetworkStream(scratch_packet);
-
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
-
-								ob->from_remote_other_dirty = false;
-								ob->from_remote_transform_dirty = false; // transform is sent in full packet also.
-								server.world_state->markAsChanged();
-							}
-							else if(ob->state == WorldObject::State_JustCreated)
-							{
-								// Send ObjectCreated packet
-								MessageUtils::initPacket(scratch_packet, Protocol::ObjectCreated);
-								ob->writeToNetworkStream(scratch_packet);
-
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
-
-								ob->state = WorldObject::State_Alive;
-								ob->from_remote_other_dirty = false;
-								server.world_state->markAsChanged();
-							}
-							else if(ob->state == WorldObject::State_Dead)
-							{
-								// Send ObjectDestroyed packet
-								MessageUtils::initPacket(scratch_packet, Protocol::ObjectDestroyed);
-								writeToStream(ob->uid, scratch_packet);
-
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
-
-								// Remove from dirty-set, so it's not updated in DB.
-								world_state->db_dirty_world_objects.erase(ob);
-
-								// Add DB record to list of records to be deleted.
-								server.world_state->db_records_to_delete.insert(ob->database_key);
-
-								// Remove ob from object map
-								world_state->objects.erase(ob->uid);
-
-								conPrint("Removed object from world_state->objects");
-								server.world_state->markAsChanged();
-							}
-							else
-							{
-								conPrint("ERROR: invalid object state (ob->state=" + toString(ob->state) + ")");
-								assert(0);
-							}
+							assert(0);
 						}
-						else if(ob->from_remote_transform_dirty)
+					}
+					else if(avatar->transform_dirty)
+					{
+						if(avatar->state == Avatar::State_Alive)
 						{
-							//conPrint("Object 'transform' dirty, sending transform update");
-
-							if(ob->state == WorldObject::State_Alive)
-							{
-								// Send ObjectTransformUpdate packet
-								MessageUtils::initPacket(scratch_packet, Protocol::ObjectTransformUpdate);
-								writeToStream(ob->uid, scratch_packet);
-								writeToStream(ob->pos, scratch_packet);
-								writeToStream(ob->axis, scratch_packet);
-								scratch_packet.writeFloat(ob->angle);
-								writeToStream(ob->scale, scratch_packet);
+							// Send AvatarTransformUpdate packet
+							MessageUtils::initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
+							writeToStream(avatar->uid, scratch_packet);
+							writeToStream(avatar->pos, scratch_packet);
+							writeToStream(avatar->rotation, scratch_packet);
+							scratch_packet.writeUInt32(avatar->anim_state);
+							MessageUtils::updatePacketLengthField(scratch_packet);
 
-								scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
+							QuantizedTransformUpdate quantized;
+							const bool quantized_ok = QuantizedTransformUpdates::quantizeAvatarTransform(avatar->uid, avatar->pos, avatar->rotation, avatar->anim_state, quantized);
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+							transform_updates.addUpdate(TransformUpdateBatch::makeAvatarKey(avatar->uid), avatar->pos, scratch_packet, quantized_ok ? &quantized : NULL);
 
-								ob->from_remote_transform_dirty = false;
-								server.world_state->markAsChanged();
-							}
+							avatar->transform_dirty = false;
 						}
-						else if(ob->from_remote_physics_transform_dirty)
-						{
-							//conPrint("Object 'physics transform' dirty, sending physics transform update");
+					}
+				}
+				world_state->dirty_avatars.clear();
 
-							if(ob->state == WorldObject::State_Alive)
-							{
-								// Send ObjectPhysicsTransformUpdate packet
-								MessageUtils::initPacket(scratch_packet, Protocol::ObjectPhysicsTransformUpdate);
-								writeToStream(ob->uid, scratch_packet);
-								writeToStream(ob->pos, scratch_packet);
 
-								const Quatf rot = Quatf::fromAxisAndAngle(ob->axis, ob->angle);
-								scratch_packet.writeData(&rot.v.x, sizeof(float) * 4);
+				// Generate packets for object changes
+				for(auto i = world_state->dirty_from_remote_objects.begin(); i != world_state->dirty_from_remote_objects.end(); ++i)
+				{
+					WorldObject* ob = i->ptr();
+					if(ob->from_remote_other_dirty)
+					{
+						// conPrint("Object 'other' dirty, sending full update");
 
-								scratch_packet.writeData(ob->linear_vel.x, sizeof(float) * 3);
-								scratch_packet.writeData(ob->angular_vel.x, sizeof(float) * 3);
+						if(ob->state == WorldObject::State_Alive)
+						{
+							// Send ObjectFullUpdate packet
+							MessageUtils::initPacket(scratch_packet, Protocol::ObjectFullUpdate);
+							ob->writeToNetworkStream(scratch_packet);
 
-								scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
-								scratch_packet.writeDouble(ob->last_transform_client_time);
+							enqueueMessageToBroadcast(scratch_packet, world_packets);
+							transform_updates.addSupersededKey(TransformUpdateBatch::makeObjectKey(ob->uid));
 
-								enqueueMessageToBroadcast(scratch_packet, world_packets);
+							ob->from_remote_other_dirty = false;
+							ob->from_remote_transform_dirty = false; // transform is sent in full packet also.
+							server.world_state->markAsChanged();
+						}
+						else if(ob->state == WorldObject::State_JustCreated)
+						{
+							// Send ObjectCreated packet
+							MessageUtils::initPacket(scratch_packet, Protocol::ObjectCreated);
+							ob->writeToNetworkStream(scratch_packet);
+
+							enqueueMessageToBroadcast(scratch_packet, world_packets);
+							transform_updates.addSupersededKey(TransformUpdateBatch::makeObjectKey(ob->uid));
 
-								ob->from_remote_transform_dirty = false;
-								server.world_state->markAsChanged();
-							}
+							ob->state = WorldObject::State_Alive;
+							ob->from_remote_other_dirty = false;
+							server.world_state->markAsChanged();
 						}
-						else if(ob->from_remote_lightmap_url_dirty)
+						else if(ob->state == WorldObject::State_Dead)
 						{
-							// Send ObjectLightmapURLChanged packet
-							MessageUtils::initPacket(scratch_packet, Protocol::ObjectLightmapURLChanged);
+							// Send ObjectDestroyed packet
+							MessageUtils::initPacket(scratch_packet, Protocol::ObjectDestroyed);
 							writeToStream(ob->uid, scratch_packet);
-							scratch_packet.writeStringLengthFirst(ob->lightmap_url);
 
 							enqueueMessageToBroadcast(scratch_packet, world_packets);
+							transform_updates.addSupersededKey(TransformUpdateBatch::makeObjectKey(ob->uid));
+
+							// Remove from dirty-set, so it's not updated in DB.
+							world_state->db_dirty_world_objects.erase(ob);
+
+							// Add DB record to list of records to be deleted.
+							world_state->db_records_to_delete.insert(ob->database_key);
 
-							ob->from_remote_lightmap_url_dirty = false;
+							// Remove ob from object map and spatial index
+							world_state->removeObject(ob);
+
+							conPrint("Removed object from world_state->objects");
 							server.world_state->markAsChanged();
 						}
-						else if(ob->from_remote_model_url_dirty)
+						else
+						{
+							conPrint("ERROR: invalid object state (ob->state=" + toString(ob->state) + ")");
+							assert(0);
+						}
+					}
+					else if(ob->from_remote_transform_dirty)
+					{
+						//conPrint("Object 'transform' dirty, sending transform update");
+
+						if(ob->state == WorldObject::State_Alive)
 						{
-							// Send ObjectModelURLChanged packet
-							MessageUtils::initPacket(scratch_packet, Protocol::ObjectModelURLChanged);
+							// Send ObjectTransformUpdate packet
+							MessageUtils::initPacket(scratch_packet, Protocol::ObjectTransformUpdate);
 							writeToStream(ob->uid, scratch_packet);
-							scratch_packet.writeStringLengthFirst(ob->model_url);
+							writeToStream(ob->pos, scratch_packet);
+							writeToStream(ob->axis, scratch_packet);
+							scratch_packet.writeFloat(ob->angle);
+							writeToStream(ob->scale, scratch_packet);
 
-							enqueueMessageToBroadcast(scratch_packet, world_packets);
+							scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
+							MessageUtils::updatePacketLengthField(scratch_packet);
+
+							transform_updates.addUpdate(TransformUpdateBatch::makeObjectKey(ob->uid), ob->pos, scratch_packet, /*quantized=*/NULL); // ObjectTransformUpdate doesn't have a quantized form.
 
-							ob->from_remote_model_url_dirty = false;
+							ob->from_remote_transform_dirty = false;
 							server.world_state->markAsChanged();
 						}
-						else if(ob->from_remote_flags_dirty)
+					}
+					else if(ob->from_remote_physics_transform_dirty)
+					{
+						//conPrint("Object 'physics transform' dirty, sending physics transform update");
+
+						if(ob->state == WorldObject::State_Alive)
 						{
-							// Send ObjectFlagsChanged packet
-							MessageUtils::initPacket(scratch_packet, Protocol::ObjectFlagsChanged);
+							// Send ObjectPhysicsTransformUpdate packet
+							MessageUtils::initPacket(scratch_packet, Protocol::ObjectPhysicsTransformUpdate);
 							writeToStream(ob->uid, scratch_packet);
-							scratch_packet.writeUInt32(ob->flags);
+							writeToStream(ob->pos, scratch_packet);
 
-							enqueueMessageToBroadcast(scratch_packet, world_packets);
+							const Quatf rot = Quatf::fromAxisAndAngle(ob->axis, ob->angle);
+							scratch_packet.writeData(&rot.v.x, sizeof(float) * 4);
+
+							scratch_packet.writeData(ob->linear_vel.x, sizeof(float) * 3);
+							scratch_packet.writeData(ob->angular_vel.x, sizeof(float) * 3);
 
-							ob->from_remote_flags_dirty = false;
+							scratch_packet.writeUInt32(ob->last_transform_update_avatar_uid);
+							scratch_packet.writeDouble(ob->last_transform_client_time);
+							MessageUtils::updatePacketLengthField(scratch_packet);
+
+							QuantizedTransformUpdate quantized;
+							const bool quantized_ok = QuantizedTransformUpdates::quantizeObjectPhysicsTransform(ob->uid, ob->pos, rot, ob->linear_vel, ob->angular_vel, 
+								ob->last_transform_update_avatar_uid, ob->last_transform_client_time, quantized);
+
+							transform_updates.addUpdate(TransformUpdateBatch::makeObjectKey(ob->uid), ob->pos, scratch_packet, quantized_ok ? &quantized : NULL);
+
+							ob->from_remote_transform_dirty = false;
 							server.world_state->markAsChanged();
 						}
+					}
+					else if(ob->from_remote_lightmap_url_dirty)
+					{
+						// Send ObjectLightmapURLChanged packet
+						MessageUtils::initPacket(scratch_packet, Protocol::ObjectLightmapURLChanged);
+						writeToStream(ob->uid, scratch_packet);
+						scratch_packet.writeStringLengthFirst(ob->lightmap_url);
+
+						enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+						ob->from_remote_lightmap_url_dirty = false;
+						server.world_state->markAsChanged();
 					}
+					else if(ob->from_remote_model_url_dirty)
+					{
+						// Send ObjectModelURLChanged packet
+						MessageUtils::initPacket(scratch_packet, Protocol::ObjectModelURLChanged);
+						writeToStream(ob->uid, scratch_packet);
+						scratch_packet.writeStringLengthFirst(ob->model_url);
 
-					world_state->dirty_from_remote_objects.clear();
-				} // End for each server world
+						enqueueMessageToBroadcast(scratch_packet, world_packets);
 
+						ob->from_remote_model_url_dirty = false;
+						server.world_state->markAsChanged();
+					}
+					else if(ob->from_remote_flags_dirty)
+					{
+						// Send ObjectFlagsChanged packet
+						MessageUtils::initPacket(scratch_packet, Protocol::ObjectFlagsChanged);
+						writeToStream(ob->uid, scratch_packet);
+						scratch_packet.writeUInt32(ob->flags);
 
-				if(server.world_state->server_admin_message_changed)
-				{
-					conPrint("Sending ServerAdminMessages to clients...");
+						enqueueMessageToBroadcast(scratch_packet, world_packets);
 
-					// Send out ServerAdminMessageID packets to clients
-					MessageUtils::initPacket(scratch_packet, Protocol::ServerAdminMessageID);
-					scratch_packet.writeStringLengthFirst(server.world_state->server_admin_message);
-					MessageUtils::updatePacketLengthField(scratch_packet);
+						ob->from_remote_flags_dirty = false;
+						server.world_state->markAsChanged();
+					}
 
-					Lock lock3(server.worker_thread_manager.getMutex());
-					for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
+				}
+
+				world_state->dirty_from_remote_objects.clear();
+			} // End for each server world
+			worlds.clear();
+
+			// Enqueue each world batch to the worker threads for the clients connected to that world, along with the transform updates that pass the client's area-of-interest filter.
+			// This is done for every world with subscribers, even if there are no new updates, so that throttled distant updates get sent when due.
+			{
+				const double cur_time = Clock::getTimeSinceInit();
+				bool sent_data = false;
+
+				Lock lock2(server.world_subscribers_mutex);
+				for(auto sub_it = server.world_subscribers.begin(); sub_it != server.world_subscribers.end(); ++sub_it)
+				{
+					const auto res = world_broadcasts.find(sub_it->first);
+					const SharedPacketBuffer* batch = (res != world_broadcasts.end()) ? res->second.batch.ptr() : NULL;
+					const TransformUpdateBatch& transform_updates = (res != world_broadcasts.end()) ? res->second.transform_updates : empty_transform_updates;
+
+					for(auto it = sub_it->second.begin(); it != sub_it->second.end(); ++it)
 					{
-						assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-						static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(scratch_packet);
+						WorkerThread* worker = *it;
+						uint64 bytes_sent = 0;
+						uint64 bytes_saved = 0;
+
+						if(batch && !batch->data.empty())
+						{
+							worker->enqueueSharedDataToSend(res->second.batch);
+							bytes_sent += batch->data.size();
+						}
+
+						Vec3d cam_pos;
+						const bool cam_pos_known = worker->getClientCamPos(cam_pos);
+
+						filtered_updates_packet.buf.clear();
+						uint64 filtered_bytes_sent = 0;
+						const bool use_quantized_updates = worker->client_protocol_version >= 40; // QuantizedTransformUpdates was added in protocol version 40.
+						worker->update_interest_filter.filterUpdates(transform_updates, cam_pos_known, cam_pos, cur_time, server.config.update_interest_filter_config, use_quantized_updates,
+							filtered_updates_packet.buf, filtered_bytes_sent, bytes_saved);
+
+						if(!filtered_updates_packet.buf.empty())
+							worker->enqueueDataToSend(filtered_updates_packet);
+
+						bytes_sent += filtered_bytes_sent;
+						num_filtered_bytes_sent += filtered_bytes_sent;
+						num_filtered_bytes_saved += bytes_saved;
+						num_fanned_out_bytes += bytes_sent;
+
+						if(bytes_sent > 0 || bytes_saved > 0)
+						{
+							worker->addBroadcastStats(bytes_sent, bytes_saved);
+							sent_data = true;
+						}
 					}
+				}
 
-					server.world_state->server_admin_message_changed = false;
+				for(auto it = world_broadcasts.begin(); it != world_broadcasts.end(); ++it)
+					num_batch_bytes += it->second.batch->data.size() + it->second.transform_updates.data_size;
+
+				if(sent_data)
+				{
+					num_broadcasts++;
+					broadcast_time += broadcast_timer.elapsed();
 				}
+			}
 
-			} // End scope for world_state->mutex lock
+			if((server.connected_clients_changed != 0) || (voice_relay_clients_timer.elapsed() > VOICE_RELAY_CLIENTS_UPDATE_PERIOD))
+			{
+				server.updateVoiceRelayClients();
+				voice_relay_clients_timer.reset();
+			}
 
-			// Enqueue packets to worker threads to send
-			// For each connected client, get packets for the world the client is connected to, and send to them.
+			if(broadcast_stats_timer.elapsed() > 60.0)
 			{
-				Lock lock2(server.worker_thread_manager.getMutex());
-				for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
+				if(num_broadcasts > 0)
+					conPrint("Broadcasts in last " + doubleToStringNSigFigs(broadcast_stats_timer.elapsed(), 3) + " s: " + toString(num_broadcasts) + ", batch data: " + getNiceByteSize(num_batch_bytes) + 
+						", fanned-out data: " + getNiceByteSize(num_fanned_out_bytes) + " (transform updates sent: " + getNiceByteSize(num_filtered_bytes_sent) + 
+						", saved by area-of-interest filtering: " + getNiceByteSize(num_filtered_bytes_saved) + "), main thread time: " + doubleToStringNSigFigs(broadcast_time * 1.0e3, 4) + " ms (" + 
+						doubleToStringNSigFigs(broadcast_time * 1.0e6 / num_broadcasts, 4) + " us / broadcast)");
+
+				// Print process CPU time, so the cost of the broadcasts and the worker threads sending them can be compared between runs.
+				{
+					const double cpu_time = (double)(std::clock() - broadcast_stats_cpu_start) / CLOCKS_PER_SEC;
+					conPrint("Process CPU time in last " + doubleToStringNSigFigs(broadcast_stats_timer.elapsed(), 3) + " s: " + doubleToStringNSigFigs(cpu_time, 4) + " s (" + 
+						doubleToStringNSigFigs(cpu_time / broadcast_stats_timer.elapsed() * 100, 3) + "% of one core)");
+				}
+
+				// Print time spent waiting for the all-worlds mutex and the world mutexes, for locks taken with TimedLock.
+				{
+					const LockWaitStats::Snapshot all_worlds_wait_stats = server.world_state->mutex_wait_stats.getAndReset();
+					LockWaitStats::Snapshot world_wait_stats;
+					{
+						Lock lock(server.world_state->mutex);
+						for(auto it = server.world_state->world_states.begin(); it != server.world_state->world_states.end(); ++it)
+							world_wait_stats.add(it->second->mutex_wait_stats.getAndReset());
+					}
+
+					if(all_worlds_wait_stats.num_acquisitions > 0 || world_wait_stats.num_acquisitions > 0)
+						conPrint("Lock waits in last " + doubleToStringNSigFigs(broadcast_stats_timer.elapsed(), 3) + " s: all-worlds mutex: " + all_worlds_wait_stats.toString() + 
+							", world mutexes: " + world_wait_stats.toString());
+				}
+
+				// Print checkpoint latency and size stats
 				{
-					WorkerThread* worker = static_cast<WorkerThread*>(i->getPointer());
-					std::vector<std::string>& packets = broadcast_packets[worker->connected_world_name];
+					CheckpointStats checkpoint_stats;
+					{
+						Lock lock(server.world_state->checkpoint_stats_mutex);
+						checkpoint_stats = server.world_state->checkpoint_stats;
+						server.world_state->checkpoint_stats = CheckpointStats();
+					}
 
-					for(size_t z=0; z<packets.size(); ++z)
-						worker->enqueueDataToSend(packets[z]);
+					if(checkpoint_stats.num_checkpoints > 0 || num_checkpoints_deferred > 0)
+						conPrint("Checkpoints in last " + doubleToStringNSigFigs(broadcast_stats_timer.elapsed(), 3) + " s: " + checkpoint_stats.toString() + ", deferred: " + toString(num_checkpoints_deferred));
+					num_checkpoints_deferred = 0;
 				}
-			}
 
-			// Clear broadcast_packets vectors of packets.
-			for(auto it = broadcast_packets.begin(); it != broadcast_packets.end(); ++it)
-				it->second.clear();
+				// Print resource download stats
+				{
+					const uint64 num_files = server.resource_send_stats.num_files_sent.exchange(0);
+					const uint64 num_resumed = server.resource_send_stats.num_files_resumed.exchange(0);
+					const uint64 zero_copy_bytes = server.resource_send_stats.num_bytes_sent_zero_copy.exchange(0);
+					const uint64 copied_bytes = server.resource_send_stats.num_bytes_sent_copied.exchange(0);
+					if(num_files > 0)
+						conPrint("Resources served in last " + doubleToStringNSigFigs(broadcast_stats_timer.elapsed(), 3) + " s: " + toString(num_files) + " files (" + toString(num_resumed) + " resumed), " + 
+							getNiceByteSize(zero_copy_bytes) + " sent zero-copy, " + getNiceByteSize(copied_bytes) + " sent copied");
+				}
+
+				// Print voice relay throughput and latency
+				{
+					const VoiceRelayStats::Snapshot voice_stats = server.voice_relay_stats.getAndReset();
+					if(voice_stats.num_packets_relayed > 0 || voice_stats.num_packets_dropped > 0)
+						conPrint("Voice relay in last " + doubleToStringNSigFigs(broadcast_stats_timer.elapsed(), 3) + " s: " + voice_stats.toString(broadcast_stats_timer.elapsed()));
+				}
+
+				num_broadcasts = 0;
+				num_batch_bytes = 0;
+				num_fanned_out_bytes = 0;
+				num_filtered_bytes_sent = 0;
+				num_filtered_bytes_saved = 0;
+				broadcast_time = 0;
+				broadcast_stats_timer.reset();
+				broadcast_stats_cpu_start = std::clock();
+			}
 			
-			if((loop_iter % 40) == 0) // Approx every 4 s.
+			if((loop_iter == 0) || (time_sync_timer.elapsed() > 4.0)) // Every 4 s.
 			{
+				time_sync_timer.reset();
+
 				// Send out TimeSyncMessage packets to clients
 				MessageUtils::initPacket(scratch_packet, Protocol::TimeSyncMessage);
 				scratch_packet.writeDouble(server.getCurrentGlobalTime());
 				MessageUtils::updatePacketLengthField(scratch_packet);
 
-				Lock lock3(server.worker_thread_manager.getMutex());
-				for(auto i = server.worker_thread_manager.getThreads().begin(); i != server.worker_thread_manager.getThreads().end(); ++i)
-				{
-					assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-					static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(scratch_packet);
-				}
+				server.enqueuePacketToAllClients(scratch_packet);
 			}
 
 #if USE_GLARE_PARCEL_AUCTION_CODE
-			if(server_config.update_parcel_sales && ((loop_iter % 512) == 0)) // Approx every 50 s.
+			if(server_config.update_parcel_sales && ((loop_iter == 0) || (parcel_sales_timer.elapsed() > 50.0))) // Every 50 s.
 			{
+				parcel_sales_timer.reset();
+
 				AuctionManagement::updateParcelSales(*server.world_state);
 
 				// Want want to list new parcels (to bring the total number being listed up to our target number) every day at midnight UTC.
@@ -793,20 +998,44 @@ int main(int argc, char *argv[])
 
 			if(server.world_state->hasChanged() && (save_state_timer.elapsed() > 10.0))
 			{
-				try
+				if(server.world_state->checkpoint_in_progress)
 				{
-					// Save world state to disk
-					Lock lock2(server.world_state->mutex);
-
-					server.world_state->serialiseToDisk();
-
-					server.world_state->clearChangedFlag();
-					save_state_timer.reset();
+					// The previous checkpoint is still being written.  Don't capture another one until it is done, so the writer can't fall further behind.
+					// Changes keep accumulating in the dirty sets in the meantime, and will be captured by the next checkpoint.
+					if(!checkpoint_deferred)
+					{
+						conPrint("Previous checkpoint is still being written, deferring checkpoint.");
+						checkpoint_deferred = true;
+						num_checkpoints_deferred++;
+					}
 				}
-				catch(glare::Exception& e)
+				else
 				{
-					conPrint("Warning: saving world state to disk failed: " + e.what());
-					save_state_timer.reset(); // Reset timer so we don't try again straight away.
+					try
+					{
+						// Capture changes to the world state.  The database writes and flush are done by DatabaseWriterThread, without the mutex held.
+						Reference<DatabaseCheckpoint> checkpoint;
+						{
+							TimedLock lock2(server.world_state->mutex, server.world_state->mutex_wait_stats);
+
+							server.world_state->clearChangedFlag(); // Clear before capturing, so that changes made to other worlds while capturing mark the state as changed again.
+
+							checkpoint = server.world_state->captureCheckpoint();
+						}
+
+						server.world_state->checkpoint_in_progress = true;
+
+						Reference<WriteCheckpointMessage> msg = new WriteCheckpointMessage();
+						msg->checkpoint = checkpoint;
+						server.database_writer_thread_manager.enqueueMessage(msg);
+					}
+					catch(glare::Exception& e)
+					{
+						conPrint("Warning: capturing world state checkpoint failed: " + e.what());
+					}
+
+					checkpoint_deferred = false;
+					save_state_timer.reset(); // Reset timer, also so that if capturing failed, we don't try again straight away.
 				}
 			}
 
@@ -830,6 +1059,7 @@ int main(int argc, char *argv[])
 
 
 Server::Server()
+:	updates_pending(false)
 {
 	world_state = new ServerAllWorldsState();
 }
@@ -841,7 +1071,31 @@ double Server::getCurrentGlobalTime() const
 }
 
 
-void Server::clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id)
+void Server::enqueuePacketToAllClients(const SocketBufferOutStream& packet)
+{
+	{
+		Lock lock(worker_thread_manager.getMutex());
+		for(auto i = worker_thread_manager.getThreads().begin(); i != worker_thread_manager.getThreads().end(); ++i)
+		{
+			assert(dynamic_cast<WorkerThread*>(i->getPointer()));
+			static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(packet);
+		}
+	}
+
+	if(connection_io_pool.nonNull())
+	{
+		std::vector<PooledConnectionRef> pooled_connections;
+		connection_io_pool->getConnections(pooled_connections);
+		for(size_t i=0; i<pooled_connections.size(); ++i)
+		{
+			assert(dynamic_cast<WorkerThreadPooledConnection*>(pooled_connections[i].ptr()));
+			static_cast<WorkerThreadPooledConnection*>(pooled_connections[i].ptr())->worker->enqueueDataToSend(packet);
+		}
+	}
+}
+
+
+void Server::clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id, const std::string& world_name)
 {
 	conPrint("Server::clientUDPPortOpen(): worker_thread: 0x" + toHexString((uint64)worker_thread) + ", ip_addr: " + ip_addr.toString());// + ", port: " + toString(client_UDP_port));
 
@@ -850,7 +1104,7 @@ void Server::clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_
 		if(connected_clients.count(worker_thread) == 0)
 		{
 			connected_clients.insert(std::make_pair(worker_thread, 
-				ServerConnectedClientInfo({ip_addr, client_avatar_id, /*client_UDP_port=*/-1})));
+				ServerConnectedClientInfo({ip_addr, client_avatar_id, /*client_UDP_port=*/-1, world_name})));
 			connected_clients_changed = 1;
 		}
 	}
@@ -886,6 +1140,116 @@ void Server::clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip
 }
 
 
+void Server::subscribeToWorldUpdates(WorkerThread* worker_thread, const std::string& world_name)
+{
+	Lock lock(world_subscribers_mutex);
+	world_subscribers[world_name].insert(worker_thread);
+}
+
+
+void Server::unsubscribeFromWorldUpdates(WorkerThread* worker_thread)
+{
+	Lock lock(world_subscribers_mutex);
+	auto res = world_subscribers.find(worker_thread->connected_world_name);
+	if(res != world_subscribers.end())
+	{
+		res->second.erase(worker_thread);
+		if(res->second.empty())
+			world_subscribers.erase(res);
+	}
+}
+
+
+void Server::notifyUpdatesPending()
+{
+	{
+		Lock lock(updates_pending_mutex);
+		updates_pending = true;
+	}
+	updates_pending_condition.notify();
+}
+
+
+void Server::waitForUpdatesPending(double max_wait_time_s)
+{
+	Lock lock(updates_pending_mutex);
+	if(!updates_pending)
+		updates_pending_condition.waitWithTimeout(updates_pending_mutex, max_wait_time_s); // Suspend until notified, timed out, or a spurious wake up.
+	updates_pending = false;
+}
+
+
+void Server::updateVoiceRelayClients()
+{
+	VoiceRelayClientSetRef new_clients = new VoiceRelayClientSet();
+	std::vector<UID> client_avatar_uids;
+	std::map<std::string, std::vector<size_t>> world_client_indices; // Map from world name to indices of clients connected to that world.
+	{
+		Lock lock(connected_clients_mutex);
+		connected_clients_changed = 0;
+
+		for(auto it = connected_clients.begin(); it != connected_clients.end(); ++it)
+			if(it->second.client_UDP_port > 0) // If remote UDP port is known:
+			{
+				VoiceRelayClient client;
+				client.ip_addr = it->second.ip_addr;
+				client.UDP_port = it->second.client_UDP_port;
+				client.avatar_uid = (uint32)it->second.client_avatar_id.value();
+				client.world_index = 0;
+				client.pos = Vec3d(0.0);
+				client.pos_known = false;
+
+				world_client_indices[it->second.world_name].push_back(new_clients->clients.size());
+				new_clients->clients.push_back(client);
+				client_avatar_uids.push_back(it->second.client_avatar_id);
+			}
+	}
+
+	// Assign world indices, and get avatar positions, holding one world mutex at a time.
+	uint32 world_index = 0;
+	for(auto it = world_client_indices.begin(); it != world_client_indices.end(); ++it, ++world_index)
+	{
+		const std::vector<size_t>& indices = it->second;
+		for(size_t i=0; i<indices.size(); ++i)
+			new_clients->clients[indices[i]].world_index = world_index;
+
+		Reference<ServerWorldState> world;
+		{
+			Lock lock(world_state->mutex);
+			auto res = world_state->world_states.find(it->first);
+			if(res != world_state->world_states.end())
+				world = res->second;
+		}
+
+		if(world.nonNull())
+		{
+			Lock world_lock(world->mutex);
+			for(size_t i=0; i<indices.size(); ++i)
+			{
+				auto res = world->avatars.find(client_avatar_uids[indices[i]]);
+				if(res != world->avatars.end())
+				{
+					new_clients->clients[indices[i]].pos = res->second->pos;
+					new_clients->clients[indices[i]].pos_known = true;
+				}
+			}
+		}
+	}
+
+	new_clients->buildIndex();
+
+	Lock lock(voice_relay_clients_mutex);
+	voice_relay_clients = new_clients;
+}
+
+
+VoiceRelayClientSetRef Server::getVoiceRelayClients()
+{
+	Lock lock(voice_relay_clients_mutex);
+	return voice_relay_clients;
+}
+
+
 void Server::clientDisconnected(WorkerThread* worker_thread)
 {
 	conPrint("Server::clientDisconnected(): worker_thread: 0x" + toHexString((uint64)worker_thread));
@@ -7,16 +7,24 @@ Copyright Glare Technologies Limited 2016 -
 
 
 #include "ServerWorldState.h"
+#include "UpdateInterestFilter.h"
+#include "VoiceRelay.h"
+#include "ResourceFileSender.h"
+#include "ConnectionIOPool.h"
 #include "ThreadManager.h"
 #include "../shared/ResourceManager.h"
 #include <IPAddress.h>
+#include <Mutex.h>
+#include <Condition.h>
+#include <SocketBufferOutStream.h>
+#include <set>
 class WorkerThread;
 
 
 class ServerConfig
 {
 public:
-	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false) {}
+	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false), use_connection_io_pool(true), connection_io_pool_num_io_threads(2), connection_io_pool_num_worker_threads(32), connection_io_pool_max_stall_time(30.0), compress_object_query_responses(true) {}
 	
 	std::string webserver_fragments_dir; // empty string = use default.
 	std::string webserver_public_files_dir; // empty string = use default.
@@ -28,6 +36,17 @@ public:
 	bool allow_light_mapper_bot_full_perms; // Allow lightmapper bot (User account with name "lightmapperbot" to have full write permissions.
 
 	bool update_parcel_sales; // Should we run auctions?
+
+	UpdateInterestFilterConfig update_interest_filter_config; // Area-of-interest filtering of avatar and object transform update broadcasts.
+
+	VoiceRelayConfig voice_relay_config;
+
+	bool use_connection_io_pool; // Serve updates connections with a ConnectionIOPool, instead of a thread per connection.  Only supported on Linux.
+	int connection_io_pool_num_io_threads;
+	int connection_io_pool_num_worker_threads;
+	double connection_io_pool_max_stall_time; // A pooled connection's socket is shut down if a service() call sends and receives nothing for this many seconds.
+
+	bool compress_object_query_responses; // Send the ObjectInitialSend messages for object queries in CompressedMessages messages, to clients that support them.
 };
 
 
@@ -36,6 +55,7 @@ struct ServerConnectedClientInfo
 	IPAddress ip_addr;
 	UID client_avatar_id;
 	int client_UDP_port; // UDP port on client end
+	std::string world_name; // Name of the world the client is connected to.
 };
 
 
@@ -54,12 +74,31 @@ public:
 
 
 	// Called from off main thread
-	void clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id/*, int client_UDP_port*/);
+	void clientUDPPortOpen(WorkerThread* worker_thread, const IPAddress& ip_addr, UID client_avatar_id, const std::string& world_name);
 	void clientDisconnected(WorkerThread* worker_thread);
 
 	// Called when we receive a UDP packet from a client, which allows the client remote UDP port to be known.
 	void clientUDPPortBecameKnown(UID client_avatar_uid, const IPAddress& ip_addr, int client_UDP_port);
 
+	// Called from WorkerThreads when a client connects to / disconnects from a world, so that broadcasts for a world are only sent to clients connected to it.
+	void subscribeToWorldUpdates(WorkerThread* worker_thread, const std::string& world_name);
+	void unsubscribeFromWorldUpdates(WorkerThread* worker_thread);
+
+	// Called (from any thread) after avatars or objects have been marked as dirty, to wake up the main thread so it broadcasts the changes straight away.
+	void notifyUpdatesPending();
+
+	// Called by the main thread.  Blocks until notifyUpdatesPending() has been called, or max_wait_time_s has elapsed.  Clears the pending flag.
+	void waitForUpdatesPending(double max_wait_time_s);
+
+	// Called periodically by the main thread.  Rebuilds the client set used by the voice relay threads, with the current avatar positions.
+	void updateVoiceRelayClients();
+
+	// Called by the voice relay threads.
+	VoiceRelayClientSetRef getVoiceRelayClients();
+
+	// Enqueues packet to send to all connected clients, whether their connection is handled by a WorkerThread thread or by connection_io_pool.  threadsafe.
+	void enqueuePacketToAllClients(const SocketBufferOutStream& packet);
+
 
 	Reference<ServerAllWorldsState> world_state;
 
@@ -72,11 +111,30 @@ public:
 
 	ThreadManager dyn_tex_updater_thread_manager;
 
+	ThreadManager database_writer_thread_manager;
+
 	std::string screenshot_dir;
 
 	ServerConfig config;
 
+	Mutex world_subscribers_mutex;
+	std::map<std::string, std::set<WorkerThread*>> world_subscribers GUARDED_BY(world_subscribers_mutex); // Map from world name to worker threads for clients connected to that world.
+
+	Mutex updates_pending_mutex;
+	Condition updates_pending_condition;
+	bool updates_pending GUARDED_BY(updates_pending_mutex);
+
 	Mutex connected_clients_mutex;
 	std::map<WorkerThread*, ServerConnectedClientInfo> connected_clients;
 	glare::AtomicInt connected_clients_changed;
+
+	Mutex voice_relay_clients_mutex;
+	VoiceRelayClientSetRef voice_relay_clients GUARDED_BY(voice_relay_clients_mutex);
+	VoiceRelayStats voice_relay_stats;
+
+	ResourceSendStats resource_send_stats; // Updated by WorkerThreads serving resource downloads.
+
+	// Services the updates connections, if config.use_connection_io_pool is set.  NULL otherwise.
+	// Declared last so it is destroyed first, as destroying it closes the remaining connections, which uses the other members.
+	Reference<ConnectionIOPool> connection_io_pool;
 };
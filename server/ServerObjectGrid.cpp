@@ -0,0 +1,440 @@
+/*=====================================================================
+ServerObjectGrid.cpp
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ServerObjectGrid.h"
+
+
+#include <maths/mathstypes.h>
+#include <utils/RuntimeCheck.h>
+#include <cmath>
+
+
+const float ServerObjectGrid::CELL_WIDTH = 200.f;
+
+
+ServerObjectGrid::ServerObjectGrid()
+{}
+
+
+ServerObjectGrid::~ServerObjectGrid()
+{}
+
+
+void ServerObjectGrid::clear()
+{
+	cells.clear();
+	ob_cells.clear();
+}
+
+
+// Clamp cell coords so that huge (but finite) positions don't overflow the int conversion.
+static inline int clampedCellCoord(float x)
+{
+	const float MAX_COORD = (float)(1 << 30);
+	return (int)myClamp(std::floor(x / ServerObjectGrid::CELL_WIDTH), -MAX_COORD, MAX_COORD);
+}
+
+
+Vec3<int> ServerObjectGrid::cellCoordsForPos(const Vec4f& pos)
+{
+	return Vec3<int>(clampedCellCoord(pos[0]), clampedCellCoord(pos[1]), clampedCellCoord(pos[2]));
+}
+
+
+void ServerObjectGrid::insert(const WorldObjectRef& ob)
+{
+	const Vec4f pos = ob->pos.toVec4fPoint();
+	if(!pos.isFinite())
+		return;
+
+	const Vec3<int> cell_coords = cellCoordsForPos(pos);
+
+	const auto res = ob_cells.find(ob.ptr());
+	if(res != ob_cells.end())
+	{
+		if(res->second == cell_coords) // If already inserted in this cell:
+			return;
+		removeFromCell(ob.ptr(), res->second);
+		res->second = cell_coords;
+	}
+	else
+		ob_cells.insert(std::make_pair(ob.ptr(), cell_coords));
+
+	cells[cell_coords].objects.insert(ob);
+}
+
+
+void ServerObjectGrid::remove(const WorldObjectRef& ob)
+{
+	const auto res = ob_cells.find(ob.ptr());
+	if(res != ob_cells.end())
+	{
+		removeFromCell(ob.ptr(), res->second);
+		ob_cells.erase(res);
+	}
+}
+
+
+void ServerObjectGrid::objectMoved(const WorldObjectRef& ob)
+{
+	const Vec4f pos = ob->pos.toVec4fPoint();
+	if(pos.isFinite())
+		insert(ob); // insert() handles moving between cells.
+	else
+		remove(ob);
+}
+
+
+void ServerObjectGrid::removeFromCell(WorldObject* ob, const Vec3<int>& cell_coords)
+{
+	auto cell_res = cells.find(cell_coords);
+	assert(cell_res != cells.end());
+	if(cell_res != cells.end())
+	{
+		cell_res->second.objects.erase(WorldObjectRef(ob));
+		if(cell_res->second.objects.empty())
+			cells.erase(cell_res);
+	}
+}
+
+
+const ServerObjectGridCell* ServerObjectGrid::getCell(const Vec3<int>& cell_coords) const
+{
+	const auto res = cells.find(cell_coords);
+	return (res != cells.end()) ? &res->second : NULL;
+}
+
+
+void ServerObjectGrid::getObjectsInAABB(const js::AABBox& aabb, std::vector<const WorldObject*>& obs_out) const
+{
+	if(!aabb.min_.isFinite() || !aabb.max_.isFinite())
+	{
+		// Just do a scan over all cells and objects in that case.
+		for(auto it = cells.begin(); it != cells.end(); ++it)
+			for(auto ob_it = it->second.objects.begin(); ob_it != it->second.objects.end(); ++ob_it)
+			{
+				const WorldObject* ob = ob_it->ptr();
+				if(aabb.contains(ob->pos.toVec4fPoint()))
+					obs_out.push_back(ob);
+			}
+		return;
+	}
+
+	const Vec3<int> min_cell = cellCoordsForPos(aabb.min_);
+	const Vec3<int> max_cell = cellCoordsForPos(aabb.max_);
+	if(min_cell.x > max_cell.x || min_cell.y > max_cell.y || min_cell.z > max_cell.z)
+		return;
+
+	const double num_cells_in_range = ((double)max_cell.x - min_cell.x + 1) * ((double)max_cell.y - min_cell.y + 1) * ((double)max_cell.z - min_cell.z + 1);
+
+	if(num_cells_in_range <= (double)cells.size())
+	{
+		// Look up each cell in the query range.
+		for(int z=min_cell.z; z<=max_cell.z; ++z)
+		for(int y=min_cell.y; y<=max_cell.y; ++y)
+		for(int x=min_cell.x; x<=max_cell.x; ++x)
+		{
+			const auto res = cells.find(Vec3<int>(x, y, z));
+			if(res != cells.end())
+				for(auto ob_it = res->second.objects.begin(); ob_it != res->second.objects.end(); ++ob_it)
+				{
+					const WorldObject* ob = ob_it->ptr();
+					if(aabb.contains(ob->pos.toVec4fPoint()))
+						obs_out.push_back(ob);
+				}
+		}
+	}
+	else
+	{
+		// The query range covers more cells than there are non-empty cells, so iterate over the non-empty cells instead.
+		for(auto it = cells.begin(); it != cells.end(); ++it)
+		{
+			const Vec3<int>& c = it->first;
+			if(c.x >= min_cell.x && c.x <= max_cell.x && c.y >= min_cell.y && c.y <= max_cell.y && c.z >= min_cell.z && c.z <= max_cell.z)
+				for(auto ob_it = it->second.objects.begin(); ob_it != it->second.objects.end(); ++ob_it)
+				{
+					const WorldObject* ob = ob_it->ptr();
+					if(aabb.contains(ob->pos.toVec4fPoint()))
+						obs_out.push_back(ob);
+				}
+		}
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include "../shared/MessageUtils.h"
+#include "../shared/Protocol.h"
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <utils/Mutex.h>
+#include <utils/Lock.h>
+#include <utils/SocketBufferOutStream.h>
+#include <maths/PCG32.h>
+#include <algorithm>
+#include <map>
+
+
+static void checkSameObjects(std::vector<const WorldObject*> a, std::vector<const WorldObject*> b)
+{
+	std::sort(a.begin(), a.end());
+	std::sort(b.begin(), b.end());
+	testAssert(a == b);
+}
+
+
+static void bruteForceGetObjectsInAABB(const std::map<UID, WorldObjectRef>& objects, const js::AABBox& aabb, std::vector<const WorldObject*>& obs_out)
+{
+	for(auto it = objects.begin(); it != objects.end(); ++it)
+	{
+		const WorldObject* ob = it->second.ptr();
+		const Vec4f ob_pos = ob->pos.toVec4fPoint();
+		if(ob_pos.isFinite() && aabb.contains(ob_pos))
+			obs_out.push_back(ob);
+	}
+}
+
+
+// Serialise the query results as WorkerThread does while holding the world lock.
+static size_t writeObjects(const std::vector<const WorldObject*>& obs, SocketBufferOutStream& scratch_packet, SocketBufferOutStream& packet)
+{
+	packet.buf.clear();
+	for(size_t i=0; i<obs.size(); ++i)
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
+		obs[i]->writeToNetworkStream(scratch_packet);
+		MessageUtils::updatePacketLengthField(scratch_packet);
+		packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+	}
+	return packet.buf.size();
+}
+
+
+static void doPerfTest(int num_obs)
+{
+	PCG32 rng(1);
+
+	// Spread objects over a 10 km x 10 km area, with some height variation, roughly like the main world.
+	const float world_w = 10000.f;
+
+	std::map<UID, WorldObjectRef> objects;
+	ServerObjectGrid grid;
+	for(int i=0; i<num_obs; ++i)
+	{
+		WorldObjectRef ob = new WorldObject();
+		ob->uid = UID(i);
+		ob->pos = Vec3d((rng.unitRandom() - 0.5) * world_w, (rng.unitRandom() - 0.5) * world_w, rng.unitRandom() * 50.0);
+		objects[ob->uid] = ob;
+		grid.insert(ob);
+	}
+	testAssert(grid.numObjects() == (size_t)num_obs);
+
+	::Mutex mutex;
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	std::vector<const WorldObject*> obs, ref_obs;
+
+	const int NUM_QUERIES = 20;
+	double grid_lock_time = 0, scan_lock_time = 0;
+	double grid_cells_lock_time = 0, scan_cells_lock_time = 0;
+	size_t total_num_results = 0;
+	for(int q=0; q<NUM_QUERIES; ++q)
+	{
+		const Vec4f campos((rng.unitRandom() - 0.5f) * world_w, (rng.unitRandom() - 0.5f) * world_w, 2.f, 1.f);
+
+		//------------------- QueryObjectsInAABB with a 1 km query AABB, as done by clients on connect -------------------
+		const js::AABBox aabb(campos - Vec4f(500.f, 500.f, 500.f, 0), campos + Vec4f(500.f, 500.f, 500.f, 0));
+		{
+			Lock lock(mutex);
+			Timer timer;
+			obs.clear();
+			grid.getObjectsInAABB(aabb, obs);
+			writeObjects(obs, scratch_packet, packet);
+			grid_lock_time += timer.elapsed();
+		}
+		{
+			Lock lock(mutex);
+			Timer timer;
+			ref_obs.clear();
+			bruteForceGetObjectsInAABB(objects, aabb, ref_obs);
+			writeObjects(ref_obs, scratch_packet, packet);
+			scan_lock_time += timer.elapsed();
+		}
+		checkSameObjects(obs, ref_obs);
+		total_num_results += obs.size();
+
+		//------------------- QueryObjects for the 5x5x3 block of cells around the camera -------------------
+		const Vec3<int> cam_cell = ServerObjectGrid::cellCoordsForPos(campos);
+		std::vector<Vec3<int>> query_cells;
+		for(int z=-1; z<=1; ++z)
+		for(int y=-2; y<=2; ++y)
+		for(int x=-2; x<=2; ++x)
+			query_cells.push_back(Vec3<int>(cam_cell.x + x, cam_cell.y + y, cam_cell.z + z));
+		{
+			Lock lock(mutex);
+			Timer timer;
+			obs.clear();
+			for(size_t i=0; i<query_cells.size(); ++i)
+			{
+				const ServerObjectGridCell* cell = grid.getCell(query_cells[i]);
+				if(cell)
+					for(auto it = cell->objects.begin(); it != cell->objects.end(); ++it)
+						obs.push_back(it->ptr());
+			}
+			writeObjects(obs, scratch_packet, packet);
+			grid_cells_lock_time += timer.elapsed();
+		}
+		{
+			Lock lock(mutex);
+			Timer timer;
+			ref_obs.clear();
+			for(auto it = objects.begin(); it != objects.end(); ++it)
+			{
+				const WorldObject* ob = it->second.ptr();
+				for(size_t i=0; i<query_cells.size(); ++i)
+					if(ServerObjectGrid::cellCoordsForPos(ob->pos.toVec4fPoint()) == query_cells[i])
+					{
+						ref_obs.push_back(ob);
+						break;
+					}
+			}
+			writeObjects(ref_obs, scratch_packet, packet);
+			scan_cells_lock_time += timer.elapsed();
+		}
+		checkSameObjects(obs, ref_obs);
+	}
+
+	conPrint("num_obs: " + toString(num_obs) + ", av. num results: " + toString(total_num_results / NUM_QUERIES));
+	conPrint("    QueryObjectsInAABB lock hold time per query: grid: " + doubleToStringNSigFigs(grid_lock_time / NUM_QUERIES * 1.0e3, 4) + " ms, full scan: " + doubleToStringNSigFigs(scan_lock_time / NUM_QUERIES * 1.0e3, 4) + " ms");
+	conPrint("    QueryObjects lock hold time per query:       grid: " + doubleToStringNSigFigs(grid_cells_lock_time / NUM_QUERIES * 1.0e3, 4) + " ms, full scan: " + doubleToStringNSigFigs(scan_cells_lock_time / NUM_QUERIES * 1.0e3, 4) + " ms");
+}
+
+
+void ServerObjectGrid::test()
+{
+	conPrint("ServerObjectGrid::test()");
+
+	//------------------- Test insertion, moving and removal -------------------
+	{
+		ServerObjectGrid grid;
+
+		WorldObjectRef ob = new WorldObject();
+		ob->pos = Vec3d(10, 20, 30);
+		grid.insert(ob);
+		testAssert(grid.numObjects() == 1);
+		testAssert(grid.getCell(Vec3<int>(0, 0, 0)) && grid.getCell(Vec3<int>(0, 0, 0))->objects.count(ob) == 1);
+
+		// Insert again, should be a no-op
+		grid.insert(ob);
+		testAssert(grid.numObjects() == 1 && grid.numNonEmptyCells() == 1);
+
+		// Move to another cell
+		ob->pos = Vec3d(-10, 420, 30);
+		grid.objectMoved(ob);
+		testAssert(grid.numObjects() == 1 && grid.numNonEmptyCells() == 1);
+		testAssert(grid.getCell(Vec3<int>(0, 0, 0)) == NULL);
+		testAssert(grid.getCell(Vec3<int>(-1, 2, 0)) && grid.getCell(Vec3<int>(-1, 2, 0))->objects.count(ob) == 1);
+
+		std::vector<const WorldObject*> obs;
+		grid.getObjectsInAABB(js::AABBox(Vec4f(-20, 400, 0, 1), Vec4f(0, 500, 100, 1)), obs);
+		testAssert(obs.size() == 1 && obs[0] == ob.ptr());
+
+		obs.clear();
+		grid.getObjectsInAABB(js::AABBox(Vec4f(0, 400, 0, 1), Vec4f(10, 500, 100, 1)), obs);
+		testAssert(obs.empty());
+
+		// Huge query AABB should use the scan-over-cells path.
+		obs.clear();
+		grid.getObjectsInAABB(js::AABBox(Vec4f(-1.0e9f, -1.0e9f, -1.0e9f, 1), Vec4f(1.0e9f, 1.0e9f, 1.0e9f, 1)), obs);
+		testAssert(obs.size() == 1 && obs[0] == ob.ptr());
+
+		// Moving to a non-finite position should remove the object.
+		ob->pos = Vec3d(std::numeric_limits<double>::quiet_NaN(), 0, 0);
+		grid.objectMoved(ob);
+		testAssert(grid.numObjects() == 0 && grid.numNonEmptyCells() == 0);
+
+		// Objects with non-finite positions are not inserted.
+		grid.insert(ob);
+		testAssert(grid.numObjects() == 0);
+
+		// Objects at huge positions get clamped cell coords.
+		ob->pos = Vec3d(1.0e30, -1.0e30, 0);
+		grid.insert(ob);
+		testAssert(grid.numObjects() == 1);
+		obs.clear();
+		grid.getObjectsInAABB(js::AABBox(Vec4f(1.0e29f, -1.0e31f, -1, 1), Vec4f(1.0e31f, -1.0e29f, 1, 1)), obs);
+		testAssert(obs.size() == 1 && obs[0] == ob.ptr());
+
+		grid.remove(ob);
+		testAssert(grid.numObjects() == 0 && grid.numNonEmptyCells() == 0);
+		grid.remove(ob); // Removing again should be a no-op
+	}
+
+	//------------------- Test grid results match a brute-force scan, with random objects, moves and removals -------------------
+	{
+		PCG32 rng(1);
+		std::map<UID, WorldObjectRef> objects;
+		std::vector<UID> live_uids; // UIDs of the objects not removed yet, so we can pick a random one.
+		ServerObjectGrid grid;
+		for(int i=0; i<2000; ++i)
+		{
+			WorldObjectRef ob = new WorldObject();
+			ob->uid = UID(i);
+			ob->pos = Vec3d((rng.unitRandom() - 0.5) * 2000, (rng.unitRandom() - 0.5) * 2000, (rng.unitRandom() - 0.5) * 400);
+			objects[ob->uid] = ob;
+			live_uids.push_back(ob->uid);
+			grid.insert(ob);
+		}
+
+		for(int i=0; i<500; ++i)
+		{
+			const size_t live_index = rng.nextUInt((uint32)live_uids.size());
+			WorldObjectRef ob = objects[live_uids[live_index]];
+			testAssert(ob.nonNull());
+			if(i % 4 == 0)
+			{
+				grid.remove(ob);
+				objects.erase(ob->uid);
+				live_uids[live_index] = live_uids.back();
+				live_uids.pop_back();
+			}
+			else
+			{
+				ob->pos = Vec3d((rng.unitRandom() - 0.5) * 2000, (rng.unitRandom() - 0.5) * 2000, (rng.unitRandom() - 0.5) * 400);
+				grid.objectMoved(ob);
+			}
+		}
+		testAssert(grid.numObjects() == objects.size());
+
+		for(int i=0; i<100; ++i)
+		{
+			const Vec4f a((rng.unitRandom() - 0.5f) * 2500, (rng.unitRandom() - 0.5f) * 2500, (rng.unitRandom() - 0.5f) * 500, 1);
+			const Vec4f b((rng.unitRandom() - 0.5f) * 2500, (rng.unitRandom() - 0.5f) * 2500, (rng.unitRandom() - 0.5f) * 500, 1);
+			const js::AABBox aabb(min(a, b), max(a, b));
+
+			std::vector<const WorldObject*> obs, ref_obs;
+			grid.getObjectsInAABB(aabb, obs);
+			bruteForceGetObjectsInAABB(objects, aabb, ref_obs);
+			checkSameObjects(obs, ref_obs);
+		}
+	}
+
+	//------------------- Perf test: lock hold time per query -------------------
+	if(false)
+	{
+		doPerfTest(10000);
+		doPerfTest(100000);
+		doPerfTest(500000);
+	}
+
+	conPrint("ServerObjectGrid::test() done.");
+}
+
+
+#endif // BUILD_TESTS
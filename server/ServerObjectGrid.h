@@ -0,0 +1,85 @@
+/*=====================================================================
+ServerObjectGrid.h
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/WorldObject.h"
+#include <maths/vec3.h>
+#include <maths/Vec4f.h>
+#include <physics/jscol_aabbox.h>
+#include <Platform.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+
+struct ServerObjectGridCellHash
+{
+	size_t operator() (const Vec3<int>& c) const
+	{
+		// NOTE: technically possible undefined behaviour here (signed overflow), same as HashedObGrid.
+		return (size_t)((c.x * 73856093) ^ (c.y * 19349663) ^ (c.z * 83492791));
+	}
+};
+
+
+class ServerObjectGridCell
+{
+public:
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> objects;
+};
+
+
+/*=====================================================================
+ServerObjectGrid
+----------------
+Sparse uniform grid over the objects in a ServerWorldState, keyed by object position (WorldObject::pos).
+Used to answer QueryObjects and QueryObjectsInAABB in time proportional to the number of cells touched
+and objects returned, instead of scanning every object in the world.
+
+The cell width is the same as the client's proximity loader cell width, so a QueryObjects cell maps to exactly one grid cell.
+
+Objects with non-finite positions are not stored, since they can never be returned by a query.
+
+Must be kept up to date by calling insert(), remove() and objectMoved() when objects are added to, removed from,
+or moved in the world.  (See ServerWorldState::addObject() etc.)
+Not threadsafe, should be accessed with ServerAllWorldsState::mutex held.
+=====================================================================*/
+class ServerObjectGrid
+{
+public:
+	ServerObjectGrid();
+	~ServerObjectGrid();
+
+	static const float CELL_WIDTH; // NOTE: has to be the same value as in gui_client/ProximityLoader.cpp.
+
+	void clear();
+
+	void insert(const WorldObjectRef& ob);
+	void remove(const WorldObjectRef& ob);
+	void objectMoved(const WorldObjectRef& ob); // To be called after ob->pos is changed.
+
+	// Returns the objects whose position is in the grid cell with the given integer coordinates.  May return NULL if cell is empty.
+	const ServerObjectGridCell* getCell(const Vec3<int>& cell_coords) const;
+
+	// Appends objects with a finite position that is contained in aabb to obs_out.
+	void getObjectsInAABB(const js::AABBox& aabb, std::vector<const WorldObject*>& obs_out) const;
+
+	size_t numObjects() const { return ob_cells.size(); }
+	size_t numNonEmptyCells() const { return cells.size(); }
+
+	static Vec3<int> cellCoordsForPos(const Vec4f& pos); // pos should be finite.  Uses single-precision position so cell assignment is consistent with js::AABBox::contains().
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ServerObjectGrid);
+
+	void removeFromCell(WorldObject* ob, const Vec3<int>& cell_coords);
+
+	std::unordered_map<Vec3<int>, ServerObjectGridCell, ServerObjectGridCellHash> cells; // Only non-empty cells are stored.
+	std::unordered_map<const WorldObject*, Vec3<int>> ob_cells; // Map from object to the coords of the cell it is currently stored in.
+};
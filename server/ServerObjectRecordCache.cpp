@@ -0,0 +1,369 @@
+/*=====================================================================
+ServerObjectRecordCache.cpp
+---------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "ServerObjectRecordCache.h"
+
+
+#include "../shared/MessageUtils.h"
+#include "../shared/Protocol.h"
+
+
+ServerObjectRecordCache::ServerObjectRecordCache()
+:	num_hits(0),
+	num_misses(0),
+	total_record_bytes(0)
+{}
+
+
+ServerObjectRecordCache::~ServerObjectRecordCache()
+{}
+
+
+void ServerObjectRecordCache::appendObjectInitialSendMessage(const WorldObject* ob, SocketBufferOutStream& scratch_packet, SocketBufferOutStream& packet_out)
+{
+	auto res = records.find(ob);
+	if(res != records.end())
+	{
+		if(res->second.uid == ob->uid)
+		{
+			num_hits++;
+			packet_out.writeData(res->second.data.data(), res->second.data.size());
+			return;
+		}
+	}
+	else
+		res = records.insert(std::make_pair(ob, Record())).first;
+
+	num_misses++;
+
+	MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
+	ob->writeToNetworkStream(scratch_packet);
+	MessageUtils::updatePacketLengthField(scratch_packet);
+
+	Record& record = res->second;
+	total_record_bytes -= record.data.size();
+	record.uid = ob->uid;
+	record.data.assign(scratch_packet.buf.data(), scratch_packet.buf.data() + scratch_packet.buf.size());
+	total_record_bytes += record.data.size();
+
+	packet_out.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+}
+
+
+void ServerObjectRecordCache::invalidate(const WorldObject* ob)
+{
+	auto res = records.find(ob);
+	if(res != records.end())
+	{
+		total_record_bytes -= res->second.data.size();
+		records.erase(res);
+	}
+}
+
+
+void ServerObjectRecordCache::clear()
+{
+	records.clear();
+	total_record_bytes = 0;
+}
+
+
+#if BUILD_TESTS
+
+
+#include "ServerWorldState.h"
+#include "LockWaitStats.h"
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <utils/Lock.h>
+#include <utils/TaskManager.h>
+#include <maths/PCG32.h>
+#include <algorithm>
+
+
+static WorldObjectRef makeTestObject(PCG32& rng, uint64 uid, float world_w)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->uid = UID(uid);
+	ob->model_url = "some_model_" + toString(uid) + "_glb_12345678901234567890.bmesh";
+	ob->content = "Some hypercard content " + toString(uid);
+	ob->pos = Vec3d((rng.unitRandom() - 0.5) * world_w, (rng.unitRandom() - 0.5) * world_w, rng.unitRandom() * 50.0);
+	ob->creator_name = "someone";
+	for(int i=0; i<4; ++i)
+	{
+		WorldMaterialRef mat = new WorldMaterial();
+		mat->colour_texture_url = "some_texture_" + toString(uid) + "_" + toString(i) + "_jpg_12345678901234567890.jpg";
+		ob->materials.push_back(mat);
+	}
+	return ob;
+}
+
+
+static void writeUncached(const WorldObject* ob, SocketBufferOutStream& scratch_packet, SocketBufferOutStream& packet_out)
+{
+	MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
+	ob->writeToNetworkStream(scratch_packet);
+	MessageUtils::updatePacketLengthField(scratch_packet);
+	packet_out.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+}
+
+
+static bool packetsEqual(const SocketBufferOutStream& a, const SocketBufferOutStream& b)
+{
+	return a.buf.size() == b.buf.size() && std::equal(a.buf.data(), a.buf.data() + a.buf.size(), b.buf.data());
+}
+
+
+struct JoinBenchmarkResults
+{
+	JoinBenchmarkResults() : total_hold_time(0), max_hold_time(0), total_bytes(0) {}
+
+	double total_hold_time;
+	double max_hold_time;
+	uint64 total_bytes;
+	LockWaitStats::Snapshot wait_stats;
+};
+
+
+// Does what WorkerThread does for the QueryObjectsInAABB message a client sends when it joins, and records how long the world lock was held.
+class JoinBenchmarkTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		std::vector<const WorldObject*> obs;
+
+		const js::AABBox aabb(campos - Vec4f(500.f, 500.f, 500.f, 0), campos + Vec4f(500.f, 500.f, 500.f, 0));
+
+		double hold_time;
+		{
+			TimedLock lock(world->mutex, world->mutex_wait_stats);
+			Timer timer;
+
+			world->ob_grid.getObjectsInAABB(aabb, obs);
+			for(size_t i=0; i<obs.size(); ++i)
+			{
+				if(use_cache)
+					world->ob_record_cache.appendObjectInitialSendMessage(obs[i], scratch_packet, packet);
+				else
+					writeUncached(obs[i], scratch_packet, packet);
+			}
+
+			hold_time = timer.elapsed();
+		}
+
+		Lock lock(*results_mutex);
+		results->total_hold_time += hold_time;
+		results->max_hold_time = myMax(results->max_hold_time, hold_time);
+		results->total_bytes += packet.buf.size();
+	}
+
+	ServerWorldState* world;
+	bool use_cache;
+	Vec4f campos;
+	::Mutex* results_mutex;
+	JoinBenchmarkResults* results;
+};
+
+
+// Runs num_joins simultaneous joins, with clients joining in a small area around the spawn point, as happens after e.g. an event is announced.
+static JoinBenchmarkResults doJoinBurst(ServerWorldState& world, bool use_cache, int num_joins, glare::TaskManager& task_manager, PCG32& rng, double& elapsed_out)
+{
+	::Mutex results_mutex;
+	JoinBenchmarkResults results;
+
+	std::vector<glare::TaskRef> tasks;
+	for(int i=0; i<num_joins; ++i)
+	{
+		Reference<JoinBenchmarkTask> task = new JoinBenchmarkTask();
+		task->world = &world;
+		task->use_cache = use_cache;
+		task->campos = Vec4f((rng.unitRandom() - 0.5f) * 100.f, (rng.unitRandom() - 0.5f) * 100.f, 2.f, 1.f);
+		task->results_mutex = &results_mutex;
+		task->results = &results;
+		tasks.push_back(task);
+	}
+
+	world.mutex_wait_stats.getAndReset();
+
+	Timer timer;
+	for(size_t i=0; i<tasks.size(); ++i)
+		task_manager.addTask(tasks[i]);
+	task_manager.waitForTasksToComplete();
+	elapsed_out = timer.elapsed();
+
+	results.wait_stats = world.mutex_wait_stats.getAndReset();
+	return results;
+}
+
+
+static void printJoinBurstResults(const std::string& label, int num_joins, const JoinBenchmarkResults& results, double elapsed)
+{
+	conPrint("    " + label + ": total lock hold time: " + doubleToStringNSigFigs(results.total_hold_time * 1.0e3, 4) + " ms, mean hold time: " +
+		doubleToStringNSigFigs(results.total_hold_time / num_joins * 1.0e3, 4) + " ms, max hold time: " + doubleToStringNSigFigs(results.max_hold_time * 1.0e3, 4) + " ms, elapsed: " +
+		doubleToStringNSigFigs(elapsed * 1.0e3, 4) + " ms, sent: " + getNiceByteSize(results.total_bytes));
+	conPrint("        lock waits: " + results.wait_stats.toString());
+}
+
+
+static void doJoinBenchmark(int num_obs, int num_joins, int num_threads)
+{
+	PCG32 rng(1);
+	const float world_w = 4000.f;
+
+	ServerWorldState world;
+	{
+		Lock lock(world.mutex);
+		for(int i=0; i<num_obs; ++i)
+			world.addObject(makeTestObject(rng, i, world_w));
+	}
+
+	glare::TaskManager task_manager("ServerObjectRecordCache join benchmark task manager", num_threads);
+
+	conPrint("ServerObjectRecordCache join benchmark: " + toString(num_obs) + " objects, " + toString(num_joins) + " simultaneous joins, " + toString(num_threads) + " threads");
+
+	double elapsed;
+	JoinBenchmarkResults results = doJoinBurst(world, /*use cache=*/false, num_joins, task_manager, rng, elapsed);
+	printJoinBurstResults("no cache          ", num_joins, results, elapsed);
+
+	results = doJoinBurst(world, /*use cache=*/true, num_joins, task_manager, rng, elapsed);
+	printJoinBurstResults("cache, cold       ", num_joins, results, elapsed);
+
+	results = doJoinBurst(world, /*use cache=*/true, num_joins, task_manager, rng, elapsed);
+	printJoinBurstResults("cache, warm       ", num_joins, results, elapsed);
+
+	// Modify 5% of the objects, as if they were edited between bursts.
+	{
+		Lock lock(world.mutex);
+		for(auto it = world.objects.begin(); it != world.objects.end(); ++it)
+			if(rng.unitRandom() < 0.05f)
+			{
+				it->second->content += " (edited)";
+				world.addWorldObjectAsDBDirty(it->second);
+			}
+		world.db_dirty_world_objects.clear();
+	}
+	results = doJoinBurst(world, /*use cache=*/true, num_joins, task_manager, rng, elapsed);
+	printJoinBurstResults("cache, 5% edited  ", num_joins, results, elapsed);
+
+	Lock lock(world.mutex);
+	conPrint("    cache records: " + toString(world.ob_record_cache.numRecords()) + " (" + getNiceByteSize(world.ob_record_cache.totalRecordBytes()) + "), hits: " +
+		toString(world.ob_record_cache.num_hits) + ", misses: " + toString(world.ob_record_cache.num_misses));
+}
+
+
+void ServerObjectRecordCache::test()
+{
+	conPrint("ServerObjectRecordCache::test()");
+
+	//------------------- Test cached records match serialisation from scratch, and are invalidated on modification -------------------
+	{
+		PCG32 rng(1);
+		ServerWorldState world;
+		Lock lock(world.mutex);
+
+		std::vector<WorldObjectRef> obs;
+		for(int i=0; i<10; ++i)
+		{
+			obs.push_back(makeTestObject(rng, i, 100.f));
+			world.addObject(obs.back());
+		}
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream cached_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream ref_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		for(int pass=0; pass<2; ++pass)
+		{
+			cached_packet.buf.clear();
+			ref_packet.buf.clear();
+			for(size_t i=0; i<obs.size(); ++i)
+			{
+				world.ob_record_cache.appendObjectInitialSendMessage(obs[i].ptr(), scratch_packet, cached_packet);
+				writeUncached(obs[i].ptr(), scratch_packet, ref_packet);
+			}
+			testAssert(packetsEqual(cached_packet, ref_packet));
+		}
+		testAssert(world.ob_record_cache.num_misses == 10);
+		testAssert(world.ob_record_cache.num_hits == 10);
+		testAssert(world.ob_record_cache.numRecords() == 10);
+
+		// Modify objects in the different ways the server does.
+		obs[0]->content = "new content";
+		world.addWorldObjectAsDBDirty(obs[0]);
+
+		obs[1]->pos = Vec3d(10, 20, 30);
+		world.objectTransformChanged(obs[1]);
+
+		obs[2]->physics_owner_id = 123;
+		world.invalidateObjectRecord(obs[2]);
+
+		testAssert(world.ob_record_cache.numRecords() == 7);
+
+		cached_packet.buf.clear();
+		ref_packet.buf.clear();
+		for(size_t i=0; i<obs.size(); ++i)
+		{
+			world.ob_record_cache.appendObjectInitialSendMessage(obs[i].ptr(), scratch_packet, cached_packet);
+			writeUncached(obs[i].ptr(), scratch_packet, ref_packet);
+		}
+		testAssert(packetsEqual(cached_packet, ref_packet));
+		testAssert(world.ob_record_cache.num_misses == 13);
+
+		// Removing an object should drop its record.
+		world.removeObject(obs[3]);
+		testAssert(world.ob_record_cache.numRecords() == 9);
+
+		// Replacing an object with a new object with the same UID should drop the record for the old object.
+		WorldObjectRef replacement = makeTestObject(rng, 4, 100.f);
+		world.addObject(replacement);
+		testAssert(world.ob_record_cache.numRecords() == 8);
+
+		size_t total_bytes = 0;
+		for(size_t i=0; i<obs.size(); ++i)
+			if(i != 3 && i != 4)
+			{
+				ref_packet.buf.clear();
+				writeUncached(obs[i].ptr(), scratch_packet, ref_packet);
+				total_bytes += ref_packet.buf.size();
+			}
+		testAssert(world.ob_record_cache.totalRecordBytes() == total_bytes);
+
+		world.ob_record_cache.clear();
+		testAssert(world.ob_record_cache.numRecords() == 0 && world.ob_record_cache.totalRecordBytes() == 0);
+	}
+
+	//------------------- Test a record for an object with a different UID at the same address is not used -------------------
+	{
+		PCG32 rng(1);
+		ServerObjectRecordCache cache;
+		WorldObjectRef ob = makeTestObject(rng, 1, 100.f);
+
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream cached_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream ref_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		cache.appendObjectInitialSendMessage(ob.ptr(), scratch_packet, cached_packet);
+
+		ob->uid = UID(2);
+		cached_packet.buf.clear();
+		cache.appendObjectInitialSendMessage(ob.ptr(), scratch_packet, cached_packet);
+		writeUncached(ob.ptr(), scratch_packet, ref_packet);
+		testAssert(packetsEqual(cached_packet, ref_packet));
+		testAssert(cache.num_hits == 0 && cache.num_misses == 2 && cache.numRecords() == 1);
+	}
+
+	//------------------- Benchmark 100 simultaneous joins -------------------
+	if(false)
+		doJoinBenchmark(/*num obs=*/20000, /*num joins=*/100, /*num threads=*/32);
+
+	conPrint("ServerObjectRecordCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
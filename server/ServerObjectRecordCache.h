@@ -0,0 +1,64 @@
+/*=====================================================================
+ServerObjectRecordCache.h
+-------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/WorldObject.h"
+#include <SocketBufferOutStream.h>
+#include <Platform.h>
+#include <unordered_map>
+#include <vector>
+
+
+/*=====================================================================
+ServerObjectRecordCache
+-----------------------
+Cache of serialised ObjectInitialSend messages for the objects in a ServerWorldState.
+
+GetAllObjects, QueryObjects and QueryObjectsInAABB send an ObjectInitialSend message for every returned object,
+so without caching, popular objects are reserialised for every client that connects.
+With the cache, the world lock is mostly held for copying already-serialised messages into the response buffer.
+
+WorldObject::writeToNetworkStream() does not depend on the client protocol version, so a single record per object can be
+sent to all clients.
+
+The record for an object must be invalidated whenever any of its serialised state changes.
+ServerWorldState does this in addWorldObjectAsDBDirty(), objectTransformChanged(), addObject() and removeObject(),
+and invalidateObjectRecord() should be called for changes that don't go through those methods.
+Not threadsafe, should be accessed with the world mutex held.
+=====================================================================*/
+class ServerObjectRecordCache
+{
+public:
+	ServerObjectRecordCache();
+	~ServerObjectRecordCache();
+
+	// Appends an ObjectInitialSend message for ob to packet_out, serialising ob (using scratch_packet) if there is no valid cached record for it.
+	void appendObjectInitialSendMessage(const WorldObject* ob, SocketBufferOutStream& scratch_packet, SocketBufferOutStream& packet_out);
+
+	void invalidate(const WorldObject* ob); // Drops the cached record for ob, if any.  To be called when ob is modified.
+	void clear();
+
+	size_t numRecords() const { return records.size(); }
+	size_t totalRecordBytes() const { return total_record_bytes; }
+
+	uint64 num_hits;
+	uint64 num_misses;
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ServerObjectRecordCache);
+
+	struct Record
+	{
+		UID uid; // UID of the object when the record was created.  Checked on lookup, as a guard against stale records for a reused address.
+		std::vector<uint8> data; // ObjectInitialSend message, including the message header.
+	};
+
+	std::unordered_map<const WorldObject*, Record> records;
+	size_t total_record_bytes;
+};
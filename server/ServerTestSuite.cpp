@@ -7,7 +7,18 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "AccountHandlers.h"
+#include "ServerObjectGrid.h"
+#include "ServerObjectRecordCache.h"
+#include "UpdateInterestFilter.h"
+#include "ResourceFactsCache.h"
+#include "VoiceRelay.h"
+#include "ResourceFileSender.h"
+#include "ResourceRequestScheduler.h"
+#include "ConnectionIOPool.h"
+#include "WorkerThreadTests.h"
 #include "../shared/WorldObject.h"
+#include "../shared/QuantizedTransformUpdates.h"
+#include "../shared/CompressedMessages.h"
 #include "../shared/LODGeneration.h"
 #include "../ethereum/RLP.h"
 #include "../ethereum/Signing.h"
@@ -99,6 +110,17 @@ void ServerTestSuite::test()
 	runTest([&]() { RLP::test();														});
 	runTest([&]() { Signing::test();													});
 	runTest([&]() { AccountHandlers::test();											});
+	runTest([&]() { ServerObjectGrid::test();											});
+	runTest([&]() { ServerObjectRecordCache::test();									});
+	runTest([&]() { UpdateInterestFilter::test();										});
+	runTest([&]() { QuantizedTransformUpdates::test();									});
+	runTest([&]() { CompressedMessages::test();											});
+	runTest([&]() { ResourceFactsCache::test();											});
+	runTest([&]() { VoiceRelayer::test();												});
+	runTest([&]() { ResourceFileSender::test();											});
+	runTest([&]() { ResourceRequestScheduler::test();									});
+	runTest([&]() { ConnectionIOPool::test();											});
+	runTest([&]() { WorkerThreadTests::test();											});
 	runTest([&]() { HTTPClient::test();													}, /*mem leak allowed=*/true); // Leaks due to libtls allocating globals
 	
 	// runTest([&]() { BatchedMeshTests::test();										}); // Uses some Indigo files
@@ -19,6 +19,41 @@ Generated at 2016-01-12 12:22:34 +1300
 #include <Database.h>
 #include <BufferOutStream.h>
 #include <BufferViewInStream.h>
+#include <cstring>
+
+
+void ServerWorldState::addObject(const WorldObjectRef& ob)
+{
+	auto res = objects.find(ob->uid);
+	if(res != objects.end())
+	{
+		if(res->second == ob)
+		{
+			ob_grid.objectMoved(ob);
+			ob_record_cache.invalidate(ob.ptr());
+			return;
+		}
+		ob_grid.remove(res->second);
+		ob_record_cache.invalidate(res->second.ptr());
+		res->second = ob;
+	}
+	else
+		objects.insert(std::make_pair(ob->uid, ob));
+
+	ob_grid.insert(ob);
+	ob_record_cache.invalidate(ob.ptr());
+}
+
+
+void ServerWorldState::removeObject(const WorldObjectRef& ob)
+{
+	ob_grid.remove(ob);
+	ob_record_cache.invalidate(ob.ptr());
+
+	auto res = objects.find(ob->uid);
+	if(res != objects.end() && res->second == ob)
+		objects.erase(res);
+}
 
 
 ServerAllWorldsState::ServerAllWorldsState()
@@ -28,7 +63,8 @@ ServerAllWorldsState::ServerAllWorldsState()
 	next_order_uid = 0;
 	next_sub_eth_transaction_uid = 0;
 
-	world_states[""] = new ServerWorldState();
+	root_world_state = new ServerWorldState();
+	world_states[""] = root_world_state;
 
 	last_parcel_update_info.last_parcel_sale_update_hour = 0;
 	last_parcel_update_info.last_parcel_sale_update_day = 0;
@@ -44,6 +80,8 @@ ServerAllWorldsState::ServerAllWorldsState()
 	read_only_mode = false;
 
 	force_dyn_tex_update = false;
+
+	checkpoint_in_progress = false;
 }
 
 
@@ -54,9 +92,7 @@ ServerAllWorldsState::~ServerAllWorldsState()
 
 Reference<ServerWorldState> ServerAllWorldsState::getRootWorldState() // Guaranteed to return a non-null reference
 {
-	Lock lock(mutex);
-
-	return world_states[""]; 
+	return root_world_state; 
 }
 
 
@@ -65,6 +101,7 @@ void ServerAllWorldsState::createNewDatabase(const std::string& path)
 	conPrint("Creating new world state database at '" + path + "'...");
 
 	Lock lock(mutex);
+	Lock database_lock(database_mutex);
 
 	database.openAndMakeOrClearDatabase(path);
 }
@@ -99,6 +136,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 	conPrint("Reading world state from '" + path + "'...");
 
 	Lock lock(mutex);
+	Lock database_lock(database_mutex);
 
 	Timer timer;
 
@@ -158,9 +196,14 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
 
 					world_ob->database_key = database_key;
-					world_states[world_name]->objects[world_ob->uid] = world_ob; // Add to object map
+					{
+						ServerWorldState* world = world_states[world_name].ptr();
+						Lock world_lock(world->mutex);
+						world->addObject(world_ob); // Add to object map
+					}
 					num_obs++;
 
+					Lock uid_lock(uid_mutex);
 					next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
 				}
 				else if(chunk == USER_CHUNK)
@@ -187,7 +230,11 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					readFromStream(stream, *parcel);
 
 					parcel->database_key = database_key;
-					world_states[world_name]->parcels[parcel->id] = parcel; // Add to parcel map
+					{
+						ServerWorldState* world = world_states[world_name].ptr();
+						Lock world_lock(world->mutex);
+						world->parcels[parcel->id] = parcel; // Add to parcel map
+					}
 					num_parcels++;
 				}
 				else if(chunk == WORLD_SETTINGS_CHUNK)
@@ -199,16 +246,19 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					if(world_states.count(world_name) == 0) 
 						world_states[world_name] = new ServerWorldState();
 
+					ServerWorldState* world = world_states[world_name].ptr();
+					Lock world_lock(world->mutex);
+
 					// NOTE: There was a bug with multiple world settings for the same world getting saved to the database.  Resolve ambiguity of which one to use by choosing the setting with the largest database key value.
 					// Use these new settings iff the existing settings are either uninitialised (in which case database_key will be invalid), or the settings we are reading from the DB have a greater key 
 					// value than the existing settings.
-					const bool use_settings = !world_states[world_name]->world_settings.database_key.valid() || (database_key.value() > world_states[world_name]->world_settings.database_key.value());
+					const bool use_settings = !world->world_settings.database_key.valid() || (database_key.value() > world->world_settings.database_key.value());
 					if(use_settings)
 					{	
 						// Deserialise world settings
-						readWorldSettingsFromStream(stream, world_states[world_name]->world_settings);
+						readWorldSettingsFromStream(stream, world->world_settings);
 
-						world_states[world_name]->world_settings.database_key = database_key;
+						world->world_settings.database_key = database_key;
 					}
 
 					num_world_settings++;
@@ -236,6 +286,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					readFromStream(stream, *order);
 
 					order->database_key = database_key;
+					Lock orders_lock(orders_mutex);
 					orders[order->id] = order; // Add to order map
 
 					next_order_uid = myMax(order->id + 1, next_order_uid);
@@ -248,6 +299,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					readFromStream(stream, *session);
 
 					session->database_key = database_key;
+					Lock sessions_lock(sessions_mutex);
 					user_web_sessions[session->id] = session; // Add to session map
 					num_sessions++;
 				}
@@ -268,6 +320,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					readScreenshotFromStream(stream, *shot);
 
 					shot->database_key = database_key;
+					Lock screenshots_lock(screenshots_mutex);
 					screenshots[shot->id] = shot;
 					num_screenshots++;
 				}
@@ -305,6 +358,8 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				}
 				else if(chunk == MAP_TILE_INFO_CHUNK)
 				{
+					Lock screenshots_lock(screenshots_mutex);
+
 					const uint32 map_tile_info_version = stream.readInt32();
 					if(map_tile_info_version != MAP_TILE_INFO_VERSION)
 						throw glare::Exception("invalid map_tile_info_version: " + toString(map_tile_info_version));
@@ -355,6 +410,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 	{
 		Reference<ServerWorldState> current_world = new ServerWorldState();
 		world_states[""] = current_world;
+		root_world_state = current_world;
 
 		FileInStream stream(path);
 
@@ -388,9 +444,13 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				//TEMP HACK: clear lightmap needed flag
 				BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
 
-				current_world->objects[world_ob->uid] = world_ob; // Add to object map
+				{
+					Lock world_lock(current_world->mutex);
+					current_world->addObject(world_ob); // Add to object map
+				}
 				num_obs++;
 
+				Lock uid_lock(uid_mutex);
 				next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
 			}
 			else if(chunk == USER_CHUNK)
@@ -408,6 +468,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				ParcelRef parcel = new Parcel();
 				readFromStream(stream, *parcel);
 
+				Lock world_lock(current_world->mutex);
 				current_world->parcels[parcel->id] = parcel; // Add to parcel map
 				num_parcels++;
 			}
@@ -427,6 +488,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				OrderRef order = new Order();
 				readFromStream(stream, *order);
 
+				Lock orders_lock(orders_mutex);
 				orders[order->id] = order; // Add to order map
 
 				next_order_uid = myMax(order->id + 1, next_order_uid);
@@ -438,6 +500,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				UserWebSessionRef session = new UserWebSession();
 				readFromStream(stream, *session);
 
+				Lock sessions_lock(sessions_mutex);
 				user_web_sessions[session->id] = session; // Add to session map
 				num_sessions++;
 			}
@@ -456,6 +519,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				ScreenshotRef shot = new Screenshot();
 				readScreenshotFromStream(stream, *shot);
 
+				Lock screenshots_lock(screenshots_mutex);
 				screenshots[shot->id] = shot;
 				num_screenshots++;
 			}
@@ -489,6 +553,8 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 			}
 			else if(chunk == MAP_TILE_INFO_CHUNK)
 			{
+				Lock screenshots_lock(screenshots_mutex);
+
 				const uint32 map_tile_info_version = stream.readInt32();
 				if(map_tile_info_version != MAP_TILE_INFO_VERSION)
 					throw glare::Exception("invalid map_tile_info_version: " + toString(map_tile_info_version));
@@ -536,7 +602,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 		database.openAndMakeOrClearDatabase(path);
 
 		// Add everything to dirty sets so it gets saved to the DB initially.
-		addEverythingToDirtySets();
+		addEverythingToDirtySetsLocked();
 	}
 
 
@@ -546,6 +612,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		Lock world_lock(world_state->mutex);
 		for(auto it = world_state->objects.begin(); it != world_state->objects.end(); ++it)
 		{
 			/*WorldObject* ob = it->second.ptr();
@@ -569,18 +636,28 @@ void ServerAllWorldsState::addEverythingToDirtySets()
 {
 	Lock lock(mutex);
 
+	addEverythingToDirtySetsLocked();
+}
+
+
+void ServerAllWorldsState::addEverythingToDirtySetsLocked()
+{
 	for(auto it = resource_manager->getResourcesForURL().begin(); it != resource_manager->getResourcesForURL().end(); ++it)
 		db_dirty_resources.insert(it->second);
 
 	for(auto it = user_id_to_users.begin(); it != user_id_to_users.end(); ++it)
 		db_dirty_users.insert(it->second);
 
-	for(auto it = orders.begin(); it != orders.end(); ++it)
-		db_dirty_orders.insert(it->second);
+	{
+		Lock orders_lock(orders_mutex);
+		for(auto it = orders.begin(); it != orders.end(); ++it)
+			db_dirty_orders.insert(it->second);
+	}
 
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		Lock world_lock(world_state->mutex);
 
 		for(auto it = world_state->objects.begin(); it != world_state->objects.end(); ++it)
 			world_state->db_dirty_world_objects.insert(it->second);
@@ -589,36 +666,42 @@ void ServerAllWorldsState::addEverythingToDirtySets()
 			world_state->db_dirty_parcels.insert(it->second);
 	}
 
-	for(auto it = user_web_sessions.begin(); it != user_web_sessions.end(); ++it)
-		db_dirty_userwebsessions.insert(it->second);
+	{
+		Lock sessions_lock(sessions_mutex);
+		for(auto it = user_web_sessions.begin(); it != user_web_sessions.end(); ++it)
+			db_dirty_userwebsessions.insert(it->second);
+	}
 
 	for(auto it = parcel_auctions.begin(); it != parcel_auctions.end(); ++it)
 		db_dirty_parcel_auctions.insert(it->second);
 
-	for(auto it = screenshots.begin(); it != screenshots.end(); ++it)
-		db_dirty_screenshots.insert(it->second);
+	{
+		Lock screenshots_lock(screenshots_mutex);
+		for(auto it = screenshots.begin(); it != screenshots.end(); ++it)
+			db_dirty_screenshots.insert(it->second);
+
+		map_tile_info.db_dirty = true;
+	}
 
 	for(auto it = sub_eth_transactions.begin(); it != sub_eth_transactions.end(); ++it)
 		db_dirty_sub_eth_transactions.insert(it->second);
 
-	map_tile_info.db_dirty = true;
-
 	last_parcel_update_info.db_dirty = true;
 
 	eth_info.db_dirty = true;
 }
 
 
-bool ServerAllWorldsState::isInReadOnlyMode()
-{ 
-	Lock lock(mutex); 
-	return read_only_mode; 
-}
-
-
 void ServerAllWorldsState::clearAndReset() // Just for fuzzing
 {
-	Lock lock(mutex);
+	{
+		Lock lock(mutex);
+		world_states.clear();
+		root_world_state = new ServerWorldState();
+		world_states[""] = root_world_state;
+	}
+
+	Lock lock(uid_mutex);
 	next_object_uid = UID(0);
 	next_avatar_uid = UID(0);
 }
@@ -631,6 +714,7 @@ void ServerAllWorldsState::denormaliseData()
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		Lock world_lock(world_state->mutex);
 
 		// Build cached fields like WorldObject::creator_name
 		for(auto i=world_state->objects.begin(); i != world_state->objects.end(); ++i)
@@ -695,6 +779,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 		for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			Lock world_lock(world_state->mutex);
 
 			// Sanitise parcels
 			for(auto it = world_state->parcels.begin(); it != world_state->parcels.end(); ++it)
@@ -738,6 +823,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 
 		// Sanitise orders
 		{
+			Lock orders_lock(orders_mutex);
 			for(auto i=orders.begin(); i != orders.end(); ++i)
 			{
 				Order* order = i->second.ptr();
@@ -754,6 +840,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 
 		// Delete all UserWebSessions
 		{
+			Lock sessions_lock(sessions_mutex);
 			for(auto i=user_web_sessions.begin(); i != user_web_sessions.end(); ++i)
 			{
 				UserWebSession* session = i->second.ptr();
@@ -809,14 +896,40 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 }
 
 
-// Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
-void ServerAllWorldsState::serialiseToDisk()
+void DatabaseCheckpoint::addRecord(const DatabaseKey& key, const BufferOutStream& buf)
 {
-	conPrint("Saving world state to disk...");
+	Record record;
+	record.key = key;
+	record.offset = data.size();
+	record.len = buf.buf.size();
+	records.push_back(record);
+
+	if(record.len > 0)
+	{
+		data.resize(record.offset + record.len);
+		std::memcpy(&data[record.offset], buf.buf.data(), record.len);
+	}
+}
+
+
+std::string CheckpointStats::toString() const
+{
+	return ::toString(num_checkpoints) + " checkpoint(s), " + ::toString(num_records) + " record(s), " + getNiceByteSize(num_bytes) + 
+		", capture time (locked): mean " + doubleToStringNSigFigs((num_checkpoints > 0) ? (total_capture_time * 1.0e3 / num_checkpoints) : 0.0, 4) + " ms, max " + doubleToStringNSigFigs(max_capture_time * 1.0e3, 4) + 
+		" ms, write time (unlocked): mean " + doubleToStringNSigFigs((num_checkpoints > 0) ? (total_write_time * 1.0e3 / num_checkpoints) : 0.0, 4) + " ms, max " + doubleToStringNSigFigs(max_write_time * 1.0e3, 4) + " ms";
+}
+
 
+// Serialise any changed data (objects in dirty sets) into a checkpoint.  Mutex should be held already.
+Reference<DatabaseCheckpoint> ServerAllWorldsState::captureCheckpoint()
+{
 	Timer timer;
 
-	try
+	Reference<DatabaseCheckpoint> checkpoint = new DatabaseCheckpoint();
+
+	// database_mutex is only needed here for allocating keys for new records.  The main server thread only calls this when DatabaseWriterThread is idle, so it will be uncontended.
+	Lock database_lock(database_mutex);
+
 	{
 		// Number of various type of objects that were dirty and saved.
 		size_t num_obs = 0;
@@ -831,24 +944,32 @@ void ServerAllWorldsState::serialiseToDisk()
 		size_t num_resources = 0;
 		size_t num_world_settings = 0;
 
-		// First, delete any records in db_records_to_delete.  (This has the keys of deleted objects etc..)
+		// First, capture any records in db_records_to_delete.  (This has the keys of deleted objects etc..)
 		for(auto it = db_records_to_delete.begin(); it != db_records_to_delete.end(); ++it)
-		{
-			const DatabaseKey key = *it;
-			database.deleteRecord(key);
-		}
+			checkpoint->keys_to_delete.push_back(*it);
 		db_records_to_delete.clear();
 
 		
 		BufferOutStream temp_buf;
 
-		// Iterate over all objects, if they are dirty, write to the DB
+		// Iterate over all objects, if they are dirty, serialise them into the checkpoint
 
 		// For each world
 		for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 		{
 			const std::string world_name = world_it->first;
 			Reference<ServerWorldState> world_state = world_it->second;
+			TimedLock world_lock(world_state->mutex, world_state->mutex_wait_stats);
+
+			checkpoint->world_entries.push_back(DatabaseCheckpoint::WorldEntries());
+			DatabaseCheckpoint::WorldEntries& world_entries = checkpoint->world_entries.back();
+			world_entries.world = world_state;
+			world_entries.world_settings_dirty = world_state->world_settings.db_dirty;
+
+			// Capture records of objects deleted from this world
+			for(auto it = world_state->db_records_to_delete.begin(); it != world_state->db_records_to_delete.end(); ++it)
+				checkpoint->keys_to_delete.push_back(*it);
+			world_state->db_records_to_delete.clear();
 
 			// Write objects
 			{
@@ -863,7 +984,8 @@ void ServerAllWorldsState::serialiseToDisk()
 					if(!ob->database_key.valid())
 						ob->database_key = database.allocUnusedKey(); // Get a new key
 
-					database.updateRecord(ob->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+					checkpoint->addRecord(ob->database_key, temp_buf);
+					world_entries.objects.push_back(*it);
 
 					num_obs++;
 				}
@@ -884,7 +1006,8 @@ void ServerAllWorldsState::serialiseToDisk()
 					if(!parcel->database_key.valid())
 						parcel->database_key = database.allocUnusedKey(); // Get a new key
 
-					database.updateRecord(parcel->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+					checkpoint->addRecord(parcel->database_key, temp_buf);
+					world_entries.parcels.push_back(*it);
 
 					num_parcels++;
 				}
@@ -903,7 +1026,7 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!world_state->world_settings.database_key.valid())
 					world_state->world_settings.database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(world_state->world_settings.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				checkpoint->addRecord(world_state->world_settings.database_key, temp_buf);
 
 				world_state->world_settings.db_dirty = false;
 
@@ -923,7 +1046,8 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!user->database_key.valid())
 					user->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(user->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				checkpoint->addRecord(user->database_key, temp_buf);
+				checkpoint->users.push_back(*it);
 
 				num_users++;
 			}
@@ -943,7 +1067,8 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!resource->database_key.valid())
 					resource->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(resource->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				checkpoint->addRecord(resource->database_key, temp_buf);
+				checkpoint->resources.push_back(*i);
 
 				num_resources++;
 			}
@@ -953,6 +1078,7 @@ void ServerAllWorldsState::serialiseToDisk()
 
 		// Write orders
 		{
+			Lock orders_lock(orders_mutex);
 			for(auto i=db_dirty_orders.begin(); i != db_dirty_orders.end(); ++i)
 			{
 				Order* order = i->ptr();
@@ -963,7 +1089,8 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!order->database_key.valid())
 					order->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(order->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				checkpoint->addRecord(order->database_key, temp_buf);
+				checkpoint->orders.push_back(*i);
 
 				num_orders++;
 			}
@@ -973,6 +1100,7 @@ void ServerAllWorldsState::serialiseToDisk()
 
 		// Write UserWebSessions
 		{
+			Lock sessions_lock(sessions_mutex);
 			for(auto i=db_dirty_userwebsessions.begin(); i != db_dirty_userwebsessions.end(); ++i)
 			{
 				UserWebSession* session = i->ptr();
@@ -983,7 +1111,8 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!session->database_key.valid())
 					session->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(session->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				checkpoint->addRecord(session->database_key, temp_buf);
+				checkpoint->user_web_sessions.push_back(*i);
 
 				num_sessions++;
 			}
@@ -1003,7 +1132,8 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!auction->database_key.valid())
 					auction->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(auction->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				checkpoint->addRecord(auction->database_key, temp_buf);
+				checkpoint->parcel_auctions.push_back(*i);
 
 				num_auctions++;
 			}
@@ -1011,8 +1141,9 @@ void ServerAllWorldsState::serialiseToDisk()
 			db_dirty_parcel_auctions.clear();
 		}
 
-		// Write Screenshots
+		// Write Screenshots and MAP_TILE_INFO_CHUNK
 		{
+			Lock screenshots_lock(screenshots_mutex);
 			for(auto it=db_dirty_screenshots.begin(); it != db_dirty_screenshots.end(); ++it)
 			{
 				Screenshot* shot = it->ptr();
@@ -1023,12 +1154,48 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!shot->database_key.valid())
 					shot->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(shot->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				checkpoint->addRecord(shot->database_key, temp_buf);
+				checkpoint->screenshots.push_back(*it);
 
 				num_screenshots++;
 			}
 
 			db_dirty_screenshots.clear();
+
+			if(map_tile_info.db_dirty)
+			{
+				temp_buf.clear();
+				temp_buf.writeUInt32(MAP_TILE_INFO_CHUNK);
+				temp_buf.writeUInt32(MAP_TILE_INFO_VERSION);
+				temp_buf.writeInt32((int)map_tile_info.info.size());
+				for(auto it=map_tile_info.info.begin(); it != map_tile_info.info.end(); ++it)
+				{
+					Vec3<int> v = it->first;
+					const TileInfo& tile_info = it->second;
+
+					temp_buf.writeInt32(v.x);
+					temp_buf.writeInt32(v.y);
+					temp_buf.writeInt32(v.z);
+
+					temp_buf.writeInt32(tile_info.cur_tile_screenshot.nonNull() ? 1 : 0);
+					if(tile_info.cur_tile_screenshot.nonNull())
+						writeScreenshotToStream(*tile_info.cur_tile_screenshot, temp_buf);
+
+					temp_buf.writeInt32(tile_info.prev_tile_screenshot.nonNull() ? 1 : 0);
+					if(tile_info.prev_tile_screenshot.nonNull())
+						writeScreenshotToStream(*tile_info.prev_tile_screenshot, temp_buf);
+				}
+
+				if(!map_tile_info.database_key.valid())
+					map_tile_info.database_key = database.allocUnusedKey(); // Get a new key
+
+				checkpoint->addRecord(map_tile_info.database_key, temp_buf);
+				checkpoint->map_tile_info_dirty = true;
+
+				map_tile_info.db_dirty = false;
+
+				num_tiles_written = map_tile_info.info.size();
+			}
 		}
 
 		// Write SubEthTransactions
@@ -1043,7 +1210,8 @@ void ServerAllWorldsState::serialiseToDisk()
 				if(!trans->database_key.valid())
 					trans->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(trans->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				checkpoint->addRecord(trans->database_key, temp_buf);
+				checkpoint->sub_eth_transactions.push_back(*i);
 
 				num_sub_eth_transactions++;
 			}
@@ -1051,41 +1219,6 @@ void ServerAllWorldsState::serialiseToDisk()
 			db_dirty_sub_eth_transactions.clear();
 		}
 
-		// Write MAP_TILE_INFO_CHUNK
-		if(map_tile_info.db_dirty)
-		{
-			temp_buf.clear();
-			temp_buf.writeUInt32(MAP_TILE_INFO_CHUNK);
-			temp_buf.writeUInt32(MAP_TILE_INFO_VERSION);
-			temp_buf.writeInt32((int)map_tile_info.info.size());
-			for(auto it=map_tile_info.info.begin(); it != map_tile_info.info.end(); ++it)
-			{
-				Vec3<int> v = it->first;
-				const TileInfo& tile_info = it->second;
-
-				temp_buf.writeInt32(v.x);
-				temp_buf.writeInt32(v.y);
-				temp_buf.writeInt32(v.z);
-
-				temp_buf.writeInt32(tile_info.cur_tile_screenshot.nonNull() ? 1 : 0);
-				if(tile_info.cur_tile_screenshot.nonNull())
-					writeScreenshotToStream(*tile_info.cur_tile_screenshot, temp_buf);
-
-				temp_buf.writeInt32(tile_info.prev_tile_screenshot.nonNull() ? 1 : 0);
-				if(tile_info.prev_tile_screenshot.nonNull())
-					writeScreenshotToStream(*tile_info.prev_tile_screenshot, temp_buf);
-			}
-
-			if(!map_tile_info.database_key.valid())
-				map_tile_info.database_key = database.allocUnusedKey(); // Get a new key
-
-			database.updateRecord(map_tile_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
-
-			map_tile_info.db_dirty = false;
-
-			num_tiles_written = map_tile_info.info.size();
-		}
-
 		// Write LAST_PARCEL_SALE_UPDATE_CHUNK
 		if(last_parcel_update_info.db_dirty)
 		{
@@ -1099,7 +1232,8 @@ void ServerAllWorldsState::serialiseToDisk()
 			if(!last_parcel_update_info.database_key.valid())
 				last_parcel_update_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(last_parcel_update_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			checkpoint->addRecord(last_parcel_update_info.database_key, temp_buf);
+			checkpoint->last_parcel_update_info_dirty = true;
 
 			last_parcel_update_info.db_dirty = false;
 		}
@@ -1115,22 +1249,149 @@ void ServerAllWorldsState::serialiseToDisk()
 			if(!eth_info.database_key.valid())
 				eth_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(eth_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			checkpoint->addRecord(eth_info.database_key, temp_buf);
+			checkpoint->eth_info_dirty = true;
 
 			eth_info.db_dirty = false;
 		}
 
-		database.flush();
-
-		conPrint("Saved " + toString(num_obs) + " object(s), " + toString(num_users) + " user(s), " +
+		checkpoint->summary = toString(num_obs) + " object(s), " + toString(num_users) + " user(s), " +
 			toString(num_parcels) + " parcel(s), " + toString(num_resources) + " resource(s), " + toString(num_orders) + " order(s), " + 
 			toString(num_sessions) + " session(s), " + toString(num_auctions) + " auction(s), " + toString(num_screenshots) + " screenshot(s), " +
-			toString(num_sub_eth_transactions) + " sub eth transction(s), " + toString(num_tiles_written) + " tiles, " + toString(num_world_settings) + " world setting(s) in " + timer.elapsedStringNSigFigs(4));
+			toString(num_sub_eth_transactions) + " sub eth transction(s), " + toString(num_tiles_written) + " tiles, " + toString(num_world_settings) + " world setting(s), " + 
+			toString(checkpoint->keys_to_delete.size()) + " deletion(s)";
+	}
+
+	checkpoint->capture_time = timer.elapsed();
+	return checkpoint;
+}
+
+
+// Write the records in the checkpoint to the database, and flush it to disk.  Doesn't need mutex to be held.
+void ServerAllWorldsState::writeCheckpoint(const DatabaseCheckpoint& checkpoint)
+{
+	Timer timer;
+
+	try
+	{
+		Lock database_lock(database_mutex);
+
+		for(size_t i=0; i<checkpoint.keys_to_delete.size(); ++i)
+			database.deleteRecord(checkpoint.keys_to_delete[i]);
+
+		for(size_t i=0; i<checkpoint.records.size(); ++i)
+		{
+			const DatabaseCheckpoint::Record& record = checkpoint.records[i];
+			database.updateRecord(record.key, ArrayRef<uint8>(checkpoint.data.data() + record.offset, record.len));
+		}
+
+		database.flush();
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
 		throw glare::Exception(e.what());
 	}
+
+	const double write_time = timer.elapsed();
+
+	{
+		Lock lock(checkpoint_stats_mutex);
+		checkpoint_stats.num_checkpoints++;
+		checkpoint_stats.num_records += checkpoint.records.size() + checkpoint.keys_to_delete.size();
+		checkpoint_stats.num_bytes += checkpoint.data.size();
+		checkpoint_stats.total_capture_time += checkpoint.capture_time;
+		checkpoint_stats.max_capture_time = myMax(checkpoint_stats.max_capture_time, checkpoint.capture_time);
+		checkpoint_stats.total_write_time += write_time;
+		checkpoint_stats.max_write_time = myMax(checkpoint_stats.max_write_time, write_time);
+	}
+
+	conPrint("Saved " + checkpoint.summary + " (" + getNiceByteSize(checkpoint.data.size()) + "), captured in " + doubleToStringNSigFigs(checkpoint.capture_time * 1.0e3, 4) + 
+		" ms, written in " + doubleToStringNSigFigs(write_time * 1.0e3, 4) + " ms");
+}
+
+
+// Puts the contents of a checkpoint that could not be written back into the dirty sets, so that it will be written by the next checkpoint.
+// Entries that have been removed since the checkpoint was captured are skipped, so they aren't written back to the database after their deletion.
+void ServerAllWorldsState::checkpointWriteFailed(const DatabaseCheckpoint& checkpoint)
+{
+	Lock lock(mutex);
+
+	for(size_t i=0; i<checkpoint.keys_to_delete.size(); ++i)
+		db_records_to_delete.insert(checkpoint.keys_to_delete[i]);
+
+	for(size_t w=0; w<checkpoint.world_entries.size(); ++w)
+	{
+		const DatabaseCheckpoint::WorldEntries& entries = checkpoint.world_entries[w];
+		ServerWorldState* world_state = entries.world.ptr();
+		Lock world_lock(world_state->mutex);
+
+		for(size_t i=0; i<entries.objects.size(); ++i)
+		{
+			const auto res = world_state->objects.find(entries.objects[i]->uid);
+			if(res != world_state->objects.end() && res->second == entries.objects[i])
+				world_state->db_dirty_world_objects.insert(entries.objects[i]);
+		}
+
+		for(size_t i=0; i<entries.parcels.size(); ++i)
+		{
+			const auto res = world_state->parcels.find(entries.parcels[i]->id);
+			if(res != world_state->parcels.end() && res->second == entries.parcels[i])
+				world_state->db_dirty_parcels.insert(entries.parcels[i]);
+		}
+
+		if(entries.world_settings_dirty)
+			world_state->world_settings.db_dirty = true;
+	}
+
+	db_dirty_users.insert(checkpoint.users.begin(), checkpoint.users.end());
+	db_dirty_resources.insert(checkpoint.resources.begin(), checkpoint.resources.end());
+	db_dirty_parcel_auctions.insert(checkpoint.parcel_auctions.begin(), checkpoint.parcel_auctions.end());
+
+	for(size_t i=0; i<checkpoint.sub_eth_transactions.size(); ++i)
+	{
+		const auto res = sub_eth_transactions.find(checkpoint.sub_eth_transactions[i]->id);
+		if(res != sub_eth_transactions.end() && res->second == checkpoint.sub_eth_transactions[i])
+			db_dirty_sub_eth_transactions.insert(checkpoint.sub_eth_transactions[i]);
+	}
+
+	if(checkpoint.last_parcel_update_info_dirty)
+		last_parcel_update_info.db_dirty = true;
+	if(checkpoint.eth_info_dirty)
+		eth_info.db_dirty = true;
+
+	{
+		Lock orders_lock(orders_mutex);
+		db_dirty_orders.insert(checkpoint.orders.begin(), checkpoint.orders.end());
+	}
+
+	{
+		Lock sessions_lock(sessions_mutex);
+		for(size_t i=0; i<checkpoint.user_web_sessions.size(); ++i)
+		{
+			const auto res = user_web_sessions.find(checkpoint.user_web_sessions[i]->id);
+			if(res != user_web_sessions.end() && res->second == checkpoint.user_web_sessions[i])
+				db_dirty_userwebsessions.insert(checkpoint.user_web_sessions[i]);
+		}
+	}
+
+	{
+		Lock screenshots_lock(screenshots_mutex);
+		db_dirty_screenshots.insert(checkpoint.screenshots.begin(), checkpoint.screenshots.end());
+		if(checkpoint.map_tile_info_dirty)
+			map_tile_info.db_dirty = true;
+	}
+
+	markAsChanged();
+}
+
+
+// Write any changed data (objects in dirty set) to disk synchronously.  Mutex should be held already.
+void ServerAllWorldsState::serialiseToDisk()
+{
+	conPrint("Saving world state to disk...");
+
+	Reference<DatabaseCheckpoint> checkpoint = captureCheckpoint();
+	writeCheckpoint(*checkpoint);
 }
 
 
@@ -1147,7 +1408,7 @@ std::string ServerAllWorldsState::getCredential(const std::string& key) // Throw
 
 UID ServerAllWorldsState::getNextObjectUID()
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 
 	const UID next = next_object_uid;
 	next_object_uid = UID(next_object_uid.value() + 1);
@@ -1157,7 +1418,7 @@ UID ServerAllWorldsState::getNextObjectUID()
 
 UID ServerAllWorldsState::getNextAvatarUID()
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 
 	const UID next = next_avatar_uid;
 	next_avatar_uid = UID(next_avatar_uid.value() + 1);
@@ -1167,7 +1428,7 @@ UID ServerAllWorldsState::getNextAvatarUID()
 
 uint64 ServerAllWorldsState::getNextOrderUID()
 {
-	Lock lock(mutex);
+	Lock lock(orders_mutex);
 	return next_order_uid++;
 }
 
@@ -1181,7 +1442,7 @@ uint64 ServerAllWorldsState::getNextSubEthTransactionUID()
 
 uint64 ServerAllWorldsState::getNextScreenshotUID()
 {
-	Lock lock(mutex);
+	Lock lock(screenshots_mutex);
 
 	uint64 highest_id = 0;
 
@@ -18,31 +18,59 @@ Generated at 2016-01-12 12:22:34 +1300
 #include "ParcelAuction.h"
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
+#include "ServerObjectGrid.h"
+#include "ServerObjectRecordCache.h"
+#include "LockWaitStats.h"
 #include <ThreadSafeRefCounted.h>
 #include <Platform.h>
 #include <Mutex.h>
 #include <Database.h>
+#include <BufferOutStream.h>
 #include <map>
 #include <unordered_set>
+#include <atomic>
 
 
+/*=====================================================================
+ServerWorldState
+----------------
+The objects, avatars and parcels in a single world.
+
+Each world has its own mutex, so that activity in one world doesn't block other worlds.
+See the lock ordering notes for ServerAllWorldsState below.
+=====================================================================*/
 class ServerWorldState : public ThreadSafeRefCounted
 {
 public:
-	void addParcelAsDBDirty(const ParcelRef parcel) { db_dirty_parcels.insert(parcel); }
-	void addWorldObjectAsDBDirty(const WorldObjectRef ob) { db_dirty_world_objects.insert(ob); }
+	void addParcelAsDBDirty(const ParcelRef parcel) REQUIRES(mutex) { db_dirty_parcels.insert(parcel); }
+	void addWorldObjectAsDBDirty(const WorldObjectRef ob) REQUIRES(mutex) { db_dirty_world_objects.insert(ob); ob_record_cache.invalidate(ob.ptr()); }
 
-	WorldSettings world_settings;
+	// Objects should be added to and removed from the world with these methods, so that ob_grid and ob_record_cache are kept up to date.
+	void addObject(const WorldObjectRef& ob) REQUIRES(mutex); // Adds to objects map and ob_grid, replacing any existing object with the same UID.
+	void removeObject(const WorldObjectRef& ob) REQUIRES(mutex);
+	void objectTransformChanged(const WorldObjectRef& ob) REQUIRES(mutex) { ob_grid.objectMoved(ob); ob_record_cache.invalidate(ob.ptr()); } // Should be called after ob->pos is changed.
 
-	std::map<UID, Reference<Avatar>> avatars;
+	// Should be called after changing serialised object state that is not saved to the DB (e.g. physics ownership), so that new clients don't get stale state.
+	void invalidateObjectRecord(const WorldObjectRef& ob) REQUIRES(mutex) { ob_record_cache.invalidate(ob.ptr()); }
 
-	std::map<UID, WorldObjectRef> objects;
-	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects;
+	WorldSettings world_settings GUARDED_BY(mutex);
 
-	std::unordered_set<ParcelRef, ParcelRefHash> db_dirty_parcels;
-	std::unordered_set<WorldObjectRef, WorldObjectRefHash> db_dirty_world_objects;
+	std::map<UID, Reference<Avatar>> avatars GUARDED_BY(mutex);
+	std::unordered_set<UID, UIDHasher> dirty_avatars GUARDED_BY(mutex); // UIDs of avatars with other_dirty or transform_dirty set, so the broadcast only visits avatars that changed.
 
-	std::map<ParcelID, ParcelRef> parcels;
+	std::map<UID, WorldObjectRef> objects GUARDED_BY(mutex);
+	ServerObjectGrid ob_grid GUARDED_BY(mutex); // Spatial index over objects, for QueryObjects and QueryObjectsInAABB.
+	ServerObjectRecordCache ob_record_cache GUARDED_BY(mutex); // Serialised ObjectInitialSend messages, for GetAllObjects, QueryObjects and QueryObjectsInAABB.
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects GUARDED_BY(mutex);
+
+	std::unordered_set<ParcelRef, ParcelRefHash> db_dirty_parcels GUARDED_BY(mutex);
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> db_dirty_world_objects GUARDED_BY(mutex);
+	std::unordered_set<DatabaseKey, DatabaseKeyHash> db_records_to_delete GUARDED_BY(mutex); // Keys of deleted objects in this world.
+
+	std::map<ParcelID, ParcelRef> parcels GUARDED_BY(mutex);
+
+	mutable ::Mutex mutex;
+	LockWaitStats mutex_wait_stats; // Time spent waiting for mutex, for locks taken with TimedLock.
 };
 
 
@@ -99,9 +127,91 @@ struct ServerCredentials
 
 
 /*=====================================================================
-ServerWorldState
-----------------
+DatabaseCheckpoint
+------------------
+Serialised records captured from the DB dirty sets by ServerAllWorldsState::captureCheckpoint(),
+so that they can be written to the database by DatabaseWriterThread without holding any world state mutexes.
 
+Also keeps references to the dirty set entries the records were captured from, so that just those can be
+re-added to the dirty sets if the checkpoint can't be written.
+=====================================================================*/
+class DatabaseCheckpoint : public ThreadSafeRefCounted
+{
+public:
+	DatabaseCheckpoint() : capture_time(0), map_tile_info_dirty(false), last_parcel_update_info_dirty(false), eth_info_dirty(false) {}
+
+	struct Record
+	{
+		DatabaseKey key;
+		size_t offset; // Offset of the record data in data.
+		size_t len;
+	};
+
+	void addRecord(const DatabaseKey& key, const BufferOutStream& buf); // Copies the contents of buf.
+
+	std::vector<DatabaseKey> keys_to_delete;
+	std::vector<Record> records;
+	std::vector<uint8> data; // Data for all records, concatenated.
+
+	std::string summary; // Number of each type of record captured, for logging.
+	double capture_time; // Time spent in captureCheckpoint(), in seconds.
+
+	// Captured dirty set entries
+	struct WorldEntries
+	{
+		Reference<ServerWorldState> world;
+		std::vector<WorldObjectRef> objects;
+		std::vector<ParcelRef> parcels;
+		bool world_settings_dirty;
+	};
+	std::vector<WorldEntries> world_entries;
+	std::vector<UserRef> users;
+	std::vector<ResourceRef> resources;
+	std::vector<OrderRef> orders;
+	std::vector<UserWebSessionRef> user_web_sessions;
+	std::vector<ParcelAuctionRef> parcel_auctions;
+	std::vector<ScreenshotRef> screenshots;
+	std::vector<SubEthTransactionRef> sub_eth_transactions;
+	bool map_tile_info_dirty;
+	bool last_parcel_update_info_dirty;
+	bool eth_info_dirty;
+};
+
+
+struct CheckpointStats
+{
+	CheckpointStats() : num_checkpoints(0), num_records(0), num_bytes(0), total_capture_time(0), max_capture_time(0), total_write_time(0), max_write_time(0) {}
+
+	std::string toString() const;
+
+	uint64 num_checkpoints;
+	uint64 num_records; // Num records updated or deleted.
+	uint64 num_bytes;
+	double total_capture_time; // Time spent capturing checkpoints, with world state mutexes held.
+	double max_capture_time;
+	double total_write_time; // Time spent writing and flushing checkpoints to the database, without world state mutexes held.
+	double max_write_time;
+};
+
+
+/*=====================================================================
+ServerAllWorldsState
+--------------------
+State for all worlds, plus the users, web sessions, orders, screenshots etc. shared by all worlds.
+
+Locking:
+mutex protects users and everything else that isn't covered by one of the more specific mutexes below, including the world_states map,
+the database and the DB dirty sets.
+Each ServerWorldState has its own mutex protecting the contents of that world.
+sessions_mutex, orders_mutex, screenshots_mutex and uid_mutex protect their own subsystems.
+
+Lock ordering: if more than one lock needs to be held, they must be acquired in this order:
+	ServerAllWorldsState::mutex
+	database_mutex
+	ServerWorldState::mutex (at most one world at a time)
+	sessions_mutex, orders_mutex, screenshots_mutex or uid_mutex (at most one of these at a time)
+
+In particular, ServerAllWorldsState::mutex must not be acquired while a world mutex is held.
 =====================================================================*/
 class ServerAllWorldsState : public ThreadSafeRefCounted
 {
@@ -111,8 +221,21 @@ public:
 
 	void readFromDisk(const std::string& path);
 	void createNewDatabase(const std::string& path);
-	void serialiseToDisk() REQUIRES(mutex); // Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
-	void denormaliseData(); // Build/update cached/denormalised fields like creator_name.  Mutex should be locked already.
+	void serialiseToDisk() REQUIRES(mutex); // Write any changed data (objects in dirty set) to disk synchronously.  Mutex should be held already.  Locks each world mutex in turn.
+
+	// Serialises everything in the DB dirty sets, and the keys of deleted records, into a checkpoint, and clears the dirty sets.
+	// Mutex should be held already.  Locks database_mutex, and each world mutex in turn, but doesn't write to the database.
+	Reference<DatabaseCheckpoint> captureCheckpoint() REQUIRES(mutex);
+
+	// Writes the checkpoint records to the database and flushes it to disk.  Locks database_mutex only, so may be called while other threads are using the world state.
+	// Throws glare::Exception on failure.
+	void writeCheckpoint(const DatabaseCheckpoint& checkpoint);
+
+	// Called if writeCheckpoint() failed.  Re-adds the records in the checkpoint to the dirty sets, and its deleted keys to db_records_to_delete,
+	// so they will be saved by the next checkpoint.  Locks mutex, and each world mutex in turn.
+	void checkpointWriteFailed(const DatabaseCheckpoint& checkpoint);
+
+	void denormaliseData(); // Build/update cached/denormalised fields like creator_name.  Locks mutex.
 
 	// Removes sensitive information from the database, such as user passwords, email addresses, billing information, web sessions etc.
 	// Then saves the updates to disk.
@@ -120,11 +243,11 @@ public:
 
 	std::string getCredential(const std::string& key); // Throws glare::Exception if not found
 
-	UID getNextObjectUID(); // Gets and then increments next_object_uid.  Locks mutex.
-	UID getNextAvatarUID(); // Gets and then increments next_avatar_uid.  Locks mutex.
-	uint64 getNextOrderUID(); // Gets and then increments next_order_uid.  Locks mutex.
-	uint64 getNextSubEthTransactionUID();
-	uint64 getNextScreenshotUID();
+	UID getNextObjectUID(); // Gets and then increments next_object_uid.  Locks uid_mutex.
+	UID getNextAvatarUID(); // Gets and then increments next_avatar_uid.  Locks uid_mutex.
+	uint64 getNextOrderUID(); // Gets and then increments next_order_uid.  Locks orders_mutex.
+	uint64 getNextSubEthTransactionUID(); // Locks mutex.
+	uint64 getNextScreenshotUID(); // Locks screenshots_mutex.
 
 	void markAsChanged() { changed = 1; }
 	void clearChangedFlag() { changed = 0; }
@@ -133,42 +256,43 @@ public:
 	void setUserWebMessage(const UserID& user_id, const std::string& s);
 	std::string getAndRemoveUserWebMessage(const UserID& user_id); // returns empty string if no message or user
 
-	Reference<ServerWorldState> getRootWorldState(); // Guaranteed to return a non-null reference
+	Reference<ServerWorldState> getRootWorldState(); // Guaranteed to return a non-null reference.  Doesn't lock mutex.
 
 	void addResourcesAsDBDirty(const ResourceRef resource)					REQUIRES(mutex) { db_dirty_resources.insert(resource); changed = 1; }
 	void addSubEthTransactionAsDBDirty(const SubEthTransactionRef trans)	REQUIRES(mutex) { db_dirty_sub_eth_transactions.insert(trans); changed = 1; }
-	void addOrderAsDBDirty(const OrderRef order)							REQUIRES(mutex) { db_dirty_orders.insert(order); changed = 1; }
+	void addOrderAsDBDirty(const OrderRef order)							REQUIRES(orders_mutex) { db_dirty_orders.insert(order); changed = 1; }
 	void addParcelAuctionAsDBDirty(const ParcelAuctionRef parcel_auction)	REQUIRES(mutex) { db_dirty_parcel_auctions.insert(parcel_auction); changed = 1; }
-	void addUserWebSessionAsDBDirty(const UserWebSessionRef screenshot)		REQUIRES(mutex) { db_dirty_userwebsessions.insert(screenshot); changed = 1; }
-	void addScreenshotAsDBDirty(const ScreenshotRef screenshot)				REQUIRES(mutex) { db_dirty_screenshots.insert(screenshot); changed = 1; }
+	void addUserWebSessionAsDBDirty(const UserWebSessionRef screenshot)		REQUIRES(sessions_mutex) { db_dirty_userwebsessions.insert(screenshot); changed = 1; }
+	void addScreenshotAsDBDirty(const ScreenshotRef screenshot)				REQUIRES(screenshots_mutex) { db_dirty_screenshots.insert(screenshot); changed = 1; }
 	void addUserAsDBDirty(const UserRef user)								REQUIRES(mutex) { db_dirty_users.insert(user); changed = 1; }
 
-	void addEverythingToDirtySets();
+	void addEverythingToDirtySets(); // Locks mutex.
+	void addEverythingToDirtySetsLocked() REQUIRES(mutex);
 
-	bool isInReadOnlyMode();
+	bool isInReadOnlyMode() const { return read_only_mode; } // Doesn't lock, so may be called while holding any mutex.
 
-	void clearAndReset(); // Just for fuzzing
+	void clearAndReset(); // Just for fuzzing.  Removes all worlds apart from an empty root world, and resets UIDs.
 
 	Reference<ResourceManager> resource_manager;
 
 	std::map<UserID, Reference<User>> user_id_to_users GUARDED_BY(mutex);  // User id to user
 	std::map<std::string, Reference<User>> name_to_users GUARDED_BY(mutex); // Username to user
 
-	std::map<uint64, OrderRef> orders GUARDED_BY(mutex); // Order ID to order
+	std::map<uint64, OrderRef> orders GUARDED_BY(orders_mutex); // Order ID to order
 
 	std::map<std::string, Reference<ServerWorldState> > world_states GUARDED_BY(mutex); // ServerWorldState contains WorldObjects and Parcels
 
-	std::map<std::string, UserWebSessionRef> user_web_sessions GUARDED_BY(mutex); // Map from key to UserWebSession
+	std::map<std::string, UserWebSessionRef> user_web_sessions GUARDED_BY(sessions_mutex); // Map from key to UserWebSession
 	
 	std::map<uint32, ParcelAuctionRef> parcel_auctions GUARDED_BY(mutex); // ParcelAuction id to ParcelAuction
 
-	std::map<uint64, ScreenshotRef> screenshots GUARDED_BY(mutex);// Screenshot id to ScreenshotRef
+	std::map<uint64, ScreenshotRef> screenshots GUARDED_BY(screenshots_mutex);// Screenshot id to ScreenshotRef
 
 	std::map<uint64, SubEthTransactionRef> sub_eth_transactions GUARDED_BY(mutex); // SubEthTransaction id to SubEthTransaction
 
 
 	// For the map:
-	MapTileInfo map_tile_info;
+	MapTileInfo map_tile_info GUARDED_BY(screenshots_mutex);
 
 	LastParcelUpdateInfo last_parcel_update_info;
 
@@ -182,7 +306,7 @@ public:
 	std::vector<OpenSeaParcelListing> opensea_parcel_listings GUARDED_BY(mutex);
 
 	// Ephemeral state
-	TimeStamp last_screenshot_bot_contact_time GUARDED_BY(mutex);
+	TimeStamp last_screenshot_bot_contact_time GUARDED_BY(screenshots_mutex);
 	TimeStamp last_lightmapper_bot_contact_time GUARDED_BY(mutex);
 	TimeStamp last_eth_bot_contact_time GUARDED_BY(mutex);
 
@@ -191,7 +315,8 @@ public:
 	bool server_admin_message_changed GUARDED_BY(mutex);
 
 	// Ephemeral state - is the server in read-only mode?  When true, clients can't make changes to objects etc.
-	bool read_only_mode GUARDED_BY(mutex);
+	// Atomic so that it can be checked while holding a world mutex.
+	std::atomic<bool> read_only_mode;
 
 	// Ephemeral state - do we want to force the DynamicTextureUpdaterThread to do a run?
 	bool force_dyn_tex_update GUARDED_BY(mutex);
@@ -201,27 +326,43 @@ public:
 	// Sets of objects that should be written to (updated) in the database.
 	std::unordered_set<ResourceRef, ResourceRefHash>					db_dirty_resources				GUARDED_BY(mutex);
 	std::unordered_set<SubEthTransactionRef, SubEthTransactionRefHash>	db_dirty_sub_eth_transactions	GUARDED_BY(mutex);
-	std::unordered_set<OrderRef, OrderRefHash>							db_dirty_orders					GUARDED_BY(mutex);
+	std::unordered_set<OrderRef, OrderRefHash>							db_dirty_orders					GUARDED_BY(orders_mutex);
 	std::unordered_set<ParcelAuctionRef, ParcelAuctionRefHash>			db_dirty_parcel_auctions		GUARDED_BY(mutex);
-	std::unordered_set<UserWebSessionRef, UserWebSessionRefHash>		db_dirty_userwebsessions		GUARDED_BY(mutex);
-	std::unordered_set<ScreenshotRef, ScreenshotRefHash>				db_dirty_screenshots			GUARDED_BY(mutex);
+	std::unordered_set<UserWebSessionRef, UserWebSessionRefHash>		db_dirty_userwebsessions		GUARDED_BY(sessions_mutex);
+	std::unordered_set<ScreenshotRef, ScreenshotRefHash>				db_dirty_screenshots			GUARDED_BY(screenshots_mutex);
 	std::unordered_set<UserRef, UserRefHash>							db_dirty_users					GUARDED_BY(mutex);
 
-	std::unordered_set<DatabaseKey, DatabaseKeyHash>					db_records_to_delete			GUARDED_BY(mutex);
+	std::unordered_set<DatabaseKey, DatabaseKeyHash>					db_records_to_delete			GUARDED_BY(mutex); // Keys of deleted records, apart from world objects, see ServerWorldState::db_records_to_delete.
 
 
 	ServerCredentials server_credentials;
 
 	mutable ::Mutex mutex;
+	LockWaitStats mutex_wait_stats; // Time spent waiting for mutex, for locks taken with TimedLock.
+
+	mutable ::Mutex sessions_mutex;
+	mutable ::Mutex orders_mutex;
+	mutable ::Mutex screenshots_mutex;
+	mutable ::Mutex uid_mutex;
+
+	// Set by the main server thread when it hands a checkpoint to DatabaseWriterThread, cleared when the checkpoint has been written.
+	// The next checkpoint is not captured while this is set.
+	std::atomic<bool> checkpoint_in_progress;
+
+	::Mutex checkpoint_stats_mutex;
+	CheckpointStats checkpoint_stats GUARDED_BY(checkpoint_stats_mutex); // Accumulated by writeCheckpoint(), printed and reset by the main server thread.
 private:
 	GLARE_DISABLE_COPY(ServerAllWorldsState);
 
 	glare::AtomicInt changed;
 
-	UID next_object_uid GUARDED_BY(mutex);
-	UID next_avatar_uid GUARDED_BY(mutex);
-	uint64 next_order_uid GUARDED_BY(mutex);
+	Reference<ServerWorldState> root_world_state; // Same as world_states[""].  Only set in the constructor, readFromDisk() and clearAndReset(), when no other threads are running, so can be read without locking.
+
+	UID next_object_uid GUARDED_BY(uid_mutex);
+	UID next_avatar_uid GUARDED_BY(uid_mutex);
+	uint64 next_order_uid GUARDED_BY(orders_mutex);
 	uint64 next_sub_eth_transaction_uid GUARDED_BY(mutex);
 
-	Database database GUARDED_BY(mutex);
+	::Mutex database_mutex; // Held while writing to the database.  Taken by captureCheckpoint() to allocate keys.
+	Database database GUARDED_BY(database_mutex);
 };
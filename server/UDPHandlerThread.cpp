@@ -11,6 +11,8 @@ Copyright Glare Technologies Limited 2023 -
 #include <ConPrint.h>
 #include <StringUtils.h>
 #include <PlatformUtils.h>
+#include <ThreadManager.h>
+#include <utils/Clock.h>
 
 
 static const int server_UDP_port = 7601;
@@ -39,6 +41,18 @@ void UDPHandlerThread::doRun()
 
 		conPrint("UDPHandlerThread: Bound to port " + toString(server_UDP_port));
 
+		// Start voice relay threads
+		const int num_relay_threads = myClamp<int>((int)PlatformUtils::getNumLogicalProcessors() / 4, 1, 4);
+		ThreadManager relay_thread_manager;
+		std::vector<Reference<VoiceRelayThread>> relay_threads;
+		for(int i=0; i<num_relay_threads; ++i)
+		{
+			relay_threads.push_back(new VoiceRelayThread(server, udp_socket));
+			relay_thread_manager.addThread(relay_threads.back());
+		}
+
+		conPrint("UDPHandlerThread: Started " + toString(num_relay_threads) + " voice relay thread(s)");
+
 		std::vector<uint8> packet_buf(4096);
 		uint64 num_packets_rcvd = 0;
 
@@ -58,29 +72,11 @@ void UDPHandlerThread::doRun()
 				std::memcpy(&type, packet_buf.data(), 4);
 				if(type == 1) // If packet has voice type:
 				{
-					if(server->connected_clients_changed != 0)
+					uint32 sender_avatar_uid;
+					if(getVoicePacketSenderAvatarUID(packet_buf.data(), packet_len, sender_avatar_uid))
 					{
-						// Rebuild our connected_clients vector.
-						connected_clients.clear();
-
-						{
-							Lock lock(server->connected_clients_mutex);
-
-							for(auto it = server->connected_clients.begin(); it != server->connected_clients.end(); ++it)
-								if(it->second.client_UDP_port > 0) // If remote UDP port is known:
-									connected_clients.push_back(ConnectedClientInfo({it->second.ip_addr, it->second.client_UDP_port}));
-
-							server->connected_clients_changed = 0;
-						}
-					}
-
-					// Broadcast packet to clients
-					for(size_t i=0; i<connected_clients.size(); ++i)
-					{
-						if(num_packets_rcvd % 512 == 0) // Log occasional packets:
-							conPrint("UDPHandlerThread: Sending packet to " + connected_clients[i].ip_addr.toString() + ", port " + toString(connected_clients[i].client_UDP_port) + " ...");
-
-						udp_socket->sendPacket(packet_buf.data(), packet_len, connected_clients[i].ip_addr, connected_clients[i].client_UDP_port);
+						// Packets from the same speaker always go to the same relay thread, so they stay in order.
+						relay_threads[sender_avatar_uid % relay_threads.size()]->enqueuePacket(packet_buf.data(), packet_len, sender_avatar_uid, sender_ip_addr, Clock::getTimeSinceInit());
 					}
 				}
 				else if(type == 2)
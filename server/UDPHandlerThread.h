@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2023 -
 #pragma once
 
 
+#include "VoiceRelayThread.h"
 #include <MessageableThread.h>
 #include <UDPSocket.h>
 #include <IPAddress.h>
@@ -13,17 +14,13 @@ Copyright Glare Technologies Limited 2023 -
 class Server;
 
 
-struct ConnectedClientInfo
-{
-	IPAddress ip_addr;
-	int client_UDP_port;
-};
-
-
 /*=====================================================================
 UDPHandlerThread
 ----------------
-Handles UDP messages from clients, sends back to connected clients.
+Handles UDP messages from clients.
+
+Voice packets are handed off to the VoiceRelayThreads, sharded by speaker, which send them on
+to the clients in the same world as the speaker, within audible distance.
 =====================================================================*/
 class UDPHandlerThread : public MessageableThread
 {
@@ -34,7 +31,6 @@ public:
 	void doRun() override;
 
 private:
-	std::vector<ConnectedClientInfo> connected_clients;
 	Reference<UDPSocket> udp_socket;
 	Server* server;
 };
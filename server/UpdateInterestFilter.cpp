@@ -0,0 +1,419 @@
+/*=====================================================================
+UpdateInterestFilter.cpp
+------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "UpdateInterestFilter.h"
+
+
+#include <maths/mathstypes.h>
+#include <cstring>
+#include <limits>
+
+
+void TransformUpdateBatch::clear()
+{
+	updates.clear();
+	superseded_keys.clear();
+	data_size = 0;
+}
+
+
+void TransformUpdateBatch::addUpdate(uint64 key, const Vec3d& pos, const SocketBufferOutStream& packet, const QuantizedTransformUpdate* quantized)
+{
+	if(packet.buf.empty())
+		return;
+
+	SharedTransformUpdateRef update = new SharedTransformUpdate();
+	update->pos = pos;
+	update->key = key;
+	update->data.resize(packet.buf.size());
+	std::memcpy(update->data.data(), packet.buf.data(), packet.buf.size());
+	update->has_quantized = quantized != NULL;
+	if(quantized)
+		update->quantized = *quantized;
+
+	updates.push_back(update);
+	data_size += packet.buf.size();
+}
+
+
+UpdateInterestFilter::UpdateInterestFilter()
+:	last_distant_flush_time(-1.0e30),
+	quantized_packet(SocketBufferOutStream::DontUseNetworkByteOrder),
+	quantized_original_size(0)
+{}
+
+
+void UpdateInterestFilter::sendUpdate(const SharedTransformUpdate& update, bool use_quantized_updates, js::Vector<uint8, 16>& data_out, uint64& bytes_sent_in_out)
+{
+	if(use_quantized_updates && update.has_quantized)
+	{
+		encoder.addUpdate(update.quantized);
+		quantized_original_size += update.data.size();
+	}
+	else
+	{
+		const size_t write_i = data_out.size();
+		data_out.resize(write_i + update.data.size());
+		std::memcpy(&data_out[write_i], update.data.data(), update.data.size());
+		bytes_sent_in_out += update.data.size();
+	}
+}
+
+
+// Removes the update for key from updates, if there is one, counting it as saved.  Returns true if there was one.
+bool UpdateInterestFilter::erasePendingUpdate(UpdateMap& updates, uint64 key, uint64& bytes_saved_in_out)
+{
+	if(updates.empty())
+		return false;
+
+	const auto res = updates.find(key);
+	if(res == updates.end())
+		return false;
+
+	bytes_saved_in_out += res->second->data.size();
+	updates.erase(res);
+	return true;
+}
+
+
+void UpdateInterestFilter::filterUpdates(const TransformUpdateBatch& batch, bool cam_pos_known, const Vec3d& cam_pos, double cur_time, const UpdateInterestFilterConfig& config, bool use_quantized_updates,
+	js::Vector<uint8, 16>& data_out, uint64& bytes_sent_in_out, uint64& bytes_saved_in_out)
+{
+	if(use_quantized_updates)
+	{
+		encoder.begin(quantized_packet);
+		quantized_original_size = 0;
+	}
+
+	// Discard any throttled or out-of-range updates that are older than a full update, creation or destruction message that has been sent in the meantime.
+	for(size_t i=0; i<batch.superseded_keys.size(); ++i)
+	{
+		erasePendingUpdate(pending_distant_updates, batch.superseded_keys[i], bytes_saved_in_out);
+		erasePendingUpdate(out_of_range_updates, batch.superseded_keys[i], bytes_saved_in_out);
+	}
+
+	const double full_rate_radius2 = config.full_rate_radius * config.full_rate_radius;
+	const double max_radius2 = (config.max_radius > 0) ? (config.max_radius * config.max_radius) : std::numeric_limits<double>::infinity();
+
+	for(size_t i=0; i<batch.updates.size(); ++i)
+	{
+		const SharedTransformUpdateRef& update = batch.updates[i];
+
+		const double dist2 = cam_pos_known ? cam_pos.getDist2(update->pos) : 0.0;
+		if(dist2 <= full_rate_radius2 || !(dist2 == dist2)) // Send non-finite distances at full rate as well, to be conservative.
+		{
+			sendUpdate(*update, use_quantized_updates, data_out, bytes_sent_in_out);
+
+			// This update is newer than any throttled or out-of-range update for the same avatar or object, so remove those.
+			erasePendingUpdate(pending_distant_updates, update->key, bytes_saved_in_out);
+			erasePendingUpdate(out_of_range_updates, update->key, bytes_saved_in_out);
+		}
+		else if(dist2 <= max_radius2)
+		{
+			SharedTransformUpdateRef& pending = pending_distant_updates[update->key];
+			if(pending.nonNull())
+				bytes_saved_in_out += pending->data.size(); // The existing pending update is replaced without being sent.
+			pending = update;
+
+			erasePendingUpdate(out_of_range_updates, update->key, bytes_saved_in_out);
+		}
+		else
+		{
+			// Keep the update, in case the avatar or object comes back within max_radius without moving again.
+			auto res = out_of_range_updates.find(update->key);
+			if(res != out_of_range_updates.end())
+			{
+				bytes_saved_in_out += res->second->data.size(); // The existing out-of-range update is replaced without being sent.
+				res->second = update;
+			}
+			else if(out_of_range_updates.size() < (size_t)myMax(0, config.max_out_of_range_updates))
+				out_of_range_updates.insert(std::make_pair(update->key, update));
+			else
+				bytes_saved_in_out += update->data.size(); // Too many out-of-range updates kept already, drop this one.
+
+			// Any throttled update from before the avatar or object went out of range is out of date now.
+			erasePendingUpdate(pending_distant_updates, update->key, bytes_saved_in_out);
+		}
+	}
+
+	// Send throttled updates if they are due.
+	if(cur_time - last_distant_flush_time >= config.distant_update_period)
+	{
+		for(auto it = pending_distant_updates.begin(); it != pending_distant_updates.end(); ++it)
+			sendUpdate(*it->second, use_quantized_updates, data_out, bytes_sent_in_out);
+
+		pending_distant_updates.clear();
+
+		// Send the latest updates for avatars and objects that are back within max_radius, because the camera has moved, or max_radius has changed.
+		for(auto it = out_of_range_updates.begin(); it != out_of_range_updates.end(); )
+		{
+			const double dist2 = cam_pos_known ? cam_pos.getDist2(it->second->pos) : 0.0;
+			if(dist2 <= max_radius2 || !(dist2 == dist2))
+			{
+				sendUpdate(*it->second, use_quantized_updates, data_out, bytes_sent_in_out);
+				it = out_of_range_updates.erase(it);
+			}
+			else
+				++it;
+		}
+
+		last_distant_flush_time = cur_time;
+	}
+
+	if(use_quantized_updates && encoder.numUpdates() > 0)
+	{
+		encoder.finish();
+
+		const size_t write_i = data_out.size();
+		data_out.resize(write_i + quantized_packet.buf.size());
+		std::memcpy(&data_out[write_i], quantized_packet.buf.data(), quantized_packet.buf.size());
+
+		bytes_sent_in_out += quantized_packet.buf.size();
+		if(quantized_original_size > quantized_packet.buf.size())
+			bytes_saved_in_out += quantized_original_size - quantized_packet.buf.size();
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include "../shared/MessageUtils.h"
+#include "../shared/Protocol.h"
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/BufferInStream.h>
+
+
+static void addAvatarTransformUpdate(TransformUpdateBatch& batch, SocketBufferOutStream& packet, uint64 uid, const Vec3d& pos)
+{
+	MessageUtils::initPacket(packet, Protocol::AvatarTransformUpdate);
+	writeToStream(UID(uid), packet);
+	writeToStream(pos, packet);
+	writeToStream(Vec3f(0.f), packet);
+	packet.writeUInt32(0);
+	MessageUtils::updatePacketLengthField(packet);
+
+	QuantizedTransformUpdate quantized;
+	testAssert(QuantizedTransformUpdates::quantizeAvatarTransform(UID(uid), pos, Vec3f(0.f), 0, quantized));
+
+	batch.addUpdate(TransformUpdateBatch::makeAvatarKey(UID(uid)), pos, packet, &quantized);
+}
+
+
+void UpdateInterestFilter::test()
+{
+	conPrint("UpdateInterestFilter::test()");
+
+	UpdateInterestFilterConfig config;
+	config.full_rate_radius = 100;
+	config.max_radius = 1000;
+	config.distant_update_period = 0.5;
+
+	const Vec3d cam_pos(1000, 2000, 0);
+
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	TransformUpdateBatch batch;
+	addAvatarTransformUpdate(batch, packet, /*uid=*/1, cam_pos + Vec3d(10, 0, 0)); // near
+	addAvatarTransformUpdate(batch, packet, /*uid=*/2, cam_pos + Vec3d(0, 500, 0)); // distant
+	addAvatarTransformUpdate(batch, packet, /*uid=*/3, cam_pos + Vec3d(0, 0, 5000)); // out of range
+	testAssert(batch.updates.size() == 3);
+	const size_t msg_size = batch.updates[0]->data.size();
+	testAssert(batch.updates[1]->data.size() == msg_size && batch.updates[2]->data.size() == msg_size);
+	testAssert(batch.data_size == msg_size * 3);
+
+	//-------------------- Test with unknown camera position: all updates should be sent --------------------
+	{
+		UpdateInterestFilter filter;
+		js::Vector<uint8, 16> data_out;
+		uint64 sent = 0, saved = 0;
+		filter.filterUpdates(batch, /*cam_pos_known=*/false, Vec3d(0.0), /*cur_time=*/10.0, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.size() == msg_size * 3);
+		testAssert(sent == msg_size * 3 && saved == 0);
+		testAssert(filter.numPendingDistantUpdates() == 0);
+	}
+
+	//-------------------- Test near, distant and out-of-range updates --------------------
+	{
+		UpdateInterestFilter filter;
+		js::Vector<uint8, 16> data_out;
+		uint64 sent = 0, saved = 0;
+
+		// First call: no distant updates have been sent yet, so the distant update is sent straight away.  The out-of-range one is kept, but not sent.
+		filter.filterUpdates(batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.0, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.size() == msg_size * 2);
+		testAssert(sent == msg_size * 2 && saved == 0);
+		testAssert(filter.numOutOfRangeUpdates() == 1);
+		testAssert(std::memcmp(data_out.data(), batch.updates[0]->data.data(), msg_size) == 0); // Near update should come first.
+		testAssert(filter.numPendingDistantUpdates() == 0);
+
+		// Second call, before distant_update_period has elapsed: only the near update is sent, the distant one is held back.  The kept out-of-range update is replaced.
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.1, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.size() == msg_size);
+		testAssert(sent == msg_size && saved == msg_size);
+		testAssert(filter.numPendingDistantUpdates() == 1);
+
+		// Third call: the held-back distant and out-of-range updates are replaced by the newer ones.
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.2, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.size() == msg_size);
+		testAssert(sent == msg_size && saved == msg_size * 2);
+		testAssert(filter.numPendingDistantUpdates() == 1);
+
+		// After distant_update_period, with an empty batch: the held-back distant update should be sent.
+		TransformUpdateBatch empty_batch;
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(empty_batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.6, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.size() == msg_size);
+		testAssert(std::memcmp(data_out.data(), batch.updates[1]->data.data(), msg_size) == 0);
+		testAssert(sent == msg_size && saved == 0);
+		testAssert(filter.numPendingDistantUpdates() == 0);
+
+		// Hold back another distant update, then supersede it with a full update.  It should not be sent.
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.7, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(filter.numPendingDistantUpdates() == 1);
+
+		TransformUpdateBatch superseding_batch;
+		superseding_batch.addSupersededKey(TransformUpdateBatch::makeAvatarKey(UID(2)));
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(superseding_batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/20.0, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.size() == 0);
+		testAssert(sent == 0 && saved == msg_size);
+		testAssert(filter.numPendingDistantUpdates() == 0);
+	}
+
+	//-------------------- Test sending quantized updates --------------------
+	{
+		UpdateInterestFilter filter;
+		js::Vector<uint8, 16> data_out;
+		uint64 sent = 0, saved = 0;
+		filter.filterUpdates(batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.0, config, /*use_quantized_updates=*/true, data_out, sent, saved);
+
+		// Near and distant updates should be in a single QuantizedTransformUpdates message, the out-of-range update should be dropped.
+		testAssert(sent == data_out.size());
+		testAssert(data_out.size() < msg_size * 2);
+		testAssert(saved == msg_size * 2 - data_out.size());
+
+		BufferInStream msg_buffer;
+		msg_buffer.buf.resize(data_out.size());
+		std::memcpy(msg_buffer.buf.data(), data_out.data(), data_out.size());
+		testAssert(msg_buffer.readUInt32() == Protocol::QuantizedTransformUpdates);
+		testAssert(msg_buffer.readUInt32() == (uint32)data_out.size());
+		std::vector<QuantizedTransformUpdate> updates;
+		QuantizedTransformUpdates::readUpdates(msg_buffer, updates);
+		testAssert(msg_buffer.endOfStream());
+		testAssert(updates.size() == 2);
+		testAssert(updates[0].uid == 1 && updates[1].uid == 2);
+		testAssert(QuantizedTransformUpdates::getPos(updates[0]).getDist(cam_pos + Vec3d(10, 0, 0)) <= QuantizedTransformUpdates::POS_QUANTUM);
+
+		// With no updates to send, nothing should be written.
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(TransformUpdateBatch(), /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.1, config, /*use_quantized_updates=*/true, data_out, sent, saved);
+		testAssert(data_out.empty() && sent == 0 && saved == 0);
+	}
+
+	//-------------------- Test an avatar that stops moving while out of range gets its latest transform when it comes back in range --------------------
+	{
+		UpdateInterestFilter filter;
+		js::Vector<uint8, 16> data_out;
+		uint64 sent = 0, saved = 0;
+
+		// Avatar 4 is distant, so its update is sent straight away on the first call, then held back on the next.
+		TransformUpdateBatch distant_batch;
+		addAvatarTransformUpdate(distant_batch, packet, /*uid=*/4, cam_pos + Vec3d(0, 500, 0));
+		filter.filterUpdates(distant_batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.0, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(distant_batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.1, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(filter.numPendingDistantUpdates() == 1);
+
+		// It then moves out of range.  The held-back update is out of date, so should be discarded rather than sent later.
+		TransformUpdateBatch out_of_range_batch;
+		addAvatarTransformUpdate(out_of_range_batch, packet, /*uid=*/4, cam_pos + Vec3d(0, 3000, 0));
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(out_of_range_batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.2, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.empty());
+		testAssert(sent == 0 && saved == msg_size);
+		testAssert(filter.numPendingDistantUpdates() == 0 && filter.numOutOfRangeUpdates() == 1);
+
+		// No more updates for avatar 4, and the camera stays put: nothing should be sent.
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(TransformUpdateBatch(), /*cam_pos_known=*/true, cam_pos, /*cur_time=*/11.0, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.empty());
+		testAssert(filter.numOutOfRangeUpdates() == 1);
+
+		// The camera moves towards avatar 4, so it is back within max_radius.  Its latest update should be sent with the throttled updates.
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(TransformUpdateBatch(), /*cam_pos_known=*/true, cam_pos + Vec3d(0, 2500, 0), /*cur_time=*/12.0, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.size() == msg_size);
+		testAssert(std::memcmp(data_out.data(), out_of_range_batch.updates[0]->data.data(), msg_size) == 0);
+		testAssert(sent == msg_size && saved == 0);
+		testAssert(filter.numOutOfRangeUpdates() == 0);
+
+		// A newer in-range update for the avatar replaces a kept out-of-range update.
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(out_of_range_batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/12.1, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(filter.numOutOfRangeUpdates() == 1);
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(distant_batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/12.2, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(filter.numOutOfRangeUpdates() == 0 && filter.numPendingDistantUpdates() == 1);
+		testAssert(saved == msg_size);
+
+		// A kept out-of-range update is discarded if superseded, e.g. by the avatar being destroyed.
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(out_of_range_batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/12.3, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(filter.numOutOfRangeUpdates() == 1);
+		TransformUpdateBatch superseding_batch;
+		superseding_batch.addSupersededKey(TransformUpdateBatch::makeAvatarKey(UID(4)));
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(superseding_batch, /*cam_pos_known=*/true, cam_pos + Vec3d(0, 2500, 0), /*cur_time=*/20.0, config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.empty());
+		testAssert(filter.numOutOfRangeUpdates() == 0);
+	}
+
+	//-------------------- Test held-back updates are shared with the batch, not copied, and the number of out-of-range updates kept is capped --------------------
+	{
+		UpdateInterestFilterConfig capped_config = config;
+		capped_config.max_out_of_range_updates = 1;
+
+		UpdateInterestFilter filter;
+		js::Vector<uint8, 16> data_out;
+		uint64 sent = 0, saved = 0;
+		filter.filterUpdates(batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.0, capped_config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.1, capped_config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(filter.numPendingDistantUpdates() == 1 && filter.numOutOfRangeUpdates() == 1);
+		testAssert(batch.updates[1]->getRefCount() == 2 && batch.updates[2]->getRefCount() == 2); // Referenced by the batch and the filter.
+
+		// Another out-of-range avatar: there is no room to keep its update, so it is dropped.
+		TransformUpdateBatch other_out_of_range_batch;
+		addAvatarTransformUpdate(other_out_of_range_batch, packet, /*uid=*/5, cam_pos + Vec3d(0, 0, -5000));
+		data_out.clear(); sent = saved = 0;
+		filter.filterUpdates(other_out_of_range_batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.2, capped_config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.empty());
+		testAssert(saved == msg_size);
+		testAssert(filter.numOutOfRangeUpdates() == 1);
+		testAssert(other_out_of_range_batch.updates[0]->getRefCount() == 1);
+	}
+
+	//-------------------- Test with no max radius --------------------
+	{
+		UpdateInterestFilterConfig unlimited_config = config;
+		unlimited_config.max_radius = 0;
+
+		UpdateInterestFilter filter;
+		js::Vector<uint8, 16> data_out;
+		uint64 sent = 0, saved = 0;
+		filter.filterUpdates(batch, /*cam_pos_known=*/true, cam_pos, /*cur_time=*/10.0, unlimited_config, /*use_quantized_updates=*/false, data_out, sent, saved);
+		testAssert(data_out.size() == msg_size * 3);
+		testAssert(sent == msg_size * 3 && saved == 0);
+	}
+
+	conPrint("UpdateInterestFilter::test() done.");
+}
+
+
+#endif // BUILD_TESTS
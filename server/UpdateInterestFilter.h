@@ -0,0 +1,134 @@
+/*=====================================================================
+UpdateInterestFilter.h
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UID.h"
+#include "../shared/QuantizedTransformUpdates.h"
+#include <maths/vec3.h>
+#include <Vector.h>
+#include <Platform.h>
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <SocketBufferOutStream.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+struct UpdateInterestFilterConfig
+{
+	UpdateInterestFilterConfig() : full_rate_radius(150.0), max_radius(1000.0), distant_update_period(0.5), max_out_of_range_updates(16384) {}
+
+	double full_rate_radius; // Transform updates for avatars and objects within this distance of the client camera are sent every broadcast.
+	double max_radius; // Transform updates further than this from the client camera are not sent.  <= 0 means no limit.
+	double distant_update_period; // Transform updates between full_rate_radius and max_radius are sent at most once per this many seconds.
+	int max_out_of_range_updates; // Max number of avatars and objects outside of max_radius each client keeps the latest update for.  Updates for further avatars and objects are dropped.
+};
+
+
+/*=====================================================================
+SharedTransformUpdate
+---------------------
+A single encoded AvatarTransformUpdate, ObjectTransformUpdate or ObjectPhysicsTransformUpdate message.
+Immutable once added to a TransformUpdateBatch, so it can be referenced by the UpdateInterestFilters of all the clients
+it is held back for, instead of each client keeping its own copy.
+=====================================================================*/
+class SharedTransformUpdate : public ThreadSafeRefCounted
+{
+public:
+	Vec3d pos; // Position of the avatar or object.
+	uint64 key; // Identifies the avatar or object the update is for, see TransformUpdateBatch::makeAvatarKey() and makeObjectKey().
+	js::Vector<uint8, 16> data; // The message.
+	QuantizedTransformUpdate quantized;
+	bool has_quantized; // False if the update could not be quantized.
+};
+typedef Reference<SharedTransformUpdate> SharedTransformUpdateRef;
+
+
+/*=====================================================================
+TransformUpdateBatch
+--------------------
+The transform updates for a single world for a single broadcast.
+
+Built once per broadcast by the main server thread, then filtered per client by UpdateInterestFilter.
+=====================================================================*/
+class TransformUpdateBatch
+{
+public:
+	TransformUpdateBatch() : data_size(0) {}
+
+	void clear();
+	bool empty() const { return updates.empty() && superseded_keys.empty(); }
+
+	// Appends the message in packet to the batch.  The packet length field should already be updated.
+	// quantized is the same update in quantized form, for clients that support QuantizedTransformUpdates messages, or NULL if it could not be quantized.
+	void addUpdate(uint64 key, const Vec3d& pos, const SocketBufferOutStream& packet, const QuantizedTransformUpdate* quantized);
+
+	// Records that a full update, creation or destruction message for the avatar or object was broadcast in the same broadcast as this batch,
+	// so any older throttled transform update for it should not be sent any more.
+	void addSupersededKey(uint64 key) { superseded_keys.push_back(key); }
+
+	static uint64 makeAvatarKey(const UID& uid) { return uid.value() * 2; }
+	static uint64 makeObjectKey(const UID& uid) { return uid.value() * 2 + 1; }
+
+	std::vector<SharedTransformUpdateRef> updates;
+	std::vector<uint64> superseded_keys;
+	size_t data_size; // Total size of the messages in updates.
+};
+
+
+/*=====================================================================
+UpdateInterestFilter
+--------------------
+Area-of-interest filtering of transform updates for a single client.
+
+Updates for avatars and objects near the client camera are sent at full rate.
+For more distant avatars and objects, only the most recent update is kept, and is sent
+at most once every distant_update_period seconds.
+Updates outside of max_radius are not sent, but the most recent one for each avatar or object is kept, for up to max_out_of_range_updates
+avatars and objects.  If the avatar or object comes back within max_radius, either because it moves or the camera does,
+its latest update is sent with the next throttled updates, so the client doesn't keep a stale transform for it.
+
+Held-back updates are references to the SharedTransformUpdate from the batch, so are shared with other clients, and only one is kept per avatar or object.
+
+For clients that support them, updates with a quantized form are packed into a single QuantizedTransformUpdates message.
+
+Not threadsafe, only accessed by the main server thread.
+=====================================================================*/
+class UpdateInterestFilter
+{
+public:
+	UpdateInterestFilter();
+
+	// Appends the messages from batch that should be sent to the client now, and any throttled updates that are now due, to data_out.
+	// If cam_pos_known is false, all messages in batch are appended.
+	// If use_quantized_updates is true, updates that have a quantized form are sent in a QuantizedTransformUpdates message instead.
+	// Adds the number of bytes appended to bytes_sent_in_out.
+	// Adds the size of the original messages that were dropped or replaced by a newer update before being sent, plus the size reduction from quantization, to bytes_saved_in_out.
+	void filterUpdates(const TransformUpdateBatch& batch, bool cam_pos_known, const Vec3d& cam_pos, double cur_time, const UpdateInterestFilterConfig& config, bool use_quantized_updates,
+		js::Vector<uint8, 16>& data_out, uint64& bytes_sent_in_out, uint64& bytes_saved_in_out);
+
+	size_t numPendingDistantUpdates() const { return pending_distant_updates.size(); }
+	size_t numOutOfRangeUpdates() const { return out_of_range_updates.size(); }
+
+	static void test();
+
+private:
+	typedef std::unordered_map<uint64, SharedTransformUpdateRef> UpdateMap;
+
+	bool erasePendingUpdate(UpdateMap& updates, uint64 key, uint64& bytes_saved_in_out);
+
+	void sendUpdate(const SharedTransformUpdate& update, bool use_quantized_updates, js::Vector<uint8, 16>& data_out, uint64& bytes_sent_in_out);
+
+	UpdateMap pending_distant_updates; // Latest throttled update for each distant avatar or object, keyed by TransformUpdateBatch key.
+	UpdateMap out_of_range_updates; // Latest unsent update for each avatar or object outside of max_radius, keyed by TransformUpdateBatch key.
+	double last_distant_flush_time;
+
+	QuantizedTransformUpdates::Encoder encoder;
+	SocketBufferOutStream quantized_packet;
+	size_t quantized_original_size; // Total size of the original messages for the updates added to encoder.
+};
@@ -0,0 +1,406 @@
+/*=====================================================================
+VoiceRelay.cpp
+--------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "VoiceRelay.h"
+
+
+#include <utils/Clock.h>
+#include <maths/mathstypes.h>
+#include <StringUtils.h>
+
+
+static std::atomic<uint64> next_client_set_version(1);
+
+
+VoiceRelayClientSet::VoiceRelayClientSet()
+:	version(next_client_set_version++)
+{
+}
+
+
+void VoiceRelayClientSet::buildIndex()
+{
+	avatar_uid_to_index.clear();
+	avatar_uid_to_index.reserve(clients.size());
+	for(size_t i=0; i<clients.size(); ++i)
+		avatar_uid_to_index[clients[i].avatar_uid] = (uint32)i;
+}
+
+
+int VoiceRelayClientSet::findClientForAvatar(uint32 avatar_uid) const
+{
+	auto res = avatar_uid_to_index.find(avatar_uid);
+	return (res != avatar_uid_to_index.end()) ? (int)res->second : -1;
+}
+
+
+void VoiceRelayClientSet::getRecipients(size_t sender_index, double max_audible_dist, std::vector<uint32>& recipients_out) const
+{
+	const VoiceRelayClient& sender = clients[sender_index];
+	const bool filter_by_dist = (max_audible_dist > 0) && sender.pos_known;
+	const double max_dist2 = max_audible_dist * max_audible_dist;
+
+	for(size_t i=0; i<clients.size(); ++i)
+	{
+		const VoiceRelayClient& client = clients[i];
+		if((i != sender_index) && (client.world_index == sender.world_index))
+		{
+			if(!filter_by_dist || !client.pos_known || (client.pos.getDist2(sender.pos) <= max_dist2))
+				recipients_out.push_back((uint32)i);
+		}
+	}
+}
+
+
+void VoicePacketBatch::addPacket(const uint8* packet_data, size_t packet_len, uint32 sender_avatar_uid, const IPAddress& sender_ip_addr, double receive_time)
+{
+	Packet packet;
+	packet.offset = data.size();
+	packet.len = (uint32)packet_len;
+	packet.sender_avatar_uid = sender_avatar_uid;
+	packet.sender_ip_addr = sender_ip_addr;
+	packet.receive_time = receive_time;
+	packets.push_back(packet);
+
+	data.resize(data.size() + packet_len);
+	if(packet_len > 0)
+		std::memcpy(&data[packet.offset], packet_data, packet_len);
+}
+
+
+std::string VoiceRelayStats::Snapshot::toString(double period) const
+{
+	return ::toString(num_packets_relayed) + " packets relayed (" + doubleToStringNSigFigs(num_packets_relayed / period, 4) + " /s), " + ::toString(num_packets_sent) + " packets sent (" +
+		doubleToStringNSigFigs(num_packets_sent / period, 4) + " /s), " + ::toString(num_packets_dropped) + " dropped, " + ::toString(num_batches) + " batches, mean relay latency: " +
+		doubleToStringNSigFigs((num_packets_relayed > 0) ? (total_latency_ns * 1.0e-3 / num_packets_relayed) : 0.0, 4) + " us, max relay latency: " + doubleToStringNSigFigs(max_latency_ns * 1.0e-6, 4) + " ms";
+}
+
+
+VoiceRelayStats::Snapshot VoiceRelayStats::getAndReset()
+{
+	Snapshot s;
+	s.num_packets_relayed = num_packets_relayed.exchange(0);
+	s.num_packets_sent = num_packets_sent.exchange(0);
+	s.num_packets_dropped = num_packets_dropped.exchange(0);
+	s.num_batches = num_batches.exchange(0);
+	s.total_latency_ns = total_latency_ns.exchange(0);
+	s.max_latency_ns = max_latency_ns.exchange(0);
+	return s;
+}
+
+
+VoiceRelayer::VoiceRelayer()
+:	cached_client_set_version(0)
+{
+}
+
+
+void VoiceRelayer::relayBatch(const VoiceRelayClientSet& client_set, const VoicePacketBatch& batch, const VoiceRelayConfig& config, VoicePacketSender& sender, VoiceRelayStats& stats)
+{
+	if(client_set.version != cached_client_set_version)
+	{
+		// Recipient lists were computed for a different client set, so can't be reused.
+		recipient_cache.clear();
+		cached_client_set_version = client_set.version;
+	}
+
+	uint64 num_relayed = 0;
+	uint64 num_sent = 0;
+	uint64 num_dropped = 0;
+	uint64 total_latency_ns = 0;
+	uint64 max_latency_ns = 0;
+
+	for(size_t i=0; i<batch.packets.size(); ++i)
+	{
+		const VoicePacketBatch::Packet& packet = batch.packets[i];
+
+		const int sender_index = client_set.findClientForAvatar(packet.sender_avatar_uid);
+		if(sender_index < 0 || !(client_set.clients[sender_index].ip_addr == packet.sender_ip_addr)) // Drop packets from unknown clients, or claiming to be from another client's avatar.
+		{
+			num_dropped++;
+			continue;
+		}
+
+		auto res = recipient_cache.find(packet.sender_avatar_uid);
+		if(res == recipient_cache.end())
+		{
+			res = recipient_cache.insert(std::make_pair(packet.sender_avatar_uid, std::vector<uint32>())).first;
+			client_set.getRecipients(sender_index, config.max_audible_dist, res->second);
+		}
+		const std::vector<uint32>& recipients = res->second;
+
+		for(size_t z=0; z<recipients.size(); ++z)
+		{
+			const VoiceRelayClient& recipient = client_set.clients[recipients[z]];
+			sender.sendPacket(&batch.data[packet.offset], packet.len, recipient.ip_addr, recipient.UDP_port);
+		}
+
+		num_relayed++;
+		num_sent += recipients.size();
+
+		const uint64 latency_ns = (uint64)(myMax(0.0, Clock::getTimeSinceInit() - packet.receive_time) * 1.0e9);
+		total_latency_ns += latency_ns;
+		max_latency_ns = myMax(max_latency_ns, latency_ns);
+	}
+
+	stats.num_packets_relayed += num_relayed;
+	stats.num_packets_sent += num_sent;
+	stats.num_packets_dropped += num_dropped;
+	stats.num_batches++;
+	stats.total_latency_ns += total_latency_ns;
+
+	uint64 cur_max = stats.max_latency_ns;
+	while(max_latency_ns > cur_max && !stats.max_latency_ns.compare_exchange_weak(cur_max, max_latency_ns))
+	{}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/Timer.h>
+#include <utils/TaskManager.h>
+#include <utils/Task.h>
+#include <maths/PCG32.h>
+
+
+class CountingVoicePacketSender : public VoicePacketSender
+{
+public:
+	CountingVoicePacketSender() : num_packets(0), num_bytes(0), checksum(0) {}
+
+	virtual void sendPacket(const uint8* data, size_t len, const IPAddress& ip_addr, int port) override
+	{
+		num_packets++;
+		num_bytes += len;
+		checksum += (uint64)port * data[len - 1]; // Touch the packet data so the send isn't completely free.
+		sent_to_ports.push_back(port);
+	}
+
+	uint64 num_packets;
+	uint64 num_bytes;
+	uint64 checksum;
+	std::vector<int> sent_to_ports;
+};
+
+
+static VoiceRelayClient makeClient(uint32 avatar_uid, uint32 world_index, const Vec3d& pos)
+{
+	VoiceRelayClient client;
+	client.ip_addr = IPAddress("127.0.0.1");
+	client.UDP_port = 10000 + (int)avatar_uid;
+	client.avatar_uid = avatar_uid;
+	client.world_index = world_index;
+	client.pos = pos;
+	client.pos_known = true;
+	return client;
+}
+
+
+static void addVoicePacket(VoicePacketBatch& batch, uint32 sender_avatar_uid, uint32 seq_num, size_t payload_size)
+{
+	std::vector<uint8> packet(sizeof(uint32) * 3 + payload_size, 7);
+	const uint32 type = 1;
+	std::memcpy(packet.data(), &type, sizeof(uint32));
+	std::memcpy(packet.data() + 4, &sender_avatar_uid, sizeof(uint32));
+	std::memcpy(packet.data() + 8, &seq_num, sizeof(uint32));
+
+	uint32 read_uid;
+	testAssert(getVoicePacketSenderAvatarUID(packet.data(), packet.size(), read_uid) && read_uid == sender_avatar_uid);
+
+	batch.addPacket(packet.data(), packet.size(), sender_avatar_uid, IPAddress("127.0.0.1"), Clock::getTimeSinceInit());
+}
+
+
+// Relays one shard of the benchmark packets.  Packets are sharded by sender, as done by UDPHandlerThread, so each shard has its own VoiceRelayer.
+class VoiceRelayBenchmarkTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		for(size_t i=0; i<batches->size(); ++i)
+			relayer.relayBatch(*client_set, (*batches)[i], config, sender, *stats);
+	}
+
+	VoiceRelayer relayer;
+	const VoiceRelayClientSet* client_set;
+	const std::vector<VoicePacketBatch>* batches;
+	VoiceRelayConfig config;
+	CountingVoicePacketSender sender;
+	VoiceRelayStats* stats;
+};
+
+
+// Synthetic clients spread over a few worlds, with a fraction of them speaking.  Measures relayed packets per second and relay latency.
+static void doPerfTest(int num_clients, int num_worlds, int num_relay_threads)
+{
+	PCG32 rng(1);
+
+	const double world_w = 2000.0;
+	const int num_speakers = myMax(1, num_clients / 10);
+	const int packets_per_speaker = 50; // 1 s of voice with 20 ms Opus frames.
+	const int packets_per_batch = 64;
+
+	VoiceRelayClientSetRef client_set = new VoiceRelayClientSet();
+	for(int i=0; i<num_clients; ++i)
+		client_set->clients.push_back(makeClient(/*avatar uid=*/(uint32)i, /*world index=*/(uint32)(i % num_worlds), Vec3d((rng.unitRandom() - 0.5) * world_w, (rng.unitRandom() - 0.5) * world_w, 2.0)));
+	client_set->buildIndex();
+
+	// Make the batches for each shard.
+	std::vector<std::vector<VoicePacketBatch>> shard_batches(num_relay_threads);
+	for(int p=0; p<packets_per_speaker; ++p)
+		for(int s=0; s<num_speakers; ++s)
+		{
+			std::vector<VoicePacketBatch>& batches = shard_batches[s % num_relay_threads];
+			if(batches.empty() || batches.back().packets.size() >= (size_t)packets_per_batch)
+				batches.push_back(VoicePacketBatch());
+			addVoicePacket(batches.back(), /*sender avatar uid=*/(uint32)s, /*seq num=*/(uint32)p, /*payload size=*/80);
+		}
+
+	glare::TaskManager task_manager("VoiceRelay perf test task manager", num_relay_threads);
+	VoiceRelayStats stats;
+	std::vector<Reference<VoiceRelayBenchmarkTask>> tasks;
+	for(int i=0; i<num_relay_threads; ++i)
+	{
+		Reference<VoiceRelayBenchmarkTask> task = new VoiceRelayBenchmarkTask();
+		task->client_set = client_set.ptr();
+		task->batches = &shard_batches[i];
+		task->stats = &stats;
+		tasks.push_back(task);
+	}
+
+	// Latency is measured from when each packet was added to its batch, so includes time spent queued behind earlier batches in the same shard.
+	Timer timer;
+	for(int i=0; i<num_relay_threads; ++i)
+		task_manager.addTask(tasks[i]);
+	task_manager.waitForTasksToComplete();
+	const double elapsed = timer.elapsed();
+
+	const VoiceRelayStats::Snapshot snapshot = stats.getAndReset();
+	testAssert(snapshot.num_packets_relayed == (uint64)num_speakers * packets_per_speaker);
+	testAssert(snapshot.num_packets_dropped == 0);
+
+	uint64 num_sent = 0;
+	for(int i=0; i<num_relay_threads; ++i)
+		num_sent += tasks[i]->sender.num_packets;
+	testAssert(num_sent == snapshot.num_packets_sent);
+
+	// The old relay sent every voice packet to every client on the server.
+	const uint64 num_sent_unfiltered = (uint64)num_speakers * packets_per_speaker * num_clients;
+
+	conPrint("VoiceRelay perf test: " + toString(num_clients) + " clients, " + toString(num_worlds) + " world(s), " + toString(num_speakers) + " speakers, " + toString(num_relay_threads) + " relay thread(s)");
+	conPrint("    relayed " + toString(snapshot.num_packets_relayed) + " packets in " + doubleToStringNSigFigs(elapsed * 1.0e3, 4) + " ms: " +
+		doubleToStringNSigFigs(snapshot.num_packets_relayed / elapsed, 4) + " packets/s relayed, " + doubleToStringNSigFigs(snapshot.num_packets_sent / elapsed, 4) + " packets/s sent");
+	conPrint("    packets sent: " + toString(snapshot.num_packets_sent) + " (" + toString(num_sent_unfiltered) + " without world and distance filtering)");
+	conPrint("    max latency from batch build to send: " + doubleToStringNSigFigs(snapshot.max_latency_ns * 1.0e-6, 4) + " ms");
+}
+
+
+void VoiceRelayer::test()
+{
+	conPrint("VoiceRelayer::test()");
+
+	//-------------------- Test recipient filtering --------------------
+	{
+		VoiceRelayClientSetRef client_set = new VoiceRelayClientSet();
+		client_set->clients.push_back(makeClient(/*avatar uid=*/1, /*world index=*/0, Vec3d(0, 0, 0)));
+		client_set->clients.push_back(makeClient(/*avatar uid=*/2, /*world index=*/0, Vec3d(50, 0, 0))); // Within audible distance of 1
+		client_set->clients.push_back(makeClient(/*avatar uid=*/3, /*world index=*/0, Vec3d(1000, 0, 0))); // Too far from 1
+		client_set->clients.push_back(makeClient(/*avatar uid=*/4, /*world index=*/1, Vec3d(0, 0, 0))); // In a different world
+		client_set->clients.push_back(makeClient(/*avatar uid=*/5, /*world index=*/0, Vec3d(2000, 0, 0)));
+		client_set->clients.back().pos_known = false; // Position not known, so not distance filtered.
+		client_set->buildIndex();
+
+		testAssert(client_set->findClientForAvatar(3) == 2);
+		testAssert(client_set->findClientForAvatar(100) == -1);
+
+		VoiceRelayConfig config;
+		config.max_audible_dist = 200.0;
+
+		VoiceRelayer relayer;
+		VoiceRelayStats stats;
+
+		{
+			VoicePacketBatch batch;
+			addVoicePacket(batch, /*sender avatar uid=*/1, /*seq num=*/0, /*payload size=*/10);
+			addVoicePacket(batch, /*sender avatar uid=*/1, /*seq num=*/1, /*payload size=*/10);
+			addVoicePacket(batch, /*sender avatar uid=*/4, /*seq num=*/0, /*payload size=*/10); // No one else in world 1
+			addVoicePacket(batch, /*sender avatar uid=*/100, /*seq num=*/0, /*payload size=*/10); // Unknown sender, should be dropped.
+
+			CountingVoicePacketSender sender;
+			relayer.relayBatch(*client_set, batch, config, sender, stats);
+
+			testAssert(sender.sent_to_ports == std::vector<int>({10002, 10005, 10002, 10005}));
+
+			const VoiceRelayStats::Snapshot snapshot = stats.getAndReset();
+			testAssert(snapshot.num_packets_relayed == 3);
+			testAssert(snapshot.num_packets_sent == 4);
+			testAssert(snapshot.num_packets_dropped == 1);
+			testAssert(snapshot.num_batches == 1);
+		}
+
+		// Test with no distance limit
+		{
+			config.max_audible_dist = 0;
+			VoiceRelayer relayer2;
+
+			VoicePacketBatch batch;
+			addVoicePacket(batch, /*sender avatar uid=*/1, /*seq num=*/0, /*payload size=*/10);
+
+			CountingVoicePacketSender sender;
+			relayer2.relayBatch(*client_set, batch, config, sender, stats);
+			testAssert(sender.sent_to_ports == std::vector<int>({10002, 10003, 10005}));
+			stats.getAndReset();
+		}
+
+		// Test that recipient lists are recomputed when the client set changes.
+		{
+			config.max_audible_dist = 200.0;
+
+			VoiceRelayClientSetRef client_set2 = new VoiceRelayClientSet();
+			client_set2->clients = client_set->clients;
+			client_set2->clients[2].pos = Vec3d(10, 0, 0); // Avatar 3 moves near avatar 1
+			client_set2->buildIndex();
+			testAssert(client_set2->version != client_set->version);
+
+			VoicePacketBatch batch;
+			addVoicePacket(batch, /*sender avatar uid=*/1, /*seq num=*/2, /*payload size=*/10);
+
+			CountingVoicePacketSender sender;
+			relayer.relayBatch(*client_set2, batch, config, sender, stats);
+			testAssert(sender.sent_to_ports == std::vector<int>({10002, 10003, 10005}));
+			stats.getAndReset();
+		}
+
+		// Test that a packet claiming to be from a client, but coming from a different IP address, is dropped.
+		{
+			VoicePacketBatch batch;
+			std::vector<uint8> packet(16, 0);
+			const uint32 uid = 1;
+			std::memcpy(packet.data() + 4, &uid, sizeof(uint32));
+			batch.addPacket(packet.data(), packet.size(), uid, IPAddress("10.0.0.1"), Clock::getTimeSinceInit());
+
+			CountingVoicePacketSender sender;
+			relayer.relayBatch(*client_set, batch, config, sender, stats);
+			testAssert(sender.num_packets == 0);
+			testAssert(stats.getAndReset().num_packets_dropped == 1);
+		}
+	}
+
+	//-------------------- Perf test: packets per second and relay latency with synthetic clients --------------------
+	if(false)
+	{
+		doPerfTest(/*num clients=*/100,  /*num worlds=*/1, /*num relay threads=*/1);
+		doPerfTest(/*num clients=*/2000, /*num worlds=*/4, /*num relay threads=*/1);
+		doPerfTest(/*num clients=*/2000, /*num worlds=*/4, /*num relay threads=*/4);
+	}
+
+	conPrint("VoiceRelayer::test() done.");
+}
+
+
+#endif // BUILD_TESTS
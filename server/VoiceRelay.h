@@ -0,0 +1,171 @@
+/*=====================================================================
+VoiceRelay.h
+------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <maths/vec3.h>
+#include <IPAddress.h>
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Platform.h>
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+struct VoiceRelayConfig
+{
+	VoiceRelayConfig() : max_audible_dist(200.0) {}
+
+	double max_audible_dist; // Voice packets are only relayed to clients whose avatar is within this distance of the speaking avatar.  <= 0 means no limit.
+};
+
+
+struct VoiceRelayClient
+{
+	IPAddress ip_addr;
+	int UDP_port; // UDP port on client end
+	uint32 avatar_uid; // Lower 32 bits of the client avatar UID, as written in voice packets.
+	uint32 world_index; // Index of the world the client is connected to.  Clients in different worlds don't hear each other.
+	Vec3d pos; // Avatar position
+	bool pos_known; // False if the avatar position was not known when the client set was built.  Distance filtering is not done in that case.
+};
+
+
+/*=====================================================================
+VoiceRelayClientSet
+-------------------
+Immutable snapshot of the clients that voice packets can be relayed to.
+Built periodically by the main server thread, and shared with the voice relay threads,
+so they don't need to take any world locks.
+=====================================================================*/
+class VoiceRelayClientSet : public ThreadSafeRefCounted
+{
+public:
+	VoiceRelayClientSet();
+
+	// Builds avatar_uid_to_index from clients.  Should be called after clients has been filled in.
+	void buildIndex();
+
+	// Returns the index in clients of the client with the given avatar UID, or -1 if not found.
+	int findClientForAvatar(uint32 avatar_uid) const;
+
+	// Appends the indices of the clients that should receive voice from the client with index sender_index: clients in the same world, other than the sender,
+	// within max_audible_dist of the sender.
+	void getRecipients(size_t sender_index, double max_audible_dist, std::vector<uint32>& recipients_out) const;
+
+	std::vector<VoiceRelayClient> clients;
+	std::unordered_map<uint32, uint32> avatar_uid_to_index;
+	uint64 version; // Unique for each client set built, so per-sender recipient lists computed for a client set can be reused.
+};
+typedef Reference<VoiceRelayClientSet> VoiceRelayClientSetRef;
+
+
+/*=====================================================================
+VoicePacketBatch
+----------------
+A batch of received voice packets, stored contiguously.
+=====================================================================*/
+class VoicePacketBatch
+{
+public:
+	struct Packet
+	{
+		size_t offset; // Offset of the packet in data.
+		uint32 len;
+		uint32 sender_avatar_uid;
+		IPAddress sender_ip_addr;
+		double receive_time; // Time the packet was received, for measuring relay latency.
+	};
+
+	void addPacket(const uint8* packet_data, size_t packet_len, uint32 sender_avatar_uid, const IPAddress& sender_ip_addr, double receive_time);
+	void clear() { data.clear(); packets.clear(); }
+	bool empty() const { return packets.empty(); }
+
+	std::vector<uint8> data;
+	std::vector<Packet> packets;
+};
+
+
+class VoicePacketSender
+{
+public:
+	virtual ~VoicePacketSender() {}
+
+	virtual void sendPacket(const uint8* data, size_t len, const IPAddress& ip_addr, int port) = 0;
+};
+
+
+/*=====================================================================
+VoiceRelayStats
+---------------
+Threadsafe.
+=====================================================================*/
+class VoiceRelayStats
+{
+public:
+	VoiceRelayStats() : num_packets_relayed(0), num_packets_sent(0), num_packets_dropped(0), num_batches(0), total_latency_ns(0), max_latency_ns(0) {}
+
+	struct Snapshot
+	{
+		std::string toString(double period) const;
+
+		uint64 num_packets_relayed; // Number of received voice packets relayed.
+		uint64 num_packets_sent; // Number of packets sent to recipients.
+		uint64 num_packets_dropped; // Number of received voice packets dropped because the sender was not a known client.
+		uint64 num_batches;
+		uint64 total_latency_ns;
+		uint64 max_latency_ns;
+	};
+
+	// Returns the stats accumulated since the last call, and resets them.
+	Snapshot getAndReset();
+
+	std::atomic<uint64> num_packets_relayed;
+	std::atomic<uint64> num_packets_sent;
+	std::atomic<uint64> num_packets_dropped;
+	std::atomic<uint64> num_batches;
+	std::atomic<uint64> total_latency_ns;
+	std::atomic<uint64> max_latency_ns;
+};
+
+
+/*=====================================================================
+VoiceRelayer
+------------
+Relays batches of voice packets to the clients in the same world as the speaker, within audible distance.
+
+The recipient list for each speaker is computed once per client set, and reused for all packets
+from that speaker until the client set changes.
+
+Not threadsafe, each voice relay thread has its own VoiceRelayer.
+=====================================================================*/
+class VoiceRelayer
+{
+public:
+	VoiceRelayer();
+
+	void relayBatch(const VoiceRelayClientSet& client_set, const VoicePacketBatch& batch, const VoiceRelayConfig& config, VoicePacketSender& sender, VoiceRelayStats& stats);
+
+	static void test();
+
+private:
+	uint64 cached_client_set_version;
+	std::unordered_map<uint32, std::vector<uint32>> recipient_cache; // Map from sender avatar UID to recipient client indices.
+};
+
+
+// Reads the sender avatar UID from a voice packet.  Voice packets have a uint32 type, then the lower 32 bits of the sender avatar UID, then a uint32 sequence number.
+// Returns false if the packet is too short.
+inline bool getVoicePacketSenderAvatarUID(const uint8* packet_data, size_t packet_len, uint32& avatar_uid_out)
+{
+	if(packet_len < sizeof(uint32) * 3)
+		return false;
+	std::memcpy(&avatar_uid_out, packet_data + sizeof(uint32), sizeof(uint32));
+	return true;
+}
@@ -0,0 +1,115 @@
+/*=====================================================================
+VoiceRelayThread.cpp
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "VoiceRelayThread.h"
+
+
+#include "Server.h"
+#include <ConPrint.h>
+#include <Lock.h>
+#include <StringUtils.h>
+#include <PlatformUtils.h>
+
+
+class UDPSocketVoicePacketSender : public VoicePacketSender
+{
+public:
+	UDPSocketVoicePacketSender(UDPSocket* udp_socket_) : udp_socket(udp_socket_) {}
+
+	virtual void sendPacket(const uint8* data, size_t len, const IPAddress& ip_addr, int port) override
+	{
+		udp_socket->sendPacket(data, len, ip_addr, port);
+	}
+
+	UDPSocket* udp_socket;
+};
+
+
+// If the relay thread falls this far behind, drop new packets rather than queueing them.  Voice that late isn't useful anyway.
+static const size_t MAX_PENDING_PACKETS = 8192;
+
+
+VoiceRelayThread::VoiceRelayThread(Server* server_, Reference<UDPSocket> udp_socket_)
+:	server(server_),
+	udp_socket(udp_socket_),
+	die(false)
+{
+}
+
+
+VoiceRelayThread::~VoiceRelayThread()
+{
+}
+
+
+void VoiceRelayThread::enqueuePacket(const uint8* packet_data, size_t packet_len, uint32 sender_avatar_uid, const IPAddress& sender_ip_addr, double receive_time)
+{
+	bool was_empty;
+	{
+		Lock lock(queue_mutex);
+		if(pending_batch.packets.size() >= MAX_PENDING_PACKETS)
+		{
+			server->voice_relay_stats.num_packets_dropped++;
+			return;
+		}
+		was_empty = pending_batch.empty();
+		pending_batch.addPacket(packet_data, packet_len, sender_avatar_uid, sender_ip_addr, receive_time);
+	}
+
+	if(was_empty) // The relay thread only waits when the batch is empty, so only need to wake it in that case.
+		queue_condition.notify();
+}
+
+
+void VoiceRelayThread::kill()
+{
+	{
+		Lock lock(queue_mutex);
+		die = true;
+	}
+	queue_condition.notify();
+}
+
+
+void VoiceRelayThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("VoiceRelayThread");
+
+	try
+	{
+		VoiceRelayer relayer;
+		UDPSocketVoicePacketSender sender(udp_socket.ptr());
+		VoicePacketBatch batch;
+
+		while(1)
+		{
+			{
+				Lock lock(queue_mutex);
+				while(pending_batch.empty() && !die)
+					queue_condition.wait(queue_mutex); // Suspend until packets are enqueued, or we get a spurious wake up.
+
+				if(die)
+					break;
+
+				// Take all pending packets.  Swap so that the buffers are reused and don't need to be reallocated.
+				batch.clear();
+				std::swap(batch.data, pending_batch.data);
+				std::swap(batch.packets, pending_batch.packets);
+			}
+
+			VoiceRelayClientSetRef client_set = server->getVoiceRelayClients();
+			if(client_set.nonNull())
+				relayer.relayBatch(*client_set, batch, server->config.voice_relay_config, sender, server->voice_relay_stats);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("VoiceRelayThread: glare::Exception: " + e.what());
+	}
+	catch(std::bad_alloc&)
+	{
+		conPrint("VoiceRelayThread: Caught std::bad_alloc.");
+	}
+}
@@ -0,0 +1,49 @@
+/*=====================================================================
+VoiceRelayThread.h
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "VoiceRelay.h"
+#include <MessageableThread.h>
+#include <UDPSocket.h>
+#include <Mutex.h>
+#include <Condition.h>
+class Server;
+
+
+/*=====================================================================
+VoiceRelayThread
+----------------
+Relays voice packets received by UDPHandlerThread to the clients that can hear them.
+
+UDPHandlerThread appends received packets to pending_batch.  This thread takes all
+the packets that arrived while it was relaying the previous batch, and relays them together.
+
+There may be several of these threads.  Packets from a given speaker always go to the same thread,
+so they are relayed in the order they were received.
+=====================================================================*/
+class VoiceRelayThread : public MessageableThread
+{
+public:
+	VoiceRelayThread(Server* server, Reference<UDPSocket> udp_socket);
+	~VoiceRelayThread();
+
+	void doRun() override;
+
+	void kill() override;
+
+	// Called by UDPHandlerThread
+	void enqueuePacket(const uint8* packet_data, size_t packet_len, uint32 sender_avatar_uid, const IPAddress& sender_ip_addr, double receive_time);
+
+private:
+	Server* server;
+	Reference<UDPSocket> udp_socket; // Shared with UDPHandlerThread and the other relay threads.  Sending on the same socket from multiple threads is fine.
+
+	Mutex queue_mutex;
+	Condition queue_condition;
+	VoicePacketBatch pending_batch GUARDED_BY(queue_mutex);
+	bool die GUARDED_BY(queue_mutex);
+};
@@ -11,12 +11,14 @@ Copyright Glare Technologies Limited 2018 -
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
 #include "MeshLODGenThread.h"
+#include "ResourceFileSender.h"
 #include "../webserver/LoginHandlers.h"
 #include "../shared/Protocol.h"
 #include "../shared/ProtocolStructs.h"
 #include "../shared/UID.h"
 #include "../shared/WorldObject.h"
 #include "../shared/MessageUtils.h"
+#include "../shared/CompressedMessages.h"
 #include "../shared/FileTypes.h"
 #include <vec3.h>
 #include <ConPrint.h>
@@ -35,7 +37,6 @@ Copyright Glare Technologies Limited 2018 -
 #include <KillThreadMessage.h>
 #include <Parser.h>
 #include <FileUtils.h>
-#include <MemMappedFile.h>
 #include <FileOutStream.h>
 #include <networking/RecordingSocket.h>
 #include <maths/CheckedMaths.h>
@@ -47,15 +48,28 @@ Copyright Glare Technologies Limited 2018 -
 
 static const bool VERBOSE = false;
 static const int MAX_STRING_LEN = 10000;
+static const uint64 MAX_NUM_FILES_PER_GET_FILES = 100000;
 static const bool CAPTURE_TRACES = false; // If true, records a trace of data read from the socket, for fuzz seeding.
 
 
 WorkerThread::WorkerThread(const Reference<SocketInterface>& socket_, Server* server_)
-:	socket(socket_),
+:	client_protocol_version(0),
+	socket(socket_),
 	server(server_),
 	scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder),
+	compressed_packet(SocketBufferOutStream::DontUseNetworkByteOrder),
+	client_cam_pos(0.0),
+	client_cam_pos_known(false),
+	broadcast_bytes_sent(0),
+	broadcast_bytes_saved(0),
 	fuzzing(false),
-	write_trace(false)
+	write_trace(false),
+	handshake_done(false),
+	connection_type(0),
+	client_avatar_uid(0),
+	client_user_id(UserID::invalidUserID()),
+	client_user_flags(0),
+	logged_in_user_is_lightmapper_bot(false)
 {
 	//if(VERBOSE) print("event_fd.efd: " + toString(event_fd.efd));
 
@@ -69,6 +83,36 @@ WorkerThread::~WorkerThread()
 }
 
 
+void WorkerThread::writeQueryResponseToClient(const SocketBufferOutStream& packet)
+{
+	const bool compress = (client_protocol_version >= 42) && server->config.compress_object_query_responses; // CompressedMessages was added in protocol version 42.
+
+	size_t chunk_begin = 0;
+	while(chunk_begin < packet.buf.size())
+	{
+		if(compress)
+		{
+			// Make the first chunk small, so the client can start loading the closest objects as soon as possible.
+			const size_t max_chunk_size = (chunk_begin == 0) ? CompressedMessages::FIRST_CHUNK_MAX_SIZE : CompressedMessages::CHUNK_MAX_SIZE;
+			const size_t chunk_end = CompressedMessages::findChunkEnd(packet.buf.data(), packet.buf.size(), chunk_begin, max_chunk_size);
+
+			compressed_packet.buf.clear();
+			CompressedMessages::appendCompressedMessage(&packet.buf[chunk_begin], chunk_end - chunk_begin, CompressedMessages::DEFAULT_COMPRESSION_LEVEL, compressed_packet);
+			socket->writeData(compressed_packet.buf.data(), compressed_packet.buf.size());
+			chunk_begin = chunk_end;
+		}
+		else
+		{
+			const size_t chunk_end = CompressedMessages::findChunkEnd(packet.buf.data(), packet.buf.size(), chunk_begin, /*max chunk size=*/4096);
+			socket->writeData(&packet.buf[chunk_begin], chunk_end - chunk_begin);
+			chunk_begin = chunk_end;
+		}
+
+		socket->flush(); // Will cause websockets to send a data frame.
+	}
+}
+
+
 // Checks if the resource is present on the server, if not, sends a GetFile message (or rather enqueues to send) to the client.
 void WorkerThread::sendGetFileMessageIfNeeded(const std::string& resource_URL)
 {
@@ -122,18 +166,13 @@ static void writeErrorMessageToClient(SocketInterfaceRef& socket, const std::str
 }
 
 
-// Enqueues packet to all WorkerThreads to send to all clients connected to the server.
+// Enqueues packet to send to all clients connected to the server.
 static void enqueuePacketToBroadcast(const SocketBufferOutStream& packet_buffer, Server* server)
 {
 	assert(packet_buffer.buf.size() > 0);
 	if(packet_buffer.buf.size() > 0)
 	{
-		Lock lock(server->worker_thread_manager.getMutex());
-		for(auto i = server->worker_thread_manager.getThreads().begin(); i != server->worker_thread_manager.getThreads().end(); ++i)
-		{
-			assert(dynamic_cast<WorkerThread*>(i->getPointer()));
-			static_cast<WorkerThread*>(i->getPointer())->enqueueDataToSend(packet_buffer);
-		}
+		server->enqueuePacketToAllClients(packet_buffer);
 	}
 }
 
@@ -305,6 +344,7 @@ void WorkerThread::handleResourceUploadConnection()
 				for(auto world_it = server->world_state->world_states.begin(); world_it != server->world_state->world_states.end(); ++world_it)
 				{
 					ServerWorldState* world = world_it->second.ptr();
+					Lock world_lock(world->mutex);
 
 					std::set<DependencyURL> URLs;
 					for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
@@ -352,66 +392,231 @@ void WorkerThread::handleResourceUploadConnection()
 }
 
 
+void WorkerThread::handleResourceRequest(ResourceRequestScheduler& scheduler)
+{
+	const uint32 request_id = socket->readUInt32();
+	const std::string URL = socket->readStringLengthFirst(MAX_STRING_LEN);
+	const uint64 requested_start_offset = socket->readUInt64();
+	const float priority = socket->readFloat();
+	if(!isFinite(priority))
+		throw glare::Exception("Invalid priority");
+
+	// conPrintIfNotFuzzing("Handling ResourceRequest: request_id: " + toString(request_id) + ", URL: '" + URL + "', priority: " + toString(priority));
+
+	Reference<ResourceRequestScheduler::Request> request = new ResourceRequestScheduler::Request();
+	request->request_id = request_id;
+	request->priority = priority;
+
+	bool opened = false;
+	if(ResourceManager::isValidURL(URL))
+	{
+		ResourceRef resource = server->world_state->resource_manager->getExistingResourceForURL(URL);
+		if(resource.nonNull() && (resource->getState() == Resource::State_Present))
+		{
+			try
+			{
+				request->file_sender.open(server->world_state->resource_manager->getLocalAbsPathForResource(*resource));
+				opened = true;
+			}
+			catch(glare::Exception& e)
+			{
+				conPrintIfNotFuzzing("\tException while trying to open file for URL: " + e.what());
+			}
+		}
+	}
+
+	if(!opened)
+	{
+		socket->writeUInt32(Protocol::ResourceRequestResult);
+		socket->writeUInt32(request_id);
+		socket->writeUInt32(1); // Write error result
+		return;
+	}
+
+	request->end = request->file_sender.fileSize();
+	// A client may have a partial file from a different version of the resource.  If it is longer than our file, it can't be a prefix of it, so send the whole file.
+	request->start_offset = (requested_start_offset <= request->end) ? requested_start_offset : 0;
+	request->offset = request->start_offset;
+
+	scratch_packet.buf.clear();
+	scratch_packet.writeUInt32(Protocol::ResourceRequestResult);
+	scratch_packet.writeUInt32(request_id);
+	scratch_packet.writeUInt32(0); // OK result
+	scratch_packet.writeUInt64(request->end); // Write file size
+	scratch_packet.writeUInt64(request->offset); // Write offset the data starts from
+	socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+
+	if(request->offset < request->end)
+		scheduler.addRequest(request); // Throws if there are too many outstanding requests, or the id is in use.
+	else
+		finishResourceRequest(*request);
+}
+
+
+void WorkerThread::sendNextResourceChunk(ResourceRequestScheduler& scheduler)
+{
+	const uint64 MAX_CHUNK_SIZE = 64 * 1024; // Bounds how long a more important request has to wait behind a less important one.
+
+	ResourceRequestScheduler::Request* request = scheduler.getNextRequest();
+	assert(request);
+
+	const uint64 chunk_size = myMin(request->end - request->offset, MAX_CHUNK_SIZE);
+
+	scratch_packet.buf.clear();
+	scratch_packet.writeUInt32(Protocol::ResourceDataChunk);
+	scratch_packet.writeUInt32(request->request_id);
+	scratch_packet.writeUInt32((uint32)chunk_size);
+	socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+
+	request->file_sender.sendRange(*socket, request->offset, chunk_size); // Throws on socket error, which ends the connection.
+	request->offset += chunk_size;
+
+	if(request->offset == request->end)
+	{
+		Reference<ResourceRequestScheduler::Request> completed = scheduler.removeRequest(request->request_id);
+		finishResourceRequest(*completed);
+	}
+}
+
+
+void WorkerThread::finishResourceRequest(const ResourceRequestScheduler::Request& request)
+{
+	if(request.offset == request.end)
+	{
+		server->resource_send_stats.num_files_sent++;
+		if(request.start_offset > 0)
+			server->resource_send_stats.num_files_resumed++;
+	}
+	server->resource_send_stats.num_bytes_sent_zero_copy += request.file_sender.num_bytes_sent_zero_copy;
+	server->resource_send_stats.num_bytes_sent_copied += request.file_sender.num_bytes_sent_copied;
+}
+
+
 void WorkerThread::handleResourceDownloadConnection()
 {
 	conPrintIfNotFuzzing("handleResourceDownloadConnection()");
 
 	try
 	{
+		std::vector<std::string> URLs;
+		std::vector<uint64> start_offsets;
+		std::vector<ResourceRef> resources;
+		ResourceFileSender file_sender; // Sends without copying through user space where the socket allows, otherwise in bounded chunks.
+
+		ResourceRequestScheduler scheduler; // Outstanding multiplexed resource requests.
 
 		while(1)
 		{
+			// While there are outstanding multiplexed requests, keep sending chunks of the highest priority one, 
+			// checking between chunks for new requests, reprioritisations and cancellations from the client.
+			if((scheduler.numRequests() > 0) && !socket->readable(/*timeout=*/0.0))
+			{
+				sendNextResourceChunk(scheduler);
+				continue;
+			}
+
 			const uint32 msg_type = socket->readUInt32();
-			if(msg_type == Protocol::GetFiles)
+			if(msg_type == Protocol::ResourceRequest)
+			{
+				handleResourceRequest(scheduler);
+			}
+			else if(msg_type == Protocol::ResourceRequestPriority)
+			{
+				const uint32 request_id = socket->readUInt32();
+				const float priority = socket->readFloat();
+				if(!isFinite(priority))
+					throw glare::Exception("Invalid priority");
+
+				scheduler.setPriority(request_id, priority);
+			}
+			else if(msg_type == Protocol::ResourceRequestCancel)
+			{
+				const uint32 request_id = socket->readUInt32();
+				Reference<ResourceRequestScheduler::Request> request = scheduler.removeRequest(request_id);
+				if(request.nonNull())
+					finishResourceRequest(*request);
+			}
+			else if(msg_type == Protocol::GetFiles || msg_type == Protocol::GetFilesWithRanges)
 			{
+				const bool with_ranges = msg_type == Protocol::GetFilesWithRanges;
+
 				const uint64 num_resources = socket->readUInt64();
+				if(num_resources > MAX_NUM_FILES_PER_GET_FILES)
+					throw glare::Exception("Too many files requested: " + toString(num_resources));
 				
 				conPrintIfNotFuzzing("Handling GetFiles:\tnum resources requested: " + toString(num_resources));
 
+				// Read all the requested URLs first, so they can be looked up in the resource manager with a single lock.
+				URLs.resize(num_resources);
+				start_offsets.resize(num_resources);
 				for(size_t i=0; i<num_resources; ++i)
 				{
-					const std::string URL = socket->readStringLengthFirst(MAX_STRING_LEN);
+					URLs[i] = socket->readStringLengthFirst(MAX_STRING_LEN);
+					start_offsets[i] = with_ranges ? socket->readUInt64() : 0;
+
+					conPrintIfNotFuzzing("\tRequested URL: '" + URLs[i] + "'" + ((start_offsets[i] > 0) ? (", from offset " + toString(start_offsets[i])) : std::string()));
+				}
+
+				server->world_state->resource_manager->getExistingResourcesForURLs(URLs, resources);
 
-					conPrintIfNotFuzzing("\tRequested URL: '" + URL + "'");
+				for(size_t i=0; i<num_resources; ++i)
+				{
+					const std::string& URL = URLs[i];
+					const ResourceRef& resource = resources[i];
 
 					if(!ResourceManager::isValidURL(URL))
 					{
 						conPrint("\tRequested URL was invalid.");
 						socket->writeUInt32(1); // write error msg to client
 					}
+					else if(resource.isNull() || (resource->getState() != Resource::State_Present))
+					{
+						conPrintIfNotFuzzing("\tRequested URL was not present on disk.");
+						socket->writeUInt32(1); // write error msg to client
+					}
 					else
 					{
-						// conPrint("\tRequested URL was valid.");
+						const std::string local_path = server->world_state->resource_manager->getLocalAbsPathForResource(*resource);
+
+						// conPrint("\tlocal path: '" + local_path + "'");
 
-						const ResourceRef resource = server->world_state->resource_manager->getExistingResourceForURL(URL);
-						if(resource.isNull() || (resource->getState() != Resource::State_Present))
+						bool opened = false;
+						try
+						{
+							file_sender.open(local_path);
+							opened = true;
+						}
+						catch(glare::Exception& e)
 						{
-							conPrintIfNotFuzzing("\tRequested URL was not present on disk.");
+							conPrintIfNotFuzzing("\tException while trying to open file for URL: " + e.what());
+
 							socket->writeUInt32(1); // write error msg to client
 						}
-						else
+
+						if(opened)
 						{
-							const std::string local_path = server->world_state->resource_manager->getLocalAbsPathForResource(*resource);
+							const uint64 file_size = file_sender.fileSize();
+							// A client may have a partial file from a different version of the resource.  If it is longer than our file, it can't be a prefix of it, so send the whole file.
+							const uint64 start_offset = (start_offsets[i] <= file_size) ? start_offsets[i] : 0;
 
-							// conPrint("\tlocal path: '" + local_path + "'");
+							socket->writeUInt32(0); // write OK msg to client
+							socket->writeUInt64(file_size); // Write file size
+							if(with_ranges)
+								socket->writeUInt64(start_offset); // Write offset the data starts from
 
-							try
-							{
-								// Load resource off disk
-								MemMappedFile file(local_path);
-								// conPrint("\tSending file to client.");
-								socket->writeUInt32(0); // write OK msg to client
-								socket->writeUInt64(file.fileSize()); // Write file size
-								socket->writeData(file.fileData(), file.fileSize()); // Write file data
-
-								conPrintIfNotFuzzing("\tSent file '" + local_path + "' to client. (" + toString(file.fileSize()) + " B)");
-							}
-							catch(glare::Exception& e)
-							{
-								conPrintIfNotFuzzing("\tException while trying to load file for URL: " + e.what());
+							const uint64 prev_zero_copy = file_sender.num_bytes_sent_zero_copy;
+							const uint64 prev_copied = file_sender.num_bytes_sent_copied;
 
-								socket->writeUInt32(1); // write error msg to client
-							}
+							file_sender.sendRange(*socket, start_offset, file_size - start_offset); // Write file data.  Throws on socket error, which ends the connection.
+							file_sender.close();
+
+							server->resource_send_stats.num_files_sent++;
+							if(start_offset > 0)
+								server->resource_send_stats.num_files_resumed++;
+							server->resource_send_stats.num_bytes_sent_zero_copy += file_sender.num_bytes_sent_zero_copy - prev_zero_copy;
+							server->resource_send_stats.num_bytes_sent_copied += file_sender.num_bytes_sent_copied - prev_copied;
+
+							conPrintIfNotFuzzing("\tSent file '" + local_path + "' to client. (" + toString(file_size - start_offset) + " B)");
 						}
 					}
 				}
@@ -463,7 +668,7 @@ void WorkerThread::handleScreenshotBotConnection()
 			ScreenshotRef screenshot;
 
 			{ // lock scope
-				Lock lock(server->world_state->mutex);
+				Lock lock(server->world_state->screenshots_mutex);
 
 				server->world_state->last_screenshot_bot_contact_time = TimeStamp::currentTime();
 
@@ -571,7 +776,7 @@ void WorkerThread::handleScreenshotBotConnection()
 					screenshot->local_path = screenshot_path;
 
 					{
-						Lock lock(server->world_state->mutex);
+						Lock lock(server->world_state->screenshots_mutex);
 						server->world_state->addScreenshotAsDBDirty(screenshot);
 
 						if(screenshot->is_map_tile) // If we received a tile screenshot, mark map tile info as dirty to get it saved.
@@ -677,12 +882,15 @@ void WorkerThread::handleEthBotConnection()
 
 						server->world_state->addSubEthTransactionAsDBDirty(trans);
 
-						auto parcel_res = server->world_state->getRootWorldState()->parcels.find(trans->parcel_id);
-						if(parcel_res != server->world_state->getRootWorldState()->parcels.end())
+						ServerWorldState* root_world = server->world_state->getRootWorldState().ptr();
+						Lock root_world_lock(root_world->mutex);
+
+						auto parcel_res = root_world->parcels.find(trans->parcel_id);
+						if(parcel_res != root_world->parcels.end())
 						{
 							Parcel* parcel = parcel_res->second.ptr();
 							parcel->nft_status = Parcel::NFTStatus_MintedNFT;
-							server->world_state->getRootWorldState()->addParcelAsDBDirty(parcel);
+							root_world->addParcelAsDBDirty(parcel);
 							server->world_state->markAsChanged();
 						}
 					} // End lock scope
@@ -727,7 +935,7 @@ void WorkerThread::handleEthBotConnection()
 }
 
 
-static bool objectIsInParcelForWhichLoggedInUserHasWritePerms(const WorldObject& ob, const UserID& user_id, ServerWorldState& world_state)
+static bool objectIsInParcelForWhichLoggedInUserHasWritePerms(const WorldObject& ob, const UserID& user_id, ServerWorldState& world_state) REQUIRES(world_state.mutex)
 {
 	assert(user_id.valid());
 
@@ -745,7 +953,7 @@ static bool objectIsInParcelForWhichLoggedInUserHasWritePerms(const WorldObject&
 
 
 // NOTE: world state mutex should be locked before calling this method.
-static bool userHasObjectWritePermissions(const WorldObject& ob, const UserID& user_id, const std::string& user_name, const std::string& connected_world_name, ServerWorldState& world_state, bool allow_light_mapper_bot_full_perms)
+static bool userHasObjectWritePermissions(const WorldObject& ob, const UserID& user_id, const std::string& user_name, const std::string& connected_world_name, ServerWorldState& world_state, bool allow_light_mapper_bot_full_perms) REQUIRES(world_state.mutex)
 {
 	if(user_id.valid())
 	{
@@ -769,7 +977,7 @@ static bool userConnectedToTheirPersonalWorldOrGodUser(const UserID& user_id, co
 
 // This is for editing the parcel itself.
 // NOTE: world state mutex should be locked before calling this method.
-static bool userHasParcelWritePermissions(const Parcel& parcel, const UserID& user_id, const std::string& connected_world_name, ServerWorldState& world_state)
+static bool userHasParcelWritePermissions(const Parcel& parcel, const UserID& user_id, const std::string& connected_world_name, ServerWorldState& world_state) REQUIRES(world_state.mutex)
 {
 	if(user_id.valid())
 	{
@@ -792,52 +1000,10 @@ void WorkerThread::doRun()
 {
 	PlatformUtils::setCurrentThreadNameIfTestsEnabled("WorkerThread");
 
-
-	if(CAPTURE_TRACES)
-		socket.downcastToPtr<RecordingSocket>()->clearRecordBuf();
-
-	ServerAllWorldsState* world_state = server->world_state.getPointer();
-
-	UID client_avatar_uid(0);
-	UserID client_user_id = UserID::invalidUserID(); // Will be an invalid reference if client is not logged in, otherwise will refer to the user account the client is logged in to.
-	std::string client_user_name;
-	AvatarSettings client_user_avatar_settings;
-	uint32 client_user_flags = 0;
-
-	Reference<ServerWorldState> cur_world_state; // World the client is connected to.
-	bool logged_in_user_is_lightmapper_bot = false; // Just for updating the last_lightmapper_bot_contact_time.
-
 	try
 	{
-		// Read hello bytes
-		const uint32 hello = socket->readUInt32();
-		if(hello != Protocol::CyberspaceHello)
-			throw glare::Exception("Received invalid hello message (" + toString(hello) + ") from client.");
-		
-		// Write hello response
-		socket->writeUInt32(Protocol::CyberspaceHello);
-
-		// Read protocol version
-		const uint32 client_protocol_version = socket->readUInt32();
-		conPrintIfNotFuzzing("client protocol version: " + toString(client_protocol_version));
-		if(client_protocol_version < 38) // We can't handle protocol versions < 38
-		{
-			socket->writeUInt32(Protocol::ClientProtocolTooOld);
-			socket->writeStringLengthFirst("Sorry, your Substrata client is too old. Please download and install an updated client from https://substrata.info/.");
-
-			//socket->writeStringLengthFirst("Sorry, your client protocol version (" + toString(client_protocol_version) + ") is too old, require version " + 
-			//	toString(Protocol::CyberspaceProtocolVersion) + ".  Please install an updated client from https://substrata.info/.");
-		}
-		else
-		{
-			// For versions newer than our current version, consider them OK.  We will send back our current version below, which will then be used by the client.
-
-			socket->writeUInt32(Protocol::ClientProtocolOK);
-		}
-
-		socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
-
-		const uint32 connection_type = socket->readUInt32();
+		if(!handshake_done) // The handshake will have been done already if the connection was handed over from a ConnectionIOPool.
+			doHandshake();
 	
 		if(connection_type == Protocol::ConnectionTypeUploadResource)
 		{
@@ -857,1743 +1023,1932 @@ void WorkerThread::doRun()
 		}
 		else if(connection_type == Protocol::ConnectionTypeUpdates)
 		{
-			if(CAPTURE_TRACES)
-				this->write_trace = true;
-
-			// Read name of world to connect to
-			const std::string world_name = socket->readStringLengthFirst(1000);
-			conPrintIfNotFuzzing("Client connecting to world '" + world_name + "'...");
-			
+			initUpdatesConnection();
 
+			while(1) // write to / read from socket loop
 			{
-				Lock lock(world_state->mutex);
-				// Create world if didn't exist before.
-				// For now only the main world ("") and personal worlds are allowed
-				if(world_name == "")
-				{}
-				else if(world_state->name_to_users.find(world_name) != world_state->name_to_users.end()) // Else if world_name is a user name, it's valid
-				{}
+				sendPendingData();
+
+#if defined(_WIN32) || defined(OSX)
+				if(socket->readable(0.05)) // If socket has some data to read from it:
+#else
+				if(socket->readable(event_fd)) // Block until either the socket is readable or the event fd is signalled, which means we have data to write.
+#endif
+				{
+					if(!handleUpdatesMessage())
+						break;
+				}
 				else
-					throw glare::Exception("Invalid world name '" + world_name + "'.");
+				{
+#if defined(_WIN32) || defined(OSX)
+#else
+					if(VERBOSE) conPrint("WorkerThread: event FD was signalled.");
 
-				if(world_state->world_states[world_name].isNull())
-					world_state->world_states[world_name] = new ServerWorldState();
-				cur_world_state = world_state->world_states[world_name];
-			}
+					// The event FD was signalled, which means there is some data to send on the socket.
+					// Reset the event fd by reading from it.
+					event_fd.read();
 
-			this->connected_world_name = world_name;
+					if(VERBOSE) conPrint("WorkerThread: event FD has been reset.");
+#endif
+				}
+			} // End write to / read from socket loop
+		} // End if(connection_type == Protocol::ConnectionTypeUpdates)
+		else
+		{
+			throw glare::Exception("Unknown connection_type: " + toString(connection_type));
+		}
+	}
+	catch(MySocketExcep& e)
+	{
+		if(e.excepType() == MySocketExcep::ExcepType_ConnectionClosedGracefully)
+			conPrint("Updates client from " + IPAddress::formatIPAddressAndPort(socket->getOtherEndIPAddress(), socket->getOtherEndPort()) + " closed connection gracefully.");
+		else
+			conPrint("Socket error: " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrintIfNotFuzzing("glare::Exception: " + e.what());
+	}
+	catch(std::bad_alloc&)
+	{
+		conPrint("WorkerThread: Caught std::bad_alloc.");
+	}
 
-			// Write avatar UID assigned to the connected client.
-			client_avatar_uid = world_state->getNextAvatarUID();
-			writeToStream(client_avatar_uid, *socket);
+	connectionClosed();
+}
 
-			// If the client connected via a websocket, they can be logged in with a session cookie.
-			// Note that this may only work if the websocket connects over TLS.
-			{
-				Lock lock(world_state->mutex);
-				User* cookie_logged_in_user = LoginHandlers::getLoggedInUser(*world_state, this->websocket_request_info);
-	
-				if(cookie_logged_in_user != NULL)
-				{
-					client_user_id = cookie_logged_in_user->id;
-					client_user_name = cookie_logged_in_user->name;
-					client_user_avatar_settings = cookie_logged_in_user->avatar_settings; // TODO: clone materials?
-					client_user_flags = cookie_logged_in_user->flags;
-				}
-			}
 
-			if(client_user_id.valid())
-			{
-				// Send logged-in message to client
-				MessageUtils::initPacket(scratch_packet, Protocol::LoggedInMessageID);
-				writeToStream(client_user_id, scratch_packet);
-				scratch_packet.writeStringLengthFirst(client_user_name);
-				writeAvatarSettingsToStream(client_user_avatar_settings, scratch_packet);
-				scratch_packet.writeUInt32(client_user_flags);
-				MessageUtils::updatePacketLengthField(scratch_packet);
+void WorkerThread::doHandshake()
+{
+	if(CAPTURE_TRACES)
+		socket.downcastToPtr<RecordingSocket>()->clearRecordBuf();
 
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-				socket->flush();
-			}
+	// Read hello bytes
+	const uint32 hello = socket->readUInt32();
+	if(hello != Protocol::CyberspaceHello)
+		throw glare::Exception("Received invalid hello message (" + toString(hello) + ") from client.");
+	
+	// Write hello response
+	socket->writeUInt32(Protocol::CyberspaceHello);
 
-			// Send TimeSyncMessage packet to client
-			{
-				MessageUtils::initPacket(scratch_packet, Protocol::TimeSyncMessage);
-				scratch_packet.writeDouble(server->getCurrentGlobalTime());
-				MessageUtils::updatePacketLengthField(scratch_packet);
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-			}
+	// Read protocol version
+	client_protocol_version = socket->readUInt32();
+	conPrintIfNotFuzzing("client protocol version: " + toString(client_protocol_version));
+	if(client_protocol_version < 38) // We can't handle protocol versions < 38
+	{
+		socket->writeUInt32(Protocol::ClientProtocolTooOld);
+		socket->writeStringLengthFirst("Sorry, your Substrata client is too old. Please download and install an updated client from https://substrata.info/.");
 
-			// Send a ServerAdminMessage to client if we have a non-empty message.
-			std::string server_admin_msg;
-			{ // Lock scope
-				Lock lock(world_state->mutex);
-				server_admin_msg = world_state->server_admin_message;
-			} // End lock scope
-			if(!server_admin_msg.empty())
-			{
-				MessageUtils::initPacket(scratch_packet, Protocol::ServerAdminMessageID);
-				scratch_packet.writeStringLengthFirst(server_admin_msg);
-				MessageUtils::updatePacketLengthField(scratch_packet);
+		//socket->writeStringLengthFirst("Sorry, your client protocol version (" + toString(client_protocol_version) + ") is too old, require version " + 
+		//	toString(Protocol::CyberspaceProtocolVersion) + ".  Please install an updated client from https://substrata.info/.");
+	}
+	else
+	{
+		// For versions newer than our current version, consider them OK.  We will send back our current version below, which will then be used by the client.
 
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-				socket->flush();
-			}
+		socket->writeUInt32(Protocol::ClientProtocolOK);
+	}
 
-			// Send world settings to client
-			{
-				MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsInitialSendMessage);
+	socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
 
-				cur_world_state->world_settings.writeToStream(scratch_packet);
+	connection_type = socket->readUInt32();
+	handshake_done = true;
+}
 
-				MessageUtils::updatePacketLengthField(scratch_packet);
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-			}
 
+void WorkerThread::initUpdatesConnection()
+{
+	ServerAllWorldsState* world_state = server->world_state.getPointer();
 
-			// Send all current avatar state data to client
-			{
-				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	if(CAPTURE_TRACES)
+		this->write_trace = true;
 
-				{ // Lock scope
-					Lock lock(world_state->mutex);
-					for(auto it = cur_world_state->avatars.begin(); it != cur_world_state->avatars.end(); ++it)
-					{
-						const Avatar* avatar = it->second.getPointer();
+	// Read name of world to connect to
+	const std::string world_name = socket->readStringLengthFirst(1000);
+	conPrintIfNotFuzzing("Client connecting to world '" + world_name + "'...");
+	
 
-						// Write AvatarIsHere message
-						MessageUtils::initPacket(scratch_packet, Protocol::AvatarIsHere);
-						writeAvatarToNetworkStream(*avatar, scratch_packet);
-						MessageUtils::updatePacketLengthField(scratch_packet);
+	{
+		Lock lock(world_state->mutex);
+		// Create world if didn't exist before.
+		// For now only the main world ("") and personal worlds are allowed
+		if(world_name == "")
+		{}
+		else if(world_state->name_to_users.find(world_name) != world_state->name_to_users.end()) // Else if world_name is a user name, it's valid
+		{}
+		else
+			throw glare::Exception("Invalid world name '" + world_name + "'.");
 
-						packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-					}
-				} // End lock scope
+		if(world_state->world_states[world_name].isNull())
+			world_state->world_states[world_name] = new ServerWorldState();
+		cur_world_state = world_state->world_states[world_name];
+	}
 
-				socket->writeData(packet.buf.data(), packet.buf.size());
-			}
+	this->connected_world_name = world_name;
+	server->subscribeToWorldUpdates(this, world_name);
 
-			// Send all current object data to client
-			/*{
-				Lock lock(world_state->mutex);
-				for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-				{
-					const WorldObject* ob = it->second.getPointer();
+	// Write avatar UID assigned to the connected client.
+	client_avatar_uid = world_state->getNextAvatarUID();
+	writeToStream(client_avatar_uid, *socket);
 
-					// Send ObjectCreated packet
-					SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-					packet.writeUInt32(Protocol::ObjectCreated);
-					ob->writeToNetworkStream(packet);
-					socket->writeData(packet.buf.data(), packet.buf.size());
-				}
-			}*/
+	// If the client connected via a websocket, they can be logged in with a session cookie.
+	// Note that this may only work if the websocket connects over TLS.
+	{
+		Lock lock(world_state->mutex);
+		User* cookie_logged_in_user = LoginHandlers::getLoggedInUser(*world_state, this->websocket_request_info);
 
-			// Send all current parcel data to client
-			{
-				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		if(cookie_logged_in_user != NULL)
+		{
+			client_user_id = cookie_logged_in_user->id;
+			client_user_name = cookie_logged_in_user->name;
+			client_user_avatar_settings = cookie_logged_in_user->avatar_settings; // TODO: clone materials?
+			client_user_flags = cookie_logged_in_user->flags;
+		}
+	}
 
-				{ // Lock scope
-					Lock lock(world_state->mutex);
-					for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
-					{
-						const Parcel* parcel = it->second.getPointer();
+	if(client_user_id.valid())
+	{
+		// Send logged-in message to client
+		MessageUtils::initPacket(scratch_packet, Protocol::LoggedInMessageID);
+		writeToStream(client_user_id, scratch_packet);
+		scratch_packet.writeStringLengthFirst(client_user_name);
+		writeAvatarSettingsToStream(client_user_avatar_settings, scratch_packet);
+		scratch_packet.writeUInt32(client_user_flags);
+		MessageUtils::updatePacketLengthField(scratch_packet);
+
+		socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+		socket->flush();
+	}
 
-						// Send ParcelCreated message
-						MessageUtils::initPacket(scratch_packet, Protocol::ParcelCreated);
-						writeToNetworkStream(*parcel, scratch_packet, client_protocol_version);
-						MessageUtils::updatePacketLengthField(scratch_packet);
+	// Send TimeSyncMessage packet to client
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::TimeSyncMessage);
+		scratch_packet.writeDouble(server->getCurrentGlobalTime());
+		MessageUtils::updatePacketLengthField(scratch_packet);
+		socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+	}
 
-						packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-					}
-				} // End lock scope
+	// Send a ServerAdminMessage to client if we have a non-empty message.
+	std::string server_admin_msg;
+	{ // Lock scope
+		Lock lock(world_state->mutex);
+		server_admin_msg = world_state->server_admin_message;
+	} // End lock scope
+	if(!server_admin_msg.empty())
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::ServerAdminMessageID);
+		scratch_packet.writeStringLengthFirst(server_admin_msg);
+		MessageUtils::updatePacketLengthField(scratch_packet);
 
-				socket->writeData(packet.buf.data(), packet.buf.size());
-				socket->flush();
-			}
+		socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+		socket->flush();
+	}
 
-			// Send a message saying we have sent all initial state
-			/*{
-				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-				packet.writeUInt32(Protocol::InitialStateSent);
-				socket->writeData(packet.buf.data(), packet.buf.size());
-			}*/
+	// Send world settings to client
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsInitialSendMessage);
 
+		{
+			Lock lock(cur_world_state->mutex);
+			cur_world_state->world_settings.writeToStream(scratch_packet);
+		}
 
-			assert(cur_world_state.nonNull());
+		MessageUtils::updatePacketLengthField(scratch_packet);
+		socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+	}
 
 
-			socket->setNoDelayEnabled(true); // We want to send out lots of little packets with low latency.  So disable Nagle's algorithm, e.g. send coalescing.
+	// Send all current avatar state data to client
+	{
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
-			bool keep_looping = true;
-			while(keep_looping) // write to / read from socket loop
+		{ // Lock scope
+			Lock lock(cur_world_state->mutex);
+			for(auto it = cur_world_state->avatars.begin(); it != cur_world_state->avatars.end(); ++it)
 			{
-				// See if we have any pending data to send in the data_to_send queue, and if so, send all pending data.
-				if(VERBOSE) conPrint("WorkerThread: checking for pending data to send...");
+				const Avatar* avatar = it->second.getPointer();
 
-				// We don't want to do network writes while holding the data_to_send_mutex.  So copy to temp_data_to_send.
-				{
-					Lock lock(data_to_send_mutex);
-					temp_data_to_send = data_to_send;
-					data_to_send.clear();
-				}
+				// Write AvatarIsHere message
+				MessageUtils::initPacket(scratch_packet, Protocol::AvatarIsHere);
+				writeAvatarToNetworkStream(*avatar, scratch_packet);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-				if(temp_data_to_send.nonEmpty())
-				{
-					socket->writeData(temp_data_to_send.data(), temp_data_to_send.size());
-					socket->flush();
-					temp_data_to_send.clear();
-				}
+				packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
+		} // End lock scope
 
+		socket->writeData(packet.buf.data(), packet.buf.size());
+	}
 
-				if(logged_in_user_is_lightmapper_bot)
-				{
-					Lock lock(server->world_state->mutex);
-					server->world_state->last_lightmapper_bot_contact_time = TimeStamp::currentTime(); // bit of a hack
-				}
+	// Send all current object data to client
+	/*{
+		Lock lock(cur_world_state->mutex);
+		for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
+		{
+			const WorldObject* ob = it->second.getPointer();
 
+			// Send ObjectCreated packet
+			SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+			packet.writeUInt32(Protocol::ObjectCreated);
+			ob->writeToNetworkStream(packet);
+			socket->writeData(packet.buf.data(), packet.buf.size());
+		}
+	}*/
 
-#if defined(_WIN32) || defined(OSX)
-				if(socket->readable(0.05)) // If socket has some data to read from it:
-#else
-				if(socket->readable(event_fd)) // Block until either the socket is readable or the event fd is signalled, which means we have data to write.
-#endif
+	// Send all current parcel data to client
+	{
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+		{ // Lock scope
+			Lock lock(cur_world_state->mutex);
+			for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
+			{
+				const Parcel* parcel = it->second.getPointer();
+
+				// Send ParcelCreated message
+				MessageUtils::initPacket(scratch_packet, Protocol::ParcelCreated);
+				writeToNetworkStream(*parcel, scratch_packet, client_protocol_version);
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
+		} // End lock scope
+
+		socket->writeData(packet.buf.data(), packet.buf.size());
+		socket->flush();
+	}
+
+	// Send a message saying we have sent all initial state
+	/*{
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		packet.writeUInt32(Protocol::InitialStateSent);
+		socket->writeData(packet.buf.data(), packet.buf.size());
+	}*/
+
+
+	assert(cur_world_state.nonNull());
+
+
+	socket->setNoDelayEnabled(true); // We want to send out lots of little packets with low latency.  So disable Nagle's algorithm, e.g. send coalescing.
+}
+
+
+void WorkerThread::sendPendingData()
+{
+	// See if we have any pending data to send in the data_to_send queue, and if so, send all pending data.
+	if(VERBOSE) conPrint("WorkerThread: checking for pending data to send...");
+
+	// We don't want to do network writes while holding the data_to_send_mutex.  So copy to temp_data_to_send.
+	{
+		Lock lock(data_to_send_mutex);
+		temp_data_to_send = data_to_send;
+		data_to_send.clear();
+		temp_shared_data_to_send.swap(shared_data_to_send);
+	}
+
+	if(temp_data_to_send.nonEmpty() || !temp_shared_data_to_send.empty())
+	{
+		// Write shared buffers interleaved with temp_data_to_send, in the order they were enqueued.
+		size_t write_i = 0;
+		for(size_t i=0; i<temp_shared_data_to_send.size(); ++i)
+		{
+			const SharedDataToSend& shared = temp_shared_data_to_send[i];
+			assert(shared.data_to_send_offset >= write_i && shared.data_to_send_offset <= temp_data_to_send.size());
+			if(shared.data_to_send_offset > write_i)
+			{
+				socket->writeData(temp_data_to_send.data() + write_i, shared.data_to_send_offset - write_i);
+				write_i = shared.data_to_send_offset;
+			}
+			socket->writeData(shared.buffer->data.data(), shared.buffer->data.size());
+		}
+		if(write_i < temp_data_to_send.size())
+			socket->writeData(temp_data_to_send.data() + write_i, temp_data_to_send.size() - write_i);
+
+		socket->flush();
+		temp_data_to_send.clear();
+		temp_shared_data_to_send.clear();
+	}
+
+
+	if(logged_in_user_is_lightmapper_bot)
+	{
+		Lock lock(server->world_state->mutex);
+		server->world_state->last_lightmapper_bot_contact_time = TimeStamp::currentTime(); // bit of a hack
+	}
+}
+
+
+bool WorkerThread::handleUpdatesMessage()
+{
+	ServerAllWorldsState* world_state = server->world_state.getPointer();
+
+	// Read msg type and length
+	uint32 msg_type_and_len[2];
+	socket->readData(msg_type_and_len, sizeof(uint32) * 2);
+	const uint32 msg_type = msg_type_and_len[0];
+	const uint32 msg_len = msg_type_and_len[1]; // Length of message, including the message type and length fields.
+
+	if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
+		throw glare::Exception("Invalid message size: " + toString(msg_len));
+
+	// conPrint("WorkerThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
+
+	// Read entire message
+	msg_buffer.buf.resizeNoCopy(msg_len);
+	msg_buffer.read_index = sizeof(uint32) * 2;
+
+	socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
+
+	switch(msg_type)
+	{
+	case Protocol::CyberspaceGoodbye:
+		{
+			conPrintIfNotFuzzing("WorkerThread: received CyberspaceGoodbye, starting graceful shutdown..");
+			socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
+			socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
+			conPrintIfNotFuzzing("WorkerThread: waitForGracefulDisconnect done.");
+			return false;
+		}
+	case Protocol::ClientUDPSocketOpen:
+		{
+			conPrint("WorkerThread: received Protocol::ClientUDPSocketOpen");
+			//const uint32 client_UDP_port = msg_buffer.readUInt32();
+			server->clientUDPPortOpen(this, socket->getOtherEndIPAddress(), client_avatar_uid, connected_world_name);
+			break;
+		}
+	case Protocol::AudioStreamToServerStarted:
+		{
+			const uint32 sampling_rate = msg_buffer.readUInt32();
+			const uint32 flags         = msg_buffer.readUInt32();
+			const uint32 stream_id     = msg_buffer.readUInt32();
+
+			if(!BitUtils::isBitSet(flags, 0x1u)) // If renew flag is not set:
+				conPrint("WorkerThread: received Protocol::AudioStreamToServerStarted without renew flag");
+
+			// Send message to all clients
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::AudioStreamToServerStarted);
+				writeToStream(client_avatar_uid, scratch_packet); // Send client avatar UID as well.
+				scratch_packet.writeUInt32(sampling_rate);
+				scratch_packet.writeUInt32(flags);
+				scratch_packet.writeUInt32(stream_id);
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+
+			break;
+		}
+	case Protocol::AudioStreamToServerEnded:
+		{
+			conPrint("WorkerThread: received Protocol::AudioStreamToServerEnded");
+
+			// Send message to all clients
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::AudioStreamToServerEnded);
+				writeToStream(client_avatar_uid, scratch_packet); // Send client avatar UID as well.
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+
+			break;
+		}
+	case Protocol::AvatarTransformUpdate:
+		{
+			//conPrint("AvatarTransformUpdate");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+			const Vec3d pos = readVec3FromStream<double>(msg_buffer);
+			const Vec3f rotation = readVec3FromStream<float>(msg_buffer);
+			const uint32 anim_state = msg_buffer.readUInt32();
+
+			// The client's own avatar position is updated more often than the QueryObjects camera position, so use it for area-of-interest filtering as well.
+			if(avatar_uid == client_avatar_uid && pos.isFinite())
+				setClientCamPos(pos);
+
+			// Look up existing avatar in world state
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				auto res = cur_world_state->avatars.find(avatar_uid);
+				if(res != cur_world_state->avatars.end())
+				{
+					Avatar* avatar = res->second.getPointer();
+					avatar->pos = pos;
+					avatar->rotation = rotation;
+					avatar->anim_state = anim_state;
+					avatar->transform_dirty = true;
+					cur_world_state->dirty_avatars.insert(avatar_uid);
+					server->notifyUpdatesPending();
+
+					//conPrint("updated avatar transform");
+				}
+			}
+			break;
+		}
+	case Protocol::AvatarPerformGesture:
+		{
+			//conPrint("AvatarPerformGesture");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+			const std::string gesture_name = msg_buffer.readStringLengthFirst(10000);
+
+			//conPrint("Received AvatarPerformGesture: '" + gesture_name + "'");
+
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient(socket, "You must be logged in to perform a gesture.");
+			}
+			else
+			{
+				// Enqueue AvatarPerformGesture messages to worker threads to send
+				MessageUtils::initPacket(scratch_packet, Protocol::AvatarPerformGesture);
+				writeToStream(avatar_uid, scratch_packet);
+				scratch_packet.writeStringLengthFirst(gesture_name);
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+			break;
+		}
+	case Protocol::AvatarStopGesture:
+		{
+			//conPrint("AvatarStopGesture");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient(socket, "You must be logged in to stop a gesture.");
+			}
+			else
+			{
+				// Enqueue AvatarStopGesture messages to worker threads to send
+				MessageUtils::initPacket(scratch_packet, Protocol::AvatarStopGesture);
+				writeToStream(avatar_uid, scratch_packet);
+				MessageUtils::updatePacketLengthField(scratch_packet);
+
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+			break;
+		}
+	case Protocol::AvatarFullUpdate:
+		{
+			conPrintIfNotFuzzing("Protocol::AvatarFullUpdate");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+
+			Avatar temp_avatar;
+			readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
+
+			bool user_avatar_settings_changed = false;
+
+			// Look up existing avatar in world state
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				auto res = cur_world_state->avatars.find(avatar_uid);
+				if(res != cur_world_state->avatars.end())
+				{
+					Avatar* avatar = res->second.getPointer();
+					avatar->copyNetworkStateFrom(temp_avatar);
+					avatar->other_dirty = true;
+					cur_world_state->dirty_avatars.insert(avatar_uid);
+					server->notifyUpdatesPending();
+
+					if(client_user_id.valid())
+					{
+						const bool avatar_settings_changed = !(client_user_avatar_settings == avatar->avatar_settings);
+
+						if(avatar_settings_changed && !world_state->isInReadOnlyMode())
+						{
+							client_user_avatar_settings = avatar->avatar_settings;
+							user_avatar_settings_changed = true;
+						}
+					}
+
+					//conPrint("updated avatar transform");
+				}
+			}
+
+			// Store avatar settings in the user data.  Done after releasing the world mutex, as the all-worlds mutex can't be acquired while holding it.
+			if(user_avatar_settings_changed)
+			{
+				TimedLock lock(world_state->mutex, world_state->mutex_wait_stats);
+				auto res2 = world_state->user_id_to_users.find(client_user_id);
+				if(res2 != world_state->user_id_to_users.end())
+				{
+					Reference<User> client_user = res2->second;
+					client_user->avatar_settings = client_user_avatar_settings;
+					world_state->addUserAsDBDirty(client_user);
+
+					conPrintIfNotFuzzing("Updated user avatar settings.  model_url: " + client_user->avatar_settings.model_url);
+				}
+			}
+
+			if(!temp_avatar.avatar_settings.model_url.empty())
+				sendGetFileMessageIfNeeded(temp_avatar.avatar_settings.model_url);
+
+			// Process resources
+			std::set<DependencyURL> URLs;
+			temp_avatar.getDependencyURLSetForAllLODLevels(URLs);
+			for(auto it = URLs.begin(); it != URLs.end(); ++it)
+				sendGetFileMessageIfNeeded(it->URL);
+
+			break;
+		}
+	case Protocol::CreateAvatar:
+		{
+			conPrintIfNotFuzzing("received Protocol::CreateAvatar");
+			// Note: name will come from user account
+			// will use the client_avatar_uid that we assigned to the client
+		
+			Avatar temp_avatar;
+			temp_avatar.uid = readUIDFromStream(msg_buffer); // Will be replaced.
+			readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
+
+			temp_avatar.name = client_user_id.valid() ? client_user_name : "Anonymous";
+
+			const UID use_avatar_uid = client_avatar_uid;
+			temp_avatar.uid = use_avatar_uid;
+
+			// Look up existing avatar in world state
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				auto res = cur_world_state->avatars.find(use_avatar_uid);
+				if(res == cur_world_state->avatars.end())
+				{
+					// Avatar for UID not already created, create it now.
+					AvatarRef avatar = new Avatar();
+					avatar->uid = use_avatar_uid;
+					avatar->copyNetworkStateFrom(temp_avatar);
+					avatar->state = Avatar::State_JustCreated;
+					avatar->other_dirty = true;
+					cur_world_state->dirty_avatars.insert(use_avatar_uid);
+					server->notifyUpdatesPending();
+					cur_world_state->avatars.insert(std::make_pair(use_avatar_uid, avatar));
+
+					conPrintIfNotFuzzing("created new avatar");
+				}
+			}
+
+			if(!temp_avatar.avatar_settings.model_url.empty())
+				sendGetFileMessageIfNeeded(temp_avatar.avatar_settings.model_url);
+
+			// Process resources
+			std::set<DependencyURL> URLs;
+			temp_avatar.getDependencyURLSetForAllLODLevels(URLs);
+			for(auto it = URLs.begin(); it != URLs.end(); ++it)
+				sendGetFileMessageIfNeeded(it->URL);
+
+			conPrintIfNotFuzzing("New Avatar creation: username: '" + temp_avatar.name + "', model_url: '" + temp_avatar.avatar_settings.model_url + "'");
+
+			break;
+		}
+	case Protocol::AvatarDestroyed:
+		{
+			conPrintIfNotFuzzing("AvatarDestroyed");
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+
+			// Mark avatar as dead
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				auto res = cur_world_state->avatars.find(avatar_uid);
+				if(res != cur_world_state->avatars.end())
+				{
+					Avatar* avatar = res->second.getPointer();
+					avatar->state = Avatar::State_Dead;
+					avatar->other_dirty = true;
+					cur_world_state->dirty_avatars.insert(avatar_uid);
+					server->notifyUpdatesPending();
+				}
+			}
+			break;
+		}
+	case Protocol::AvatarEnteredVehicle:
+		{
+			conPrintIfNotFuzzing("AvatarEnteredVehicle");
+
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+			const UID vehicle_ob_uid = readUIDFromStream(msg_buffer);
+			const uint32 seat_index = msg_buffer.readUInt32();
+			const uint32 flags = msg_buffer.readUInt32();
+
+			
+			// Enqueue AvatarEnteredVehicle messages to worker threads to send
+			MessageUtils::initPacket(scratch_packet, Protocol::AvatarEnteredVehicle);
+			writeToStream(avatar_uid, scratch_packet);
+			writeToStream(vehicle_ob_uid, scratch_packet);
+			scratch_packet.writeUInt32(seat_index);
+			scratch_packet.writeUInt32(flags);
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			enqueuePacketToBroadcast(scratch_packet, server);
+
+			break;
+		}
+	case Protocol::AvatarExitedVehicle:
+		{
+			conPrintIfNotFuzzing("AvatarExitedVehicle");
+
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+
+			// Enqueue AvatarExitedVehicle messages to worker threads to send
+			MessageUtils::initPacket(scratch_packet, Protocol::AvatarExitedVehicle);
+			writeToStream(avatar_uid, scratch_packet);
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			enqueuePacketToBroadcast(scratch_packet, server);
+
+			break;
+		}
+	case Protocol::ObjectTransformUpdate:
+		{
+			//conPrint("received ObjectTransformUpdate");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const Vec3d pos = readVec3FromStream<double>(msg_buffer);
+			const Vec3f axis = readVec3FromStream<float>(msg_buffer);
+			const float angle = msg_buffer.readFloat();
+			const Vec3f scale = readVec3FromStream<float>(msg_buffer);
+
+			// If client is not logged in, refuse object modification.
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+			}
+			else
+			{
+				std::string err_msg_to_client;
+				// Look up existing object in world state
+				{
+					TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+					auto res = cur_world_state->objects.find(object_uid);
+					if(res != cur_world_state->objects.end())
+					{
+						WorldObject* ob = res->second.getPointer();
+
+						// See if the user has permissions to alter this object:
+						if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms))
+							err_msg_to_client = "You must be the owner of this object to change it.";
+						else
+						{
+							ob->pos = pos;
+							ob->axis = axis;
+							ob->angle = angle;
+							ob->scale = scale;
+							ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
+							ob->last_modified_time = TimeStamp::currentTime();
+							cur_world_state->objectTransformChanged(ob);
+
+							ob->from_remote_transform_dirty = true;
+							cur_world_state->addWorldObjectAsDBDirty(ob);
+							cur_world_state->dirty_from_remote_objects.insert(ob);
+							server->notifyUpdatesPending();
+
+							world_state->markAsChanged();
+						}
+
+						//conPrint("updated object transform");
+					}
+				} // End lock scope
+
+				if(!err_msg_to_client.empty())
+					writeErrorMessageToClient(socket, err_msg_to_client);
+			}
+
+			break;
+		}
+	case Protocol::SummonObject:
+		{
+			conPrint("received SummonObject");
+			SummonObjectMessageClientToServer summon_msg;
+			msg_buffer.readData(&summon_msg, sizeof(SummonObjectMessageClientToServer));
+
+			// If client is not logged in, refuse object modification.
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient(socket, "You must be logged in to summon an object.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+			}
+			else
+			{
+				std::string err_msg_to_client;
+				bool send_summon_object_msg = false;
+				{
+					TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+					auto res = cur_world_state->objects.find(summon_msg.object_uid); // Look up existing object in world state
+					if(res != cur_world_state->objects.end())
+					{
+						WorldObject* ob = res->second.getPointer();
+
+						if(client_user_id != ob->creator_id)
+							err_msg_to_client = "You must be the owner of this object to summon it.";
+						else
+						{
+							// TODO: check that this object is the only vehicle object that can be summoned.
+							if(!BitUtils::isBitSet(ob->flags, WorldObject::SUMMONED_FLAG))
+								err_msg_to_client = "Object must have summoned flag set to summon it.";
+							else
+							{
+								ob->pos   = summon_msg.pos;
+								ob->axis  = summon_msg.axis;
+								ob->angle = summon_msg.angle;
+								ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
+								ob->last_modified_time = TimeStamp::currentTime();
+								cur_world_state->objectTransformChanged(ob);
+
+								cur_world_state->addWorldObjectAsDBDirty(ob); // Object state has changed, so save to DB.
+								world_state->markAsChanged();
+
+								send_summon_object_msg = true;
+							}
+						}
+					}
+				} // End lock scope
+
+				if(!err_msg_to_client.empty())
+					writeErrorMessageToClient(socket, err_msg_to_client);
+
+				if(send_summon_object_msg)
+				{
+					// Enqueue SummonObject messages to worker threads to send
+					conPrint("Broadcasting SummonObject message");
+					MessageUtils::initPacket(scratch_packet, Protocol::SummonObject);
+					scratch_packet.writeData(&summon_msg, sizeof(SummonObjectMessageClientToServer));
+					scratch_packet.writeUInt32((uint32)client_avatar_uid.value()); // Write last_transform_update_avatar_uid
+					MessageUtils::updatePacketLengthField(scratch_packet);
+					enqueuePacketToBroadcast(scratch_packet, server);
+				}
+			}
+
+			break;
+		}
+	case Protocol::ObjectPhysicsTransformUpdate:
+		{
+			//conPrint("received ObjectPhysicsTransformUpdate");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const Vec3d pos = readVec3FromStream<double>(msg_buffer);
+		
+			Quatf rot;
+			msg_buffer.readData(rot.v.x, sizeof(float) * 4);
+
+			Vec4f linear_vel(0.f);
+			Vec4f angular_vel(0.f);
+			msg_buffer.readData(linear_vel.x, sizeof(float) * 3);
+			msg_buffer.readData(angular_vel.x, sizeof(float) * 3);
+
+			const double client_cur_time = msg_buffer.readDouble();
+
+			// If client is not logged in, refuse object modification.
+			/*if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
+			}
+			*/
+			if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+			}
+			else
+			{
+				std::string err_msg_to_client;
+				// Look up existing object in world state
+				{
+					TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+					auto res = cur_world_state->objects.find(object_uid);
+					if(res != cur_world_state->objects.end())
+					{
+						WorldObject* ob = res->second.getPointer();
+
+						// See if the user has permissions to alter this object:
+						//if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms))
+						//	err_msg_to_client = "You must be the owner of this object to change it.";
+						if(ob->isDynamic()) // We will only allow clients to apply PhysicsTransformUpdates to objects it the object is a dynamic object.
+						{
+							ob->pos = pos;
+							Vec4f axis;
+							float angle;
+							rot.toAxisAndAngle(axis, angle);
+							ob->axis = Vec3f(axis);
+							ob->angle = angle;
+
+							ob->linear_vel = linear_vel;
+							ob->angular_vel = angular_vel;
+
+							ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
+							ob->last_transform_client_time = client_cur_time;
+
+							ob->last_modified_time = TimeStamp::currentTime();
+							cur_world_state->objectTransformChanged(ob);
+
+							ob->from_remote_physics_transform_dirty = true;
+							cur_world_state->addWorldObjectAsDBDirty(ob);
+							cur_world_state->dirty_from_remote_objects.insert(ob);
+							server->notifyUpdatesPending();
+
+							world_state->markAsChanged();
+						}
+					}
+				} // End lock scope
+
+				if(!err_msg_to_client.empty())
+					writeErrorMessageToClient(socket, err_msg_to_client);
+			}
+
+			break;
+		}
+	case Protocol::ObjectFullUpdate:
+		{
+			//conPrint("received ObjectFullUpdate");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+
+			WorldObject temp_ob;
+			readWorldObjectFromNetworkStreamGivenUID(msg_buffer, temp_ob); // Read rest of ObjectFullUpdate message.
+
+			// If client is not logged in, refuse object modification.
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
+			}
+			else
+			{
+				// Look up existing object in world state
+				bool send_must_be_owner_msg = false;
+				{
+					TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+					auto res = cur_world_state->objects.find(object_uid);
+					if(res != cur_world_state->objects.end())
+					{
+						WorldObject* ob = res->second.getPointer();
+
+						// See if the user has permissions to alter this object:
+						if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms))
+						{
+							send_must_be_owner_msg = true;
+						}
+						else
+						{
+							ob->copyNetworkStateFrom(temp_ob);
+							cur_world_state->objectTransformChanged(ob);
+							
+							// Clamp volume to the max allowed level
+							ob->audio_volume = myClamp(ob->audio_volume, 0.f, maxAudioVolumeForObject(*ob, client_user_id, client_user_name, this->connected_world_name));
+
+							ob->last_modified_time = TimeStamp::currentTime();
+
+							ob->from_remote_other_dirty = true;
+							cur_world_state->addWorldObjectAsDBDirty(ob);
+							cur_world_state->dirty_from_remote_objects.insert(ob);
+							server->notifyUpdatesPending();
+
+							world_state->markAsChanged();
+
+							// Process resources
+							std::set<DependencyURL> URLs;
+							WorldObject::GetDependencyOptions options;
+							ob->getDependencyURLSetBaseLevel(options, URLs);
+							for(auto it = URLs.begin(); it != URLs.end(); ++it)
+								sendGetFileMessageIfNeeded(it->URL);
+						}
+					}
+				} // End lock scope
+
+				if(send_must_be_owner_msg)
+					writeErrorMessageToClient(socket, "You must be the owner of this object to change it.");
+			}
+			break;
+		}
+	case Protocol::ObjectLightmapURLChanged:
+		{
+			//conPrint("ObjectLightmapURLChanged");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const std::string new_lightmap_url = msg_buffer.readStringLengthFirst(10000);
+
+			// Look up existing object in world state
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				auto res = cur_world_state->objects.find(object_uid);
+				if(res != cur_world_state->objects.end())
+				{
+					WorldObject* ob = res->second.getPointer();
+
+					if(!world_state->isInReadOnlyMode())
+					{
+						ob->lightmap_url = new_lightmap_url;
+						ob->last_modified_time = TimeStamp::currentTime();
+
+						ob->from_remote_lightmap_url_dirty = true;
+						cur_world_state->addWorldObjectAsDBDirty(ob);
+						cur_world_state->dirty_from_remote_objects.insert(ob);
+						server->notifyUpdatesPending();
+
+						world_state->markAsChanged();
+					}
+				}
+			}
+			break;
+		}
+	case Protocol::ObjectModelURLChanged:
+		{
+			//conPrint("ObjectModelURLChanged");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const std::string new_model_url = msg_buffer.readStringLengthFirst(10000);
+
+			// Look up existing object in world state
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				auto res = cur_world_state->objects.find(object_uid);
+				if(res != cur_world_state->objects.end())
+				{
+					WorldObject* ob = res->second.getPointer();
+
+					if(!world_state->isInReadOnlyMode())
+					{
+						ob->model_url = new_model_url;
+						ob->last_modified_time = TimeStamp::currentTime();
+
+						ob->from_remote_model_url_dirty = true;
+						cur_world_state->addWorldObjectAsDBDirty(ob);
+						cur_world_state->dirty_from_remote_objects.insert(ob);
+						server->notifyUpdatesPending();
+
+						world_state->markAsChanged();
+					}
+				}
+			}
+			break;
+		}
+	case Protocol::ObjectFlagsChanged:
+		{
+			//conPrint("ObjectFlagsChanged");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const uint32 flags = msg_buffer.readUInt32();
+
+			// Look up existing object in world state
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				auto res = cur_world_state->objects.find(object_uid);
+				if(res != cur_world_state->objects.end())
+				{
+					WorldObject* ob = res->second.getPointer();
+
+					if(!world_state->isInReadOnlyMode())
+					{
+						ob->flags = flags; // Copy flags
+						ob->last_modified_time = TimeStamp::currentTime();
+
+						ob->from_remote_flags_dirty = true;
+						cur_world_state->addWorldObjectAsDBDirty(ob);
+						cur_world_state->dirty_from_remote_objects.insert(ob);
+						server->notifyUpdatesPending();
+
+						world_state->markAsChanged();
+					}
+				}
+			}
+			break;
+		}
+	case Protocol::ObjectPhysicsOwnershipTaken:
+		{
+			// conPrint("ObjectPhysicsOwnershipTaken");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+			const uint32 physics_owner_id = msg_buffer.readUInt32();
+			const double client_global_time = msg_buffer.readDouble();
+			const uint32 flags = msg_buffer.readUInt32();
+
+			// Look up existing object in world state
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				auto res = cur_world_state->objects.find(object_uid);
+				if(res != cur_world_state->objects.end())
+				{
+					WorldObject* ob = res->second.getPointer();
+
+					if(!world_state->isInReadOnlyMode())
+					{
+						ob->physics_owner_id = physics_owner_id;
+						ob->last_physics_ownership_change_global_time = client_global_time;
+
+						// Consider physics_owner_id ephemeral state, so doesn't need to be written to DB.
+						// It is sent in ObjectInitialSend messages though, so the cached message needs to be invalidated.
+						cur_world_state->invalidateObjectRecord(res->second);
+					}
+				}
+			}
+
+			// Enqueue ObjectPhysicsOwnershipTaken messages to worker threads to send
+			MessageUtils::initPacket(scratch_packet, Protocol::ObjectPhysicsOwnershipTaken);
+			writeToStream(object_uid, scratch_packet);
+			scratch_packet.writeUInt32(physics_owner_id);
+			scratch_packet.writeDouble(client_global_time);
+			scratch_packet.writeUInt32(flags);
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			enqueuePacketToBroadcast(scratch_packet, server);
+
+			break;
+		}
+	case Protocol::CreateObject: // Client wants to create an object
+		{
+			conPrintIfNotFuzzing("CreateObject");
+
+			WorldObjectRef new_ob = new WorldObject();
+			new_ob->uid = readUIDFromStream(msg_buffer); // Read dummy UID
+			readWorldObjectFromNetworkStreamGivenUID(msg_buffer, *new_ob);
+
+			conPrintIfNotFuzzing("model_url: '" + new_ob->model_url + "', pos: " + new_ob->pos.toString());
+
+			// If client is not logged in, refuse object creation.
+			if(!client_user_id.valid())
+			{
+				conPrintIfNotFuzzing("Creation denied, user was not logged in.");
+				MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+				scratch_packet.writeStringLengthFirst("You must be logged in to create an object.");
+				MessageUtils::updatePacketLengthField(scratch_packet);
+				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				socket->flush();
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient(socket, "Server is in read-only mode, you can't create an object right now.");
+			}
+			else
+			{
+				new_ob->creator_id = client_user_id;
+				new_ob->created_time = TimeStamp::currentTime();
+				new_ob->last_modified_time = new_ob->created_time;
+				new_ob->creator_name = client_user_name;
+
+				std::set<DependencyURL> URLs;
+				WorldObject::GetDependencyOptions options;
+				new_ob->getDependencyURLSetBaseLevel(options, URLs);
+				for(auto it = URLs.begin(); it != URLs.end(); ++it)
+					sendGetFileMessageIfNeeded(it->URL);
+
+				// Insert object into world state
+				{
+					TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+
+					new_ob->uid = world_state->getNextObjectUID();
+					new_ob->state = WorldObject::State_JustCreated;
+					new_ob->from_remote_other_dirty = true;
+					cur_world_state->addWorldObjectAsDBDirty(new_ob);
+					cur_world_state->dirty_from_remote_objects.insert(new_ob);
+					server->notifyUpdatesPending();
+					cur_world_state->addObject(new_ob);
+
+					world_state->markAsChanged();
+				}
+			}
+
+			break;
+		}
+	case Protocol::DestroyObject: // Client wants to destroy an object.
+		{
+			conPrintIfNotFuzzing("DestroyObject");
+			const UID object_uid = readUIDFromStream(msg_buffer);
+
+			// If client is not logged in, refuse object modification.
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient(socket, "You must be logged in to destroy an object.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient(socket, "Server is in read-only mode, you can't destroy an object right now.");
+			}
+			else
+			{
+				bool send_must_be_owner_msg = false;
 				{
-					// Read msg type and length
-					uint32 msg_type_and_len[2];
-					socket->readData(msg_type_and_len, sizeof(uint32) * 2);
-					const uint32 msg_type = msg_type_and_len[0];
-					const uint32 msg_len = msg_type_and_len[1]; // Length of message, including the message type and length fields.
+					TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+					auto res = cur_world_state->objects.find(object_uid);
+					if(res != cur_world_state->objects.end())
+					{
+						WorldObject* ob = res->second.getPointer();
+
+						// See if the user has permissions to alter this object:
+						const bool have_delete_perms = userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms);
+						if(!have_delete_perms)
+							send_must_be_owner_msg = true;
+						else
+						{
+							// Mark object as dead
+							ob->state = WorldObject::State_Dead;
+							ob->from_remote_other_dirty = true;
+							cur_world_state->addWorldObjectAsDBDirty(ob);
+							cur_world_state->dirty_from_remote_objects.insert(ob);
+							server->notifyUpdatesPending();
+
+							world_state->markAsChanged();
+						}
+					}
+				} // End lock scope
+
+				if(send_must_be_owner_msg)
+					writeErrorMessageToClient(socket, "You must be the owner of this object to destroy it.");
+			}
+			break;
+		}
+	case Protocol::GetAllObjects: // Client wants to get all objects in world
+		{
+			conPrintIfNotFuzzing("GetAllObjects");
+
+			SocketBufferOutStream temp_buf(SocketBufferOutStream::DontUseNetworkByteOrder); // Will contain several messages
+
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
+				{
+					const WorldObject* ob = it->second.getPointer();
+
+					// Append ObjectInitialSend message
+					cur_world_state->ob_record_cache.appendObjectInitialSendMessage(ob, scratch_packet, temp_buf);
+				}
+			}
+
+			MessageUtils::initPacket(scratch_packet, Protocol::AllObjectsSent); // Terminate the buffer with an AllObjectsSent message.
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			temp_buf.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+
+			writeQueryResponseToClient(temp_buf);
+
+			break;
+		}
+	case Protocol::QueryObjects: // Client wants to query objects in certain grid cells
+		{
+			Vec3d cam_position;
+			if(client_protocol_version >= 36) // position was introduced in protocol version 36.
+			{
+				cam_position = readVec3FromStream<double>(msg_buffer);
+				if(cam_position.isFinite())
+					setClientCamPos(cam_position); // Used for area-of-interest filtering of broadcast updates.
+			}
+			else
+				cam_position = Vec3d(0.0);
+
+			const uint32 num_cells = msg_buffer.readUInt32();
+			if(num_cells > 100000)
+				throw glare::Exception("QueryObjects: too many cells: " + toString(num_cells));
+
+			//conPrint("QueryObjects, num_cells=" + toString(num_cells));
+	
+			// Read cell coords from network.  Cells have the same width as the ServerObjectGrid cells, so we can look them up directly.
+			std::vector<Vec3<int>> cells(num_cells);
+			for(uint32 i=0; i<num_cells; ++i)
+			{
+				const int x = msg_buffer.readInt32();
+				const int y = msg_buffer.readInt32();
+				const int z = msg_buffer.readInt32();
+
+				//if(i < 10)
+				//	conPrint("cell " + toString(i) + " coords: " + toString(x) + ", " + toString(y) + ", " + toString(z));
 
-					if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
-						throw glare::Exception("Invalid message size: " + toString(msg_len));
+				cells[i] = Vec3<int>(x, y, z);
+			}
 
-					// conPrint("WorkerThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
+			// Remove any duplicate cells, so we don't send objects more than once.
+			std::sort(cells.begin(), cells.end());
+			cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
 
-					// Read entire message
-					msg_buffer.buf.resizeNoCopy(msg_len);
-					msg_buffer.read_index = sizeof(uint32) * 2;
 
-					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
+			SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+			int num_obs_written = 0;
 
-					switch(msg_type)
+			{ // Lock scope
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				for(size_t i=0; i<cells.size(); ++i)
+				{
+					const ServerObjectGridCell* cell = cur_world_state->ob_grid.getCell(cells[i]);
+					if(cell)
 					{
-					case Protocol::CyberspaceGoodbye:
-						{
-							conPrintIfNotFuzzing("WorkerThread: received CyberspaceGoodbye, starting graceful shutdown..");
-							socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
-							socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
-							conPrintIfNotFuzzing("WorkerThread: waitForGracefulDisconnect done.");
-							keep_looping = false;
-							break;
-						}
-					case Protocol::ClientUDPSocketOpen:
-						{
-							conPrint("WorkerThread: received Protocol::ClientUDPSocketOpen");
-							//const uint32 client_UDP_port = msg_buffer.readUInt32();
-							server->clientUDPPortOpen(this, socket->getOtherEndIPAddress(), client_avatar_uid);
-							break;
-						}
-					case Protocol::AudioStreamToServerStarted:
+						for(auto it = cell->objects.begin(); it != cell->objects.end(); ++it)
 						{
-							const uint32 sampling_rate = msg_buffer.readUInt32();
-							const uint32 flags         = msg_buffer.readUInt32();
-							const uint32 stream_id     = msg_buffer.readUInt32();
-
-							if(!BitUtils::isBitSet(flags, 0x1u)) // If renew flag is not set:
-								conPrint("WorkerThread: received Protocol::AudioStreamToServerStarted without renew flag");
+							const WorldObject* ob = it->ptr();
 
-							// Send message to all clients
-							{
-								MessageUtils::initPacket(scratch_packet, Protocol::AudioStreamToServerStarted);
-								writeToStream(client_avatar_uid, scratch_packet); // Send client avatar UID as well.
-								scratch_packet.writeUInt32(sampling_rate);
-								scratch_packet.writeUInt32(flags);
-								scratch_packet.writeUInt32(stream_id);
-								MessageUtils::updatePacketLengthField(scratch_packet);
-
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
+							// Append ObjectInitialSend message
+							cur_world_state->ob_record_cache.appendObjectInitialSendMessage(ob, scratch_packet, packet);
 
-							break;
+							num_obs_written++;
 						}
-					case Protocol::AudioStreamToServerEnded:
-						{
-							conPrint("WorkerThread: received Protocol::AudioStreamToServerEnded");
-
-							// Send message to all clients
-							{
-								MessageUtils::initPacket(scratch_packet, Protocol::AudioStreamToServerEnded);
-								writeToStream(client_avatar_uid, scratch_packet); // Send client avatar UID as well.
-								MessageUtils::updatePacketLengthField(scratch_packet);
+					}
+				}
+			} // End lock scope
 
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
+			if(!packet.buf.empty())
+			{
+				conPrintIfNotFuzzing("QueryObjects: Sending back info on " + toString(num_obs_written) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ") ...");
 
-							break;
-						}
-					case Protocol::AvatarTransformUpdate:
-						{
-							//conPrint("AvatarTransformUpdate");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
-							const Vec3d pos = readVec3FromStream<double>(msg_buffer);
-							const Vec3f rotation = readVec3FromStream<float>(msg_buffer);
-							const uint32 anim_state = msg_buffer.readUInt32();
+				writeQueryResponseToClient(packet); // Write data to network
+			}
+		
+			break;
+		}
+	case Protocol::QueryObjectsInAABB: // Client wants to query objects in a particular AABB
+		{
+			// This kind of query will be done when a client connects.
+			// Because the AABB can be quite large (>= 1km on each side), the number of objects returned can be large.
+			// Therefore we first work out the objects in the AABB, then sort by distance to camera, and send back the closer objects first.
+			// This allows the client to start loading and displaying objects before all the queried objects are returned, which can take a while.
+			//
+			// For sending over websocket connections, we will also flush occasionally, which sends a websocket frame.
+			// writeQueryResponseToClient() does this after each chunk. (~= 4096 bytes, or one CompressedMessages message)
+
+			Vec3d cam_position;
+			if(client_protocol_version >= 36) // position was introduced in protocol version 36.
+			{
+				cam_position = readVec3FromStream<double>(msg_buffer);
+				if(!cam_position.isFinite())
+					throw glare::Exception("Invalid cam_position");
 
-							// Look up existing avatar in world state
-							{
-								Lock lock(world_state->mutex);
-								auto res = cur_world_state->avatars.find(avatar_uid);
-								if(res != cur_world_state->avatars.end())
-								{
-									Avatar* avatar = res->second.getPointer();
-									avatar->pos = pos;
-									avatar->rotation = rotation;
-									avatar->anim_state = anim_state;
-									avatar->transform_dirty = true;
-
-									//conPrint("updated avatar transform");
-								}
-							}
-							break;
-						}
-					case Protocol::AvatarPerformGesture:
-						{
-							//conPrint("AvatarPerformGesture");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
-							const std::string gesture_name = msg_buffer.readStringLengthFirst(10000);
+				setClientCamPos(cam_position); // Used for area-of-interest filtering of broadcast updates.
+			}
+			else
+				cam_position = Vec3d(0.0);
 
-							//conPrint("Received AvatarPerformGesture: '" + gesture_name + "'");
+			const float lower_x = msg_buffer.readFloat();
+			const float lower_y = msg_buffer.readFloat();
+			const float lower_z = msg_buffer.readFloat();
+			const float upper_x = msg_buffer.readFloat();
+			const float upper_y = msg_buffer.readFloat();
+			const float upper_z = msg_buffer.readFloat();
 
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to perform a gesture.");
-							}
-							else
-							{
-								// Enqueue AvatarPerformGesture messages to worker threads to send
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarPerformGesture);
-								writeToStream(avatar_uid, scratch_packet);
-								scratch_packet.writeStringLengthFirst(gesture_name);
-								MessageUtils::updatePacketLengthField(scratch_packet);
+			const js::AABBox aabb(Vec4f(lower_x, lower_y, lower_z, 1.f), Vec4f(upper_x, upper_y, upper_z, 1.f));
+	
+			conPrintIfNotFuzzing("QueryObjectsInAABB, aabb: " + aabb.toStringNSigFigs(4) + ", cam_position: " + cam_position.toString());
 
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
-							break;
-						}
-					case Protocol::AvatarStopGesture:
-						{
-							//conPrint("AvatarStopGesture");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
+			SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to stop a gesture.");
-							}
-							else
-							{
-								// Enqueue AvatarStopGesture messages to worker threads to send
-								MessageUtils::initPacket(scratch_packet, Protocol::AvatarStopGesture);
-								writeToStream(avatar_uid, scratch_packet);
-								MessageUtils::updatePacketLengthField(scratch_packet);
+			std::vector<const WorldObject*> obs;
+			obs.reserve(16384);
 
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
-							break;
-						}
-					case Protocol::AvatarFullUpdate:
-						{
-							conPrintIfNotFuzzing("Protocol::AvatarFullUpdate");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
+			{ // Lock scope
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				cur_world_state->ob_grid.getObjectsInAABB(aabb, obs); // Get objects with a valid position in the query AABB.
 
-							Avatar temp_avatar;
-							readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
+				// Sort objects from near to far from camera.
+				struct WorldObjectDistComparator
+				{
+					bool operator () (const WorldObject* a, const WorldObject* b)
+					{
+						const double a_dist2 = a->pos.getDist2(campos);
+						const double b_dist2 = b->pos.getDist2(campos);
+						return a_dist2 < b_dist2;
+					}
+					Vec3d campos;
+				};
 
-							// Look up existing avatar in world state
-							{
-								Lock lock(world_state->mutex);
-								auto res = cur_world_state->avatars.find(avatar_uid);
-								if(res != cur_world_state->avatars.end())
-								{
-									Avatar* avatar = res->second.getPointer();
-									avatar->copyNetworkStateFrom(temp_avatar);
-									avatar->other_dirty = true;
-
-
-									// Store avatar settings in the user data
-									if(client_user_id.valid())
-									{
-										const bool avatar_settings_changed = !(client_user_avatar_settings == avatar->avatar_settings);
-
-										if(avatar_settings_changed && !world_state->isInReadOnlyMode())
-										{
-											client_user_avatar_settings = avatar->avatar_settings;
-
-											auto res2 = world_state->user_id_to_users.find(client_user_id);
-											if(res2 != world_state->user_id_to_users.end())
-											{
-												Reference<User> client_user = res2->second;
-												client_user->avatar_settings = avatar->avatar_settings;
-												world_state->addUserAsDBDirty(client_user);
-
-												conPrintIfNotFuzzing("Updated user avatar settings.  model_url: " + client_user->avatar_settings.model_url);
-											}
-										}
-									}
-
-									//conPrint("updated avatar transform");
-								}
-							}
+				WorldObjectDistComparator comparator;
+				comparator.campos = cam_position;
+				std::sort(obs.begin(), obs.end(), comparator);
 
-							if(!temp_avatar.avatar_settings.model_url.empty())
-								sendGetFileMessageIfNeeded(temp_avatar.avatar_settings.model_url);
+				for(size_t i=0; i<obs.size(); ++i)
+				{
+					const WorldObject* ob = obs[i];
 
-							// Process resources
-							std::set<DependencyURL> URLs;
-							temp_avatar.getDependencyURLSetForAllLODLevels(URLs);
-							for(auto it = URLs.begin(); it != URLs.end(); ++it)
-								sendGetFileMessageIfNeeded(it->URL);
+					// Append ObjectInitialSend message to packet.  Uses the cached message for the object if it hasn't changed since it was last sent.
+					cur_world_state->ob_record_cache.appendObjectInitialSendMessage(ob, scratch_packet, packet);
+				}
+			} // End lock scope
 
-							break;
-						}
-					case Protocol::CreateAvatar:
-						{
-							conPrintIfNotFuzzing("received Protocol::CreateAvatar");
-							// Note: name will come from user account
-							// will use the client_avatar_uid that we assigned to the client
-						
-							Avatar temp_avatar;
-							temp_avatar.uid = readUIDFromStream(msg_buffer); // Will be replaced.
-							readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
+			// Send back the data, now we have released the world lock.  Send it back in chunks instead of one big write. (better for websockets)
+			// The data is compressed here too if the client supports it, so compression doesn't hold the world lock.
+			if(!packet.buf.empty())
+			{
+				conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on " + toString(obs.size()) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ")...");
+				Timer timer;
 
-							temp_avatar.name = client_user_id.valid() ? client_user_name : "Anonymous";
+				writeQueryResponseToClient(packet);
 
-							const UID use_avatar_uid = client_avatar_uid;
-							temp_avatar.uid = use_avatar_uid;
+				conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on objects took " + timer.elapsedStringNSigFigs(4));
+			}
 
-							// Look up existing avatar in world state
-							{
-								Lock lock(world_state->mutex);
-								auto res = cur_world_state->avatars.find(use_avatar_uid);
-								if(res == cur_world_state->avatars.end())
-								{
-									// Avatar for UID not already created, create it now.
-									AvatarRef avatar = new Avatar();
-									avatar->uid = use_avatar_uid;
-									avatar->copyNetworkStateFrom(temp_avatar);
-									avatar->state = Avatar::State_JustCreated;
-									avatar->other_dirty = true;
-									cur_world_state->avatars.insert(std::make_pair(use_avatar_uid, avatar));
-
-									conPrintIfNotFuzzing("created new avatar");
-								}
-							}
+			break;
+		}
+	case Protocol::QueryParcels:
+		{
+			conPrintIfNotFuzzing("QueryParcels");
 
-							if(!temp_avatar.avatar_settings.model_url.empty())
-								sendGetFileMessageIfNeeded(temp_avatar.avatar_settings.model_url);
+			// Send all current parcel data to client
+			MessageUtils::initPacket(scratch_packet, Protocol::ParcelList);
+			{
+				TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+				scratch_packet.writeUInt64(cur_world_state->parcels.size()); // Write num parcels
+				for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
+					writeToNetworkStream(*it->second, scratch_packet, client_protocol_version); // Write parcel
+			}
+			MessageUtils::updatePacketLengthField(scratch_packet);
+			socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Send the data
+			socket->flush();
+			break;
+		}
+	case Protocol::ParcelFullUpdate: // Client wants to update a parcel
+		{
+			conPrintIfNotFuzzing("ParcelFullUpdate");
+			const ParcelID parcel_id = readParcelIDFromStream(msg_buffer);
 
-							// Process resources
-							std::set<DependencyURL> URLs;
-							temp_avatar.getDependencyURLSetForAllLODLevels(URLs);
-							for(auto it = URLs.begin(); it != URLs.end(); ++it)
-								sendGetFileMessageIfNeeded(it->URL);
+			Parcel temp_parcel;
+			readFromNetworkStreamGivenID(msg_buffer, temp_parcel, client_protocol_version);
 
-							conPrintIfNotFuzzing("New Avatar creation: username: '" + temp_avatar.name + "', model_url: '" + temp_avatar.avatar_settings.model_url + "'");
+			// If client is not logged in, refuse parcel modification.
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient(socket, "You must be logged in to modify a parcel.");
+			}
+			else if(world_state->isInReadOnlyMode())
+			{
+				writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify a parcel right now.");
+			}
+			else
+			{
+				// Look up existing parcel in world state
+				std::string error_msg;
+				{
+					TimedLock lock(cur_world_state->mutex, cur_world_state->mutex_wait_stats);
+					auto res = cur_world_state->parcels.find(parcel_id);
+					if(res != cur_world_state->parcels.end())
+					{
+						Parcel* parcel = res->second.getPointer();
 
-							break;
-						}
-					case Protocol::AvatarDestroyed:
+						// See if the user has permissions to alter this object:
+						if(!userHasParcelWritePermissions(*parcel, client_user_id, this->connected_world_name, *cur_world_state))
 						{
-							conPrintIfNotFuzzing("AvatarDestroyed");
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
-
-							// Mark avatar as dead
-							{
-								Lock lock(world_state->mutex);
-								auto res = cur_world_state->avatars.find(avatar_uid);
-								if(res != cur_world_state->avatars.end())
-								{
-									Avatar* avatar = res->second.getPointer();
-									avatar->state = Avatar::State_Dead;
-									avatar->other_dirty = true;
-								}
-							}
-							break;
+							error_msg = "You must be the owner of this parcel (or have write permissions) to modify it";
 						}
-					case Protocol::AvatarEnteredVehicle:
+						else
 						{
-							conPrintIfNotFuzzing("AvatarEnteredVehicle");
+							parcel->copyNetworkStateFrom(temp_parcel, /*restrict_changes=*/true); // restrict changes to stuff clients are allowed to change
 
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
-							const UID vehicle_ob_uid = readUIDFromStream(msg_buffer);
-							const uint32 seat_index = msg_buffer.readUInt32();
-							const uint32 flags = msg_buffer.readUInt32();
+							//parcel->from_remote_other_dirty = true;
+							cur_world_state->addParcelAsDBDirty(parcel);
+							//cur_world_state->dirty_from_remote_parcels.insert(ob);
 
-							
-							// Enqueue AvatarEnteredVehicle messages to worker threads to send
-							MessageUtils::initPacket(scratch_packet, Protocol::AvatarEnteredVehicle);
-							writeToStream(avatar_uid, scratch_packet);
-							writeToStream(vehicle_ob_uid, scratch_packet);
-							scratch_packet.writeUInt32(seat_index);
-							scratch_packet.writeUInt32(flags);
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							enqueuePacketToBroadcast(scratch_packet, server);
-
-							break;
+							world_state->markAsChanged();
 						}
-					case Protocol::AvatarExitedVehicle:
-						{
-							conPrintIfNotFuzzing("AvatarExitedVehicle");
-
-							const UID avatar_uid = readUIDFromStream(msg_buffer);
+					}
+				} // End lock scope
 
-							// Enqueue AvatarExitedVehicle messages to worker threads to send
-							MessageUtils::initPacket(scratch_packet, Protocol::AvatarExitedVehicle);
-							writeToStream(avatar_uid, scratch_packet);
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							enqueuePacketToBroadcast(scratch_packet, server);
+				if(!error_msg.empty())
+					writeErrorMessageToClient(socket, error_msg);
+			}
+			break;
+		}
+	case Protocol::ChatMessageID:
+		{
+			//const std::string name = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string msg = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 
-							break;
-						}
-					case Protocol::ObjectTransformUpdate:
-						{
-							//conPrint("received ObjectTransformUpdate");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const Vec3d pos = readVec3FromStream<double>(msg_buffer);
-							const Vec3f axis = readVec3FromStream<float>(msg_buffer);
-							const float angle = msg_buffer.readFloat();
-							const Vec3f scale = readVec3FromStream<float>(msg_buffer);
-
-							// If client is not logged in, refuse object modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
-							}
-							else
-							{
-								std::string err_msg_to_client;
-								// Look up existing object in world state
-								{
-									Lock lock(world_state->mutex);
-									auto res = cur_world_state->objects.find(object_uid);
-									if(res != cur_world_state->objects.end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms))
-											err_msg_to_client = "You must be the owner of this object to change it.";
-										else
-										{
-											ob->pos = pos;
-											ob->axis = axis;
-											ob->angle = angle;
-											ob->scale = scale;
-											ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
-											ob->last_modified_time = TimeStamp::currentTime();
-
-											ob->from_remote_transform_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob);
-											cur_world_state->dirty_from_remote_objects.insert(ob);
-
-											world_state->markAsChanged();
-										}
-
-										//conPrint("updated object transform");
-									}
-								} // End lock scope
-
-								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
-							}
+			conPrintIfNotFuzzing("Received chat message: '" + msg + "'");
 
-							break;
-						}
-					case Protocol::SummonObject:
-						{
-							conPrint("received SummonObject");
-							SummonObjectMessageClientToServer summon_msg;
-							msg_buffer.readData(&summon_msg, sizeof(SummonObjectMessageClientToServer));
+			if(!client_user_id.valid())
+			{
+				writeErrorMessageToClient(socket, "You must be logged in to chat.");
+			}
+			else
+			{
+				// Enqueue chat messages to worker threads to send
+				// Send ChatMessageID packet
+				MessageUtils::initPacket(scratch_packet, Protocol::ChatMessageID);
+				scratch_packet.writeStringLengthFirst(client_user_name);
+				scratch_packet.writeStringLengthFirst(msg);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							// If client is not logged in, refuse object modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to summon an object.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
-							}
-							else
-							{
-								std::string err_msg_to_client;
-								bool send_summon_object_msg = false;
-								{
-									Lock lock(world_state->mutex);
-									auto res = cur_world_state->objects.find(summon_msg.object_uid); // Look up existing object in world state
-									if(res != cur_world_state->objects.end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										if(client_user_id != ob->creator_id)
-											err_msg_to_client = "You must be the owner of this object to summon it.";
-										else
-										{
-											// TODO: check that this object is the only vehicle object that can be summoned.
-											if(!BitUtils::isBitSet(ob->flags, WorldObject::SUMMONED_FLAG))
-												err_msg_to_client = "Object must have summoned flag set to summon it.";
-											else
-											{
-												ob->pos   = summon_msg.pos;
-												ob->axis  = summon_msg.axis;
-												ob->angle = summon_msg.angle;
-												ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
-												ob->last_modified_time = TimeStamp::currentTime();
-
-												cur_world_state->addWorldObjectAsDBDirty(ob); // Object state has changed, so save to DB.
-												world_state->markAsChanged();
-
-												send_summon_object_msg = true;
-											}
-										}
-									}
-								} // End lock scope
-
-								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
-
-								if(send_summon_object_msg)
-								{
-									// Enqueue SummonObject messages to worker threads to send
-									conPrint("Broadcasting SummonObject message");
-									MessageUtils::initPacket(scratch_packet, Protocol::SummonObject);
-									scratch_packet.writeData(&summon_msg, sizeof(SummonObjectMessageClientToServer));
-									scratch_packet.writeUInt32((uint32)client_avatar_uid.value()); // Write last_transform_update_avatar_uid
-									MessageUtils::updatePacketLengthField(scratch_packet);
-									enqueuePacketToBroadcast(scratch_packet, server);
-								}
-							}
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+			break;
+		}
+	case Protocol::UserSelectedObject:
+		{
+			//conPrint("Received UserSelectedObject msg.");
 
-							break;
-						}
-					case Protocol::ObjectPhysicsTransformUpdate:
-						{
-							//conPrint("received ObjectPhysicsTransformUpdate");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const Vec3d pos = readVec3FromStream<double>(msg_buffer);
-						
-							Quatf rot;
-							msg_buffer.readData(rot.v.x, sizeof(float) * 4);
-
-							Vec4f linear_vel(0.f);
-							Vec4f angular_vel(0.f);
-							msg_buffer.readData(linear_vel.x, sizeof(float) * 3);
-							msg_buffer.readData(angular_vel.x, sizeof(float) * 3);
-
-							const double client_cur_time = msg_buffer.readDouble();
-
-							// If client is not logged in, refuse object modification.
-							/*if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
-							}
-							*/
-							if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
-							}
-							else
-							{
-								std::string err_msg_to_client;
-								// Look up existing object in world state
-								{
-									Lock lock(world_state->mutex);
-									auto res = cur_world_state->objects.find(object_uid);
-									if(res != cur_world_state->objects.end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										//if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms))
-										//	err_msg_to_client = "You must be the owner of this object to change it.";
-										if(ob->isDynamic()) // We will only allow clients to apply PhysicsTransformUpdates to objects it the object is a dynamic object.
-										{
-											ob->pos = pos;
-											Vec4f axis;
-											float angle;
-											rot.toAxisAndAngle(axis, angle);
-											ob->axis = Vec3f(axis);
-											ob->angle = angle;
-
-											ob->linear_vel = linear_vel;
-											ob->angular_vel = angular_vel;
-
-											ob->last_transform_update_avatar_uid = (uint32)client_avatar_uid.value();
-											ob->last_transform_client_time = client_cur_time;
-
-											ob->last_modified_time = TimeStamp::currentTime();
-
-											ob->from_remote_physics_transform_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob);
-											cur_world_state->dirty_from_remote_objects.insert(ob);
-
-											world_state->markAsChanged();
-										}
-									}
-								} // End lock scope
-
-								if(!err_msg_to_client.empty())
-									writeErrorMessageToClient(socket, err_msg_to_client);
-							}
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-							break;
-						}
-					case Protocol::ObjectFullUpdate:
-						{
-							//conPrint("received ObjectFullUpdate");
-							const UID object_uid = readUIDFromStream(msg_buffer);
+			// Send message to connected clients
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::UserSelectedObject);
+				writeToStream(client_avatar_uid, scratch_packet);
+				writeToStream(object_uid, scratch_packet);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							WorldObject temp_ob;
-							readWorldObjectFromNetworkStreamGivenUID(msg_buffer, temp_ob); // Read rest of ObjectFullUpdate message.
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+			break;
+		}
+	case Protocol::UserDeselectedObject:
+		{
+			//conPrint("Received UserDeselectedObject msg.");
 
-							// If client is not logged in, refuse object modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify an object.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify an object right now.");
-							}
-							else
-							{
-								// Look up existing object in world state
-								bool send_must_be_owner_msg = false;
-								{
-									Lock lock(world_state->mutex);
-									auto res = cur_world_state->objects.find(object_uid);
-									if(res != cur_world_state->objects.end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										if(!userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms))
-										{
-											send_must_be_owner_msg = true;
-										}
-										else
-										{
-											ob->copyNetworkStateFrom(temp_ob);
-											
-											// Clamp volume to the max allowed level
-											ob->audio_volume = myClamp(ob->audio_volume, 0.f, maxAudioVolumeForObject(*ob, client_user_id, client_user_name, this->connected_world_name));
-
-											ob->last_modified_time = TimeStamp::currentTime();
-
-											ob->from_remote_other_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob);
-											cur_world_state->dirty_from_remote_objects.insert(ob);
-
-											world_state->markAsChanged();
-
-											// Process resources
-											std::set<DependencyURL> URLs;
-											WorldObject::GetDependencyOptions options;
-											ob->getDependencyURLSetBaseLevel(options, URLs);
-											for(auto it = URLs.begin(); it != URLs.end(); ++it)
-												sendGetFileMessageIfNeeded(it->URL);
-										}
-									}
-								} // End lock scope
-
-								if(send_must_be_owner_msg)
-									writeErrorMessageToClient(socket, "You must be the owner of this object to change it.");
-							}
-							break;
-						}
-					case Protocol::ObjectLightmapURLChanged:
-						{
-							//conPrint("ObjectLightmapURLChanged");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const std::string new_lightmap_url = msg_buffer.readStringLengthFirst(10000);
+			const UID object_uid = readUIDFromStream(msg_buffer);
 
-							// Look up existing object in world state
-							{
-								Lock lock(world_state->mutex);
-								auto res = cur_world_state->objects.find(object_uid);
-								if(res != cur_world_state->objects.end())
-								{
-									WorldObject* ob = res->second.getPointer();
-
-									if(!world_state->isInReadOnlyMode())
-									{
-										ob->lightmap_url = new_lightmap_url;
-										ob->last_modified_time = TimeStamp::currentTime();
-
-										ob->from_remote_lightmap_url_dirty = true;
-										cur_world_state->addWorldObjectAsDBDirty(ob);
-										cur_world_state->dirty_from_remote_objects.insert(ob);
-
-										world_state->markAsChanged();
-									}
-								}
-							}
-							break;
-						}
-					case Protocol::ObjectModelURLChanged:
-						{
-							//conPrint("ObjectModelURLChanged");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const std::string new_model_url = msg_buffer.readStringLengthFirst(10000);
+			// Send message to connected clients
+			{
+				MessageUtils::initPacket(scratch_packet, Protocol::UserDeselectedObject);
+				writeToStream(client_avatar_uid, scratch_packet);
+				writeToStream(object_uid, scratch_packet);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							// Look up existing object in world state
-							{
-								Lock lock(world_state->mutex);
-								auto res = cur_world_state->objects.find(object_uid);
-								if(res != cur_world_state->objects.end())
-								{
-									WorldObject* ob = res->second.getPointer();
-
-									if(!world_state->isInReadOnlyMode())
-									{
-										ob->model_url = new_model_url;
-										ob->last_modified_time = TimeStamp::currentTime();
-
-										ob->from_remote_model_url_dirty = true;
-										cur_world_state->addWorldObjectAsDBDirty(ob);
-										cur_world_state->dirty_from_remote_objects.insert(ob);
-
-										world_state->markAsChanged();
-									}
-								}
-							}
-							break;
-						}
-					case Protocol::ObjectFlagsChanged:
-						{
-							//conPrint("ObjectFlagsChanged");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const uint32 flags = msg_buffer.readUInt32();
+				enqueuePacketToBroadcast(scratch_packet, server);
+			}
+			break;
+		}
+	case Protocol::LogInMessage: // Client wants to log in.
+		{
+			conPrintIfNotFuzzing("LogInMessage");
 
-							// Look up existing object in world state
-							{
-								Lock lock(world_state->mutex);
-								auto res = cur_world_state->objects.find(object_uid);
-								if(res != cur_world_state->objects.end())
-								{
-									WorldObject* ob = res->second.getPointer();
-
-									if(!world_state->isInReadOnlyMode())
-									{
-										ob->flags = flags; // Copy flags
-										ob->last_modified_time = TimeStamp::currentTime();
-
-										ob->from_remote_flags_dirty = true;
-										cur_world_state->addWorldObjectAsDBDirty(ob);
-										cur_world_state->dirty_from_remote_objects.insert(ob);
-
-										world_state->markAsChanged();
-									}
-								}
-							}
-							break;
-						}
-					case Protocol::ObjectPhysicsOwnershipTaken:
-						{
-							// conPrint("ObjectPhysicsOwnershipTaken");
-							const UID object_uid = readUIDFromStream(msg_buffer);
-							const uint32 physics_owner_id = msg_buffer.readUInt32();
-							const double client_global_time = msg_buffer.readDouble();
-							const uint32 flags = msg_buffer.readUInt32();
+			const std::string username = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string password = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 
-							// Look up existing object in world state
-							{
-								Lock lock(world_state->mutex);
-								auto res = cur_world_state->objects.find(object_uid);
-								if(res != cur_world_state->objects.end())
-								{
-									WorldObject* ob = res->second.getPointer();
-
-									if(!world_state->isInReadOnlyMode())
-									{
-										ob->physics_owner_id = physics_owner_id;
-										ob->last_physics_ownership_change_global_time = client_global_time;
-
-										// Consider physics_owner_id ephemeral state, so doesn't need to be written to DB.
-									}
-								}
-							}
+			conPrintIfNotFuzzing("username: '" + username + "'");
+		
+			bool logged_in = false;
+			{
+				Lock lock(world_state->mutex);
+				auto res = world_state->name_to_users.find(username);
+				if(res != world_state->name_to_users.end())
+				{
+					User* user = res->second.getPointer();
+					const bool password_valid = user->isPasswordValid(password);
+					conPrintIfNotFuzzing("password_valid: " + boolToString(password_valid));
+					if(password_valid)
+					{
+						// Password is valid, log user in.
+						client_user_id = user->id;
+						client_user_name = user->name;
+						client_user_avatar_settings = user->avatar_settings;
+						client_user_flags = user->flags;
 
-							// Enqueue ObjectPhysicsOwnershipTaken messages to worker threads to send
-							MessageUtils::initPacket(scratch_packet, Protocol::ObjectPhysicsOwnershipTaken);
-							writeToStream(object_uid, scratch_packet);
-							scratch_packet.writeUInt32(physics_owner_id);
-							scratch_packet.writeDouble(client_global_time);
-							scratch_packet.writeUInt32(flags);
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							enqueuePacketToBroadcast(scratch_packet, server);
+						logged_in = true;
+					}
+				}
+			}
 
-							break;
-						}
-					case Protocol::CreateObject: // Client wants to create an object
-						{
-							conPrintIfNotFuzzing("CreateObject");
+			conPrintIfNotFuzzing("logged_in: " + boolToString(logged_in));
+			if(logged_in)
+			{
+				if(username == "lightmapperbot")
+					logged_in_user_is_lightmapper_bot = true;
 
-							WorldObjectRef new_ob = new WorldObject();
-							new_ob->uid = readUIDFromStream(msg_buffer); // Read dummy UID
-							readWorldObjectFromNetworkStreamGivenUID(msg_buffer, *new_ob);
+				// Send logged-in message to client
+				MessageUtils::initPacket(scratch_packet, Protocol::LoggedInMessageID);
+				writeToStream(client_user_id, scratch_packet);
+				scratch_packet.writeStringLengthFirst(username);
+				writeAvatarSettingsToStream(client_user_avatar_settings, scratch_packet);
+				scratch_packet.writeUInt32(client_user_flags);
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							conPrintIfNotFuzzing("model_url: '" + new_ob->model_url + "', pos: " + new_ob->pos.toString());
+				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				socket->flush();
+			}
+			else
+			{
+				// Login failed.  Send error message back to client
+				MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+				scratch_packet.writeStringLengthFirst("Login failed: username or password incorrect.");
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							// If client is not logged in, refuse object creation.
-							if(!client_user_id.valid())
-							{
-								conPrintIfNotFuzzing("Creation denied, user was not logged in.");
-								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-								scratch_packet.writeStringLengthFirst("You must be logged in to create an object.");
-								MessageUtils::updatePacketLengthField(scratch_packet);
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't create an object right now.");
-							}
-							else
-							{
-								new_ob->creator_id = client_user_id;
-								new_ob->created_time = TimeStamp::currentTime();
-								new_ob->last_modified_time = new_ob->created_time;
-								new_ob->creator_name = client_user_name;
-
-								std::set<DependencyURL> URLs;
-								WorldObject::GetDependencyOptions options;
-								new_ob->getDependencyURLSetBaseLevel(options, URLs);
-								for(auto it = URLs.begin(); it != URLs.end(); ++it)
-									sendGetFileMessageIfNeeded(it->URL);
-
-								// Insert object into world state
-								{
-									::Lock lock(world_state->mutex);
-
-									new_ob->uid = world_state->getNextObjectUID();
-									new_ob->state = WorldObject::State_JustCreated;
-									new_ob->from_remote_other_dirty = true;
-									cur_world_state->addWorldObjectAsDBDirty(new_ob);
-									cur_world_state->dirty_from_remote_objects.insert(new_ob);
-									cur_world_state->objects.insert(std::make_pair(new_ob->uid, new_ob));
-
-									world_state->markAsChanged();
-								}
-							}
+				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				socket->flush();
+			}
+	
+			break;
+		}
+	case Protocol::LogOutMessage: // Client wants to log out.
+		{
+			conPrintIfNotFuzzing("LogOutMessage");
 
-							break;
-						}
-					case Protocol::DestroyObject: // Client wants to destroy an object.
-						{
-							conPrintIfNotFuzzing("DestroyObject");
-							const UID object_uid = readUIDFromStream(msg_buffer);
+			client_user_id = UserID::invalidUserID(); // Mark the client as not logged in.
+			client_user_name = "";
+			client_user_flags = 0;
 
-							// If client is not logged in, refuse object modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to destroy an object.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't destroy an object right now.");
-							}
-							else
-							{
-								bool send_must_be_owner_msg = false;
-								{
-									Lock lock(world_state->mutex);
-									auto res = cur_world_state->objects.find(object_uid);
-									if(res != cur_world_state->objects.end())
-									{
-										WorldObject* ob = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										const bool have_delete_perms = userHasObjectWritePermissions(*ob, client_user_id, client_user_name, this->connected_world_name, *cur_world_state, server->config.allow_light_mapper_bot_full_perms);
-										if(!have_delete_perms)
-											send_must_be_owner_msg = true;
-										else
-										{
-											// Mark object as dead
-											ob->state = WorldObject::State_Dead;
-											ob->from_remote_other_dirty = true;
-											cur_world_state->addWorldObjectAsDBDirty(ob);
-											cur_world_state->dirty_from_remote_objects.insert(ob);
-
-											world_state->markAsChanged();
-										}
-									}
-								} // End lock scope
-
-								if(send_must_be_owner_msg)
-									writeErrorMessageToClient(socket, "You must be the owner of this object to destroy it.");
-							}
-							break;
-						}
-					case Protocol::GetAllObjects: // Client wants to get all objects in world
-						{
-							conPrintIfNotFuzzing("GetAllObjects");
+			// Send logged-out message to client
+			MessageUtils::initPacket(scratch_packet, Protocol::LoggedOutMessageID);
+			MessageUtils::updatePacketLengthField(scratch_packet);
 
-							SocketBufferOutStream temp_buf(SocketBufferOutStream::DontUseNetworkByteOrder); // Will contain several messages
+			socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			socket->flush();
+			break;
+		}
+	case Protocol::SignUpMessage:
+		{
+			conPrintIfNotFuzzing("SignUpMessage");
 
-							{
-								Lock lock(world_state->mutex);
-								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.getPointer();
-
-									// Build ObjectInitialSend message
-									MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-									ob->writeToNetworkStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
-
-									temp_buf.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								}
-							}
+			const std::string username = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string email    = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string password = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 
-							MessageUtils::initPacket(scratch_packet, Protocol::AllObjectsSent); // Terminate the buffer with an AllObjectsSent message.
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							temp_buf.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			try
+			{
+				conPrintIfNotFuzzing("username: '" + username + "', email: '" + email + "'");
 
-							socket->writeData(temp_buf.buf.data(), temp_buf.buf.size());
-							socket->flush();
+				bool signed_up = false;
 
-							break;
-						}
-					case Protocol::QueryObjects: // Client wants to query objects in certain grid cells
+				std::string msg_to_client;
+				if(world_state->isInReadOnlyMode())
+				{
+					msg_to_client = "Server is in read-only mode, you can't sign up right now.";
+				}
+				else
+				{
+					if(username.size() < 3)
+						msg_to_client = "Username is too short, must have at least 3 characters";
+					else
+					{
+						if(password.size() < 6)
+							msg_to_client = "Password is too short, must have at least 6 characters";
+						else
 						{
-							Vec3d cam_position;
-							if(client_protocol_version >= 36) // position was introduced in protocol version 36.
-								cam_position = readVec3FromStream<double>(msg_buffer);
-							else
-								cam_position = Vec3d(0.0);
+							Lock lock(world_state->mutex);
+							auto res = world_state->name_to_users.find(username);
+							if(res == world_state->name_to_users.end())
+							{
+								Reference<User> new_user = new User();
+								new_user->id = UserID((uint32)world_state->name_to_users.size());
+								new_user->created_time = TimeStamp::currentTime();
+								new_user->name = username;
+								new_user->email_address = email;
 
-							const uint32 num_cells = msg_buffer.readUInt32();
-							if(num_cells > 100000)
-								throw glare::Exception("QueryObjects: too many cells: " + toString(num_cells));
+								new_user->setNewPasswordAndSalt(password);
 
-							//conPrint("QueryObjects, num_cells=" + toString(num_cells));
-					
-							// Read cell coords from network and make AABBs for cells
-							js::Vector<js::AABBox, 16> cell_aabbs(num_cells);
-							for(uint32 i=0; i<num_cells; ++i)
-							{
-								const int x = msg_buffer.readInt32();
-								const int y = msg_buffer.readInt32();
-								const int z = msg_buffer.readInt32();
+								world_state->addUserAsDBDirty(new_user);
 
-								//if(i < 10)
-								//	conPrint("cell " + toString(i) + " coords: " + toString(x) + ", " + toString(y) + ", " + toString(z));
+								// Add new user to world state
+								world_state->user_id_to_users.insert(std::make_pair(new_user->id, new_user));
+								world_state->name_to_users   .insert(std::make_pair(username,     new_user));
+								world_state->markAsChanged(); // Mark as changed so gets saved to disk.
 
-								const float CELL_WIDTH = 200.f; // NOTE: has to be the same value as in gui_client/ProximityLoader.cpp.
+								client_user_id = new_user->id; // Log user in as well.
+								client_user_name = new_user->name;
+								client_user_avatar_settings = new_user->avatar_settings;
+								client_user_flags = new_user->flags;
 
-								cell_aabbs[i] = js::AABBox(
-									Vec4f(0,0,0,1) + Vec4f((float)x,     (float)y,     (float)z,     0)*CELL_WIDTH,
-									Vec4f(0,0,0,1) + Vec4f((float)(x+1), (float)(y+1), (float)(z+1), 0)*CELL_WIDTH
-								);
+								signed_up = true;
 							}
+						}
+					}
+				}
 
+				conPrintIfNotFuzzing("signed_up: " + boolToString(signed_up));
+				if(signed_up)
+				{
+					conPrintIfNotFuzzing("Sign up successful");
+					// Send signed-up message to client
+					MessageUtils::initPacket(scratch_packet, Protocol::SignedUpMessageID);
+					writeToStream(client_user_id, scratch_packet);
+					scratch_packet.writeStringLengthFirst(username);
+					MessageUtils::updatePacketLengthField(scratch_packet);
+
+					socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+					socket->flush();
+				}
+				else
+				{
+					conPrintIfNotFuzzing("Sign up failed.");
 
-							SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-							int num_obs_written = 0;
+					// signup failed.  Send error message back to client
+					MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+					scratch_packet.writeStringLengthFirst(msg_to_client);
+					MessageUtils::updatePacketLengthField(scratch_packet);
 
-							{ // Lock scope
-								Lock lock(world_state->mutex);
-								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.ptr();
+					socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+					socket->flush();
+				}
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("Sign up failed, internal error: " + e.what());
 
-									// See if the object is in any of the cell AABBs
-									bool in_cell = false;
-									for(uint32 i=0; i<num_cells; ++i)
-										if(cell_aabbs[i].contains(ob->pos.toVec4fPoint()))
-										{
-											in_cell = true;
-											break;
-										}
+				// signup failed.  Send error message back to client
+				MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+				scratch_packet.writeStringLengthFirst("Signup failed: internal error.");
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-									if(in_cell)
-									{
-										// Send ObjectInitialSend packet
-										MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-										ob->writeToNetworkStream(scratch_packet);
-										MessageUtils::updatePacketLengthField(scratch_packet);
+				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				socket->flush();
+			}
 
-										packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); 
+			break;
+		}
+	case Protocol::RequestPasswordReset:
+		{
+			conPrintIfNotFuzzing("RequestPasswordReset");
+
+			const std::string email    = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+
+			// NOTE: This stuff is done via the website now instead.
+
+			//conPrint("email: " + email);
+			//
+			//// TEMP: Send password reset email in this thread for now. 
+			//// TODO: move to another thread (make some kind of background task?)
+			//{
+			//	Lock lock(world_state->mutex);
+			//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
+			//		if(it->second->email_address == email)
+			//		{
+			//			User* user = it->second.getPointer();
+			//			try
+			//			{
+			//				user->sendPasswordResetEmail();
+			//				world_state->markAsChanged(); // Mark as changed so gets saved to disk.
+			//				conPrint("Sent user password reset email to '" + email + ", username '" + user->name + "'");
+			//			}
+			//			catch(glare::Exception& e)
+			//			{
+			//				conPrint("Sending password reset email failed: " + e.what());
+			//			}
+			//		}
+			//}
+	
+			break;
+		}
+	case Protocol::ChangePasswordWithResetToken:
+		{
+			conPrintIfNotFuzzing("ChangePasswordWithResetToken");
+		
+			const std::string email			= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string reset_token	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+			const std::string new_password	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
 
-										num_obs_written++;
-									}
-								}
-							} // End lock scope
+			// NOTE: This stuff is done via the website now instead.
+	
+			//conPrint("email: " + email);
+			//conPrint("reset_token: " + reset_token);
+			////conPrint("new_password: " + new_password);
+			//
+			//{
+			//	Lock lock(world_state->mutex);
+			//
+			//	// Find user with the given email address:
+			//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
+			//		if(it->second->email_address == email)
+			//		{
+			//			User* user = it->second.getPointer();
+			//			const bool reset = user->resetPasswordWithToken(reset_token, new_password);
+			//			if(reset)
+			//			{
+			//				world_state->markAsChanged(); // Mark as changed so gets saved to disk.
+			//				conPrint("User password successfully updated.");
+			//			}
+			//		}
+			//}
+
+			break;
+		}
+	case Protocol::WorldSettingsUpdate:
+		{
+			conPrintIfNotFuzzing("WorldSettingsUpdate");
+		
+			WorldSettings world_settings;
+			readWorldSettingsFromStream(msg_buffer, world_settings);
 
-							if(!packet.buf.empty())
-							{
-								conPrintIfNotFuzzing("QueryObjects: Sending back info on " + toString(num_obs_written) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ") ...");
+			if(userConnectedToTheirPersonalWorldOrGodUser(client_user_id, client_user_name, this->connected_world_name))
+			{
+				{
+					Lock lock(cur_world_state->mutex);
+					cur_world_state->world_settings.copyNetworkStateFrom(world_settings);
+					cur_world_state->world_settings.db_dirty = true;
+					world_state->markAsChanged();
+				}
 
-								socket->writeData(packet.buf.data(), packet.buf.size()); // Write data to network
-								socket->flush();
-							}
-						
-							break;
-						}
-					case Protocol::QueryObjectsInAABB: // Client wants to query objects in a particular AABB
-						{
-							// This kind of query will be done when a client connects.
-							// Because the AABB can be quite large (>= 1km on each side), the number of objects returned can be large.
-							// Therefore we first work out the objects in the AABB, then sort by distance to camera, and send back the closer objects first.
-							// This allows the client to start loading and displaying objects before all the queried objects are returned, which can take a while.
-							//
-							// For sending over websocket connections, we will also flush occasionally, which sends a websocket frame.
-							// To do this we will record the offset of the start of chunks. (~= 4096 bytes)
-
-							Vec3d cam_position;
-							if(client_protocol_version >= 36) // position was introduced in protocol version 36.
-							{
-								cam_position = readVec3FromStream<double>(msg_buffer);
-								if(!cam_position.isFinite())
-									throw glare::Exception("Invalid cam_position");
-							}
-							else
-								cam_position = Vec3d(0.0);
-
-							const float lower_x = msg_buffer.readFloat();
-							const float lower_y = msg_buffer.readFloat();
-							const float lower_z = msg_buffer.readFloat();
-							const float upper_x = msg_buffer.readFloat();
-							const float upper_y = msg_buffer.readFloat();
-							const float upper_z = msg_buffer.readFloat();
-
-							const js::AABBox aabb(Vec4f(lower_x, lower_y, lower_z, 1.f), Vec4f(upper_x, upper_y, upper_z, 1.f));
-					
-							conPrintIfNotFuzzing("QueryObjectsInAABB, aabb: " + aabb.toStringNSigFigs(4) + ", cam_position: " + cam_position.toString());
-
-							SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-							std::vector<size_t> chunk_begin_offsets; // Byte index of the start of a chunk (~= 4096 bytes).
-							chunk_begin_offsets.reserve(512);
-							chunk_begin_offsets.push_back(0);
-							size_t last_chunk_begin_offset = 0;
-
-							std::vector<const WorldObject*> obs;
-							obs.reserve(16384);
-
-							{ // Lock scope
-								Lock lock(world_state->mutex);
-								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
-								{
-									const WorldObject* ob = it->second.ptr();
-									const Vec4f ob_pos_vec4f = ob->pos.toVec4fPoint();
-									if(ob_pos_vec4f.isFinite() && aabb.contains(ob_pos_vec4f)) // If the object position is valid, and if it's in the query AABB:
-										obs.push_back(ob);
-								}
-
-								// Sort objects from near to far from camera.
-								struct WorldObjectDistComparator
-								{
-									bool operator () (const WorldObject* a, const WorldObject* b)
-									{
-										const double a_dist2 = a->pos.getDist2(campos);
-										const double b_dist2 = b->pos.getDist2(campos);
-										return a_dist2 < b_dist2;
-									}
-									Vec3d campos;
-								};
-
-								WorldObjectDistComparator comparator;
-								comparator.campos = cam_position;
-								std::sort(obs.begin(), obs.end(), comparator);
-
-								for(size_t i=0; i<obs.size(); ++i)
-								{
-									const WorldObject* ob = obs[i];
-
-									// Create ObjectInitialSend packet
-									MessageUtils::initPacket(scratch_packet, Protocol::ObjectInitialSend);
-									ob->writeToNetworkStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
-
-									packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Append scratch_packet with ObjectInitialSend message to packet.
-
-									if(packet.buf.size() - last_chunk_begin_offset >= 4096) // If we have written more than X bytes since last chunk start:
-									{
-										last_chunk_begin_offset = packet.buf.size();
-										chunk_begin_offsets.push_back(packet.buf.size()); // Record offset of start of chunk.
-									}
-								}
-							} // End lock scope
-
-							// Send back the data, now we have released the world lock.  Send it back in chunks instead of one big write. (better for websockets)
-							if(!packet.buf.empty())
-							{
-								conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on " + toString(obs.size()) + " object(s) (" + getNiceByteSize(packet.buf.size()) + ")...");
-								Timer timer;
-
-								for(size_t i=0; i<chunk_begin_offsets.size(); ++i)
-								{
-									const size_t chunk_offset = chunk_begin_offsets[i];
-									if(chunk_offset < packet.buf.size())
-									{
-										const size_t chunk_end = ((i + 1) < chunk_begin_offsets.size()) ? chunk_begin_offsets[i + 1] : packet.buf.size();
-										const size_t chunk_size = chunk_end - chunk_offset;
-										runtimeCheck((chunk_offset < packet.buf.size()) && (CheckedMaths::addUnsignedInts(chunk_offset, chunk_size) <= packet.buf.size())); 
-										socket->writeData(&packet.buf[chunk_offset], chunk_size); // Write data to network
-										socket->flush(); // Will cause websockets to send a data frame.
-									}
-								}
-
-								conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on objects took " + timer.elapsedStringNSigFigs(4));
-							}
+				// Process resources
+				std::set<DependencyURL> URLs;
+				world_settings.getDependencyURLSet(URLs);
+				for(auto it = URLs.begin(); it != URLs.end(); ++it)
+					sendGetFileMessageIfNeeded(it->URL);
 
-							break;
-						}
-					case Protocol::QueryParcels:
-						{
-							conPrintIfNotFuzzing("QueryParcels");
+				conPrintIfNotFuzzing("WorkerThread: Updated world settings.");
 
-							// Send all current parcel data to client
-							MessageUtils::initPacket(scratch_packet, Protocol::ParcelList);
-							{
-								Lock lock(world_state->mutex);
-								scratch_packet.writeUInt64(cur_world_state->parcels.size()); // Write num parcels
-								for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
-									writeToNetworkStream(*it->second, scratch_packet, client_protocol_version); // Write parcel
-							}
-							MessageUtils::updatePacketLengthField(scratch_packet);
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Send the data
-							socket->flush();
-							break;
-						}
-					case Protocol::ParcelFullUpdate: // Client wants to update a parcel
-						{
-							conPrintIfNotFuzzing("ParcelFullUpdate");
-							const ParcelID parcel_id = readParcelIDFromStream(msg_buffer);
+				// Send WorldSettingsUpdate message to all connected clients
+				{
+					MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsUpdate);
+					world_settings.writeToStream(scratch_packet);
+					MessageUtils::updatePacketLengthField(scratch_packet);
 
-							Parcel temp_parcel;
-							readFromNetworkStreamGivenID(msg_buffer, temp_parcel, client_protocol_version);
+					enqueuePacketToBroadcast(scratch_packet, server);
+				}
+			}
+			else
+			{
+				conPrintIfNotFuzzing("Client does not have pemissions to set world settings.");
 
-							// If client is not logged in, refuse parcel modification.
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to modify a parcel.");
-							}
-							else if(world_state->isInReadOnlyMode())
-							{
-								writeErrorMessageToClient(socket, "Server is in read-only mode, you can't modify a parcel right now.");
-							}
-							else
-							{
-								// Look up existing parcel in world state
-								std::string error_msg;
-								{
-									Lock lock(world_state->mutex);
-									auto res = cur_world_state->parcels.find(parcel_id);
-									if(res != cur_world_state->parcels.end())
-									{
-										Parcel* parcel = res->second.getPointer();
-
-										// See if the user has permissions to alter this object:
-										if(!userHasParcelWritePermissions(*parcel, client_user_id, this->connected_world_name, *cur_world_state))
-										{
-											error_msg = "You must be the owner of this parcel (or have write permissions) to modify it";
-										}
-										else
-										{
-											parcel->copyNetworkStateFrom(temp_parcel, /*restrict_changes=*/true); // restrict changes to stuff clients are allowed to change
-
-											//parcel->from_remote_other_dirty = true;
-											cur_world_state->addParcelAsDBDirty(parcel);
-											//cur_world_state->dirty_from_remote_parcels.insert(ob);
-
-											world_state->markAsChanged();
-										}
-									}
-								} // End lock scope
-
-								if(!error_msg.empty())
-									writeErrorMessageToClient(socket, error_msg);
-							}
-							break;
-						}
-					case Protocol::ChatMessageID:
-						{
-							//const std::string name = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string msg = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+				// Send error message back to client
+				MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
+				scratch_packet.writeStringLengthFirst("You do not have permissions to set the world settings");
+				MessageUtils::updatePacketLengthField(scratch_packet);
 
-							conPrintIfNotFuzzing("Received chat message: '" + msg + "'");
+				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				socket->flush();
+			}
 
-							if(!client_user_id.valid())
-							{
-								writeErrorMessageToClient(socket, "You must be logged in to chat.");
-							}
-							else
-							{
-								// Enqueue chat messages to worker threads to send
-								// Send ChatMessageID packet
-								MessageUtils::initPacket(scratch_packet, Protocol::ChatMessageID);
-								scratch_packet.writeStringLengthFirst(client_user_name);
-								scratch_packet.writeStringLengthFirst(msg);
-								MessageUtils::updatePacketLengthField(scratch_packet);
-
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
-							break;
-						}
-					case Protocol::UserSelectedObject:
-						{
-							//conPrint("Received UserSelectedObject msg.");
+			break;
+		}
+	case Protocol::QueryMapTiles:
+		{
+			conPrintIfNotFuzzing("QueryMapTiles");
+		
+			const uint32 num_tiles = msg_buffer.readUInt32();
+			if(num_tiles > 1000)
+				throw glare::Exception("QueryMapTiles: too many tiles: " + toString(num_tiles));
 
-							const UID object_uid = readUIDFromStream(msg_buffer);
+			// conPrint("QueryMapTiles, num_tiles=" + toString(num_tiles));
+	
+			// Read tile coords
+			std::vector<Vec3i> tile_coords(num_tiles);
+			msg_buffer.readData(tile_coords.data(), num_tiles * sizeof(Vec3i));
 
-							// Send message to connected clients
-							{
-								MessageUtils::initPacket(scratch_packet, Protocol::UserSelectedObject);
-								writeToStream(client_avatar_uid, scratch_packet);
-								writeToStream(object_uid, scratch_packet);
-								MessageUtils::updatePacketLengthField(scratch_packet);
+			std::vector<std::string> result_URLs(num_tiles);
+			{
+				Lock lock(world_state->screenshots_mutex);
 
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
-							break;
-						}
-					case Protocol::UserDeselectedObject:
+				for(size_t i=0; i<tile_coords.size(); ++i)
+				{
+					auto res = world_state->map_tile_info.info.find(tile_coords[i]);
+					if(res != world_state->map_tile_info.info.end())
+					{
+						const TileInfo& tile_info = res->second;
+						if(tile_info.cur_tile_screenshot.nonNull())
 						{
-							//conPrint("Received UserDeselectedObject msg.");
-
-							const UID object_uid = readUIDFromStream(msg_buffer);
-
-							// Send message to connected clients
-							{
-								MessageUtils::initPacket(scratch_packet, Protocol::UserDeselectedObject);
-								writeToStream(client_avatar_uid, scratch_packet);
-								writeToStream(object_uid, scratch_packet);
-								MessageUtils::updatePacketLengthField(scratch_packet);
-
-								enqueuePacketToBroadcast(scratch_packet, server);
-							}
-							break;
+							result_URLs[i] = tile_info.cur_tile_screenshot->URL;
 						}
-					case Protocol::LogInMessage: // Client wants to log in.
+						else if(tile_info.prev_tile_screenshot.nonNull())
 						{
-							conPrintIfNotFuzzing("LogInMessage");
+							result_URLs[i] = tile_info.prev_tile_screenshot->URL;
+						}
 
-							const std::string username = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string password = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+						// conPrint("QueryMapTiles: Found result_URLs[i]: " + result_URLs[i]);
+					}
+				}
+			}
 
-							conPrintIfNotFuzzing("username: '" + username + "'");
-						
-							bool logged_in = false;
-							{
-								Lock lock(world_state->mutex);
-								auto res = world_state->name_to_users.find(username);
-								if(res != world_state->name_to_users.end())
-								{
-									User* user = res->second.getPointer();
-									const bool password_valid = user->isPasswordValid(password);
-									conPrintIfNotFuzzing("password_valid: " + boolToString(password_valid));
-									if(password_valid)
-									{
-										// Password is valid, log user in.
-										client_user_id = user->id;
-										client_user_name = user->name;
-										client_user_avatar_settings = user->avatar_settings;
-										client_user_flags = user->flags;
-
-										logged_in = true;
-									}
-								}
-							}
+			// Send result URLs back
+			MessageUtils::initPacket(scratch_packet, Protocol::MapTilesResult);
+			scratch_packet.writeUInt32(num_tiles);
 
-							conPrintIfNotFuzzing("logged_in: " + boolToString(logged_in));
-							if(logged_in)
-							{
-								if(username == "lightmapperbot")
-									logged_in_user_is_lightmapper_bot = true;
-
-								// Send logged-in message to client
-								MessageUtils::initPacket(scratch_packet, Protocol::LoggedInMessageID);
-								writeToStream(client_user_id, scratch_packet);
-								scratch_packet.writeStringLengthFirst(username);
-								writeAvatarSettingsToStream(client_user_avatar_settings, scratch_packet);
-								scratch_packet.writeUInt32(client_user_flags);
-								MessageUtils::updatePacketLengthField(scratch_packet);
-
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
-							else
-							{
-								// Login failed.  Send error message back to client
-								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-								scratch_packet.writeStringLengthFirst("Login failed: username or password incorrect.");
-								MessageUtils::updatePacketLengthField(scratch_packet);
+			// Write tile coords
+			scratch_packet.writeData(tile_coords.data(), tile_coords.size() * sizeof(Vec3i));
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
-					
-							break;
-						}
-					case Protocol::LogOutMessage: // Client wants to log out.
-						{
-							conPrintIfNotFuzzing("LogOutMessage");
+			// Write URLS
+			for(size_t i=0; i<result_URLs.size(); ++i)
+				scratch_packet.writeStringLengthFirst(result_URLs[i]);
 
-							client_user_id = UserID::invalidUserID(); // Mark the client as not logged in.
-							client_user_name = "";
-							client_user_flags = 0;
+			MessageUtils::updatePacketLengthField(scratch_packet);
 
-							// Send logged-out message to client
-							MessageUtils::initPacket(scratch_packet, Protocol::LoggedOutMessageID);
-							MessageUtils::updatePacketLengthField(scratch_packet);
+			socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			socket->flush();
 
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-							socket->flush();
-							break;
-						}
-					case Protocol::SignUpMessage:
-						{
-							conPrintIfNotFuzzing("SignUpMessage");
+			break;
+		}
+	default:
+		{
+			//conPrint("Unknown message id: " + toString(msg_type));
+			throw glare::Exception("Unknown message id: " + toString(msg_type));
+		}
+	}
 
-							const std::string username = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string email    = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string password = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
+	return true;
+}
 
-							try
-							{
-								conPrintIfNotFuzzing("username: '" + username + "', email: '" + email + "'");
-
-								bool signed_up = false;
-
-								std::string msg_to_client;
-								if(world_state->isInReadOnlyMode())
-								{
-									msg_to_client = "Server is in read-only mode, you can't sign up right now.";
-								}
-								else
-								{
-									if(username.size() < 3)
-										msg_to_client = "Username is too short, must have at least 3 characters";
-									else
-									{
-										if(password.size() < 6)
-											msg_to_client = "Password is too short, must have at least 6 characters";
-										else
-										{
-											Lock lock(world_state->mutex);
-											auto res = world_state->name_to_users.find(username);
-											if(res == world_state->name_to_users.end())
-											{
-												Reference<User> new_user = new User();
-												new_user->id = UserID((uint32)world_state->name_to_users.size());
-												new_user->created_time = TimeStamp::currentTime();
-												new_user->name = username;
-												new_user->email_address = email;
-
-												new_user->setNewPasswordAndSalt(password);
-
-												world_state->addUserAsDBDirty(new_user);
-
-												// Add new user to world state
-												world_state->user_id_to_users.insert(std::make_pair(new_user->id, new_user));
-												world_state->name_to_users   .insert(std::make_pair(username,     new_user));
-												world_state->markAsChanged(); // Mark as changed so gets saved to disk.
-
-												client_user_id = new_user->id; // Log user in as well.
-												client_user_name = new_user->name;
-												client_user_avatar_settings = new_user->avatar_settings;
-												client_user_flags = new_user->flags;
-
-												signed_up = true;
-											}
-										}
-									}
-								}
-
-								conPrintIfNotFuzzing("signed_up: " + boolToString(signed_up));
-								if(signed_up)
-								{
-									conPrintIfNotFuzzing("Sign up successful");
-									// Send signed-up message to client
-									MessageUtils::initPacket(scratch_packet, Protocol::SignedUpMessageID);
-									writeToStream(client_user_id, scratch_packet);
-									scratch_packet.writeStringLengthFirst(username);
-									MessageUtils::updatePacketLengthField(scratch_packet);
-
-									socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-									socket->flush();
-								}
-								else
-								{
-									conPrintIfNotFuzzing("Sign up failed.");
-
-									// signup failed.  Send error message back to client
-									MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-									scratch_packet.writeStringLengthFirst(msg_to_client);
-									MessageUtils::updatePacketLengthField(scratch_packet);
-
-									socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-									socket->flush();
-								}
-							}
-							catch(glare::Exception& e)
-							{
-								conPrint("Sign up failed, internal error: " + e.what());
 
-								// signup failed.  Send error message back to client
-								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-								scratch_packet.writeStringLengthFirst("Signup failed: internal error.");
-								MessageUtils::updatePacketLengthField(scratch_packet);
+// Cleans up after the connection has ended, either normally or due to an exception.
+void WorkerThread::connectionClosed()
+{
+	if(write_trace)
+		socket.downcastToPtr<RecordingSocket>()->writeRecordBufToDisk("traces/worker_thread_trace_" + ::toString(Clock::getTimeSinceInit()) + ".bin");
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
+	server->clientDisconnected(this);
+	server->unsubscribeFromWorldUpdates(this);
+	
+	// Mark avatar corresponding to client as dead.  Note that we want to do this after catching any exceptions, so avatar is removed on broken connections etc.
+	if(cur_world_state.nonNull())
+	{
+		Lock lock(cur_world_state->mutex);
+		if(cur_world_state->avatars.count(client_avatar_uid) == 1)
+		{
+			cur_world_state->avatars[client_avatar_uid]->state = Avatar::State_Dead;
+			cur_world_state->avatars[client_avatar_uid]->other_dirty = true;
+			cur_world_state->dirty_avatars.insert(client_avatar_uid);
+			server->notifyUpdatesPending();
+		}
+	}
 
-							break;
-						}
-					case Protocol::RequestPasswordReset:
-						{
-							conPrintIfNotFuzzing("RequestPasswordReset");
-
-							const std::string email    = msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-
-							// NOTE: This stuff is done via the website now instead.
-
-							//conPrint("email: " + email);
-							//
-							//// TEMP: Send password reset email in this thread for now. 
-							//// TODO: move to another thread (make some kind of background task?)
-							//{
-							//	Lock lock(world_state->mutex);
-							//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
-							//		if(it->second->email_address == email)
-							//		{
-							//			User* user = it->second.getPointer();
-							//			try
-							//			{
-							//				user->sendPasswordResetEmail();
-							//				world_state->markAsChanged(); // Mark as changed so gets saved to disk.
-							//				conPrint("Sent user password reset email to '" + email + ", username '" + user->name + "'");
-							//			}
-							//			catch(glare::Exception& e)
-							//			{
-							//				conPrint("Sending password reset email failed: " + e.what());
-							//			}
-							//		}
-							//}
-					
-							break;
-						}
-					case Protocol::ChangePasswordWithResetToken:
-						{
-							conPrintIfNotFuzzing("ChangePasswordWithResetToken");
-						
-							const std::string email			= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string reset_token	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-							const std::string new_password	= msg_buffer.readStringLengthFirst(MAX_STRING_LEN);
-
-							// NOTE: This stuff is done via the website now instead.
-					
-							//conPrint("email: " + email);
-							//conPrint("reset_token: " + reset_token);
-							////conPrint("new_password: " + new_password);
-							//
-							//{
-							//	Lock lock(world_state->mutex);
-							//
-							//	// Find user with the given email address:
-							//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
-							//		if(it->second->email_address == email)
-							//		{
-							//			User* user = it->second.getPointer();
-							//			const bool reset = user->resetPasswordWithToken(reset_token, new_password);
-							//			if(reset)
-							//			{
-							//				world_state->markAsChanged(); // Mark as changed so gets saved to disk.
-							//				conPrint("User password successfully updated.");
-							//			}
-							//		}
-							//}
+	// Remove thread-local OpenSSL error state, to avoid leaking it.
+	// NOTE: have to destroy socket first, before calling ERR_remove_thread_state(), otherwise memory will just be reallocated.
+	if(socket.nonNull())
+	{
+		assert(socket->getRefCount() == 1);
+	}
+	socket = NULL;
+	ERR_remove_thread_state(/*thread id=*/NULL); // Set thread ID to null to use current thread.
+}
 
-							break;
-						}
-					case Protocol::WorldSettingsUpdate:
-						{
-							conPrintIfNotFuzzing("WorldSettingsUpdate");
-						
-							WorldSettings world_settings;
-							readWorldSettingsFromStream(msg_buffer, world_settings);
 
-							if(userConnectedToTheirPersonalWorldOrGodUser(client_user_id, client_user_name, this->connected_world_name))
-							{
-								{
-									Lock lock(server->world_state->mutex);
-									cur_world_state->world_settings.copyNetworkStateFrom(world_settings);
-									cur_world_state->world_settings.db_dirty = true;
-									world_state->markAsChanged();
-								}
-
-								// Process resources
-								std::set<DependencyURL> URLs;
-								world_settings.getDependencyURLSet(URLs);
-								for(auto it = URLs.begin(); it != URLs.end(); ++it)
-									sendGetFileMessageIfNeeded(it->URL);
-
-								conPrintIfNotFuzzing("WorkerThread: Updated world settings.");
-
-								// Send WorldSettingsUpdate message to all connected clients
-								{
-									MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsUpdate);
-									world_settings.writeToStream(scratch_packet);
-									MessageUtils::updatePacketLengthField(scratch_packet);
-
-									enqueuePacketToBroadcast(scratch_packet, server);
-								}
-							}
-							else
-							{
-								conPrintIfNotFuzzing("Client does not have pemissions to set world settings.");
+// Max number of messages to handle in one service() call, before letting other connections have a turn.
+static const int MAX_NUM_MSGS_PER_SERVICE = 64;
 
-								// Send error message back to client
-								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-								scratch_packet.writeStringLengthFirst("You do not have permissions to set the world settings");
-								MessageUtils::updatePacketLengthField(scratch_packet);
+// Max time for the handshake, including the TLS handshake, which is done on the first read.  The client sends it all straight away, so this is generous.
+static const double MAX_POOLED_HANDSHAKE_TIME = 10.0;
 
-								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-								socket->flush();
-							}
+// Max time for reading the world name and sending the initial world state, which may be large.
+static const double MAX_POOLED_INIT_TIME = 60.0;
 
-							break;
-						}
-					case Protocol::QueryMapTiles:
-						{
-							conPrintIfNotFuzzing("QueryMapTiles");
-						
-							const uint32 num_tiles = msg_buffer.readUInt32();
-							if(num_tiles > 1000)
-								throw glare::Exception("QueryMapTiles: too many tiles: " + toString(num_tiles));
-
-							// conPrint("QueryMapTiles, num_tiles=" + toString(num_tiles));
-					
-							// Read tile coords
-							std::vector<Vec3i> tile_coords(num_tiles);
-							msg_buffer.readData(tile_coords.data(), num_tiles * sizeof(Vec3i));
-
-							std::vector<std::string> result_URLs(num_tiles);
-							{
-								Lock lock(world_state->mutex);
-
-								for(size_t i=0; i<tile_coords.size(); ++i)
-								{
-									auto res = world_state->map_tile_info.info.find(tile_coords[i]);
-									if(res != world_state->map_tile_info.info.end())
-									{
-										const TileInfo& tile_info = res->second;
-										if(tile_info.cur_tile_screenshot.nonNull())
-										{
-											result_URLs[i] = tile_info.cur_tile_screenshot->URL;
-										}
-										else if(tile_info.prev_tile_screenshot.nonNull())
-										{
-											result_URLs[i] = tile_info.prev_tile_screenshot->URL;
-										}
-
-										// conPrint("QueryMapTiles: Found result_URLs[i]: " + result_URLs[i]);
-									}
-								}
-							}
+// Max time for reading and handling a single message, including writing any reply, or for sending the pending data.
+// Measured from the start of the message rather than from the last progress, so a client that trickles bytes in or reads slowly
+// gets its connection closed, instead of holding on to a pool worker.
+static const double MAX_POOLED_MESSAGE_TIME = 10.0;
 
-							// Send result URLs back
-							MessageUtils::initPacket(scratch_packet, Protocol::MapTilesResult);
-							scratch_packet.writeUInt32(num_tiles);
 
-							// Write tile coords
-							scratch_packet.writeData(tile_coords.data(), tile_coords.size() * sizeof(Vec3i));
+WorkerThreadPooledConnection::WorkerThreadPooledConnection(const Reference<WorkerThread>& worker_, int socket_fd_)
+:	worker(worker_),
+	socket_fd(socket_fd_),
+	hand_over_to_thread(false)
+{
+	max_service_time = MAX_POOLED_HANDSHAKE_TIME; // The first service() call does the handshake, see service().
+}
 
-							// Write URLS
-							for(size_t i=0; i<result_URLs.size(); ++i)
-								scratch_packet.writeStringLengthFirst(result_URLs[i]);
 
-							MessageUtils::updatePacketLengthField(scratch_packet);
+bool WorkerThreadPooledConnection::service()
+{
+	try
+	{
+		if(!worker->handshake_done)
+		{
+			worker->doHandshake();
+			max_service_time = 0; // Handshake is done, just rely on the pool's stall detection from now on.
 
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-							socket->flush();
+			if(worker->connection_type != Protocol::ConnectionTypeUpdates)
+			{
+				hand_over_to_thread = true; // WorkerThread::doRun() will handle the rest of the connection, see removedFromPool().
+				return false;
+			}
 
-							break;
-						}
-					default:
-						{
-							//conPrint("Unknown message id: " + toString(msg_type));
-							throw glare::Exception("Unknown message id: " + toString(msg_type));
-						}
-					}
-				}
-				else
-				{
-#if defined(_WIN32) || defined(OSX)
-#else
-					if(VERBOSE) conPrint("WorkerThread: event FD was signalled.");
+			beginMessage(MAX_POOLED_INIT_TIME);
+			worker->initUpdatesConnection();
+			endMessage();
+		}
 
-					// The event FD was signalled, which means there is some data to send on the socket.
-					// Reset the event fd by reading from it.
-					event_fd.read();
+		// Do what an iteration of the loop in WorkerThread::doRun() does, for each available message.
+		beginMessage(MAX_POOLED_MESSAGE_TIME);
+		worker->sendPendingData();
+		endMessage();
 
-					if(VERBOSE) conPrint("WorkerThread: event FD has been reset.");
-#endif
-				}
-			} // End write to / read from socket loop
-		} // End if(connection_type == Protocol::ConnectionTypeUpdates)
-		else
+		for(int i=0; worker->socket->readable(/*timeout=*/0.0); ++i)
 		{
-			throw glare::Exception("Unknown connection_type: " + toString(connection_type));
+			if(i == MAX_NUM_MSGS_PER_SERVICE)
+			{
+				// Signal the event FD so we get serviced again after other connections.  The socket fd might not fire again, if the remaining data is already buffered in the TLS layer.
+				worker->event_fd.notify();
+				return true;
+			}
+
+			beginMessage(MAX_POOLED_MESSAGE_TIME);
+			if(!worker->handleUpdatesMessage())
+				return false;
+			endMessage();
+
+			beginMessage(MAX_POOLED_MESSAGE_TIME);
+			worker->sendPendingData();
+			endMessage();
 		}
+		return true;
 	}
 	catch(MySocketExcep& e)
 	{
 		if(e.excepType() == MySocketExcep::ExcepType_ConnectionClosedGracefully)
-			conPrint("Updates client from " + IPAddress::formatIPAddressAndPort(socket->getOtherEndIPAddress(), socket->getOtherEndPort()) + " closed connection gracefully.");
+			conPrint("Updates client from " + IPAddress::formatIPAddressAndPort(worker->socket->getOtherEndIPAddress(), worker->socket->getOtherEndPort()) + " closed connection gracefully.");
 		else
 			conPrint("Socket error: " + e.what());
 	}
 	catch(glare::Exception& e)
 	{
-		conPrintIfNotFuzzing("glare::Exception: " + e.what());
+		conPrint("glare::Exception: " + e.what());
 	}
 	catch(std::bad_alloc&)
 	{
-		conPrint("WorkerThread: Caught std::bad_alloc.");
+		conPrint("WorkerThreadPooledConnection: Caught std::bad_alloc.");
 	}
+	return false;
+}
 
 
-	if(write_trace)
-		socket.downcastToPtr<RecordingSocket>()->writeRecordBufToDisk("traces/worker_thread_trace_" + ::toString(Clock::getTimeSinceInit()) + ".bin");
+void WorkerThreadPooledConnection::removedFromPool()
+{
+	if(hand_over_to_thread)
+		worker->server->worker_thread_manager.addThread(worker);
+	else
+		worker->connectionClosed();
+}
 
-	server->clientDisconnected(this);
-	
-	// Mark avatar corresponding to client as dead.  Note that we want to do this after catching any exceptions, so avatar is removed on broken connections etc.
-	if(cur_world_state.nonNull())
-	{
-		Lock lock(world_state->mutex);
-		if(cur_world_state->avatars.count(client_avatar_uid) == 1)
-		{
-			cur_world_state->avatars[client_avatar_uid]->state = Avatar::State_Dead;
-			cur_world_state->avatars[client_avatar_uid]->other_dirty = true;
-		}
-	}
 
-	// Remove thread-local OpenSSL error state, to avoid leaking it.
-	// NOTE: have to destroy socket first, before calling ERR_remove_thread_state(), otherwise memory will just be reallocated.
-	if(socket.nonNull())
-	{
-		assert(socket->getRefCount() == 1);
-	}
-	socket = NULL;
-	ERR_remove_thread_state(/*thread id=*/NULL); // Set thread ID to null to use current thread.
+int WorkerThreadPooledConnection::getEventFD()
+{
+#if defined(_WIN32) || defined(OSX)
+	return -1;
+#else
+	return worker->event_fd.efd;
+#endif
 }
 
 
@@ -2629,6 +2984,53 @@ void WorkerThread::enqueueDataToSend(const SocketBufferOutStream& packet) // thr
 }
 
 
+void WorkerThread::enqueueSharedDataToSend(const SharedPacketBufferRef& buffer) // threadsafe
+{
+	if(!buffer->data.empty())
+	{
+		Lock lock(data_to_send_mutex);
+		SharedDataToSend shared;
+		shared.buffer = buffer;
+		shared.data_to_send_offset = data_to_send.size();
+		shared_data_to_send.push_back(shared);
+	}
+
+	event_fd.notify();
+}
+
+
+void WorkerThread::setClientCamPos(const Vec3d& cam_pos)
+{
+	Lock lock(client_cam_pos_mutex);
+	client_cam_pos = cam_pos;
+	client_cam_pos_known = true;
+}
+
+
+bool WorkerThread::getClientCamPos(Vec3d& cam_pos_out)
+{
+	Lock lock(client_cam_pos_mutex);
+	cam_pos_out = client_cam_pos;
+	return client_cam_pos_known;
+}
+
+
+void WorkerThread::addBroadcastStats(uint64 bytes_sent, uint64 bytes_saved)
+{
+	Lock lock(broadcast_stats_mutex);
+	broadcast_bytes_sent += bytes_sent;
+	broadcast_bytes_saved += bytes_saved;
+}
+
+
+void WorkerThread::getBroadcastStats(uint64& bytes_sent_out, uint64& bytes_saved_out)
+{
+	Lock lock(broadcast_stats_mutex);
+	bytes_sent_out = broadcast_bytes_sent;
+	bytes_saved_out = broadcast_bytes_saved;
+}
+
+
 void WorkerThread::conPrintIfNotFuzzing(const std::string& msg)
 {
 	if(!fuzzing)
@@ -6,6 +6,12 @@ Copyright Glare Technologies Limited 2018 -
 #pragma once
 
 
+#include "UpdateInterestFilter.h"
+#include "ConnectionIOPool.h"
+#include "ResourceRequestScheduler.h"
+#include "../shared/UID.h"
+#include "../shared/UserID.h"
+#include "../shared/Avatar.h"
 #include <RequestInfo.h>
 #include <MessageableThread.h>
 #include <Platform.h>
@@ -15,14 +21,36 @@ Copyright Glare Technologies Limited 2018 -
 #include <SocketBufferOutStream.h>
 #include <Vector.h>
 #include <BufferInStream.h>
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
 #include <string>
+#include <vector>
 class Server;
+class ServerWorldState;
+
+
+/*=====================================================================
+SharedPacketBuffer
+------------------
+A batch of one or more encoded messages, that is built once and then sent
+to multiple clients without being copied per client.
+Should not be modified after being enqueued with enqueueSharedDataToSend().
+=====================================================================*/
+class SharedPacketBuffer : public ThreadSafeRefCounted
+{
+public:
+	js::Vector<uint8, 16> data;
+};
+typedef Reference<SharedPacketBuffer> SharedPacketBufferRef;
 
 
 /*=====================================================================
 WorkerThread
 ------------
 This thread runs on the server, and handles communication with a single client.
+
+Updates connections may instead be serviced by a ConnectionIOPool, without running
+this thread, see WorkerThreadPooledConnection below.
 =====================================================================*/
 class WorkerThread : public MessageableThread
 {
@@ -35,15 +63,43 @@ public:
 
 	std::string connected_world_name;
 
+	uint32 client_protocol_version; // Set before the client is subscribed to world updates, so can be read by the main thread while holding Server::world_subscribers_mutex.
+
 	void enqueueDataToSend(const std::string& data); // threadsafe
 	void enqueueDataToSend(const SocketBufferOutStream& packet); // threadsafe
+	void enqueueSharedDataToSend(const SharedPacketBufferRef& buffer); // threadsafe.  Holds a reference to buffer instead of copying it.
 
 	web::RequestInfo websocket_request_info; // If the client connected via a websocket, this the HTTP request data.  Is used for accessing the login cookie.
 
+	// Returns false if the client has not reported a camera position yet.  threadsafe.
+	bool getClientCamPos(Vec3d& cam_pos_out);
+
+	// Broadcast data stats, for the admin connections page.
+	void addBroadcastStats(uint64 bytes_sent, uint64 bytes_saved); // threadsafe
+	void getBroadcastStats(uint64& bytes_sent_out, uint64& bytes_saved_out); // threadsafe
+
+	UpdateInterestFilter update_interest_filter; // Only accessed by the main server thread.
+
 private:
+	friend class WorkerThreadPooledConnection;
+
+	// The stages of handling a connection, used by both doRun() and WorkerThreadPooledConnection.
+	void doHandshake(); // Reads the hello, protocol version and connection type.  Sets connection_type.
+	void initUpdatesConnection(); // Reads the world name and sends the initial world state.
+	void sendPendingData(); // Sends the data enqueued with enqueueDataToSend() etc.  Called before each read of a message.
+	bool handleUpdatesMessage(); // Reads and handles a single message.  Returns false if the client said goodbye.
+	void connectionClosed(); // Cleans up after the connection has ended, normally or due to an exception.
+
+	// Writes the complete messages in packet to the socket in chunks, flushing after each chunk (which sends a data frame for websocket connections).
+	// The messages are sent in CompressedMessages messages if the client supports them and compression is enabled.
+	void writeQueryResponseToClient(const SocketBufferOutStream& packet);
+
 	void sendGetFileMessageIfNeeded(const std::string& resource_URL);
 	void handleResourceUploadConnection();
 	void handleResourceDownloadConnection();
+	void handleResourceRequest(ResourceRequestScheduler& scheduler); // Reads a ResourceRequest message body, and replies with a ResourceRequestResult.
+	void sendNextResourceChunk(ResourceRequestScheduler& scheduler); // Sends a ResourceDataChunk for the highest priority outstanding request.
+	void finishResourceRequest(const ResourceRequestScheduler::Request& request); // Updates server->resource_send_stats for a completed or cancelled request.
 	void handleScreenshotBotConnection();
 	void handleEthBotConnection();
 	void conPrintIfNotFuzzing(const std::string& msg);
@@ -52,15 +108,77 @@ private:
 	Server* server;
 	EventFD event_fd;	
 
+	// A shared buffer to send, and the offset in data_to_send that it should be sent at, so that message ordering is preserved.
+	struct SharedDataToSend
+	{
+		SharedPacketBufferRef buffer;
+		size_t data_to_send_offset;
+	};
+
 	Mutex data_to_send_mutex;
-	js::Vector<uint8, 16> data_to_send			GUARDED_BY(data_to_send_mutex);
+	js::Vector<uint8, 16> data_to_send						GUARDED_BY(data_to_send_mutex);
+	std::vector<SharedDataToSend> shared_data_to_send		GUARDED_BY(data_to_send_mutex);
 	js::Vector<uint8, 16> temp_data_to_send;
+	std::vector<SharedDataToSend> temp_shared_data_to_send;
 
 	SocketBufferOutStream scratch_packet;
+	SocketBufferOutStream compressed_packet; // Used by writeQueryResponseToClient().
+
+	void setClientCamPos(const Vec3d& cam_pos);
+
+	Mutex client_cam_pos_mutex;
+	Vec3d client_cam_pos						GUARDED_BY(client_cam_pos_mutex);
+	bool client_cam_pos_known					GUARDED_BY(client_cam_pos_mutex);
+
+	Mutex broadcast_stats_mutex;
+	uint64 broadcast_bytes_sent					GUARDED_BY(broadcast_stats_mutex); // Total bytes of broadcast updates enqueued to send to the client.
+	uint64 broadcast_bytes_saved				GUARDED_BY(broadcast_stats_mutex); // Total bytes of transform updates not sent to the client due to area-of-interest filtering.
 
 	BufferInStream msg_buffer;
 public:
 	bool fuzzing; // Are we currently doing fuzz-testing?
 private:
 	bool write_trace; // Should we write a record of network traffic to disk for fuzz seeding?
+
+	// Connection state.  Only accessed by the thread handling the connection: this thread, or the ConnectionIOPool worker currently servicing it.
+	bool handshake_done;
+	uint32 connection_type;
+	UID client_avatar_uid;
+	UserID client_user_id; // Will be an invalid reference if client is not logged in, otherwise will refer to the user account the client is logged in to.
+	std::string client_user_name;
+	AvatarSettings client_user_avatar_settings;
+	uint32 client_user_flags;
+	Reference<ServerWorldState> cur_world_state; // World the client is connected to.
+	bool logged_in_user_is_lightmapper_bot; // Just for updating the last_lightmapper_bot_contact_time.
+};
+
+
+/*=====================================================================
+WorkerThreadPooledConnection
+----------------------------
+Services a WorkerThread's connection on a ConnectionIOPool, instead of running the WorkerThread as a thread.
+
+The handshake is done on the pool, in the first service() call, which is made once the client has sent something.
+The pool shuts the socket down if the handshake takes more than a few seconds, so a client that stalls part way through
+can't hold on to a pool worker.  Updates connections then stay in the pool, with each service() call
+sending pending data and handling the messages already available, like an iteration of the loop in WorkerThread::doRun().
+The reads and writes still block, so each message, and each send of pending data, is given a deadline with beginMessage(),
+and the pool shuts the socket down if it passes, so a client trickling bytes in or reading slowly can't hold on to a worker either.
+Other connection types (resource uploads and downloads, bots) make long blocking reads and writes, so
+are handed over to a WorkerThread thread after the handshake.
+=====================================================================*/
+class WorkerThreadPooledConnection : public PooledConnection
+{
+public:
+	WorkerThreadPooledConnection(const Reference<WorkerThread>& worker, int socket_fd);
+
+	virtual bool service() override;
+	virtual void removedFromPool() override;
+	virtual int getSocketFD() override { return socket_fd; }
+	virtual int getEventFD() override;
+
+	Reference<WorkerThread> worker;
+private:
+	int socket_fd; // Underlying OS socket, for TLS connections.
+	bool hand_over_to_thread;
 };
@@ -36,6 +36,13 @@ Copyright Glare Technologies Limited 2022 -
 #include <MemMappedFile.h>
 #include <PCG32.h>
 #include "WorldCreation.h"
+#include "ServerWorldState.h"
+#include "../shared/CompressedMessages.h"
+#include "../shared/Protocol.h"
+#include <FileUtils.h>
+#include <Timer.h>
+#include <BufferInStream.h>
+#include <algorithm>
 
 
 #if 0
@@ -127,7 +134,7 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 		test_socket = NULL;
 		worker->doRun();
 
-		test_server->world_state->world_states.clear();
+		test_server->world_state->clearAndReset(); // Clears worlds and resets UIDs.
 
 		// Create a parcel
 		const ParcelID parcel_id(0);
@@ -146,12 +153,14 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 
 		parcel->build();
 
-		test_server->world_state->world_states[""] = new ServerWorldState();
-		test_server->world_state->getRootWorldState()->parcels[parcel_id] = parcel;
+		{
+			Reference<ServerWorldState> root_world = test_server->world_state->getRootWorldState();
+			Lock lock(root_world->mutex);
+			root_world->parcels[parcel_id] = parcel;
+		}
 
 		//test_server->world_state->user_id_to_users.clear();
 		//test_server->world_state->name_to_users.clear();
-		test_server->world_state->clearAndReset();
 	}
 	catch(glare::Exception&)
 	{
@@ -162,9 +171,194 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 #endif
 
 
-void WorkerThreadTests::test()
+// Makes a synthetic object.  Objects share a limited set of model and texture URLs, as in real worlds.
+static WorldObjectRef makeSyntheticObject(PCG32& rng, uint64 uid)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->uid = UID(uid);
+	ob->model_url = "model_" + toString(rng.nextUInt(200)) + "_glb_" + toString(rng.nextUInt(1u << 30)) + ".bmesh";
+	ob->pos = Vec3d((rng.unitRandom() - 0.5) * 2000.0, (rng.unitRandom() - 0.5) * 2000.0, rng.unitRandom() * 20.0);
+	ob->scale = Vec3f(1.f);
+	ob->creator_name = "user" + toString(rng.nextUInt(50));
+	const int num_mats = 1 + (int)rng.nextUInt(4);
+	for(int i=0; i<num_mats; ++i)
+	{
+		WorldMaterialRef mat = new WorldMaterial();
+		mat->colour_texture_url = "texture_" + toString(rng.nextUInt(300)) + "_jpg_" + toString(rng.nextUInt(1u << 30)) + ".jpg";
+		mat->colour_rgb = Colour3f(rng.unitRandom(), rng.unitRandom(), rng.unitRandom());
+		ob->materials.push_back(mat);
+	}
+	return ob;
+}
+
+
+struct CompressedResponseStats
 {
+	size_t compressed_size;
+	double compress_time;
+	double first_chunk_compress_time;
+	double decompress_time;
+	std::vector<size_t> cumulative_compressed_size_at_ob; // Total number of bytes that need to be received before ob i can be handled.
+};
+
+
+// Compresses the query response in chunks like WorkerThread::writeQueryResponseToClient() does, and decompresses it like the client.
+static CompressedResponseStats compressResponse(const SocketBufferOutStream& packet, size_t num_obs, int compression_level)
+{
+	CompressedResponseStats stats;
+	stats.compressed_size = 0;
+	stats.compress_time = 0;
+	stats.first_chunk_compress_time = 0;
+	stats.decompress_time = 0;
+
+	SocketBufferOutStream compressed_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	BufferInStream msg_buffer;
+	js::Vector<uint8, 16> decompressed;
+
+	const uint8* data = packet.buf.data();
+	size_t begin = 0;
+	while(begin < packet.buf.size())
+	{
+		const size_t max_chunk_size = (begin == 0) ? CompressedMessages::FIRST_CHUNK_MAX_SIZE : CompressedMessages::CHUNK_MAX_SIZE;
+		const size_t end = CompressedMessages::findChunkEnd(data, packet.buf.size(), begin, max_chunk_size);
+
+		compressed_packet.buf.clear();
+		Timer timer;
+		CompressedMessages::appendCompressedMessage(data + begin, end - begin, compression_level, compressed_packet);
+		const double chunk_compress_time = timer.elapsed();
+		stats.compress_time += chunk_compress_time;
+		if(begin == 0)
+			stats.first_chunk_compress_time = chunk_compress_time;
+		stats.compressed_size += compressed_packet.buf.size();
+
+		// Count the number of messages in the chunk.  All of them are available once the whole chunk has been received.
+		for(size_t offset = begin; offset < end; )
+		{
+			uint32 msg_len;
+			std::memcpy(&msg_len, data + offset + sizeof(uint32), sizeof(uint32));
+			offset += msg_len;
+			stats.cumulative_compressed_size_at_ob.push_back(stats.compressed_size);
+		}
+
+		uint32 msg_type;
+		std::memcpy(&msg_type, compressed_packet.buf.data(), sizeof(uint32));
+		if(msg_type == Protocol::CompressedMessages) // May have fallen back to uncompressed messages.
+		{
+			Timer decompress_timer;
+			msg_buffer.buf.resizeNoCopy(compressed_packet.buf.size());
+			std::memcpy(msg_buffer.buf.data(), compressed_packet.buf.data(), compressed_packet.buf.size());
+			msg_buffer.read_index = sizeof(uint32) * 2;
+			CompressedMessages::decompressMessages(msg_buffer, decompressed);
+			stats.decompress_time += decompress_timer.elapsed();
+
+			testAssert(decompressed.size() == end - begin);
+			testAssert(std::memcmp(decompressed.data(), data + begin, end - begin) == 0);
+		}
+
+		begin = end;
+	}
+
+	testAssert(stats.cumulative_compressed_size_at_ob.size() == num_obs);
+	return stats;
+}
+
+
+static void printTimeToObjects(const std::string& label, double bandwidth_bits_per_s, size_t num_obs, const std::vector<size_t>& uncompressed_size_at_ob, const CompressedResponseStats& stats)
+{
+	const double bytes_per_s = bandwidth_bits_per_s / 8;
+	const size_t counts[] = { 1, 100, num_obs };
+	std::string s = "    " + label + ": ";
+	for(size_t i=0; i<3; ++i)
+	{
+		const size_t n = myMin(counts[i], num_obs);
+		const double uncompressed_time = uncompressed_size_at_ob[n - 1] / bytes_per_s;
+
+		// Model: server compresses the first chunk before sending anything, then later chunks are compressed while earlier ones are being sent.
+		// The client decompression time is small and overlaps with receiving, so just add the average decompression time per byte of what has been received so far.
+		const double frac = (double)stats.cumulative_compressed_size_at_ob[n - 1] / stats.compressed_size;
+		const double compressed_time = stats.first_chunk_compress_time + stats.cumulative_compressed_size_at_ob[n - 1] / bytes_per_s + stats.decompress_time * frac;
+
+		s += "first " + toString(n) + " obs: " + doubleToStringNSigFigs(uncompressed_time * 1.0e3, 4) + " ms -> " + doubleToStringNSigFigs(compressed_time * 1.0e3, 4) + " ms" + ((i < 2) ? ", " : "");
+	}
+	conPrint(s);
+}
+
+
+// Measures compression of QueryObjectsInAABB responses, as sent to a client joining the world.
+// Uses a copy of a real server state if available in the test repos dir, otherwise a synthetic world.
+static void doQueryResponseCompressionBenchmark()
+{
+	ServerAllWorldsState all_worlds_state;
 	
+	const std::string server_state_path = TestUtils::getTestReposDir() + "/testfiles/server_state/server_state.bin";
+	if(FileUtils::fileExists(server_state_path))
+	{
+		// readFromDisk may write to the file, so work on a copy.
+		const std::string temp_path = PlatformUtils::getTempDirPath() + "/query_response_compression_benchmark_server_state.bin";
+		FileUtils::copyFile(server_state_path, temp_path);
+		all_worlds_state.resource_manager = new ResourceManager(PlatformUtils::getTempDirPath() + "/query_response_compression_benchmark_resources");
+		all_worlds_state.readFromDisk(temp_path);
+		conPrint("Query response compression benchmark: using server state from '" + server_state_path + "'");
+	}
+	else
+	{
+		PCG32 rng(1);
+		Reference<ServerWorldState> world = all_worlds_state.getRootWorldState();
+		Lock lock(world->mutex);
+		for(int i=0; i<20000; ++i)
+			world->addObject(makeSyntheticObject(rng, i));
+		conPrint("Query response compression benchmark: using synthetic world");
+	}
+
+	Reference<ServerWorldState> world = all_worlds_state.getRootWorldState();
+
+	// Build the response for a 1 km AABB around the origin, sorted by distance, like WorkerThread does for QueryObjectsInAABB.
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	std::vector<size_t> uncompressed_size_at_ob;
+	{
+		Lock lock(world->mutex);
+		std::vector<const WorldObject*> obs;
+		const js::AABBox aabb(Vec4f(-500, -500, -500, 1), Vec4f(500, 500, 500, 1));
+		world->ob_grid.getObjectsInAABB(aabb, obs);
+		std::sort(obs.begin(), obs.end(), [](const WorldObject* a, const WorldObject* b) { return a->pos.getDist2(Vec3d(0.0)) < b->pos.getDist2(Vec3d(0.0)); });
+
+		for(size_t i=0; i<obs.size(); ++i)
+		{
+			world->ob_record_cache.appendObjectInitialSendMessage(obs[i], scratch_packet, packet);
+			uncompressed_size_at_ob.push_back(packet.buf.size());
+		}
+	}
+
+	const size_t num_obs = uncompressed_size_at_ob.size();
+	conPrint("    " + toString(num_obs) + " objects, uncompressed response size: " + getNiceByteSize(packet.buf.size()));
+	if(num_obs == 0)
+		return;
+
+	const int levels[] = { 1, CompressedMessages::DEFAULT_COMPRESSION_LEVEL };
+	for(int z=0; z<2; ++z)
+	{
+		CompressedResponseStats stats = compressResponse(packet, num_obs, levels[z]);
+		for(int i=0; i<2; ++i) // Repeat so the timings don't include first-use costs.
+			stats = compressResponse(packet, num_obs, levels[z]);
+
+		const double MB = packet.buf.size() / (1024.0 * 1024.0);
+		conPrint("  zstd level " + toString(levels[z]) + ": compressed size: " + getNiceByteSize(stats.compressed_size) +
+			", ratio: " + doubleToStringNSigFigs((double)packet.buf.size() / stats.compressed_size, 4) +
+			", server compression: " + doubleToStringNSigFigs(stats.compress_time * 1.0e3 / MB, 4) + " ms/MB" +
+			", client decompression: " + doubleToStringNSigFigs(stats.decompress_time * 1.0e3 / MB, 4) + " ms/MB");
+
+		printTimeToObjects(" 2 Mbit/s", 2.0e6, num_obs, uncompressed_size_at_ob, stats);
+		printTimeToObjects("20 Mbit/s", 20.0e6, num_obs, uncompressed_size_at_ob, stats);
+	}
+}
+
+
+void WorkerThreadTests::test()
+{
+	// Performance test
+	if(false)
+		doQueryResponseCompressionBenchmark();
 }
 
 
@@ -32,7 +32,7 @@ static const int parcel_coords[10][4][2] ={
 	{ { 45, 115 },{ 65, 115 },{ 65, 135 },{ 45, 135 } }, // 9
 };
 
-static void makeParcels(Matrix2d M, int& next_id, Reference<ServerWorldState> world_state)
+static void makeParcels(Matrix2d M, int& next_id, Reference<ServerWorldState> world_state) REQUIRES(world_state->mutex)
 {
 	// Add up then right parcels
 	for(int i=0; i<10; ++i)
@@ -59,7 +59,7 @@ static void makeParcels(Matrix2d M, int& next_id, Reference<ServerWorldState> wo
 
 
 static void makeRandomParcel(const Vec2d& region_botleft, const Vec2d& region_topright, PCG32& rng, int& next_id, Reference<ServerWorldState> world_state, Map2DRef road_map,
-	float base_w, float rng_width, float base_h, float rng_h)
+	float base_w, float rng_width, float base_h, float rng_h) REQUIRES(world_state->mutex)
 {
 	for(int i=0; i<100; ++i)
 	{
@@ -154,7 +154,7 @@ static void makeRandomParcel(const Vec2d& region_botleft, const Vec2d& region_to
 
 
 
-static void makeBlock(const Vec2d& botleft, PCG32& rng, int& next_id, Reference<ServerWorldState> world_state, double parcel_w, double parcel_max_z)
+static void makeBlock(const Vec2d& botleft, PCG32& rng, int& next_id, Reference<ServerWorldState> world_state, double parcel_w, double parcel_max_z) REQUIRES(world_state->mutex)
 {
 	// Randomly omit one of the 4 edge blocks
 	const int e = (int)(rng.unitRandom() * 3.9999);
@@ -210,7 +210,7 @@ static void makeBlock(const Vec2d& botleft, PCG32& rng, int& next_id, Reference<
 
 
 #if 0
-static void makeTowerParcels(const Vec2d& botleft, int& next_id, Reference<ServerWorldState> world_state, double parcel_w, double story_height, int num_stories)
+static void makeTowerParcels(const Vec2d& botleft, int& next_id, Reference<ServerWorldState> world_state, double parcel_w, double story_height, int num_stories) REQUIRES(world_state->mutex)
 {
 	for(int i=0; i<num_stories; ++i)
 	{
@@ -240,10 +240,10 @@ static void makeTowerParcels(const Vec2d& botleft, int& next_id, Reference<Serve
 #endif
 
 
-static WorldObjectRef findObWithModelURL(Reference<ServerAllWorldsState> world_state, const std::string& URL)
+static WorldObjectRef findObWithModelURL(ServerWorldState& root_world, const std::string& URL) REQUIRES(root_world.mutex)
 {
 	WorldObjectRef ob;
-	for(auto it = world_state->getRootWorldState()->objects.begin(); it != world_state->getRootWorldState()->objects.end(); ++it)
+	for(auto it = root_world.objects.begin(); it != root_world.objects.end(); ++it)
 	{
 		if(it->second->model_url == URL)
 			ob = it->second;
@@ -256,30 +256,30 @@ static WorldObjectRef findObWithModelURL(Reference<ServerAllWorldsState> world_s
 }
 
 
-static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<ServerAllWorldsState> world_state, PCG32& rng, double parcel_w, double story_height, int num_stories)
+static void makeTowerObjects(const Vec2d& botleft, int& next_id, ServerAllWorldsState& world_state, ServerWorldState& root_world, PCG32& rng, double parcel_w, double story_height, int num_stories) REQUIRES(root_world.mutex)
 {
 	// Find an object using room model to copy from
-	WorldObjectRef room1_ob = findObWithModelURL(world_state, "room1_show_noBeam_glb_5590447676997932357.bmesh");
-	WorldObjectRef room2_ob = findObWithModelURL(world_state, "room2_WindowsFLAT_glb_13600392068904710101.bmesh");
-	WorldObjectRef room3_ob = findObWithModelURL(world_state, "room3_WindowsFLAT_2_glb_12220979663580597788.bmesh");
+	WorldObjectRef room1_ob = findObWithModelURL(root_world, "room1_show_noBeam_glb_5590447676997932357.bmesh");
+	WorldObjectRef room2_ob = findObWithModelURL(root_world, "room2_WindowsFLAT_glb_13600392068904710101.bmesh");
+	WorldObjectRef room3_ob = findObWithModelURL(root_world, "room3_WindowsFLAT_2_glb_12220979663580597788.bmesh");
 
-	WorldObjectRef platform1_ob = findObWithModelURL(world_state, "PlatformFinal_glb_6209101633263662392.bmesh");
-	WorldObjectRef platform2_ob = findObWithModelURL(world_state, "PlatformFinalLEFT_glb_2715111425173727191.bmesh");
+	WorldObjectRef platform1_ob = findObWithModelURL(root_world, "PlatformFinal_glb_6209101633263662392.bmesh");
+	WorldObjectRef platform2_ob = findObWithModelURL(root_world, "PlatformFinalLEFT_glb_2715111425173727191.bmesh");
 
-	WorldObjectRef couch1_ob = findObWithModelURL(world_state, "VoxCouch__Final_grey_glb_3629570434401678297.bmesh");
-	WorldObjectRef couch2_ob = findObWithModelURL(world_state, "Couch_Holz_Grau_glb_10451238764035445915.bmesh");
+	WorldObjectRef couch1_ob = findObWithModelURL(root_world, "VoxCouch__Final_grey_glb_3629570434401678297.bmesh");
+	WorldObjectRef couch2_ob = findObWithModelURL(root_world, "Couch_Holz_Grau_glb_10451238764035445915.bmesh");
 
-	WorldObjectRef seat1_ob = findObWithModelURL(world_state, "grey_Gustav_glb_14897620384736448070.bmesh");
-	WorldObjectRef seat2_ob = findObWithModelURL(world_state, "VoxSeat__Final_grey_glb_6666984473320402552.bmesh");
+	WorldObjectRef seat1_ob = findObWithModelURL(root_world, "grey_Gustav_glb_14897620384736448070.bmesh");
+	WorldObjectRef seat2_ob = findObWithModelURL(root_world, "VoxSeat__Final_grey_glb_6666984473320402552.bmesh");
 
-	WorldObjectRef table1_ob = findObWithModelURL(world_state, "60_tisch_glb_11656912686065707806.bmesh");
-	WorldObjectRef table2_ob = findObWithModelURL(world_state, "couch_table_Geschwungen_glb_3686631209284750062.bmesh");
-	WorldObjectRef table3_ob = findObWithModelURL(world_state, "CouchTisch_Holz_Grau_glb_6583257170939054006.bmesh");
+	WorldObjectRef table1_ob = findObWithModelURL(root_world, "60_tisch_glb_11656912686065707806.bmesh");
+	WorldObjectRef table2_ob = findObWithModelURL(root_world, "couch_table_Geschwungen_glb_3686631209284750062.bmesh");
+	WorldObjectRef table3_ob = findObWithModelURL(root_world, "CouchTisch_Holz_Grau_glb_6583257170939054006.bmesh");
 
-	WorldObjectRef carpet1_ob = findObWithModelURL(world_state, "Carpet_Yellow_2_glb_10610072849682925808.bmesh");
-	WorldObjectRef carpet2_ob = findObWithModelURL(world_state, "Carpet_grey_2_glb_16725751618769902725.bmesh");
+	WorldObjectRef carpet1_ob = findObWithModelURL(root_world, "Carpet_Yellow_2_glb_10610072849682925808.bmesh");
+	WorldObjectRef carpet2_ob = findObWithModelURL(root_world, "Carpet_grey_2_glb_16725751618769902725.bmesh");
 
-	WorldObjectRef lamp_ob = findObWithModelURL(world_state, "Lampe_Kaiser_glb_6366364697719938472.bmesh");
+	WorldObjectRef lamp_ob = findObWithModelURL(root_world, "Lampe_Kaiser_glb_6366364697719938472.bmesh");
 
 	std::vector<WorldObjectRef> room_obs({room1_ob, room2_ob, room3_ob});
 	std::vector<WorldObjectRef> platform_obs({platform1_ob, platform2_ob});
@@ -301,7 +301,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			new_object->created_time = TimeStamp::currentTime();
 			new_object->last_modified_time = TimeStamp::currentTime();
 			new_object->state = WorldObject::State_Alive;
-			new_object->uid = world_state->getNextObjectUID();
+			new_object->uid = world_state.getNextObjectUID();
 			new_object->pos = Vec3d(botleft.x + parcel_w/2, botleft.y + parcel_w/2, floor_z);
 			new_object->angle = Maths::pi_2<float>();
 			new_object->axis = Vec3f(1,0,0);
@@ -315,8 +315,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
-			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
+			root_world.addObject(new_object); // Insert into world
+			root_world.addWorldObjectAsDBDirty(new_object);
 		}
 
 
@@ -338,7 +338,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			new_object->created_time = TimeStamp::currentTime();
 			new_object->last_modified_time = TimeStamp::currentTime();
 			new_object->state = WorldObject::State_Alive;
-			new_object->uid = world_state->getNextObjectUID();
+			new_object->uid = world_state.getNextObjectUID();
 			new_object->pos = Vec3d(botleft.x + parcel_w/2, botleft.y + parcel_w/2, floor_z);
 			new_object->angle = angle;
 			new_object->axis = Vec3f(axis);
@@ -352,8 +352,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
-			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
+			root_world.addObject(new_object); // Insert into world
+			root_world.addWorldObjectAsDBDirty(new_object);
 		}
 
 		// Make couches etc..
@@ -387,7 +387,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			new_object->created_time = TimeStamp::currentTime();
 			new_object->last_modified_time = TimeStamp::currentTime();
 			new_object->state = WorldObject::State_Alive;
-			new_object->uid = world_state->getNextObjectUID();
+			new_object->uid = world_state.getNextObjectUID();
 			new_object->pos = Vec3d(table_pos.x, table_pos.y, floor_z);
 			new_object->angle = angle;
 			new_object->axis = Vec3f(axis);
@@ -401,8 +401,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
-			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
+			root_world.addObject(new_object); // Insert into world
+			root_world.addWorldObjectAsDBDirty(new_object);
 		}
 
 		// Add carpet
@@ -423,7 +423,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			new_object->created_time = TimeStamp::currentTime();
 			new_object->last_modified_time = TimeStamp::currentTime();
 			new_object->state = WorldObject::State_Alive;
-			new_object->uid = world_state->getNextObjectUID();
+			new_object->uid = world_state.getNextObjectUID();
 			new_object->pos = Vec3d(carpet_pos.x, carpet_pos.y, floor_z);
 			new_object->angle = angle;
 			new_object->axis = Vec3f(axis);
@@ -437,8 +437,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
-			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
+			root_world.addObject(new_object); // Insert into world
+			root_world.addWorldObjectAsDBDirty(new_object);
 		}
 
 		// Add couch 1
@@ -460,7 +460,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			new_object->created_time = TimeStamp::currentTime();
 			new_object->last_modified_time = TimeStamp::currentTime();
 			new_object->state = WorldObject::State_Alive;
-			new_object->uid = world_state->getNextObjectUID();
+			new_object->uid = world_state.getNextObjectUID();
 			new_object->pos = Vec3d(couch_pos.x, couch_pos.y, floor_z);
 			new_object->angle = angle;
 			new_object->axis = Vec3f(axis);
@@ -474,8 +474,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
-			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
+			root_world.addObject(new_object); // Insert into world
+			root_world.addWorldObjectAsDBDirty(new_object);
 		}
 
 		// Add seat
@@ -499,7 +499,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			new_object->created_time = TimeStamp::currentTime();
 			new_object->last_modified_time = TimeStamp::currentTime();
 			new_object->state = WorldObject::State_Alive;
-			new_object->uid = world_state->getNextObjectUID();
+			new_object->uid = world_state.getNextObjectUID();
 			new_object->pos = Vec3d(couch_pos.x, couch_pos.y, floor_z);
 			new_object->angle = angle;
 			new_object->axis = Vec3f(axis);
@@ -513,8 +513,8 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
-			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
+			root_world.addObject(new_object); // Insert into world
+			root_world.addWorldObjectAsDBDirty(new_object);
 		}
 
 		// Add lamp
@@ -539,7 +539,7 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			new_object->created_time = TimeStamp::currentTime();
 			new_object->last_modified_time = TimeStamp::currentTime();
 			new_object->state = WorldObject::State_Alive;
-			new_object->uid = world_state->getNextObjectUID();
+			new_object->uid = world_state.getNextObjectUID();
 			new_object->pos = Vec3d(lamp_pos.x, lamp_pos.y, floor_z);
 			new_object->angle = angle;
 			new_object->axis = Vec3f(axis);
@@ -553,14 +553,14 @@ static void makeTowerObjects(const Vec2d& botleft, int& next_id, Reference<Serve
 			for(size_t z=0; z<new_object->materials.size(); ++z)
 				new_object->materials[z] = source_ob->materials[z]->clone();
 
-			world_state->getRootWorldState()->objects[new_object->uid] = new_object; // Insert into world
-			world_state->getRootWorldState()->addWorldObjectAsDBDirty(new_object);
+			root_world.addObject(new_object); // Insert into world
+			root_world.addWorldObjectAsDBDirty(new_object);
 		}
 	}
 }
 
 
-static void makeRoad(ServerAllWorldsState& world_state, const Vec3d& pos, const Vec3f& scale, float rotation_angle)
+static void makeRoad(ServerAllWorldsState& world_state, ServerWorldState& root_world, const Vec3d& pos, const Vec3f& scale, float rotation_angle) REQUIRES(root_world.mutex)
 {
 	WorldObjectRef test_object = new WorldObject();
 	test_object->creator_id = UserID(0);
@@ -578,7 +578,7 @@ static void makeRoad(ServerAllWorldsState& world_state, const Vec3d& pos, const
 	test_object->materials[0]->tex_matrix = Matrix2f(scale.x / 10.f, 0, 0, scale.y / 10.f);
 	test_object->materials[0]->colour_texture_url = "stone_floor_jpg_6978110256346892991.jpg";
 
-	world_state.getRootWorldState()->objects[test_object->uid] = test_object;
+	root_world.addObject(test_object);
 }
 
 
@@ -604,6 +604,7 @@ static void updateToUseImageCubeMeshes(ServerAllWorldsState& all_worlds_state)
 		for(auto world_it = all_worlds_state.world_states.begin(); world_it != all_worlds_state.world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			Lock world_lock(world_state->mutex);
 
 			for(auto i = world_state->objects.begin(); i != world_state->objects.end(); ++i)
 			{
@@ -659,6 +660,7 @@ void WorldCreation::removeHypercardMaterials(ServerAllWorldsState& all_worlds_st
 		for(auto world_it = all_worlds_state.world_states.begin(); world_it != all_worlds_state.world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			Lock world_lock(world_state->mutex);
 
 			for(auto i = world_state->objects.begin(); i != world_state->objects.end(); ++i)
 			{
@@ -683,20 +685,23 @@ void WorldCreation::removeHypercardMaterials(ServerAllWorldsState& all_worlds_st
 
 void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_state)
 {
+	Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+	Lock lock(root_world->mutex);
+
 	// Add 'town square' parcels
-	if(world_state->getRootWorldState()->parcels.empty())
+	if(root_world->parcels.empty())
 	{
 		conPrint("Adding some parcels!");
 
 		int next_id = 10;
-		makeParcels(Matrix2d(1, 0, 0, 1), next_id, world_state->getRootWorldState());
-		makeParcels(Matrix2d(-1, 0, 0, 1), next_id, world_state->getRootWorldState()); // Mirror in y axis (x' = -x)
-		makeParcels(Matrix2d(0, 1, 1, 0), next_id, world_state->getRootWorldState()); // Mirror in x=y line(x' = y, y' = x)
-		makeParcels(Matrix2d(0, 1, -1, 0), next_id, world_state->getRootWorldState()); // Rotate right 90 degrees (x' = y, y' = -x)
-		makeParcels(Matrix2d(1, 0, 0, -1), next_id, world_state->getRootWorldState()); // Mirror in x axis (y' = -y)
-		makeParcels(Matrix2d(-1, 0, 0, -1), next_id, world_state->getRootWorldState()); // Rotate 180 degrees (x' = -x, y' = -y)
-		makeParcels(Matrix2d(0, -1, -1, 0), next_id, world_state->getRootWorldState()); // Mirror in x=-y line (x' = -y, y' = -x)
-		makeParcels(Matrix2d(0, -1, 1, 0), next_id, world_state->getRootWorldState()); // Rotate left 90 degrees (x' = -y, y' = x)
+		makeParcels(Matrix2d(1, 0, 0, 1), next_id, root_world);
+		makeParcels(Matrix2d(-1, 0, 0, 1), next_id, root_world); // Mirror in y axis (x' = -x)
+		makeParcels(Matrix2d(0, 1, 1, 0), next_id, root_world); // Mirror in x=y line(x' = y, y' = x)
+		makeParcels(Matrix2d(0, 1, -1, 0), next_id, root_world); // Rotate right 90 degrees (x' = y, y' = -x)
+		makeParcels(Matrix2d(1, 0, 0, -1), next_id, root_world); // Mirror in x axis (y' = -y)
+		makeParcels(Matrix2d(-1, 0, 0, -1), next_id, root_world); // Rotate 180 degrees (x' = -x, y' = -y)
+		makeParcels(Matrix2d(0, -1, -1, 0), next_id, root_world); // Mirror in x=-y line (x' = -y, y' = -x)
+		makeParcels(Matrix2d(0, -1, 1, 0), next_id, root_world); // Rotate left 90 degrees (x' = -y, y' = x)
 
 		PCG32 rng(1);
 		const int D = 4;
@@ -709,14 +714,14 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 					// Special town square blocks
 				}
 				else
-					makeBlock(Vec2d(5 + x*70, 5 + y*70), rng, next_id, world_state->getRootWorldState(), /*parcel_w=*/20, /*parcel_max_z=*/10);
+					makeBlock(Vec2d(5 + x*70, 5 + y*70), rng, next_id, root_world, /*parcel_w=*/20, /*parcel_max_z=*/10);
 			}
 	}
 
 	// TEMP: make all parcels have zmax = 10
 	if(false)
 	{
-		for(auto i = world_state->getRootWorldState()->parcels.begin(); i != world_state->getRootWorldState()->parcels.end(); ++i)
+		for(auto i = root_world->parcels.begin(); i != root_world->parcels.end(); ++i)
 		{
 			ParcelRef parcel = i->second;
 			parcel->zbounds.y = 10.0f;
@@ -726,8 +731,8 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 	/*
 	// Make parcel with id 20 a 'sandbox', world-writeable parcel
 	{
-		auto res = world_state->getRootWorldState()->parcels.find(ParcelID(20));
-		if(res != world_state->getRootWorldState()->parcels.end())
+		auto res = root_world->parcels.find(ParcelID(20));
+		if(res != root_world->parcels.end())
 		{
 			res->second->all_writeable = true;
 			conPrint("Made parcel 20 all-writeable.");
@@ -738,7 +743,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 	//server.world_state->objects.clear();
 
 	ParcelID max_parcel_id(0);
-	for(auto it = world_state->getRootWorldState()->parcels.begin(); it != world_state->getRootWorldState()->parcels.end(); ++it)
+	for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
 	{
 		const Parcel* parcel = it->second.ptr();
 		max_parcel_id = myMax(max_parcel_id, parcel->id);
@@ -767,16 +772,16 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 
 			parcel->build();
 
-			world_state->getRootWorldState()->parcels[parcel_id] = parcel;
+			root_world->parcels[parcel_id] = parcel;
 		}
 	}
 
 
 	// Delete parcels newer than id 429.
-	/*for(auto it = world_state->getRootWorldState()->parcels.begin(); it != world_state->getRootWorldState()->parcels.end();)
+	/*for(auto it = root_world->parcels.begin(); it != root_world->parcels.end();)
 	{
 		if(it->first.value() > 429)
-			it = world_state->getRootWorldState()->parcels.erase(it);
+			it = root_world->parcels.erase(it);
 		else
 			it++;
 	}*/
@@ -784,7 +789,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 
 	// Recompute max_parcel_id
 	max_parcel_id = ParcelID(0);
-	for(auto it = world_state->getRootWorldState()->parcels.begin(); it != world_state->getRootWorldState()->parcels.end(); ++it)
+	for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
 	{
 		const Parcel* parcel = it->second.ptr();
 		max_parcel_id = myMax(max_parcel_id, parcel->id);
@@ -809,7 +814,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 #endif
 
 			for(int i=0; i<300; ++i)
-				makeRandomParcel(/*region botleft=*/Vec2d(335.f, 75), /*region topright=*/Vec2d(335.f + 130.f, 205.f), rng, next_id, world_state->getRootWorldState(), road_map,
+				makeRandomParcel(/*region botleft=*/Vec2d(335.f, 75), /*region topright=*/Vec2d(335.f + 130.f, 205.f), rng, next_id, root_world, road_map,
 					/*base width=*/3, /*rng width=*/4, /*base_h=*/4, /*rng_h=*/4);
 
 			conPrint("Made market district, parcel ids " + toString(start_id) + " to " + toString(next_id - 1));
@@ -828,7 +833,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 					for(int i=0; i<100; ++i)
 					{
 						const Vec2d botleft = Vec2d(335.f, -275) + offset;
-						makeRandomParcel(/*region botleft=*/botleft, /*region topright=*/botleft + Vec2d(60, 60), rng, next_id, world_state->getRootWorldState(), NULL/*road_map*/,
+						makeRandomParcel(/*region botleft=*/botleft, /*region topright=*/botleft + Vec2d(60, 60), rng, next_id, root_world, NULL/*road_map*/,
 							/*base width=*/8, /*rng width=*/40, /*base_h=*/8, /*rng_h=*/20);
 					}
 				}
@@ -858,8 +863,8 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 
 			parcel->build();
 
-			world_state->getRootWorldState()->parcels[parcel_id] = parcel;
-			world_state->getRootWorldState()->addParcelAsDBDirty(parcel);
+			root_world->parcels[parcel_id] = parcel;
+			root_world->addParcelAsDBDirty(parcel);
 		}
 		{
 			const ParcelID parcel_id(955);
@@ -879,8 +884,8 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 
 			parcel->build();
 
-			world_state->getRootWorldState()->parcels[parcel_id] = parcel;
-			world_state->getRootWorldState()->addParcelAsDBDirty(parcel);
+			root_world->parcels[parcel_id] = parcel;
+			root_world->addParcelAsDBDirty(parcel);
 		}
 	}
 
@@ -922,7 +927,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 					// Make empty space for park/square
 				}
 				else
-					makeBlock(/*botleft=*/Vec2d(-275 + x * block_width, 335 + y * block_width), rng, next_id, world_state->getRootWorldState(), /*parcel_w=*/parcel_width,
+					makeBlock(/*botleft=*/Vec2d(-275 + x * block_width, 335 + y * block_width), rng, next_id, root_world, /*parcel_w=*/parcel_width,
 						/*parcel_max_z=*/15 + rng.unitRandom() * 8);
 			}
 
@@ -932,40 +937,40 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 
 	
 	// TEMP: Delete parcels newer than id 1221.
-	/*for(auto it = world_state->getRootWorldState()->parcels.begin(); it != world_state->getRootWorldState()->parcels.end();)
+	/*for(auto it = root_world->parcels.begin(); it != root_world->parcels.end();)
 	{
 		if(it->first.value() > 1221)
-			it = world_state->getRootWorldState()->parcels.erase(it);
+			it = root_world->parcels.erase(it);
 		else
 			it++;
 	}
 
 	// TEMP: Recompute max_parcel_id
 	max_parcel_id = ParcelID(0);
-	for(auto it = world_state->getRootWorldState()->parcels.begin(); it != world_state->getRootWorldState()->parcels.end(); ++it)
+	for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
 	{
 		const Parcel* parcel = it->second.ptr();
 		max_parcel_id = myMax(max_parcel_id, parcel->id);
 	}
 
 	// TEMP: remove any objects with 'tower' content
-	for(auto it = world_state->getRootWorldState()->objects.begin(); it != world_state->getRootWorldState()->objects.end(); ++it)
+	for(auto it = root_world->objects.begin(); it != root_world->objects.end(); ++it)
 	{
 		if(it->second->content == "tower" || it->second->content == "tower prefab" || it->second->content == "tower platform" || it->second->content == "tower furniture")
-			it = world_state->getRootWorldState()->objects.erase(it);
+			it = root_world->objects.erase(it);
 		else
 			it++;
 	}
 
 	// TEMP: remove any objects with 'tower' content
-	for(auto it = world_state->getRootWorldState()->objects.begin(); it != world_state->getRootWorldState()->objects.end(); ++it)
+	for(auto it = root_world->objects.begin(); it != root_world->objects.end(); ++it)
 	{
 		WorldObject* ob = it->second.ptr();
 		if(ob->content == "tower" || ob->content == "tower prefab" || ob->content == "tower platform" || ob->content == "tower furniture")
 		{
 			ob->state = WorldObject::State_Dead;
 			ob->from_remote_other_dirty = true;
-			world_state->getRootWorldState()->dirty_from_remote_objects.insert(ob);
+			root_world->dirty_from_remote_objects.insert(ob);
 		}
 	}*/
 	
@@ -1004,20 +1009,20 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 			//			// Make empty space for park/square or tower
 			//		}
 			//		else
-			//			makeBlock(/*botleft=*/Vec2d(335 + x * block_width, 335 + y * block_width), rng, next_id, world_state->getRootWorldState(), /*parcel_w=*/parcel_width,
+			//			makeBlock(/*botleft=*/Vec2d(335 + x * block_width, 335 + y * block_width), rng, next_id, root_world, /*parcel_w=*/parcel_width,
 			//				/*parcel_max_z=*/18 /*+ rng.unitRandom() * 8*/);
 			//	}
 
 			const double padding = 0.3;
 			const double tower_parcel_w = 14 + padding * 2; // Large enough to hold the story 3d models
-			//makeTowerParcels(/*botleft=*/Vec2d(335 + 3 * block_width + parcel_width - padding, 335 + 2 * block_width + parcel_width - padding), next_id, world_state->getRootWorldState(), /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/24);
-			makeTowerObjects(/*botleft=*/Vec2d(335 + 3 * block_width + parcel_width - padding, 335 + 2 * block_width + parcel_width - padding), next_id, world_state, rng, /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/24);
+			//makeTowerParcels(/*botleft=*/Vec2d(335 + 3 * block_width + parcel_width - padding, 335 + 2 * block_width + parcel_width - padding), next_id, root_world, /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/24);
+			makeTowerObjects(/*botleft=*/Vec2d(335 + 3 * block_width + parcel_width - padding, 335 + 2 * block_width + parcel_width - padding), next_id, *world_state, *root_world, rng, /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/24);
 
-			//makeTowerParcels(/*botleft=*/Vec2d(335 + 1 * block_width + parcel_width - padding, 335 + 2 * block_width + parcel_width - padding), next_id, world_state->getRootWorldState(), /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/22);
-			makeTowerObjects(/*botleft=*/Vec2d(335 + 1 * block_width + parcel_width - padding, 335 + 2 * block_width + parcel_width - padding), next_id, world_state, rng, /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/22);
+			//makeTowerParcels(/*botleft=*/Vec2d(335 + 1 * block_width + parcel_width - padding, 335 + 2 * block_width + parcel_width - padding), next_id, root_world, /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/22);
+			makeTowerObjects(/*botleft=*/Vec2d(335 + 1 * block_width + parcel_width - padding, 335 + 2 * block_width + parcel_width - padding), next_id, *world_state, *root_world, rng, /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/22);
 
-			//makeTowerParcels(/*botleft=*/Vec2d(335 + 2 * block_width + parcel_width - padding, 335 + 0 * block_width + parcel_width - padding), next_id, world_state->getRootWorldState(), /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/20);
-			makeTowerObjects(/*botleft=*/Vec2d(335 + 2 * block_width + parcel_width - padding, 335 + 0 * block_width + parcel_width - padding), next_id, world_state, rng, /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/20);
+			//makeTowerParcels(/*botleft=*/Vec2d(335 + 2 * block_width + parcel_width - padding, 335 + 0 * block_width + parcel_width - padding), next_id, root_world, /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/20);
+			makeTowerObjects(/*botleft=*/Vec2d(335 + 2 * block_width + parcel_width - padding, 335 + 0 * block_width + parcel_width - padding), next_id, *world_state, *root_world, rng, /*parcel_w=*/tower_parcel_w, /*story height=*/9.0, /*num stories=*/20);
 
 			world_state->markAsChanged();
 			//conPrint("Num parcels added: " + toString(next_id - initial_next_id));
@@ -1035,7 +1040,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 	if(false)
 	{
 		bool have_added_roads = false;
-		for(auto it = world_state->getRootWorldState()->objects.begin(); it != world_state->getRootWorldState()->objects.end(); ++it)
+		for(auto it = root_world->objects.begin(); it != root_world->objects.end(); ++it)
 		{
 			const WorldObject* object = it->second.ptr();
 			if(object->creator_id.value() == 0 && object->content == "road")
@@ -1048,10 +1053,13 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 		if(false)
 		{
 			// Remove all existing road objects (UID > 1000000)
-			for(auto it = world_state->getRootWorldState()->objects.begin(); it != world_state->getRootWorldState()->objects.end();)
+			for(auto it = root_world->objects.begin(); it != root_world->objects.end();)
 			{
 				if(it->second->uid.value() >= 1000000)
-					it = world_state->getRootWorldState()->objects.erase(it);
+				{
+					root_world->ob_grid.remove(it->second);
+					it = root_world->objects.erase(it);
+				}
 				else
 					++it;
 			}
@@ -1069,7 +1077,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 			{
 				if(x != 0)
 				{
-					makeRoad(*world_state,
+					makeRoad(*world_state, *root_world,
 						Vec3d(x * 92.5, 0, 0), // pos
 						Vec3f(87, 8, z_scale), // scale
 						0 // rot angle
@@ -1081,7 +1089,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 			{
 				if(y != 0)
 				{
-					makeRoad(*world_state,
+					makeRoad(*world_state, *root_world,
 						Vec3d(0, y * 92.5, 0), // pos
 						Vec3f(8, 87, z_scale), // scale
 						0 // rot angle
@@ -1092,25 +1100,25 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 			// Diagonal roads
 			{
 				const float diag_z_scale = z_scale / 2; // to avoid z-fighting
-				makeRoad(*world_state,
+				makeRoad(*world_state, *root_world,
 					Vec3d(57.5, 57.5, 0), // pos
 					Vec3f(30, 6, diag_z_scale), // scale
 					Maths::pi<float>() / 4 // rot angle
 				);
 
-				makeRoad(*world_state,
+				makeRoad(*world_state, *root_world,
 					Vec3d(57.5, -57.5, 0), // pos
 					Vec3f(30, 6, diag_z_scale), // scale
 					-Maths::pi<float>() / 4 // rot angle
 				);
 
-				makeRoad(*world_state,
+				makeRoad(*world_state, *root_world,
 					Vec3d(-57.5, 57.5, 0), // pos
 					Vec3f(30, 6, diag_z_scale), // scale
 					Maths::pi<float>() * 3 / 4 // rot angle
 				);
 
-				makeRoad(*world_state,
+				makeRoad(*world_state, *root_world,
 					Vec3d(-57.5, -57.5, 0), // pos
 					Vec3f(30, 6, diag_z_scale), // scale
 					-Maths::pi<float>() * 3 / 4 // rot angle
@@ -1128,7 +1136,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 
 					if(!near_centre && !long_roads)
 					{
-						makeRoad(*world_state,
+						makeRoad(*world_state, *root_world,
 							Vec3d(35 + x * 70, y * 70.0, 0), // pos
 							Vec3f(62, 8, z_scale), // scale
 							0 // rot angle
@@ -1146,7 +1154,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 
 					if(!near_centre && !long_roads)
 					{
-						makeRoad(*world_state,
+						makeRoad(*world_state, *root_world,
 							Vec3d(x * 70.0, 35 + y * 70, 0), // pos
 							Vec3f(8, 62, z_scale), // scale
 							0 // rot angle
@@ -1162,7 +1170,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 
 					if(!near_centre)
 					{
-						makeRoad(*world_state,
+						makeRoad(*world_state, *root_world,
 							Vec3d(x * 70.0, y * 70, 0), // pos
 							Vec3f(8, 8, z_scale), // scale
 							0 // rot angle
@@ -1176,7 +1184,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 				{
 					if(x != 0 && y != 0)
 					{
-						makeRoad(*world_state,
+						makeRoad(*world_state, *root_world,
 							Vec3d(x * 70.0, y * 70, 0), // pos
 							Vec3f(8, 8, z_scale), // scale
 							0 // rot angle
@@ -1190,7 +1198,7 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 				{
 					if(x != 0 && y != 0)
 					{
-						makeRoad(*world_state,
+						makeRoad(*world_state, *root_world,
 							Vec3d(x * 45, y * 45, 0), // pos
 							Vec3f(8, 8, z_scale), // scale
 							0 // rot angle
@@ -1199,22 +1207,22 @@ void WorldCreation::createParcelsAndRoads(Reference<ServerAllWorldsState> world_
 				}
 
 			// Centre roads
-			makeRoad(*world_state,
+			makeRoad(*world_state, *root_world,
 				Vec3d(0, 45, 0), // pos
 				Vec3f(82, 8, z_scale), // scale
 				0 // rot angle
 			);
-			makeRoad(*world_state,
+			makeRoad(*world_state, *root_world,
 				Vec3d(0, -45, 0), // pos
 				Vec3f(82, 8, z_scale), // scale
 				0 // rot angle
 			);
-			makeRoad(*world_state,
+			makeRoad(*world_state, *root_world,
 				Vec3d(45, 0, 0), // pos
 				Vec3f(8, 82, z_scale), // scale
 				0 // rot angle
 			);
-			makeRoad(*world_state,
+			makeRoad(*world_state, *root_world,
 				Vec3d(-45, 0, 0), // pos
 				Vec3f(8, 82, z_scale), // scale
 				0 // rot angle
@@ -1266,7 +1274,14 @@ void WorldCreation::createPhysicsTest(ServerAllWorldsState& all_worlds_state)
 		test_object->materials[0]->colour_texture_url = "stone_floor_jpg_6978110256346892991.jpg";
 
 		//all_worlds_state.getRootWorldState()->objects[test_object->uid] = test_object;
-		all_worlds_state.getRootWorldState()->objects.erase(test_object->uid);
+		{
+			Reference<ServerWorldState> root_world = all_worlds_state.getRootWorldState();
+			Lock lock(root_world->mutex);
+
+			auto res = root_world->objects.find(test_object->uid);
+			if(res != root_world->objects.end())
+				root_world->removeObject(res->second);
+		}
 		//all_worlds_state.getRootWorldState()->addWorldObjectAsDBDirty(test_object);
 
 
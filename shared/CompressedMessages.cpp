@@ -0,0 +1,320 @@
+/*=====================================================================
+CompressedMessages.cpp
+----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "CompressedMessages.h"
+
+
+#include "MessageUtils.h"
+#include "Protocol.h"
+#include <utils/SocketBufferOutStream.h>
+#include <utils/BufferInStream.h>
+#include <utils/Exception.h>
+#include <utils/StringUtils.h>
+#include <zstd.h>
+#include <cstring>
+
+
+namespace CompressedMessages
+{
+
+
+static const size_t HEADER_SIZE = sizeof(uint32) * 2;
+
+
+static inline uint32 readMessageLength(const uint8* messages, size_t messages_size, size_t offset)
+{
+	if(messages_size - offset < HEADER_SIZE)
+		throw glare::Exception("CompressedMessages: truncated message header");
+
+	uint32 len;
+	std::memcpy(&len, messages + offset + sizeof(uint32), sizeof(uint32));
+	if(len < HEADER_SIZE || len > MAX_MESSAGE_SIZE || len > messages_size - offset)
+		throw glare::Exception("CompressedMessages: invalid message length: " + toString(len));
+	return len;
+}
+
+
+size_t findChunkEnd(const uint8* messages, size_t messages_size, size_t begin, size_t max_chunk_size)
+{
+	size_t end = begin;
+	while(end < messages_size)
+	{
+		const uint32 len = readMessageLength(messages, messages_size, end);
+		if((end > begin) && (end - begin + len > max_chunk_size))
+			break;
+		end += len;
+	}
+	return end;
+}
+
+
+void appendCompressedMessage(const uint8* messages, size_t messages_size, int compression_level, SocketBufferOutStream& packet_out)
+{
+	const size_t msg_begin = packet_out.buf.size();
+	const size_t bound = ZSTD_compressBound(messages_size);
+	packet_out.buf.resize(msg_begin + HEADER_SIZE + bound);
+
+	const size_t compressed_size = ZSTD_compress(&packet_out.buf[msg_begin + HEADER_SIZE], bound, messages, messages_size, compression_level);
+	if(ZSTD_isError(compressed_size) || (HEADER_SIZE + compressed_size >= messages_size))
+	{
+		// Compression failed or didn't help, just send the messages uncompressed.
+		packet_out.buf.resize(msg_begin);
+		packet_out.writeData(messages, messages_size);
+		return;
+	}
+
+	packet_out.buf.resize(msg_begin + HEADER_SIZE + compressed_size);
+
+	const uint32 msg_type = Protocol::CompressedMessages;
+	const uint32 msg_len = (uint32)(HEADER_SIZE + compressed_size);
+	std::memcpy(&packet_out.buf[msg_begin], &msg_type, sizeof(uint32));
+	std::memcpy(&packet_out.buf[msg_begin + sizeof(uint32)], &msg_len, sizeof(uint32));
+}
+
+
+void decompressMessages(BufferInStream& msg_buffer, js::Vector<uint8, 16>& decompressed_out)
+{
+	const size_t compressed_size = msg_buffer.buf.size() - msg_buffer.read_index;
+	const uint8* compressed_data = msg_buffer.buf.data() + msg_buffer.read_index;
+
+	const uint64 decompressed_size = ZSTD_getFrameContentSize(compressed_data, compressed_size);
+	if(decompressed_size == ZSTD_CONTENTSIZE_UNKNOWN || decompressed_size == ZSTD_CONTENTSIZE_ERROR)
+		throw glare::Exception("CompressedMessages: failed to get decompressed size");
+	if(decompressed_size > MAX_DECOMPRESSED_SIZE)
+		throw glare::Exception("CompressedMessages: decompressed size too large: " + toString(decompressed_size));
+
+	decompressed_out.resizeNoCopy(decompressed_size);
+
+	const size_t res = ZSTD_decompress(decompressed_out.data(), decompressed_size, compressed_data, compressed_size);
+	if(ZSTD_isError(res))
+		throw glare::Exception("CompressedMessages: decompression failed: " + std::string(ZSTD_getErrorName(res)));
+	if(res != decompressed_size)
+		throw glare::Exception("CompressedMessages: decompression failed: not enough bytes in result");
+
+	msg_buffer.read_index = msg_buffer.buf.size();
+}
+
+
+uint32 readNextMessage(const js::Vector<uint8, 16>& decompressed, size_t& offset, BufferInStream& msg_buffer_out)
+{
+	const uint32 len = readMessageLength(decompressed.data(), decompressed.size(), offset);
+
+	uint32 msg_type;
+	std::memcpy(&msg_type, &decompressed[offset], sizeof(uint32));
+	if(msg_type == Protocol::CompressedMessages)
+		throw glare::Exception("CompressedMessages: nested compressed message");
+
+	msg_buffer_out.buf.resizeNoCopy(len);
+	std::memcpy(msg_buffer_out.buf.data(), &decompressed[offset], len);
+	msg_buffer_out.read_index = HEADER_SIZE;
+
+	offset += len;
+	return msg_type;
+}
+
+
+} // end namespace CompressedMessages
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+#include <vector>
+
+
+static void appendTestMessage(SocketBufferOutStream& packet, SocketBufferOutStream& scratch_packet, uint32 msg_type, const std::string& payload)
+{
+	MessageUtils::initPacket(scratch_packet, msg_type);
+	scratch_packet.writeStringLengthFirst(payload);
+	MessageUtils::updatePacketLengthField(scratch_packet);
+	packet.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+}
+
+
+// Decompresses and checks that the messages read back from the compressed packet are the same as the original messages.
+static void checkRoundTrip(const SocketBufferOutStream& messages, const SocketBufferOutStream& compressed_packet)
+{
+	std::vector<uint8> read_messages;
+	BufferInStream outer_buffer;
+	BufferInStream msg_buffer;
+	js::Vector<uint8, 16> decompressed;
+
+	size_t offset = 0;
+	while(offset < compressed_packet.buf.size())
+	{
+		uint32 msg_len;
+		std::memcpy(&msg_len, &compressed_packet.buf[offset + 4], 4);
+		outer_buffer.buf.resize(msg_len);
+		std::memcpy(outer_buffer.buf.data(), &compressed_packet.buf[offset], msg_len);
+		outer_buffer.read_index = sizeof(uint32) * 2;
+
+		uint32 msg_type;
+		std::memcpy(&msg_type, outer_buffer.buf.data(), 4);
+		if(msg_type == Protocol::CompressedMessages)
+		{
+			CompressedMessages::decompressMessages(outer_buffer, decompressed);
+			size_t decompressed_offset = 0;
+			while(decompressed_offset < decompressed.size())
+			{
+				CompressedMessages::readNextMessage(decompressed, decompressed_offset, msg_buffer);
+				read_messages.insert(read_messages.end(), msg_buffer.buf.begin(), msg_buffer.buf.end());
+			}
+		}
+		else
+			read_messages.insert(read_messages.end(), outer_buffer.buf.begin(), outer_buffer.buf.end());
+
+		offset += msg_len;
+	}
+
+	testAssert(read_messages.size() == messages.buf.size());
+	testAssert(std::memcmp(read_messages.data(), messages.buf.data(), messages.buf.size()) == 0);
+}
+
+
+static void compressInChunks(const SocketBufferOutStream& messages, int compression_level, SocketBufferOutStream& compressed_packet_out, size_t& num_chunks_out)
+{
+	compressed_packet_out.buf.clear();
+	num_chunks_out = 0;
+	size_t begin = 0;
+	while(begin < messages.buf.size())
+	{
+		const size_t end = CompressedMessages::findChunkEnd(messages.buf.data(), messages.buf.size(), begin,
+			(begin == 0) ? CompressedMessages::FIRST_CHUNK_MAX_SIZE : CompressedMessages::CHUNK_MAX_SIZE);
+		testAssert(end > begin);
+		CompressedMessages::appendCompressedMessage(messages.buf.data() + begin, end - begin, compression_level, compressed_packet_out);
+		begin = end;
+		num_chunks_out++;
+	}
+}
+
+
+static void testDecompressFails(const SocketBufferOutStream& packet)
+{
+	try
+	{
+		BufferInStream msg_buffer;
+		msg_buffer.buf.resize(packet.buf.size());
+		std::memcpy(msg_buffer.buf.data(), packet.buf.data(), packet.buf.size());
+		msg_buffer.read_index = sizeof(uint32) * 2;
+
+		js::Vector<uint8, 16> decompressed;
+		CompressedMessages::decompressMessages(msg_buffer, decompressed);
+		size_t offset = 0;
+		while(offset < decompressed.size())
+			CompressedMessages::readNextMessage(decompressed, offset, msg_buffer);
+		failTest("Expected exception");
+	}
+	catch(glare::Exception&)
+	{}
+}
+
+
+void CompressedMessages::test()
+{
+	conPrint("CompressedMessages::test()");
+
+	PCG32 rng(1);
+	SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+
+	//-------------------- Test round trip of repetitive messages, like ObjectInitialSend messages --------------------
+	{
+		SocketBufferOutStream messages(SocketBufferOutStream::DontUseNetworkByteOrder);
+		for(int i=0; i<5000; ++i)
+			appendTestMessage(messages, scratch_packet, Protocol::ObjectInitialSend, "some_model_" + toString(i % 100) + "_glb_12345678901234567890.bmesh");
+		appendTestMessage(messages, scratch_packet, Protocol::AllObjectsSent, "");
+
+		SocketBufferOutStream compressed_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		size_t num_chunks;
+		compressInChunks(messages, /*compression level=*/3, compressed_packet, num_chunks);
+		testAssert(num_chunks > 1);
+		testAssert(compressed_packet.buf.size() < messages.buf.size() / 4);
+
+		checkRoundTrip(messages, compressed_packet);
+
+		// The first chunk should be limited to FIRST_CHUNK_MAX_SIZE.
+		const size_t first_end = findChunkEnd(messages.buf.data(), messages.buf.size(), 0, FIRST_CHUNK_MAX_SIZE);
+		testAssert(first_end <= FIRST_CHUNK_MAX_SIZE && first_end > FIRST_CHUNK_MAX_SIZE - 100);
+	}
+
+	//-------------------- Test a single message larger than the max chunk size goes in its own chunk --------------------
+	{
+		SocketBufferOutStream messages(SocketBufferOutStream::DontUseNetworkByteOrder);
+		appendTestMessage(messages, scratch_packet, Protocol::ObjectInitialSend, "a");
+		appendTestMessage(messages, scratch_packet, Protocol::ObjectInitialSend, std::string(CHUNK_MAX_SIZE + 100, 'b'));
+		appendTestMessage(messages, scratch_packet, Protocol::ObjectInitialSend, "c");
+
+		const size_t end_0 = findChunkEnd(messages.buf.data(), messages.buf.size(), 0, CHUNK_MAX_SIZE);
+		const size_t end_1 = findChunkEnd(messages.buf.data(), messages.buf.size(), end_0, CHUNK_MAX_SIZE);
+		const size_t end_2 = findChunkEnd(messages.buf.data(), messages.buf.size(), end_1, CHUNK_MAX_SIZE);
+		testAssert(end_0 < end_1 && end_1 < end_2 && end_2 == messages.buf.size());
+		testAssert(end_1 - end_0 > CHUNK_MAX_SIZE);
+
+		SocketBufferOutStream compressed_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		size_t num_chunks;
+		compressInChunks(messages, /*compression level=*/3, compressed_packet, num_chunks);
+		checkRoundTrip(messages, compressed_packet);
+	}
+
+	//-------------------- Test incompressible messages are sent uncompressed --------------------
+	{
+		std::string random_payload(1000, ' ');
+		for(size_t i=0; i<random_payload.size(); ++i)
+			random_payload[i] = (char)(rng.nextUInt() & 0xFF);
+
+		SocketBufferOutStream messages(SocketBufferOutStream::DontUseNetworkByteOrder);
+		appendTestMessage(messages, scratch_packet, Protocol::ObjectInitialSend, random_payload);
+
+		SocketBufferOutStream compressed_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		appendCompressedMessage(messages.buf.data(), messages.buf.size(), /*compression level=*/3, compressed_packet);
+		testAssert(compressed_packet.buf.size() == messages.buf.size());
+		testAssert(std::memcmp(compressed_packet.buf.data(), messages.buf.data(), messages.buf.size()) == 0);
+	}
+
+	//-------------------- Test invalid data is rejected --------------------
+	{
+		// Truncated messages
+		SocketBufferOutStream messages(SocketBufferOutStream::DontUseNetworkByteOrder);
+		for(int i=0; i<100; ++i)
+			appendTestMessage(messages, scratch_packet, Protocol::ObjectInitialSend, "some content some content some content");
+		try
+		{
+			findChunkEnd(messages.buf.data(), messages.buf.size() - 3, 0, CHUNK_MAX_SIZE);
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+
+		// Compressed message containing a truncated message
+		SocketBufferOutStream compressed_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		appendCompressedMessage(messages.buf.data(), messages.buf.size() - 3, /*compression level=*/3, compressed_packet);
+		testDecompressFails(compressed_packet);
+
+		// Nested compressed message.  Followed by the uncompressed messages, so the outer compressed message is smaller than its contents.
+		SocketBufferOutStream nested_messages(SocketBufferOutStream::DontUseNetworkByteOrder);
+		appendCompressedMessage(messages.buf.data(), messages.buf.size(), /*compression level=*/3, nested_messages);
+		testAssert(nested_messages.buf.size() < messages.buf.size());
+		nested_messages.writeData(messages.buf.data(), messages.buf.size());
+		compressed_packet.buf.clear();
+		appendCompressedMessage(nested_messages.buf.data(), nested_messages.buf.size(), /*compression level=*/3, compressed_packet);
+		testAssert(compressed_packet.buf.size() < nested_messages.buf.size());
+		testDecompressFails(compressed_packet);
+
+		// Corrupted compressed data
+		compressed_packet.buf.clear();
+		appendCompressedMessage(messages.buf.data(), messages.buf.size(), /*compression level=*/3, compressed_packet);
+		for(size_t i=sizeof(uint32) * 2 + 8; i<compressed_packet.buf.size(); ++i)
+			compressed_packet.buf[i] = (uint8)(rng.nextUInt() & 0xFF);
+		testDecompressFails(compressed_packet);
+	}
+
+	conPrint("CompressedMessages::test() done.");
+}
+
+
+#endif // BUILD_TESTS
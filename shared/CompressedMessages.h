@@ -0,0 +1,53 @@
+/*=====================================================================
+CompressedMessages.h
+--------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/Vector.h>
+#include <utils/Platform.h>
+class SocketBufferOutStream;
+class BufferInStream;
+
+
+/*=====================================================================
+CompressedMessages
+------------------
+Compression of runs of complete messages into Protocol::CompressedMessages messages.
+Used by the server for the ObjectInitialSend messages sent in response to QueryObjectsInAABB, QueryObjects and GetAllObjects,
+which contain lots of repetitive URLs.  Sent to clients with protocol version >= 42.
+
+Message layout after the usual message type and length:
+	zstd frame (with content size), which decompresses to one or more complete messages, each with the usual type and length.
+
+Compressed messages may not contain other compressed messages.
+=====================================================================*/
+namespace CompressedMessages
+{
+	const size_t FIRST_CHUNK_MAX_SIZE = 16 * 1024; // Max uncompressed size of the first compressed message of a response, so the client can start on the closest objects quickly.
+	const size_t CHUNK_MAX_SIZE = 256 * 1024; // Max uncompressed size of later compressed messages, unless a single message is larger.
+	const size_t MAX_DECOMPRESSED_SIZE = 4 * 1024 * 1024; // Compressed messages with a larger content size are rejected.
+	const size_t MAX_MESSAGE_SIZE = 1000000; // Max size of a message contained in a compressed message, same as the limit for uncompressed messages.
+	const int DEFAULT_COMPRESSION_LEVEL = 3; // zstd compression level used by the server.
+
+	// Returns the end offset of the run of complete messages starting at messages[begin], with total size at most max_chunk_size,
+	// or the end of the first message if it is larger than max_chunk_size.
+	// Throws glare::Exception if the messages are malformed.
+	size_t findChunkEnd(const uint8* messages, size_t messages_size, size_t begin, size_t max_chunk_size);
+
+	// Appends a Protocol::CompressedMessages message containing the complete messages in messages[0, messages_size) to packet_out.
+	// If compression doesn't make the data smaller, appends the original messages instead.
+	void appendCompressedMessage(const uint8* messages, size_t messages_size, int compression_level, SocketBufferOutStream& packet_out);
+
+	// Reads the body of a Protocol::CompressedMessages message (after the message type and length) from msg_buffer, and decompresses it to decompressed_out.
+	// Throws glare::Exception on invalid data.
+	void decompressMessages(BufferInStream& msg_buffer, js::Vector<uint8, 16>& decompressed_out);
+
+	// Copies the message at decompressed[offset] to msg_buffer_out, with the read index set to just after the message type and length, and advances offset past it.
+	// Returns the message type.  Throws glare::Exception if the message is invalid or is itself a compressed message.
+	uint32 readNextMessage(const js::Vector<uint8, 16>& decompressed, size_t& offset, BufferInStream& msg_buffer_out);
+
+	void test();
+}
@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2022 -
 #include "ImageDecoding.h"
 
 
+#include "TaskCompletionCounter.h"
 #include <graphics/jpegdecoder.h>
 #include <graphics/PNGDecoder.h>
 #include <graphics/TIFFDecoder.h>
@@ -13,16 +14,222 @@ Copyright Glare Technologies Limited 2022 -
 #include <graphics/GifDecoder.h>
 #include <graphics/KTXDecoder.h>
 #include <graphics/Map2D.h>
+#include <graphics/ImageMap.h>
+#include <graphics/imformatdecoder.h>
 #include <utils/StringUtils.h>
+#include <utils/TaskManager.h>
+#include <utils/FileUtils.h>
 #include <maths/mathstypes.h>
 #include <stdlib.h> // for NULL
 #include <fstream>
+#include <cstring>
+#include <stdio.h>
+#include <setjmp.h>
+#include <jpeglib.h>
 
 
-Reference<Map2D> ImageDecoding::decodeImage(const std::string& indigo_base_dir, const std::string& path) // throws ImFormatExcep on failure
+struct JPEGErrorManager
+{
+	jpeg_error_mgr pub;
+	jmp_buf setjmp_buffer;
+	char msg[JMSG_LENGTH_MAX];
+};
+
+
+static void jpegErrorExit(j_common_ptr cinfo)
+{
+	JPEGErrorManager* err = (JPEGErrorManager*)cinfo->err;
+	(*cinfo->err->format_message)(cinfo, err->msg);
+	longjmp(err->setjmp_buffer, 1);
+}
+
+
+static void jpegOutputMessage(j_common_ptr /*cinfo*/) {} // Ignore warnings.
+
+
+static bool hasICCProfileMarker(const jpeg_decompress_struct& cinfo)
+{
+	for(jpeg_saved_marker_ptr marker = cinfo.marker_list; marker != NULL; marker = marker->next)
+		if(marker->marker == JPEG_APP0 + 2 && marker->data_length >= 12 && std::memcmp(marker->data, "ICC_PROFILE", 12) == 0)
+			return true;
+	return false;
+}
+
+
+// Returns true if the JPEG is large enough to be worth decoding in parallel, and is a plain baseline YCbCr image, so can be decoded in bands with the same result as JPEGDecoder.
+// Progressive images have to be entropy-decoded in full by each decompressor before any scanlines are output, so are not decoded in bands.
+// Images with an ICC profile or in CMYK are left to JPEGDecoder, as it may convert them.
+static bool getBandDecodableJPEGInfo(const uint8* data, size_t data_size, int& width_out, int& height_out)
+{
+	JPEGErrorManager err;
+	jpeg_decompress_struct cinfo;
+	cinfo.err = jpeg_std_error(&err.pub);
+	err.pub.error_exit = jpegErrorExit;
+	err.pub.output_message = jpegOutputMessage;
+	jpeg_create_decompress(&cinfo);
+
+	if(setjmp(err.setjmp_buffer))
+	{
+		jpeg_destroy_decompress(&cinfo);
+		return false; // Let JPEGDecoder handle and report the error.
+	}
+
+	jpeg_mem_src(&cinfo, data, (unsigned long)data_size);
+	jpeg_save_markers(&cinfo, JPEG_APP0 + 2, 0xFFFF);
+	jpeg_read_header(&cinfo, TRUE);
+
+	const size_t MIN_PIXELS_FOR_BAND_DECODING = 1 << 21; // ~2 MPixels
+	const bool decodable = 
+		((size_t)cinfo.image_width * (size_t)cinfo.image_height >= MIN_PIXELS_FOR_BAND_DECODING) &&
+		!cinfo.progressive_mode &&
+		(cinfo.jpeg_color_space == JCS_YCbCr) && (cinfo.num_components == 3) &&
+		!hasICCProfileMarker(cinfo);
+
+	width_out = (int)cinfo.image_width;
+	height_out = (int)cinfo.image_height;
+
+	jpeg_destroy_decompress(&cinfo);
+	return decodable;
+}
+
+
+// Decodes rows [begin_y, end_y) of the JPEG into map.  Rows before begin_y are skipped with jpeg_skip_scanlines(), which still entropy-decodes them,
+// but skips the IDCT, upsampling and colour conversion, which are most of the work.
+// Returns false and sets err.msg on failure.
+static bool decodeJPEGRows(const uint8* data, size_t data_size, int begin_y, int end_y, ImageMapUInt8& map, JPEGErrorManager& err)
+{
+	jpeg_decompress_struct cinfo;
+	cinfo.err = jpeg_std_error(&err.pub);
+	err.pub.error_exit = jpegErrorExit;
+	err.pub.output_message = jpegOutputMessage;
+	jpeg_create_decompress(&cinfo);
+
+	if(setjmp(err.setjmp_buffer))
+	{
+		jpeg_destroy_decompress(&cinfo);
+		return false;
+	}
+
+	jpeg_mem_src(&cinfo, data, (unsigned long)data_size);
+	jpeg_read_header(&cinfo, TRUE);
+	cinfo.out_color_space = JCS_RGB;
+	jpeg_start_decompress(&cinfo);
+
+	if(cinfo.output_width != map.getWidth() || cinfo.output_height != map.getHeight() || cinfo.output_components != (int)map.getN())
+	{
+		jpeg_destroy_decompress(&cinfo);
+		strcpy(err.msg, "Unexpected output dimensions");
+		return false;
+	}
+
+	if(begin_y > 0)
+		jpeg_skip_scanlines(&cinfo, (JDIMENSION)begin_y);
+
+	while(cinfo.output_scanline < (JDIMENSION)end_y)
+	{
+		JSAMPROW row = map.getPixel(0, cinfo.output_scanline);
+		jpeg_read_scanlines(&cinfo, &row, 1);
+	}
+
+	if(cinfo.output_scanline == cinfo.output_height)
+		jpeg_finish_decompress(&cinfo);
+	else
+		jpeg_abort_decompress(&cinfo);
+
+	jpeg_destroy_decompress(&cinfo);
+	return true;
+}
+
+
+class DecodeJPEGBandTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		JPEGErrorManager err;
+		if(!decodeJPEGRows(data, data_size, begin_y, end_y, *map, err))
+			error_msg = err.msg;
+
+		bands_remaining->taskFinished();
+	}
+
+	const uint8* data;
+	size_t data_size;
+	int begin_y, end_y;
+	ImageMapUInt8* map;
+	TaskCompletionCounter* bands_remaining;
+	std::string error_msg;
+};
+
+
+// Returns NULL if the JPEG should be decoded with JPEGDecoder instead.
+static Reference<Map2D> decodeJPEGInParallelBands(const std::string& path, glare::TaskManager& task_manager)
+{
+	if(task_manager.getNumThreads() <= 1)
+		return NULL;
+
+	std::vector<uint8> data;
+	try
+	{
+		FileUtils::readEntireFile(path, data);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw ImFormatExcep("Failed to read '" + path + "': " + e.what());
+	}
+
+	int W, H;
+	if(!getBandDecodableJPEGInfo(data.data(), data.size(), W, H))
+		return NULL;
+
+	Reference<ImageMapUInt8> map = new ImageMapUInt8(W, H, 3);
+
+	// Use a few bands per thread for load balancing, as later bands have to skip over more rows.  Align band boundaries to 32 rows, a multiple of the iMCU row height.
+	const int num_bands = (int)myMax<size_t>(1, myMin<size_t>(task_manager.getNumThreads() * 2, (size_t)H / 128));
+	const int band_h = (H / num_bands + 32) & ~31;
+
+	// The task manager is shared with other loaders and the engine, so wait for just our band tasks, instead of using TaskManager::waitForTasksToComplete(), which would wait for their tasks too.
+	TaskCompletionCounter bands_remaining;
+	std::vector<Reference<DecodeJPEGBandTask> > tasks;
+	for(int begin_y = 0; begin_y < H; begin_y += band_h)
+	{
+		Reference<DecodeJPEGBandTask> task = new DecodeJPEGBandTask();
+		task->data = data.data();
+		task->data_size = data.size();
+		task->begin_y = begin_y;
+		task->end_y = myMin(begin_y + band_h, H);
+		task->map = map.ptr();
+		task->bands_remaining = &bands_remaining;
+		tasks.push_back(task);
+	}
+
+	bands_remaining.setNumTasks(tasks.size());
+
+	// Add in reverse order, so the bands with the most rows to skip start first.
+	for(int i=(int)tasks.size() - 1; i >= 0; --i)
+		task_manager.addTask(tasks[i]);
+
+	bands_remaining.waitForTasks();
+
+	for(size_t i=0; i<tasks.size(); ++i)
+		if(!tasks[i]->error_msg.empty())
+			throw ImFormatExcep("Error decoding JPEG '" + path + "': " + tasks[i]->error_msg);
+
+	return map;
+}
+
+
+Reference<Map2D> ImageDecoding::decodeImage(const std::string& indigo_base_dir, const std::string& path, glare::TaskManager* task_manager) // throws ImFormatExcep on failure
 {
 	if(hasExtension(path, "jpg") || hasExtension(path, "jpeg"))
 	{
+		if(task_manager)
+		{
+			Reference<Map2D> map = decodeJPEGInParallelBands(path, *task_manager);
+			if(map.nonNull())
+				return map;
+		}
+
 		return JPEGDecoder::decode(indigo_base_dir, path);
 	}
 	else if(hasExtension(path, "png"))
@@ -125,3 +332,161 @@ bool ImageDecoding::areMagicBytesValid(const void* data, size_t data_len, string
 	else
 		return false;
 }
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+
+
+// Encodes a test image with libjpeg and writes it to path.
+static void writeTestJPEG(const std::string& path, int W, int H, int N, bool progressive)
+{
+	PCG32 rng(1);
+	std::vector<uint8> pixels((size_t)W * H * N);
+	for(int y=0; y<H; ++y)
+	for(int x=0; x<W; ++x)
+	for(int c=0; c<N; ++c)
+		pixels[((size_t)y * W + x) * N + c] = (uint8)myClamp<int>((x * (c + 1) / 7 + y / 3 + (x / 64 + y / 64) % 2 * 80 + (int)(rng.unitRandom() * 20)) % 256, 0, 255);
+
+	jpeg_compress_struct cinfo;
+	jpeg_error_mgr jerr;
+	cinfo.err = jpeg_std_error(&jerr);
+	jpeg_create_compress(&cinfo);
+
+	unsigned char* buf = NULL;
+	unsigned long buf_size = 0;
+	jpeg_mem_dest(&cinfo, &buf, &buf_size);
+
+	cinfo.image_width = W;
+	cinfo.image_height = H;
+	cinfo.input_components = N;
+	cinfo.in_color_space = (N == 3) ? JCS_RGB : JCS_GRAYSCALE;
+	jpeg_set_defaults(&cinfo);
+	jpeg_set_quality(&cinfo, 90, TRUE);
+	if(progressive)
+		jpeg_simple_progression(&cinfo);
+
+	jpeg_start_compress(&cinfo, TRUE);
+	while(cinfo.next_scanline < cinfo.image_height)
+	{
+		JSAMPROW row = &pixels[(size_t)cinfo.next_scanline * W * N];
+		jpeg_write_scanlines(&cinfo, &row, 1);
+	}
+	jpeg_finish_compress(&cinfo);
+
+	const std::vector<uint8> file_data(buf, buf + buf_size);
+	free(buf);
+	jpeg_destroy_compress(&cinfo);
+
+	FileUtils::writeEntireFile(path, file_data);
+}
+
+
+static void checkMapsEqual(const Reference<Map2D>& a, const Reference<Map2D>& b)
+{
+	testAssert(a.isType<ImageMapUInt8>() && b.isType<ImageMapUInt8>());
+	const ImageMapUInt8* map_a = a.downcastToPtr<ImageMapUInt8>();
+	const ImageMapUInt8* map_b = b.downcastToPtr<ImageMapUInt8>();
+	testAssert(map_a->getWidth() == map_b->getWidth() && map_a->getHeight() == map_b->getHeight() && map_a->getN() == map_b->getN());
+	testAssert(std::memcmp(map_a->getData(), map_b->getData(), map_a->getWidth() * map_a->getHeight() * map_a->getN()) == 0);
+}
+
+
+void ImageDecoding::test()
+{
+	conPrint("ImageDecoding::test()");
+
+	try
+	{
+		glare::TaskManager task_manager;
+		const std::string dir = PlatformUtils::getTempDirPath();
+
+		// Band-decoded JPEGs should be identical to JPEGs decoded by JPEGDecoder.  Use a height that is not a multiple of the band alignment.
+		{
+			const std::string path = dir + "/image_decoding_test_baseline.jpg";
+			writeTestJPEG(path, /*W=*/1500, /*H=*/1501, /*N=*/3, /*progressive=*/false);
+			checkMapsEqual(decodeImage(".", path, &task_manager), decodeImage(".", path));
+			FileUtils::deleteFile(path);
+		}
+
+		// Progressive and greyscale JPEGs are decoded by JPEGDecoder, check they still decode with a task manager.
+		{
+			const std::string path = dir + "/image_decoding_test_progressive.jpg";
+			writeTestJPEG(path, /*W=*/1500, /*H=*/1500, /*N=*/3, /*progressive=*/true);
+			checkMapsEqual(decodeImage(".", path, &task_manager), decodeImage(".", path));
+
+			writeTestJPEG(path, /*W=*/1500, /*H=*/1500, /*N=*/1, /*progressive=*/false);
+			const Reference<Map2D> map = decodeImage(".", path, &task_manager);
+			testAssert(map->getMapWidth() == 1500 && map->getMapHeight() == 1500);
+			FileUtils::deleteFile(path);
+		}
+
+		// Corrupted JPEG data should either decode (libjpeg just warns about some errors) or throw, not crash.
+		{
+			const std::string path = dir + "/image_decoding_test_truncated.jpg";
+			writeTestJPEG(path, /*W=*/1500, /*H=*/1500, /*N=*/3, /*progressive=*/false);
+			std::vector<uint8> data;
+			FileUtils::readEntireFile(path, data);
+			data.resize(data.size() / 2);
+			for(size_t i=data.size() / 4; i<data.size(); i += 97)
+				data[i] = 0xFF;
+			FileUtils::writeEntireFile(path, data);
+			try
+			{
+				decodeImage(".", path, &task_manager);
+			}
+			catch(ImFormatExcep&)
+			{}
+			catch(glare::Exception&)
+			{}
+			FileUtils::deleteFile(path);
+		}
+
+		// Benchmark: decode time for a large JPEG with and without band decoding.
+		if(false)
+		{
+			const std::string path = dir + "/image_decoding_test_large.jpg";
+			writeTestJPEG(path, /*W=*/4096, /*H=*/4096, /*N=*/3, /*progressive=*/false);
+
+			double serial_time = 1.0e10;
+			double parallel_time = 1.0e10;
+			for(int i=0; i<5; ++i)
+			{
+				Timer timer;
+				decodeImage(".", path);
+				serial_time = myMin(serial_time, timer.elapsed());
+
+				timer.reset();
+				decodeImage(".", path, &task_manager);
+				parallel_time = myMin(parallel_time, timer.elapsed());
+			}
+			FileUtils::deleteFile(path);
+
+			conPrint("Decoding 4096x4096 JPEG: JPEGDecoder: " + doubleToStringNSigFigs(serial_time * 1.0e3, 4) + " ms, band decoding with " + toString(task_manager.getNumThreads()) + " threads: " +
+				doubleToStringNSigFigs(parallel_time * 1.0e3, 4) + " ms");
+		}
+	}
+	catch(ImFormatExcep& e)
+	{
+		failTest(e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ImageDecoding::test() done");
+}
+
+
+#endif // BUILD_TESTS
@@ -12,6 +12,7 @@ Copyright Glare Technologies Limited 2022 -
 #include <string>
 #include <vector>
 class Map2D;
+namespace glare { class TaskManager; }
 
 
 /*=====================================================================
@@ -23,11 +24,15 @@ class ImageDecoding
 {
 public:
 
-	static Reference<Map2D> decodeImage(const std::string& indigo_base_dir, const std::string& path);
+	// If task_manager is non-null, large baseline JPEGs are decoded in horizontal bands in parallel.
+	// Must not be called from a task executing on task_manager.
+	static Reference<Map2D> decodeImage(const std::string& indigo_base_dir, const std::string& path, glare::TaskManager* task_manager = NULL);
 
 	static bool isSupportedImageExtension(string_view extension);
 
 	static bool hasSupportedImageExtension(const std::string& path);
 
 	static bool areMagicBytesValid(const void* data, size_t data_len, string_view extension);
+
+	static void test();
 };
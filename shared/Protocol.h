@@ -33,13 +33,17 @@ CyberspaceProtocolVersion
 	Added scale to ObjectTransformUpdate message.
 38: Use length-prefixed serialisation for WorldMaterial, sending server version to client.
 39: Added QueryMapTiles, MapTilesResult
+40: Added QuantizedTransformUpdates, sent to clients instead of AvatarTransformUpdate and ObjectPhysicsTransformUpdate.
+41: Added GetFilesWithRanges, for resuming interrupted resource downloads.
+42: Added CompressedMessages, sent to clients instead of uncompressed ObjectInitialSend messages in response to object queries.
+43: Added ResourceRequest, ResourceRequestPriority, ResourceRequestCancel, ResourceRequestResult and ResourceDataChunk, for multiplexed resource downloads.
 */
 namespace Protocol
 {
 
 const uint32 CyberspaceHello = 1357924680;
 
-const uint32 CyberspaceProtocolVersion = 39;
+const uint32 CyberspaceProtocolVersion = 43;
 
 const uint32 ClientProtocolOK		= 10000;
 const uint32 ClientProtocolTooOld	= 10001;
@@ -81,6 +85,7 @@ const uint32 ObjectFlagsChanged		= 3011;
 const uint32 ObjectModelURLChanged	= 3012;
 const uint32 ObjectPhysicsOwnershipTaken	= 3013;
 const uint32 ObjectPhysicsTransformUpdate	= 3016;
+const uint32 QuantizedTransformUpdates	= 3017; // Multiple quantized avatar and object physics transform updates, see QuantizedTransformUpdates.h.  Sent by server to clients with protocol version >= 40.
 const uint32 SummonObject			= 3030;
 
 const uint32 CreateObject			= 3004; // Client wants to create an object.
@@ -111,6 +116,16 @@ const uint32 MapTilesResult			= 3801; // Server is sending back a list of tile i
 //TEMP HACK move elsewhere
 const uint32 GetFile				= 4000;
 const uint32 GetFiles				= 4001; // Client wants to download multiple resources from the server.
+const uint32 GetFilesWithRanges		= 4002; // Client wants to download multiple resources from the server, each starting from a given byte offset.
+
+// Multiplexed resource downloads, on a ConnectionTypeDownloadResources connection.
+// The client may have multiple requests outstanding.  The server sends the data for outstanding requests in chunks, 
+// always sending the next chunk of the request with the lowest priority value.
+const uint32 ResourceRequest		= 4003; // Client -> server: request_id (uint32), URL (string), start offset (uint64), priority (float, lower is more important)
+const uint32 ResourceRequestPriority = 4004; // Client -> server: request_id (uint32), priority (float).  Ignored if the request has completed.
+const uint32 ResourceRequestCancel	= 4005; // Client -> server: request_id (uint32).  Ignored if the request has completed.
+const uint32 ResourceRequestResult	= 4006; // Server -> client: request_id (uint32), result (uint32, 0 = OK), then if OK, file size (uint64) and start offset (uint64)
+const uint32 ResourceDataChunk		= 4007; // Server -> client: request_id (uint32), chunk length (uint32), data.  Chunks for a request are sent in order.
 
 const uint32 NewResourceOnServer	= 4100; // A file has been uploaded to the server
 
@@ -154,4 +169,6 @@ const uint32 EthTransactionSubmissionFailed		= 12003;
 
 const uint32 KeepAlive				= 13000; // A message that doesn't do anything apart from provide a means for the client or server to check a connection is still working by making a socket call.
 
+const uint32 CompressedMessages		= 14000; // Several complete messages, compressed together, see CompressedMessages.h.  Sent by server to clients with protocol version >= 42.
+
 } // end namespace Protocol
@@ -0,0 +1,764 @@
+/*=====================================================================
+QuantizedTransformUpdates.cpp
+-----------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "QuantizedTransformUpdates.h"
+
+
+#include "MessageUtils.h"
+#include "Protocol.h"
+#include <utils/SocketBufferOutStream.h>
+#include <utils/BufferInStream.h>
+#include <utils/Exception.h>
+#include <maths/mathstypes.h>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+
+namespace QuantizedTransformUpdates
+{
+
+
+static const uint8 FLAG_OBJECT_PHYSICS_TRANSFORM	= 1;
+static const uint8 FLAG_HAS_LINEAR_VEL				= 2;
+static const uint8 FLAG_HAS_ANGULAR_VEL				= 4;
+static const uint8 FLAG_SAME_AVATAR_UID				= 8;
+static const uint8 ALL_FLAGS						= 15;
+
+static const double MAX_ABS_POS = 2.0e6; // Positions are quantized to int32, so must be less than 2^31 * POS_QUANTUM ~= 2.1e6 m.
+static const double MAX_ABS_ANGLE = 5.0e5; // Angles are quantized to int32, so must be less than 2^31 * ANGLE_QUANTUM ~= 5.2e5 rad.
+static const double MAX_ABS_TIME = 1.0e14;
+static const double INV_SQRT_2 = 0.70710678118654752440;
+static const uint32 ROT_COMPONENT_MAX = (1 << 15) - 1;
+
+
+static inline int32 quantizeToInt32(double x, double quantum)
+{
+	return (int32)std::floor(x / quantum + 0.5);
+}
+
+
+// Quantizes a velocity component, clamping to a large but representable range.  Non-finite values are quantized to zero.
+static inline int32 quantizeVelocity(float v, double quantum)
+{
+	if(!isFinite(v))
+		return 0;
+	return quantizeToInt32(myClamp<double>(v, -1.0e6, 1.0e6), quantum);
+}
+
+
+static bool quantizePos(const Vec3d& pos, int32* pos_out)
+{
+	for(int i=0; i<3; ++i)
+	{
+		if(!(std::fabs(pos[i]) < MAX_ABS_POS)) // NaN will fail this test as well.
+			return false;
+		pos_out[i] = quantizeToInt32(pos[i], POS_QUANTUM);
+	}
+	return true;
+}
+
+
+// Encodes a rotation quaternion with the 'smallest three' method: The index of the component with the largest magnitude is stored in 2 bits,
+// and the other three components, which are in [-1/sqrt(2), 1/sqrt(2)], are stored in 15 bits each.
+static bool encodeRotation(const Quatf& rot, uint64& encoded_out)
+{
+	const double len = std::sqrt((double)rot.v[0]*rot.v[0] + (double)rot.v[1]*rot.v[1] + (double)rot.v[2]*rot.v[2] + (double)rot.v[3]*rot.v[3]);
+	if(!(len > 1.0e-10 && len < 1.0e10))
+		return false;
+
+	double q[4];
+	int largest_i = 0;
+	for(int i=0; i<4; ++i)
+	{
+		q[i] = rot.v[i] / len;
+		if(std::fabs(q[i]) > std::fabs(q[largest_i]))
+			largest_i = i;
+	}
+
+	// q and -q represent the same rotation, so negate if needed so that the largest component is positive, and can be reconstructed from the other three.
+	const double sign = (q[largest_i] < 0) ? -1.0 : 1.0;
+
+	uint64 encoded = (uint64)largest_i;
+	int shift = 2;
+	for(int i=0; i<4; ++i)
+		if(i != largest_i)
+		{
+			const double normed = (sign * q[i] + INV_SQRT_2) / (2 * INV_SQRT_2); // Map to [0, 1]
+			const uint64 c = (uint64)myClamp<int>((int)std::floor(normed * ROT_COMPONENT_MAX + 0.5), 0, (int)ROT_COMPONENT_MAX);
+			encoded |= c << shift;
+			shift += 15;
+		}
+
+	encoded_out = encoded;
+	return true;
+}
+
+
+static Quatf decodeRotation(uint64 encoded)
+{
+	const int largest_i = (int)(encoded & 0x3);
+
+	float q[4];
+	double sum_sq = 0;
+	int shift = 2;
+	for(int i=0; i<4; ++i)
+		if(i != largest_i)
+		{
+			const uint32 c = (uint32)((encoded >> shift) & ROT_COMPONENT_MAX);
+			const double v = (double)c / ROT_COMPONENT_MAX * (2 * INV_SQRT_2) - INV_SQRT_2;
+			q[i] = (float)v;
+			sum_sq += v * v;
+			shift += 15;
+		}
+	q[largest_i] = (float)std::sqrt(myMax(0.0, 1.0 - sum_sq));
+
+	Quatf rot;
+	rot.v = Vec4f(q[0], q[1], q[2], q[3]);
+	return rot;
+}
+
+
+bool quantizeAvatarTransform(const UID& uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state, QuantizedTransformUpdate& update_out)
+{
+	update_out.type = QuantizedTransformUpdate::Type_AvatarTransform;
+	update_out.uid = uid.value();
+	if(!quantizePos(pos, update_out.pos))
+		return false;
+
+	for(int i=0; i<3; ++i)
+	{
+		if(!(std::fabs(rotation[i]) < MAX_ABS_ANGLE))
+			return false;
+		update_out.avatar_rotation[i] = quantizeToInt32(rotation[i], ANGLE_QUANTUM);
+	}
+	update_out.anim_state = anim_state;
+
+	update_out.rot = 0;
+	for(int i=0; i<3; ++i)
+		update_out.linear_vel[i] = update_out.angular_vel[i] = 0;
+	update_out.transform_update_avatar_uid = 0;
+	update_out.client_time = 0;
+	return true;
+}
+
+
+bool quantizeObjectPhysicsTransform(const UID& uid, const Vec3d& pos, const Quatf& rot, const Vec4f& linear_vel, const Vec4f& angular_vel,
+	uint32 transform_update_avatar_uid, double client_time, QuantizedTransformUpdate& update_out)
+{
+	update_out.type = QuantizedTransformUpdate::Type_ObjectPhysicsTransform;
+	update_out.uid = uid.value();
+	if(!quantizePos(pos, update_out.pos))
+		return false;
+	if(!encodeRotation(rot, update_out.rot))
+		return false;
+
+	for(int i=0; i<3; ++i)
+	{
+		update_out.linear_vel[i] = quantizeVelocity(linear_vel[i], VEL_QUANTUM);
+		update_out.angular_vel[i] = quantizeVelocity(angular_vel[i], ANG_VEL_QUANTUM);
+		update_out.avatar_rotation[i] = 0;
+	}
+	update_out.anim_state = 0;
+	update_out.transform_update_avatar_uid = transform_update_avatar_uid;
+	update_out.client_time = (std::fabs(client_time) < MAX_ABS_TIME) ? (int64)std::floor(client_time / TIME_QUANTUM + 0.5) : 0;
+	return true;
+}
+
+
+Vec3d getPos(const QuantizedTransformUpdate& update)
+{
+	return Vec3d(update.pos[0] * POS_QUANTUM, update.pos[1] * POS_QUANTUM, update.pos[2] * POS_QUANTUM);
+}
+
+
+Vec3f getAvatarRotation(const QuantizedTransformUpdate& update)
+{
+	return Vec3f((float)(update.avatar_rotation[0] * ANGLE_QUANTUM), (float)(update.avatar_rotation[1] * ANGLE_QUANTUM), (float)(update.avatar_rotation[2] * ANGLE_QUANTUM));
+}
+
+
+Quatf getRotation(const QuantizedTransformUpdate& update)
+{
+	return decodeRotation(update.rot);
+}
+
+
+Vec4f getLinearVel(const QuantizedTransformUpdate& update)
+{
+	return Vec4f((float)(update.linear_vel[0] * VEL_QUANTUM), (float)(update.linear_vel[1] * VEL_QUANTUM), (float)(update.linear_vel[2] * VEL_QUANTUM), 0.f);
+}
+
+
+Vec4f getAngularVel(const QuantizedTransformUpdate& update)
+{
+	return Vec4f((float)(update.angular_vel[0] * ANG_VEL_QUANTUM), (float)(update.angular_vel[1] * ANG_VEL_QUANTUM), (float)(update.angular_vel[2] * ANG_VEL_QUANTUM), 0.f);
+}
+
+
+double getClientTime(const QuantizedTransformUpdate& update)
+{
+	return (double)update.client_time * TIME_QUANTUM;
+}
+
+
+//--------------------------------------- Variable-length integer encoding ---------------------------------------
+
+
+static inline uint64 zigzagEncode(int64 x)
+{
+	return ((uint64)x << 1) ^ (uint64)(x >> 63);
+}
+
+
+static inline int64 zigzagDecode(uint64 x)
+{
+	return (int64)(x >> 1) ^ -(int64)(x & 1);
+}
+
+
+static inline void writeVarUInt(js::Vector<uint8, 16>& buf, uint64 x)
+{
+	while(x >= 0x80)
+	{
+		buf.push_back((uint8)(x | 0x80));
+		x >>= 7;
+	}
+	buf.push_back((uint8)x);
+}
+
+
+static inline void writeVarInt(js::Vector<uint8, 16>& buf, int64 x)
+{
+	writeVarUInt(buf, zigzagEncode(x));
+}
+
+
+static inline uint64 readVarUInt(BufferInStream& stream)
+{
+	uint64 x = 0;
+	for(int shift=0; shift<64; shift += 7)
+	{
+		if(stream.read_index >= stream.buf.size())
+			throw glare::Exception("QuantizedTransformUpdates: unexpected end of message");
+
+		const uint8 b = stream.buf[stream.read_index++];
+		x |= (uint64)(b & 0x7F) << shift;
+		if((b & 0x80) == 0)
+			return x;
+	}
+	throw glare::Exception("QuantizedTransformUpdates: invalid varint");
+}
+
+
+static inline int64 readVarInt(BufferInStream& stream)
+{
+	return zigzagDecode(readVarUInt(stream));
+}
+
+
+// Reads a value that must fit in an int32, for example a delta from a previous int32 value.
+static inline int32 readInt32Delta(BufferInStream& stream, int32 prev)
+{
+	const int64 x = (int64)prev + readVarInt(stream);
+	if(x < std::numeric_limits<int32>::min() || x > std::numeric_limits<int32>::max())
+		throw glare::Exception("QuantizedTransformUpdates: value out of range");
+	return (int32)x;
+}
+
+
+//--------------------------------------- Encoder ---------------------------------------
+
+
+Encoder::Encoder()
+:	packet(NULL),
+	num_updates_offset(0),
+	num_updates(0)
+{}
+
+
+void Encoder::begin(SocketBufferOutStream& packet_)
+{
+	packet = &packet_;
+	MessageUtils::initPacket(*packet, Protocol::QuantizedTransformUpdates);
+	num_updates_offset = packet->buf.size();
+	packet->writeUInt32(0); // Placeholder for num updates, written in finish().
+
+	num_updates = 0;
+	prev_uid = 0;
+	prev_pos[0] = prev_pos[1] = prev_pos[2] = 0;
+	have_prev_physics_update = false;
+	prev_transform_update_avatar_uid = 0;
+	prev_client_time = 0;
+}
+
+
+size_t Encoder::addUpdate(const QuantizedTransformUpdate& update)
+{
+	assert(packet);
+	js::Vector<uint8, 16>& buf = packet->buf;
+	const size_t initial_size = buf.size();
+
+	const bool physics = update.type == QuantizedTransformUpdate::Type_ObjectPhysicsTransform;
+	const bool has_linear_vel  = physics && (update.linear_vel [0] != 0 || update.linear_vel [1] != 0 || update.linear_vel [2] != 0);
+	const bool has_angular_vel = physics && (update.angular_vel[0] != 0 || update.angular_vel[1] != 0 || update.angular_vel[2] != 0);
+	const bool same_avatar_uid = physics && have_prev_physics_update && (update.transform_update_avatar_uid == prev_transform_update_avatar_uid);
+
+	const uint8 flags = (physics ? FLAG_OBJECT_PHYSICS_TRANSFORM : 0) | (has_linear_vel ? FLAG_HAS_LINEAR_VEL : 0) | (has_angular_vel ? FLAG_HAS_ANGULAR_VEL : 0) |
+		(same_avatar_uid ? FLAG_SAME_AVATAR_UID : 0);
+	buf.push_back(flags);
+
+	writeVarInt(buf, (int64)(update.uid - prev_uid)); // Wrapping subtraction, decoder does wrapping addition.
+	prev_uid = update.uid;
+
+	for(int i=0; i<3; ++i)
+	{
+		writeVarInt(buf, (int64)update.pos[i] - (int64)prev_pos[i]);
+		prev_pos[i] = update.pos[i];
+	}
+
+	if(physics)
+	{
+		for(int i=0; i<6; ++i) // Write 48 bits of rotation
+			buf.push_back((uint8)(update.rot >> (i * 8)));
+
+		if(has_linear_vel)
+			for(int i=0; i<3; ++i)
+				writeVarInt(buf, update.linear_vel[i]);
+
+		if(has_angular_vel)
+			for(int i=0; i<3; ++i)
+				writeVarInt(buf, update.angular_vel[i]);
+
+		if(!same_avatar_uid)
+			writeVarUInt(buf, update.transform_update_avatar_uid);
+
+		writeVarInt(buf, update.client_time - prev_client_time);
+
+		have_prev_physics_update = true;
+		prev_transform_update_avatar_uid = update.transform_update_avatar_uid;
+		prev_client_time = update.client_time;
+	}
+	else
+	{
+		for(int i=0; i<3; ++i)
+			writeVarInt(buf, update.avatar_rotation[i]);
+		writeVarUInt(buf, update.anim_state);
+	}
+
+	num_updates++;
+	return buf.size() - initial_size;
+}
+
+
+void Encoder::finish()
+{
+	assert(packet);
+	std::memcpy(&packet->buf[num_updates_offset], &num_updates, sizeof(uint32));
+	MessageUtils::updatePacketLengthField(*packet);
+}
+
+
+//--------------------------------------- Decoder ---------------------------------------
+
+
+void readUpdates(BufferInStream& msg_buffer, std::vector<QuantizedTransformUpdate>& updates_out)
+{
+	const uint32 num_updates = msg_buffer.readUInt32();
+
+	// Each record takes at least 5 bytes, so we can check num_updates against the remaining message size before allocating anything.
+	const size_t remaining = msg_buffer.buf.size() - myMin(msg_buffer.buf.size(), msg_buffer.read_index);
+	if((size_t)num_updates > remaining / 5)
+		throw glare::Exception("QuantizedTransformUpdates: invalid num_updates");
+
+	updates_out.resize(num_updates);
+
+	uint64 prev_uid = 0;
+	int32 prev_pos[3] = { 0, 0, 0 };
+	bool have_prev_physics_update = false;
+	uint32 prev_transform_update_avatar_uid = 0;
+	int64 prev_client_time = 0;
+
+	for(uint32 z=0; z<num_updates; ++z)
+	{
+		QuantizedTransformUpdate& update = updates_out[z];
+
+		if(msg_buffer.read_index >= msg_buffer.buf.size())
+			throw glare::Exception("QuantizedTransformUpdates: unexpected end of message");
+		const uint8 flags = msg_buffer.buf[msg_buffer.read_index++];
+		if((flags & ~ALL_FLAGS) != 0)
+			throw glare::Exception("QuantizedTransformUpdates: invalid flags");
+
+		const bool physics = (flags & FLAG_OBJECT_PHYSICS_TRANSFORM) != 0;
+		update.type = physics ? QuantizedTransformUpdate::Type_ObjectPhysicsTransform : QuantizedTransformUpdate::Type_AvatarTransform;
+
+		update.uid = prev_uid + (uint64)readVarInt(msg_buffer);
+		prev_uid = update.uid;
+
+		for(int i=0; i<3; ++i)
+		{
+			update.pos[i] = readInt32Delta(msg_buffer, prev_pos[i]);
+			prev_pos[i] = update.pos[i];
+		}
+
+		for(int i=0; i<3; ++i)
+			update.avatar_rotation[i] = update.linear_vel[i] = update.angular_vel[i] = 0;
+		update.anim_state = 0;
+		update.rot = 0;
+		update.transform_update_avatar_uid = 0;
+		update.client_time = 0;
+
+		if(physics)
+		{
+			if(!msg_buffer.canReadNBytes(6))
+				throw glare::Exception("QuantizedTransformUpdates: unexpected end of message");
+			for(int i=0; i<6; ++i)
+				update.rot |= (uint64)msg_buffer.buf[msg_buffer.read_index++] << (i * 8);
+
+			if(flags & FLAG_HAS_LINEAR_VEL)
+				for(int i=0; i<3; ++i)
+					update.linear_vel[i] = readInt32Delta(msg_buffer, 0);
+
+			if(flags & FLAG_HAS_ANGULAR_VEL)
+				for(int i=0; i<3; ++i)
+					update.angular_vel[i] = readInt32Delta(msg_buffer, 0);
+
+			if(flags & FLAG_SAME_AVATAR_UID)
+			{
+				if(!have_prev_physics_update)
+					throw glare::Exception("QuantizedTransformUpdates: no previous avatar UID");
+				update.transform_update_avatar_uid = prev_transform_update_avatar_uid;
+			}
+			else
+			{
+				const uint64 avatar_uid = readVarUInt(msg_buffer);
+				if(avatar_uid > std::numeric_limits<uint32>::max())
+					throw glare::Exception("QuantizedTransformUpdates: invalid avatar UID");
+				update.transform_update_avatar_uid = (uint32)avatar_uid;
+			}
+
+			update.client_time = prev_client_time + readVarInt(msg_buffer);
+
+			have_prev_physics_update = true;
+			prev_transform_update_avatar_uid = update.transform_update_avatar_uid;
+			prev_client_time = update.client_time;
+		}
+		else
+		{
+			if(flags & (FLAG_HAS_LINEAR_VEL | FLAG_HAS_ANGULAR_VEL | FLAG_SAME_AVATAR_UID))
+				throw glare::Exception("QuantizedTransformUpdates: invalid flags for avatar transform");
+
+			for(int i=0; i<3; ++i)
+				update.avatar_rotation[i] = readInt32Delta(msg_buffer, 0);
+
+			const uint64 anim_state = readVarUInt(msg_buffer);
+			if(anim_state > std::numeric_limits<uint32>::max())
+				throw glare::Exception("QuantizedTransformUpdates: invalid anim_state");
+			update.anim_state = (uint32)anim_state;
+		}
+	}
+}
+
+
+} // end namespace QuantizedTransformUpdates
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+
+
+// Writes the legacy, unquantized messages, in the same way as the server main loop does.
+static void writeLegacyAvatarTransformUpdate(SocketBufferOutStream& packet, const UID& uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state)
+{
+	MessageUtils::initPacket(packet, Protocol::AvatarTransformUpdate);
+	writeToStream(uid, packet);
+	writeToStream(pos, packet);
+	writeToStream(rotation, packet);
+	packet.writeUInt32(anim_state);
+	MessageUtils::updatePacketLengthField(packet);
+}
+
+
+static void writeLegacyObjectPhysicsTransformUpdate(SocketBufferOutStream& packet, const UID& uid, const Vec3d& pos, const Quatf& rot, const Vec4f& linear_vel, const Vec4f& angular_vel,
+	uint32 avatar_uid, double client_time)
+{
+	MessageUtils::initPacket(packet, Protocol::ObjectPhysicsTransformUpdate);
+	writeToStream(uid, packet);
+	writeToStream(pos, packet);
+	packet.writeData(&rot.v.x, sizeof(float) * 4);
+	packet.writeData(linear_vel.x, sizeof(float) * 3);
+	packet.writeData(angular_vel.x, sizeof(float) * 3);
+	packet.writeUInt32(avatar_uid);
+	packet.writeDouble(client_time);
+	MessageUtils::updatePacketLengthField(packet);
+}
+
+
+static float maxComponentDiff(const Vec4f& a, const Vec4f& b)
+{
+	return myMax(myMax(std::fabs(a[0] - b[0]), std::fabs(a[1] - b[1])), myMax(std::fabs(a[2] - b[2]), std::fabs(a[3] - b[3])));
+}
+
+
+struct TestTransform
+{
+	bool is_avatar;
+	UID uid;
+	Vec3d pos;
+	Vec3f avatar_rotation;
+	uint32 anim_state;
+	Quatf rot;
+	Vec4f linear_vel;
+	Vec4f angular_vel;
+	uint32 avatar_uid;
+	double client_time;
+};
+
+
+// Make a set of transforms resembling a busy world: some avatars walking around, and physics objects, some resting and some moving, mostly clustered together.
+static std::vector<TestTransform> makeTestTransforms(int num, PCG32& rng)
+{
+	std::vector<TestTransform> transforms(num);
+	const double base_time = 1.7e9;
+	for(int i=0; i<num; ++i)
+	{
+		TestTransform& t = transforms[i];
+		t.is_avatar = (i % 4) == 0;
+		t.uid = UID(1000 + i * 3);
+		const Vec3d cluster_centre((i % 5) * 300.0 - 600.0, (i % 3) * 250.0, 0.0);
+		t.pos = cluster_centre + Vec3d(rng.unitRandom() * 100 - 50, rng.unitRandom() * 100 - 50, rng.unitRandom() * 10);
+		t.avatar_rotation = Vec3f(0, (rng.unitRandom() - 0.5f) * 0.2f, rng.unitRandom() * 6.28f - 3.14f);
+		t.anim_state = (i % 7 == 0) ? ((1u << 16) | 2) : 0;
+		t.rot.v = normalise(Vec4f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f));
+		const bool moving = (i % 3) != 0;
+		t.linear_vel  = moving ? Vec4f(rng.unitRandom() * 4 - 2, rng.unitRandom() * 4 - 2, rng.unitRandom() * 4 - 2, 0) : Vec4f(0.f);
+		t.angular_vel = moving ? Vec4f(rng.unitRandom() * 2 - 1, rng.unitRandom() * 2 - 1, rng.unitRandom() * 2 - 1, 0) : Vec4f(0.f);
+		t.avatar_uid = 7 + (i % 2);
+		t.client_time = base_time + i * 0.001;
+	}
+	return transforms;
+}
+
+
+static bool quantize(const TestTransform& t, QuantizedTransformUpdate& q)
+{
+	if(t.is_avatar)
+		return QuantizedTransformUpdates::quantizeAvatarTransform(t.uid, t.pos, t.avatar_rotation, t.anim_state, q);
+	else
+		return QuantizedTransformUpdates::quantizeObjectPhysicsTransform(t.uid, t.pos, t.rot, t.linear_vel, t.angular_vel, t.avatar_uid, t.client_time, q);
+}
+
+
+static void checkDecodedTransform(const TestTransform& t, const QuantizedTransformUpdate& q)
+{
+	using namespace QuantizedTransformUpdates;
+
+	testAssert(q.uid == t.uid.value());
+	testAssert(q.type == (t.is_avatar ? QuantizedTransformUpdate::Type_AvatarTransform : QuantizedTransformUpdate::Type_ObjectPhysicsTransform));
+	testAssert(getPos(q).getDist(t.pos) <= POS_QUANTUM);
+
+	if(t.is_avatar)
+	{
+		testAssert(getAvatarRotation(q).getDist(t.avatar_rotation) <= (float)ANGLE_QUANTUM);
+		testAssert(q.anim_state == t.anim_state);
+	}
+	else
+	{
+		// q and -q represent the same rotation.
+		const Vec4f decoded_rot = getRotation(q).v;
+		const float max_err = myMin(maxComponentDiff(decoded_rot, t.rot.v), maxComponentDiff(decoded_rot, Vec4f(0.f) - t.rot.v));
+		testAssert(max_err < 1.0e-4f);
+		testAssert(maxComponentDiff(getLinearVel(q), t.linear_vel) <= (float)VEL_QUANTUM);
+		testAssert(maxComponentDiff(getAngularVel(q), t.angular_vel) <= (float)ANG_VEL_QUANTUM);
+		testAssert(q.transform_update_avatar_uid == t.avatar_uid);
+		testAssert(std::fabs(getClientTime(q) - t.client_time) <= TIME_QUANTUM);
+	}
+}
+
+
+static void decodeMessage(const SocketBufferOutStream& packet, std::vector<QuantizedTransformUpdate>& updates_out)
+{
+	BufferInStream msg_buffer;
+	msg_buffer.buf.resize(packet.buf.size());
+	std::memcpy(msg_buffer.buf.data(), packet.buf.data(), packet.buf.size());
+
+	testAssert(msg_buffer.readUInt32() == Protocol::QuantizedTransformUpdates);
+	testAssert(msg_buffer.readUInt32() == (uint32)packet.buf.size());
+	QuantizedTransformUpdates::readUpdates(msg_buffer, updates_out);
+	testAssert(msg_buffer.endOfStream());
+}
+
+
+void QuantizedTransformUpdates::test()
+{
+	conPrint("QuantizedTransformUpdates::test()");
+
+	PCG32 rng(1);
+
+	//-------------------- Test rotation encoding round trip --------------------
+	for(int i=0; i<10000; ++i)
+	{
+		Quatf rot;
+		rot.v = Vec4f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f) * (1 + rng.unitRandom() * 10);
+		if(i == 0) rot.v = Vec4f(0, 0, 0, 1);
+		if(i == 1) rot.v = Vec4f(0, 0, 0, -1);
+		if(i == 2) rot.v = Vec4f(0.5f, -0.5f, 0.5f, -0.5f); // All components equal magnitude.
+		const Vec4f unit_rot = normalise(rot.v);
+
+		uint64 encoded;
+		testAssert(encodeRotation(rot, encoded));
+		testAssert(encoded < (1ull << 47));
+		const Vec4f decoded = decodeRotation(encoded).v;
+		testAssert(std::fabs(length(decoded) - 1.f) < 1.0e-4f);
+		testAssert(myMin(maxComponentDiff(decoded, unit_rot), maxComponentDiff(decoded, Vec4f(0.f) - unit_rot)) < 1.0e-4f);
+	}
+
+	//-------------------- Test values that can't be quantized --------------------
+	{
+		QuantizedTransformUpdate q;
+		testAssert(!quantizeAvatarTransform(UID(1), Vec3d(std::numeric_limits<double>::quiet_NaN(), 0, 0), Vec3f(0.f), 0, q));
+		testAssert(!quantizeAvatarTransform(UID(1), Vec3d(0, 3.0e6, 0), Vec3f(0.f), 0, q));
+		testAssert(!quantizeAvatarTransform(UID(1), Vec3d(0, 0, 0), Vec3f(0, 0, std::numeric_limits<float>::infinity()), 0, q));
+		Quatf zero_rot;
+		zero_rot.v = Vec4f(0.f);
+		testAssert(!quantizeObjectPhysicsTransform(UID(1), Vec3d(0, 0, 0), zero_rot, Vec4f(0.f), Vec4f(0.f), 0, 0.0, q));
+		testAssert(quantizeAvatarTransform(UID(1), Vec3d(-1.9e6, 1.9e6, 0), Vec3f(0.f), 0, q));
+	}
+
+	//-------------------- Test message encoding round trip, and that truncated messages are rejected --------------------
+	{
+		const std::vector<TestTransform> transforms = makeTestTransforms(200, rng);
+
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		Encoder encoder;
+		encoder.begin(packet);
+		for(size_t i=0; i<transforms.size(); ++i)
+		{
+			QuantizedTransformUpdate q;
+			testAssert(quantize(transforms[i], q));
+			testAssert(encoder.addUpdate(q) > 0);
+		}
+		encoder.finish();
+		testAssert(encoder.numUpdates() == transforms.size());
+
+		std::vector<QuantizedTransformUpdate> decoded;
+		decodeMessage(packet, decoded);
+		testAssert(decoded.size() == transforms.size());
+		for(size_t i=0; i<transforms.size(); ++i)
+			checkDecodedTransform(transforms[i], decoded[i]);
+
+		for(size_t trunc_len = 8; trunc_len < packet.buf.size(); trunc_len += 7)
+		{
+			BufferInStream msg_buffer;
+			msg_buffer.buf.resize(trunc_len);
+			std::memcpy(msg_buffer.buf.data(), packet.buf.data(), trunc_len);
+			msg_buffer.read_index = 8;
+			try
+			{
+				readUpdates(msg_buffer, decoded);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		// Empty message
+		encoder.begin(packet);
+		encoder.finish();
+		decodeMessage(packet, decoded);
+		testAssert(decoded.empty());
+	}
+
+	//-------------------- Benchmark: bytes per update and encode / decode time per update --------------------
+	if(false)
+	{
+		const int num_updates = 1000;
+		const int num_trials = 100;
+		const std::vector<TestTransform> transforms = makeTestTransforms(num_updates, rng);
+
+		SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+		js::Vector<uint8, 16> legacy_data;
+
+		// Legacy messages
+		double legacy_encode_time = 1.0e10;
+		for(int trial=0; trial<num_trials; ++trial)
+		{
+			Timer timer;
+			legacy_data.clear();
+			for(size_t i=0; i<transforms.size(); ++i)
+			{
+				const TestTransform& t = transforms[i];
+				if(t.is_avatar)
+					writeLegacyAvatarTransformUpdate(scratch_packet, t.uid, t.pos, t.avatar_rotation, t.anim_state);
+				else
+					writeLegacyObjectPhysicsTransformUpdate(scratch_packet, t.uid, t.pos, t.rot, t.linear_vel, t.angular_vel, t.avatar_uid, t.client_time);
+				const size_t write_i = legacy_data.size();
+				legacy_data.resize(write_i + scratch_packet.buf.size());
+				std::memcpy(&legacy_data[write_i], scratch_packet.buf.data(), scratch_packet.buf.size());
+			}
+			legacy_encode_time = myMin(legacy_encode_time, timer.elapsed());
+		}
+
+		// Quantized messages.  Quantization is done once per update on the server, encoding is done once per client.
+		std::vector<QuantizedTransformUpdate> quantized(transforms.size());
+		double quantize_time = 1.0e10;
+		for(int trial=0; trial<num_trials; ++trial)
+		{
+			Timer timer;
+			for(size_t i=0; i<transforms.size(); ++i)
+				quantize(transforms[i], quantized[i]);
+			quantize_time = myMin(quantize_time, timer.elapsed());
+		}
+
+		double encode_time = 1.0e10;
+		for(int trial=0; trial<num_trials; ++trial)
+		{
+			Timer timer;
+			Encoder encoder;
+			encoder.begin(packet);
+			for(size_t i=0; i<quantized.size(); ++i)
+				encoder.addUpdate(quantized[i]);
+			encoder.finish();
+			encode_time = myMin(encode_time, timer.elapsed());
+		}
+
+		BufferInStream msg_buffer;
+		msg_buffer.buf.resize(packet.buf.size());
+		std::memcpy(msg_buffer.buf.data(), packet.buf.data(), packet.buf.size());
+		std::vector<QuantizedTransformUpdate> decoded;
+		double decode_time = 1.0e10;
+		for(int trial=0; trial<num_trials; ++trial)
+		{
+			Timer timer;
+			msg_buffer.read_index = sizeof(uint32) * 2;
+			readUpdates(msg_buffer, decoded);
+			decode_time = myMin(decode_time, timer.elapsed());
+		}
+		testAssert(decoded.size() == transforms.size());
+		for(size_t i=0; i<transforms.size(); ++i)
+			checkDecodedTransform(transforms[i], decoded[i]);
+
+		conPrint("Transform updates (" + toString(num_updates) + " updates, 1/4 avatars, 2/3 of objects moving):");
+		conPrint("    legacy messages:    " + doubleToStringNSigFigs((double)legacy_data.size() / num_updates, 4) + " B / update, encode: " +
+			doubleToStringNSigFigs(legacy_encode_time * 1.0e9 / num_updates, 4) + " ns / update");
+		conPrint("    quantized message:  " + doubleToStringNSigFigs((double)packet.buf.size() / num_updates, 4) + " B / update, quantize: " +
+			doubleToStringNSigFigs(quantize_time * 1.0e9 / num_updates, 4) + " ns / update, encode: " + doubleToStringNSigFigs(encode_time * 1.0e9 / num_updates, 4) +
+			" ns / update, decode: " + doubleToStringNSigFigs(decode_time * 1.0e9 / num_updates, 4) + " ns / update");
+
+		testAssert(packet.buf.size() * 2 < legacy_data.size());
+	}
+
+	conPrint("QuantizedTransformUpdates::test() done.");
+}
+
+
+#endif // BUILD_TESTS
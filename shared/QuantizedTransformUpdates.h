@@ -0,0 +1,117 @@
+/*=====================================================================
+QuantizedTransformUpdates.h
+---------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "UID.h"
+#include <maths/vec3.h>
+#include <maths/Vec4f.h>
+#include <maths/Quat.h>
+#include <utils/Platform.h>
+#include <vector>
+class SocketBufferOutStream;
+class BufferInStream;
+
+
+/*=====================================================================
+QuantizedTransformUpdate
+------------------------
+An avatar transform update or object physics transform update, with all values quantized to integers,
+for sending in a Protocol::QuantizedTransformUpdates message.
+=====================================================================*/
+struct QuantizedTransformUpdate
+{
+	enum Type
+	{
+		Type_AvatarTransform = 0,
+		Type_ObjectPhysicsTransform = 1
+	};
+
+	Type type;
+	uint64 uid; // Avatar UID or object UID.
+	int32 pos[3]; // In units of QuantizedTransformUpdates::POS_QUANTUM.
+
+	// Avatar transform:
+	int32 avatar_rotation[3]; // (roll, pitch, heading), in units of QuantizedTransformUpdates::ANGLE_QUANTUM.
+	uint32 anim_state;
+
+	// Object physics transform:
+	uint64 rot; // Rotation quaternion, encoded with the 'smallest three' method in 48 bits.
+	int32 linear_vel[3]; // In units of QuantizedTransformUpdates::VEL_QUANTUM.
+	int32 angular_vel[3]; // In units of QuantizedTransformUpdates::ANG_VEL_QUANTUM.
+	uint32 transform_update_avatar_uid;
+	int64 client_time; // In units of QuantizedTransformUpdates::TIME_QUANTUM.
+};
+
+
+/*=====================================================================
+QuantizedTransformUpdates
+-------------------------
+Compact encoding of many AvatarTransformUpdate and ObjectPhysicsTransformUpdate messages into a single
+Protocol::QuantizedTransformUpdates message.  Sent to clients with protocol version >= 40.
+
+Message layout after the usual message type and length:
+	uint32 num_updates
+	num_updates records of:
+		uint8 flags (record type, which optional fields are present)
+		varint uid delta, pos deltas (relative to the previous record in the message)
+		avatar: varint rotation angles, varint anim_state
+		object: 48-bit rotation, [varint linear vel], [varint angular vel], [varint avatar uid], varint client time delta
+
+Varints are LEB128 encoded, signed values are zigzag encoded first.
+Velocities that are zero, and transform_update_avatar_uid if it is the same as the previous object record, are omitted.
+=====================================================================*/
+namespace QuantizedTransformUpdates
+{
+	const double POS_QUANTUM = 1.0 / 1024; // metres
+	const double ANGLE_QUANTUM = 1.0 / 4096; // radians
+	const double VEL_QUANTUM = 1.0 / 512; // metres / s
+	const double ANG_VEL_QUANTUM = 1.0 / 1024; // radians / s
+	const double TIME_QUANTUM = 1.0e-4; // seconds
+
+	// Returns false if the transform can't be quantized, for example if the position is not finite or is too far from the origin.
+	// In that case the original, unquantized message should be sent instead.
+	bool quantizeAvatarTransform(const UID& uid, const Vec3d& pos, const Vec3f& rotation, uint32 anim_state, QuantizedTransformUpdate& update_out);
+	bool quantizeObjectPhysicsTransform(const UID& uid, const Vec3d& pos, const Quatf& rot, const Vec4f& linear_vel, const Vec4f& angular_vel,
+		uint32 transform_update_avatar_uid, double client_time, QuantizedTransformUpdate& update_out);
+
+	Vec3d getPos(const QuantizedTransformUpdate& update);
+	Vec3f getAvatarRotation(const QuantizedTransformUpdate& update);
+	Quatf getRotation(const QuantizedTransformUpdate& update);
+	Vec4f getLinearVel(const QuantizedTransformUpdate& update);
+	Vec4f getAngularVel(const QuantizedTransformUpdate& update);
+	double getClientTime(const QuantizedTransformUpdate& update);
+
+
+	// Writes a Protocol::QuantizedTransformUpdates message to a packet.
+	class Encoder
+	{
+	public:
+		Encoder();
+
+		void begin(SocketBufferOutStream& packet); // Inits the packet with the message header.
+		size_t addUpdate(const QuantizedTransformUpdate& update); // Returns number of bytes written for the update.
+		void finish(); // Writes the number of updates and the message length.
+
+		size_t numUpdates() const { return num_updates; }
+
+	private:
+		SocketBufferOutStream* packet;
+		size_t num_updates_offset;
+		uint32 num_updates;
+		uint64 prev_uid;
+		int32 prev_pos[3];
+		bool have_prev_physics_update;
+		uint32 prev_transform_update_avatar_uid;
+		int64 prev_client_time;
+	};
+
+	// Reads the body of a Protocol::QuantizedTransformUpdates message (after the message type and length) from msg_buffer.
+	// Throws glare::Exception on invalid or truncated data.
+	void readUpdates(BufferInStream& msg_buffer, std::vector<QuantizedTransformUpdate>& updates_out);
+
+	void test();
+}
@@ -159,6 +159,20 @@ ResourceRef ResourceManager::getExistingResourceForURL(const std::string& URL) /
 }
 
 
+void ResourceManager::getExistingResourcesForURLs(const std::vector<std::string>& URLs, std::vector<ResourceRef>& resources_out) // Threadsafe
+{
+	resources_out.resize(URLs.size());
+
+	Lock lock(mutex);
+
+	for(size_t i=0; i<URLs.size(); ++i)
+	{
+		auto res = resource_for_url.find(URLs[i]);
+		resources_out[i] = (res == resource_for_url.end()) ? ResourceRef() : res->second;
+	}
+}
+
+
 void ResourceManager::copyLocalFileToResourceDir(const std::string& local_path, const std::string& URL) // Threadsafe
 {
 	try
@@ -44,6 +44,9 @@ public:
 	// Returns null reference if no resource object for URL inserted.
 	ResourceRef getExistingResourceForURL(const std::string& URL); // Threadsafe
 
+	// Like getExistingResourceForURL, for each URL in URLs, but only takes the mutex once.  resources_out[i] is null if there is no resource for URLs[i].
+	void getExistingResourcesForURLs(const std::vector<std::string>& URLs, std::vector<ResourceRef>& resources_out); // Threadsafe
+
 	// Copy a local file with given local path and corresponding URL into the resource dir, if there is no file in the
 	// destination location.
 	// Throws glare::Exception on failure.
@@ -0,0 +1,43 @@
+/*=====================================================================
+TaskCompletionCounter.cpp
+-------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "TaskCompletionCounter.h"
+
+
+#include <utils/Lock.h>
+
+
+TaskCompletionCounter::TaskCompletionCounter()
+:	num_remaining(0)
+{}
+
+
+TaskCompletionCounter::~TaskCompletionCounter()
+{}
+
+
+void TaskCompletionCounter::setNumTasks(size_t num_tasks)
+{
+	Lock lock(mutex);
+	num_remaining = num_tasks;
+}
+
+
+void TaskCompletionCounter::taskFinished()
+{
+	Lock lock(mutex);
+	assert(num_remaining > 0);
+	num_remaining--;
+	if(num_remaining == 0)
+		condition.notifyAll();
+}
+
+
+void TaskCompletionCounter::waitForTasks()
+{
+	Lock lock(mutex);
+	while(num_remaining > 0)
+		condition.wait(mutex); // Suspend until a task finishes, or we get a spurious wake up.
+}
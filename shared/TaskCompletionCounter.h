@@ -0,0 +1,41 @@
+/*=====================================================================
+TaskCompletionCounter.h
+-----------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/Mutex.h>
+#include <utils/Condition.h>
+#include <utils/Platform.h>
+
+
+/*=====================================================================
+TaskCompletionCounter
+---------------------
+Counts the tasks added by a single call that have not finished yet, so the call can wait for just those tasks.
+
+TaskManager::waitForTasksToComplete() waits for every task in the manager, so when the manager is shared,
+for example the engine or GUIClient task manager, it would also wait on unrelated, possibly long-running tasks.
+
+Usage: call setNumTasks() before adding the tasks, have each task call taskFinished() at the end of run(),
+whether or not it succeeded, then call waitForTasks().
+=====================================================================*/
+class TaskCompletionCounter
+{
+public:
+	TaskCompletionCounter();
+	~TaskCompletionCounter();
+
+	void setNumTasks(size_t num_tasks); // Should be called before the tasks are added.
+	void taskFinished(); // Called by each task at the end of run().  threadsafe.
+	void waitForTasks(); // Blocks until taskFinished() has been called num_tasks times.
+
+private:
+	GLARE_DISABLE_COPY(TaskCompletionCounter);
+
+	Mutex mutex;
+	Condition condition;
+	size_t num_remaining GUARDED_BY(mutex);
+};
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2022 -
 
 
 #include "../shared/WorldObject.h"
+#include "../shared/TaskCompletionCounter.h"
 #include "../dll/include/IndigoException.h"
 #include "../dll/IndigoStringUtils.h"
 #include "../utils/ShouldCancelCallback.h"
@@ -20,10 +21,12 @@ Copyright Glare Technologies Limited 2022 -
 #include "../utils/Sort.h"
 #include "../utils/Array2D.h"
 #include "../utils/Array3D.h"
+#include "../utils/TaskManager.h"
 #if GUI_CLIENT
 #include "superluminal/PerformanceAPI.h"
 #endif
 #include <limits>
+#include <new>
 
 
 #if 0
@@ -60,149 +63,108 @@ struct VoxelBounds
 typedef uint8 VoxelMatIndexType;
 
 
-// Does greedy meshing.
-// Splats voxels to 3d array.
-static Reference<Indigo::Mesh> doMakeIndigoMeshForVoxelGroupWith3dArray(const js::Vector<Voxel, 16>& voxels, int subsample_factor, const js::Vector<bool, 16>& mats_transparent_)
-{
-#if GUI_CLIENT
-	PERFORMANCEAPI_INSTRUMENT_FUNCTION();
-#endif
+typedef HashMapInsertOnly2<Indigo::Vec3f, int, Vec3fHashFunc> VertPosHashMap;
 
-	try
-	{
-		if(voxels.empty())
-			throw glare::Exception("No voxels");
 
-		Reference<Indigo::Mesh> mesh = new Indigo::Mesh();
+static inline unsigned int getOrAddVertex(const Indigo::Vec3f& v, VertPosHashMap& vertpos_hash, Indigo::Mesh& mesh)
+{
+	// returns object of type std::pair<iterator, bool>
+	const auto insert_res = vertpos_hash.insert(std::make_pair(v, (int)vertpos_hash.size())); // Try and insert vertex
+	if(insert_res.second) // If inserted new value:
+		mesh.vert_positions.push_back(v);
+	return insert_res.first->second; // Get existing or new item (insert_res.first) - a (vec3f, index) pair, then get the index.
+}
 
-		const Indigo::Vec3f vertpos_empty_key(std::numeric_limits<float>::max());
-		HashMapInsertOnly2<Indigo::Vec3f, int, Vec3fHashFunc> vertpos_hash(/*empty key=*/vertpos_empty_key, /*expected_num_items=*/voxels.size());
 
-		mesh->vert_positions.reserve(voxels.size());
-		mesh->triangles.reserve(voxels.size());
+static inline void addQuadTris(const unsigned int v_i[4], uint32 mat_index, Indigo::Mesh& mesh)
+{
+	const size_t tri_start = mesh.triangles.size();
+	mesh.triangles.resize(tri_start + 2);
+
+	mesh.triangles[tri_start + 0].vertex_indices[0] = v_i[0];
+	mesh.triangles[tri_start + 0].vertex_indices[1] = v_i[1];
+	mesh.triangles[tri_start + 0].vertex_indices[2] = v_i[2];
+	mesh.triangles[tri_start + 0].uv_indices[0]     = 0;
+	mesh.triangles[tri_start + 0].uv_indices[1]     = 0;
+	mesh.triangles[tri_start + 0].uv_indices[2]     = 0;
+	mesh.triangles[tri_start + 0].tri_mat_index     = mat_index;
+
+	mesh.triangles[tri_start + 1].vertex_indices[0] = v_i[0];
+	mesh.triangles[tri_start + 1].vertex_indices[1] = v_i[2];
+	mesh.triangles[tri_start + 1].vertex_indices[2] = v_i[3];
+	mesh.triangles[tri_start + 1].uv_indices[0]     = 0;
+	mesh.triangles[tri_start + 1].uv_indices[1]     = 0;
+	mesh.triangles[tri_start + 1].uv_indices[2]     = 0;
+	mesh.triangles[tri_start + 1].tri_mat_index     = mat_index;
+}
 
-		mesh->setMaxNumTexcoordSets(0);
 
-		// Do a pass over the voxels to get the bounds
-		Vec4i bounds_min(std::numeric_limits<int>::max());
-		Vec4i bounds_max(std::numeric_limits<int>::min());
-		int max_mat_index = 0;
-		for(size_t i=0; i<voxels.size(); ++i)
+// Does greedy meshing of the voxels in voxel_array with array indices in [region_begin, region_end), adding quads to mesh.
+// Voxels in the array but outside of the region are only used to decide which faces of voxels in the region are visible, so adjacent regions can be meshed independently.
+// Voxels outside of the array are treated as empty.
+// array_origin is the voxel position of array element (0, 0, 0).
+static void greedyMeshVoxelArrayRegion(const Array3D<VoxelMatIndexType>& voxel_array, const Vec3<int>& array_res, const Vec3<int>& array_origin, 
+	const Vec3<int>& region_begin, const Vec3<int>& region_end, const bool* mat_transparent, VertPosHashMap& vertpos_hash, Indigo::Mesh& mesh)
+{
+	const VoxelMatIndexType no_voxel_mat = std::numeric_limits<VoxelMatIndexType>::max();
+
+	// For each dimension (x, y, z)
+	for(int dim=0; dim<3; ++dim)
+	{
+		// Want the a_axis x b_axis = dim_axis
+		int dim_a, dim_b;
+		if(dim == 0)
 		{
-			const Vec4i vox_pos = Vec4i(voxels[i].pos.x / subsample_factor, voxels[i].pos.y / subsample_factor, voxels[i].pos.z / subsample_factor, 0);
-			bounds_min = min(bounds_min, vox_pos);
-			bounds_max = max(bounds_max, vox_pos);
-			if(voxels[i].mat_index < 0)
-				throw glare::Exception("Invalid mat index (< 0)");
-			max_mat_index = myMax(voxels[i].mat_index, max_mat_index);
+			dim_a = 1;
+			dim_b = 2;
 		}
-
-		// We want to be able to fit all the material indices, plus the 'no voxel' index, into the 256 values of a uint8.  So mat_index of 255 = no voxel index.
-		if(max_mat_index >= 255) 
-			throw glare::Exception("Too many materials");
-
-
-		// Build a local array of mat-transparent booleans, one for each material.  If no such entry in mats_transparent_ for a given index, assume opaque.
-		bool mat_transparent[256];
-		for(size_t i=0; i<256; ++i)
-			mat_transparent[i] = (i < mats_transparent_.size()) && mats_transparent_[i];
-	
-
-		VoxelBounds bounds;
-		bounds.min = Vec3<int>(bounds_min[0], bounds_min[1], bounds_min[2]);
-		bounds.max = Vec3<int>(bounds_max[0], bounds_max[1], bounds_max[2]);
-
-		// Limit voxel coordinates to something reasonable.  Also avoids integer overflows in the res computation below.
-		const int min_coord = -1000000;
-		const int max_coord =  1000000;
-		if(bounds_min[0] < min_coord || bounds_min[1] < min_coord || bounds_min[2] < min_coord)
-			throw glare::Exception("Invalid voxel position coord: " + bounds_min.toString());
-		if(bounds_max[0] > max_coord || bounds_max[1] > max_coord || bounds_max[2] > max_coord)
-			throw glare::Exception("Invalid voxel position coord: " + bounds_max.toString());
-	
-		// Do a pass over the voxels to splat into a 3d array
-		const Vec3<int> res = bounds.max - bounds.min + Vec3<int>(1); // Voxel array resolution
-
-		const int max_dim_w = 100000;
-		if(res.x > max_dim_w || res.y > max_dim_w || res.z > max_dim_w)
-			throw glare::Exception("Voxel dimension span exceeds " + toString(max_dim_w));
-
-		const int64 voxel_array_size = (int64)res.x * (int64)res.y * (int64)res.z; // Use int64 to avoid overflow.
-		const int64 max_voxel_array_size = (1 << 26) / sizeof(VoxelMatIndexType); // 64 MB, ~64 million voxels
-		if(voxel_array_size > max_voxel_array_size)
-			throw glare::Exception("Voxel array num voxels (" + toString(voxel_array_size) + ") exceeds limit of " + toString(max_voxel_array_size));
-
-		const VoxelMatIndexType no_voxel_mat = std::numeric_limits<VoxelMatIndexType>::max();
-		Array3D<VoxelMatIndexType> voxel_array(res.x, res.y, res.z, no_voxel_mat);
-
-		for(size_t i=0; i<voxels.size(); ++i)
+		else if(dim == 1)
 		{
-			const Voxel& voxel = voxels[i];
-			const Vec4i vox_pos = Vec4i(voxels[i].pos.x / subsample_factor, voxels[i].pos.y / subsample_factor, voxels[i].pos.z / subsample_factor, 0);
-			const Vec4i indices = vox_pos - bounds_min;
-			voxel_array.elem(indices[0], indices[1], indices[2]) = (VoxelMatIndexType)voxel.mat_index;
+			dim_a = 2;
+			dim_b = 0;
 		}
-
-		//if(voxel_array.getData().size() > 100000)
-		//	conPrint("voxel_array size: " + toString(voxel_array.getData().size()) + " elems, " + toString(voxel_array.getData().dataSizeBytes()) + " B");
-
-		// For each dimension (x, y, z)
-		for(int dim=0; dim<3; ++dim)
+		else // dim == 2:
 		{
-			// Want the a_axis x b_axis = dim_axis
-			int dim_a, dim_b;
-			if(dim == 0)
-			{
-				dim_a = 1;
-				dim_b = 2;
-			}
-			else if(dim == 1)
-			{
-				dim_a = 2;
-				dim_b = 0;
-			}
-			else // dim == 2:
-			{
-				dim_a = 0;
-				dim_b = 1;
-			}
+			dim_a = 0;
+			dim_b = 1;
+		}
 
-			// Get the extents along dim_a, dim_b
-			const int a_min = bounds.min[dim_a];
-			const int a_size = res[dim_a];
+		// Get the extents of the region along dim_a, dim_b
+		const int a_begin = region_begin[dim_a];
+		const int a_size = region_end[dim_a] - a_begin;
 
-			const int b_min = bounds.min[dim_b];
-			const int b_size = res[dim_b];
+		const int b_begin = region_begin[dim_b];
+		const int b_size = region_end[dim_b] - b_begin;
 
-			// Walk from lower to greater coords, look for downwards facing faces
-			const int dim_min = bounds.min[dim];
-			const int dim_size = res[dim];
+		// An array of faces that still need to be processed.  We store the face material index if the face needs to be processed, and no_voxel_mat otherwise.  Processed = included in a greedy quad already.
+		Array2D<VoxelMatIndexType> face_needed_mat(a_size, b_size);
 
-			// An array of faces that still need to be processed.  We store the face material index if the face needs to be processed, and no_voxel_mat otherwise.  Processed = included in a greedy quad already.
-			Array2D<VoxelMatIndexType> face_needed_mat(a_size, b_size);
-
-			for(int dim_coord = 0; dim_coord < dim_size; ++dim_coord)
+		// Walk from lower to greater coords
+		for(int dim_coord = region_begin[dim]; dim_coord < region_end[dim]; ++dim_coord)
+		{
+			// Do lower faces along dim (side = 0), then upper faces (side = 1)
+			for(int side=0; side<2; ++side)
 			{
 				Vec3<int> vox_indices, adjacent_vox_indices; // pos coords of current voxel, and adjacent voxel
+				vox_indices[dim] = dim_coord;
+				adjacent_vox_indices[dim] = (side == 0) ? (dim_coord - 1) : (dim_coord + 1);
+				const bool adjacent_in_array = (adjacent_vox_indices[dim] >= 0) && (adjacent_vox_indices[dim] < array_res[dim]);
 
-				//================= Do lower faces along dim ==========================
 				// Build face_needed data for this slice
-				vox_indices[dim] = dim_coord;
-				adjacent_vox_indices[dim] = dim_coord - 1;
 				for(int y=0; y<b_size; ++y)
 				for(int x=0; x<a_size; ++x)
 				{
-					vox_indices[dim_a] = x;
-					vox_indices[dim_b] = y;
+					vox_indices[dim_a] = a_begin + x;
+					vox_indices[dim_b] = b_begin + y;
 
 					VoxelMatIndexType this_face_needed_mat = no_voxel_mat;
 					const auto vox_mat_index = voxel_array.elem(vox_indices.x, vox_indices.y, vox_indices.z);
 					if(vox_mat_index != no_voxel_mat) // If there is a voxel here
 					{
-						adjacent_vox_indices[dim_a] = x;
-						adjacent_vox_indices[dim_b] = y;
-						if(dim_coord > 0) // If adjacent vox indices are in array bounds: (if dim_coord - 1 >= 0)
+						if(adjacent_in_array)
 						{
+							adjacent_vox_indices[dim_a] = a_begin + x;
+							adjacent_vox_indices[dim_b] = b_begin + y;
 							const auto adjacent_vox_mat_index = voxel_array.elem(adjacent_vox_indices.x, adjacent_vox_indices.y, adjacent_vox_indices.z);
 
 							// For an opaque or transparent voxel (the material assigned to it at least), adjacent to an empty voxel, we want to create a face.
@@ -284,243 +246,147 @@ static Reference<Indigo::Mesh> doMakeIndigoMeshForVoxelGroupWith3dArray(const js
 						// Add the greedy quad
 						unsigned int v_i[4]; // quad vert indices
 						Indigo::Vec3f v; // Vertex position coordinates
-						v[dim] = (float)(dim_coord + dim_min);
-
-						const float start_x_coord = (float)(start_x + a_min);
-						const float start_y_coord = (float)(start_y + b_min);
-						const float end_x_coord   = (float)(end_x + a_min);
-						const float end_y_coord   = (float)(end_y + b_min);
-
+						v[dim] = (float)(dim_coord + array_origin[dim] + side);
+
+						const float start_x_coord = (float)(start_x + a_begin + array_origin[dim_a]);
+						const float start_y_coord = (float)(start_y + b_begin + array_origin[dim_b]);
+						const float end_x_coord   = (float)(end_x   + a_begin + array_origin[dim_a]);
+						const float end_y_coord   = (float)(end_y   + b_begin + array_origin[dim_b]);
+
+						// Vertices are ordered so that the quad faces outwards from the voxel.
+						v[dim_a] = start_x_coord; // bot left
+						v[dim_b] = start_y_coord;
+						v_i[0] = getOrAddVertex(v, vertpos_hash, mesh);
+						if(side == 0)
 						{
-							// bot left
-							v[dim_a] = start_x_coord;
-							v[dim_b] = start_y_coord;
-
-							// returns object of type std::pair<iterator, bool>
-							const auto insert_res = vertpos_hash.insert(std::make_pair(v, (int)vertpos_hash.size())); // Try and insert vertex
-							v_i[0] = insert_res.first->second; // Get existing or new item (insert_res.first) - a (vec3f, index) pair, then get the index.
-							if(insert_res.second) // If inserted new value:
-								mesh->vert_positions.push_back(v);
-						}
-						{
-							// top left
-							v[dim_a] = start_x_coord;
+							v[dim_a] = start_x_coord; // top left
 							v[dim_b] = end_y_coord;
-
-							const auto insert_res = vertpos_hash.insert(std::make_pair(v, (int)vertpos_hash.size()));
-							v_i[1] = insert_res.first->second; // deref iterator to get (vec3f, index) pair, then get the index.
-							if(insert_res.second) // If inserted new value:
-								mesh->vert_positions.push_back(v);
-						}
-						{
-							// top right
-							v[dim_a] = end_x_coord;
+							v_i[1] = getOrAddVertex(v, vertpos_hash, mesh);
+							v[dim_a] = end_x_coord; // top right
 							v[dim_b] = end_y_coord;
-
-							const auto insert_res = vertpos_hash.insert(std::make_pair(v, (int)vertpos_hash.size()));
-							v_i[2] = insert_res.first->second; // deref iterator to get (vec3f, index) pair, then get the index.
-							if(insert_res.second) // If inserted new value:
-								mesh->vert_positions.push_back(v);
+							v_i[2] = getOrAddVertex(v, vertpos_hash, mesh);
+							v[dim_a] = end_x_coord; // bot right
+							v[dim_b] = start_y_coord;
+							v_i[3] = getOrAddVertex(v, vertpos_hash, mesh);
 						}
+						else
 						{
-							// bot right
-							v[dim_a] = end_x_coord;
+							v[dim_a] = end_x_coord; // bot right
 							v[dim_b] = start_y_coord;
-
-							const auto insert_res = vertpos_hash.insert(std::make_pair(v, (int)vertpos_hash.size()));
-							v_i[3] = insert_res.first->second; // deref iterator to get (vec3f, index) pair, then get the index.
-							if(insert_res.second) // If inserted new value:
-								mesh->vert_positions.push_back(v);
+							v_i[1] = getOrAddVertex(v, vertpos_hash, mesh);
+							v[dim_a] = end_x_coord; // top right
+							v[dim_b] = end_y_coord;
+							v_i[2] = getOrAddVertex(v, vertpos_hash, mesh);
+							v[dim_a] = start_x_coord; // top left
+							v[dim_b] = end_y_coord;
+							v_i[3] = getOrAddVertex(v, vertpos_hash, mesh);
 						}
 
-						assert(mesh->vert_positions.size() == vertpos_hash.size());
-
-						const size_t tri_start = mesh->triangles.size();
-						mesh->triangles.resize(tri_start + 2);
-
+						assert(mesh.vert_positions.size() == vertpos_hash.size());
 						assert(start_face_needed_mat != no_voxel_mat);
 
-						mesh->triangles[tri_start + 0].vertex_indices[0] = v_i[0];
-						mesh->triangles[tri_start + 0].vertex_indices[1] = v_i[1];
-						mesh->triangles[tri_start + 0].vertex_indices[2] = v_i[2];
-						mesh->triangles[tri_start + 0].uv_indices[0]     = 0;
-						mesh->triangles[tri_start + 0].uv_indices[1]     = 0;
-						mesh->triangles[tri_start + 0].uv_indices[2]     = 0;
-						mesh->triangles[tri_start + 0].tri_mat_index     = (uint32)start_face_needed_mat;
-
-						mesh->triangles[tri_start + 1].vertex_indices[0] = v_i[0];
-						mesh->triangles[tri_start + 1].vertex_indices[1] = v_i[2];
-						mesh->triangles[tri_start + 1].vertex_indices[2] = v_i[3];
-						mesh->triangles[tri_start + 1].uv_indices[0]     = 0;
-						mesh->triangles[tri_start + 1].uv_indices[1]     = 0;
-						mesh->triangles[tri_start + 1].uv_indices[2]     = 0;
-						mesh->triangles[tri_start + 1].tri_mat_index     = (uint32)start_face_needed_mat;
+						addQuadTris(v_i, (uint32)start_face_needed_mat, mesh);
 					}
 				}
+			} // End for each side
+		}
+	} // End for each dim
+}
 
-				//================= Do upper faces along dim ==========================
-				// Build face_needed data for this slice
-				adjacent_vox_indices[dim] = dim_coord + 1;
-				for(int y=0; y<b_size; ++y)
-				for(int x=0; x<a_size; ++x)
-				{
-					vox_indices[dim_a] = x;
-					vox_indices[dim_b] = y;
-					const auto vox_mat_index = voxel_array.elem(vox_indices.x, vox_indices.y, vox_indices.z);
 
-					VoxelMatIndexType this_face_needed_mat = no_voxel_mat;
-					if(vox_mat_index != no_voxel_mat) // If there is a voxel here
-					{
-						adjacent_vox_indices[dim_a] = x;
-						adjacent_vox_indices[dim_b] = y;
-						if(dim_coord < dim_size - 1) // If adjacent vox indices are in array bounds: (if dim_coord + 1 < dim_size)
-						{
-							const auto adjacent_vox_mat_index = voxel_array.elem(adjacent_vox_indices.x, adjacent_vox_indices.y, adjacent_vox_indices.z);
-							if((adjacent_vox_mat_index == no_voxel_mat) || 
-								(mat_transparent[adjacent_vox_mat_index] && (adjacent_vox_mat_index != vox_mat_index)))
-								this_face_needed_mat = vox_mat_index;
-						}
-						else
-							this_face_needed_mat = vox_mat_index;
-					}
-					face_needed_mat.elem(x, y) = this_face_needed_mat;
-				}
+// Limit voxel coordinates to something reasonable.  Also avoids integer overflows in array resolution computations.
+static const int MIN_VOXEL_COORD = -1000000;
+static const int MAX_VOXEL_COORD =  1000000;
 
-				// For each voxel face:
-				for(int start_y=0; start_y<b_size; ++start_y)
-				for(int start_x=0; start_x<a_size; ++start_x)
-				{
-					const int start_face_needed_mat = face_needed_mat.elem(start_x, start_y);
-					if(start_face_needed_mat != no_voxel_mat)
-					{
-						// Start a quad here (start corner at (start_x, start_y))
-						// The quad will range from (start_x, start_y) to (end_x, end_y)
-						int end_x = start_x + 1;
-						int end_y = start_y + 1;
 
-						bool x_increase_ok = true;
-						bool y_increase_ok = true;
-						while(x_increase_ok || y_increase_ok)
-						{
-							// Try and increase in x direction
-							if(x_increase_ok)
-							{
-								if(end_x < a_size) // If there is still room to increase in x direction:
-								{
-									// Check y values for new x = end_x
-									for(int y = start_y; y < end_y; ++y)
-										if(face_needed_mat.elem(end_x, y) != start_face_needed_mat)
-										{
-											x_increase_ok = false;
-											break;
-										}
+// Build a local array of mat-transparent booleans, one for each material.  If no such entry in mats_transparent_ for a given index, assume opaque.
+static void buildMatTransparentArray(const js::Vector<bool, 16>& mats_transparent, bool mat_transparent_out[256])
+{
+	for(size_t i=0; i<256; ++i)
+		mat_transparent_out[i] = (i < mats_transparent.size()) && mats_transparent[i];
+}
 
-									if(x_increase_ok)
-										end_x++;
-								}
-								else
-									x_increase_ok = false;
-							}
 
-							// Try and increase in y direction
-							if(y_increase_ok)
-							{
-								if(end_y < b_size)
-								{
-									// Check x values for new y = end_y
-									for(int x = start_x; x < end_x; ++x)
-										if(face_needed_mat.elem(x, end_y) != start_face_needed_mat)
-										{
-											y_increase_ok = false;
-											break;
-										}
+// Does greedy meshing.
+// Splats voxels to 3d array.
+static Reference<Indigo::Mesh> doMakeIndigoMeshForVoxelGroupWith3dArray(const js::Vector<Voxel, 16>& voxels, int subsample_factor, const js::Vector<bool, 16>& mats_transparent_)
+{
+#if GUI_CLIENT
+	PERFORMANCEAPI_INSTRUMENT_FUNCTION();
+#endif
 
-									if(y_increase_ok)
-										end_y++;
-								}
-								else
-									y_increase_ok = false;
-							}
-						}
+	try
+	{
+		if(voxels.empty())
+			throw glare::Exception("No voxels");
 
-						// We have worked out the greedy quad.  Mark elements in it as processed
-						for(int y=start_y; y < end_y; ++y)
-						for(int x=start_x; x < end_x; ++x)
-							face_needed_mat.elem(x, y) = no_voxel_mat;
+		Reference<Indigo::Mesh> mesh = new Indigo::Mesh();
 
-						// Add the greedy quad
-						unsigned int v_i[4]; // quad vert indices
-						Indigo::Vec3f v;
-						v[dim] = (float)(dim_coord + dim_min + 1);
+		const Indigo::Vec3f vertpos_empty_key(std::numeric_limits<float>::max());
+		VertPosHashMap vertpos_hash(/*empty key=*/vertpos_empty_key, /*expected_num_items=*/voxels.size());
 
-						const float start_x_coord = (float)(start_x + a_min);
-						const float start_y_coord = (float)(start_y + b_min);
-						const float end_x_coord   = (float)(end_x + a_min);
-						const float end_y_coord   = (float)(end_y + b_min);
+		mesh->vert_positions.reserve(voxels.size());
+		mesh->triangles.reserve(voxels.size());
 
-						{ // Add bot left vert
-							v[dim_a] = start_x_coord;
-							v[dim_b] = start_y_coord;
+		mesh->setMaxNumTexcoordSets(0);
 
-							const auto insert_res = vertpos_hash.insert(std::make_pair(v, (int)vertpos_hash.size()));
-							v_i[0] = insert_res.first->second; // deref iterator to get (vec3f, index) pair, then get the index.
-							if(insert_res.second) // If inserted new value:
-								mesh->vert_positions.push_back(v);
-						}
-						{ // bot right
-							v[dim_a] = end_x_coord;
-							v[dim_b] = start_y_coord;
+		// Do a pass over the voxels to get the bounds
+		Vec4i bounds_min(std::numeric_limits<int>::max());
+		Vec4i bounds_max(std::numeric_limits<int>::min());
+		int max_mat_index = 0;
+		for(size_t i=0; i<voxels.size(); ++i)
+		{
+			const Vec4i vox_pos = Vec4i(voxels[i].pos.x / subsample_factor, voxels[i].pos.y / subsample_factor, voxels[i].pos.z / subsample_factor, 0);
+			bounds_min = min(bounds_min, vox_pos);
+			bounds_max = max(bounds_max, vox_pos);
+			if(voxels[i].mat_index < 0)
+				throw glare::Exception("Invalid mat index (< 0)");
+			max_mat_index = myMax(voxels[i].mat_index, max_mat_index);
+		}
 
-							const auto insert_res = vertpos_hash.insert(std::make_pair(v, (int)vertpos_hash.size()));
-							v_i[1] = insert_res.first->second; // deref iterator to get (vec3f, index) pair, then get the index.
-							if(insert_res.second) // If inserted new value:
-								mesh->vert_positions.push_back(v);
-						}
-						{ // top right
-							v[dim_a] = end_x_coord;
-							v[dim_b] = end_y_coord;
+		// We want to be able to fit all the material indices, plus the 'no voxel' index, into the 256 values of a uint8.  So mat_index of 255 = no voxel index.
+		if(max_mat_index >= 255) 
+			throw glare::Exception("Too many materials");
 
-							const auto insert_res = vertpos_hash.insert(std::make_pair(v, (int)vertpos_hash.size()));
-							v_i[2] = insert_res.first->second; // deref iterator to get (vec3f, index) pair, then get the index.
-							if(insert_res.second) // If inserted new value:
-								mesh->vert_positions.push_back(v);
-						}
-						{ // top left
-							v[dim_a] = start_x_coord;
-							v[dim_b] = end_y_coord;
+		bool mat_transparent[256];
+		buildMatTransparentArray(mats_transparent_, mat_transparent);
 
-							const auto insert_res = vertpos_hash.insert(std::make_pair(v, (int)vertpos_hash.size()));
-							v_i[3] = insert_res.first->second; // deref iterator to get (vec3f, index) pair, then get the index.
-							if(insert_res.second) // If inserted new value:
-								mesh->vert_positions.push_back(v);
-						}
+		VoxelBounds bounds;
+		bounds.min = Vec3<int>(bounds_min[0], bounds_min[1], bounds_min[2]);
+		bounds.max = Vec3<int>(bounds_max[0], bounds_max[1], bounds_max[2]);
 
-						const size_t tri_start = mesh->triangles.size();
-						mesh->triangles.resize(tri_start + 2);
+		if(bounds_min[0] < MIN_VOXEL_COORD || bounds_min[1] < MIN_VOXEL_COORD || bounds_min[2] < MIN_VOXEL_COORD)
+			throw glare::Exception("Invalid voxel position coord: " + bounds_min.toString());
+		if(bounds_max[0] > MAX_VOXEL_COORD || bounds_max[1] > MAX_VOXEL_COORD || bounds_max[2] > MAX_VOXEL_COORD)
+			throw glare::Exception("Invalid voxel position coord: " + bounds_max.toString());
+	
+		// Do a pass over the voxels to splat into a 3d array
+		const Vec3<int> res = bounds.max - bounds.min + Vec3<int>(1); // Voxel array resolution
 
-						assert(start_face_needed_mat != no_voxel_mat);
+		const int max_dim_w = 100000;
+		if(res.x > max_dim_w || res.y > max_dim_w || res.z > max_dim_w)
+			throw glare::Exception("Voxel dimension span exceeds " + toString(max_dim_w));
 
-						mesh->triangles[tri_start + 0].vertex_indices[0] = v_i[0];
-						mesh->triangles[tri_start + 0].vertex_indices[1] = v_i[1];
-						mesh->triangles[tri_start + 0].vertex_indices[2] = v_i[2];
-						mesh->triangles[tri_start + 0].uv_indices[0]     = 0;
-						mesh->triangles[tri_start + 0].uv_indices[1]     = 0;
-						mesh->triangles[tri_start + 0].uv_indices[2]     = 0;
-						mesh->triangles[tri_start + 0].tri_mat_index     = (uint32)start_face_needed_mat;
+		const int64 voxel_array_size = (int64)res.x * (int64)res.y * (int64)res.z; // Use int64 to avoid overflow.
+		const int64 max_voxel_array_size = (1 << 26) / sizeof(VoxelMatIndexType); // 64 MB, ~64 million voxels
+		if(voxel_array_size > max_voxel_array_size)
+			throw glare::Exception("Voxel array num voxels (" + toString(voxel_array_size) + ") exceeds limit of " + toString(max_voxel_array_size));
 
-						mesh->triangles[tri_start + 1].vertex_indices[0] = v_i[0];
-						mesh->triangles[tri_start + 1].vertex_indices[1] = v_i[2];
-						mesh->triangles[tri_start + 1].vertex_indices[2] = v_i[3];
-						mesh->triangles[tri_start + 1].uv_indices[0]     = 0;
-						mesh->triangles[tri_start + 1].uv_indices[1]     = 0;
-						mesh->triangles[tri_start + 1].uv_indices[2]     = 0;
-						mesh->triangles[tri_start + 1].tri_mat_index     = (uint32)start_face_needed_mat;
-					}
-				}
-			}
+		const VoxelMatIndexType no_voxel_mat = std::numeric_limits<VoxelMatIndexType>::max();
+		Array3D<VoxelMatIndexType> voxel_array(res.x, res.y, res.z, no_voxel_mat);
+
+		for(size_t i=0; i<voxels.size(); ++i)
+		{
+			const Voxel& voxel = voxels[i];
+			const Vec4i vox_pos = Vec4i(voxels[i].pos.x / subsample_factor, voxels[i].pos.y / subsample_factor, voxels[i].pos.z / subsample_factor, 0);
+			const Vec4i indices = vox_pos - bounds_min;
+			voxel_array.elem(indices[0], indices[1], indices[2]) = (VoxelMatIndexType)voxel.mat_index;
+		}
 
-			//conPrint("Dim " + toString(dim) + " took " + dim_timer.elapsedStringNSigFigs(4));
-		} // End for each dim
+		//if(voxel_array.getData().size() > 100000)
+		//	conPrint("voxel_array size: " + toString(voxel_array.getData().size()) + " elems, " + toString(voxel_array.getData().dataSizeBytes()) + " B");
+
+		greedyMeshVoxelArrayRegion(voxel_array, /*array res=*/res, /*array origin=*/bounds.min, /*region begin=*/Vec3<int>(0), /*region end=*/res, mat_transparent, vertpos_hash, *mesh);
 
 		mesh->endOfModel();
 		assert(isFinite(mesh->aabb_os.bound[0].x));
@@ -975,11 +841,378 @@ static Reference<Indigo::Mesh> doMakeIndigoMeshWithNormalsForVoxelGroup(const js
 #endif
 
 
-Reference<Indigo::Mesh> VoxelMeshBuilding::makeIndigoMeshForVoxelGroup(const VoxelGroup& voxel_group, const int subsample_factor, bool generate_shading_normals, const js::Vector<bool, 16>& mats_transparent)
+//=========================================== ChunkedVoxelMesh ===========================================
+
+
+// Hash of a single voxel.  Chunk hashes are the sum of the voxel hashes, so are independent of voxel order.
+static inline uint64 voxelHash(const Vec3<int>& pos, int mat_index)
+{
+	uint64 h = ((uint64)(uint32)pos.x * 0x9E3779B97F4A7C15ull) ^ ((uint64)(uint32)pos.y * 0xC2B2AE3D27D4EB4Full) ^ ((uint64)(uint32)pos.z * 0x165667B19E3779F9ull) ^ ((uint64)(uint32)mat_index * 0x27D4EB2F165667C5ull);
+	// MurmurHash3 finaliser
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+
+static inline int floorDiv(int x, int w)
+{
+	return (x >= 0) ? (x / w) : -((-x + w - 1) / w);
+}
+
+
+// Chunk data built during ChunkedVoxelMesh::update().
+struct VoxelChunkBuildData
+{
+	Vec3<int> coords;
+	js::Vector<Voxel, 16> voxels; // Voxels in the chunk, with subsampled positions.
+	uint64 voxels_hash;
+	uint64 face_hashes[6];
+	bool needs_meshing;
+	Reference<Indigo::Mesh> mesh;
+
+	const VoxelChunkBuildData* neighbours[6]; // Neighbouring chunks on each face, or NULL if there is no such chunk.
+};
+
+
+static Reference<Indigo::Mesh> meshVoxelChunk(const VoxelChunkBuildData& chunk, const bool* mat_transparent)
+{
+	const int W = ChunkedVoxelMesh::CHUNK_W;
+
+	// Array covering the chunk plus a 1 voxel border, so that faces adjacent to voxels in neighbouring chunks can be culled.
+	const Vec3<int> array_res(W + 2, W + 2, W + 2);
+	const Vec3<int> array_origin(chunk.coords.x * W - 1, chunk.coords.y * W - 1, chunk.coords.z * W - 1);
+
+	const VoxelMatIndexType no_voxel_mat = std::numeric_limits<VoxelMatIndexType>::max();
+	Array3D<VoxelMatIndexType> voxel_array(array_res.x, array_res.y, array_res.z, no_voxel_mat);
+
+	for(size_t i=0; i<chunk.voxels.size(); ++i)
+	{
+		const Voxel& voxel = chunk.voxels[i];
+		voxel_array.elem(voxel.pos.x - array_origin.x, voxel.pos.y - array_origin.y, voxel.pos.z - array_origin.z) = (VoxelMatIndexType)voxel.mat_index;
+	}
+
+	// Splat voxels from the boundary layers of neighbouring chunks into the border.
+	for(int f=0; f<6; ++f)
+		if(chunk.neighbours[f])
+		{
+			const js::Vector<Voxel, 16>& neighbour_voxels = chunk.neighbours[f]->voxels;
+			for(size_t i=0; i<neighbour_voxels.size(); ++i)
+			{
+				const Vec3<int> indices(neighbour_voxels[i].pos.x - array_origin.x, neighbour_voxels[i].pos.y - array_origin.y, neighbour_voxels[i].pos.z - array_origin.z);
+				if(indices.x >= 0 && indices.x < array_res.x && indices.y >= 0 && indices.y < array_res.y && indices.z >= 0 && indices.z < array_res.z)
+					voxel_array.elem(indices.x, indices.y, indices.z) = (VoxelMatIndexType)neighbour_voxels[i].mat_index;
+			}
+		}
+
+	Reference<Indigo::Mesh> mesh = new Indigo::Mesh();
+	mesh->setMaxNumTexcoordSets(0);
+
+	const Indigo::Vec3f vertpos_empty_key(std::numeric_limits<float>::max());
+	VertPosHashMap vertpos_hash(/*empty key=*/vertpos_empty_key, /*expected_num_items=*/chunk.voxels.size());
+
+	greedyMeshVoxelArrayRegion(voxel_array, array_res, array_origin, /*region begin=*/Vec3<int>(1), /*region end=*/Vec3<int>(W + 1), mat_transparent, vertpos_hash, *mesh);
+
+	if(mesh->triangles.empty()) // If all faces were culled:
+		return NULL;
+
+	mesh->endOfModel();
+	return mesh;
+}
+
+
+class MeshVoxelChunksTask : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		try
+		{
+			for(size_t i=begin; i<end; ++i)
+				(*chunks_to_mesh)[i]->mesh = meshVoxelChunk(*(*chunks_to_mesh)[i], mat_transparent);
+		}
+		catch(Indigo::IndigoException& e)
+		{
+			error_msg = toStdString(e.what());
+		}
+		catch(std::bad_alloc&)
+		{
+			error_msg = "Out of memory while meshing voxel chunks";
+		}
+
+		tasks_remaining->taskFinished();
+	}
+
+	const std::vector<VoxelChunkBuildData*>* chunks_to_mesh;
+	const bool* mat_transparent;
+	size_t begin, end;
+	TaskCompletionCounter* tasks_remaining;
+	std::string error_msg;
+};
+
+
+ChunkedVoxelMesh::ChunkedVoxelMesh()
+:	last_subsample_factor(0)
+{}
+
+
+ChunkedVoxelMesh::~ChunkedVoxelMesh()
+{}
+
+
+uint64 ChunkedVoxelMesh::chunkKey(const Vec3<int>& c)
+{
+	// Chunk coords are limited to about +-2^15 by the voxel coordinate limit, so 21 bits each is plenty.
+	return ((uint64)(c.x + (1 << 20)) << 42) | ((uint64)(c.y + (1 << 20)) << 21) | (uint64)(c.z + (1 << 20));
+}
+
+
+void ChunkedVoxelMesh::update(const VoxelGroup& voxel_group, int subsample_factor, const js::Vector<bool, 16>& mats_transparent, glare::TaskManager* task_manager, std::vector<uint64>& changed_chunks_out)
+{
+#if GUI_CLIENT
+	PERFORMANCEAPI_INSTRUMENT_FUNCTION();
+#endif
+
+	const int W = CHUNK_W;
+	const js::Vector<Voxel, 16>& voxels = voxel_group.voxels;
+
+	//------------------- Bucket voxels into chunks, and compute chunk hashes -------------------
+	std::map<uint64, VoxelChunkBuildData> new_chunks;
+	VoxelChunkBuildData* last_chunk = NULL; // Voxels are usually spatially coherent, so avoid a map lookup when the voxel is in the same chunk as the last one.
+	uint64 last_chunk_key = 0;
+	for(size_t i=0; i<voxels.size(); ++i)
+	{
+		const Vec3<int> pos(voxels[i].pos.x / subsample_factor, voxels[i].pos.y / subsample_factor, voxels[i].pos.z / subsample_factor);
+		const int mat_index = voxels[i].mat_index;
+
+		if(mat_index < 0)
+			throw glare::Exception("Invalid mat index (< 0)");
+		// We want to be able to fit all the material indices, plus the 'no voxel' index, into the 256 values of a uint8.  So mat_index of 255 = no voxel index.
+		if(mat_index >= 255)
+			throw glare::Exception("Too many materials");
+		if(pos.x < MIN_VOXEL_COORD || pos.y < MIN_VOXEL_COORD || pos.z < MIN_VOXEL_COORD || pos.x > MAX_VOXEL_COORD || pos.y > MAX_VOXEL_COORD || pos.z > MAX_VOXEL_COORD)
+			throw glare::Exception("Invalid voxel position coord: " + toString(pos.x) + ", " + toString(pos.y) + ", " + toString(pos.z));
+
+		const Vec3<int> chunk_coords(floorDiv(pos.x, W), floorDiv(pos.y, W), floorDiv(pos.z, W));
+		const uint64 key = chunkKey(chunk_coords);
+		if(!last_chunk || key != last_chunk_key)
+		{
+			auto res = new_chunks.find(key);
+			if(res == new_chunks.end())
+			{
+				VoxelChunkBuildData& chunk = new_chunks[key];
+				chunk.coords = chunk_coords;
+				chunk.voxels_hash = 0;
+				for(int f=0; f<6; ++f)
+					chunk.face_hashes[f] = 0;
+				chunk.needs_meshing = false;
+				last_chunk = &chunk;
+			}
+			else
+				last_chunk = &res->second;
+			last_chunk_key = key;
+		}
+
+		last_chunk->voxels.push_back(Voxel(pos, mat_index));
+
+		const uint64 h = voxelHash(pos, mat_index);
+		last_chunk->voxels_hash += h;
+
+		const Vec3<int> local(pos.x - chunk_coords.x * W, pos.y - chunk_coords.y * W, pos.z - chunk_coords.z * W);
+		if(local.x == 0)     last_chunk->face_hashes[0] += h;
+		if(local.x == W - 1) last_chunk->face_hashes[1] += h;
+		if(local.y == 0)     last_chunk->face_hashes[2] += h;
+		if(local.y == W - 1) last_chunk->face_hashes[3] += h;
+		if(local.z == 0)     last_chunk->face_hashes[4] += h;
+		if(local.z == W - 1) last_chunk->face_hashes[5] += h;
+	}
+
+	//------------------- Work out which chunks need meshing -------------------
+	bool remesh_all = (subsample_factor != last_subsample_factor) || (mats_transparent.size() != last_mats_transparent.size());
+	for(size_t i=0; (i<mats_transparent.size()) && !remesh_all; ++i)
+		remesh_all = mats_transparent[i] != last_mats_transparent[i];
+
+	const Vec3<int> face_dirs[6] = { Vec3<int>(-1,0,0), Vec3<int>(1,0,0), Vec3<int>(0,-1,0), Vec3<int>(0,1,0), Vec3<int>(0,0,-1), Vec3<int>(0,0,1) };
+
+	std::vector<VoxelChunkBuildData*> chunks_to_mesh;
+	for(auto it = new_chunks.begin(); it != new_chunks.end(); ++it)
+	{
+		VoxelChunkBuildData& chunk = it->second;
+
+		const auto old_res = chunks.find(it->first);
+		chunk.needs_meshing = remesh_all || (old_res == chunks.end()) || (old_res->second.voxels_hash != chunk.voxels_hash);
+
+		for(int f=0; f<6; ++f)
+		{
+			const uint64 neighbour_key = chunkKey(chunk.coords + face_dirs[f]);
+			const int facing_face = f ^ 1; // Face of the neighbour chunk facing this chunk.
+
+			const auto new_neighbour_res = new_chunks.find(neighbour_key);
+			chunk.neighbours[f] = (new_neighbour_res != new_chunks.end()) ? &new_neighbour_res->second : NULL;
+			const uint64 new_facing_hash = chunk.neighbours[f] ? chunk.neighbours[f]->face_hashes[facing_face] : 0;
+
+			const auto old_neighbour_res = chunks.find(neighbour_key);
+			const uint64 old_facing_hash = (old_neighbour_res != chunks.end()) ? old_neighbour_res->second.face_hashes[facing_face] : 0;
+
+			if(new_facing_hash != old_facing_hash)
+				chunk.needs_meshing = true;
+		}
+
+		if(chunk.needs_meshing)
+			chunks_to_mesh.push_back(&chunk);
+		else
+			chunk.mesh = old_res->second.mesh;
+	}
+
+	//------------------- Mesh chunks -------------------
+	bool mat_transparent[256];
+	buildMatTransparentArray(mats_transparent, mat_transparent);
+
+	const size_t num_tasks = task_manager ? myMin((size_t)task_manager->getNumThreads(), chunks_to_mesh.size()) : 0;
+	if(num_tasks <= 1)
+	{
+		try
+		{
+			for(size_t i=0; i<chunks_to_mesh.size(); ++i)
+				chunks_to_mesh[i]->mesh = meshVoxelChunk(*chunks_to_mesh[i], mat_transparent);
+		}
+		catch(Indigo::IndigoException& e)
+		{
+			throw glare::Exception(toStdString(e.what()));
+		}
+	}
+	else
+	{
+		// update() may be given the shared engine task manager, so wait for just our tasks, rather than every task in the manager.
+		TaskCompletionCounter tasks_remaining;
+		tasks_remaining.setNumTasks(num_tasks);
+
+		std::vector<Reference<MeshVoxelChunksTask> > tasks(num_tasks);
+		for(size_t t=0; t<num_tasks; ++t)
+		{
+			tasks[t] = new MeshVoxelChunksTask();
+			tasks[t]->chunks_to_mesh = &chunks_to_mesh;
+			tasks[t]->mat_transparent = mat_transparent;
+			tasks[t]->begin = chunks_to_mesh.size() * t       / num_tasks;
+			tasks[t]->end   = chunks_to_mesh.size() * (t + 1) / num_tasks;
+			tasks[t]->tasks_remaining = &tasks_remaining;
+			task_manager->addTask(tasks[t]);
+		}
+
+		tasks_remaining.waitForTasks();
+
+		for(size_t t=0; t<num_tasks; ++t)
+			if(!tasks[t]->error_msg.empty())
+				throw glare::Exception(tasks[t]->error_msg);
+	}
+
+	//------------------- Replace chunks with the new chunks -------------------
+	for(auto it = chunks.begin(); it != chunks.end(); ++it)
+		if(new_chunks.count(it->first) == 0) // If chunk was removed:
+			changed_chunks_out.push_back(it->first);
+
+	chunks.clear();
+	for(auto it = new_chunks.begin(); it != new_chunks.end(); ++it)
+	{
+		Chunk& chunk = chunks[it->first];
+		chunk.voxels_hash = it->second.voxels_hash;
+		for(int f=0; f<6; ++f)
+			chunk.face_hashes[f] = it->second.face_hashes[f];
+		chunk.mesh = it->second.mesh;
+
+		if(it->second.needs_meshing)
+			changed_chunks_out.push_back(it->first);
+	}
+
+	last_subsample_factor = subsample_factor;
+	last_mats_transparent = mats_transparent;
+}
+
+
+Reference<Indigo::Mesh> ChunkedVoxelMesh::makeMergedMesh() const
+{
+	size_t num_verts = 0;
+	size_t num_tris = 0;
+	for(auto it = chunks.begin(); it != chunks.end(); ++it)
+		if(it->second.mesh.nonNull())
+		{
+			num_verts += it->second.mesh->vert_positions.size();
+			num_tris  += it->second.mesh->triangles.size();
+		}
+
+	if(num_tris == 0)
+		throw glare::Exception("No voxel faces");
+
+	try
+	{
+		Reference<Indigo::Mesh> mesh = new Indigo::Mesh();
+		mesh->setMaxNumTexcoordSets(0);
+		mesh->vert_positions.reserve(num_verts);
+		mesh->triangles.reserve(num_tris);
+
+		for(auto it = chunks.begin(); it != chunks.end(); ++it)
+		{
+			const Indigo::Mesh* chunk_mesh = it->second.mesh.ptr();
+			if(chunk_mesh)
+			{
+				const uint32 vert_offset = (uint32)mesh->vert_positions.size();
+				for(size_t i=0; i<chunk_mesh->vert_positions.size(); ++i)
+					mesh->vert_positions.push_back(chunk_mesh->vert_positions[i]);
+
+				for(size_t i=0; i<chunk_mesh->triangles.size(); ++i)
+				{
+					Indigo::Triangle tri = chunk_mesh->triangles[i];
+					tri.vertex_indices[0] += vert_offset;
+					tri.vertex_indices[1] += vert_offset;
+					tri.vertex_indices[2] += vert_offset;
+					mesh->triangles.push_back(tri);
+				}
+			}
+		}
+
+		mesh->endOfModel();
+		return mesh;
+	}
+	catch(Indigo::IndigoException& e)
+	{
+		throw glare::Exception(toStdString(e.what()));
+	}
+}
+
+
+const Indigo::Mesh* ChunkedVoxelMesh::getChunkMesh(uint64 chunk_key) const
+{
+	const auto res = chunks.find(chunk_key);
+	return (res != chunks.end()) ? res->second.mesh.ptr() : NULL;
+}
+
+
+void ChunkedVoxelMesh::getChunkKeys(std::vector<uint64>& keys_out) const
+{
+	for(auto it = chunks.begin(); it != chunks.end(); ++it)
+		keys_out.push_back(it->first);
+}
+
+
+Reference<Indigo::Mesh> VoxelMeshBuilding::makeIndigoMeshForVoxelGroup(const VoxelGroup& voxel_group, const int subsample_factor, bool generate_shading_normals, const js::Vector<bool, 16>& mats_transparent,
+	glare::TaskManager* task_manager)
 {
 	assert(voxel_group.voxels.size() > 0);
 	// conPrint("Adding " + toString(voxel_group.voxels.size()) + " voxels.");
 
+	// For large groups, mesh chunks in parallel.  Below this size, meshing is fast enough that it's not worth the task overhead.
+	const size_t MIN_VOXELS_FOR_CHUNKED_MESHING = 1 << 16;
+	if(task_manager && (voxel_group.voxels.size() >= MIN_VOXELS_FOR_CHUNKED_MESHING))
+	{
+		ChunkedVoxelMesh chunked_mesh;
+		std::vector<uint64> changed_chunks;
+		chunked_mesh.update(voxel_group, subsample_factor, mats_transparent, task_manager, changed_chunks);
+		return chunked_mesh.makeMergedMesh();
+	}
+
 	return doMakeIndigoMeshForVoxelGroupWith3dArray(voxel_group.voxels, subsample_factor, mats_transparent);
 }
 
@@ -1015,6 +1248,90 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 #include <simpleraytracer/raymesh.h>
 #include <utils/TaskManager.h>
 #include <utils/TestUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+
+
+static double totalSurfaceArea(const Indigo::Mesh& mesh)
+{
+	double area = 0;
+	for(size_t i=0; i<mesh.triangles.size(); ++i)
+	{
+		const Indigo::Vec3f& v0 = mesh.vert_positions[mesh.triangles[i].vertex_indices[0]];
+		const Indigo::Vec3f& v1 = mesh.vert_positions[mesh.triangles[i].vertex_indices[1]];
+		const Indigo::Vec3f& v2 = mesh.vert_positions[mesh.triangles[i].vertex_indices[2]];
+		const Vec3d e0((double)v1.x - v0.x, (double)v1.y - v0.y, (double)v1.z - v0.z);
+		const Vec3d e1((double)v2.x - v0.x, (double)v2.y - v0.y, (double)v2.z - v0.z);
+		area += crossProduct(e0, e1).length() * 0.5;
+	}
+	return area;
+}
+
+
+// Checks a chunked mesh covers the same surface as a mesh of the whole group.  The triangulation will differ, as quads are split at chunk boundaries.
+static void checkChunkedMeshMatchesWholeMesh(const Indigo::Mesh& chunked, const Indigo::Mesh& whole)
+{
+	testAssert(chunked.aabb_os.bound[0] == whole.aabb_os.bound[0]);
+	testAssert(chunked.aabb_os.bound[1] == whole.aabb_os.bound[1]);
+	testAssert(chunked.num_materials_referenced == whole.num_materials_referenced);
+	testAssert(chunked.triangles.size() >= whole.triangles.size());
+	testAssert(epsEqual(totalSurfaceArea(chunked), totalSurfaceArea(whole)));
+}
+
+
+static void checkChunkedMeshesEqual(const ChunkedVoxelMesh& a, const ChunkedVoxelMesh& b, const std::vector<uint64>& keys)
+{
+	testAssert(a.numChunks() == b.numChunks());
+	for(size_t i=0; i<keys.size(); ++i)
+	{
+		const Indigo::Mesh* mesh_a = a.getChunkMesh(keys[i]);
+		const Indigo::Mesh* mesh_b = b.getChunkMesh(keys[i]);
+		testAssert((mesh_a == NULL) == (mesh_b == NULL));
+		if(mesh_a)
+		{
+			testAssert(mesh_a->vert_positions.size() == mesh_b->vert_positions.size());
+			testAssert(mesh_a->triangles.size() == mesh_b->triangles.size());
+			for(size_t z=0; z<mesh_a->vert_positions.size(); ++z)
+				testAssert(mesh_a->vert_positions[z] == mesh_b->vert_positions[z]);
+			for(size_t z=0; z<mesh_a->triangles.size(); ++z)
+				for(int c=0; c<3; ++c)
+					testAssert(mesh_a->triangles[z].vertex_indices[c] == mesh_b->triangles[z].vertex_indices[c]);
+		}
+	}
+}
+
+
+// Makes a w^3 block of voxels with random materials, and some holes.
+static VoxelGroup makeTestVoxelBlock(int w, int num_mats, PCG32& rng)
+{
+	VoxelGroup group;
+	for(int z=0; z<w; ++z)
+	for(int y=0; y<w; ++y)
+	for(int x=0; x<w; ++x)
+		if(rng.unitRandom() < 0.95f)
+			group.voxels.push_back(Voxel(Vec3<int>(x, y, z) - Vec3<int>(w / 3), (int)(rng.unitRandom() * num_mats) % num_mats));
+	return group;
+}
+
+
+// Sets the material of the voxel at pos, adding a voxel if there isn't one there, as done for voxel edits.
+static void setVoxel(VoxelGroup& group, const Vec3<int>& pos, int mat_index)
+{
+	for(size_t i=0; i<group.voxels.size(); ++i)
+		if(group.voxels[i].pos == pos)
+		{
+			group.voxels[i].mat_index = mat_index;
+			return;
+		}
+	group.voxels.push_back(Voxel(pos, mat_index));
+}
+
+
+static void removeVoxel(VoxelGroup& group, size_t i)
+{
+	group.voxels[i] = group.voxels[group.voxels.size() - 1];
+	group.voxels.resize(group.voxels.size() - 1);
+}
 
 
 void VoxelMeshBuilding::test()
@@ -1199,6 +1516,190 @@ void VoxelMeshBuilding::test()
 		testAssert(data->triangles.size() == 6 * 2);
 	}
 
+	// Test ChunkedVoxelMesh: the merged chunk meshes should cover the same surface as the mesh of the whole group.
+	try
+	{
+		PCG32 rng(1);
+		js::Vector<bool, 16> mat_transparent(3, false);
+		mat_transparent[2] = true;
+
+		for(int subsample_factor=1; subsample_factor<=2; subsample_factor *= 2)
+		{
+			const VoxelGroup group = makeTestVoxelBlock(/*w=*/70, /*num_mats=*/3, rng);
+
+			Reference<Indigo::Mesh> whole_mesh = makeIndigoMeshForVoxelGroup(group, subsample_factor, /*generate_shading_normals=*/false, mat_transparent);
+
+			ChunkedVoxelMesh chunked_mesh;
+			std::vector<uint64> changed_chunks;
+			chunked_mesh.update(group, subsample_factor, mat_transparent, &task_manager, changed_chunks);
+			testAssert(changed_chunks.size() == chunked_mesh.numChunks());
+			testAssert(chunked_mesh.numChunks() > 1);
+			checkChunkedMeshMatchesWholeMesh(*chunked_mesh.makeMergedMesh(), *whole_mesh);
+
+			// Meshing large groups with a task manager should give the chunked mesh.
+			Reference<Indigo::Mesh> parallel_mesh = makeIndigoMeshForVoxelGroup(group, subsample_factor, /*generate_shading_normals=*/false, mat_transparent, &task_manager);
+			checkChunkedMeshMatchesWholeMesh(*parallel_mesh, *whole_mesh);
+
+			// Updating with no changes shouldn't re-mesh anything.
+			changed_chunks.clear();
+			chunked_mesh.update(group, subsample_factor, mat_transparent, &task_manager, changed_chunks);
+			testAssert(changed_chunks.empty());
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	// Test ChunkedVoxelMesh incremental updates: only chunks around an edit should be re-meshed, and the result should be the same as meshing from scratch.
+	try
+	{
+		PCG32 rng(1);
+		js::Vector<bool, 16> mat_transparent(3, false);
+		mat_transparent[2] = true;
+
+		VoxelGroup group = makeTestVoxelBlock(/*w=*/80, /*num_mats=*/3, rng);
+
+		ChunkedVoxelMesh chunked_mesh;
+		std::vector<uint64> changed_chunks;
+		chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, /*task_manager=*/NULL, changed_chunks);
+
+		const int W = ChunkedVoxelMesh::CHUNK_W;
+
+		// Edit a voxel in the interior of a chunk: just that chunk should be re-meshed.
+		{
+			setVoxel(group, Vec3<int>(W + 5, W + 6, W + 7), 1);
+			changed_chunks.clear();
+			chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, &task_manager, changed_chunks);
+			testAssert(changed_chunks.size() == 1);
+			testAssert(changed_chunks[0] == ChunkedVoxelMesh::chunkKey(Vec3<int>(1, 1, 1)));
+		}
+
+		// Remove a voxel on a chunk face: the chunk and the neighbouring chunk should be re-meshed.
+		{
+			size_t i = 0;
+			while(!(group.voxels[i].pos.x == W - 1 && group.voxels[i].pos.y > 0 && group.voxels[i].pos.y < W - 1 && group.voxels[i].pos.z > 0 && group.voxels[i].pos.z < W - 1))
+				i++;
+			removeVoxel(group, i);
+
+			changed_chunks.clear();
+			chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, &task_manager, changed_chunks);
+			testAssert(changed_chunks.size() == 2);
+		}
+
+		// Do random edits, and check the incrementally updated chunks are the same as chunks meshed from scratch.
+		for(int iter=0; iter<20; ++iter)
+		{
+			const int num_edits = 1 + (int)(rng.unitRandom() * 10);
+			for(int e=0; e<num_edits; ++e)
+			{
+				if(rng.unitRandom() < 0.5f && !group.voxels.empty())
+					removeVoxel(group, rng.nextUInt((uint32)group.voxels.size()));
+				else
+					setVoxel(group, Vec3<int>((int)(rng.unitRandom() * 100) - 30, (int)(rng.unitRandom() * 100) - 30, (int)(rng.unitRandom() * 100) - 30), (int)rng.nextUInt(3));
+			}
+
+			changed_chunks.clear();
+			chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, &task_manager, changed_chunks);
+			testAssert(changed_chunks.size() <= (size_t)num_edits * 7);
+
+			ChunkedVoxelMesh ref_mesh;
+			std::vector<uint64> keys;
+			ref_mesh.update(group, /*subsample_factor=*/1, mat_transparent, /*task_manager=*/NULL, keys);
+			checkChunkedMeshesEqual(chunked_mesh, ref_mesh, keys);
+		}
+
+		// Changing the transparent materials should re-mesh everything.
+		mat_transparent[2] = false;
+		changed_chunks.clear();
+		chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, &task_manager, changed_chunks);
+		testAssert(changed_chunks.size() == chunked_mesh.numChunks());
+
+		// Removing all voxels in a chunk should remove the chunk.
+		const size_t initial_num_chunks = chunked_mesh.numChunks();
+		group.voxels.push_back(Voxel(Vec3<int>(1000, 0, 0), 0));
+		chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, &task_manager, changed_chunks);
+		testAssert(chunked_mesh.numChunks() == initial_num_chunks + 1);
+		removeVoxel(group, group.voxels.size() - 1);
+		changed_chunks.clear();
+		chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, &task_manager, changed_chunks);
+		testAssert(chunked_mesh.numChunks() == initial_num_chunks);
+		testAssert(changed_chunks.size() == 1 && chunked_mesh.getChunkMesh(changed_chunks[0]) == NULL);
+
+		// Invalid voxels should throw, and leave the chunks unchanged.
+		group.voxels.push_back(Voxel(Vec3<int>(0, 0, 0), 255));
+		try
+		{
+			chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, &task_manager, changed_chunks);
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+		testAssert(chunked_mesh.numChunks() == initial_num_chunks);
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	// Benchmark: initial meshing and edit latency for a group with 1M voxels.
+	if(false)
+	{
+		try
+		{
+			js::Vector<bool, 16> mat_transparent(3, false);
+			mat_transparent[2] = true;
+
+			VoxelGroup group;
+			for(int z=0; z<100; ++z)
+			for(int y=0; y<100; ++y)
+			for(int x=0; x<100; ++x)
+				group.voxels.push_back(Voxel(Vec3<int>(x, y, z), (x / 7 + y / 5 + z / 3) % 3));
+
+			double whole_mesh_time = 1.0e10;
+			double parallel_mesh_time = 1.0e10;
+			for(int t=0; t<3; ++t)
+			{
+				Timer timer;
+				makeIndigoMeshForVoxelGroup(group, /*subsample_factor=*/1, /*generate_shading_normals=*/false, mat_transparent);
+				whole_mesh_time = myMin(whole_mesh_time, timer.elapsed());
+				timer.reset();
+				makeIndigoMeshForVoxelGroup(group, /*subsample_factor=*/1, /*generate_shading_normals=*/false, mat_transparent, &task_manager);
+				parallel_mesh_time = myMin(parallel_mesh_time, timer.elapsed());
+			}
+
+			ChunkedVoxelMesh chunked_mesh;
+			std::vector<uint64> changed_chunks;
+			chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, &task_manager, changed_chunks);
+
+			// Time removing a voxel and re-meshing, as done for an edit.
+			double whole_edit_time = 1.0e10;
+			double chunked_edit_time = 1.0e10;
+			for(int t=0; t<10; ++t)
+			{
+				removeVoxel(group, 500000 + t);
+
+				Timer timer;
+				makeIndigoMeshForVoxelGroup(group, /*subsample_factor=*/1, /*generate_shading_normals=*/false, mat_transparent);
+				whole_edit_time = myMin(whole_edit_time, timer.elapsed());
+
+				timer.reset();
+				changed_chunks.clear();
+				chunked_mesh.update(group, /*subsample_factor=*/1, mat_transparent, &task_manager, changed_chunks);
+				chunked_mesh.makeMergedMesh();
+				chunked_edit_time = myMin(chunked_edit_time, timer.elapsed());
+			}
+
+			conPrint("Meshing " + toString(group.voxels.size()) + " voxels: whole group: " + doubleToStringNSigFigs(whole_mesh_time * 1.0e3, 4) + " ms, parallel chunks (" + toString(task_manager.getNumThreads()) + " threads): " +
+				doubleToStringNSigFigs(parallel_mesh_time * 1.0e3, 4) + " ms");
+			conPrint("Single voxel edit: whole group re-mesh: " + doubleToStringNSigFigs(whole_edit_time * 1.0e3, 4) + " ms, incremental chunked re-mesh: " + doubleToStringNSigFigs(chunked_edit_time * 1.0e3, 4) + " ms");
+		}
+		catch(glare::Exception& e)
+		{
+			failTest(e.what());
+		}
+	}
+
 	// Performance test
 	if(false)
 	{
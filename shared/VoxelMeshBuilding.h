@@ -9,7 +9,12 @@ Copyright Glare Technologies Limited 2022 -
 #include <dll/include/IndigoMesh.h>
 #include <maths/vec3.h>
 #include <utils/Vector.h>
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <map>
+#include <vector>
 class VoxelGroup;
+namespace glare { class TaskManager; }
 
 
 /*=====================================================================
@@ -22,7 +27,66 @@ class VoxelMeshBuilding
 {
 public:
 	// If mats_transparent is lacking entries for a particular material index, the material is assumed to be opaque.
-	static Reference<Indigo::Mesh> makeIndigoMeshForVoxelGroup(const VoxelGroup& voxel_group, const int subsample_factor, bool generate_shading_normals, const js::Vector<bool, 16>& mats_transparent);
+	// If task_manager is non-null and the voxel group is large, the group is meshed in chunks in parallel with ChunkedVoxelMesh.
+	// Note that quads are then split at chunk boundaries, so the mesh will differ from the mesh built without a task manager.
+	static Reference<Indigo::Mesh> makeIndigoMeshForVoxelGroup(const VoxelGroup& voxel_group, const int subsample_factor, bool generate_shading_normals, const js::Vector<bool, 16>& mats_transparent,
+		glare::TaskManager* task_manager = NULL);
 
 	static void test();
 };
+
+
+/*=====================================================================
+ChunkedVoxelMesh
+----------------
+Greedy-meshes a voxel group in independent CHUNK_W^3 chunks, and keeps the chunk meshes,
+so that when the voxels are edited, only the chunks around the edit need to be re-meshed.
+
+A chunk is re-meshed when its voxels change, or when the voxels in the boundary layer of
+a neighbouring chunk on a shared face change, since those determine which of the chunk faces are visible.
+Changes are detected by comparing order-independent hashes of the voxels, so update() can just be passed
+the whole edited voxel group.
+
+Quads don't cross chunk boundaries, so the merged mesh has somewhat more triangles than a mesh of the whole group.
+=====================================================================*/
+class ChunkedVoxelMesh : public ThreadSafeRefCounted
+{
+public:
+	ChunkedVoxelMesh();
+	~ChunkedVoxelMesh();
+
+	static const int CHUNK_W = 32; // Chunk width in (subsampled) voxels.
+
+	// Re-meshes all chunks that have changed since the last call, or all chunks on the first call, or if subsample_factor or mats_transparent changed.
+	// If task_manager is non-null, chunks are meshed in parallel.  Must not be called from a task executing on task_manager.
+	// Appends the keys of chunks that were re-meshed or removed to changed_chunks_out.
+	// Throws glare::Exception on invalid voxel data, in which case the chunks are left unchanged.
+	void update(const VoxelGroup& voxel_group, int subsample_factor, const js::Vector<bool, 16>& mats_transparent, glare::TaskManager* task_manager, std::vector<uint64>& changed_chunks_out);
+
+	// Concatenates the chunk meshes into a single mesh.  Throws glare::Exception if there are no faces.
+	Reference<Indigo::Mesh> makeMergedMesh() const;
+
+	// Returns NULL if there is no chunk with the given key, or if the chunk has no visible faces.
+	const Indigo::Mesh* getChunkMesh(uint64 chunk_key) const;
+
+	// Appends the keys of all chunks to keys_out.
+	void getChunkKeys(std::vector<uint64>& keys_out) const;
+
+	size_t numChunks() const { return chunks.size(); }
+
+	static uint64 chunkKey(const Vec3<int>& chunk_coords);
+
+	struct Chunk
+	{
+		uint64 voxels_hash; // Hash of all voxels in the chunk.
+		uint64 face_hashes[6]; // Hashes of the voxels in the boundary layer on each face: -x, +x, -y, +y, -z, +z.
+		Reference<Indigo::Mesh> mesh; // NULL if the chunk has no visible faces.
+	};
+
+private:
+	GLARE_DISABLE_COPY(ChunkedVoxelMesh);
+
+	std::map<uint64, Chunk> chunks; // Map from chunk key to chunk.
+	int last_subsample_factor;
+	js::Vector<bool, 16> last_mats_transparent;
+};
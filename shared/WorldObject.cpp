@@ -27,7 +27,9 @@ Copyright Glare Technologies Limited 2016 -
 #include "../gui_client/MeshManager.h"
 #include <graphics/ImageMap.h>
 #include "../gui_client/PhysicsObject.h"
+#include "../gui_client/ObjectLODTable.h"
 #include "../gui_client/Scripting.h"
+#include "../gui_client/ModelLoading.h"
 #include <opengl/ui/GLUITextView.h>
 #endif // GUI_CLIENT
 #include "../shared/ResourceManager.h"
@@ -79,6 +81,9 @@ WorldObject::WorldObject() noexcept
 
 	waypoint_index = 0;
 	dist_along_segment = 0;
+
+	lod_table = NULL;
+	lod_table_index = -1;
 #endif
 	next_snapshot_i = 0;
 	next_insertable_snapshot_i = 0;
@@ -1156,7 +1161,20 @@ void WorldObject::zeroAABBOS()
 	this->centroid_ws = Vec4f(0,0,0,1);
 	this->aabb_ws_longest_len = 0;
 	this->biased_aabb_len = 0;
+
+#if GUI_CLIENT
+	if(lod_table)
+		lodTableTransformChanged();
+#endif
+}
+
+
+#if GUI_CLIENT
+void WorldObject::lodTableTransformChanged()
+{
+	lod_table->objectTransformChanged(*this);
 }
+#endif
 
 
 void WorldObject::transformChanged() // Rebuild centroid_ws, biased_aabb_len
@@ -46,7 +46,9 @@ class BrowserVidPlayer;
 struct AnimatedTexObData;
 struct MeshData;
 struct PhysicsShapeData;
+struct VoxelEditMeshCache;
 class GLUITextView;
+class ObjectLODTable;
 class UInt8ComponentValueTraits;
 template <class V, class ComponentValueTraits> class ImageMap;
 
@@ -155,7 +157,7 @@ public:
 
 	inline int getLODLevel(const Vec3d& campos) const;
 	inline int getLODLevel(const Vec4f& campos) const;
-	inline float getMaxDistForLODLevel(int level);
+	inline float getMaxDistForLODLevel(int level) const;
 	inline int getLODLevel(float cam_to_ob_d2) const;
 	int getModelLODLevel(const Vec3d& campos) const; // getLODLevel() clamped to max_model_lod_level, also clamped to >= 0.
 	int getModelLODLevelForObLODLevel(int ob_lod_level) const; // getLODLevel() clamped to max_model_lod_level, also clamped to >= 0.
@@ -363,6 +365,8 @@ public:
 	Reference<MeshData> mesh_manager_data; // Hang on to a reference to the mesh data, so when object-uses of it are removed, it can be removed from the MeshManager with meshDataBecameUnused().
 	Reference<PhysicsShapeData> mesh_manager_shape_data; // Likewise for the physics mesh data.
 
+	Reference<VoxelEditMeshCache> voxel_edit_mesh_cache; // Chunk meshes and physics shapes for voxel objects that have been edited, so further edits only rebuild the changed chunks.
+
 	enum AudioState
 	{
 		AudioState_NotLoaded,
@@ -409,6 +413,10 @@ public:
 	// For objects that are path controlled:
 	int waypoint_index;
 	float dist_along_segment;
+
+	ObjectLODTable* lod_table; // The world's ObjectLODTable, if this object has been added to it.  Set by ObjectLODTable.
+	int lod_table_index; // Index of this object in lod_table.
+	void lodTableTransformChanged(); // Updates the centroid etc. in lod_table.
 #endif // GUI_CLIENT
 
 	float max_load_dist2;
@@ -551,7 +559,7 @@ lod level 2 if proj_len <= 0.03
 
 = aabb_ws.longestLength() / 0.03 <= dist_to_cam
 */
-float WorldObject::getMaxDistForLODLevel(int level)
+float WorldObject::getMaxDistForLODLevel(int level) const
 {
 	const float eps_factor = 1.001f; // Make distance slightly larger to account for fastApproxRecipLength() usage in getLODLevel().
 	if(level == -1)
@@ -606,11 +614,16 @@ void WorldObject::doTransformChanged(const Matrix4f& ob_to_world, const Vec4f& u
 
 	if(BitUtils::isBitSet(flags, SUMMONED_FLAG))
 		this->biased_aabb_len *= 4;
+
+#if GUI_CLIENT
+	if(lod_table)
+		lodTableTransformChanged();
+#endif
 }
 
 
 // Rebuild centroid_ws, aabb_ws_longest_len, biased_aabb_len, ignoring rotation part of object-to-world transformation.
-// See evalObjectScript() in Scripting.cpp
+// See ObjectScriptEvaluator::applyScriptResults() in Scripting.cpp
 void WorldObject::doTransformChangedIgnoreRotation(const Vec4f& use_position, const Vec4f& use_scale) 
 {
 	assert(use_scale[3] == 0);
@@ -627,4 +640,9 @@ void WorldObject::doTransformChangedIgnoreRotation(const Vec4f& use_position, co
 
 	if(BitUtils::isBitSet(flags, SUMMONED_FLAG))
 		this->biased_aabb_len *= 4;
+
+#if GUI_CLIENT
+	if(lod_table)
+		lodTableTransformChanged();
+#endif
 }
@@ -0,0 +1,213 @@
+/*=====================================================================
+BenchmarkStats.cpp
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "BenchmarkStats.h"
+
+
+#include <maths/mathstypes.h>
+#include <StringUtils.h>
+#include <algorithm>
+#include <cmath>
+
+
+const char* latencyTypeName(int type)
+{
+	switch(type)
+	{
+	case Latency_Connect:			return "connect";
+	case Latency_Login:				return "login";
+	case Latency_InitialQuery:		return "initial_query";
+	case Latency_AvatarUpdate:		return "avatar_update";
+	case Latency_ObjectCreate:		return "object_create";
+	case Latency_ObjectEdit:		return "object_edit";
+	case Latency_ResourceDownload:	return "resource_download";
+	case Latency_Voice:				return "voice";
+	default:						return "unknown";
+	}
+}
+
+
+void LatencySamples::append(const LatencySamples& other)
+{
+	for(int i=0; i<NUM_LATENCY_TYPES; ++i)
+		samples[i].insert(samples[i].end(), other.samples[i].begin(), other.samples[i].end());
+}
+
+
+// v must be sorted.  Uses the nearest-rank method.
+static double getPercentile(const std::vector<float>& v, double p)
+{
+	const size_t rank = (size_t)std::ceil(p * v.size());
+	return v[myClamp<size_t>(rank, 1, v.size()) - 1];
+}
+
+
+LatencySamples::Summary LatencySamples::computeSummary(LatencyType type)
+{
+	std::vector<float>& v = samples[type];
+
+	Summary summary;
+	summary.num_samples = v.size();
+	summary.mean = summary.p50 = summary.p90 = summary.p99 = summary.p999 = summary.max = 0;
+	if(v.empty())
+		return summary;
+
+	std::sort(v.begin(), v.end());
+
+	double sum = 0;
+	for(size_t i=0; i<v.size(); ++i)
+		sum += v[i];
+
+	summary.mean = sum / v.size();
+	summary.p50  = getPercentile(v, 0.5);
+	summary.p90  = getPercentile(v, 0.9);
+	summary.p99  = getPercentile(v, 0.99);
+	summary.p999 = getPercentile(v, 0.999);
+	summary.max  = v.back();
+	return summary;
+}
+
+
+BenchmarkCounters::Snapshot BenchmarkCounters::getSnapshot() const
+{
+	Snapshot s;
+	s.num_msgs_sent = num_msgs_sent;
+	s.num_msgs_received = num_msgs_received;
+	s.num_bytes_sent = num_bytes_sent;
+	s.num_bytes_received = num_bytes_received;
+	s.num_resource_bytes_received = num_resource_bytes_received;
+	s.num_voice_packets_received = num_voice_packets_received;
+	return s;
+}
+
+
+void LocalCounters::flushTo(BenchmarkCounters& counters)
+{
+	counters.num_msgs_sent += num_msgs_sent;
+	counters.num_msgs_received += num_msgs_received;
+	counters.num_bytes_sent += num_bytes_sent;
+	counters.num_bytes_received += num_bytes_received;
+	counters.num_resource_bytes_received += num_resource_bytes_received;
+	counters.num_voice_packets_received += num_voice_packets_received;
+	clear();
+}
+
+
+static std::string jsonString(const std::string& s)
+{
+	std::string res = "\"";
+	for(size_t i=0; i<s.size(); ++i)
+	{
+		const char c = s[i];
+		if(c == '"')
+			res += "\\\"";
+		else if(c == '\\')
+			res += "\\\\";
+		else if((unsigned char)c < 0x20)
+			res += ' '; // Control chars are not allowed in JSON strings, and won't be in hostnames or world names anyway.
+		else
+			res.push_back(c);
+	}
+	return res + "\"";
+}
+
+
+static std::string jsonNumber(double x)
+{
+	if(!std::isfinite(x))
+		return "null"; // JSON doesn't allow inf or NaN.
+	return doubleToStringNSigFigs(x, 6);
+}
+
+
+// Returns (end - start) / period, or 0 if the period is empty.
+static double rate(uint64 start, uint64 end, double period)
+{
+	return (period > 0) ? ((double)(end - start) / period) : 0.0;
+}
+
+
+std::string BenchmarkResults::toJSON() const
+{
+	const double per_client_divisor = (double)myMax(1, num_bots_ready);
+
+	std::string s = "{\n";
+
+	s += "\t\"config\": {\n";
+	s += "\t\t\"server_hostname\": " + jsonString(server_hostname) + ",\n";
+	s += "\t\t\"world_names\": [";
+	for(size_t i=0; i<world_names.size(); ++i)
+		s += ((i > 0) ? ", " : "") + jsonString(world_names[i]);
+	s += "],\n";
+	s += "\t\t\"num_bots\": " + ::toString(num_bots) + ",\n";
+	s += "\t\t\"edit_fraction\": " + jsonNumber(edit_fraction) + ",\n";
+	s += "\t\t\"voice_fraction\": " + jsonNumber(voice_fraction) + ",\n";
+	s += "\t\t\"download_fraction\": " + jsonNumber(download_fraction) + "\n";
+	s += "\t},\n";
+
+	s += "\t\"num_bots_ready\": " + ::toString(num_bots_ready) + ",\n";
+	s += "\t\"num_bots_failed\": " + ::toString(num_bots_failed) + ",\n";
+	s += "\t\"measurement_period_s\": " + jsonNumber(measurement_period) + ",\n";
+	s += "\t\"process_cpu_time_s\": " + jsonNumber(process_cpu_time) + ",\n";
+
+	s += "\t\"throughput\": {\n";
+	s += "\t\t\"msgs_sent_per_s\": " + jsonNumber(rate(start_counters.num_msgs_sent, end_counters.num_msgs_sent, measurement_period)) + ",\n";
+	s += "\t\t\"msgs_received_per_s\": " + jsonNumber(rate(start_counters.num_msgs_received, end_counters.num_msgs_received, measurement_period)) + ",\n";
+	s += "\t\t\"bytes_sent_per_s\": " + jsonNumber(rate(start_counters.num_bytes_sent, end_counters.num_bytes_sent, measurement_period)) + ",\n";
+	s += "\t\t\"bytes_received_per_s\": " + jsonNumber(rate(start_counters.num_bytes_received, end_counters.num_bytes_received, measurement_period)) + ",\n";
+	s += "\t\t\"resource_bytes_received_per_s\": " + jsonNumber(rate(start_counters.num_resource_bytes_received, end_counters.num_resource_bytes_received, measurement_period)) + ",\n";
+	s += "\t\t\"voice_packets_received_per_s\": " + jsonNumber(rate(start_counters.num_voice_packets_received, end_counters.num_voice_packets_received, measurement_period)) + "\n";
+	s += "\t},\n";
+
+	s += "\t\"per_client\": {\n";
+	s += "\t\t\"bytes_sent_per_s\": " + jsonNumber(rate(start_counters.num_bytes_sent, end_counters.num_bytes_sent, measurement_period) / per_client_divisor) + ",\n";
+	s += "\t\t\"bytes_received_per_s\": " + jsonNumber(rate(start_counters.num_bytes_received, end_counters.num_bytes_received, measurement_period) / per_client_divisor) + ",\n";
+	s += "\t\t\"bytes_received_total\": " + jsonNumber((double)end_counters.num_bytes_received / per_client_divisor) + "\n"; // Including the initial world state.
+	s += "\t},\n";
+
+	s += "\t\"latency_ms\": {\n";
+	for(int i=0; i<NUM_LATENCY_TYPES; ++i)
+	{
+		const LatencySamples::Summary& summary = latency_summaries[i];
+		s += "\t\t" + jsonString(latencyTypeName(i)) + ": {\"count\": " + ::toString((uint64)summary.num_samples) +
+			", \"mean\": " + jsonNumber(summary.mean * 1.0e3) +
+			", \"p50\": " + jsonNumber(summary.p50 * 1.0e3) +
+			", \"p90\": " + jsonNumber(summary.p90 * 1.0e3) +
+			", \"p99\": " + jsonNumber(summary.p99 * 1.0e3) +
+			", \"p999\": " + jsonNumber(summary.p999 * 1.0e3) +
+			", \"max\": " + jsonNumber(summary.max * 1.0e3) + "}" + ((i + 1 < NUM_LATENCY_TYPES) ? ",\n" : "\n");
+	}
+	s += "\t}\n";
+
+	s += "}\n";
+	return s;
+}
+
+
+std::string BenchmarkResults::toString() const
+{
+	std::string s;
+	s += "Bots ready: " + ::toString(num_bots_ready) + " / " + ::toString(num_bots) + " (" + ::toString(num_bots_failed) + " failed)\n";
+	s += "Measurement period: " + doubleToStringNSigFigs(measurement_period, 4) + " s\n";
+	s += "Process CPU time: " + doubleToStringNSigFigs(process_cpu_time, 4) + " s (" + doubleToStringNSigFigs(process_cpu_time / myMax(1.0e-9, measurement_period) * 100, 3) + "% of one core)\n";
+	s += "Messages sent: " + doubleToStringNSigFigs(rate(start_counters.num_msgs_sent, end_counters.num_msgs_sent, measurement_period), 4) + " /s, received: " +
+		doubleToStringNSigFigs(rate(start_counters.num_msgs_received, end_counters.num_msgs_received, measurement_period), 4) + " /s\n";
+	s += "Bytes sent: " + getNiceByteSize((uint64)rate(start_counters.num_bytes_sent, end_counters.num_bytes_sent, measurement_period)) + "/s, received: " +
+		getNiceByteSize((uint64)rate(start_counters.num_bytes_received, end_counters.num_bytes_received, measurement_period)) + "/s\n";
+	s += "Bytes received per client: " + getNiceByteSize((uint64)(rate(start_counters.num_bytes_received, end_counters.num_bytes_received, measurement_period) / myMax(1, num_bots_ready))) + "/s\n";
+
+	for(int i=0; i<NUM_LATENCY_TYPES; ++i)
+	{
+		const LatencySamples::Summary& summary = latency_summaries[i];
+		const std::string name = std::string(latencyTypeName(i)) + ":";
+		s += name + std::string(name.size() < 20 ? (20 - name.size()) : 0, ' ');
+		if(summary.num_samples == 0)
+			s += "no samples\n";
+		else
+			s += "p50: " + doubleToStringNSigFigs(summary.p50 * 1.0e3, 4) + " ms, p90: " + doubleToStringNSigFigs(summary.p90 * 1.0e3, 4) + " ms, p99: " + doubleToStringNSigFigs(summary.p99 * 1.0e3, 4) +
+				" ms, max: " + doubleToStringNSigFigs(summary.max * 1.0e3, 4) + " ms (" + ::toString((uint64)summary.num_samples) + " samples)\n";
+	}
+	return s;
+}
@@ -0,0 +1,134 @@
+/*=====================================================================
+BenchmarkStats.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+// The kinds of request whose latency the stress test bots measure.
+enum LatencyType
+{
+	Latency_Connect = 0,		// From starting the TCP connection until the assigned avatar UID is received.
+	Latency_Login,				// From sending LogInMessage until LoggedInMessageID is received.
+	Latency_InitialQuery,		// From sending QueryObjectsInAABB until all the objects in the AABB have been received.
+	Latency_AvatarUpdate,		// From sending AvatarTransformUpdate until the server broadcasts the update back to the bot.
+	Latency_ObjectCreate,		// From sending CreateObject until the ObjectCreated broadcast is received.
+	Latency_ObjectEdit,			// From sending ObjectTransformUpdate until the server broadcasts the update back to the bot.
+	Latency_ResourceDownload,	// From sending GetFiles until all the requested files have been received.
+	Latency_Voice,				// From sending a voice packet over UDP until it is received, relayed, by another bot.
+	NUM_LATENCY_TYPES
+};
+
+const char* latencyTypeName(int type);
+
+
+/*=====================================================================
+LatencySamples
+--------------
+Latency samples for each LatencyType.
+Not threadsafe, each bot thread has its own, which are merged at the end of the run.
+=====================================================================*/
+class LatencySamples
+{
+public:
+	void add(LatencyType type, double latency_s) { samples[type].push_back((float)latency_s); }
+
+	void append(const LatencySamples& other);
+
+	struct Summary
+	{
+		size_t num_samples;
+		double mean, p50, p90, p99, p999, max; // In seconds.  Zero if there are no samples.
+	};
+
+	// Sorts the samples for the given type.
+	Summary computeSummary(LatencyType type);
+
+	std::vector<float> samples[NUM_LATENCY_TYPES];
+};
+
+
+/*=====================================================================
+BenchmarkCounters
+-----------------
+Message and byte totals over all bots.  Threadsafe.
+Bot threads accumulate into a local LocalCounters and add it to the global counters periodically,
+so the atomics aren't updated for every message.
+=====================================================================*/
+class BenchmarkCounters
+{
+public:
+	BenchmarkCounters() : num_msgs_sent(0), num_msgs_received(0), num_bytes_sent(0), num_bytes_received(0), num_resource_bytes_received(0), num_voice_packets_received(0) {}
+
+	struct Snapshot
+	{
+		uint64 num_msgs_sent;
+		uint64 num_msgs_received;
+		uint64 num_bytes_sent;
+		uint64 num_bytes_received; // Includes resource downloads and UDP voice packets.
+		uint64 num_resource_bytes_received;
+		uint64 num_voice_packets_received;
+	};
+
+	Snapshot getSnapshot() const;
+
+	std::atomic<uint64> num_msgs_sent;
+	std::atomic<uint64> num_msgs_received;
+	std::atomic<uint64> num_bytes_sent;
+	std::atomic<uint64> num_bytes_received;
+	std::atomic<uint64> num_resource_bytes_received;
+	std::atomic<uint64> num_voice_packets_received;
+};
+
+
+struct LocalCounters
+{
+	LocalCounters() { clear(); }
+
+	void clear() { num_msgs_sent = num_msgs_received = num_bytes_sent = num_bytes_received = num_resource_bytes_received = num_voice_packets_received = 0; }
+
+	// Adds these counts to the global counters, and clears them.
+	void flushTo(BenchmarkCounters& counters);
+
+	uint64 num_msgs_sent;
+	uint64 num_msgs_received;
+	uint64 num_bytes_sent;
+	uint64 num_bytes_received;
+	uint64 num_resource_bytes_received;
+	uint64 num_voice_packets_received;
+};
+
+
+/*=====================================================================
+BenchmarkResults
+----------------
+Results of a stress test run, written as JSON so that runs can be compared by scripts.
+=====================================================================*/
+struct BenchmarkResults
+{
+	std::string server_hostname;
+	std::vector<std::string> world_names;
+	int num_bots;
+	int num_bots_ready; // Number of bots that connected, logged in and finished their initial query.
+	int num_bots_failed;
+	double edit_fraction;
+	double voice_fraction;
+	double download_fraction;
+
+	double measurement_period; // Length of the steady-state period the throughput is measured over, in seconds.
+	double process_cpu_time; // CPU time used by this process (all the bots) over the steady-state period, in seconds.  Run the server on another machine, or measure it separately, for the server CPU time.
+	BenchmarkCounters::Snapshot start_counters; // Counters at the start of the steady-state period.
+	BenchmarkCounters::Snapshot end_counters; // Counters at the end of the steady-state period.
+
+	LatencySamples::Summary latency_summaries[NUM_LATENCY_TYPES];
+
+	std::string toJSON() const;
+	std::string toString() const; // Human-readable summary.
+};
@@ -0,0 +1,467 @@
+/*=====================================================================
+SceneDownloadBenchmark.cpp
+--------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "SceneDownloadBenchmark.h"
+
+
+#include "../shared/Protocol.h"
+#include "../shared/WorldObject.h"
+#include "../shared/MessageUtils.h"
+#include "../shared/CompressedMessages.h"
+#include <networking/TLSSocket.h>
+#include <networking/MySocket.h>
+#include <maths/mathstypes.h>
+#include <PlatformUtils.h>
+#include <Timer.h>
+#include <ConPrint.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <BufferInStream.h>
+#include <SocketBufferOutStream.h>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+
+
+namespace SceneDownloadBenchmark
+{
+
+
+static const uint32 MAX_MSG_LEN = 1000000;
+static const uint64 MAX_DOWNLOAD_FILE_SIZE = 1000000000;
+static const size_t READ_CHUNK_SIZE = 64 * 1024;
+
+
+struct SceneResource
+{
+	std::string URL;
+	float priority; // Same as the client's download queue priority: distance to camera * size factor.  Lower is more important.
+	bool visible; // Is the resource used by an object within visible_dist of the camera?
+};
+
+
+struct DownloadResults
+{
+	DownloadResults() : time_to_first_visible(-1), time_to_visible_scene(-1), time_to_all(-1), num_bytes(0), num_failed(0) {}
+
+	double time_to_first_visible;
+	double time_to_visible_scene;
+	double time_to_all;
+	uint64 num_bytes;
+	size_t num_failed;
+};
+
+
+// Keeps track of which resources have completed, for computing DownloadResults.
+struct CompletionTracker
+{
+	CompletionTracker(const std::vector<SceneResource>& resources_) : resources(resources_), num_done(0), num_visible_done(0)
+	{
+		num_visible = 0;
+		for(size_t i=0; i<resources.size(); ++i)
+			if(resources[i].visible)
+				num_visible++;
+	}
+
+	void resourceDone(size_t i, bool succeeded)
+	{
+		const double t = timer.elapsed();
+		num_done++;
+		if(!succeeded)
+			results.num_failed++;
+		if(resources[i].visible)
+		{
+			num_visible_done++;
+			if(results.time_to_first_visible < 0)
+				results.time_to_first_visible = t;
+			if(num_visible_done == num_visible)
+				results.time_to_visible_scene = t;
+		}
+		if(num_done == resources.size())
+			results.time_to_all = t;
+	}
+
+	const std::vector<SceneResource>& resources;
+	Timer timer;
+	size_t num_done, num_visible, num_visible_done;
+	DownloadResults results;
+};
+
+
+// Limits the rate data is read from a socket, by sleeping when ahead of schedule.
+// The server is then limited by TCP flow control, like when sending to a client on a slow connection.
+class ReceiveRateLimiter
+{
+public:
+	ReceiveRateLimiter(double bytes_per_s_) : bytes_per_s(bytes_per_s_), total_bytes(0) {}
+
+	void bytesReceived(uint64 n)
+	{
+		total_bytes += n;
+		if(bytes_per_s > 0)
+		{
+			const double ahead = total_bytes / bytes_per_s - timer.elapsed();
+			if(ahead > 0.001)
+				PlatformUtils::Sleep((int)(ahead * 1000));
+		}
+	}
+
+	double bytes_per_s;
+	uint64 total_bytes;
+	Timer timer;
+};
+
+
+// Reads and discards len bytes of file data from the socket, at the limited rate.
+static void readFileData(SocketInterface& socket, uint64 len, std::vector<uint8>& buf, ReceiveRateLimiter& limiter)
+{
+	buf.resize(READ_CHUNK_SIZE);
+	for(uint64 received = 0; received < len; )
+	{
+		const size_t chunk_size = (size_t)myMin<uint64>(len - received, buf.size());
+		socket.readData(buf.data(), chunk_size);
+		received += chunk_size;
+		limiter.bytesReceived(chunk_size);
+	}
+}
+
+
+// Connects and does the handshake.  Returns the server protocol version.
+static SocketInterfaceRef connect(const StressTestConfig& config, struct tls_config* client_tls_config, uint32 connection_type, uint32& server_protocol_version_out)
+{
+	MySocketRef plain_socket = new MySocket();
+	plain_socket->setUseNetworkByteOrder(false);
+	plain_socket->connect(config.server_hostname, config.server_port);
+
+	SocketInterfaceRef socket = new TLSSocket(plain_socket, client_tls_config, config.server_hostname);
+
+	socket->writeUInt32(Protocol::CyberspaceHello);
+	socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
+	socket->writeUInt32(connection_type);
+	if(connection_type == Protocol::ConnectionTypeUpdates)
+		socket->writeStringLengthFirst(""); // World name: the main world.
+
+	const uint32 hello_response = socket->readUInt32();
+	if(hello_response != Protocol::CyberspaceHello)
+		throw glare::Exception("Invalid hello from server: " + toString(hello_response));
+
+	const uint32 protocol_response = socket->readUInt32();
+	if(protocol_response == Protocol::ClientProtocolTooOld || protocol_response == Protocol::ClientProtocolTooNew)
+		throw glare::Exception(socket->readStringLengthFirst(10000));
+	else if(protocol_response != Protocol::ClientProtocolOK)
+		throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
+
+	server_protocol_version_out = socket->readUInt32();
+	return socket;
+}
+
+
+static void disconnectDownloadSocket(SocketInterface& socket)
+{
+	socket.writeUInt32(Protocol::CyberspaceGoodbye);
+	socket.startGracefulShutdown();
+}
+
+
+static void addObjectResources(const WorldObject& ob, const SceneDownloadBenchmarkConfig& benchmark_config, std::map<std::string, SceneResource>& resources)
+{
+	// Approximate the world-space size from the object-space AABB and scale, for the priority.
+	const float aabb_ws_longest_len = ob.getAABBOS().longestLength() * myMax(std::fabs(ob.scale.x), myMax(std::fabs(ob.scale.y), std::fabs(ob.scale.z)));
+	const float size_factor = 1.f / myMax(1.0f, aabb_ws_longest_len); // As in DownloadQueueItem::sizeFactorForAABBWS()
+	const double dist = ob.pos.getDist(benchmark_config.cam_pos);
+	const float priority = (float)dist * size_factor;
+
+	WorldObject::GetDependencyOptions options;
+	std::set<DependencyURL> URLs;
+	ob.getDependencyURLSetBaseLevel(options, URLs);
+
+	for(auto it = URLs.begin(); it != URLs.end(); ++it)
+	{
+		const std::string& URL = it->URL;
+		if(hasPrefix(URL, "http://") || hasPrefix(URL, "https://")) // The client downloads these directly, not from the server.
+			continue;
+
+		auto res = resources.find(URL);
+		if(res == resources.end())
+		{
+			SceneResource resource;
+			resource.URL = URL;
+			resource.priority = priority;
+			resource.visible = dist <= benchmark_config.visible_dist;
+			resources[URL] = resource;
+		}
+		else
+		{
+			// Resource is shared by multiple objects, use the most important.
+			res->second.priority = myMin(res->second.priority, priority);
+			res->second.visible = res->second.visible || (dist <= benchmark_config.visible_dist);
+		}
+	}
+}
+
+
+static void handleQueryMessage(uint32 msg_type, BufferInStream& msg_buffer, const SceneDownloadBenchmarkConfig& benchmark_config, std::map<std::string, SceneResource>& resources, size_t& num_obs)
+{
+	if(msg_type == Protocol::ObjectInitialSend)
+	{
+		WorldObject ob;
+		ob.uid = readUIDFromStream(msg_buffer);
+		readWorldObjectFromNetworkStreamGivenUID(msg_buffer, ob);
+		addObjectResources(ob, benchmark_config, resources);
+		num_obs++;
+	}
+}
+
+
+// Queries the objects around the camera, and returns their resources, sorted by priority.
+static void querySceneResources(const StressTestConfig& config, const SceneDownloadBenchmarkConfig& benchmark_config, struct tls_config* client_tls_config, std::vector<SceneResource>& resources_out)
+{
+	uint32 server_protocol_version;
+	SocketInterfaceRef socket = connect(config, client_tls_config, Protocol::ConnectionTypeUpdates, server_protocol_version);
+	readUIDFromStream(*socket); // Read client avatar UID
+
+	SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+	const Vec3d& cam_pos = benchmark_config.cam_pos;
+	const double r = benchmark_config.query_radius;
+	MessageUtils::initPacket(packet, Protocol::QueryObjectsInAABB);
+	writeToStream<double>(cam_pos, packet);
+	packet.writeFloat((float)(cam_pos.x - r));
+	packet.writeFloat((float)(cam_pos.y - r));
+	packet.writeFloat((float)(cam_pos.z - r));
+	packet.writeFloat((float)(cam_pos.x + r));
+	packet.writeFloat((float)(cam_pos.y + r));
+	packet.writeFloat((float)(cam_pos.z + r));
+	MessageUtils::updatePacketLengthField(packet);
+	socket->writeData(packet.buf.data(), packet.buf.size());
+
+	// As in StressTestBots, take the reply to an empty map tile query to mean all the query results have been received.
+	MessageUtils::initPacket(packet, Protocol::QueryMapTiles);
+	packet.writeUInt32(0); // Num tiles
+	MessageUtils::updatePacketLengthField(packet);
+	socket->writeData(packet.buf.data(), packet.buf.size());
+
+	std::map<std::string, SceneResource> resources;
+	size_t num_obs = 0;
+	BufferInStream msg_buffer;
+	js::Vector<uint8, 16> decompressed_msgs;
+	while(1)
+	{
+		uint32 msg_type_and_len[2];
+		socket->readData(msg_type_and_len, sizeof(uint32) * 2);
+		const uint32 msg_type = msg_type_and_len[0];
+		const uint32 msg_len = msg_type_and_len[1];
+		if((msg_len < sizeof(uint32) * 2) || (msg_len > MAX_MSG_LEN))
+			throw glare::Exception("Invalid message size: " + toString(msg_len));
+
+		msg_buffer.buf.resizeNoCopy(msg_len);
+		msg_buffer.read_index = sizeof(uint32) * 2;
+		socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2);
+
+		if(msg_type == Protocol::MapTilesResult)
+			break;
+		else if(msg_type == Protocol::CompressedMessages)
+		{
+			CompressedMessages::decompressMessages(msg_buffer, decompressed_msgs);
+			size_t offset = 0;
+			while(offset < decompressed_msgs.size())
+			{
+				const uint32 inner_msg_type = CompressedMessages::readNextMessage(decompressed_msgs, offset, msg_buffer);
+				handleQueryMessage(inner_msg_type, msg_buffer, benchmark_config, resources, num_obs);
+			}
+		}
+		else
+			handleQueryMessage(msg_type, msg_buffer, benchmark_config, resources, num_obs);
+	}
+
+	MessageUtils::initPacket(packet, Protocol::CyberspaceGoodbye);
+	MessageUtils::updatePacketLengthField(packet);
+	socket->writeData(packet.buf.data(), packet.buf.size());
+	socket->startGracefulShutdown();
+
+	resources_out.clear();
+	for(auto it = resources.begin(); it != resources.end(); ++it)
+		resources_out.push_back(it->second);
+
+	std::sort(resources_out.begin(), resources_out.end(), [](const SceneResource& a, const SceneResource& b) { return a.priority < b.priority; });
+
+	size_t num_visible = 0;
+	for(size_t i=0; i<resources_out.size(); ++i)
+		if(resources_out[i].visible)
+			num_visible++;
+
+	conPrint("Queried " + toString(num_obs) + " objects, using " + toString(resources_out.size()) + " resources (" + toString(num_visible) + " in visible scene)");
+}
+
+
+// Downloads the resources in priority order with GetFiles requests for a few files at a time, like DownloadResourcesThread does with older servers.
+static DownloadResults downloadLegacy(const StressTestConfig& config, const SceneDownloadBenchmarkConfig& benchmark_config, struct tls_config* client_tls_config,
+	const std::vector<SceneResource>& resources, double bandwidth_bits_per_s)
+{
+	uint32 server_protocol_version;
+	SocketInterfaceRef socket = connect(config, client_tls_config, Protocol::ConnectionTypeDownloadResources, server_protocol_version);
+
+	CompletionTracker tracker(resources);
+	ReceiveRateLimiter limiter(bandwidth_bits_per_s / 8);
+	std::vector<uint8> buf;
+
+	for(size_t begin = 0; begin < resources.size(); begin += benchmark_config.legacy_files_per_request)
+	{
+		const size_t end = myMin(resources.size(), begin + benchmark_config.legacy_files_per_request);
+
+		socket->writeUInt32(Protocol::GetFiles);
+		socket->writeUInt64(end - begin);
+		for(size_t i=begin; i<end; ++i)
+			socket->writeStringLengthFirst(resources[i].URL);
+
+		for(size_t i=begin; i<end; ++i)
+		{
+			const uint32 result = socket->readUInt32();
+			if(result == 0)
+			{
+				const uint64 file_len = socket->readUInt64();
+				if(file_len > MAX_DOWNLOAD_FILE_SIZE)
+					throw glare::Exception("Downloaded file too large (len=" + toString(file_len) + ").");
+
+				readFileData(*socket, file_len, buf, limiter);
+			}
+			tracker.resourceDone(i, /*succeeded=*/result == 0);
+		}
+	}
+
+	disconnectDownloadSocket(*socket);
+
+	tracker.results.num_bytes = limiter.total_bytes;
+	return tracker.results;
+}
+
+
+// Downloads the resources with multiplexed ResourceRequests, keeping up to max_outstanding_requests outstanding.
+static DownloadResults downloadMultiplexed(const StressTestConfig& config, const SceneDownloadBenchmarkConfig& benchmark_config, struct tls_config* client_tls_config,
+	const std::vector<SceneResource>& resources, double bandwidth_bits_per_s)
+{
+	uint32 server_protocol_version;
+	SocketInterfaceRef socket = connect(config, client_tls_config, Protocol::ConnectionTypeDownloadResources, server_protocol_version);
+	if(server_protocol_version < 43)
+		throw glare::Exception("Server does not support multiplexed resource requests (server protocol version: " + toString(server_protocol_version) + ")");
+
+	CompletionTracker tracker(resources);
+	ReceiveRateLimiter limiter(bandwidth_bits_per_s / 8);
+	std::vector<uint8> buf;
+
+	struct OutstandingRequest
+	{
+		size_t resource_i;
+		uint64 remaining; // Bytes still to receive, once the result has been received.
+	};
+	std::map<uint32, OutstandingRequest> outstanding; // Map from request id to request
+
+	size_t next_resource_i = 0;
+	while(tracker.num_done < resources.size())
+	{
+		// Keep max_outstanding_requests requests outstanding.  Request ids are just the resource indices.
+		while((outstanding.size() < (size_t)benchmark_config.max_outstanding_requests) && (next_resource_i < resources.size()))
+		{
+			socket->writeUInt32(Protocol::ResourceRequest);
+			socket->writeUInt32((uint32)next_resource_i);
+			socket->writeStringLengthFirst(resources[next_resource_i].URL);
+			socket->writeUInt64(0); // Start offset
+			socket->writeFloat(resources[next_resource_i].priority);
+
+			OutstandingRequest request;
+			request.resource_i = next_resource_i;
+			request.remaining = std::numeric_limits<uint64>::max();
+			outstanding[(uint32)next_resource_i] = request;
+			next_resource_i++;
+		}
+
+		const uint32 msg_type = socket->readUInt32();
+		if(msg_type == Protocol::ResourceRequestResult)
+		{
+			const uint32 request_id = socket->readUInt32();
+			const uint32 result = socket->readUInt32();
+
+			auto res = outstanding.find(request_id);
+			if(res == outstanding.end())
+				throw glare::Exception("Result for unknown request");
+
+			if(result == 0)
+			{
+				const uint64 file_len = socket->readUInt64();
+				const uint64 start_offset = socket->readUInt64();
+				if(file_len > MAX_DOWNLOAD_FILE_SIZE || start_offset > file_len)
+					throw glare::Exception("Invalid file length or start offset.");
+				res->second.remaining = file_len - start_offset;
+			}
+
+			if(result != 0 || res->second.remaining == 0)
+			{
+				tracker.resourceDone(res->second.resource_i, /*succeeded=*/result == 0);
+				outstanding.erase(res);
+			}
+		}
+		else if(msg_type == Protocol::ResourceDataChunk)
+		{
+			const uint32 request_id = socket->readUInt32();
+			const uint32 chunk_len = socket->readUInt32();
+
+			auto res = outstanding.find(request_id);
+			if(res == outstanding.end() || chunk_len > res->second.remaining)
+				throw glare::Exception("Invalid chunk");
+
+			readFileData(*socket, chunk_len, buf, limiter);
+			res->second.remaining -= chunk_len;
+			if(res->second.remaining == 0)
+			{
+				tracker.resourceDone(res->second.resource_i, /*succeeded=*/true);
+				outstanding.erase(res);
+			}
+		}
+		else
+			throw glare::Exception("Invalid message type from server: " + toString(msg_type));
+	}
+
+	disconnectDownloadSocket(*socket);
+
+	tracker.results.num_bytes = limiter.total_bytes;
+	return tracker.results;
+}
+
+
+static std::string timeString(double t)
+{
+	return (t < 0) ? std::string("n/a") : (doubleToStringNSigFigs(t, 4) + " s");
+}
+
+
+static void printResults(const std::string& label, const DownloadResults& results)
+{
+	conPrint(label + ": first visible resource: " + timeString(results.time_to_first_visible) + ", visible scene: " + timeString(results.time_to_visible_scene) +
+		", all resources: " + timeString(results.time_to_all) + " (" + getNiceByteSize(results.num_bytes) + ", " + toString(results.num_failed) + " failed)");
+}
+
+
+void run(const StressTestConfig& config, const SceneDownloadBenchmarkConfig& benchmark_config, struct tls_config* client_tls_config)
+{
+	conPrint("Scene download benchmark: camera at " + benchmark_config.cam_pos.toString() + ", visible dist: " + toString(benchmark_config.visible_dist) + " m, bandwidth: " +
+		doubleToStringNSigFigs(benchmark_config.bandwidth_bits_per_s / 1.0e6, 4) + " Mbit/s");
+
+	std::vector<SceneResource> resources;
+	querySceneResources(config, benchmark_config, client_tls_config, resources);
+	if(resources.empty())
+		return;
+
+	// Do an unlimited-bandwidth download first, so that the server has the files in the OS file cache for both measured runs.
+	downloadLegacy(config, benchmark_config, client_tls_config, resources, /*bandwidth_bits_per_s=*/0);
+
+	const DownloadResults legacy_results = downloadLegacy(config, benchmark_config, client_tls_config, resources, benchmark_config.bandwidth_bits_per_s);
+	printResults("GetFiles (" + toString(benchmark_config.legacy_files_per_request) + " files per request)", legacy_results);
+
+	const DownloadResults multiplexed_results = downloadMultiplexed(config, benchmark_config, client_tls_config, resources, benchmark_config.bandwidth_bits_per_s);
+	printResults("Multiplexed (" + toString(benchmark_config.max_outstanding_requests) + " outstanding requests)", multiplexed_results);
+}
+
+
+} // end namespace SceneDownloadBenchmark
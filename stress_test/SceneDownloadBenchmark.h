@@ -0,0 +1,43 @@
+/*=====================================================================
+SceneDownloadBenchmark.h
+------------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "StressTestBots.h"
+#include <maths/vec3.h>
+#include <string>
+struct tls_config;
+
+
+struct SceneDownloadBenchmarkConfig
+{
+	Vec3d cam_pos;
+	double query_radius; // Half-width of the AABB objects are queried in.
+	double visible_dist; // Resources of objects within this distance of the camera make up the 'visible scene'.
+	double bandwidth_bits_per_s; // Client receive rate is limited to this, so that ordering effects show up on a local server.
+	int legacy_files_per_request; // Number of files in each GetFiles request in legacy mode, same as the client's DownloadResourcesThread.
+	int max_outstanding_requests; // Max outstanding ResourceRequests in multiplexed mode.
+};
+
+
+/*=====================================================================
+SceneDownloadBenchmark
+----------------------
+Measures time-to-visible-scene for a client joining a world: the time until all the resources used by the objects
+within visible_dist of the camera have been downloaded.
+
+Queries the objects around the camera on a (usually local) server, which should be running with a recorded
+world state, then downloads the resources of the returned objects, most important first,
+with both the legacy serial GetFiles requests and the multiplexed ResourceRequests, over a single connection each.
+
+Resources are the base-level (non-LOD) model and texture URLs of the objects.
+Prioritised the same way as the client's DownloadingResourceQueue, with a static camera.
+Downloaded data is discarded.
+=====================================================================*/
+namespace SceneDownloadBenchmark
+{
+	void run(const StressTestConfig& config, const SceneDownloadBenchmarkConfig& benchmark_config, struct tls_config* client_tls_config);
+}
@@ -1,272 +1,306 @@
 /*=====================================================================
-ScreenshotBot.h
-----------------
+StressTest.cpp
+--------------
 Copyright Glare Technologies Limited 2021 -
 =====================================================================*/
 
 
-#include "../shared/Protocol.h"
-#include "../shared/UID.h"
-#include "../shared/Avatar.h"
-#include <networking/networking.h>
+#include "StressTestBots.h"
+#include "BenchmarkStats.h"
+#include "SceneDownloadBenchmark.h"
+#include <networking/Networking.h>
 #include <networking/TLSSocket.h>
-#include <networking/url.h>
-#include <utils/SocketBufferOutStream.h>
-#include <utils/BufferInStream.h>
-#include <utils/SocketBufferOutStream.h>
-#include <maths/vec3.h>
+#include <networking/MySocket.h>
+#include <maths/PCG32.h>
+#include <maths/mathstypes.h>
+#include <utils/ArgumentParser.h>
 #include <PlatformUtils.h>
 #include <Clock.h>
 #include <Timer.h>
-#include <MyThread.h>
-#include <PCG32.h>
+#include <ThreadManager.h>
 #include <ConPrint.h>
 #include <OpenSSL.h>
 #include <Exception.h>
 #include <FileUtils.h>
 #include <StringUtils.h>
-#include <GlareProcess.h>
-#include <CryptoRNG.h>
 #include <tls.h>
+#include <ctime>
 
 
-// TODO: do authentication
-//static const std::string username = "screenshotbot";
-//static const std::string password = "1NzpaaM3qN";
+/*
+Load-generation benchmark for the server.
 
+Runs many bots against a (usually local) server, with a mix of workloads:
+all bots connect, log in, query the objects around them with QueryObjectsInAABB, and send avatar updates,
+and configurable fractions of the bots also create and edit objects, download resources, and send voice over UDP.
 
-static void updatePacketLengthField(SocketBufferOutStream& packet)
+Once all bots are ready, throughput and latencies are measured over a steady-state period, then a summary is printed
+and the results are written as JSON, e.g. for comparing runs before and after a server change.
+
+Usage: stress_test [--host hostname] [--bots num_bots] [--duration seconds] [--worlds world_names] [--output results.json] ...
+world_names is a comma-separated list of worlds to connect to, e.g. ",alice,bob" for the main world plus the personal worlds of users alice and bob.
+Bots are spread evenly over the worlds.  Defaults to just the main world.
+
+With --scene_download_benchmark, runs SceneDownloadBenchmark instead of the bots:
+stress_test --scene_download_benchmark [--cam_x x] [--cam_y y] [--cam_z z] [--visible_dist metres] [--bandwidth_mbit mbit_per_s] [--max_outstanding num_requests] ...
+--query_radius and --files_per_download are also used by the benchmark.
+*/
+
+
+static std::string getStringArg(const ArgumentParser& parsed_args, const std::string& name, const std::string& default_val)
 {
-	// length field is second uint32
-	assert(packet.buf.size() >= sizeof(uint32) * 2);
-	if(packet.buf.size() >= sizeof(uint32) * 2)
-	{
-		const uint32 len = (uint32)packet.buf.size();
-		std::memcpy(&packet.buf[4], &len, 4);
-	}
+	return parsed_args.isArgPresent(name) ? parsed_args.getArgStringValue(name) : default_val;
 }
 
+static int getIntArg(const ArgumentParser& parsed_args, const std::string& name, int default_val)
+{
+	return parsed_args.isArgPresent(name) ? stringToInt(parsed_args.getArgStringValue(name)) : default_val;
+}
 
-static void initPacket(SocketBufferOutStream& scratch_packet, uint32 message_id)
+static double getDoubleArg(const ArgumentParser& parsed_args, const std::string& name, double default_val)
 {
-	scratch_packet.buf.resize(sizeof(uint32) * 2);
-	std::memcpy(&scratch_packet.buf[0], &message_id, sizeof(uint32));
-	std::memset(&scratch_packet.buf[4], 0, sizeof(uint32)); // Write dummy message length, will be updated later when size of message is known.
+	return parsed_args.isArgPresent(name) ? stringToDouble(parsed_args.getArgStringValue(name)) : default_val;
 }
 
 
-class StressTestBotThread : public MyThread
+static void printProgress(const StressTestSharedState& shared_state, int num_bots, const BenchmarkCounters::Snapshot& prev, const BenchmarkCounters::Snapshot& cur, double period)
 {
-public:
-	virtual void run()
-	{
-		// Connect to substrata server
-		try
-		{
-			//const std::string server_hostname = "localhost";
-			const std::string server_hostname = "substrata.info";
-			const int server_port = 7600;
+	conPrint("Bots ready: " + toString((int)shared_state.num_bots_ready) + " / " + toString(num_bots) + " (" + toString((int)shared_state.num_bots_failed) + " failed), " +
+		"msgs sent: " + doubleToStringNSigFigs((cur.num_msgs_sent - prev.num_msgs_sent) / period, 4) + " /s, msgs received: " + doubleToStringNSigFigs((cur.num_msgs_received - prev.num_msgs_received) / period, 4) + " /s, " +
+		"received: " + getNiceByteSize((uint64)((cur.num_bytes_received - prev.num_bytes_received) / period)) + "/s");
+}
 
-			conPrint("Connecting to " + server_hostname + ":" + toString(server_port) + "...");
 
-			MySocketRef plain_socket = new MySocket();
-			plain_socket->setUseNetworkByteOrder(false);
-			plain_socket->connect(server_hostname, server_port);
+int main(int argc, char* argv[])
+{
+	Clock::init();
+	Networking::createInstance();
+	PlatformUtils::ignoreUnixSignals();
+	OpenSSL::init();
+	TLSSocket::initTLS();
 
-			conPrint("Connected to " + server_hostname + ":" + toString(server_port) + "!");
+	try
+	{
+		std::map<std::string, std::vector<ArgumentParser::ArgumentType> > syntax;
+		const char* string_args[] = { "--host", "--port", "--bots", "--bots_per_thread", "--worlds", "--duration", "--max_connect_time", "--output", "--seed",
+			"--area_width", "--query_radius", "--avatar_update_period",
+			"--edit_fraction", "--edit_period",
+			"--download_fraction", "--download_period", "--files_per_download",
+			"--voice_fraction", "--voice_period", "--voice_packet_size",
+			"--cam_x", "--cam_y", "--cam_z", "--visible_dist", "--bandwidth_mbit", "--max_outstanding" };
+		for(size_t i=0; i<staticArrayNumElems(string_args); ++i)
+			syntax[string_args[i]] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // One string arg
+		syntax["--scene_download_benchmark"] = std::vector<ArgumentParser::ArgumentType>();
+
+		std::vector<std::string> args;
+		for(int i=0; i<argc; ++i)
+			args.push_back(argv[i]);
+
+		ArgumentParser parsed_args(args, syntax, /*allow_unnamed_arg=*/false);
+
+		StressTestConfig config;
+		config.server_hostname			= getStringArg(parsed_args, "--host", "localhost");
+		config.server_port				= getIntArg(parsed_args, "--port", 7600);
+		config.area_width				= getDoubleArg(parsed_args, "--area_width", 200.0);
+		config.query_radius				= getDoubleArg(parsed_args, "--query_radius", 500.0);
+		config.avatar_update_period		= getDoubleArg(parsed_args, "--avatar_update_period", 0.1);
+		config.edit_period				= getDoubleArg(parsed_args, "--edit_period", 1.0);
+		config.download_period			= getDoubleArg(parsed_args, "--download_period", 2.0);
+		config.max_files_per_download	= myMax(1, getIntArg(parsed_args, "--files_per_download", 4));
+		config.voice_period				= getDoubleArg(parsed_args, "--voice_period", 0.02); // 20 ms Opus frames
+		config.voice_packet_size		= getIntArg(parsed_args, "--voice_packet_size", 100);
+
+		const int num_bots				= getIntArg(parsed_args, "--bots", 500);
+		const int bots_per_thread		= myMax(1, getIntArg(parsed_args, "--bots_per_thread", 32));
+		const std::vector<std::string> world_names = parsed_args.isArgPresent("--worlds") ? ::split(parsed_args.getArgStringValue("--worlds"), ',') : std::vector<std::string>(1, "");
+		const double duration			= getDoubleArg(parsed_args, "--duration", 60.0);
+		const double max_connect_time	= getDoubleArg(parsed_args, "--max_connect_time", 120.0);
+		const std::string output_path	= getStringArg(parsed_args, "--output", "stress_test_results.json");
+		const int seed					= getIntArg(parsed_args, "--seed", 1);
+		const double edit_fraction		= getDoubleArg(parsed_args, "--edit_fraction", 0.1);
+		const double download_fraction	= getDoubleArg(parsed_args, "--download_fraction", 0.05);
+		const double voice_fraction		= getDoubleArg(parsed_args, "--voice_fraction", 0.1);
+
+		if(num_bots <= 0)
+			throw glare::Exception("Invalid number of bots.");
+
+		// Create and init TLS client config
+		struct tls_config* client_tls_config = tls_config_new();
+		if(!client_tls_config)
+			throw glare::Exception("Failed to initialise TLS (tls_config_new failed)");
+		tls_config_insecure_noverifycert(client_tls_config); // The server is usually running locally with a self-signed certificate.
+		tls_config_insecure_noverifyname(client_tls_config);
+
+		if(parsed_args.isArgPresent("--scene_download_benchmark"))
+		{
+			SceneDownloadBenchmarkConfig benchmark_config;
+			benchmark_config.cam_pos = Vec3d(getDoubleArg(parsed_args, "--cam_x", 0.0), getDoubleArg(parsed_args, "--cam_y", 0.0), getDoubleArg(parsed_args, "--cam_z", 2.0));
+			benchmark_config.query_radius				= config.query_radius;
+			benchmark_config.visible_dist				= getDoubleArg(parsed_args, "--visible_dist", 100.0);
+			benchmark_config.bandwidth_bits_per_s		= getDoubleArg(parsed_args, "--bandwidth_mbit", 20.0) * 1.0e6;
+			benchmark_config.legacy_files_per_request	= config.max_files_per_download;
+			benchmark_config.max_outstanding_requests	= myMax(1, getIntArg(parsed_args, "--max_outstanding", 16));
+
+			SceneDownloadBenchmark::run(config, benchmark_config, client_tls_config);
+
+			tls_config_free(client_tls_config);
+			return 0;
+		}
 
-			SocketInterfaceRef socket = new TLSSocket(plain_socket, client_tls_config, server_hostname);
+		const std::vector<IPAddress> server_ips = Networking::doDNSLookup(config.server_hostname);
+		if(server_ips.empty())
+			throw glare::Exception("Failed to look up server hostname '" + config.server_hostname + "'");
+		const IPAddress server_ip_addr = server_ips[0];
 
-			socket->writeUInt32(Protocol::CyberspaceHello); // Write hello
-			socket->writeUInt32(Protocol::CyberspaceProtocolVersion); // Write protocol version
-			socket->writeUInt32(Protocol::ConnectionTypeUpdates); // Write connection type
+		conPrint("Running " + toString(num_bots) + " bots against " + config.server_hostname + ":" + toString(config.server_port) + " in " + toString(world_names.size()) + " world(s)");
 
-			socket->writeStringLengthFirst(""); // Write world name
+		//------------------------------ Create bots, and assign them to threads ------------------------------
+		// Downloading bots do their downloads on their own ResourceDownloadThread, started by their group thread, so can share groups with the other bots.
+		std::vector<StressTestBotRef> bots;
+		size_t num_download_bots = 0;
+		for(int i=0; i<num_bots; ++i)
+		{
+			StressTestBotRef bot = new StressTestBot(i, /*seed=*/(uint64)seed * 1000003 + i);
+			bot->world_name = world_names[i % world_names.size()];
+			bot->does_object_edits	= bot->rng.unitRandom() < edit_fraction;
+			bot->does_downloads		= bot->rng.unitRandom() < download_fraction;
+			bot->does_voice			= bot->rng.unitRandom() < voice_fraction;
+
+			if(bot->does_downloads)
+				num_download_bots++;
+			bots.push_back(bot);
+		}
 
-			// Read hello response from server
-			const uint32 hello_response = socket->readUInt32();
-			if(hello_response != Protocol::CyberspaceHello)
-				throw glare::Exception("Invalid hello from server: " + toString(hello_response));
+		StressTestSharedState shared_state;
+		ThreadManager thread_manager;
+		std::vector<Reference<StressTestBotGroupThread>> group_threads;
+		std::vector<Reference<VoiceReceiverThread>> voice_receiver_threads;
 
-			// Read protocol version response from server
-			const uint32 protocol_response = socket->readUInt32();
-			if(protocol_response == Protocol::ClientProtocolTooOld)
-			{
-				const std::string msg = socket->readStringLengthFirst(10000);
-				throw glare::Exception(msg);
-			}
-			else if(protocol_response == Protocol::ClientProtocolTooNew)
+		for(size_t begin=0; begin<bots.size(); begin += bots_per_thread)
+		{
+			Reference<StressTestBotGroupThread> group = new StressTestBotGroupThread(config, &shared_state, client_tls_config, server_ip_addr);
+			bool any_voice = false;
+			for(size_t i=begin; i<myMin(bots.size(), begin + bots_per_thread); ++i)
 			{
-				const std::string msg = socket->readStringLengthFirst(10000);
-				throw glare::Exception(msg);
+				group->bots.push_back(bots[i]);
+				any_voice = any_voice || bots[i]->does_voice;
 			}
-			else if(protocol_response == Protocol::ClientProtocolOK)
-			{}
-			else
-				throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
-
-			const uint32 peer_protocol_version = Protocol::CyberspaceProtocolVersion; // Just assume server is speaking the latest procotol version we know about, for now.
-			// TODO: Send server protocol version from the server.
-
 
-			// Read assigned client avatar UID
-			const UID client_avatar_uid = readUIDFromStream(*socket);
-
-
-			Vec3d cur_pos(0,0,1.67);
-			Vec3d cur_vel(0.5,0,0);
-			Vec3f cur_angles(0, Maths::pi_2<float>(), 0);
-
-
-			PCG32 rng(seed);
-			float heading = rng.unitRandom() * Maths::get2Pi<float>();
-			cur_angles = Vec3f(0, Maths::pi_2<float>(), heading);
-			cur_vel = Vec3d(cos(heading), sin(heading), 0) * 2;
-
-			SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
-			// Send CreateAvatar packet for this client's avatar
+			if(any_voice)
 			{
-				initPacket(scratch_packet, Protocol::CreateAvatar);
+				group->udp_socket = new UDPSocket();
+				group->udp_socket->createClientSocket(/*use_IPv6=*/server_ip_addr.getVersion() == IPAddress::Version_6);
 
-				Avatar avatar;
-				avatar.uid = client_avatar_uid;
-				avatar.pos = cur_pos;
-				avatar.rotation = cur_angles;
-				writeToNetworkStream(avatar, scratch_packet);
+				// Send dummy packet to server to make the OS bind the socket to a local port, so we can start reading from it.
+				uint32 dummy_type = 6;
+				group->udp_socket->sendPacket(&dummy_type, sizeof(dummy_type), server_ip_addr, 7601);
 
-				updatePacketLengthField(scratch_packet);
-				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+				Reference<VoiceReceiverThread> receiver = new VoiceReceiverThread(group->udp_socket, &shared_state);
+				voice_receiver_threads.push_back(receiver);
+				thread_manager.addThread(receiver);
 			}
 
-			
-			Timer timer;
-			Timer time_since_update_packet_sent;
-
-			BufferInStream msg_buffer;
+			group_threads.push_back(group);
+			thread_manager.addThread(group);
+		}
 
-			
-			Timer change_dir_timer;
-			
+		conPrint("Started " + toString(group_threads.size()) + " bot threads (" + toString(bots.size()) + " bots, " + toString(num_download_bots) + " downloading bots)");
 
-			double last_think_time = Clock::getCurTimeRealSec();
+		//------------------------------ Wait for bots to connect ------------------------------
+		Timer connect_timer;
+		BenchmarkCounters::Snapshot prev_counters = shared_state.counters.getSnapshot();
+		double last_print_time = 0;
+		while(((shared_state.num_bots_ready + shared_state.num_bots_failed) < num_bots) && (connect_timer.elapsed() < max_connect_time))
+		{
+			PlatformUtils::Sleep(100);
 
-			while(1)
+			if(connect_timer.elapsed() - last_print_time >= 5.0)
 			{
-				if(socket->readable(/*timeout_s=*/0.05))
-				{
-					// Read msg type and length
-					uint32 msg_type_and_len[2];
-					socket->readData(msg_type_and_len, sizeof(uint32) * 2);
-					const uint32 msg_type = msg_type_and_len[0];
-					const uint32 msg_len = msg_type_and_len[1];
-
-					// conPrint("ClientThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
-
-					if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
-						throw glare::Exception("Invalid message size: " + toString(msg_len));
-
-					// Read entire message
-					msg_buffer.buf.resizeNoCopy(msg_len);
-					msg_buffer.read_index = sizeof(uint32) * 2;
-
-					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
-
-					//conPrint("Read msg of type " + toString(msg_type));
-
-					switch(msg_type)
-					{
-						case Protocol::AllObjectsSent:
-						{
-						}
-					}
-				} // end if socket was readable
-
-				// Change heading to a random value every couple of seconds
-				if(change_dir_timer.elapsed() > 2)
-				{
-					heading = rng.unitRandom() * Maths::get2Pi<float>();// (float)std::atan2(cur_vel.y, cur_vel.x);
-					cur_angles = Vec3f(0, Maths::pi_2<float>(), heading);
-
-					//cur_vel = normalise(Vec3d(rng.unitRandom(), rng.unitRandom(), 0));
-					cur_vel = Vec3d(cos(heading), sin(heading), 0) * 2;
-
-					change_dir_timer.reset();
-				}
-
-				const double cur_time = Clock::getCurTimeRealSec();
-				const double dt = myMin(0.1, cur_time - last_think_time);
-				last_think_time = cur_time;
-				cur_pos += cur_vel * dt;
-				
-
-				// Send AvatarTransformUpdate packet every 0.1 s
-				if(time_since_update_packet_sent.elapsed() > 0.1)
-				{
-					const uint32 anim_state = 0;
-
-					initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
-					writeToStream(client_avatar_uid, scratch_packet);
-					writeToStream(cur_pos, scratch_packet);
-					writeToStream(cur_angles, scratch_packet);
-					scratch_packet.writeUInt32(anim_state);
-
-					updatePacketLengthField(scratch_packet);
-					socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-
-					time_since_update_packet_sent.reset();
-				}
-
-			} // End while(1) loop
+				const BenchmarkCounters::Snapshot cur_counters = shared_state.counters.getSnapshot();
+				printProgress(shared_state, num_bots, prev_counters, cur_counters, connect_timer.elapsed() - last_print_time);
+				prev_counters = cur_counters;
+				last_print_time = connect_timer.elapsed();
+			}
 		}
-		catch(glare::Exception& e)
+		conPrint(toString((int)shared_state.num_bots_ready) + " bots ready after " + connect_timer.elapsedStringNSigFigs(4));
+
+		//------------------------------ Measure steady-state throughput and latencies ------------------------------
+		BenchmarkResults results;
+		results.start_counters = shared_state.counters.getSnapshot();
+		shared_state.measuring = true;
+		Timer measurement_timer;
+		const std::clock_t measurement_cpu_start = std::clock();
+
+		prev_counters = results.start_counters;
+		last_print_time = 0;
+		while(measurement_timer.elapsed() < duration)
 		{
-			// Connection failed.
-			conPrint("Error: " + e.what());
-			//PlatformUtils::Sleep(1000);
+			PlatformUtils::Sleep(myMin(1000, myMax(1, (int)((duration - measurement_timer.elapsed()) * 1000))));
+
+			if(measurement_timer.elapsed() - last_print_time >= 5.0)
+			{
+				const BenchmarkCounters::Snapshot cur_counters = shared_state.counters.getSnapshot();
+				printProgress(shared_state, num_bots, prev_counters, cur_counters, measurement_timer.elapsed() - last_print_time);
+				prev_counters = cur_counters;
+				last_print_time = measurement_timer.elapsed();
+			}
 		}
-	}
 
-	struct tls_config* client_tls_config;
-	int seed;
-};
+		shared_state.measuring = false;
+		results.end_counters = shared_state.counters.getSnapshot();
+		results.measurement_period = measurement_timer.elapsed();
+		results.process_cpu_time = (double)(std::clock() - measurement_cpu_start) / CLOCKS_PER_SEC; // Over all bot threads.
+		results.num_bots_ready = shared_state.num_bots_ready;
+		results.num_bots_failed = shared_state.num_bots_failed;
 
+		//------------------------------ Stop bots and gather results ------------------------------
+		conPrint("Stopping bots...");
+		thread_manager.killThreadsBlocking();
 
-int main(int argc, char* argv[])
-{
-	Clock::init();
-	Networking::createInstance();
-	PlatformUtils::ignoreUnixSignals();
-	OpenSSL::init();
-	TLSSocket::initTLS();
+		LatencySamples samples;
+		for(size_t i=0; i<group_threads.size(); ++i)
+			samples.append(group_threads[i]->samples);
+		for(size_t i=0; i<voice_receiver_threads.size(); ++i)
+			samples.append(voice_receiver_threads[i]->samples);
+
+		for(int i=0; i<NUM_LATENCY_TYPES; ++i)
+			results.latency_summaries[i] = samples.computeSummary((LatencyType)i);
 
+		results.server_hostname = config.server_hostname;
+		results.world_names = world_names;
+		results.num_bots = num_bots;
+		results.edit_fraction = edit_fraction;
+		results.download_fraction = download_fraction;
+		results.voice_fraction = voice_fraction;
 
-	// Create and init TLS client config
-	struct tls_config* client_tls_config = tls_config_new();
-	if(!client_tls_config)
-		throw glare::Exception("Failed to initialise TLS (tls_config_new failed)");
-	tls_config_insecure_noverifycert(client_tls_config); // TODO: Fix this, check cert etc..
-	tls_config_insecure_noverifyname(client_tls_config);
+		conPrint("");
+		conPrint(results.toString());
 
+		FileUtils::writeEntireFileTextMode(output_path, results.toJSON());
+		conPrint("Wrote results to '" + output_path + "'.");
 
-	const int NUM_THREADS = 300;
-	std::vector<Reference<StressTestBotThread>> threads;
-	for(int i=0; i<NUM_THREADS; ++i)
+		tls_config_free(client_tls_config);
+	}
+	catch(ArgumentParserExcep& e)
 	{
-		Reference<StressTestBotThread> t = new StressTestBotThread();
-		t->client_tls_config = client_tls_config;
-		t->seed = i;
-		t->launch();
-		threads.push_back(t);
+		stdErrPrint("ArgumentParserExcep: " + e.what());
+		return 1;
 	}
-
-	while(1)
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		stdErrPrint("FileUtilsExcep: " + e.what());
+		return 1;
+	}
+	catch(MySocketExcep& e)
+	{
+		stdErrPrint("MySocketExcep: " + e.what());
+		return 1;
+	}
+	catch(glare::Exception& e)
 	{
-		PlatformUtils::Sleep(100);
+		stdErrPrint("glare::Exception: " + e.what());
+		return 1;
 	}
-	//while(1) // While stress-test bot should keep running:
-	//{
-	//	
-	//} // End while screenshot bot should keep running:
 
 	return 0;
 }
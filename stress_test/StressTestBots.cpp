@@ -0,0 +1,753 @@
+/*=====================================================================
+StressTestBots.cpp
+------------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#include "StressTestBots.h"
+
+
+#include "../shared/Protocol.h"
+#include "../shared/Avatar.h"
+#include "../shared/WorldObject.h"
+#include "../shared/MessageUtils.h"
+#include "../shared/CompressedMessages.h"
+#include <networking/TLSSocket.h>
+#include <networking/MySocket.h>
+#include <maths/mathstypes.h>
+#include <PlatformUtils.h>
+#include <Clock.h>
+#include <ConPrint.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <cstring>
+#include <limits>
+
+
+static const int server_UDP_port = 7601;
+
+static const double TICK_PERIOD = 0.005; // Bot sockets are polled at least this often, so this is roughly the resolution of the latencies measured.
+static const int MAX_MSGS_PER_BOT_PER_TICK = 256; // So a bot receiving a large initial world state doesn't hold up the other bots in its group for too long.
+static const uint32 MAX_MSG_LEN = 1000000;
+static const size_t MAX_RESOURCE_URLS_PER_BOT = 1024;
+static const uint64 MAX_DOWNLOAD_FILE_SIZE = 1000000000;
+static const double DISCOVERY_PACKET_PERIOD = 2.0; // Same as the client: the server learns which UDP port to send voice to from these packets.
+
+static const std::string bot_password = "stress_test_bot_password";
+
+
+StressTestBot::StressTestBot(int index_, uint64 seed)
+:	index(index_),
+	does_object_edits(false),
+	does_downloads(false),
+	does_voice(false),
+	state(State_SigningUp),
+	rng(seed),
+	last_think_time(0),
+	next_heading_change_time(0),
+	login_send_time(0),
+	query_send_time(0),
+	next_avatar_update_time(0),
+	last_sent_avatar_pos(std::numeric_limits<double>::infinity()),
+	last_sent_avatar_time(0),
+	create_send_time(-1),
+	object_uid(UID::invalidUID()),
+	next_edit_time(0),
+	last_sent_edit_pos(std::numeric_limits<double>::infinity()),
+	last_sent_edit_time(0),
+	voice_seq_num(0),
+	next_voice_time(0),
+	next_discovery_packet_time(0)
+{
+	username = "stress_test_bot_" + toString(index);
+	object_tag = "stress_test_bot_" + toString(index) + "_object";
+}
+
+
+// Reads the server's response to the hello and protocol version sent by the client.
+static void readHandshakeResponse(SocketInterface& socket)
+{
+	const uint32 hello_response = socket.readUInt32();
+	if(hello_response != Protocol::CyberspaceHello)
+		throw glare::Exception("Invalid hello from server: " + toString(hello_response));
+
+	const uint32 protocol_response = socket.readUInt32();
+	if(protocol_response == Protocol::ClientProtocolTooOld || protocol_response == Protocol::ClientProtocolTooNew)
+	{
+		const std::string msg = socket.readStringLengthFirst(10000);
+		throw glare::Exception(msg);
+	}
+	else if(protocol_response != Protocol::ClientProtocolOK)
+		throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
+
+	socket.readUInt32(); // Read server protocol version
+}
+
+
+StressTestBotGroupThread::StressTestBotGroupThread(const StressTestConfig& config_, StressTestSharedState* shared_state_, struct tls_config* client_tls_config_, const IPAddress& server_ip_addr_)
+:	config(config_),
+	shared_state(shared_state_),
+	client_tls_config(client_tls_config_),
+	server_ip_addr(server_ip_addr_),
+	scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder)
+{
+}
+
+
+void StressTestBotGroupThread::kill()
+{
+	die = 1;
+}
+
+
+void StressTestBotGroupThread::sendPacket(SocketInterface& socket)
+{
+	MessageUtils::updatePacketLengthField(scratch_packet);
+	socket.writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+
+	local_counters.num_msgs_sent++;
+	local_counters.num_bytes_sent += scratch_packet.buf.size();
+}
+
+
+void StressTestBotGroupThread::connectBot(StressTestBot& bot)
+{
+	const double connect_start_time = Clock::getCurTimeRealSec();
+
+	MySocketRef plain_socket = new MySocket();
+	plain_socket->setUseNetworkByteOrder(false);
+	plain_socket->connect(config.server_hostname, config.server_port);
+
+	bot.socket = new TLSSocket(plain_socket, client_tls_config, config.server_hostname);
+
+	bot.socket->writeUInt32(Protocol::CyberspaceHello);
+	bot.socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
+	bot.socket->writeUInt32(Protocol::ConnectionTypeUpdates);
+	bot.socket->writeStringLengthFirst(bot.world_name);
+
+	readHandshakeResponse(*bot.socket);
+
+	bot.avatar_uid = readUIDFromStream(*bot.socket);
+
+	samples.add(Latency_Connect, Clock::getCurTimeRealSec() - connect_start_time);
+
+	// Start at a random position in the area
+	bot.home_pos = Vec3d((bot.rng.unitRandom() - 0.5) * config.area_width, (bot.rng.unitRandom() - 0.5) * config.area_width, 1.67);
+	bot.pos = bot.home_pos;
+	bot.angles = Vec3f(0, Maths::pi_2<float>(), 0);
+	bot.vel = Vec3d(0.0);
+
+	// Send CreateAvatar packet for this bot's avatar
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::CreateAvatar);
+
+		Avatar avatar;
+		avatar.uid = bot.avatar_uid;
+		avatar.pos = bot.pos;
+		avatar.rotation = bot.angles;
+		writeToNetworkStream(avatar, scratch_packet);
+
+		sendPacket(*bot.socket);
+	}
+
+	// Sign up.  If the user already exists from a previous run, the server sends back an error message instead, and we just log in.
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::SignUpMessage);
+		scratch_packet.writeStringLengthFirst(bot.username);
+		scratch_packet.writeStringLengthFirst(bot.username + "@example.com");
+		scratch_packet.writeStringLengthFirst(bot_password);
+
+		sendPacket(*bot.socket);
+	}
+
+	bot.state = StressTestBot::State_SigningUp;
+}
+
+
+void StressTestBotGroupThread::handleMessage(StressTestBot& bot, uint32 msg_type)
+{
+	const double cur_time = Clock::getCurTimeRealSec();
+	const bool measuring = shared_state->measuring;
+
+	switch(msg_type)
+	{
+	case Protocol::SignedUpMessageID:
+	case Protocol::ErrorMessageID:
+		{
+			if(bot.state == StressTestBot::State_SigningUp)
+			{
+				// Either we signed up, or the user already existed.  Log in either way, so that login latency is measured the same way on every run.
+				MessageUtils::initPacket(scratch_packet, Protocol::LogInMessage);
+				scratch_packet.writeStringLengthFirst(bot.username);
+				scratch_packet.writeStringLengthFirst(bot_password);
+				sendPacket(*bot.socket);
+
+				bot.login_send_time = cur_time;
+				bot.state = StressTestBot::State_LoggingIn;
+			}
+			else if(msg_type == Protocol::ErrorMessageID)
+			{
+				const std::string msg = msg_buffer.readStringLengthFirst(10000);
+				if(bot.state == StressTestBot::State_LoggingIn)
+					throw glare::Exception("Login failed: " + msg);
+				conPrint("Bot " + toString(bot.index) + ": error from server: " + msg);
+			}
+			break;
+		}
+	case Protocol::LoggedInMessageID:
+		{
+			bot.user_id = readUserIDFromStream(msg_buffer);
+
+			if(bot.state == StressTestBot::State_LoggingIn)
+			{
+				samples.add(Latency_Login, cur_time - bot.login_send_time);
+
+				// Query the objects around us, like the client does when it connects.
+				MessageUtils::initPacket(scratch_packet, Protocol::QueryObjectsInAABB);
+				writeToStream<double>(bot.pos, scratch_packet); // Camera position
+				scratch_packet.writeFloat((float)(bot.pos.x - config.query_radius));
+				scratch_packet.writeFloat((float)(bot.pos.y - config.query_radius));
+				scratch_packet.writeFloat((float)(bot.pos.z - config.query_radius));
+				scratch_packet.writeFloat((float)(bot.pos.x + config.query_radius));
+				scratch_packet.writeFloat((float)(bot.pos.y + config.query_radius));
+				scratch_packet.writeFloat((float)(bot.pos.z + config.query_radius));
+				sendPacket(*bot.socket);
+
+				// There is no message marking the end of the query results, but the server handles the messages from a client in order,
+				// so query zero map tiles, and take the MapTilesResult reply to mean all the ObjectInitialSend messages have been received.
+				MessageUtils::initPacket(scratch_packet, Protocol::QueryMapTiles);
+				scratch_packet.writeUInt32(0); // Num tiles
+				sendPacket(*bot.socket);
+
+				bot.query_send_time = cur_time;
+				bot.state = StressTestBot::State_Querying;
+
+				if(bot.does_voice)
+				{
+					MessageUtils::initPacket(scratch_packet, Protocol::ClientUDPSocketOpen);
+					scratch_packet.writeUInt32(0); // Local UDP port, unused.
+					sendPacket(*bot.socket);
+				}
+			}
+			break;
+		}
+	case Protocol::ObjectInitialSend:
+		{
+			if(bot.does_downloads && (bot.resource_URLs.size() < MAX_RESOURCE_URLS_PER_BOT))
+			{
+				WorldObject ob;
+				ob.uid = readUIDFromStream(msg_buffer);
+				readWorldObjectFromNetworkStreamGivenUID(msg_buffer, ob);
+				if(!ob.model_url.empty())
+					bot.resource_URLs.push_back(ob.model_url);
+			}
+			break;
+		}
+	case Protocol::MapTilesResult:
+		{
+			if(bot.state == StressTestBot::State_Querying)
+			{
+				samples.add(Latency_InitialQuery, cur_time - bot.query_send_time);
+
+				bot.state = StressTestBot::State_Running;
+				bot.last_think_time = cur_time;
+				shared_state->num_bots_ready++;
+
+				if(bot.does_downloads && !bot.resource_URLs.empty())
+					startResourceDownloads(bot);
+
+				if(bot.does_object_edits)
+				{
+					WorldObject ob;
+					ob.uid = UID::invalidUID(); // Dummy UID, the server assigns one.
+					ob.object_type = WorldObject::ObjectType_Hypercard; // Hypercards don't reference any resources, so the server doesn't need to process anything for them.
+					ob.content = bot.object_tag;
+					ob.pos = bot.home_pos;
+					ob.axis = Vec3f(0, 0, 1);
+					ob.angle = 0;
+					ob.scale = Vec3f(1.f);
+
+					MessageUtils::initPacket(scratch_packet, Protocol::CreateObject);
+					ob.writeToNetworkStream(scratch_packet);
+					sendPacket(*bot.socket);
+
+					bot.create_send_time = cur_time;
+				}
+			}
+			break;
+		}
+	case Protocol::AvatarTransformUpdate:
+		{
+			const UID avatar_uid = readUIDFromStream(msg_buffer);
+			const Vec3d pos = readVec3FromStream<double>(msg_buffer);
+
+			// If this is the broadcast of our last transform update, record the latency.
+			if(avatar_uid == bot.avatar_uid && pos == bot.last_sent_avatar_pos)
+			{
+				if(measuring)
+					samples.add(Latency_AvatarUpdate, cur_time - bot.last_sent_avatar_time);
+				bot.last_sent_avatar_pos = Vec3d(std::numeric_limits<double>::infinity());
+			}
+			break;
+		}
+	case Protocol::QuantizedTransformUpdates:
+		{
+			QuantizedTransformUpdates::readUpdates(msg_buffer, quantized_updates);
+
+			for(size_t i=0; i<quantized_updates.size(); ++i)
+				if(quantized_updates[i].type == QuantizedTransformUpdate::Type_AvatarTransform && UID(quantized_updates[i].uid) == bot.avatar_uid &&
+					QuantizedTransformUpdates::getPos(quantized_updates[i]).getDist(bot.last_sent_avatar_pos) <= QuantizedTransformUpdates::POS_QUANTUM)
+				{
+					if(measuring)
+						samples.add(Latency_AvatarUpdate, cur_time - bot.last_sent_avatar_time);
+					bot.last_sent_avatar_pos = Vec3d(std::numeric_limits<double>::infinity());
+				}
+			break;
+		}
+	case Protocol::ObjectCreated:
+		{
+			if(bot.create_send_time >= 0)
+			{
+				WorldObject ob;
+				ob.uid = readUIDFromStream(msg_buffer);
+				readWorldObjectFromNetworkStreamGivenUID(msg_buffer, ob);
+				if(ob.content == bot.object_tag)
+				{
+					samples.add(Latency_ObjectCreate, cur_time - bot.create_send_time);
+					bot.object_uid = ob.uid;
+					bot.create_send_time = -1;
+					bot.next_edit_time = cur_time + bot.rng.unitRandom() * config.edit_period; // Spread edits from different bots out over time.
+				}
+			}
+			break;
+		}
+	case Protocol::ObjectTransformUpdate:
+		{
+			if(bot.object_uid.valid() && bot.last_sent_edit_pos.isFinite())
+			{
+				const UID object_uid = readUIDFromStream(msg_buffer);
+				const Vec3d pos = readVec3FromStream<double>(msg_buffer);
+
+				if(object_uid == bot.object_uid && pos == bot.last_sent_edit_pos)
+				{
+					if(measuring)
+						samples.add(Latency_ObjectEdit, cur_time - bot.last_sent_edit_time);
+					bot.last_sent_edit_pos = Vec3d(std::numeric_limits<double>::infinity());
+				}
+			}
+			break;
+		}
+	}
+}
+
+
+void StressTestBotGroupThread::updateBot(StressTestBot& bot, double cur_time)
+{
+	if(bot.state != StressTestBot::State_Running)
+		return;
+
+	// Change heading to a random value every couple of seconds, heading back towards home if we have wandered too far away, so that bots stay in each other's area of interest.
+	if(cur_time >= bot.next_heading_change_time)
+	{
+		float heading = bot.rng.unitRandom() * Maths::get2Pi<float>();
+		if(bot.pos.getDist(bot.home_pos) > 20.0)
+			heading = (float)std::atan2(bot.home_pos.y - bot.pos.y, bot.home_pos.x - bot.pos.x);
+
+		bot.angles = Vec3f(0, Maths::pi_2<float>(), heading);
+		bot.vel = Vec3d(std::cos(heading), std::sin(heading), 0) * 2;
+		bot.next_heading_change_time = cur_time + 2.0;
+	}
+
+	const double dt = myMin(0.1, cur_time - bot.last_think_time);
+	bot.last_think_time = cur_time;
+	bot.pos += bot.vel * dt;
+
+	if(cur_time >= bot.next_avatar_update_time)
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
+		writeToStream(bot.avatar_uid, scratch_packet);
+		writeToStream(bot.pos, scratch_packet);
+		writeToStream(bot.angles, scratch_packet);
+		scratch_packet.writeUInt32(0); // anim_state
+		sendPacket(*bot.socket);
+
+		bot.last_sent_avatar_pos = bot.pos;
+		bot.last_sent_avatar_time = cur_time;
+		bot.next_avatar_update_time = cur_time + config.avatar_update_period;
+	}
+
+	if(bot.does_object_edits && bot.object_uid.valid() && (cur_time >= bot.next_edit_time))
+	{
+		// Move the object to a new random position near home.
+		const Vec3d new_pos = bot.home_pos + Vec3d(bot.rng.unitRandom() * 4 - 2, bot.rng.unitRandom() * 4 - 2, 0);
+
+		MessageUtils::initPacket(scratch_packet, Protocol::ObjectTransformUpdate);
+		writeToStream(bot.object_uid, scratch_packet);
+		writeToStream(new_pos, scratch_packet);
+		writeToStream(Vec3f(0, 0, 1), scratch_packet); // axis
+		scratch_packet.writeFloat(bot.rng.unitRandom() * Maths::get2Pi<float>()); // angle
+		writeToStream(Vec3f(1.f), scratch_packet); // scale
+		sendPacket(*bot.socket);
+
+		bot.last_sent_edit_pos = new_pos;
+		bot.last_sent_edit_time = cur_time;
+		bot.next_edit_time = cur_time + config.edit_period;
+	}
+
+	if(bot.does_voice && udp_socket.nonNull())
+	{
+		if(cur_time >= bot.next_discovery_packet_time)
+		{
+			scratch_packet.clear();
+			scratch_packet.writeUInt32(2); // Packet type
+			writeToStream(bot.avatar_uid, scratch_packet);
+			udp_socket->sendPacket(scratch_packet.buf.data(), scratch_packet.buf.size(), server_ip_addr, server_UDP_port);
+
+			bot.next_discovery_packet_time = cur_time + DISCOVERY_PACKET_PERIOD;
+		}
+
+		if(cur_time >= bot.next_voice_time)
+		{
+			// Voice packet: type, lower 32 bits of avatar UID, sequence number, then the encoded audio.
+			// In place of the encoded audio we send the send time, for VoiceReceiverThread to measure latency, padded to a typical Opus frame size.
+			scratch_packet.clear();
+			scratch_packet.writeUInt32(1); // Packet type
+			scratch_packet.writeUInt32((uint32)bot.avatar_uid.value());
+			scratch_packet.writeUInt32(bot.voice_seq_num++);
+			scratch_packet.writeDouble(cur_time);
+			const size_t header_size = scratch_packet.buf.size();
+			if(header_size < (size_t)config.voice_packet_size)
+			{
+				scratch_packet.buf.resize(config.voice_packet_size);
+				std::memset(&scratch_packet.buf[header_size], 0, config.voice_packet_size - header_size);
+			}
+			udp_socket->sendPacket(scratch_packet.buf.data(), scratch_packet.buf.size(), server_ip_addr, server_UDP_port);
+
+			local_counters.num_msgs_sent++;
+			local_counters.num_bytes_sent += scratch_packet.buf.size();
+			bot.next_voice_time = cur_time + config.voice_period;
+		}
+	}
+}
+
+
+void StressTestBotGroupThread::startResourceDownloads(StressTestBot& bot)
+{
+	Reference<ResourceDownloadThread> download_thread = new ResourceDownloadThread(config, shared_state, client_tls_config, bot.index, bot.resource_URLs, /*seed=*/bot.rng.nextUInt(std::numeric_limits<uint32>::max()));
+	download_threads.push_back(download_thread);
+	download_thread_manager.addThread(download_thread);
+
+	bot.resource_URLs.clear();
+}
+
+
+void StressTestBotGroupThread::disconnectBot(StressTestBot& bot)
+{
+	if(bot.socket.nonNull())
+	{
+		// Remove the object we created, so repeated runs don't fill the world with bot objects.
+		if(bot.object_uid.valid())
+		{
+			MessageUtils::initPacket(scratch_packet, Protocol::DestroyObject);
+			writeToStream(bot.object_uid, scratch_packet);
+			sendPacket(*bot.socket);
+		}
+
+		MessageUtils::initPacket(scratch_packet, Protocol::CyberspaceGoodbye);
+		sendPacket(*bot.socket);
+		bot.socket->startGracefulShutdown();
+		bot.socket = NULL;
+	}
+}
+
+
+void StressTestBotGroupThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("StressTestBotGroupThread");
+
+	for(size_t i=0; (i<bots.size()) && (die == 0); ++i)
+	{
+		StressTestBot& bot = *bots[i];
+		try
+		{
+			connectBot(bot);
+		}
+		catch(MySocketExcep& e)
+		{
+			conPrint("Bot " + toString(bot.index) + ": failed to connect: " + e.what());
+			bot.state = StressTestBot::State_Failed;
+			shared_state->num_bots_failed++;
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("Bot " + toString(bot.index) + ": failed to connect: " + e.what());
+			bot.state = StressTestBot::State_Failed;
+			shared_state->num_bots_failed++;
+		}
+		local_counters.flushTo(shared_state->counters);
+	}
+
+	while(die == 0)
+	{
+		const double tick_start_time = Clock::getCurTimeRealSec();
+
+		for(size_t i=0; i<bots.size(); ++i)
+		{
+			StressTestBot& bot = *bots[i];
+			if(bot.state == StressTestBot::State_Failed)
+				continue;
+
+			try
+			{
+				for(int z=0; (z < MAX_MSGS_PER_BOT_PER_TICK) && bot.socket->readable(/*timeout_s=*/0.0); ++z)
+				{
+					// Read msg type and length
+					uint32 msg_type_and_len[2];
+					bot.socket->readData(msg_type_and_len, sizeof(uint32) * 2);
+					const uint32 msg_type = msg_type_and_len[0];
+					const uint32 msg_len = msg_type_and_len[1];
+					if((msg_len < sizeof(uint32) * 2) || (msg_len > MAX_MSG_LEN))
+						throw glare::Exception("Invalid message size: " + toString(msg_len));
+
+					// Read rest of message
+					msg_buffer.buf.resizeNoCopy(msg_len);
+					msg_buffer.read_index = sizeof(uint32) * 2;
+					bot.socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2);
+
+					local_counters.num_msgs_received++;
+					local_counters.num_bytes_received += msg_len;
+
+					if(msg_type == Protocol::CompressedMessages)
+					{
+						CompressedMessages::decompressMessages(msg_buffer, decompressed_msgs);
+						size_t offset = 0;
+						while(offset < decompressed_msgs.size())
+						{
+							const uint32 inner_msg_type = CompressedMessages::readNextMessage(decompressed_msgs, offset, msg_buffer);
+							handleMessage(bot, inner_msg_type);
+						}
+					}
+					else
+						handleMessage(bot, msg_type);
+				}
+
+				updateBot(bot, Clock::getCurTimeRealSec());
+			}
+			catch(MySocketExcep& e)
+			{
+				conPrint("Bot " + toString(bot.index) + ": socket error: " + e.what());
+				bot.state = StressTestBot::State_Failed;
+				shared_state->num_bots_failed++;
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("Bot " + toString(bot.index) + ": error: " + e.what());
+				bot.state = StressTestBot::State_Failed;
+				shared_state->num_bots_failed++;
+			}
+		}
+
+		local_counters.flushTo(shared_state->counters);
+
+		const double tick_time = Clock::getCurTimeRealSec() - tick_start_time;
+		if(tick_time < TICK_PERIOD)
+			PlatformUtils::Sleep(myMax(1, (int)((TICK_PERIOD - tick_time) * 1000)));
+	}
+
+	for(size_t i=0; i<bots.size(); ++i)
+	{
+		try
+		{
+			disconnectBot(*bots[i]);
+		}
+		catch(MySocketExcep&)
+		{}
+		catch(glare::Exception&)
+		{}
+	}
+	local_counters.flushTo(shared_state->counters);
+
+	// Wait for the download threads to finish any download in progress, and merge in their latency samples.
+	download_thread_manager.killThreadsBlocking();
+	for(size_t i=0; i<download_threads.size(); ++i)
+		samples.append(download_threads[i]->samples);
+	download_threads.clear();
+}
+
+
+ResourceDownloadThread::ResourceDownloadThread(const StressTestConfig& config_, StressTestSharedState* shared_state_, struct tls_config* client_tls_config_, int bot_index_,
+	const std::vector<std::string>& resource_URLs_, uint64 seed)
+:	config(config_),
+	shared_state(shared_state_),
+	client_tls_config(client_tls_config_),
+	bot_index(bot_index_),
+	resource_URLs(resource_URLs_),
+	rng(seed)
+{
+}
+
+
+void ResourceDownloadThread::kill()
+{
+	die = 1;
+}
+
+
+void ResourceDownloadThread::doResourceDownload(SocketInterface& socket)
+{
+	const size_t num_files = myMin<size_t>(config.max_files_per_download, resource_URLs.size());
+
+	const double start_time = Clock::getCurTimeRealSec();
+
+	socket.writeUInt32(Protocol::GetFiles);
+	socket.writeUInt64(num_files);
+	local_counters.num_bytes_sent += sizeof(uint32) + sizeof(uint64);
+	for(size_t i=0; i<num_files; ++i)
+	{
+		const std::string& URL = resource_URLs[rng.nextUInt((uint32)resource_URLs.size())];
+		socket.writeStringLengthFirst(URL);
+		local_counters.num_bytes_sent += sizeof(uint32) + URL.size();
+	}
+	local_counters.num_msgs_sent++;
+
+	download_buf.resize(64 * 1024);
+	for(size_t i=0; i<num_files; ++i)
+	{
+		const uint32 result = socket.readUInt32();
+		local_counters.num_bytes_received += sizeof(uint32);
+		if(result == 0) // If OK:
+		{
+			const uint64 file_len = socket.readUInt64();
+			if(file_len > MAX_DOWNLOAD_FILE_SIZE)
+				throw glare::Exception("Downloaded file too large (len=" + toString(file_len) + ").");
+
+			for(uint64 received = 0; received < file_len; )
+			{
+				const size_t chunk_size = (size_t)myMin<uint64>(file_len - received, download_buf.size());
+				socket.readData(download_buf.data(), chunk_size);
+				received += chunk_size;
+			}
+
+			local_counters.num_bytes_received += sizeof(uint64) + file_len;
+			local_counters.num_resource_bytes_received += file_len;
+		}
+	}
+	local_counters.num_msgs_received++;
+
+	if(shared_state->measuring)
+		samples.add(Latency_ResourceDownload, Clock::getCurTimeRealSec() - start_time);
+}
+
+
+void ResourceDownloadThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("ResourceDownloadThread");
+
+	SocketInterfaceRef socket;
+	try
+	{
+		MySocketRef plain_socket = new MySocket();
+		plain_socket->setUseNetworkByteOrder(false);
+		plain_socket->connect(config.server_hostname, config.server_port);
+
+		socket = new TLSSocket(plain_socket, client_tls_config, config.server_hostname);
+
+		socket->writeUInt32(Protocol::CyberspaceHello);
+		socket->writeUInt32(Protocol::CyberspaceProtocolVersion);
+		socket->writeUInt32(Protocol::ConnectionTypeDownloadResources);
+
+		readHandshakeResponse(*socket);
+
+		double next_download_time = Clock::getCurTimeRealSec();
+		while(die == 0)
+		{
+			const double cur_time = Clock::getCurTimeRealSec();
+			if(cur_time >= next_download_time)
+			{
+				doResourceDownload(*socket);
+				local_counters.flushTo(shared_state->counters);
+
+				next_download_time = Clock::getCurTimeRealSec() + config.download_period;
+			}
+			else
+				PlatformUtils::Sleep(myMax(1, myMin(100, (int)((next_download_time - cur_time) * 1000)))); // Wake up at least every 100 ms to check die.
+		}
+
+		socket->writeUInt32(Protocol::CyberspaceGoodbye);
+		socket->startGracefulShutdown();
+	}
+	catch(MySocketExcep& e)
+	{
+		if(die == 0)
+			conPrint("Bot " + toString(bot_index) + ": resource download socket error: " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		if(die == 0)
+			conPrint("Bot " + toString(bot_index) + ": resource download error: " + e.what());
+	}
+	local_counters.flushTo(shared_state->counters);
+}
+
+
+VoiceReceiverThread::VoiceReceiverThread(Reference<UDPSocket> udp_socket_, StressTestSharedState* shared_state_)
+:	udp_socket(udp_socket_),
+	shared_state(shared_state_)
+{
+}
+
+
+void VoiceReceiverThread::kill()
+{
+	die = 1;
+
+	// Send a (zero-length) packet to our own socket, so that it returns from the blocking readPacket() call.
+	try
+	{
+		udp_socket->sendPacket(NULL, 0, IPAddress("127.0.0.1"), udp_socket->getThisEndPort());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("VoiceReceiverThread: Sending packet to own socket failed: " + e.what());
+	}
+}
+
+
+void VoiceReceiverThread::doRun()
+{
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("VoiceReceiverThread");
+
+	try
+	{
+		std::vector<uint8> packet_buf(4096);
+
+		while(die == 0)
+		{
+			IPAddress sender_ip_addr;
+			int sender_port;
+			const size_t packet_len = udp_socket->readPacket(packet_buf.data(), packet_buf.size(), sender_ip_addr, sender_port);
+
+			uint32 type;
+			if(packet_len >= sizeof(uint32) * 3 + sizeof(double))
+			{
+				std::memcpy(&type, packet_buf.data(), sizeof(uint32));
+				if(type == 1) // Voice packet
+				{
+					double send_time;
+					std::memcpy(&send_time, packet_buf.data() + sizeof(uint32) * 3, sizeof(double));
+
+					if(shared_state->measuring)
+						samples.add(Latency_Voice, Clock::getCurTimeRealSec() - send_time);
+
+					shared_state->counters.num_msgs_received++;
+					shared_state->counters.num_bytes_received += packet_len;
+					shared_state->counters.num_voice_packets_received++;
+				}
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		if(die == 0)
+			conPrint("VoiceReceiverThread: error: " + e.what());
+	}
+}
@@ -0,0 +1,231 @@
+/*=====================================================================
+StressTestBots.h
+----------------
+Copyright Glare Technologies Limited 2023 -
+=====================================================================*/
+#pragma once
+
+
+#include "BenchmarkStats.h"
+#include "../shared/UID.h"
+#include "../shared/UserID.h"
+#include "../shared/QuantizedTransformUpdates.h"
+#include <MessageableThread.h>
+#include <ThreadManager.h>
+#include <AtomicInt.h>
+#include <SocketInterface.h>
+#include <UDPSocket.h>
+#include <IPAddress.h>
+#include <BufferInStream.h>
+#include <SocketBufferOutStream.h>
+#include <RefCounted.h>
+#include <Reference.h>
+#include <maths/vec3.h>
+#include <maths/PCG32.h>
+#include <atomic>
+#include <string>
+#include <vector>
+struct tls_config;
+
+
+struct StressTestConfig
+{
+	std::string server_hostname;
+	int server_port;
+
+	double area_width; // Bots are placed uniformly at random in a square of this width, centred on the origin.
+	double query_radius; // Half-width of the AABB bots query objects in when they connect.
+
+	double avatar_update_period; // Seconds between AvatarTransformUpdate messages.
+	double edit_period; // Seconds between object edits, for bots doing object edits.
+	double download_period; // Seconds between GetFiles requests, for bots downloading resources.
+	int max_files_per_download; // Max number of files requested in each GetFiles request.
+	double voice_period; // Seconds between voice packets, for bots sending voice.
+	int voice_packet_size;
+};
+
+
+// State shared between all the bot threads and the main thread.
+struct StressTestSharedState
+{
+	StressTestSharedState() : num_bots_ready(0), num_bots_failed(0), measuring(false) {}
+
+	BenchmarkCounters counters;
+	std::atomic<int> num_bots_ready; // Number of bots that have connected, logged in and received the results of their initial query.
+	std::atomic<int> num_bots_failed;
+	std::atomic<bool> measuring; // Latencies of steady-state requests (avatar updates, edits etc.) are only recorded while this is set.
+};
+
+
+/*=====================================================================
+StressTestBot
+-------------
+A simulated client.  All bots connect, log in (signing up first if needed), query the objects around them with
+QueryObjectsInAABB, and then walk around sending avatar transform updates.
+Some bots additionally create and edit an object, download resources, or send voice packets over UDP.
+=====================================================================*/
+class StressTestBot : public RefCounted
+{
+public:
+	StressTestBot(int index, uint64 seed);
+
+	enum State
+	{
+		State_SigningUp,
+		State_LoggingIn,
+		State_Querying,
+		State_Running,
+		State_Failed
+	};
+
+	int index;
+	std::string world_name;
+	bool does_object_edits;
+	bool does_downloads;
+	bool does_voice;
+
+	State state;
+	SocketInterfaceRef socket;
+	UID avatar_uid;
+	UserID user_id;
+	std::string username;
+
+	PCG32 rng;
+	Vec3d home_pos;
+	Vec3d pos;
+	Vec3d vel;
+	Vec3f angles;
+	double last_think_time;
+	double next_heading_change_time;
+
+	double login_send_time;
+	double query_send_time;
+
+	double next_avatar_update_time;
+	Vec3d last_sent_avatar_pos; // Position sent in the last AvatarTransformUpdate that hasn't been broadcast back yet, or infinity if none.
+	double last_sent_avatar_time;
+
+	// Object edits
+	std::string object_tag; // Unique content string, used to recognise the ObjectCreated broadcast for our own object.
+	double create_send_time; // Time CreateObject was sent, or -1 if there is no create in flight.
+	UID object_uid;
+	double next_edit_time;
+	Vec3d last_sent_edit_pos; // Infinity if no edit in flight.
+	double last_sent_edit_time;
+
+	// Resource downloads
+	std::vector<std::string> resource_URLs; // Model URLs of objects received in the initial query.  Handed over to a ResourceDownloadThread once the query has finished.
+
+	// Voice
+	uint32 voice_seq_num;
+	double next_voice_time;
+	double next_discovery_packet_time;
+};
+typedef Reference<StressTestBot> StressTestBotRef;
+
+
+/*=====================================================================
+ResourceDownloadThread
+----------------------
+Downloads resources for a single bot over its own resource download connection, sending a GetFiles request
+for a few random resources from the bot's initial query every download_period seconds,
+and recording the time from sending the request until all the files have been received.
+=====================================================================*/
+class ResourceDownloadThread : public MessageableThread
+{
+public:
+	ResourceDownloadThread(const StressTestConfig& config, StressTestSharedState* shared_state, struct tls_config* client_tls_config, int bot_index,
+		const std::vector<std::string>& resource_URLs, uint64 seed);
+
+	virtual void doRun() override;
+
+	virtual void kill() override;
+
+	LatencySamples samples; // Only valid after the thread has finished.
+
+private:
+	void doResourceDownload(SocketInterface& socket);
+
+	StressTestConfig config;
+	StressTestSharedState* shared_state;
+	struct tls_config* client_tls_config;
+	int bot_index;
+	std::vector<std::string> resource_URLs;
+	PCG32 rng;
+	glare::AtomicInt die;
+	LocalCounters local_counters;
+	std::vector<uint8> download_buf;
+};
+
+
+/*=====================================================================
+StressTestBotGroupThread
+------------------------
+Runs a group of bots on one thread, polling the bot sockets, instead of having one thread per bot,
+so that thousands of bots can be run from a single machine.
+
+Resource downloads read whole files with blocking reads, so they are done by a ResourceDownloadThread per downloading bot,
+started by this thread, instead of in the bot's tick, so they don't delay the other bots in the group or add to their latencies.
+=====================================================================*/
+class StressTestBotGroupThread : public MessageableThread
+{
+public:
+	StressTestBotGroupThread(const StressTestConfig& config, StressTestSharedState* shared_state, struct tls_config* client_tls_config, const IPAddress& server_ip_addr);
+
+	virtual void doRun() override;
+
+	virtual void kill() override;
+
+	std::vector<StressTestBotRef> bots;
+
+	Reference<UDPSocket> udp_socket; // Shared by all the voice bots in this group.  NULL if no bots in the group send voice.
+
+	LatencySamples samples; // Only valid after the thread has finished.
+
+private:
+	void connectBot(StressTestBot& bot);
+	void handleMessage(StressTestBot& bot, uint32 msg_type);
+	void updateBot(StressTestBot& bot, double cur_time);
+	void startResourceDownloads(StressTestBot& bot);
+	void disconnectBot(StressTestBot& bot);
+	void sendPacket(SocketInterface& socket);
+
+	StressTestConfig config;
+	StressTestSharedState* shared_state;
+	struct tls_config* client_tls_config;
+	IPAddress server_ip_addr;
+	glare::AtomicInt die;
+	LocalCounters local_counters;
+	BufferInStream msg_buffer;
+	js::Vector<uint8, 16> decompressed_msgs;
+	SocketBufferOutStream scratch_packet;
+	std::vector<QuantizedTransformUpdate> quantized_updates;
+	ThreadManager download_thread_manager;
+	std::vector<Reference<ResourceDownloadThread>> download_threads;
+};
+
+
+/*=====================================================================
+VoiceReceiverThread
+-------------------
+Receives the voice packets relayed by the server to the bots of a group, and records the relay latency
+from the send time written into each packet by the sending bot.
+All the voice bots in a group share a UDP socket, so the server relays each packet to it once per recipient bot.
+=====================================================================*/
+class VoiceReceiverThread : public MessageableThread
+{
+public:
+	VoiceReceiverThread(Reference<UDPSocket> udp_socket, StressTestSharedState* shared_state);
+
+	virtual void doRun() override;
+
+	virtual void kill() override;
+
+	LatencySamples samples; // Only valid after the thread has finished.
+
+private:
+	Reference<UDPSocket> udp_socket;
+	StressTestSharedState* shared_state;
+	glare::AtomicInt die;
+};
+
@@ -46,6 +46,8 @@ void renderUserAccountPage(ServerAllWorldsState& world_state, const web::Request
 
 	{ // lock scope
 		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -75,8 +77,6 @@ void renderUserAccountPage(ServerAllWorldsState& world_state, const web::Request
 
 		page += "<h2>Parcels</h2>\n";
 
-		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
-
 		for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
 		{
 			const Parcel* parcel = it->second.ptr();
@@ -300,6 +300,8 @@ void renderMakeParcelIntoNFTPage(ServerAllWorldsState& world_state, const web::R
 
 	{ // lock scope
 		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -312,8 +314,8 @@ void renderMakeParcelIntoNFTPage(ServerAllWorldsState& world_state, const web::R
 		}
 
 		// Lookup parcel
-		auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-		if(res == world_state.getRootWorldState()->parcels.end())
+		auto res = root_world->parcels.find(parcel_id);
+		if(res == root_world->parcels.end())
 			throw glare::Exception("No such parcel");
 		
 		const Parcel* parcel = res->second.ptr();
@@ -472,6 +474,8 @@ void handleMakeParcelIntoNFTPost(ServerAllWorldsState& world_state, const web::R
 		const ParcelID parcel_id(request_info.getPostIntField("parcel_id"));
 
 		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		if(logged_in_user == NULL)
@@ -486,8 +490,8 @@ void handleMakeParcelIntoNFTPost(ServerAllWorldsState& world_state, const web::R
 			throw glare::Exception("controlled eth address must be valid.");
 
 		// Lookup parcel
-		auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-		if(res == world_state.getRootWorldState()->parcels.end())
+		auto res = root_world->parcels.find(parcel_id);
+		if(res == root_world->parcels.end())
 			throw glare::Exception("No such parcel");
 
 		Parcel* parcel = res->second.ptr();
@@ -514,7 +518,7 @@ void handleMakeParcelIntoNFTPost(ServerAllWorldsState& world_state, const web::R
 		world_state.addSubEthTransactionAsDBDirty(transaction);
 
 		parcel->minting_transaction_id = transaction->id;
-		world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+		root_world->addParcelAsDBDirty(parcel);
 
 		world_state.sub_eth_transactions[transaction->id] = transaction;
 
@@ -552,6 +556,8 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 		parcel_id = ParcelID(request_info.getPostIntField("parcel_id"));
 
 		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		if(logged_in_user == NULL)
@@ -563,8 +569,8 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 		user_controlled_eth_address = logged_in_user->controlled_eth_address;
 
 		// Lookup parcel
-		auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-		if(res == world_state.getRootWorldState()->parcels.end())
+		auto res = root_world->parcels.find(parcel_id);
+		if(res == root_world->parcels.end())
 			throw glare::Exception("No such parcel");
 
 		Parcel* parcel = res->second.ptr();
@@ -604,27 +610,32 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 
 			{ // lock scope
 				Lock lock(world_state.mutex);
+				Reference<ServerWorldState> root_world = world_state.getRootWorldState();
 
 				User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 				if(logged_in_user == NULL)
 					throw glare::Exception("logged_in_user == NULL.");
 
-				// Lookup parcel
-				auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-				if(res == world_state.getRootWorldState()->parcels.end())
-					throw glare::Exception("No such parcel");
+				{
+					Lock root_world_lock(root_world->mutex);
+
+					// Lookup parcel
+					auto res = root_world->parcels.find(parcel_id);
+					if(res == root_world->parcels.end())
+						throw glare::Exception("No such parcel");
 
-				Parcel* parcel = res->second.ptr();
+					Parcel* parcel = res->second.ptr();
 
-				parcel->owner_id = logged_in_user->id;
+					parcel->owner_id = logged_in_user->id;
 
-				// Set parcel admins and writers to the new user as well.
-				parcel->admin_ids  = std::vector<UserID>(1, UserID(logged_in_user->id));
-				parcel->writer_ids = std::vector<UserID>(1, UserID(logged_in_user->id));
+					// Set parcel admins and writers to the new user as well.
+					parcel->admin_ids  = std::vector<UserID>(1, UserID(logged_in_user->id));
+					parcel->writer_ids = std::vector<UserID>(1, UserID(logged_in_user->id));
 				
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+					root_world->addParcelAsDBDirty(parcel);
 
-				// TODO: Log ownership change?
+					// TODO: Log ownership change?
+				} // Release root_world_lock, as denormaliseData() locks each world in turn.
 
 				world_state.denormaliseData();
 				world_state.markAsChanged();
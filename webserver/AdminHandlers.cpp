@@ -13,11 +13,14 @@ Copyright Glare Technologies Limited 2021 -
 #include "WebServerResponseUtils.h"
 #include "LoginHandlers.h"
 #include "../server/ServerWorldState.h"
+#include "../server/Server.h"
+#include "../server/WorkerThread.h"
 #include <ConPrint.h>
 #include <Exception.h>
 #include <Lock.h>
 #include <Parser.h>
 #include <Escaping.h>
+#include <StringUtils.h>
 
 
 namespace AdminHandlers
@@ -29,7 +32,7 @@ std::string sharedAdminHeader(ServerAllWorldsState& world_state, const web::Requ
 	std::string page_out = WebServerResponseUtils::standardHeader(world_state, request_info, /*page title=*/"Admin");
 
 	page_out += "<p><a href=\"/admin\">Main admin page</a> | <a href=\"/admin_users\">Users</a> | <a href=\"/admin_parcels\">Parcels</a> | ";
-	page_out += "<a href=\"/admin_parcel_auctions\">Parcel Auctions</a> | <a href=\"/admin_orders\">Orders</a> | <a href=\"/admin_sub_eth_transactions\">Eth Transactions</a> | <a href=\"/admin_map\">Map</a></p>";
+	page_out += "<a href=\"/admin_parcel_auctions\">Parcel Auctions</a> | <a href=\"/admin_orders\">Orders</a> | <a href=\"/admin_sub_eth_transactions\">Eth Transactions</a> | <a href=\"/admin_map\">Map</a> | <a href=\"/admin_connections\">Connections</a></p>";
 
 	return page_out;
 }
@@ -210,6 +213,8 @@ void renderParcelsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 
 	{ // Lock scope
 		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 		page_out += "<h2>Root world Parcels</h2>\n";
 
@@ -224,9 +229,6 @@ void renderParcelsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 		//-----------------------
 
 
-
-		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
-
 		for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
 		{
 			const Parcel* parcel = it->second.ptr();
@@ -435,6 +437,7 @@ void renderOrdersPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 
 	{ // Lock scope
 		Lock lock(world_state.mutex);
+		Lock orders_lock(world_state.orders_mutex);
 
 		page_out += "<h2>Orders</h2>\n";
 
@@ -662,7 +665,7 @@ void renderMapPage(ServerAllWorldsState& world_state, const web::RequestInfo& re
 	page_out += "</form>";
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		Lock screenshots_lock(world_state.screenshots_mutex);
 
 		page_out += "<h2>Map Info</h2>\n";
 
@@ -683,6 +686,57 @@ void renderMapPage(ServerAllWorldsState& world_state, const web::RequestInfo& re
 }
 
 
+void renderConnectionsPage(Server& server, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	if(!LoginHandlers::loggedInUserHasAdminPrivs(*server.world_state, request))
+	{
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "Access denied sorry.");
+		return;
+	}
+
+	std::string page_out = sharedAdminHeader(*server.world_state, request);
+
+	const UpdateInterestFilterConfig& filter_config = server.config.update_interest_filter_config;
+	page_out += "<h2>Connected clients</h2>\n";
+	page_out += "<p>Transform updates are sent at full rate within " + doubleToStringNSigFigs(filter_config.full_rate_radius, 4) + " m of the client camera, every " + 
+		doubleToStringNSigFigs(filter_config.distant_update_period, 4) + " s up to " + doubleToStringNSigFigs(filter_config.max_radius, 4) + " m, and are dropped beyond that.</p>\n";
+
+	if(server.connection_io_pool.nonNull())
+		page_out += "<p>" + toString(server.connection_io_pool->getNumConnections()) + " updates connection(s) served by the connection IO pool.</p>\n";
+
+	uint64 total_bytes_sent = 0;
+	uint64 total_bytes_saved = 0;
+
+	{ // Lock scope
+		Lock lock(server.world_subscribers_mutex);
+
+		for(auto world_it = server.world_subscribers.begin(); world_it != server.world_subscribers.end(); ++world_it)
+		{
+			page_out += "<h3>World '" + web::Escaping::HTMLEscape(world_it->first) + "': " + toString(world_it->second.size()) + " client(s)</h3>\n";
+
+			for(auto it = world_it->second.begin(); it != world_it->second.end(); ++it)
+			{
+				WorkerThread* worker = *it;
+
+				Vec3d cam_pos;
+				const bool cam_pos_known = worker->getClientCamPos(cam_pos);
+				uint64 bytes_sent, bytes_saved;
+				worker->getBroadcastStats(bytes_sent, bytes_saved);
+				total_bytes_sent += bytes_sent;
+				total_bytes_saved += bytes_saved;
+
+				page_out += "<div>camera position: " + (cam_pos_known ? cam_pos.toString() : std::string("unknown")) + ", broadcast bytes sent: " + getNiceByteSize(bytes_sent) + 
+					", bytes saved by area-of-interest filtering: " + getNiceByteSize(bytes_saved) + "</div>\n";
+			}
+		}
+	} // End Lock scope
+
+	page_out += "<p>Total broadcast bytes sent: " + getNiceByteSize(total_bytes_sent) + ", total bytes saved: " + getNiceByteSize(total_bytes_saved) + "</p>\n";
+
+	web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page_out);
+}
+
+
 void renderAdminOrderPage(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
 	if(!LoginHandlers::loggedInUserHasAdminPrivs(world_state, request))
@@ -705,6 +759,7 @@ void renderAdminOrderPage(ServerAllWorldsState& world_state, const web::RequestI
 
 	{ // Lock scope
 		Lock lock(world_state.mutex);
+		Lock orders_lock(world_state.orders_mutex);
 
 		page_out += "<h2>Order " + toString(order_id) + "</h2>\n";
 
@@ -804,10 +859,13 @@ void createParcelAuctionPost(ServerAllWorldsState& world_state, const web::Reque
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				// Found user for username
 				Parcel* parcel = res->second.ptr();
@@ -872,7 +930,7 @@ void createParcelAuctionPost(ServerAllWorldsState& world_state, const web::Reque
 				parcel->parcel_auction_ids.push_back(auction->id);
 
 				world_state.addParcelAuctionAsDBDirty(auction);
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+				root_world->addParcelAsDBDirty(parcel);
 
 				web::ResponseUtils::writeRedirectTo(reply_info, "/parcel_auction/" + toString(auction->id));
 			}
@@ -915,10 +973,12 @@ void renderSetParcelOwnerPage(ServerAllWorldsState& world_state, const web::Requ
 	{ // Lock scope
 
 		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 		// Lookup parcel
-		const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-		if(res != world_state.getRootWorldState()->parcels.end())
+		const auto res = root_world->parcels.find(parcel_id);
+		if(res != root_world->parcels.end())
 		{
 			// Found user for username
 			Parcel* parcel = res->second.ptr();
@@ -961,21 +1021,31 @@ void handleSetParcelOwnerPost(ServerAllWorldsState& world_state, const web::Requ
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
 
-			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			bool found = false;
 			{
-				// Found user for username
-				Parcel* parcel = res->second.ptr();
+				Lock root_world_lock(root_world->mutex);
+
+				// Lookup parcel
+				const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+				if(res != root_world->parcels.end())
+				{
+					// Found user for username
+					Parcel* parcel = res->second.ptr();
 
-				parcel->owner_id = UserID(new_owner_id);
+					parcel->owner_id = UserID(new_owner_id);
 
-				// Set parcel admins and writers to the new user as well.
-				parcel->admin_ids  = std::vector<UserID>(1, UserID(new_owner_id));
-				parcel->writer_ids = std::vector<UserID>(1, UserID(new_owner_id));
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+					// Set parcel admins and writers to the new user as well.
+					parcel->admin_ids  = std::vector<UserID>(1, UserID(new_owner_id));
+					parcel->writer_ids = std::vector<UserID>(1, UserID(new_owner_id));
+					root_world->addParcelAsDBDirty(parcel);
+					found = true;
+				}
+			} // Release root_world_lock, as denormaliseData() locks each world in turn.
 
+			if(found)
+			{
 				world_state.denormaliseData(); // Update denormalised data which includes parcel owner name
 
 				world_state.markAsChanged();
@@ -1007,10 +1077,12 @@ void handleMarkParcelAsNFTMintedPost(ServerAllWorldsState& world_state, const we
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 				parcel->nft_status = Parcel::NFTStatus_MintedNFT;
@@ -1044,14 +1116,16 @@ void handleMarkParcelAsNotNFTPost(ServerAllWorldsState& world_state, const web::
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 				parcel->nft_status = Parcel::NFTStatus_NotNFT;
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+				root_world->addParcelAsDBDirty(parcel);
 
 				world_state.markAsChanged();
 
@@ -1082,12 +1156,14 @@ void handleRetryParcelMintPost(ServerAllWorldsState& world_state, const web::Req
 
 		{ // Lock scope
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
 
 			User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID((uint32)parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -1116,7 +1192,7 @@ void handleRetryParcelMintPost(ServerAllWorldsState& world_state, const web::Req
 
 				parcel->minting_transaction_id = transaction->id;
 				
-				world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+				root_world->addParcelAsDBDirty(parcel);
 
 				world_state.sub_eth_transactions[transaction->id] = transaction;
 
@@ -1347,6 +1423,9 @@ void handleRegenerateParcelAuctionScreenshots(ServerAllWorldsState& world_state,
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
 			// Lookup parcel auction
 			const auto res = world_state.parcel_auctions.find(parcel_auction_id);
@@ -1355,8 +1434,8 @@ void handleRegenerateParcelAuctionScreenshots(ServerAllWorldsState& world_state,
 				ParcelAuction* auction = res->second.ptr();
 
 				// Lookup parcel
-				const auto res2 = world_state.getRootWorldState()->parcels.find(auction->parcel_id);
-				if(res2 != world_state.getRootWorldState()->parcels.end())
+				const auto res2 = root_world->parcels.find(auction->parcel_id);
+				if(res2 != root_world->parcels.end())
 				{
 					const Parcel* parcel = res2->second.ptr();
 
@@ -1414,10 +1493,13 @@ void handleRegenerateParcelScreenshots(ServerAllWorldsState& world_state, const
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(parcel_id);
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -1478,8 +1560,11 @@ void handleRegenerateMultipleParcelScreenshots(ServerAllWorldsState& world_state
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
-			for(auto it = world_state.getRootWorldState()->parcels.begin(); it != world_state.getRootWorldState()->parcels.end(); ++it)
+			for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
 			{
 				Parcel* parcel = it->second.ptr();
 
@@ -1522,7 +1607,7 @@ void handleRegenerateMultipleParcelScreenshots(ServerAllWorldsState& world_state
 							world_state.addScreenshotAsDBDirty(shot);
 						}
 
-						world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+						root_world->addParcelAsDBDirty(parcel);
 						world_state.markAsChanged();
 
 						conPrint("Created screenshots for parcel " + parcel->id.toString());
@@ -1625,7 +1710,7 @@ void handleRegenMapTilesPost(ServerAllWorldsState& world_state, const web::Reque
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
 			// Mark all tile sceenshots as not done.
 			for(auto it = world_state.map_tile_info.info.begin(); it != world_state.map_tile_info.info.end(); ++it)
@@ -1667,7 +1752,7 @@ void handleRecreateMapTilesPost(ServerAllWorldsState& world_state, const web::Re
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
 			uint64 next_shot_id = world_state.getNextScreenshotUID();
 
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2021 -
 
 
 class ServerAllWorldsState;
+class Server;
 namespace web
 {
 class RequestInfo;
@@ -23,6 +24,8 @@ namespace AdminHandlers
 {
 	void renderMainAdminPage(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
 
+	void renderConnectionsPage(Server& server, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+
 	void renderUsersPage(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
 
 	void renderAdminUserPage(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
@@ -75,7 +75,7 @@ bool loggedInUserHasAdminPrivs(ServerAllWorldsState& world_state, const web::Req
 
 
 // Returns NULL if not logged in as a valid user.
-// ServerAllWorldsState should be locked
+// ServerAllWorldsState should be locked.  Acquires sessions_mutex internally.
 User* getLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo& request_info)
 {
 	for(size_t i=0; i<request_info.cookies.size(); ++i)
@@ -85,20 +85,23 @@ User* getLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo&
 			try
 			{
 				// Lookup session
-				const auto res = world_state.user_web_sessions.find(request_info.cookies[i].value);
-				if(res == world_state.user_web_sessions.end())
-					return NULL; // Session not found
-				else
+				UserID session_user_id;
 				{
-					const UserWebSession* session = res->second.ptr();
-
-					// Lookup user from session
-					const auto user_res = world_state.user_id_to_users.find(session->user_id);
-					if(user_res == world_state.user_id_to_users.end())
-						return NULL; // User not found
-					else
-						return user_res->second.ptr();
+					Lock sessions_lock(world_state.sessions_mutex);
+
+					const auto res = world_state.user_web_sessions.find(request_info.cookies[i].value);
+					if(res == world_state.user_web_sessions.end())
+						return NULL; // Session not found
+
+					session_user_id = res->second->user_id;
 				}
+
+				// Lookup user from session
+				const auto user_res = world_state.user_id_to_users.find(session_user_id);
+				if(user_res == world_state.user_id_to_users.end())
+					return NULL; // User not found
+				else
+					return user_res->second.ptr();
 			}
 			catch(glare::Exception& e)
 			{
@@ -199,6 +202,7 @@ void handleLoginPost(ServerAllWorldsState& world_state, const web::RequestInfo&
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Lock sessions_lock(world_state.sessions_mutex);
 
 			// Lookup user by username
 			const auto res = world_state.name_to_users.find(username.str());
@@ -348,6 +352,7 @@ void handleSignUpPost(ServerAllWorldsState& world_state, const web::RequestInfo&
 
 		{ // Lock scope
 			Lock lock(world_state.mutex);
+			Lock sessions_lock(world_state.sessions_mutex);
 			auto res = world_state.name_to_users.find(username.str()); // Find existing user with username
 			if(res != world_state.name_to_users.end())
 				throw InvalidCredentialsExcep("That username is not available."); // Username already used.
@@ -49,8 +49,9 @@ void renderParcelPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 
 		{ // lock scope
 			Lock lock(world_state.mutex);
-
 			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
 			auto res = root_world->parcels.find(ParcelID(parcel_id));
 			if(res == root_world->parcels.end())
@@ -314,10 +315,12 @@ void renderEditParcelDescriptionPage(ServerAllWorldsState& world_state, const we
 	{ // Lock scope
 
 		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 		// Lookup parcel
-		const auto res = world_state.getRootWorldState()->parcels.find(ParcelID(parcel_id));
-		if(res != world_state.getRootWorldState()->parcels.end())
+		const auto res = root_world->parcels.find(ParcelID(parcel_id));
+		if(res != root_world->parcels.end())
 		{
 			Parcel* parcel = res->second.ptr();
 
@@ -348,6 +351,8 @@ void renderAddParcelWriterPage(ServerAllWorldsState& world_state, const web::Req
 	{ // Lock scope
 
 		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user)
@@ -358,8 +363,8 @@ void renderAddParcelWriterPage(ServerAllWorldsState& world_state, const web::Req
 		}
 
 		// Lookup parcel
-		const auto res = world_state.getRootWorldState()->parcels.find(ParcelID(parcel_id));
-		if(res != world_state.getRootWorldState()->parcels.end())
+		const auto res = root_world->parcels.find(ParcelID(parcel_id));
+		if(res != root_world->parcels.end())
 		{
 			page += "<form action=\"/add_parcel_writer_post\" method=\"post\" id=\"usrform\">";
 			page += "<input type=\"hidden\" name=\"parcel_id\" value=\"" + toString(parcel_id) + "\"><br>";
@@ -387,6 +392,8 @@ void renderRemoveParcelWriterPage(ServerAllWorldsState& world_state, const web::
 	{ // Lock scope
 
 		Lock lock(world_state.mutex);
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user)
@@ -403,8 +410,8 @@ void renderRemoveParcelWriterPage(ServerAllWorldsState& world_state, const web::
 			page += "Are you sure you want to remove the user " + web::Escaping::HTMLEscape(writer_res->second->name) + " as a writer from the parcel?";
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID(parcel_id));
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(ParcelID(parcel_id));
+			if(res != root_world->parcels.end())
 			{
 				page += "<form action=\"/remove_parcel_writer_post\" method=\"post\" id=\"usrform\">";
 				page += "<input type=\"hidden\" name=\"parcel_id\" value=\"" + toString(parcel_id) + "\"><br>";
@@ -444,8 +451,8 @@ void renderMetadata(ServerAllWorldsState& world_state, const web::RequestInfo& r
 
 		{ // lock scope
 			Lock lock(world_state.mutex);
-
 			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
 
 			auto res = root_world->parcels.find(ParcelID(parcel_id));
 			if(res == root_world->parcels.end())
@@ -520,10 +527,13 @@ void handleRegenerateParcelScreenshots(ServerAllWorldsState& world_state, const
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(parcel_id);
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -585,10 +595,12 @@ void handleEditParcelDescriptionPost(ServerAllWorldsState& world_state, const we
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+			Lock root_world_lock(root_world->mutex);
 
 			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			const auto res = root_world->parcels.find(parcel_id);
+			if(res != root_world->parcels.end())
 			{
 				Parcel* parcel = res->second.ptr();
 
@@ -596,7 +608,7 @@ void handleEditParcelDescriptionPost(ServerAllWorldsState& world_state, const we
 				if(logged_in_user && parcel->owner_id == logged_in_user->id) // If the user is logged in and owns this parcel:
 				{
 					parcel->description = new_descrip.str();
-					world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+					root_world->addParcelAsDBDirty(parcel);
 
 					world_state.markAsChanged();
 
@@ -632,50 +644,59 @@ void handleAddParcelWriterPost(ServerAllWorldsState& world_state, const web::Req
 		{ // Lock scope
 
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
 
-			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
+			bool is_owner = false;
 			{
-				Parcel* parcel = res->second.ptr();
+				Lock root_world_lock(root_world->mutex);
 
-				User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
-				if(logged_in_user && parcel->owner_id == logged_in_user->id) // If the user is logged in and owns this parcel:
+				// Lookup parcel
+				const auto res = root_world->parcels.find(parcel_id);
+				if(res != root_world->parcels.end())
 				{
-					// Try and find user for writer_name
-					User* new_writer_user = NULL;
-					for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
-						if(it->second->name == writer_name.str())
-							new_writer_user = it->second.ptr();
+					Parcel* parcel = res->second.ptr();
 
-					if(new_writer_user)
+					if(logged_in_user && parcel->owner_id == logged_in_user->id) // If the user is logged in and owns this parcel:
 					{
-						if(!ContainerUtils::contains(parcel->writer_ids, new_writer_user->id))
+						is_owner = true;
+
+						// Try and find user for writer_name
+						User* new_writer_user = NULL;
+						for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
+							if(it->second->name == writer_name.str())
+								new_writer_user = it->second.ptr();
+
+						if(new_writer_user)
 						{
-							added_writer = true;
-							parcel->writer_ids.push_back(new_writer_user->id);
-							world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
-							message = "Added user as writer.";
+							if(!ContainerUtils::contains(parcel->writer_ids, new_writer_user->id))
+							{
+								added_writer = true;
+								parcel->writer_ids.push_back(new_writer_user->id);
+								root_world->addParcelAsDBDirty(parcel);
+								message = "Added user as writer.";
+							}
+							else
+							{
+								message = "User is already a writer.";
+							}
 						}
 						else
 						{
-							message = "User is already a writer.";
+							message = "Could not find a user with that name.";
 						}
 					}
-					else
-					{
-						message = "Could not find a user with that name.";
-					}
-
-					if(added_writer)
-					{
-						world_state.denormaliseData(); // Update parcel writer names
-						world_state.markAsChanged();
-					}
-
-					world_state.setUserWebMessage(logged_in_user->id, message);
 				}
+			} // Release root_world_lock, as denormaliseData() locks each world in turn.
+
+			if(added_writer)
+			{
+				world_state.denormaliseData(); // Update parcel writer names
+				world_state.markAsChanged();
 			}
+
+			if(is_owner)
+				world_state.setUserWebMessage(logged_in_user->id, message);
 		} // End lock scope
 
 		if(added_writer)
@@ -704,28 +725,39 @@ void handleRemoveParcelWriterPost(ServerAllWorldsState& world_state, const web::
 
 		{ // Lock scope
 			Lock lock(world_state.mutex);
+			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
 
-			// Lookup parcel
-			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
-			if(res != world_state.getRootWorldState()->parcels.end())
+			User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
+			bool is_owner = false;
+			bool removed = false;
 			{
-				Parcel* parcel = res->second.ptr();
+				Lock root_world_lock(root_world->mutex);
 
-				User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
-				if(logged_in_user && parcel->owner_id == logged_in_user->id) // If the user is logged in and owns this parcel:
+				// Lookup parcel
+				const auto res = root_world->parcels.find(parcel_id);
+				if(res != root_world->parcels.end())
 				{
-					const bool removed = ContainerUtils::removeFirst(parcel->writer_ids, writer_id);
-
-					if(removed)
-						world_state.setUserWebMessage(logged_in_user->id, "removed user as writer");
-					else
-						world_state.setUserWebMessage(logged_in_user->id, "User was not a writer.");
+					Parcel* parcel = res->second.ptr();
 
-					world_state.getRootWorldState()->addParcelAsDBDirty(parcel);
+					if(logged_in_user && parcel->owner_id == logged_in_user->id) // If the user is logged in and owns this parcel:
+					{
+						is_owner = true;
+						removed = ContainerUtils::removeFirst(parcel->writer_ids, writer_id);
 
-					world_state.denormaliseData(); // Update parcel writer names
-					world_state.markAsChanged();
+						root_world->addParcelAsDBDirty(parcel);
+					}
 				}
+			} // Release root_world_lock, as denormaliseData() locks each world in turn.
+
+			if(is_owner)
+			{
+				if(removed)
+					world_state.setUserWebMessage(logged_in_user->id, "removed user as writer");
+				else
+					world_state.setUserWebMessage(logged_in_user->id, "User was not a writer.");
+
+				world_state.denormaliseData(); // Update parcel writer names
+				world_state.markAsChanged();
 			}
 		} // End lock scope
 
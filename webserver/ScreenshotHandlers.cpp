@@ -45,7 +45,7 @@ void handleScreenshotRequest(ServerAllWorldsState& world_state, WebDataStore& da
 		// Get screenshot local path
 		std::string local_path;
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
 			auto res = world_state.screenshots.find(screenshot_id);
 			if(res == world_state.screenshots.end())
@@ -87,7 +87,7 @@ void handleMapTileRequest(ServerAllWorldsState& world_state, WebDataStore& datas
 		// Get screenshot local path
 		std::string local_path;
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			Lock screenshots_lock(world_state.screenshots_mutex);
 
 			auto res = world_state.map_tile_info.info.find(Vec3<int>(x, y, z));
 			if(res == world_state.map_tile_info.info.end())
@@ -387,6 +387,10 @@ void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web
 		{
 			AdminHandlers::renderMapPage(*this->world_state, request, reply_info);
 		}
+		else if(request.path == "/admin_connections")
+		{
+			AdminHandlers::renderConnectionsPage(*this->server, request, reply_info);
+		}
 		else if(::hasPrefix(request.path, "/admin_create_parcel_auction/")) // parcel ID follows in URL
 		{
 			AdminHandlers::renderCreateParcelAuction(*this->world_state, request, reply_info);
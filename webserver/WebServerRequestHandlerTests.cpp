@@ -61,7 +61,10 @@ extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv)
 		Reference<UserWebSession> session = new UserWebSession();
 		session->created_time = TimeStamp::currentTime();
 		session->user_id = UserID(0); // Admin user
-		test_world_state->user_web_sessions["AAA"] = session;
+		{
+			Lock lock(test_world_state->sessions_mutex);
+			test_world_state->user_web_sessions["AAA"] = session;
+		}
 
 		test_world_state->server_credentials.creds["coinbase_shared_secret_key"] = "AAA";
 		test_world_state->server_credentials.creds["paypal_sandbox_business_email"] = "AAA";
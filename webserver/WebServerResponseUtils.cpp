@@ -140,8 +140,8 @@ const std::string getMapEmbedCode(ServerAllWorldsState& world_state, ParcelID hi
 
 	{ // lock scope
 		Lock lock(world_state.mutex);
-
-		ServerWorldState* root_world = world_state.getRootWorldState().ptr();
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		Lock root_world_lock(root_world->mutex);
 
 
 		poly_verts.reserve(44 * 4);